@@ -0,0 +1,207 @@
+#!/usr/bin/python
+
+##
+# @file check_rls_cycles.py
+# @brief Counts the cycles of processLine() in rls_m0.c, the M0 assembly that samples the
+#        camera's pixels as they come.  It has no clock to sync to after the line starts, so
+#        every way through the pixel loop must take the same cycles, and the first red
+#        pixel must be sampled half of that after the green one before it.  Follows every
+#        branch from loop_pixel back to it, checks the cycle counts in the comments, and
+#        exits with 1 if anything is off.
+#
+# @copyright Copyright 2021 Matternet. All rights reserved.
+#
+
+import argparse
+import os
+import re
+import sys
+
+
+DEFAULT_SOURCE = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'device',
+                                               'libpixy_m0', 'src', 'rls_m0.c'))
+FUNCTION = 'processLine'
+LOOP = 'loop_pixel'
+EXIT = 'eol'
+SYNC = 'hsyncstart'     # the green pixel is loaded first thing after the line starts
+MAX_PATH = 200          # instructions, a path longer than this loops without coming back
+
+# Cortex-M0 cycles (Cortex-M0 Technical Reference Manual, table 3-1), no wait states
+CYCLES = {
+    'MOV': 1, 'MOVS': 1, 'ADD': 1, 'ADDS': 1, 'SUBS': 1, 'CMP': 1, 'TST': 1, 'LSLS': 1, 'LSRS': 1, 'ANDS': 1,
+    'ORRS': 1, 'EORS': 1, 'NOP': 1,
+    'LDR': 2, 'LDRB': 2, 'LDRH': 2, 'STR': 2, 'STRB': 2, 'STRH': 2,
+    'B': 3, 'BL': 4, 'BL.W': 4, 'BX': 3,
+}
+TAKEN = 3
+NOT_TAKEN = 1
+CONDITIONS = ('EQ', 'NE', 'CS', 'CC', 'MI', 'PL', 'VS', 'VC', 'HI', 'LS', 'GE', 'LT', 'GT', 'LE')
+
+
+class Instruction:
+    def __init__(self, line, op, args, comment):
+        self.line = line
+        self.op = op
+        self.args = args
+        self.comment = comment
+
+    def branch(self):
+        """'B' for unconditional, 'Bcc' for conditional, None otherwise"""
+        if self.op == 'B':
+            return 'B'
+        if len(self.op) == 3 and self.op[0] == 'B' and self.op[1:] in CONDITIONS:
+            return 'Bcc'
+        return None
+
+    def cycles(self):
+        if self.op in ('PUSH', 'POP'):
+            registers = len(re.findall(r'r\d+|lr|pc', self.args))
+            return 1 + registers + (3 if 'pc' in self.args else 0)
+        return CYCLES[self.op]
+
+
+def parse(filename):
+    """processLine()'s instructions, and the index of the instruction each label is at"""
+    with open(filename) as f:
+        lines = f.readlines()
+    instructions = []
+    labels = {}
+    inside = False
+    keil = None     # in an #ifdef KEIL block, the gcc side is the one built
+    for number, text in enumerate(lines, 1):
+        text = text.strip()
+        if not inside:
+            inside = text.startswith('_ASM_FUNC') and (FUNCTION + '(') in text
+            continue
+        if text.startswith('_ASM_END'):
+            break
+        if text.startswith('#ifdef KEIL'):
+            keil = True
+            continue
+        if text.startswith('#else') and keil is not None:
+            keil = False
+            continue
+        if text.startswith('#endif') and keil is not None:
+            keil = None
+            continue
+        if keil:
+            continue
+        match = re.match(r'_ASM_LABEL\((\w+)\)', text)
+        if match:
+            labels[match.group(1)] = len(instructions)
+            continue
+        match = re.match(r'_ASM\(\s*([A-Za-z.]+)\s*(.*?)\)\s*(//\s*(.*))?$', text)
+        if match:
+            instructions.append(Instruction(number, match.group(1).upper(), match.group(2).strip(),
+                                            match.group(4) or ''))
+    if not instructions:
+        sys.exit('%s: no %s()' % (filename, FUNCTION))
+    return instructions, labels
+
+
+def check_comments(instructions, filename):
+    """The counts in the comments, '2', '1 or 3', are the table's."""
+    errors = 0
+    for ins in instructions:
+        counts = [int(n) for n in re.findall(r'\b(\d+)\b', ins.comment.split(';')[0].replace('if branch', ''))]
+        if not counts or not re.match(r'\s*\d', ins.comment):
+            continue
+        if ins.branch() == 'Bcc':
+            expected = [NOT_TAKEN, TAKEN][:len(counts)]
+        else:
+            expected = [ins.cycles()]
+        if counts != expected:
+            print('%s:%d: %s %s says %s cycles, it takes %s' % (filename, ins.line, ins.op, ins.args,
+                                                             ' or '.join(map(str, counts)),
+                                                             ' or '.join(map(str, expected))))
+            errors += 1
+    return errors
+
+
+def paths(instructions, labels):
+    """Every way from LOOP back to it: (cycles, the labels it went through), and the ways
+    that never come back."""
+    done = []
+    stuck = []
+    pending = [(labels[LOOP], 0, [], 0)]
+    while pending:
+        index, cycles, route, steps = pending.pop()
+        while True:
+            if steps and index == labels[LOOP]:
+                done.append((cycles, route))
+                break
+            if index == labels.get(EXIT) or index >= len(instructions) or steps > MAX_PATH:
+                if index != labels.get(EXIT):
+                    stuck.append(route)
+                break
+            ins = instructions[index]
+            kind = ins.branch()
+            steps += 1
+            if kind == 'B':
+                index = labels[ins.args]
+                cycles += ins.cycles()
+                route = route + [ins.args]
+            elif kind == 'Bcc':
+                pending.append((labels[ins.args], cycles + TAKEN, route + [ins.args], steps))
+                index += 1
+                cycles += NOT_TAKEN
+            else:
+                index += 1
+                cycles += ins.cycles()
+    return done, stuck
+
+
+def sync_cycles(instructions, labels):
+    """From the green pixel's load to the first red one's, at LOOP"""
+    index = labels[SYNC]
+    while index < len(instructions) and instructions[index].op != 'LDRB':
+        index += 1
+    cycles = 0
+    while index < len(instructions) and index != labels[LOOP]:
+        ins = instructions[index]
+        cycles += ins.cycles()
+        if ins.branch() == 'B':
+            index = labels[ins.args]
+        elif ins.branch() == 'Bcc':
+            return None
+        else:
+            index += 1
+    return cycles
+
+
+def main(filename, verbose):
+    instructions, labels = parse(filename)
+    for label in (LOOP, EXIT, SYNC):
+        if label not in labels:
+            sys.exit('%s: no label %s in %s()' % (filename, label, FUNCTION))
+
+    errors = check_comments(instructions, filename)
+    done, stuck = paths(instructions, labels)
+    counts = sorted(set(cycles for cycles, route in done))
+    for cycles, route in done:
+        if verbose or len(counts) > 1:
+            print('%3d cycles: %s' % (cycles, ' -> '.join([LOOP] + route + [LOOP])))
+    for route in stuck:
+        print('never back to %s: %s' % (LOOP, ' -> '.join([LOOP] + route)))
+        errors += 1
+    if len(counts) != 1:
+        print('%s: the pixel loop takes %s cycles depending on the way, it must take the same' %
+              (filename, ', '.join(map(str, counts))))
+        errors += 1
+    else:
+        period = counts[0]
+        sync = sync_cycles(instructions, labels)
+        print('%s: %d ways through the pixel loop, all %d cycles' % (filename, len(done), period))
+        if sync is None or 2 * sync != period:
+            print('%s: the first red pixel is loaded %s cycles after the green one, it must be %d' %
+                  (filename, sync, period // 2))
+            errors += 1
+    return 1 if errors else 0
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Checks every pixel of processLine() takes the same cycles.')
+    parser.add_argument('source', nargs='?', default=DEFAULT_SOURCE, help='rls_m0.c')
+    parser.add_argument('-v', '--verbose', action='store_true', help='print every way through the loop')
+    args = parser.parse_args()
+    sys.exit(main(args.source, args.verbose))
@@ -0,0 +1,70 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef BEACONS_H
+#define BEACONS_H
+
+#include <stdint.h>
+#include "tracker.h"
+
+// Identifies blinking beacons from the tracker's on/off history.  A beacon repeats one of
+// the BC_NUM_CODES 16 bit codes below, one bit per frame at the camera's frame rate, LED on
+// for a 1.  The codes have no more than two 0s in a row, so the tracker coasts over them,
+// and three 1s in a row, so a new track gets confirmed.  Any two codes differ in at least
+// 4 bits at every rotation, 8 over the last 32 frames and still 5 over the BC_MIN_VALID
+// frames the camera has to have captured.  So a track's history is taken as a code (at any
+// phase) when no more than BC_MAX_ERRORS captured frames disagree, and no other code can be
+// that close.  Steady blobs (glints, sunlight) never match, random flicker rarely does and
+// then not for long.  A track is reported as a beacon once it matched the same code in
+// BC_CONFIRM frames, and until it hasn't matched for BC_MAX_FAILS frames in a row; frames
+// with too few captured frames behind them count neither way.  Cost per frame is bounded
+// by TR_MAX_TRACKS tracks times BC_NUM_CODES*BC_CODE_BITS comparisons.
+
+#define BC_CODE_BITS          16
+#define BC_NUM_CODES          8     // beacon ids are 1..BC_NUM_CODES
+#define BC_MAX_ERRORS         2     // of the last 32 frames
+#define BC_MIN_VALID          29    // captured frames needed among the last 32
+#define BC_CONFIRM            8
+#define BC_MAX_FAILS          8
+
+// LED pattern of each beacon id, most significant bit first
+extern const uint16_t g_beaconCodes[BC_NUM_CODES];
+
+struct BeaconState
+{
+    uint16_t track;     // track id
+    uint8_t code;       // 1..BC_NUM_CODES, 0 none yet
+    uint8_t hits;       // frames matching code, up to BC_CONFIRM
+    uint8_t fails;      // frames in a row not matching it
+};
+
+class Beacons
+{
+public:
+    Beacons();
+    void reset();
+    // call after every Tracker::update()
+    void update(Tracker *tracker);
+    // beacon id of the track, 0 if it isn't one
+    uint8_t id(const Track *track);
+    // code and the number of captured frames disagreeing with it, 0 if no code is close enough
+    static uint8_t decode(uint32_t seen, uint32_t valid, uint8_t *errors);
+
+private:
+    BeaconState m_states[TR_MAX_TRACKS];
+    uint16_t m_numStates;
+};
+
+#endif // BEACONS_H
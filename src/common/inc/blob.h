@@ -84,8 +84,12 @@ struct SMoments {
     static bool computeAxes;
 
     int area; // number of pixels
+    // intensity, from the M0's runs if it measures them (qqueue.h), 0 otherwise
+    int peak; // brightest pixel
+    int sum; // sum of pixel values
     void Reset() {
         area = 0;
+        peak = sum = 0;
 #ifdef INCLUDE_STATS
         sumX= sumY= sumXX= sumYY= sumXY= 0;
 #endif
@@ -100,6 +104,8 @@ struct SMoments {
 #endif
     void Add(const SMoments &moments) {
         area += moments.area;
+        if (moments.peak > peak) peak = moments.peak;
+        sum += moments.sum;
 #ifdef INCLUDE_STATS
         sumX += moments.sumX;
         sumY += moments.sumY;
@@ -131,6 +137,8 @@ struct SSegment {
     unsigned short row      : 9 ;
     unsigned short startCol : 10; // inclusive
     unsigned short endCol   : 10; // inclusive
+    unsigned char  peak;          // brightest pixel, 0 if not measured
+    unsigned int   sum;           // of the pixels, 0 if not measured
 
     const static short invalid_row= 0x1ff;
 
@@ -145,6 +153,8 @@ struct SSegment {
         int e= endCol;
 
         moments.area  = (e-s);
+        moments.peak  = peak;
+        moments.sum   = sum;
 #ifdef INCLUDE_STATS
         int e2= e*e;
         int y= row;
@@ -19,6 +19,13 @@
 #include "blob.h"
 #include "pixytypes.h"
 #include "qqueue.h"
+#include "blockframe.h"
+#include "frameq.h"
+#include "i2cregs.h"
+#include "tracker.h"
+#include "beacons.h"
+#include "pose.h"
+#include "undistort.h"
 
 #define MAX_BLOBS             20
 #define MAX_BLOBS_PER_MODEL   20
@@ -28,28 +35,63 @@
 #define MAX_CODED_DIST        8
 #define MAX_COLOR_CODE_MODELS 5
 
-#define BL_BEGIN_MARKER       0xaa55
+#define BL_BEGIN_MARKER       BF_LEGACY_MARKER
+#define BL_FRAME_PENDING      1     // blobify() took what was queued, the frame isn't complete
+// a serial frame slot holds MAX_BLOBS in any format
+#define BL_MAX(a, b)          ((a)>(b) ? (a) : (b))
+#define BL_FRAME_SLOT_LEN     BL_MAX(BL_MAX(BF_COMPACT_FRAME_LEN(MAX_BLOBS), BF_LEGACY_FRAME_LEN(MAX_BLOBS)), \
+                                     BL_MAX(BF_TRACKS_FRAME_LEN(TR_MAX_TRACKS), BF_INTENSITY_FRAME_LEN(MAX_BLOBS)))
+
+// How bright a blob of m_blobs is, in step with it, from the intensities of its runs if
+// the M0 measures them (QVAL_LAYOUT_INTENSITY), all 0 if it doesn't
+struct BlobIntensity
+{
+    uint8_t m_peak;         // brightest pixel
+    uint32_t m_sum;         // of the pixels
+    uint32_t m_area;        // pixels
+};
 
 class Blobs
 {
 public:
     Blobs();
     ~Blobs();
+    // 0 when a frame is done, BL_FRAME_PENDING until then, negative if one was lost
     int blobify(Qqueue *qq);
     uint16_t getBlock(uint8_t *buf, uint32_t buflen);
+    void setBlockFormat(uint8_t format);
+    void setFrameDepth(uint8_t depth);
+    bool queueMessage(const uint8_t *msg, uint16_t len);
+    void encodeRegisters(uint8_t *regs);
+    void encodeStatus(uint8_t *status);
+    void setMinArea(uint32_t area);
+    uint32_t getMinArea();
+    void setMergeDist(uint16_t dist);
+    void setRoi(uint16_t left, uint16_t top, uint16_t right, uint16_t bottom);
+    bool setPad(const int16_t *points, uint8_t count, uint8_t signature);
+    bool setCalibration(const Calibration *cal);
+    bool setCoords(uint8_t coords);
     BlobA *getMaxBlob(uint16_t signature=0, uint16_t *numBlobs=NULL);
     void getBlobs(BlobA **blobs, uint32_t *len);
     int runlengthAnalysis(Qqueue *qq);
     bool frameBufValid();
+    uint8_t frameSlot();    // the frame's framebuf.h slot, if frameBufValid()
 #ifndef PIXY
     void getRunlengths(uint32_t **qvals, uint32_t *len);
 #endif
 
 private:
-    int handleSegment(uint16_t row, uint16_t startCol, uint16_t length);
-    uint16_t combine(uint16_t *blobs, uint16_t numBlobs);
-    uint16_t combine2(uint16_t *blobs, uint16_t numBlobs);
-    uint16_t compress(uint16_t *blobs, uint16_t numBlobs);
+    int handleSegment(uint16_t row, uint16_t startCol, uint16_t length, uint8_t peak, uint32_t sum);
+    uint16_t combine(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs);
+    uint16_t combine2(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs);
+    uint16_t compress(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs);
+    uint16_t applyRoi(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs);
+    uint16_t encodeLegacyFrame(uint8_t *buf);
+    uint16_t encodeCompactFrame(uint8_t *buf, bool intensity);
+    uint16_t encodeTracksFrame(uint8_t *buf);
+    uint16_t encodeBeaconsFrame(uint8_t *buf);
+    uint16_t encodePoseFrame(uint8_t *buf);
+    uint8_t *putFrameHeader(uint8_t *p, uint16_t marker);
 
     bool closeby(BlobA *blob0, BlobA *blob1);
     int16_t distance(BlobA *blob0, BlobA *blob1);
@@ -66,18 +108,36 @@ private:
     CBlobAssembler m_assembler;
 
     uint16_t *m_blobs;
+    BlobIntensity *m_intensities;
     uint16_t m_numBlobs;
 
     bool m_mutex;
     uint16_t m_maxBlobs;
     uint16_t m_maxBlobsPerModel;
-    uint16_t m_blobReadIndex;
 
     uint32_t m_minArea;
+    uint16_t m_roi[4];
     uint16_t m_mergeDist;
     uint16_t m_maxCodedDist;
     BlobA *m_maxBlob;
     bool m_frameBufValid;
+    uint8_t m_frameSlot;
+
+    uint8_t m_format;
+    uint8_t m_requestedFormat;
+    uint16_t m_frameSeq;
+    uint32_t m_captureTime;
+    int16_t m_row;          // of the frame being analyzed, -1 before its first line
+    uint16_t m_layout;      // of the line's Qvals, QVAL_LAYOUT_xxx from its QVAL_LINE_BEGIN
+    Qval m_run;             // with QVAL_LAYOUT_INTENSITY, a run waiting for its intensity
+    bool m_runPending;
+    int m_segmentRes;
+    FrameQ m_frameq;
+    Tracker m_tracker;
+    Beacons m_beacons;
+    Pose m_pose;
+    Undistort m_undistort;
+    uint8_t m_coords;
 
 #ifndef PIXY
     uint32_t m_numQvals;
@@ -0,0 +1,242 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef BLOCKFRAME_H
+#define BLOCKFRAME_H
+
+// Block formats sent over the serial interfaces (I2C, SPI, UART).  Plain C so the
+// host decoder library can share it with the firmware.
+//
+// Legacy format, one 14 byte block per blob, the first block of a frame is preceded
+// by an extra BL_BEGIN_MARKER:
+//
+//   0xaa55 (frame)  0xaa55  checksum  signature  x  y  width  height  0xaa55  checksum ...
+//
+// The end of a frame is only known once the next one starts.
+//
+// Compact format, one header and one CRC per frame, all multi-byte values little endian:
+//
+//   0xaa57  seq  timestamp  count  record[count]  crc16  [pad]
+//
+//   seq        uint16, increments every frame the camera processes, so the receiver can
+//              count frames that were dropped (frame errors or stale frames, see below)
+//   timestamp  uint32, time the frame was captured, in microseconds of a free running
+//              timer (wraps after about 71 minutes)
+//   count      uint8, number of records
+//   record     five varints: zigzag(signature - previous signature), zigzag(x - previous x),
+//              zigzag(y - previous y), width, height.  The previous values start at 0.
+//   crc16      CRC-16/XMODEM (poly 0x1021, init 0) of everything after the marker
+//   pad        one zero byte if needed to make the frame an even number of bytes, so it
+//              stays word aligned on links that transfer 16 bits at a time (SPI)
+//
+// The center (x, y) is in pixels unless the host asked for undistorted coordinates with
+// BF_CMD_SET_COORDS, see below; width and height stay in pixels.
+//
+// A varint holds 7 bits per byte, least significant group first, bit 7 set on every byte
+// but the last.  Frames without blobs are still sent (count 0), so the receiver sees every
+// frame.  The host asks for the compact format with SER_SYNC_BYTE, BF_CMD_COMPACT_FRAMES
+// and goes back with BF_CMD_LEGACY_FRAMES; the switch happens at the next frame boundary.
+//
+// Tracks format, what the camera's tracker (tracker.h) makes of the blobs, one record per
+// confirmed track.  Header, CRC and pad are the same as for the compact format:
+//
+//   0xaa59  seq  timestamp  count  record[count]  crc16  [pad]
+//
+//   record     nine varints: zigzag(id - previous id), signature, x, y, zigzag(vx), zigzag(vy),
+//              width, height, age
+//   id         stays with the target for as long as the track lives, counts up from 1 and
+//              wraps, skipping 0
+//   x, y       filtered center in 1/BF_TRACK_POS_SCALE pixels, predicted if the track had no
+//              blob this frame
+//   vx, vy     filtered velocity in pixels per second
+//   age        frames since the track started, stops at 65535
+//
+// The host asks for it with BF_CMD_TRACK_FRAMES.  Tracks only live while this format is on.
+//
+// Beacons format, the tracks the beacon decoder (beacons.h) recognized by their blink code,
+// one record each.  Blobs that blink no code are left out.  Header, CRC and pad are the same
+// as for the compact format:
+//
+//   0xaa5a  seq  timestamp  count  record[count]  crc16  [pad]
+//
+//   record     seven varints: beacon, track id, signature, x, y, width, height
+//   beacon     1..BC_NUM_CODES, which code it blinks; reflections of a beacon blink the same
+//   x, y       as in the tracks format, so also while the LED is off
+//
+// The host asks for it with BF_CMD_BEACON_FRAMES.  Beacons are recognized about
+// BC_CONFIRM frames after the last 32 frames of their track match the code.
+//
+// Pose format, where the landing pad the pose estimator (pose.h) finds among the blobs is
+// relative to the camera.  Header, CRC and pad are the same as for the compact format:
+//
+//   0xaa5b  seq  timestamp  count  record[count]  crc16  [pad]
+//
+//   count      1, or 0 if the pad wasn't found this frame
+//   record     six varints: inliers, zigzag(x), zigzag(y), z, yaw, error
+//   inliers    pad points matched to blobs
+//   x, y, z    pad origin in the camera frame in mm: x right, y down, z along the optical axis
+//   yaw        angle of the pad's x axis in 1/100 degrees, 0..35999, from the camera's x
+//              axis toward its y axis
+//   error      rms distance of the matched blobs from where the pose puts them, in
+//              1/BF_POSE_ERROR_SCALE pixels
+//
+// The host asks for it with BF_CMD_POSE_FRAMES and describes its pad with BF_CMD_SET_PAD.
+//
+// Intensity format, the compact format's blobs with how bright they are, so a saturated
+// beacon can be told from a reflection just over the pixel threshold.  Header, CRC and pad
+// are the same as for the compact format:
+//
+//   0xaa5c  seq  timestamp  count  record[count]  crc16  [pad]
+//
+//   record     eight varints: the compact format's five, then peak, mean, flags
+//   peak       the blob's brightest pixel, 0 if the camera doesn't measure intensity (the
+//              "Run intensity" parameter is off)
+//   mean       mean of the blob's pixels, rounded, 0 if not measured
+//   flags      BF_INTENSITY_xxx
+//
+// The host asks for it with BF_CMD_INTENSITY_FRAMES.
+//
+// Either way the camera queues whole frames and sends one completely before starting the
+// next.  By default only the latest unread frame is kept; BF_CMD_FRAME_DEPTH(k) keeps up to
+// k unread frames instead (1 <= k <= BF_MAX_QUEUED_FRAMES), dropping the oldest.
+//
+// Commands with a payload, host to camera.  The two byte commands (SER_SYNC_BYTE, command)
+// have no room for arguments, so the camera also takes command frames:
+//
+//   0xa6  seq  cmd  len  payload[len]  crc16
+//
+//   seq        uint8, picked by the host, the response carries it back
+//   cmd        command, BF_CMD_xxx or any of the two byte commands
+//   len        uint8, at most BF_MAX_CMD_PAYLOAD
+//   crc16      CRC-16/XMODEM of seq, cmd, len and payload
+//
+// Command frames with a bad length or CRC are ignored.  Every other command frame gets a
+// response, queued with the block frames and sent between two of them:
+//
+//   0xaa58  seq  cmd  result  len  payload[len]  crc16  [pad]
+//
+//   result     BF_RESULT_xxx
+//   crc16      CRC-16/XMODEM of seq through payload
+//   pad        as for compact frames
+//
+// The camera handles commands between frames, one per pass through its input, so a burst
+// of commands is spread over a few milliseconds.  The two byte commands still work as
+// before and get no response.
+
+#define BF_CMD_FRAME_SYNC         0xa6
+#define BF_RESPONSE_MARKER        0xaa58
+
+#define BF_CMD_GET_STATUS         0x01  // response is BF_STATUS_LEN bytes, see below
+#define BF_CMD_SET_MIN_AREA       0x02  // uint16, smallest blob area reported
+#define BF_CMD_SET_ROI            0x03  // uint16 left, top, right, bottom: only report blobs centered inside, all 0 for the whole image
+#define BF_CMD_SET_FORMAT         0x04  // uint8, BF_FORMAT_xxx
+#define BF_CMD_SET_FRAME_DEPTH    0x05  // uint8, 1..BF_MAX_QUEUED_FRAMES
+#define BF_CMD_SET_LOGGING        0x06  // uint8, save every nth frame to the SD card, 0 to stop
+#define BF_CMD_SET_PAD            0x07  // uint8 signature (0 any), then PO_MIN_MODEL..PO_MAX_MODEL int16 x, y pairs in mm
+#define BF_CMD_SET_COORDS         0x08  // uint8, BF_COORDS_xxx, what the compact format's x and y are
+
+// Coordinates of the compact format's centers, as int16.  The undistorted ones go through
+// the lens' calibration (undistort.h), which the camera keeps in flash.
+#define BF_COORDS_PIXELS          0     // in the image, as the legacy format has them
+#define BF_COORDS_NORMALIZED      1     // x/z, y/z in the camera frame (x right, y down, z forward), in 1/BF_NORM_SCALE
+#define BF_COORDS_BEARINGS        2     // azimuth (+ right) and elevation (+ down) from the optical axis, in 1/BF_BEARING_SCALE degrees
+#define BF_NORM_SCALE             4096
+#define BF_BEARING_SCALE          100
+
+#define BF_RESULT_OK              0
+#define BF_RESULT_UNKNOWN         1     // no such command
+#define BF_RESULT_LENGTH          2     // wrong payload length for the command
+#define BF_RESULT_VALUE           3     // argument out of range, or not possible on this interface
+
+// BF_CMD_GET_STATUS response, multi-byte values little endian
+#define BF_STATUS_FRAME_SEQ       0     // uint16, seq of the last frame
+#define BF_STATUS_FORMAT          2     // uint8
+#define BF_STATUS_FRAME_DEPTH     3     // uint8
+#define BF_STATUS_MIN_AREA        4     // uint16
+#define BF_STATUS_LOGGING         6     // uint8, logging interval, 0 if off
+#define BF_STATUS_ROI             7     // 4 x uint16
+#define BF_STATUS_DROPPED         15    // uint32, frames dropped because the host didn't read them in time
+#define BF_STATUS_COORDS          19    // uint8
+#define BF_STATUS_LEN             20
+
+#define BF_MAX_CMD_PAYLOAD        32
+#define BF_CMD_FRAME_LEN(n)       (6 + (n))
+#define BF_RESPONSE_HEADER_LEN    6     // marker, seq, cmd, result, len
+#define BF_RESPONSE_FRAME_LEN(n)  ((BF_RESPONSE_HEADER_LEN + (n) + 2 + 1)&~1)
+
+#define BF_LEGACY_MARKER          0xaa55
+#define BF_COMPACT_MARKER         0xaa57
+#define BF_TRACKS_MARKER          0xaa59
+#define BF_BEACONS_MARKER         0xaa5a
+#define BF_POSE_MARKER            0xaa5b
+#define BF_INTENSITY_MARKER       0xaa5c
+
+#define BF_FORMAT_LEGACY          0
+#define BF_FORMAT_COMPACT         1
+#define BF_FORMAT_TRACKS          2
+#define BF_FORMAT_BEACONS         3
+#define BF_FORMAT_POSE            4
+#define BF_FORMAT_INTENSITY       5
+
+#define BF_CMD_LEGACY_FRAMES      0xc0
+#define BF_CMD_COMPACT_FRAMES     0xc1
+#define BF_CMD_TRACK_FRAMES       0xc2
+#define BF_CMD_BEACON_FRAMES      0xc3
+#define BF_CMD_POSE_FRAMES        0xc6  // 0xc4 and 0xc5 are taken by the i2c register map
+#define BF_CMD_INTENSITY_FRAMES   0xc7
+#define BF_CMD_FRAME_DEPTH_BASE   0xd0
+#define BF_CMD_FRAME_DEPTH(k)     (BF_CMD_FRAME_DEPTH_BASE + (k))
+
+#define BF_MAX_QUEUED_FRAMES      3
+
+#define BF_LEGACY_BLOCK_LEN       14    // marker, checksum, 5 fields
+#define BF_COMPACT_HEADER_LEN     9     // marker, seq, timestamp, count
+#define BF_COMPACT_CRC_LEN        2
+#define BF_MAX_VARINT_LEN         3     // 16 bit values, zigzag adds one bit
+#define BF_MAX_RECORD_LEN         (5*BF_MAX_VARINT_LEN)
+#define BF_MAX_RECORDS            255
+#define BF_MAX_TRACK_RECORD_LEN   (9*BF_MAX_VARINT_LEN)
+#define BF_MAX_TRACKS             32    // also beacons
+#define BF_MAX_BEACON_RECORD_LEN  (7*BF_MAX_VARINT_LEN)
+#define BF_TRACK_POS_SCALE        4
+#define BF_MAX_POSE_RECORD_LEN    (6*BF_MAX_VARINT_LEN)
+#define BF_POSE_ERROR_SCALE       16
+#define BF_MAX_INTENSITY_RECORD_LEN  (8*BF_MAX_VARINT_LEN)
+
+#define BF_INTENSITY_SATURATED    0x01  // a pixel is at the sensor's full scale, the blob may be brighter than peak says
+#define BF_SATURATED_LEVEL        255
+
+// length of a legacy frame with n blocks, including the frame marker
+#define BF_LEGACY_FRAME_LEN(n)    ((n) ? (n)*BF_LEGACY_BLOCK_LEN + 2 : 0)
+
+// worst case length of a compact frame with n records, including pad
+#define BF_COMPACT_FRAME_LEN(n)   (BF_COMPACT_HEADER_LEN + (n)*BF_MAX_RECORD_LEN + BF_COMPACT_CRC_LEN + 1)
+
+// worst case length of a tracks frame with n records, including pad
+#define BF_TRACKS_FRAME_LEN(n)    (BF_COMPACT_HEADER_LEN + (n)*BF_MAX_TRACK_RECORD_LEN + BF_COMPACT_CRC_LEN + 1)
+
+// worst case length of a beacons frame with n records, including pad
+#define BF_BEACONS_FRAME_LEN(n)   (BF_COMPACT_HEADER_LEN + (n)*BF_MAX_BEACON_RECORD_LEN + BF_COMPACT_CRC_LEN + 1)
+
+// worst case length of a pose frame, including pad
+#define BF_POSE_FRAME_LEN         (BF_COMPACT_HEADER_LEN + BF_MAX_POSE_RECORD_LEN + BF_COMPACT_CRC_LEN + 1)
+
+// worst case length of an intensity frame with n records, including pad
+#define BF_INTENSITY_FRAME_LEN(n) (BF_COMPACT_HEADER_LEN + (n)*BF_MAX_INTENSITY_RECORD_LEN + BF_COMPACT_CRC_LEN + 1)
+
+#define BF_ZIGZAG(d)              ((((uint32_t)(d))<<1) ^ (uint32_t)((int32_t)(d)>>31))
+#define BF_UNZIGZAG(z)            ((int32_t)((z)>>1) ^ -(int32_t)((z)&1))
+
+#endif // BLOCKFRAME_H
@@ -29,6 +29,7 @@
 #define CRP_BUFSIZE                     0x80
 #define CRP_BUFPAD                      8
 #define CRP_PROCTABLE_LEN               0x40
+#define CRP_PROCCACHE_LEN               0x40 // remote procs cached by getProc(), power of 2
 
 #define CRP_START_CODE                  0xaaaa5555
 
@@ -41,6 +42,14 @@
 #define CRP_CALL_INIT                   (CRP_CALL | CRP_INTRINSIC | 0x01)
 #define CRP_CALL_ENUMERATE_INFO         (CRP_CALL | CRP_INTRINSIC | 0x02)
 
+// integrity check modes, negotiated in CRP_CALL_INIT.  The client sends the mode it wants
+// after hinterested, the server returns the mode it accepted in the upper bits of its
+// hinterested byte.  Older peers ignore the extra arg and never set those bits.
+#define CRP_INTEGRITY_NONE              0x00 // byte sum on links that aren't error corrected, nothing otherwise
+#define CRP_INTEGRITY_CRC               0x01 // CRC-16 on links that aren't error corrected, CRC-32 trailer otherwise
+#define CRP_INIT_HINTS                  0x01 // bit
+#define CRP_INIT_INTEGRITY_SHIFT        4
+
 #define CRP_ACK                         0x59
 #define CRP_NACK                        0x95
 #define CRP_MAX_HEADER_LEN              64
@@ -166,10 +175,12 @@
 #define callSyncArray(...)              call(SYNC_RETURN_ARRAY, __VA_ARGS__, END)
 
 class Chirp;
+template <typename InList, typename OutList> class ChirpBinding; // see chirpbinding.hpp
 
 typedef int16_t ChirpProc; // negative values are invalid
 
 typedef uint32_t (*ProcPtr)(Chirp *);
+typedef uint32_t (*Crc32Engine)(const uint8_t *buf, uint32_t len);
 
 struct ProcModule
 {
@@ -200,6 +211,13 @@ struct ProcTableEntry
     const ProcTableExtension *extension;
 };
 
+// gotoe's index for a procedure we've looked up with getProc()
+struct ProcCacheEntry
+{
+    char *procName;
+    ChirpProc proc;
+};
+
 class Chirp
 {
 public:
@@ -214,6 +232,9 @@ public:
     int registerModule(const ProcModule *module);
     void setSendTimeout(uint32_t timeout);
     void setRecvTimeout(uint32_t timeout);
+    void setIntegrity(uint8_t integrity);
+    uint8_t integrity();
+    uint32_t connection();
 
     int call(uint8_t service, ChirpProc proc, ...);
     int call(uint8_t service, ChirpProc proc, va_list args);
@@ -233,6 +254,9 @@ public:
     int useBuffer(uint8_t *buf, uint32_t len);
 
     static uint16_t calcCrc(uint8_t *buf, uint32_t len);
+    static uint16_t calcCrc16(const uint8_t *buf, uint32_t len, uint16_t crc=0);
+    static uint32_t calcCrc32(const uint8_t *buf, uint32_t len, uint32_t crc=0);
+    static void setCrc32Engine(Crc32Engine engine); // used for crcs that start fresh, 0 for the table
 
 protected:
     int remoteInit(bool connect);
@@ -258,34 +282,52 @@ protected:
     uint16_t m_sendTimeout;
 
 private:
+    template <typename InList, typename OutList> friend class ChirpBinding;
+
     int sendHeader(uint8_t type, ChirpProc proc);
     int sendFull(uint8_t type, ChirpProc proc);
     int sendData();
     int sendAck(bool ack); // false=nack
     int sendChirpRetry(uint8_t type, ChirpProc proc);
+    int recvResponse(void *args[]); // null pointer terminates
     int recvHeader(uint8_t *type, ChirpProc *proc, bool wait);
     int recvFull(uint8_t *type, ChirpProc *proc, bool wait);
     int recvData();
     int recvAck(bool *ack, uint16_t timeout); // false=nack
     int32_t handleEnumerate(char *procName, ChirpProc *callback);
-    int32_t handleInit(uint16_t *blkSize, uint8_t *hintSource);
+    int32_t handleInit(uint16_t *blkSize, uint8_t *hintSource, uint8_t *integrity);
     int32_t handleEnumerateInfo(ChirpProc *proc);
     int vassemble(va_list *args);
+    uint16_t checksum(const uint8_t *buf, uint32_t len, uint16_t crc);
+    static uint32_t parseArg(uint8_t *buf, uint32_t len, uint32_t i, uint8_t dataType, void *args[]);
     void restoreBuffer();
 
     ChirpProc updateTable(const char *procName, ProcPtr procPtr);
     ChirpProc lookupTable(const char *procName);
     int realloc(uint32_t min=0);
     int reallocTable();
+    int reindexTable();
+    ChirpProc lookupCache(const char *procName);
+    void updateCache(const char *procName, ChirpProc proc);
+    void clearCache();
+    static uint32_t hashName(const char *procName);
 
     Link *m_link;
     ProcTableEntry *m_procTable;
     uint16_t m_procTableSize;
+    ChirpProc *m_procIndex;      // hash of procName -> index into m_procTable, -1 if empty, built on first lookup
+    uint16_t m_procIndexSize;    // power of 2, at least twice m_procTableSize
+    ProcCacheEntry *m_procCache; // hash of procName -> gotoe's index, cleared when we (re)connect, allocated on first remote lookup
+    uint16_t m_procCacheLen;
+    uint32_t m_connection;
     uint16_t m_blkSize;
     uint8_t m_maxNak;
     uint8_t m_retries;
     bool m_call;
     bool m_connected;
+    uint8_t m_integrity;     // mode we ask for (client) or accept (server)
+    uint8_t m_integrityMode; // mode negotiated with gotoe
+    uint8_t m_check;         // mode used for the chirp being sent/received
 };
 
 #endif // CHIRP_H
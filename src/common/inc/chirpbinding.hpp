@@ -0,0 +1,334 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef CHIRPBINDING_HPP
+#define CHIRPBINDING_HPP
+
+// Typed bindings for calling chirp procedures from host code (requires C++11).
+//
+// A binding names a procedure and its argument types once:
+//
+//   ChirpBinding<ChirpIn<uint8_t, uint16_t, uint16_t, uint16_t, uint16_t>,
+//                ChirpOut<int32_t, ChirpFourcc, ChirpHint<uint8_t>, uint16_t, uint16_t, ChirpArray<uint8_t> > >
+//       getFrame("cam_getFrame");
+//
+//   res = getFrame.call(chirp, mode, xOffset, yOffset, width, height, response, fourcc, flags, w, h, pixels);
+//
+// Type tags and the fixed part of the buffer size are worked out at compile time, so a
+// call is serialized straight into the chirp's send buffer without walking a va_list.
+// The wire format is the same as Chirp::vserialize() produces, and the response is
+// checked against the declared out types instead of being loaded blindly the way
+// Chirp::loadArgs() does.  As with Chirp::call(), the first out is the responseInt.
+//
+// Like Chirp::call(), bindings aren't thread-safe; callers that share a Chirp between
+// threads need to hold the same lock they hold around call().
+
+#include <string.h>
+#include "chirp.hpp"
+
+// array argument, sent as INTS8(len, data) etc.  When received, data points into the chirp buffer.
+template <typename T> struct ChirpArray
+{
+    ChirpArray(uint32_t len_=0, T *data_=NULL) : len(len_), data(data_) {}
+
+    uint32_t len;
+    T *data;
+};
+
+// hint argument, sent as HINT8(value) etc.  Hints are dropped by the sender if gotoe (guy on
+// the other end) isn't interested in them, so a received hint may not be there (valid=false).
+template <typename T> struct ChirpHint
+{
+    ChirpHint(const T &value_=T()) : value(value_), valid(false) {}
+
+    T value;
+    bool valid;
+};
+
+// type hint, sent as HTYPE(FOURCC(...))
+struct ChirpFourcc
+{
+    ChirpFourcc(uint32_t value_=0) : value(value_), valid(false) {}
+
+    uint32_t value;
+    bool valid;
+};
+
+template <typename... T> struct ChirpIn {};
+template <typename... T> struct ChirpOut {};
+
+// Per-type serialization.  fixed is the most a value can take in the buffer (type byte,
+// alignment padding and data), variable() is what it needs beyond that.
+template <typename T> struct ChirpArg;
+
+template <typename T, uint8_t TYPE> struct ChirpScalarArg
+{
+    static const uint8_t type = TYPE;
+    static const uint32_t fixed = 2*sizeof(T); // type, up to sizeof(T)-1 padding, data
+
+    static uint32_t variable(const T &)
+    {
+        return 0;
+    }
+    static void write(uint8_t *buf, uint32_t &i, const T &val, uint8_t origType=TYPE)
+    {
+        buf[i++] = origType;
+        ALIGN(i, sizeof(T));
+        // rewrite type so getType will work (even though we might add padding between type and data)
+        buf[i-1] = origType;
+        memcpy(buf+i, &val, sizeof(T));
+        i += sizeof(T);
+    }
+    static bool match(uint8_t recvType)
+    {
+        return (recvType&~CRP_HINT)==(TYPE&~CRP_HINT);
+    }
+    static int read(void *args[], uint32_t &a, T &val)
+    {
+        if (args[a]==NULL || !match(Chirp::getType(args[a])))
+            return CRP_RES_ERROR_PARSE;
+        memcpy(&val, args[a++], sizeof(T));
+        return CRP_RES_OK;
+    }
+};
+
+template <> struct ChirpArg<int8_t> : ChirpScalarArg<int8_t, CRP_INT8> {};
+template <> struct ChirpArg<uint8_t> : ChirpScalarArg<uint8_t, CRP_UINT8> {};
+template <> struct ChirpArg<int16_t> : ChirpScalarArg<int16_t, CRP_INT16> {};
+template <> struct ChirpArg<uint16_t> : ChirpScalarArg<uint16_t, CRP_UINT16> {};
+template <> struct ChirpArg<int32_t> : ChirpScalarArg<int32_t, CRP_INT32> {};
+template <> struct ChirpArg<uint32_t> : ChirpScalarArg<uint32_t, CRP_UINT32> {};
+template <> struct ChirpArg<float> : ChirpScalarArg<float, CRP_FLT32> {};
+
+template <> struct ChirpArg<const char *>
+{
+    static const uint8_t type = CRP_STRING;
+    static const uint32_t fixed = 1;
+
+    static uint32_t variable(const char *s)
+    {
+        return strlen(s)+1; // include null
+    }
+    static void write(uint8_t *buf, uint32_t &i, const char *s, uint8_t origType=CRP_STRING)
+    {
+        uint32_t len = strlen(s)+1;
+        buf[i++] = origType;
+        memcpy(buf+i, s, len);
+        i += len;
+    }
+    static int read(void *args[], uint32_t &a, const char *&s)
+    {
+        if (args[a]==NULL || (Chirp::getType(args[a])&~CRP_HINT)!=CRP_STRING)
+            return CRP_RES_ERROR_PARSE;
+        s = (const char *)args[a++];
+        return CRP_RES_OK;
+    }
+};
+
+template <typename T> struct ChirpArg<ChirpArray<T> >
+{
+    static const uint8_t type = CRP_ARRAY | ChirpArg<T>::type;
+    static const uint32_t fixed = 8+sizeof(T); // type, padding, len, padding
+
+    static uint32_t variable(const ChirpArray<T> &array)
+    {
+        return array.len*sizeof(T);
+    }
+    static void write(uint8_t *buf, uint32_t &i, const ChirpArray<T> &array, uint8_t origType=type)
+    {
+        buf[i++] = origType;
+        ALIGN(i, 4);
+        buf[i-1] = origType;
+        memcpy(buf+i, &array.len, 4);
+        i += 4;
+        ALIGN(i, sizeof(T));
+        memcpy(buf+i, array.data, array.len*sizeof(T));
+        i += array.len*sizeof(T);
+    }
+    static bool match(uint8_t recvType)
+    {
+        return (recvType&~CRP_HINT)==type;
+    }
+    static int read(void *args[], uint32_t &a, ChirpArray<T> &array)
+    {
+        // arrays take 2 args, length and pointer
+        if (args[a]==NULL || args[a+1]==NULL || !match(Chirp::getType(args[a])))
+            return CRP_RES_ERROR_PARSE;
+        memcpy(&array.len, args[a], 4);
+        array.data = (T *)args[a+1];
+        a += 2;
+        return CRP_RES_OK;
+    }
+};
+
+// float arrays are FLTS32/FLTS64, there is no scalar FLT64 in vserialize()
+template <> struct ChirpArg<double> { static const uint8_t type = CRP_FLT64; };
+
+template <typename T> struct ChirpArg<ChirpHint<T> >
+{
+    static const uint8_t type = CRP_HINT | ChirpArg<T>::type;
+    static const uint32_t fixed = ChirpArg<T>::fixed;
+
+    static uint32_t variable(const ChirpHint<T> &hint)
+    {
+        return ChirpArg<T>::variable(hint.value);
+    }
+    static void write(uint8_t *buf, uint32_t &i, const ChirpHint<T> &hint)
+    {
+        ChirpArg<T>::write(buf, i, hint.value, type);
+    }
+    // a missing hint isn't an error, leave it for the next out
+    static int read(void *args[], uint32_t &a, ChirpHint<T> &hint)
+    {
+        hint.valid = args[a]!=NULL && Chirp::getType(args[a])==type;
+        if (hint.valid)
+            return ChirpArg<T>::read(args, a, hint.value);
+        return CRP_RES_OK;
+    }
+};
+
+template <> struct ChirpArg<ChirpFourcc>
+{
+    static const uint8_t type = CRP_TYPE_HINT;
+    static const uint32_t fixed = 8;
+
+    static uint32_t variable(const ChirpFourcc &)
+    {
+        return 0;
+    }
+    static void write(uint8_t *buf, uint32_t &i, const ChirpFourcc &fourcc)
+    {
+        ChirpScalarArg<uint32_t, CRP_TYPE_HINT>::write(buf, i, fourcc.value);
+    }
+    static int read(void *args[], uint32_t &a, ChirpFourcc &fourcc)
+    {
+        fourcc.valid = args[a]!=NULL && Chirp::getType(args[a])==CRP_TYPE_HINT;
+        if (fourcc.valid)
+            memcpy(&fourcc.value, args[a++], 4);
+        return CRP_RES_OK;
+    }
+};
+
+// hints (and type hints) are only sent if gotoe is interested
+template <typename T> struct ChirpIsHint { static const bool value = false; };
+template <typename T> struct ChirpIsHint<ChirpHint<T> > { static const bool value = true; };
+template <> struct ChirpIsHint<ChirpFourcc> { static const bool value = true; };
+
+template <typename... T> struct ChirpFixedSize;
+template <> struct ChirpFixedSize<> { static const uint32_t value = 0; };
+template <typename T, typename... R> struct ChirpFixedSize<T, R...>
+{
+    static const uint32_t value = ChirpArg<T>::fixed + ChirpFixedSize<R...>::value;
+};
+
+template <typename... In, typename... Out>
+class ChirpBinding<ChirpIn<In...>, ChirpOut<Out...> >
+{
+public:
+    ChirpBinding(const char *procName) : m_procName(procName), m_connection(0), m_proc(-1) {}
+
+    // Call the procedure synchronously.  Returns CRP_RES_OK or a negative CRP_RES_ERROR_*.
+    // Array and string outs point into the chirp's buffer and are only good until its next call.
+    int call(Chirp *chirp, const In &... in, Out &... out)
+    {
+        int res;
+        void *args[CRP_MAX_ARGS+1];
+
+        if (!chirp->m_connected)
+            return CRP_RES_ERROR_NOT_CONNECTED;
+        if (proc(chirp)<0)
+            return CRP_RES_ERROR;
+
+        // restore buffer in case it was changed
+        chirp->restoreBuffer();
+        // reserve an extra 4 for responseint if we're being called from within a chirp call, same as vserialize()
+        uint32_t i = chirp->m_headerLen + (chirp->m_call ? 4 : 0);
+        uint32_t size = i + ChirpFixedSize<In...>::value + variable(in...);
+        if (size>chirp->m_bufSize-CRP_BUFPAD && (res=chirp->realloc(size))<0)
+            return res;
+        i = write(chirp->m_buf, i, chirp->m_hinformer, in...);
+        chirp->m_len = i - chirp->m_headerLen;
+
+        if ((res=chirp->sendChirpRetry(CRP_CALL, m_proc))!=CRP_RES_OK)
+            return res;
+        if ((res=chirp->recvResponse(args))!=CRP_RES_OK)
+            return res;
+
+        return read(args, out...);
+    }
+
+    // Serialize the in args the same way Chirp::serialize(NULL, buf, bufSize, ...) does.
+    // Returns the length, or CRP_RES_ERROR_MEMORY if buf is too small.
+    static int serialize(uint8_t *buf, uint32_t bufSize, const In &... in)
+    {
+        if (ChirpFixedSize<In...>::value + variable(in...) > bufSize)
+            return CRP_RES_ERROR_MEMORY;
+        return write(buf, 0, true, in...);
+    }
+
+    // Load received args (e.g. from Chirp::deserializeParse()) into the out args
+    static int read(void *args[], Out &... out)
+    {
+        int res = CRP_RES_OK;
+        uint32_t a = 0;
+        int expand[] = {0, (res = res<0 ? res : ChirpArg<Out>::read(args, a, out), 0)...};
+        (void)expand;
+        if (res<0)
+            return res;
+        // if there are args left over, the caller doesn't agree with gotoe about the procedure
+        if (args[a]!=NULL)
+            return CRP_RES_ERROR_PARSE;
+        return CRP_RES_OK;
+    }
+
+    const char *procName() const
+    {
+        return m_procName;
+    }
+
+    // look up the procedure, once per connection
+    ChirpProc proc(Chirp *chirp)
+    {
+        if (m_connection!=chirp->connection() || m_proc<0)
+        {
+            m_proc = chirp->getProc(m_procName);
+            m_connection = chirp->connection();
+        }
+        return m_proc;
+    }
+
+private:
+
+    static uint32_t variable(const In &... in)
+    {
+        uint32_t len = 0;
+        int expand[] = {0, (len += ChirpArg<In>::variable(in), 0)...};
+        (void)expand;
+        return len;
+    }
+
+    static uint32_t write(uint8_t *buf, uint32_t i, bool hints, const In &... in)
+    {
+        int expand[] = {0, ((hints || !ChirpIsHint<In>::value) ? ChirpArg<In>::write(buf, i, in) : (void)0, 0)...};
+        (void)expand;
+        return i;
+    }
+
+    const char *m_procName;
+    uint32_t m_connection;
+    ChirpProc m_proc;
+};
+
+#endif // CHIRPBINDING_HPP
@@ -0,0 +1,230 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef CMDFRAME_H
+#define CMDFRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include "blockframe.h"
+#include "chirp.hpp"
+
+// Parser for the commands the host sends over the serial interfaces, both the two byte
+// commands and the command frames described in blockframe.h.  Received bytes go in with
+// put(), next() takes out at most one command per call and never waits for more input.
+// A command frame that fails its length or CRC check only costs its sync byte: the parser
+// looks for the next sync right after it, so garbage or a cut off frame doesn't take the
+// good frames behind it along.  A frame that stops coming in halfway is given up with
+// expire() once the link has been quiet for a while.
+
+#define CF_SYNC_BYTE          0xa5  // SER_SYNC_BYTE
+#define CF_BUF_LEN            (2*BF_CMD_FRAME_LEN(BF_MAX_CMD_PAYLOAD))
+
+#define CF_NONE               0
+#define CF_COMMAND            1     // two byte command
+#define CF_FRAME              2     // command frame, wants a response
+
+struct CmdFrame
+{
+    uint8_t seq;
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t data[BF_MAX_CMD_PAYLOAD];
+};
+
+// Handles one command.  A handler with something to return puts up to BF_MAX_CMD_PAYLOAD
+// bytes in resp and their count in *rlen.  Returns BF_RESULT_xxx.
+typedef uint8_t (*CmdHandler)(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen);
+
+// A row of a command table: commands first..last go to handler if their payload is minLen
+// to maxLen bytes.  Like chirp's ProcModule tables, a row with a NULL handler ends the table.
+struct CmdProc
+{
+    uint8_t first;
+    uint8_t last;
+    uint8_t minLen;
+    uint8_t maxLen;
+    CmdHandler handler;
+};
+
+class CmdParser
+{
+public:
+    CmdParser()
+    {
+        reset();
+        m_errors = 0;
+        m_garbage = 0;
+    }
+
+    void reset()
+    {
+        m_start = 0;
+        m_end = 0;
+    }
+
+    uint8_t space()
+    {
+        return CF_BUF_LEN - (m_end-m_start);
+    }
+
+    void put(uint8_t c)
+    {
+        if (m_end==CF_BUF_LEN)
+        {
+            if (m_start==0)
+                return;
+            memmove(m_buf, m_buf+m_start, m_end-m_start);
+            m_end -= m_start;
+            m_start = 0;
+        }
+        m_buf[m_end++] = c;
+    }
+
+    // something is waiting for more bytes
+    bool partial()
+    {
+        return m_end>m_start;
+    }
+
+    // Returns CF_COMMAND or CF_FRAME and fills in frame, or CF_NONE if there's no complete
+    // command yet.  Two byte commands have seq 0 and no payload.
+    int next(CmdFrame *frame)
+    {
+        uint8_t *p;
+        uint16_t len;
+
+        while (m_end>m_start)
+        {
+            p = m_buf + m_start;
+            len = m_end - m_start;
+            if (p[0]==CF_SYNC_BYTE)
+            {
+                if (len<2)
+                    return CF_NONE;
+                // no command has a sync value, so this sync was garbage
+                if (p[1]==CF_SYNC_BYTE || p[1]==BF_CMD_FRAME_SYNC)
+                {
+                    m_garbage++;
+                    m_start++;
+                    continue;
+                }
+                frame->seq = 0;
+                frame->cmd = p[1];
+                frame->len = 0;
+                m_start += 2;
+                return CF_COMMAND;
+            }
+            if (p[0]==BF_CMD_FRAME_SYNC)
+            {
+                if (len>=4 && p[3]>BF_MAX_CMD_PAYLOAD)
+                {
+                    m_errors++;
+                    m_start++;
+                    continue;
+                }
+                if (len<4 || len<BF_CMD_FRAME_LEN(p[3]))
+                    return CF_NONE;
+                len = BF_CMD_FRAME_LEN(p[3]);
+                if (Chirp::calcCrc16(p+1, len-3)!=(p[len-2] | (p[len-1]<<8)))
+                {
+                    m_errors++;
+                    m_start++;
+                    continue;
+                }
+                frame->seq = p[1];
+                frame->cmd = p[2];
+                frame->len = p[3];
+                memcpy(frame->data, p+4, frame->len);
+                m_start += len;
+                return CF_FRAME;
+            }
+            m_garbage++;
+            m_start++;
+        }
+        m_start = m_end = 0;
+        return CF_NONE;
+    }
+
+    // The command at the front isn't going to complete, skip its sync byte so the next
+    // call to next() looks at what came after it.
+    void expire()
+    {
+        if (m_end>m_start)
+        {
+            m_errors++;
+            m_start++;
+        }
+    }
+
+    // command frames with a bad length or CRC, or that never completed
+    uint32_t errors()
+    {
+        return m_errors;
+    }
+
+    // bytes that weren't part of a command
+    uint32_t garbage()
+    {
+        return m_garbage;
+    }
+
+private:
+    uint8_t m_buf[CF_BUF_LEN];
+    uint16_t m_start;
+    uint16_t m_end;
+    uint32_t m_errors;
+    uint32_t m_garbage;
+};
+
+// Runs frame's command through the table.  Returns BF_RESULT_UNKNOWN if no row takes it.
+inline uint8_t cmd_dispatch(const CmdProc *table, const CmdFrame *frame, uint8_t *resp, uint8_t *rlen)
+{
+    *rlen = 0;
+    for (; table->handler; table++)
+    {
+        if (frame->cmd<table->first || frame->cmd>table->last)
+            continue;
+        if (frame->len<table->minLen || frame->len>table->maxLen)
+            return BF_RESULT_LENGTH;
+        return (*table->handler)(frame->cmd, frame->data, frame->len, resp, rlen);
+    }
+    return BF_RESULT_UNKNOWN;
+}
+
+// Encodes a response frame, buf must hold BF_RESPONSE_FRAME_LEN(len) bytes.  Returns its length.
+inline uint16_t cmd_encodeResponse(uint8_t *buf, const CmdFrame *frame, uint8_t result, const uint8_t *data, uint8_t len)
+{
+    uint8_t *p = buf;
+    uint16_t crc;
+
+    *p++ = BF_RESPONSE_MARKER&0xff;
+    *p++ = BF_RESPONSE_MARKER>>8;
+    *p++ = frame->seq;
+    *p++ = frame->cmd;
+    *p++ = result;
+    *p++ = len;
+    memcpy(p, data, len);
+    p += len;
+    crc = Chirp::calcCrc16(buf+2, p-buf-2);
+    *p++ = crc&0xff;
+    *p++ = crc>>8;
+    if ((p-buf)&1)
+        *p++ = 0;
+
+    return p - buf;
+}
+
+#endif // CMDFRAME_H
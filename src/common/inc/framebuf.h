@@ -0,0 +1,107 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+#ifndef _FRAMEBUF_H
+#define _FRAMEBUF_H
+#include <stdint.h>
+#include "cameravals.h"
+#ifdef PIXY
+#include "pixyvals.h"
+#endif
+
+// Frame memory (SRAM1) as slots, each the room for a logged 320x200 frame with the USB/SD
+// header in front, and who has each kept in shared memory.  A slot's state says which core
+// owns it, and only the owner changes it, which hands the slot on:
+//
+//   M4: FREE -> ARMED        lent to the M0 for the next frame it logs
+//   M0: ARMED -> FILLING     processLine() writes the frame into it
+//   M0: FILLING -> READY     the frame is done, the frame end's Qval names the slot
+//   M0: FILLING -> ARMED     the frame was aborted (stop, queue full)
+//   M0: ARMED -> FREE        stopped, the M0 gives back what it didn't use
+//   M4: READY -> SD_WRITING -> FREE, or READY -> FREE
+//   M4: FREE/READY -> USB_SENDING, all slots at once, for a frame or blocks sent over USB
+//
+// USB_SENDING is free again once the M4 does something else, as a chirp reply has gone out
+// by the time the call returns.  A frame the M0 wants to log with no slot armed isn't
+// written (missed).  SRAM1 fits one slot; more would let the M4 write one to the SD card
+// while the M0 fills another, as in the host model, which has three.
+
+#define FB_FREE               0
+#define FB_ARMED              1
+#define FB_FILLING            2
+#define FB_READY              3
+#define FB_SD_WRITING         4
+#define FB_USB_SENDING        5
+
+#define FB_HEADER_SIZE        512   // in front of the frame, for the SD frame header or chirp's
+#define FB_FRAME_SIZE         (CAM_RES2_WIDTH*CAM_RES2_HEIGHT)
+#define FB_SLOT_SIZE          (FB_HEADER_SIZE + FB_FRAME_SIZE)
+#ifdef PIXY
+#define FB_MEM_SIZE           MEM_FRAMES_SIZE
+#else
+#define FB_MEM_SIZE           (3*FB_SLOT_SIZE)
+#endif
+#define FB_MAX_SLOTS          4
+#define FB_SLOTS              (FB_MEM_SIZE/FB_SLOT_SIZE<FB_MAX_SLOTS ? FB_MEM_SIZE/FB_SLOT_SIZE : FB_MAX_SLOTS)
+#define FB_NO_SLOT            0xff
+
+struct FrameBufFields
+{
+    volatile uint8_t state[FB_MAX_SLOTS];
+
+    // by the M0
+    volatile uint32_t filled;
+    volatile uint32_t missed;     // frames to log without a slot armed
+    volatile uint32_t aborted;
+};
+
+#ifdef __cplusplus  // M4 is C++ and hands out the slots
+
+class FrameBuf
+{
+public:
+    FrameBuf(); // all slots free, before the M0 runs
+    ~FrameBuf();
+
+    uint8_t state(uint8_t slot) const;
+    uint8_t *slot(uint8_t slot) const;     // the header's start, the frame is FB_HEADER_SIZE on
+    uint8_t arm();                         // lends the free slots to the M0, returns how many it has
+    bool claim(uint8_t slot, uint8_t owner);
+    void release(uint8_t slot, uint8_t owner);   // only if owner still has it
+    void releaseAll(uint8_t owner);
+    uint8_t *acquireAll(uint8_t owner, uint32_t *size);   // all of the frame memory, NULL if a slot is busy
+    const FrameBufFields *fields() const
+    {
+        return m_fields;
+    }
+
+private:
+    FrameBufFields *m_fields;
+    uint8_t *m_mem;
+};
+
+#else //  M0 is C and fills the slots the M4 arms
+
+uint8_t fb_beginFill(void);     // FB_NO_SLOT if none is armed
+uint8_t *fb_frame(uint8_t slot);
+void fb_endFill(uint8_t slot);
+void fb_abortFill(uint8_t slot);
+void fb_disarm(void);
+
+extern struct FrameBufFields *g_fb;
+extern uint8_t *g_fbMem;
+
+#endif
+
+#endif
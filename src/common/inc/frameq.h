@@ -0,0 +1,252 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef FRAMEQ_H
+#define FRAMEQ_H
+
+#include <stdint.h>
+#include <string.h>
+#include "blockframe.h"
+
+// Queue of encoded frames between the main loop and the serial interrupt.  The main loop
+// encodes each frame into a free slot and publishes it.  The serial interrupt reads
+// published frames oldest first and always finishes a frame before starting the next,
+// so the master never gets blocks of two frames mixed together.  When more than depth
+// frames are waiting, the oldest are dropped, so depth 1 means the master always gets
+// the latest frame.
+//
+// The serial interrupt can preempt the main loop but not the other way around, so the
+// main loop sets m_mutex while it changes which slots are ready, and the interrupt leaves
+// ready slots alone while it's set.  Slots being written or read are owned by one side.
+//
+// Messages (command responses) have slots of their own and are never dropped.  They go
+// out between frames, ahead of any waiting frame.  Only the main loop advances m_msgWrite
+// and only the interrupt advances m_msgRead, so they need no mutex.
+
+#define FQ_SLOTS              (BF_MAX_QUEUED_FRAMES+2)  // queued, one being read, one being written
+
+#define FQ_MSG_SLOTS          4
+#define FQ_MSG_LEN            BF_RESPONSE_FRAME_LEN(BF_MAX_CMD_PAYLOAD)
+
+#define FQ_SLOT_FREE          0
+#define FQ_SLOT_WRITING       1
+#define FQ_SLOT_READY         2
+#define FQ_SLOT_READING       3
+
+class FrameQ
+{
+public:
+    FrameQ(uint16_t slotSize)
+    {
+        m_slotSize = slotSize;
+        m_buf = new uint8_t[FQ_SLOTS*slotSize];
+        m_depth = 1;
+        m_mutex = false;
+        m_published = 0;
+        m_dropped = 0;
+        m_read = -1;
+        m_write = -1;
+        m_msgWrite = 0;
+        m_msgRead = 0;
+        m_msgReading = false;
+        m_msgDropped = 0;
+        for (int i=0; i<FQ_SLOTS; i++)
+        {
+            m_state[i] = FQ_SLOT_FREE;
+            m_len[i] = 0;
+            m_order[i] = 0;
+        }
+    }
+
+    ~FrameQ()
+    {
+        delete [] m_buf;
+    }
+
+    void setDepth(uint8_t depth)
+    {
+        if (depth<1)
+            depth = 1;
+        else if (depth>BF_MAX_QUEUED_FRAMES)
+            depth = BF_MAX_QUEUED_FRAMES;
+        m_depth = depth; // applied at the next publish()
+    }
+
+    uint8_t getDepth()
+    {
+        return m_depth;
+    }
+
+    // main loop: returns a slot of slotSize bytes to encode the next frame into
+    uint8_t *writeBuf()
+    {
+        int i;
+
+        // at most depth slots are ready and one is being read, so one is always free
+        for (i=0; i<FQ_SLOTS; i++)
+        {
+            if (m_state[i]==FQ_SLOT_FREE)
+            {
+                m_state[i] = FQ_SLOT_WRITING;
+                m_write = i;
+                return m_buf + i*m_slotSize;
+            }
+        }
+        return NULL;
+    }
+
+    // main loop: make the slot from writeBuf() available to the serial interrupt
+    void publish(uint16_t len)
+    {
+        int i, oldest, ready;
+
+        if (m_write<0)
+            return;
+
+        m_mutex = true;
+        m_len[m_write] = len;
+        m_order[m_write] = m_published++;
+        m_state[m_write] = FQ_SLOT_READY;
+        m_write = -1;
+
+        // drop stale frames nobody has started reading
+        while (1)
+        {
+            for (i=0, ready=0, oldest=-1; i<FQ_SLOTS; i++)
+            {
+                if (m_state[i]!=FQ_SLOT_READY)
+                    continue;
+                ready++;
+                if (oldest<0 || (int32_t)(m_order[i]-m_order[oldest])<0)
+                    oldest = i;
+            }
+            if (ready<=m_depth)
+                break;
+            m_state[oldest] = FQ_SLOT_FREE;
+            m_dropped++;
+        }
+        m_mutex = false;
+    }
+
+    // main loop: queue a message of up to FQ_MSG_LEN bytes (an even count) to go out before
+    // the next frame.  Returns false if all message slots are waiting.
+    bool publishMessage(const uint8_t *msg, uint16_t len)
+    {
+        uint8_t next = (m_msgWrite+1)%FQ_MSG_SLOTS;
+
+        if (next==m_msgRead || len>FQ_MSG_LEN)
+        {
+            m_msgDropped++;
+            return false;
+        }
+        memcpy(m_msgs[m_msgWrite], msg, len);
+        m_msgLen[m_msgWrite] = len;
+        m_msgWrite = next;
+        return true;
+    }
+
+    // serial interrupt: copy up to len bytes of the current frame or message.  Until the end
+    // of either the count is even, so links that send 16 bits at a time stay aligned.
+    uint32_t read(uint8_t *buf, uint32_t len)
+    {
+        uint32_t n;
+        int i;
+
+        if (m_read<0 && !m_msgReading && m_msgRead!=m_msgWrite)
+        {
+            m_msgReading = true;
+            m_readIndex = 0;
+        }
+        if (m_msgReading)
+        {
+            n = m_msgLen[m_msgRead] - m_readIndex;
+            if (n>len)
+                n = len&~1;
+            memcpy(buf, m_msgs[m_msgRead] + m_readIndex, n);
+            m_readIndex += n;
+            if (m_readIndex>=m_msgLen[m_msgRead])
+            {
+                m_msgReading = false;
+                m_msgRead = (m_msgRead+1)%FQ_MSG_SLOTS;
+            }
+            return n;
+        }
+
+        while (m_read<0)
+        {
+            if (m_mutex)
+                return 0;
+            for (i=0; i<FQ_SLOTS; i++)
+            {
+                if (m_state[i]==FQ_SLOT_READY && (m_read<0 || (int32_t)(m_order[i]-m_order[m_read])<0))
+                    m_read = i;
+            }
+            if (m_read<0)
+                return 0;
+            m_state[m_read] = FQ_SLOT_READING;
+            m_readIndex = 0;
+            if (m_len[m_read]==0) // nothing to send for this frame
+            {
+                m_state[m_read] = FQ_SLOT_FREE;
+                m_read = -1;
+            }
+        }
+
+        n = m_len[m_read] - m_readIndex;
+        if (n>len)
+            n = len&~1;
+        memcpy(buf, m_buf + m_read*m_slotSize + m_readIndex, n);
+        m_readIndex += n;
+        if (m_readIndex>=m_len[m_read])
+        {
+            m_state[m_read] = FQ_SLOT_FREE;
+            m_read = -1;
+        }
+        return n;
+    }
+
+    uint32_t dropped()
+    {
+        return m_dropped;
+    }
+
+    uint32_t messagesDropped()
+    {
+        return m_msgDropped;
+    }
+
+private:
+    uint8_t *m_buf;
+    uint16_t m_slotSize;
+    uint8_t m_depth;
+    volatile bool m_mutex;
+    volatile uint8_t m_state[FQ_SLOTS];
+    uint16_t m_len[FQ_SLOTS];
+    uint32_t m_order[FQ_SLOTS];
+    uint32_t m_published;
+    uint32_t m_dropped;
+    volatile int m_read;
+    int m_write;
+    uint16_t m_readIndex;
+
+    uint8_t m_msgs[FQ_MSG_SLOTS][FQ_MSG_LEN];
+    uint16_t m_msgLen[FQ_MSG_SLOTS];
+    volatile uint8_t m_msgWrite;
+    volatile uint8_t m_msgRead;
+    bool m_msgReading;
+    uint32_t m_msgDropped;
+};
+
+#endif // FRAMEQ_H
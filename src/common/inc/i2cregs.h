@@ -0,0 +1,249 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef I2CREGS_H
+#define I2CREGS_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Register map for the register-mapped I2C interface (SER_INTERFACE_I2C_REGS).  The master
+// writes a register address, then either keeps writing (config registers) or does a
+// repeated start and reads, the address increments after every byte:
+//
+//   S addr+W reg [data ...] P              write config registers
+//   S addr+W reg Sr addr+R data ... P      read any registers
+//
+// All registers of one read transaction come from the same frame.  Multi-byte values are
+// little endian.  Config writes take effect from the main loop and read back from the next
+// frame on.  Reads past the end of the map return 0.
+
+#define I2CR_ID                 0x00  // I2CR_ID_VALUE
+#define I2CR_VERSION            0x01
+#define I2CR_FRAME_SEQ          0x02  // uint16, increments every frame, same as the compact frame seq
+#define I2CR_TIMESTAMP          0x04  // uint32, capture time in microseconds
+#define I2CR_BLOB_COUNT         0x08
+#define I2CR_CONFIG             0x09  // I2CR_CONFIG_xxx bits (rw)
+#define I2CR_MIN_AREA           0x0a  // uint16, smallest blob area reported (rw)
+#define I2CR_SPEED              0x0c  // I2CR_SPEED_xxx (rw)
+#define I2CR_MODE               0x0d  // write I2CR_MODE_STREAM to go back to the byte stream (rw)
+#define I2CR_BLOBS              0x10  // I2CR_BLOB_LEN bytes per blob, same order as the block frames
+#define I2CR_BLOB(i)            (I2CR_BLOBS + (i)*I2CR_BLOB_LEN)
+
+// offsets within a blob, uint16 each
+#define I2CR_BLOB_SIGNATURE     0
+#define I2CR_BLOB_X             2
+#define I2CR_BLOB_Y             4
+#define I2CR_BLOB_WIDTH         6
+#define I2CR_BLOB_HEIGHT        8
+#define I2CR_BLOB_LEN           10
+
+#define I2CR_MAX_BLOBS          20
+#define I2CR_SIZE               I2CR_BLOB(I2CR_MAX_BLOBS)
+#define I2CR_CONFIG_FIRST       I2CR_CONFIG
+#define I2CR_CONFIG_LAST        I2CR_MODE
+
+#define I2CR_ID_VALUE           0x50
+#define I2CR_VERSION_VALUE      1
+
+#define I2CR_CONFIG_LOGGING     0x01  // image logging to SD card
+
+#define I2CR_SPEED_100K         0     // standard mode
+#define I2CR_SPEED_400K         1     // fast mode
+#define I2CR_SPEED_1M           2     // fast mode plus
+
+#define I2CR_MODE_STREAM        0
+#define I2CR_MODE_REGISTERS     1
+
+#define I2CR_WRITES             32    // config bytes written by the master, not applied yet
+#define I2CR_COMMIT             0xffff
+
+// The register file shared between the main loop and the I2C interrupt.  Three frame
+// buffers: the interrupt reads the one it latched at the start of a read transaction, the
+// main loop fills one that's neither latched nor the latest, so neither has to wait.  The
+// interrupt can preempt the main loop but not the other way around.
+class I2cRegs
+{
+public:
+    I2cRegs()
+    {
+        int i;
+
+        memset(m_frames, 0, sizeof(m_frames));
+        memset(m_config, 0, sizeof(m_config));
+        m_config[I2CR_MODE-I2CR_CONFIG_FIRST] = I2CR_MODE_REGISTERS;
+        for (i=0; i<3; i++)
+            header(m_frames[i]);
+        m_front = 0;
+        m_latched = 0;
+        m_back = -1;
+        m_addr = 0;
+        m_first = false;
+        m_queued = false;
+        m_written = 0;
+        m_read = 0;
+        m_commits = 0;
+        m_applied = 0;
+    }
+
+    // main loop: a buffer of I2CR_SIZE bytes to fill with the next frame's registers,
+    // everything starting at I2CR_FRAME_SEQ, blobs past the count zeroed
+    uint8_t *frameBuf()
+    {
+        int i;
+
+        // m_latched can change under us, but only to m_front, which we skip anyway
+        for (i=0; i<3 && (i==m_front || i==m_latched); i++);
+        m_back = i;
+        memset(m_frames[i], 0, I2CR_SIZE);
+        return m_frames[i];
+    }
+
+    void publish()
+    {
+        if (m_back<0)
+            return;
+        header(m_frames[m_back]);
+        m_front = m_back;
+        m_back = -1;
+    }
+
+    // main loop: apply the next complete write transaction to the config registers.
+    // Returns false if there isn't one, otherwise the range of config registers written.
+    bool getWrite(uint8_t *first, uint8_t *last)
+    {
+        uint16_t w;
+        bool any = false;
+
+        if (m_applied==m_commits)
+            return false;
+        while (m_read!=m_written)
+        {
+            w = m_writes[m_read];
+            m_read = (m_read+1)%I2CR_WRITES;
+            if (w==I2CR_COMMIT)
+                break;
+            if (!any || (w>>8)<*first)
+                *first = w>>8;
+            if (!any || (w>>8)>*last)
+                *last = w>>8;
+            m_config[(w>>8)-I2CR_CONFIG_FIRST] = w&0xff;
+            any = true;
+        }
+        m_applied++;
+        return any;
+    }
+
+    uint8_t config8(uint8_t reg)
+    {
+        return m_config[reg-I2CR_CONFIG_FIRST];
+    }
+
+    uint16_t config16(uint8_t reg)
+    {
+        return m_config[reg-I2CR_CONFIG_FIRST] | (m_config[reg+1-I2CR_CONFIG_FIRST]<<8);
+    }
+
+    // main loop: report the current state, e.g. when entering register mode
+    void setConfig8(uint8_t reg, uint8_t val)
+    {
+        m_config[reg-I2CR_CONFIG_FIRST] = val;
+    }
+
+    void setConfig16(uint8_t reg, uint16_t val)
+    {
+        m_config[reg-I2CR_CONFIG_FIRST] = val&0xff;
+        m_config[reg+1-I2CR_CONFIG_FIRST] = val>>8;
+    }
+
+    // interrupt: addressed for writing, the first byte is the register address
+    void startWrite()
+    {
+        m_first = true;
+    }
+
+    void write(uint8_t c)
+    {
+        uint8_t next;
+
+        if (m_first)
+        {
+            m_addr = c;
+            m_first = false;
+            return;
+        }
+        // other registers are read-only, leave a slot for the commit marker
+        next = (m_written+1)%I2CR_WRITES;
+        if (m_addr>=I2CR_CONFIG_FIRST && m_addr<=I2CR_CONFIG_LAST && (next+1)%I2CR_WRITES!=m_read)
+        {
+            m_writes[m_written] = (m_addr<<8) | c;
+            m_written = next;
+            m_queued = true;
+        }
+        m_addr++;
+    }
+
+    // interrupt: addressed for reading, from here on until the stop everything comes from one frame
+    void startRead()
+    {
+        m_latched = m_front;
+    }
+
+    uint8_t read()
+    {
+        uint8_t c = m_addr<I2CR_SIZE ? m_frames[m_latched][m_addr] : 0;
+        m_addr++;
+        return c;
+    }
+
+    // interrupt: stop or repeated start
+    void stop()
+    {
+        if (!m_queued) // just setting the address for a read
+            return;
+        m_queued = false;
+        m_writes[m_written] = I2CR_COMMIT;
+        m_written = (m_written+1)%I2CR_WRITES;
+        m_commits++;
+    }
+
+private:
+    void header(uint8_t *regs)
+    {
+        regs[I2CR_ID] = I2CR_ID_VALUE;
+        regs[I2CR_VERSION] = I2CR_VERSION_VALUE;
+        memcpy(regs+I2CR_CONFIG_FIRST, m_config, sizeof(m_config));
+    }
+
+    uint8_t m_frames[3][I2CR_SIZE];
+    uint8_t m_config[I2CR_CONFIG_LAST-I2CR_CONFIG_FIRST+1];  // applied values, main loop only
+    volatile int8_t m_front;
+    volatile int8_t m_latched;
+    int8_t m_back;
+
+    // interrupt state
+    uint8_t m_addr;
+    bool m_first;
+    bool m_queued;
+
+    // config writes, interrupt to main loop
+    uint16_t m_writes[I2CR_WRITES];
+    volatile uint8_t m_written;
+    volatile uint8_t m_read;
+    volatile uint8_t m_commits;
+    uint8_t m_applied;
+};
+
+#endif // I2CREGS_H
@@ -0,0 +1,134 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef PARAMSTORE_H
+#define PARAMSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Keeps values by 16 bit key as a log in a ring of flash sectors.  Every change is a new
+// record at the head, so a value is never written in place and the sectors are erased in
+// turn, evenly.  Records carry a CRC, and one that power loss cut short ends its sector's
+// log.  A batch of changes is a run of records that only counts once the commit record
+// after it is in flash, so all of them take or none do.
+//
+// When the head sector is full the next one is erased and opened, and the live values in
+// the sector after that (the oldest) are copied into it, after which the oldest is marked
+// free.  So there is always a free sector ahead of the head, and live values must fit in
+// half a sector (add() checks).  If power is lost before the copy is done, the next
+// init() finds the oldest sector still in use, drops the unfinished head and lets the
+// next write start over.
+//
+// init() replays the log once into a RAM table, each value next to its key and found
+// through a hash index, so get() is a lookup and never reads flash, which the SPIFI
+// can't do while it is being programmed anyway.
+
+#define PS_MAX_PARAMS         32
+#define PS_MAX_VALUE          24    // bytes
+#define PS_MAX_BATCH          8     // values changed together
+#define PS_MAX_SECTORS        16
+#define PS_INDEX_SIZE         64    // hash slots, a power of 2 of at least twice PS_MAX_PARAMS
+#define PS_SECTOR_MAGIC       0x53505250  // "PRPS"
+#define PS_SECTOR_HEADER_LEN  16
+#define PS_RECORD_HEADER_LEN  6
+#define PS_RECORD_LEN(n)      ((PS_RECORD_HEADER_LEN + (n) + 3)&~3)
+#define PS_KEY_COMMIT         0xfffe      // ends a batch
+#define PS_KEY_ERASED         0xffff
+
+#define PS_OK                 0
+#define PS_ERROR_FLASH        -1    // erase or program failed
+#define PS_ERROR_FULL         -2    // no room for another key
+#define PS_ERROR_KEY          -3    // not added, or reserved
+#define PS_ERROR_VALUE        -4    // too long, or another length than added with
+#define PS_ERROR_BATCH        -5    // too many values, or too many bytes for one sector
+
+typedef int32_t (*FlashEraseFunc)(uint32_t addr, uint32_t len);
+typedef int32_t (*FlashProgramFunc)(uint32_t addr, const uint8_t *data, uint32_t len);
+
+struct ParamFlash
+{
+    const uint8_t *mem;     // where the first sector reads, the flash is memory mapped
+    uint32_t addr;          // of the first sector, for erase and program
+    uint32_t sectorSize;
+    uint8_t sectors;        // 2..PS_MAX_SECTORS
+    FlashEraseFunc erase;
+    FlashProgramFunc program;
+};
+
+struct ParamUpdate
+{
+    uint16_t key;
+    const void *value;
+    uint8_t len;
+};
+
+class ParamStore
+{
+public:
+    ParamStore();
+    // Replays the log, formats the sectors if there is none.  flash is kept.
+    int init(const ParamFlash *flash);
+    // The value in flash if there is one of this length, def otherwise.  Adding a key
+    // again does nothing.
+    int add(uint16_t key, const void *def, uint8_t len);
+    // NULL if the key wasn't added
+    const uint8_t *get(uint16_t key, uint8_t *len=NULL) const;
+    // Writes nothing if the value doesn't change.
+    int set(uint16_t key, const void *value, uint8_t len);
+    // all or none, also through a power loss
+    int set(const ParamUpdate *updates, uint8_t count);
+    // Erases every sector.  The values in RAM stay until the next init().
+    int format();
+    // of the sectors in use, for the tests
+    void eraseCounts(uint32_t *min, uint32_t *max) const;
+    uint32_t records() const;
+
+private:
+    struct Entry
+    {
+        uint16_t key;
+        uint8_t len;
+        bool added;
+        uint32_t addr;      // of its latest record, 0 if only the default
+        uint32_t value[(PS_MAX_VALUE+3)/4];
+    };
+
+    int lookup(uint16_t key) const;
+    Entry *insert(uint16_t key);
+    void apply(uint16_t key, uint32_t addr);
+    const uint8_t *read(uint32_t addr) const;
+    bool readHeader(uint8_t sector, uint32_t *seq, uint32_t *erases) const;
+    void scan(uint8_t sector, bool head);
+    int load();
+    int writeHeader(uint8_t sector, uint32_t seq);
+    int invalidate(uint8_t sector);
+    int append(uint16_t key, uint8_t batch, const void *value, uint8_t len, uint32_t *addr);
+    int open();
+    uint32_t live() const;
+
+    ParamFlash m_flash;
+    Entry m_entries[PS_MAX_PARAMS];
+    uint8_t m_numEntries;
+    uint8_t m_index[PS_INDEX_SIZE];    // entry + 1, 0 empty
+    uint32_t m_seq[PS_MAX_SECTORS];    // 0 free
+    uint32_t m_erases[PS_MAX_SECTORS];
+    uint8_t m_head;
+    uint32_t m_write;                  // offset in the head sector
+    uint8_t m_batch;                   // id of the next batch, never 0
+    uint32_t m_records;                // written since init(), copies included
+};
+
+#endif // PARAMSTORE_H
@@ -0,0 +1,133 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef POSE_H
+#define POSE_H
+
+#include <stdint.h>
+#include "undistort.h"
+
+// Finds the landing pad's beacon constellation among the blobs and estimates where the pad
+// is relative to the camera.  The pad is PO_MIN_MODEL..PO_MAX_MODEL points on a plane, no
+// three in a line, in mm in the pad's own frame (x, y on the pad, z up toward the camera).
+// Blob centers go through the lens' calibration (undistort.h) first.
+//
+// Matching is RANSAC over 4 point correspondences.  Every 4 model points are sorted once,
+// in setModel(), into either a convex quad or a triangle around an inner point, which a
+// perspective view of the pad doesn't change, and the camera always sees the pad's top, so
+// the cyclic order flips the same way for all of them.  A sample of 4 blobs is then only
+// tried against model quads of the same kind, in the 4 (or 3) rotations of their order,
+// and only where the normalized triangle areas, an affine invariant, roughly agree.  Each
+// surviving hypothesis is a homography, the model is projected through it and the blobs
+// within PO_INLIER_TOL pixels count as inliers.  Samples come from a fixed pseudo random
+// sequence (all of them, for few blobs) and samples, hypotheses and pose fits are capped
+// (PO_MAX_SAMPLES, PO_MAX_HYPOTHESES, PO_MAX_FITS), so the time per frame is bounded
+// whatever the image holds.
+//
+// A match is only taken if a rigid pose fits it: the homography is refit to all of the
+// inliers, decomposed with the camera's intrinsics, and Gauss-Newton brings the pose to
+// the least reprojection error, which has to be within PO_MAX_ERROR with the pad no more
+// than acos(PO_MIN_FACING) off facing the camera.  A match of every model point ends the
+// search.  Matches of only 4 (any 4 blobs match some 4 points) are fit once no better
+// one turned up.  A pose is reported only if exactly one match of the most points fits, so
+// the pad must not look the same turned any way.  With a beacon missing the rest may, and
+// then there is no pose.
+
+#define PO_MIN_MODEL          4
+#define PO_MAX_MODEL          6
+#define PO_MAX_POINTS         20    // blobs considered, the largest first
+#define PO_MAX_QUADS          (15*4)  // 4 point subsets of PO_MAX_MODEL points, times rotations
+#define PO_MAX_SAMPLES        256
+#define PO_MAX_HYPOTHESES     256
+#define PO_MIN_INLIERS        4
+#define PO_MAX_CANDIDATES     4     // matches of as many points that a pose fits
+#define PO_MAX_PENDING        16    // matches of just PO_MIN_INLIERS points, held back
+#define PO_MAX_FITS           16    // poses fit to matches
+#define PO_INLIER_TOL         3.0f  // pixels
+#define PO_AFFINE_TOL         0.12f // of the normalized triangle areas, loose to allow for perspective
+#define PO_MAX_SKEW           0.6f  // how far a homography may be from a rotation, see plausible()
+#define PO_ITERATIONS         5     // Gauss-Newton steps of the pose
+#define PO_MAX_ERROR          2.0f  // pixels, rms reprojection error of a pose that is reported
+#define PO_MIN_FACING         0.7f  // cosine of the angle between the pad's z and the optical axis
+
+struct PoseResult
+{
+    bool valid;
+    uint8_t inliers;    // model points matched
+    float x, y, z;      // pad origin in the camera frame (x right, y down, z forward), mm
+    float yaw;          // rotation of the pad's x axis about the optical axis, radians
+    float error;        // rms reprojection error of the inliers, pixels
+    uint16_t samples;   // work done this frame
+    uint16_t hypotheses;
+    uint16_t fits;
+};
+
+class Pose
+{
+public:
+    Pose();
+    // points are x, y pairs in mm, signature 0 takes blobs of any signature.  Returns false
+    // (and keeps the old model) if count is out of range or three points are in a line.
+    bool setModel(const int16_t *points, uint8_t count, uint8_t signature);
+    // the lens, kept by the caller; call again when it changes.  No pose without one.
+    void setCamera(const Undistort *undistort);
+    // blobs as Blobs keeps them, 5 uint16 each (signature, left, right, top, bottom)
+    bool update(const uint16_t *blobs, uint16_t numBlobs);
+    const PoseResult *result();
+
+private:
+    struct Quad
+    {
+        uint8_t index[4];   // model points, in the order the image sees them
+        bool inner;         // index[0] is inside the triangle of the other three
+        float areas[4];     // normalized triangle areas, see invariants()
+        float inverse[9];   // model quad to unit square
+    };
+
+    struct Candidate
+    {
+        float h[9];
+        int8_t match[PO_MAX_MODEL]; // blob of each model point, -1 none
+        uint8_t inliers;
+        float r[9], t[3];   // pose, t in units of m_scale
+        float error;        // rms, pixels
+    };
+
+    uint8_t score(const float *h, const float (*points)[2], uint16_t numPoints, int8_t *match, float *error);
+    bool refine(const float (*points)[2], const int8_t *match, float *h);
+    bool decompose(const float *h, float *r, float *t);
+    float reproject(const float (*points)[2], const int8_t *match, const float *r, const float *t, float *a);
+    float solvePose(const float (*points)[2], const int8_t *match, float *r, float *t);
+    float fit(const float (*points)[2], uint16_t numPoints, Candidate *candidate);
+    void consider(const float (*points)[2], uint16_t numPoints, const float *h, const int8_t *match);
+
+    float m_model[PO_MAX_MODEL][2];  // divided by m_scale
+    uint8_t m_numModel;
+    uint8_t m_signature;
+    float m_scale;
+    Quad m_quads[PO_MAX_QUADS];
+    uint8_t m_numQuads;
+    Candidate m_candidates[PO_MAX_CANDIDATES];
+    uint8_t m_numCandidates;
+    uint8_t m_bestInliers;
+    bool m_overflow;
+    Candidate m_pending[PO_MAX_PENDING];
+    const Undistort *m_undistort;
+    float m_fx, m_fy;
+    uint32_t m_seed;
+    PoseResult m_result;
+};
+
+#endif // POSE_H
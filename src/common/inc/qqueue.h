@@ -29,6 +29,19 @@
 #define QVAL_FRAME_ERROR      0x0ffe
 #define QVAL_FRAME_END        0x0fff
 
+// A line's QVAL_LINE_BEGIN carries how its runs are laid out in m_col_end, so the M4
+// follows the M0 whatever it was asked for when the line was read out.
+#define QVAL_LAYOUT_RUNS      0     // start and end of each run
+#define QVAL_LAYOUT_INTENSITY 1     // each run followed by its intensity, below
+
+// The intensity Qval of a run: its brightest pixel in m_col_start bits 0-7 and the sum of
+// its pixels, 17 bits for a whole line, in bits 8-11 and m_col_end.  m_col_start stays
+// under the markers.
+#define QVAL_INTENSITY_START(peak, sum)  ((peak) | (((sum)>>16)<<8))
+#define QVAL_INTENSITY_END(sum)          ((sum)&0xffff)
+#define QVAL_INTENSITY_PEAK(q)           ((q).m_col_start&0xff)
+#define QVAL_INTENSITY_SUM(q)            ((((uint32_t)(q).m_col_start&0x0f00)<<8) | (q).m_col_end)
+
 #ifdef __cplusplus
 struct Qval
 #else
@@ -0,0 +1,106 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Cooperative scheduler for a program's loop.  The frame task, which takes the M0's run
+// lengths off the queue, runs whenever it is ready.  Otherwise the first background task,
+// in the order added, that is ready and whose cost fits the slack runs, the slack being
+// how long the frame task can wait before the queue may overflow.  A task is never
+// interrupted, so cost must be the longest one run takes; a task that can split its work
+// (the SD card write) gets the slack as a budget and does as much as fits.  Ready tasks
+// that don't fit wait for more slack, they are counted as deferred, and a task that ran
+// past its slack is counted late.  With nothing to run the idle function, which should
+// sleep until the M0 queues more or an interrupt has something for a task, is called and
+// timed, so the share of each frame spent asleep is known.
+
+#define SC_MAX_TASKS          8     // the frame task included
+#define SC_MARGIN             100   // us of the slack kept back, for the dispatch and the clock
+
+typedef int32_t (*SchedFunc)(uint32_t budget);    // us, negative is an error
+typedef bool (*SchedReady)();
+typedef uint32_t (*SchedTime)();                  // us
+typedef void (*SchedIdle)();
+
+struct SchedStats
+{
+    const char *name;
+    uint32_t cost;          // us, as added
+    uint32_t runs;
+    uint32_t deferred;      // ready, but didn't fit the slack
+    uint32_t late;          // ran past the slack
+    uint32_t errors;        // returned negative
+    uint32_t maxUs;
+    uint32_t totalUs;
+};
+
+struct SchedIdleStats
+{
+    uint32_t sleeps;
+    uint32_t maxUs;         // longest sleep
+    uint32_t totalUs;
+    uint32_t frames;        // ended
+    uint16_t lastIdle;      // permille of the last frame asleep
+    uint16_t minIdle;
+    uint32_t sumIdle;       // permille, of all frames
+};
+
+class Scheduler
+{
+public:
+    // clock and slack in us, slack is only asked while the frame task isn't ready
+    Scheduler(SchedTime clock, SchedTime slack);
+    void setFrameTask(const char *name, SchedFunc run, SchedReady ready);
+    // in priority order, cost in us
+    int addTask(const char *name, SchedFunc run, SchedReady ready, uint32_t cost);
+    void setIdle(SchedIdle idle);
+    // Runs one task.  False if none was ready and fit, after the idle function returned.
+    bool dispatch();
+    // by the frame task when a frame is done, for the idle share of each
+    void endFrame();
+    uint8_t tasks() const;
+    const SchedStats *stats(uint8_t task) const;   // 0 the frame task
+    const SchedIdleStats *idleStats() const;
+    void resetStats();
+
+    // us until a queue with free entries can't take the next line, at most perLine entries
+    // per lineUs; the M0 drops a line if fewer than maxLine are free.
+    static uint32_t queueSlack(uint32_t free, uint32_t perLine, uint32_t maxLine, uint32_t lineUs);
+
+private:
+    struct Task
+    {
+        SchedFunc run;
+        SchedReady ready;
+        SchedStats stats;
+    };
+
+    void run(Task *task, uint32_t budget);
+
+    SchedTime m_clock;
+    SchedTime m_slack;
+    SchedIdle m_idle;
+    Task m_tasks[SC_MAX_TASKS];
+    uint8_t m_numTasks;
+    SchedIdleStats m_idleStats;
+    bool m_frameStarted;
+    uint32_t m_frameStart;
+    uint32_t m_frameIdle;              // m_idleStats.totalUs when the frame started
+};
+
+#endif // SCHEDULER_H
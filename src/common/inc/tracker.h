@@ -0,0 +1,88 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <stdint.h>
+
+// Multi-target tracker that runs on the blobs of each frame after blobify().  Blobs are
+// associated with tracks by gated nearest neighbour: the closest blob/track pair with the
+// same signature goes first, pairs further apart than TR_GATE never match.  Each track has
+// a constant velocity alpha-beta filter.  A blob that matches no track starts a tentative
+// track, which is confirmed after TR_CONFIRM_HITS frames in a row and dropped on its first
+// miss before that.  A confirmed track coasts on its prediction for up to TR_MAX_MISSES
+// frames without a blob.  Fixed point throughout: positions in 1/256 pixels, velocities in
+// 1/256 pixels per second.  Each track also keeps which of the last 32 frames it had a blob
+// in, for the beacon decoder (beacons.h).
+
+#define TR_MAX_TRACKS         16    // at most BF_MAX_TRACKS
+#define TR_MAX_BLOBS          20    // MAX_BLOBS
+#define TR_GATE               24    // pixels between a track's prediction and a blob
+#define TR_CONFIRM_HITS       3
+#define TR_MAX_MISSES         5
+#define TR_ALPHA              128   // position gain, /256
+#define TR_BETA               64    // velocity gain, /256
+#define TR_FRAME_PERIOD       20000 // us, nominal, and used when the timestamps don't give a period
+#define TR_MAX_PERIOD         200000
+
+#define TR_SHIFT              8     // fixed point positions and velocities
+
+struct Track
+{
+    uint16_t id;
+    uint16_t signature;
+    int32_t x;
+    int32_t y;
+    int32_t vx;
+    int32_t vy;
+    uint16_t width;
+    uint16_t height;
+    uint16_t age;       // frames since the track started
+    uint8_t hits;       // frames with a blob, up to TR_CONFIRM_HITS
+    uint8_t misses;     // frames in a row without one
+    uint32_t seen;      // bit n set: had a blob n frames ago
+    uint32_t valid;     // bit n set: the camera captured a frame n frames ago
+};
+
+class Tracker
+{
+public:
+    Tracker();
+    void reset();
+    // blobs are 5 words each: signature, left, right, top, bottom (see Blobs::blobify())
+    void update(const uint16_t *blobs, uint16_t numBlobs, uint32_t timestamp);
+    uint16_t getTracks(const Track **tracks);
+    bool confirmed(const Track *track);
+    // blob/track pairs compared in the last update(), for cycle estimates
+    uint32_t pairs();
+
+private:
+    void predict(Track *track);
+    void correct(Track *track, const uint16_t *blob);
+    void start(const uint16_t *blob);
+
+    Track m_tracks[TR_MAX_TRACKS];
+    uint16_t m_numTracks;
+    uint16_t m_nextId;
+    uint32_t m_timestamp;
+    bool m_started;
+    uint32_t m_dtq;     // frame period in seconds, 16 fractional bits
+    uint32_t m_rateq;   // frames per second, 8 fractional bits
+    uint32_t m_cost[TR_MAX_TRACKS][TR_MAX_BLOBS];
+    uint32_t m_pairs;
+};
+
+#endif // TRACKER_H
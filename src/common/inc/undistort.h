@@ -0,0 +1,89 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef UNDISTORT_H
+#define UNDISTORT_H
+
+#include <stdint.h>
+
+// Takes blob centers from distorted pixels to where an ideal pinhole camera would see them,
+// as normalized coordinates (x/z, y/z in the camera frame) or as bearings.  The lens is
+// described by a Calibration, the intrinsics and the radial and tangential distortion
+// coefficients of OpenCV's model (k1, k2, p1, p2, k3), made at any image size with the same
+// aspect as the blob image.  build() inverts the distortion once, in float, at the corners
+// of a grid of UD_STEP pixel cells over the blob image, and keeps the normalized results as
+// fixed point.  A center is then looked up in its cell and interpolated bilinearly, a few
+// multiplies per coordinate and no divide.  Bearings are worked out from that with the
+// FPU's help, there are only as many as blobs sent.  16 pixel cells would be a quarter of
+// the RAM but are off by more than half a pixel at the corners of a wide lens.  The grid's
+// accuracy is checked on the host, see host/calib-tool.
+
+#define UD_WIDTH              320   // blob image, CAM_RES2_WIDTH
+#define UD_HEIGHT             200
+#define UD_STEP_SHIFT         3
+#define UD_STEP               (1<<UD_STEP_SHIFT)  // pixels
+#define UD_COLS               (UD_WIDTH/UD_STEP + 1)
+#define UD_ROWS               ((UD_HEIGHT + UD_STEP - 1)/UD_STEP + 1)
+#define UD_NORM_SHIFT         12    // normalized coordinates in 1/4096
+#define UD_BEARING_SCALE      100   // bearings in 1/100 degrees
+#define UD_ITERATIONS         20    // of the distortion inversion, in build()
+
+// Pixy's lens at 320x200, until the camera is calibrated
+#define UD_DEFAULT_FX         208.0f
+#define UD_DEFAULT_FY         208.0f
+#define UD_DEFAULT_CX         159.5f
+#define UD_DEFAULT_CY         99.5f
+
+#define UD_CAL_MAGIC          0x4c43  // "CL"
+#define UD_CAL_VERSION        1
+
+// As kept in flash and made by host/calib-tool, little endian.  Pixel coordinates have the
+// center of the top left pixel at 0, 0, as OpenCV has them.
+struct Calibration
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t width;     // image size the calibration was made at
+    uint16_t height;
+    float fx, fy, cx, cy;
+    float k1, k2, p1, p2, k3;
+    uint16_t reserved2;
+    uint16_t crc;       // CRC-16/XMODEM of everything before it
+};
+
+class Undistort
+{
+public:
+    Undistort();
+    // NULL for the default pinhole camera.  Returns false (and keeps the grid) if the
+    // calibration doesn't fit the blob image or the distortion doesn't invert.
+    bool build(const Calibration *cal);
+    // x2, y2 are twice the center in blob image pixels, left + right and top + bottom
+    void normalize(uint16_t x2, uint16_t y2, int16_t *x, int16_t *y) const;
+    void bearing(uint16_t x2, uint16_t y2, int16_t *azimuth, int16_t *elevation) const;
+    // focal lengths in blob image pixels, to turn normalized errors into pixels
+    float fx() const;
+    float fy() const;
+    // false for the default camera
+    bool calibrated() const;
+
+private:
+    int16_t m_normal[UD_ROWS*UD_COLS][2];
+    float m_fx, m_fy;
+    bool m_calibrated;
+};
+
+#endif // UNDISTORT_H
@@ -0,0 +1,128 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include "beacons.h"
+
+const uint16_t g_beaconCodes[BC_NUM_CODES] =
+{
+    0x24bf, 0x255f, 0x25e7, 0x266f, 0x26d7, 0x2737, 0x279d, 0x27ab
+};
+
+static inline uint32_t bitCount(uint32_t v)
+{
+    v = v - ((v>>1)&0x55555555);
+    v = (v&0x33333333) + ((v>>2)&0x33333333);
+    return (((v + (v>>4))&0x0f0f0f0f)*0x01010101)>>24;
+}
+
+Beacons::Beacons()
+{
+    reset();
+}
+
+void Beacons::reset()
+{
+    m_numStates = 0;
+}
+
+uint8_t Beacons::decode(uint32_t seen, uint32_t valid, uint8_t *errors)
+{
+    uint8_t i, r;
+    uint32_t code, pattern, e;
+
+    if (bitCount(valid)<BC_MIN_VALID)
+        return 0;
+    for (i=0; i<BC_NUM_CODES; i++)
+    {
+        code = g_beaconCodes[i];
+        for (r=0; r<BC_CODE_BITS; r++)
+        {
+            // the code at phase r, twice, to cover the 32 frames
+            pattern = ((code<<r) | (code>>(BC_CODE_BITS-r)))&0xffff;
+            pattern |= pattern<<16;
+            e = bitCount((pattern ^ seen)&valid);
+            // no other code is this close, see beacons.h
+            if (e<=BC_MAX_ERRORS)
+            {
+                *errors = e;
+                return i+1;
+            }
+        }
+    }
+    return 0;
+}
+
+void Beacons::update(Tracker *tracker)
+{
+    BeaconState states[TR_MAX_TRACKS], *state;
+    const Track *tracks;
+    uint16_t i, j, n;
+    uint8_t code, errors;
+
+    // states follow the tracks by id, tracks that ended lose theirs
+    n = tracker->getTracks(&tracks);
+    for (i=0; i<n; i++)
+    {
+        state = states + i;
+        for (j=0; j<m_numStates && m_states[j].track!=tracks[i].id; j++);
+        if (j<m_numStates)
+            *state = m_states[j];
+        else
+        {
+            state->track = tracks[i].id;
+            state->code = 0;
+            state->hits = 0;
+            state->fails = 0;
+        }
+
+        // after dropped frames there may not be enough to go on, keep what we had
+        if (bitCount(tracks[i].valid)<BC_MIN_VALID)
+            continue;
+        code = decode(tracks[i].seen, tracks[i].valid, &errors);
+        if (code && code==state->code)
+        {
+            if (state->hits<BC_CONFIRM)
+                state->hits++;
+            state->fails = 0;
+        }
+        else if (code)
+        {
+            state->code = code;
+            state->hits = 1;
+            state->fails = 0;
+        }
+        else if (state->code && ++state->fails>BC_MAX_FAILS)
+        {
+            state->code = 0;
+            state->hits = 0;
+            state->fails = 0;
+        }
+    }
+    for (i=0; i<n; i++)
+        m_states[i] = states[i];
+    m_numStates = n;
+}
+
+uint8_t Beacons::id(const Track *track)
+{
+    uint16_t i;
+
+    for (i=0; i<m_numStates; i++)
+    {
+        if (m_states[i].track==track->id)
+            return m_states[i].hits>=BC_CONFIRM ? m_states[i].code : 0;
+    }
+    return 0;
+}
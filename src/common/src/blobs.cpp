@@ -13,12 +13,23 @@
 // end license header
 //
 
+#include <string.h>
 #include "cameravals.h"
 #include "pixy_init.h"
 #include "blobs.h"
+#include "framebuf.h"
+#include "chirp.hpp"
+#include "misc.h"
+
+#if (1<<UD_NORM_SHIFT)!=BF_NORM_SCALE || UD_BEARING_SCALE!=BF_BEARING_SCALE
+#error "undistort.h and blockframe.h disagree on the units"
+#endif
+#if UD_WIDTH!=CAM_RES2_WIDTH || UD_HEIGHT!=CAM_RES2_HEIGHT
+#error "undistort.h is for another blob image size"
+#endif
 
 
-Blobs::Blobs()
+Blobs::Blobs() : m_frameq(BL_FRAME_SLOT_LEN)
 {
     m_mutex = false;
     m_minArea = MIN_AREA;
@@ -28,15 +39,28 @@ Blobs::Blobs()
     m_maxBlob = NULL;
     m_maxCodedDist = MAX_CODED_DIST;
     m_blobs = new uint16_t[MAX_BLOBS*5];
+    m_intensities = new BlobIntensity[MAX_BLOBS];
     m_numBlobs = 0;
-    m_blobReadIndex = 0;
     m_frameBufValid = false;
+    m_frameSlot = FB_NO_SLOT;
+    m_format = BF_FORMAT_LEGACY;
+    m_requestedFormat = BF_FORMAT_LEGACY;
+    m_frameSeq = 0;
+    m_captureTime = 0;
+    m_row = -1;
+    m_layout = QVAL_LAYOUT_RUNS;
+    m_runPending = false;
+    m_segmentRes = 0;
+    memset(m_roi, 0, sizeof(m_roi));
+    m_coords = BF_COORDS_PIXELS;
+    m_pose.setCamera(&m_undistort);
     m_assembler.Reset();
 }
 
 Blobs::~Blobs()
 {
     delete [] m_blobs;
+    delete [] m_intensities;
 }
 
 bool Blobs::frameBufValid()
@@ -44,16 +68,26 @@ bool Blobs::frameBufValid()
     return m_frameBufValid;
 }
 
-int Blobs::handleSegment(uint16_t row, uint16_t startCol, uint16_t endCol)
+uint8_t Blobs::frameSlot()
+{
+    return m_frameSlot;
+}
+
+int Blobs::handleSegment(uint16_t row, uint16_t startCol, uint16_t endCol, uint8_t peak, uint32_t sum)
 {
     SSegment s;
     s.model = 1;
     s.row = row;
     s.startCol = startCol;
     s.endCol = endCol;
+    s.peak = peak;
+    s.sum = sum;
     return m_assembler.Add(s);
 }
 
+// Takes what the M0 has queued so far and returns BL_FRAME_PENDING if the frame isn't
+// complete yet, so the caller can do other work while the M0 reads out the rest.
+//
 // Blob format:
 // 0: model
 // 1: left X edge
@@ -62,16 +96,20 @@ int Blobs::handleSegment(uint16_t row, uint16_t startCol, uint16_t endCol)
 // 4: bottom Y edge
 int Blobs::runlengthAnalysis(Qqueue *qq)
 {
-    int32_t row = -1;
-    int32_t icount = 0;
     Qval qval;
-    int32_t res = 0;
+    int32_t row;
 
     while (true)
     {
-        // Wait for run-length calculations from M0
-        while (qq->dequeue(&qval) == 0)
-        { // Intentionally empty
+        if (qq->dequeue(&qval) == 0)
+            return BL_FRAME_PENDING;
+
+        // M0 hands over run-lengths while the frame is read out, so the first one marks capture time
+        if (m_row == -1)
+        {
+            setTimer(&m_captureTime);
+            m_frameBufValid = false;
+            m_frameSlot = FB_NO_SLOT;
         }
 
         // Break on end of frame or frame error
@@ -80,24 +118,39 @@ int Blobs::runlengthAnalysis(Qqueue *qq)
 
         // Result of handleSegment returns -1 if heap is full.
         // If so, don't add any more segments; just bypass until the end of frame.
-        if (res < 0)
+        if (m_segmentRes < 0)
             continue;
 
-        // Beginning of a new line marker
+        // Beginning of a new line marker, with how the line's runs are laid out
         if ((qval.m_col_start & QVAL_VAL_MASK) == QVAL_LINE_BEGIN)
         {
-            row++;
-            if (icount++ == 5) // an interleave of every 5 lines or about every 175us seems good
-            {
-                g_chirpUsb->service();
-                icount = 0;
-            }
+            m_row++;
+            m_layout = qval.m_col_end;
+            m_runPending = false;
             continue;
         }
 
-        res = handleSegment(row, qval.m_col_start, qval.m_col_end - 1);
+        if (m_layout == QVAL_LAYOUT_INTENSITY)
+        {
+            // a run, then its intensity, which may not be queued yet
+            if (!m_runPending)
+            {
+                m_run = qval;
+                m_runPending = true;
+                continue;
+            }
+            m_runPending = false;
+            m_segmentRes = handleSegment(m_row, m_run.m_col_start, m_run.m_col_end - 1, QVAL_INTENSITY_PEAK(qval),
+                                         QVAL_INTENSITY_SUM(qval));
+        }
+        else
+            m_segmentRes = handleSegment(m_row, qval.m_col_start, qval.m_col_end - 1, 0, 0);
     }
 
+    row = m_row;
+    m_row = -1;
+    m_runPending = false;
+    m_segmentRes = 0;
     if (((qval.m_col_start & QVAL_VAL_MASK) == QVAL_FRAME_ERROR) || // return error if queue overrun
         (row != CAM_RES2_HEIGHT - 1))  // return error if row doesn't match image height
     {
@@ -109,7 +162,10 @@ int Blobs::runlengthAnalysis(Qqueue *qq)
 
     // Check to see if M0 saved the pixels to the frame buffer for M4 to save to SD Card
     if (qval.m_col_start & QVAL_WRITE_FRAME_BIT)
+    {
         m_frameBufValid = true;
+        m_frameSlot = qval.m_col_end;
+    }
 
     return 0;
 }
@@ -121,16 +177,21 @@ int Blobs::blobify(Qqueue *qq)
     uint16_t *blobsStart;
     uint16_t numBlobsStart, invalid, invalid2;
     uint16_t left, top, right, bottom;
+    uint8_t *frame;
+    uint16_t len;
+    int res;
     //uint32_t timer, timer2=0;
 
-    m_frameBufValid = false;
-
-    if (runlengthAnalysis(qq) < 0)
+    if ((res=runlengthAnalysis(qq)) == BL_FRAME_PENDING)
+        return res;
+    if (res < 0)
     {
         printf("Error: frame error detected\n");
         qq->flush();
+        m_assembler.EndFrame(); // blobs the frame left open, so Reset() frees them too
         m_assembler.Reset();
         m_numBlobs = 0;
+        m_frameSeq++; // skip a sequence number so the receiver can tell a frame was dropped
         return -1;
     }
 
@@ -155,13 +216,16 @@ int Blobs::blobify(Qqueue *qq)
         m_blobs[j + 2] = right;
         m_blobs[j + 3] = top;
         m_blobs[j + 4] = bottom;
+        m_intensities[m_numBlobs].m_peak = blob->moments.peak;
+        m_intensities[m_numBlobs].m_sum = blob->moments.sum;
+        m_intensities[m_numBlobs].m_area = blob->moments.area;
         m_numBlobs++;
         j += 5;
     }
     //setTimer(&timer);
     while(1)
     {
-        invalid2 = combine2(blobsStart, m_numBlobs-numBlobsStart);
+        invalid2 = combine2(blobsStart, m_intensities+numBlobsStart, m_numBlobs-numBlobsStart);
         if (invalid2==0)
             break;
         invalid += invalid2;
@@ -169,19 +233,49 @@ int Blobs::blobify(Qqueue *qq)
     //timer2 += getTimer(timer);
 
     //setTimer(&timer);
-    invalid += combine(m_blobs, m_numBlobs);
+    invalid += combine(m_blobs, m_intensities, m_numBlobs);
     if (invalid)
     {
-        invalid2 = compress(m_blobs, m_numBlobs);
+        invalid2 = compress(m_blobs, m_intensities, m_numBlobs);
         m_numBlobs -= invalid2;
     }
     //timer2 += getTimer(timer);
     //cprintf("time=%d\n", timer2); // never seen this greater than 200us.  or 1% of frame period
 
-    // reset read indexes-- new frame
-    m_blobReadIndex = 0;
+    if (m_roi[2])
+        m_numBlobs = applyRoi(m_blobs, m_intensities, m_numBlobs);
+
     m_mutex = false;
 
+    // Queue the whole frame for the serial interfaces, they never see a frame half updated.
+    // Formats only switch between frames.
+    m_format = m_requestedFormat;
+    m_frameSeq++;
+    if (m_format==BF_FORMAT_TRACKS || m_format==BF_FORMAT_BEACONS)
+        m_tracker.update(m_blobs, m_numBlobs, m_captureTime);
+    else
+        m_tracker.reset();
+    if (m_format==BF_FORMAT_BEACONS)
+        m_beacons.update(&m_tracker);
+    else
+        m_beacons.reset();
+    if (m_format==BF_FORMAT_POSE)
+        m_pose.update(m_blobs, m_numBlobs);
+    if ((frame=m_frameq.writeBuf()))
+    {
+        if (m_format==BF_FORMAT_POSE)
+            len = encodePoseFrame(frame);
+        else if (m_format==BF_FORMAT_BEACONS)
+            len = encodeBeaconsFrame(frame);
+        else if (m_format==BF_FORMAT_TRACKS)
+            len = encodeTracksFrame(frame);
+        else if (m_format==BF_FORMAT_COMPACT || m_format==BF_FORMAT_INTENSITY)
+            len = encodeCompactFrame(frame, m_format==BF_FORMAT_INTENSITY);
+        else
+            len = encodeLegacyFrame(frame);
+        m_frameq.publish(len);
+    }
+
     // free memory
     m_assembler.Reset();
 
@@ -189,62 +283,390 @@ int Blobs::blobify(Qqueue *qq)
 }
 
 uint16_t Blobs::getBlock(uint8_t *buf, uint32_t buflen)
+{
+    return m_frameq.read(buf, buflen);
+}
+
+bool Blobs::queueMessage(const uint8_t *msg, uint16_t len)
+{
+    return m_frameq.publishMessage(msg, len);
+}
+
+// Keeps the blobs centered inside the region of interest, in order.  Returns how many.
+uint16_t Blobs::applyRoi(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs)
+{
+    uint16_t i, j, x, y;
+    uint16_t *blob;
+
+    for (i=0, j=0; i<numBlobs; i++)
+    {
+        blob = blobs + i*5;
+        x = (blob[1] + blob[2])/2;
+        y = (blob[3] + blob[4])/2;
+        if (x<m_roi[0] || y<m_roi[1] || x>m_roi[2] || y>m_roi[3])
+            continue;
+        if (i!=j)
+        {
+            memcpy(blobs + j*5, blob, 5*sizeof(uint16_t));
+            intensities[j] = intensities[i];
+        }
+        j++;
+    }
+    return j;
+}
+
+// See blockframe.h for the layout.
+uint16_t Blobs::encodeLegacyFrame(uint8_t *buf)
 {
     uint16_t *buf16 = (uint16_t *)buf;
-    uint16_t temp, width, height;
+    uint16_t i, temp, width, height;
     uint16_t checksum;
-    uint16_t len = 7;  // default
-    int i = m_blobReadIndex*5;
+    uint16_t *blob;
 
-    if (buflen<8*sizeof(uint16_t))
-        return 0;
+    for (i=0; i<m_numBlobs; i++, buf16+=7)
+    {
+        blob = m_blobs + i*5;
 
-    if (m_mutex || m_blobReadIndex>=m_numBlobs) // we're copying, so no blocks for now....
-        return 0;
+        if (i==0) // beginning of frame, mark it with empty block
+            *buf16++ = BL_BEGIN_MARKER;
 
-    if (m_blobReadIndex==0) // beginning of frame, mark it with empty block
-    {
+        // beginning of block
         buf16[0] = BL_BEGIN_MARKER;
-        len++;
-        buf16++;
+
+        // model
+        temp = blob[0];
+        checksum = temp;
+        buf16[2] = temp;
+
+        // width
+        width = blob[2] - blob[1];
+        checksum += width;
+        buf16[5] = width;
+
+        // height
+        height = blob[4] - blob[3];
+        checksum += height;
+        buf16[6] = height;
+
+        // x center
+        temp = blob[1] + width/2;
+        checksum += temp;
+        buf16[3] = temp;
+
+        // y center
+        temp = blob[3] + height/2;
+        checksum += temp;
+        buf16[4] = temp;
+
+        buf16[1] = checksum;
+    }
+
+    return (uint8_t *)buf16 - buf;
+}
+
+void Blobs::setBlockFormat(uint8_t format)
+{
+    // takes effect at the next frame, see blobify()
+    m_requestedFormat = format<=BF_FORMAT_INTENSITY ? format : BF_FORMAT_LEGACY;
+}
+
+bool Blobs::setPad(const int16_t *points, uint8_t count, uint8_t signature)
+{
+    return m_pose.setModel(points, count, signature);
+}
+
+// NULL for the default lens.  Builds the correction grid, so not for every frame.
+bool Blobs::setCalibration(const Calibration *cal)
+{
+    bool result = m_undistort.build(cal);
+
+    m_pose.setCamera(&m_undistort);
+    return result;
+}
+
+// BF_COORDS_xxx, takes effect at the next frame
+bool Blobs::setCoords(uint8_t coords)
+{
+    if (coords>BF_COORDS_BEARINGS)
+        return false;
+    m_coords = coords;
+    return true;
+}
+
+void Blobs::setFrameDepth(uint8_t depth)
+{
+    m_frameq.setDepth(depth);
+}
+
+void Blobs::setMinArea(uint32_t area)
+{
+    m_minArea = area;
+}
+
+uint32_t Blobs::getMinArea()
+{
+    return m_minArea;
+}
+
+void Blobs::setMergeDist(uint16_t dist)
+{
+    m_mergeDist = dist;
+}
+
+// Region of interest in image coordinates, inclusive.  right 0 means the whole image.
+// Takes effect at the next frame.
+void Blobs::setRoi(uint16_t left, uint16_t top, uint16_t right, uint16_t bottom)
+{
+    m_roi[0] = left;
+    m_roi[1] = top;
+    m_roi[2] = right;
+    m_roi[3] = bottom;
+}
+
+static void putRegister16(uint8_t *regs, uint8_t addr, uint16_t val)
+{
+    regs[addr] = val&0xff;
+    regs[addr+1] = val>>8;
+}
+
+// Fills the frame part of a register map (see i2cregs.h) from the last frame.  Fields are
+// the same as encodeLegacyFrame() sends.  Called from the main loop after blobify().
+void Blobs::encodeRegisters(uint8_t *regs)
+{
+    uint16_t i, n, width, height;
+    uint16_t *blob;
+    uint8_t *reg;
+
+    n = m_numBlobs<I2CR_MAX_BLOBS ? m_numBlobs : I2CR_MAX_BLOBS;
+    putRegister16(regs, I2CR_FRAME_SEQ, m_frameSeq);
+    putRegister16(regs, I2CR_TIMESTAMP, m_captureTime&0xffff);
+    putRegister16(regs, I2CR_TIMESTAMP+2, m_captureTime>>16);
+    regs[I2CR_BLOB_COUNT] = n;
+
+    for (i=0; i<n; i++)
+    {
+        blob = m_blobs + i*5;
+        reg = regs + I2CR_BLOB(i);
+        width = blob[2] - blob[1];
+        height = blob[4] - blob[3];
+        putRegister16(reg, I2CR_BLOB_SIGNATURE, blob[0]);
+        putRegister16(reg, I2CR_BLOB_X, blob[1] + width/2);
+        putRegister16(reg, I2CR_BLOB_Y, blob[3] + height/2);
+        putRegister16(reg, I2CR_BLOB_WIDTH, width);
+        putRegister16(reg, I2CR_BLOB_HEIGHT, height);
     }
+}
 
-    // beginning of block
-    buf16[0] = BL_BEGIN_MARKER;
+// Fills the BF_CMD_GET_STATUS response (see blockframe.h), all but BF_STATUS_LOGGING.
+void Blobs::encodeStatus(uint8_t *status)
+{
+    uint32_t dropped = m_frameq.dropped();
+    int i;
 
-    // model
-    temp = m_blobs[i];
-    checksum = temp;
-    buf16[2] = temp;
+    putRegister16(status, BF_STATUS_FRAME_SEQ, m_frameSeq);
+    status[BF_STATUS_FORMAT] = m_requestedFormat;
+    status[BF_STATUS_FRAME_DEPTH] = m_frameq.getDepth();
+    putRegister16(status, BF_STATUS_MIN_AREA, m_minArea>0xffff ? 0xffff : m_minArea);
+    for (i=0; i<4; i++)
+        putRegister16(status, BF_STATUS_ROI + i*2, m_roi[i]);
+    putRegister16(status, BF_STATUS_DROPPED, dropped&0xffff);
+    putRegister16(status, BF_STATUS_DROPPED+2, dropped>>16);
+    status[BF_STATUS_COORDS] = m_coords;
+}
+
+static uint8_t *putVarint(uint8_t *p, uint32_t val)
+{
+    while (val>=0x80)
+    {
+        *p++ = (val&0x7f) | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+    return p;
+}
 
-    // width
-    width = m_blobs[i+2] - m_blobs[i+1];
-    checksum += width;
-    buf16[5] = width;
+// marker, seq and timestamp of the compact, tracks, beacons and pose formats
+uint8_t *Blobs::putFrameHeader(uint8_t *p, uint16_t marker)
+{
+    *p++ = marker&0xff;
+    *p++ = marker>>8;
+    *p++ = m_frameSeq&0xff;
+    *p++ = m_frameSeq>>8;
+    *p++ = m_captureTime&0xff;
+    *p++ = (m_captureTime>>8)&0xff;
+    *p++ = (m_captureTime>>16)&0xff;
+    *p++ = m_captureTime>>24;
+    return p;
+}
 
-    // height
-    height = m_blobs[i+4] - m_blobs[i+3];
-    checksum += height;
-    buf16[6] = height;
+// Appends the CRC of everything after the marker and returns the frame length.
+static uint16_t putFrameCrc(uint8_t *buf, uint8_t *p)
+{
+    uint16_t crc = Chirp::calcCrc16(buf+2, p-buf-2);
 
-    // x center
-    temp = m_blobs[i+1] + width/2;
-    checksum += temp;
-    buf16[3] = temp;
+    *p++ = crc&0xff;
+    *p++ = crc>>8;
+    if ((p-buf)&1) // keep word alignment for SPI
+        *p++ = 0;
 
-    // y center
-    temp = m_blobs[i+3] + height/2;
-    checksum += temp;
-    buf16[4] = temp;
+    return p-buf;
+}
 
-    buf16[1] = checksum;
+// See blockframe.h for the layout.  Fields are the same as encodeLegacyFrame() sends, the
+// center undistorted if the host asked for that.  With intensity it's the intensity
+// format, the same records with the blob's peak, mean and flags after them.
+uint16_t Blobs::encodeCompactFrame(uint8_t *buf, bool intensity)
+{
+    uint8_t *p = buf;
+    uint16_t i, width, height;
+    int16_t x, y, prevX = 0, prevY = 0;
+    uint16_t prevSig = 0;
+    uint16_t *blob;
+    BlobIntensity *in;
 
-    // next blob
-    m_blobReadIndex++;
+    p = putFrameHeader(p, intensity ? BF_INTENSITY_MARKER : BF_COMPACT_MARKER);
+    *p++ = m_numBlobs;
 
-    return len*sizeof(uint16_t);
+    for (i=0; i<m_numBlobs; i++)
+    {
+        blob = m_blobs + i*5;
+        width = blob[2] - blob[1];
+        height = blob[4] - blob[3];
+        if (m_coords==BF_COORDS_NORMALIZED)
+            m_undistort.normalize(blob[1] + blob[2], blob[3] + blob[4], &x, &y);
+        else if (m_coords==BF_COORDS_BEARINGS)
+            m_undistort.bearing(blob[1] + blob[2], blob[3] + blob[4], &x, &y);
+        else
+        {
+            x = blob[1] + width/2;
+            y = blob[3] + height/2;
+        }
+
+        p = putVarint(p, BF_ZIGZAG((int32_t)blob[0] - prevSig));
+        p = putVarint(p, BF_ZIGZAG((int32_t)x - prevX));
+        p = putVarint(p, BF_ZIGZAG((int32_t)y - prevY));
+        p = putVarint(p, width);
+        p = putVarint(p, height);
+        if (intensity)
+        {
+            in = m_intensities + i;
+            p = putVarint(p, in->m_peak);
+            p = putVarint(p, in->m_area ? (in->m_sum + in->m_area/2)/in->m_area : 0);
+            p = putVarint(p, in->m_peak>=BF_SATURATED_LEVEL ? BF_INTENSITY_SATURATED : 0);
+        }
+
+        prevSig = blob[0];
+        prevX = x;
+        prevY = y;
+    }
+
+    return putFrameCrc(buf, p);
+}
+
+// See blockframe.h for the layout.  Only confirmed tracks are sent, oldest first.
+uint16_t Blobs::encodeTracksFrame(uint8_t *buf)
+{
+    uint8_t *p = buf, *count;
+    uint16_t i, n, prevId = 0;
+    int32_t x, y, vx, vy;
+    const Track *tracks, *track;
+
+    p = putFrameHeader(p, BF_TRACKS_MARKER);
+    count = p++;
+
+    n = m_tracker.getTracks(&tracks);
+    for (i=0, *count=0; i<n; i++)
+    {
+        track = tracks + i;
+        if (!m_tracker.confirmed(track))
+            continue;
+        // 1/BF_TRACK_POS_SCALE pixels, coasting tracks can leave the image
+        x = track->x>>(TR_SHIFT-2);
+        y = track->y>>(TR_SHIFT-2);
+        vx = track->vx>>TR_SHIFT;
+        vy = track->vy>>TR_SHIFT;
+        vx = vx<-32768 ? -32768 : (vx>32767 ? 32767 : vx);
+        vy = vy<-32768 ? -32768 : (vy>32767 ? 32767 : vy);
+
+        p = putVarint(p, BF_ZIGZAG((int32_t)track->id - prevId));
+        p = putVarint(p, track->signature);
+        p = putVarint(p, x<0 ? 0 : x);
+        p = putVarint(p, y<0 ? 0 : y);
+        p = putVarint(p, BF_ZIGZAG(vx));
+        p = putVarint(p, BF_ZIGZAG(vy));
+        p = putVarint(p, track->width);
+        p = putVarint(p, track->height);
+        p = putVarint(p, track->age);
+
+        prevId = track->id;
+        (*count)++;
+    }
+
+    return putFrameCrc(buf, p);
 }
 
+// See blockframe.h for the layout.  Tracks that blink no beacon code are left out.
+uint16_t Blobs::encodeBeaconsFrame(uint8_t *buf)
+{
+    uint8_t *p = buf, *count, beacon;
+    uint16_t i, n;
+    int32_t x, y;
+    const Track *tracks, *track;
+
+    p = putFrameHeader(p, BF_BEACONS_MARKER);
+    count = p++;
+
+    n = m_tracker.getTracks(&tracks);
+    for (i=0, *count=0; i<n; i++)
+    {
+        track = tracks + i;
+        if (!m_tracker.confirmed(track) || (beacon=m_beacons.id(track))==0)
+            continue;
+        x = track->x>>(TR_SHIFT-2);
+        y = track->y>>(TR_SHIFT-2);
+
+        p = putVarint(p, beacon);
+        p = putVarint(p, track->id);
+        p = putVarint(p, track->signature);
+        p = putVarint(p, x<0 ? 0 : x);
+        p = putVarint(p, y<0 ? 0 : y);
+        p = putVarint(p, track->width);
+        p = putVarint(p, track->height);
+        (*count)++;
+    }
+
+    return putFrameCrc(buf, p);
+}
+
+// See blockframe.h for the layout.  No record if the pad wasn't found.
+uint16_t Blobs::encodePoseFrame(uint8_t *buf)
+{
+    uint8_t *p = buf;
+    const PoseResult *pose = m_pose.result();
+    int32_t x, y, yaw;
+    uint32_t z, error;
+
+    p = putFrameHeader(p, BF_POSE_MARKER);
+    *p++ = pose->valid ? 1 : 0;
+
+    if (pose->valid)
+    {
+        x = pose->x<-32767.0f ? -32767 : (pose->x>32767.0f ? 32767 : (int32_t)pose->x);
+        y = pose->y<-32767.0f ? -32767 : (pose->y>32767.0f ? 32767 : (int32_t)pose->y);
+        z = pose->z>65535.0f ? 65535 : (uint32_t)pose->z;
+        yaw = (int32_t)(pose->yaw*(18000.0f/3.14159265f) + 36000.5f)%36000;
+        error = pose->error*BF_POSE_ERROR_SCALE>65535.0f ? 65535 : (uint32_t)(pose->error*BF_POSE_ERROR_SCALE + 0.5f);
+
+        p = putVarint(p, pose->inliers);
+        p = putVarint(p, BF_ZIGZAG(x));
+        p = putVarint(p, BF_ZIGZAG(y));
+        p = putVarint(p, z);
+        p = putVarint(p, yaw);
+        p = putVarint(p, error);
+    }
+
+    return putFrameCrc(buf, p);
+}
 
 BlobA *Blobs::getMaxBlob(uint16_t signature, uint16_t *numBlobs)
 {
@@ -288,7 +710,7 @@ void Blobs::getBlobs(BlobA **blobs, uint32_t *len)
     *len = m_numBlobs;
 }
 
-uint16_t Blobs::compress(uint16_t *blobs, uint16_t numBlobs)
+uint16_t Blobs::compress(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs)
 {
     uint16_t i, ii;
     uint16_t *destination, invalid;
@@ -305,6 +727,7 @@ uint16_t Blobs::compress(uint16_t *blobs, uint16_t numBlobs)
         }
         if (destination)
         {
+            intensities[(destination-blobs)/5] = intensities[i];
             destination[0] = blobs[ii+0];
             destination[1] = blobs[ii+1];
             destination[2] = blobs[ii+2];
@@ -316,7 +739,16 @@ uint16_t Blobs::compress(uint16_t *blobs, uint16_t numBlobs)
     return invalid;
 }
 
-uint16_t Blobs::combine(uint16_t *blobs, uint16_t numBlobs)
+// the pixels of blob from go to blob to, which takes its place
+static void mergeIntensity(BlobIntensity *intensities, uint16_t to, uint16_t from)
+{
+    if (intensities[from].m_peak>intensities[to].m_peak)
+        intensities[to].m_peak = intensities[from].m_peak;
+    intensities[to].m_sum += intensities[from].m_sum;
+    intensities[to].m_area += intensities[from].m_area;
+}
+
+uint16_t Blobs::combine(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs)
 {
     uint16_t i, j, ii, jj, left0, right0, top0, bottom0;
     uint16_t left, right, top, bottom;
@@ -344,12 +776,15 @@ uint16_t Blobs::combine(uint16_t *blobs, uint16_t numBlobs)
             if (left0<=left && right0>=right && top0<=top && bottom0>=bottom)
             {
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
             else if (left<=left0 && right>=right0 && top<=top0 && bottom>=bottom0)
             {
                 blobs[ii+0] = 0; // invalidate
+                mergeIntensity(intensities, j, i);
                 invalid++;
+                break; // what else it encloses, the one enclosing it does too
             }
         }
     }
@@ -357,7 +792,7 @@ uint16_t Blobs::combine(uint16_t *blobs, uint16_t numBlobs)
     return invalid;
 }
 
-uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
+uint16_t Blobs::combine2(uint16_t *blobs, BlobIntensity *intensities, uint16_t numBlobs)
 {
     uint16_t i, j, ii, jj, left0, right0, top0, bottom0;
     uint16_t left, right, top, bottom;
@@ -387,6 +822,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+1] = left;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
             else if (right>=right0 && left-right0<=m_mergeDist &&
@@ -394,6 +830,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+2] = right;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
             else if (top<=top0 && top0-bottom<=m_mergeDist &&
@@ -401,6 +838,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+3] = top;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
             else if (bottom>=bottom0 && top-bottom0<=m_mergeDist &&
@@ -408,6 +846,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+4] = bottom;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
 #else // at least half of a side (the smaller adjacent side) has to overlap
@@ -416,6 +855,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+1] = left;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
             else if (right>=right0 && left-right0<=m_mergeDist &&
@@ -423,6 +863,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+2] = right;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
             else if (top<=top0 && top0-bottom<=m_mergeDist &&
@@ -430,6 +871,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+3] = top;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
             else if (bottom>=bottom0 && top-bottom0<=m_mergeDist &&
@@ -437,6 +879,7 @@ uint16_t Blobs::combine2(uint16_t *blobs, uint16_t numBlobs)
             {
                 blobs[ii+4] = bottom;
                 blobs[jj+0] = 0; // invalidate
+                mergeIntensity(intensities, i, j);
                 invalid++;
             }
 #endif
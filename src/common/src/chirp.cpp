@@ -22,6 +22,117 @@
 // todo yield, sleep() while waiting for sync response
 // todo
 
+// CRC-32 (reflected, polynomial 0xedb88320, same as zlib)
+static const uint32_t g_crc32Table[256] =
+{
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+};
+
+// CRC-16/XMODEM (polynomial 0x1021, initial value 0)
+static const uint16_t g_crc16Table[256] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+
+#ifndef PIXY
+// On the host we process 8 bytes per iteration (slicing-by-8).  Slice n holds the crc of a
+// byte followed by n zero bytes.  Built before main() so there's no race on first use.
+static struct Crc32Slices
+{
+    Crc32Slices()
+    {
+        int i, n;
+        for (i=0; i<256; i++)
+        {
+            table[0][i] = g_crc32Table[i];
+            for (n=1; n<8; n++)
+                table[n][i] = (table[n-1][i]>>8) ^ g_crc32Table[table[n-1][i]&0xff];
+        }
+    }
+    uint32_t table[8][256];
+} g_crc32Slices;
+#endif
+
+// hardware crc-32, installed by the device if it has one
+static Crc32Engine g_crc32Engine = 0;
+
+// bumped every time any chirp (re)connects, so a ChirpProc cached along with connection()
+// can't be mistaken for one from an earlier connection or from another Chirp object
+static uint32_t g_connection = 0;
+
 // assume that destination is aligned on the correct boundary and copy the source byte by byte
 void copyAlign(char *dest, const char *src, int size)
 {
@@ -48,12 +159,21 @@ Chirp::Chirp(bool hinterested, bool client, Link *link)
     m_call = false;
     m_connected = false;
     m_hinformer = false;
+    m_integrity = CRP_INTEGRITY_CRC;
+    m_integrityMode = CRP_INTEGRITY_NONE;
+    m_check = CRP_INTEGRITY_NONE;
     m_hinterested = hinterested;
     m_client = client;
 
     m_procTableSize = CRP_PROCTABLE_LEN;
     m_procTable = new (std::nothrow) ProcTableEntry[m_procTableSize];
     memset(m_procTable, 0, sizeof(ProcTableEntry)*m_procTableSize);
+    // the index and cache are allocated when first needed, many instances never use them
+    m_procIndex = NULL;
+    m_procIndexSize = 0;
+    m_procCache = NULL;
+    m_procCacheLen = 0;
+    m_connection = ++g_connection;
 
     if (link)
         setLink(link);
@@ -72,6 +192,9 @@ Chirp::~Chirp()
         delete[] m_buf;
     }
     delete[] m_procTable;
+    delete[] m_procIndex;
+    clearCache();
+    delete[] m_procCache;
   log("pixydebug: Chirp::~Chirp() returned\n");
 }
 
@@ -86,6 +209,7 @@ int Chirp::setLink(Link *link)
 
   log("pixydebug: Chirp::setLink()\n");
     m_link = link;
+    clearCache();
     m_errorCorrected = m_link->getFlags()&LINK_FLAG_ERROR_CORRECTED;
     m_sharedMem = m_link->getFlags()&LINK_FLAG_SHARED_MEM;
     m_blkSize = m_link->blockSize();
@@ -454,26 +578,11 @@ int Chirp::call(uint8_t service, ChirpProc proc, va_list args)
     // if the service is synchronous, receive response while servicing other calls
     if (!(service&ASYNC))
     {
-        ChirpProc recvProc;
         void *recvArgs[CRP_MAX_ARGS+1];
-        m_link->setTimer(); // set timer, so we can check to see if we're taking too much time
-
-        while(1)
+        if ((res=recvResponse(recvArgs))!=CRP_RES_OK)
         {
-            if ((res=recvChirp(&type, &recvProc, recvArgs, true))==CRP_RES_OK)
-            {
-                if (type&CRP_RESPONSE)
-                    break;
-                else // handle calls as they come in
-                    handleChirp(type, recvProc, (const void **)recvArgs);
-            }
-            else
-            {
-                va_end(arguments);
-                return res;
-            }
-            if (m_link->getTimer()>m_headerTimeout) // we could receive XDATA (for example) and never exit this while loop
-                return CRP_RES_ERROR_RECV_TIMEOUT;
+            va_end(arguments);
+            return res;
         }
 
         // deal with arguments
@@ -502,6 +611,28 @@ int Chirp::call(uint8_t service, ChirpProc proc, va_list args)
     return CRP_RES_OK;
 }
 
+// receive the response to the call we just sent, handling any calls and xdata that arrive first
+int Chirp::recvResponse(void *args[])
+{
+    int res;
+    uint8_t type;
+    ChirpProc recvProc;
+
+    m_link->setTimer(); // set timer, so we can check to see if we're taking too much time
+
+    while(1)
+    {
+        if ((res=recvChirp(&type, &recvProc, args, true))!=CRP_RES_OK)
+            return res;
+        if (type&CRP_RESPONSE)
+            return CRP_RES_OK;
+        else // handle calls as they come in
+            handleChirp(type, recvProc, (const void **)args);
+        if (m_link->getTimer()>m_headerTimeout) // we could receive XDATA (for example) and never exit this while loop
+            return CRP_RES_ERROR_RECV_TIMEOUT;
+    }
+}
+
 int Chirp::call(uint8_t service, ChirpProc proc, ...)
 {
   int result;
@@ -574,7 +705,7 @@ int Chirp::handleChirp(uint8_t type, ChirpProc proc, const void *args[])
         if (type==CRP_CALL_ENUMERATE)
             responseInt = handleEnumerate((char *)args[0], (ChirpProc *)args[1]);
         else if (type==CRP_CALL_INIT)
-            responseInt = handleInit((uint16_t *)args[0], (uint8_t *)args[1]);
+            responseInt = handleInit((uint16_t *)args[0], (uint8_t *)args[1], (uint8_t *)args[2]);
         else if (type==CRP_CALL_ENUMERATE_INFO)
             responseInt = handleEnumerateInfo((ChirpProc *)args[0]);
         else
@@ -662,17 +793,65 @@ int Chirp::reallocTable()
     m_procTable = newProcTable;
     m_procTableSize = newProcTableSize;
 
+    return reindexTable();
+}
+
+// (re)build the hash index over the proc table, at least twice the size of the table
+// so probe sequences stay short and there's always an empty slot to end them
+int Chirp::reindexTable()
+{
+    uint16_t i, size, mask;
+    ChirpProc proc;
+    ChirpProc *newProcIndex;
+
+    for (size=1; size<2*m_procTableSize; size<<=1);
+    newProcIndex = new (std::nothrow) ChirpProc[size];
+    if (newProcIndex==NULL)
+        return CRP_RES_ERROR_MEMORY;
+    memset(newProcIndex, 0xff, sizeof(ChirpProc)*size); // -1 is empty
+    mask = size-1;
+
+    for (proc=0; proc<m_procTableSize; proc++)
+    {
+        if (m_procTable[proc].procName==NULL)
+            continue;
+        for (i=hashName(m_procTable[proc].procName)&mask; newProcIndex[i]>=0; i=(i+1)&mask);
+        newProcIndex[i] = proc;
+    }
+
+    delete [] m_procIndex;
+    m_procIndex = newProcIndex;
+    m_procIndexSize = size;
+
     return CRP_RES_OK;
 }
 
+// FNV-1a
+uint32_t Chirp::hashName(const char *procName)
+{
+    uint32_t hash = 0x811c9dc5;
+
+    while (*procName)
+        hash = (hash^(uint8_t)*procName++)*0x01000193;
+    return hash;
+}
+
 ChirpProc Chirp::lookupTable(const char *procName)
 {
-    ChirpProc i;
+    uint16_t i, mask;
+    ChirpProc proc;
+
+    if (procName==NULL)
+        return -1;
+    if (m_procIndex==NULL && reindexTable()<0)
+        return -1;
+    mask = m_procIndexSize-1;
 
-    for(i=0; i<m_procTableSize; i++)
+    // linear probing, entries are never removed so the first empty slot ends the search
+    for (i=hashName(procName)&mask; (proc=m_procIndex[i])>=0; i=(i+1)&mask)
     {
-        if (m_procTable[i].procName!=NULL && strcmp(m_procTable[i].procName, procName)==0)
-            return i;
+        if (strcmp(m_procTable[proc].procName, procName)==0)
+            return proc;
     }
     return -1;
 }
@@ -691,9 +870,17 @@ ChirpProc Chirp::updateTable(const char *procName, ProcPtr procPtr)
         for (proc=0; proc<m_procTableSize && m_procTable[proc].procName; proc++);
         if (proc==m_procTableSize)
         {
-            reallocTable();
+            if (reallocTable()<0)
+                return -1;
             return updateTable(procName, procPtr);
         }
+
+        // add to index, if lookupTable() could build one
+        if (m_procIndex==NULL)
+            return -1;
+        uint16_t i, mask = m_procIndexSize-1;
+        for (i=hashName(procName)&mask; m_procIndex[i]>=0; i=(i+1)&mask);
+        m_procIndex[i] = proc;
     }
 
     // add to table
@@ -703,13 +890,81 @@ ChirpProc Chirp::updateTable(const char *procName, ProcPtr procPtr)
     return proc;
 }
 
+ChirpProc Chirp::lookupCache(const char *procName)
+{
+    uint16_t i, mask = CRP_PROCCACHE_LEN-1;
+
+    if (procName==NULL || m_procCache==NULL)
+        return -1;
+
+    for (i=hashName(procName)&mask; m_procCache[i].procName; i=(i+1)&mask)
+    {
+        if (strcmp(m_procCache[i].procName, procName)==0)
+            return m_procCache[i].proc;
+    }
+    return -1;
+}
+
+void Chirp::updateCache(const char *procName, ChirpProc proc)
+{
+    uint16_t i, mask = CRP_PROCCACHE_LEN-1;
+    uint32_t len = strlen(procName)+1;
+
+    if (m_procCache==NULL)
+    {
+        m_procCache = new (std::nothrow) ProcCacheEntry[CRP_PROCCACHE_LEN];
+        if (m_procCache==NULL)
+            return;
+        memset(m_procCache, 0, sizeof(ProcCacheEntry)*CRP_PROCCACHE_LEN);
+    }
+    // keep it at most 3/4 full, past that procs are just looked up every time
+    if (m_procCacheLen>=CRP_PROCCACHE_LEN*3/4)
+        return;
+
+    for (i=hashName(procName)&mask; m_procCache[i].procName; i=(i+1)&mask)
+    {
+        if (strcmp(m_procCache[i].procName, procName)==0)
+        {
+            m_procCache[i].proc = proc;
+            return;
+        }
+    }
+
+    // copy the name, the caller's string might not outlive the cache
+    m_procCache[i].procName = new (std::nothrow) char[len];
+    if (m_procCache[i].procName==NULL)
+        return;
+    memcpy(m_procCache[i].procName, procName, len);
+    m_procCache[i].proc = proc;
+    m_procCacheLen++;
+}
+
+// gotoe's procedure indexes can change when it reconnects (e.g. new firmware)
+void Chirp::clearCache()
+{
+    uint16_t i;
+
+    if (m_procCache==NULL)
+        return;
+
+    for (i=0; i<CRP_PROCCACHE_LEN; i++)
+    {
+        delete [] m_procCache[i].procName;
+        m_procCache[i].procName = NULL;
+    }
+    m_procCacheLen = 0;
+}
+
 ChirpProc Chirp::getProc(const char *procName, ProcPtr callback)
 {
     uint32_t res;
     ChirpProc cproc = -1;
 
+    // procs with callbacks are always enumerated so gotoe gets our index
     if (callback)
         cproc = updateTable(procName, callback);
+    else if ((cproc=lookupCache(procName))>=0)
+        return cproc;
 
     if (call(CRP_CALL_ENUMERATE, 0,
              STRING(procName), // send name
@@ -718,7 +973,11 @@ ChirpProc Chirp::getProc(const char *procName, ProcPtr callback)
              &res, // get remote index
              END_IN_ARGS
              )>=0)
+    {
+        if (!callback && (ChirpProc)res>=0)
+            updateCache(procName, res);
         return res;
+    }
 
     // a negative ChirpProc is an error
     return -1;
@@ -733,15 +992,19 @@ int Chirp::remoteInit(bool connect)
     res = call(CRP_CALL_INIT, 0,
                UINT16(connect ? m_blkSize : 0), // send block size
                UINT8(m_hinterested), // send whether we're interested in hints or not
+               UINT8(m_sharedMem ? CRP_INTEGRITY_NONE : m_integrity), // send integrity mode we'd like
                END_OUT_ARGS,
                &responseInt,
-               &hinformer,       // receive whether we should send hints
+               &hinformer,       // receive whether we should send hints, and integrity mode
                END_IN_ARGS
                );
     if (res>=0)
     {
+        clearCache();
+        m_connection = ++g_connection;
         m_connected = connect;
-        m_hinformer = hinformer;
+        m_hinformer = hinformer&CRP_INIT_HINTS;
+        m_integrityMode = connect ? hinformer>>CRP_INIT_INTEGRITY_SHIFT : CRP_INTEGRITY_NONE;
         return responseInt;
     }
     return res;
@@ -797,28 +1060,55 @@ void Chirp::setRecvTimeout(uint32_t timeout)
     m_headerTimeout = timeout;
 }
 
+// set the integrity mode we ask for when connecting (client) or accept (server)
+void Chirp::setIntegrity(uint8_t integrity)
+{
+    m_integrity = integrity;
+}
+
+// returns the integrity mode negotiated with gotoe
+uint8_t Chirp::integrity()
+{
+    return m_integrityMode;
+}
+
+// changes every time we (re)connect, a ChirpProc from getProc() is good as long as this doesn't change
+uint32_t Chirp::connection()
+{
+    return m_connection;
+}
+
 int32_t Chirp::handleEnumerate(char *procName, ChirpProc *callback)
 {
     ChirpProc proc;
     // lookup in table
     proc = lookupTable(procName);
+    if (proc<0)
+        return -1;
     // set remote index in table
     m_procTable[proc].chirpProc = *callback;
 
     return proc;
 }
 
-int32_t Chirp::handleInit(uint16_t *blkSize, uint8_t *hinformer)
+int32_t Chirp::handleInit(uint16_t *blkSize, uint8_t *hinformer, uint8_t *integrity)
 {
     int32_t responseInt;
+    uint8_t mode = CRP_INTEGRITY_NONE;
 
     bool connect = *blkSize ? true : false;
     responseInt = init(connect);
+    clearCache();
+    m_connection = ++g_connection;
     m_connected = connect;
     m_blkSize = *blkSize;  // get block size, write it
     m_hinformer = *hinformer;
+    // older clients don't send an integrity mode (integrity is null) and get the plain hinterested byte back
+    if (connect && integrity && *integrity<=m_integrity && !m_sharedMem)
+        mode = *integrity;
+    m_integrityMode = mode;
 
-    CRP_RETURN(this, UINT8(m_hinterested), END);
+    CRP_RETURN(this, UINT8((uint8_t)m_hinterested | mode<<CRP_INIT_INTEGRITY_SHIFT), END);
 
     return responseInt;
 }
@@ -965,8 +1255,8 @@ int Chirp::vdeserialize(uint8_t *buf, uint32_t len, va_list *args)
 
 int Chirp::getArgList(uint8_t *buf, uint32_t len, uint8_t *argList)
 {
-    uint8_t dataType, size, a;
-    uint32_t i;
+    uint8_t dataType, a;
+    uint32_t i, next;
 
     // parse remaining args
     for(i=0, a=0; i<len; a++)
@@ -976,25 +1266,9 @@ int Chirp::getArgList(uint8_t *buf, uint32_t len, uint8_t *argList)
 
         dataType = buf[i++];
         argList[a] = dataType;
-        size = dataType&0x0f;
-        if (!(dataType&CRP_ARRAY)) // if we're a scalar
-        {
-            ALIGN(i, size);
-            i += dataType&0x0f; // extract size of scalar, add it
-        }
-        else // we're an array
-        {
-            if (dataType==CRP_STRING || dataType==CRP_HSTRING) // string is a special case
-                i += strlen((char *)(buf+i))+1; // +1 include null character
-            else
-            {
-                ALIGN(i, 4);
-                uint32_t len = *(uint32_t *)(buf+i);
-                i += 4;
-                ALIGN(i, size);
-                i += len*size;
-            }
-        }
+        if ((next=parseArg(buf, len, i, dataType, NULL))==0)
+            return CRP_RES_ERROR_PARSE;
+        i = next;
     }
     argList[a] = '\0'; // terminate list
     return CRP_RES_OK;
@@ -1003,8 +1277,9 @@ int Chirp::getArgList(uint8_t *buf, uint32_t len, uint8_t *argList)
 
 int Chirp::deserializeParse(uint8_t *buf, uint32_t len, void *args[])
 {
-    uint8_t dataType, size, a;
-    uint32_t i;
+    uint8_t dataType, a;
+    uint32_t i, next;
+    bool array;
 
     // parse remaining args
     for(i=0, a=0; i<len; a++)
@@ -1013,36 +1288,68 @@ int Chirp::deserializeParse(uint8_t *buf, uint32_t len, void *args[])
             return CRP_RES_ERROR;
 
         dataType = buf[i++];
-        size = dataType&0x0f;
-        if (!(dataType&CRP_ARRAY)) // if we're a scalar
-        {
-            ALIGN(i, size);
-            args[a] = (void *)(buf+i);
-            i += dataType&0x0f; // extract size of scalar, add it
-        }
-        else // we're an array
-        {
-            if (dataType==CRP_STRING || dataType==CRP_HSTRING) // string is a special case
-            {
-                args[a] = (void *)(buf+i);
-                i += strlen((char *)(buf+i))+1; // +1 include null character
-            }
-            else
-            {
-                ALIGN(i, 4);
-                uint32_t len = *(uint32_t *)(buf+i);
-                args[a++] = (void *)(buf+i);
-                i += 4;
-                ALIGN(i, size);
-                args[a] = (void *)(buf+i);
-                i += len*size;
-            }
-        }
+        array = (dataType&CRP_ARRAY) && dataType!=CRP_STRING && dataType!=CRP_HSTRING;
+        if (array && a+1==CRP_MAX_ARGS) // arrays take 2 args, length and pointer
+            return CRP_RES_ERROR;
+        if ((next=parseArg(buf, len, i, dataType, args+a))==0)
+            return CRP_RES_ERROR_PARSE;
+        if (array)
+            a++;
+        i = next;
     }
     args[a] = NULL; // terminate list
     return CRP_RES_OK;
 }
 
+// Find the extent of the argument whose data starts at index i (just after its type byte).
+// Returns the index of the next type byte, or 0 if the argument is malformed or doesn't fit
+// within len.  If args is non-null, the argument pointer(s) are written there.
+uint32_t Chirp::parseArg(uint8_t *buf, uint32_t len, uint32_t i, uint8_t dataType, void *args[])
+{
+    uint8_t size = dataType&0x0f;
+    uint32_t n;
+    uint8_t *end;
+
+    if (!(dataType&CRP_ARRAY)) // if we're a scalar
+    {
+        if (size!=1 && size!=2 && size!=4 && size!=8)
+            return 0;
+        ALIGN(i, size);
+        // the type is rewritten just before the data after padding, getType() depends on it
+        if (i>len || len-i<size || buf[i-1]!=dataType)
+            return 0;
+        if (args)
+            args[0] = (void *)(buf+i);
+        return i+size;
+    }
+    else if (dataType==CRP_STRING || dataType==CRP_HSTRING) // string is a special case
+    {
+        if (i>=len || (end=(uint8_t *)memchr(buf+i, '\0', len-i))==NULL)
+            return 0;
+        if (args)
+            args[0] = (void *)(buf+i);
+        return end-buf+1; // +1 include null character
+    }
+    else // we're an array
+    {
+        if (size!=1 && size!=2 && size!=4 && size!=8)
+            return 0;
+        ALIGN(i, 4);
+        if (i>len || len-i<4 || buf[i-1]!=dataType)
+            return 0;
+        copyAlign((char *)&n, (char *)(buf+i), 4);
+        if (args)
+            args[0] = (void *)(buf+i);
+        i += 4;
+        ALIGN(i, size);
+        if (i>len || n>(len-i)/size)
+            return 0;
+        if (args)
+            args[1] = (void *)(buf+i);
+        return i+n*size;
+    }
+}
+
 uint8_t Chirp::getType(const void *arg)
 {
     return *((uint8_t *)arg - 1);
@@ -1061,15 +1368,76 @@ uint16_t Chirp::calcCrc(uint8_t *buf, uint32_t len)
     return crc;
 }
 
+// pass the previous result as crc to continue a crc over several buffers
+uint16_t Chirp::calcCrc16(const uint8_t *buf, uint32_t len, uint16_t crc)
+{
+    while (len--)
+        crc = (crc<<8) ^ g_crc16Table[((crc>>8) ^ *buf++)&0xff];
+
+    return crc;
+}
+
+// pass the previous result as crc to continue a crc over several buffers
+uint32_t Chirp::calcCrc32(const uint8_t *buf, uint32_t len, uint32_t crc)
+{
+    if (crc==0 && g_crc32Engine)
+        return (*g_crc32Engine)(buf, len);
+
+    crc = ~crc;
+#ifndef PIXY
+    uint32_t lo, hi;
+    const uint32_t (*t)[256] = g_crc32Slices.table;
+
+    // slicing-by-8, assumes a little-endian host
+    for (; len>=8; buf+=8, len-=8)
+    {
+        memcpy(&lo, buf, 4);
+        memcpy(&hi, buf+4, 4);
+        lo ^= crc;
+        crc = t[7][lo&0xff] ^ t[6][(lo>>8)&0xff] ^ t[5][(lo>>16)&0xff] ^ t[4][lo>>24] ^
+                t[3][hi&0xff] ^ t[2][(hi>>8)&0xff] ^ t[1][(hi>>16)&0xff] ^ t[0][hi>>24];
+    }
+#endif
+    while (len--)
+        crc = (crc>>8) ^ g_crc32Table[(crc ^ *buf++)&0xff];
+
+    return ~crc;
+}
+
+void Chirp::setCrc32Engine(Crc32Engine engine)
+{
+    g_crc32Engine = engine;
+}
+
+// check used for the header and data blocks on links that aren't error corrected
+uint16_t Chirp::checksum(const uint8_t *buf, uint32_t len, uint16_t crc)
+{
+    if (m_check==CRP_INTEGRITY_CRC)
+        return calcCrc16(buf, len, crc);
+    return crc + calcCrc((uint8_t *)buf, len);
+}
+
 
 int Chirp::sendFull(uint8_t type, ChirpProc proc)
 {
     int res;
+    uint32_t crc;
 
     *(uint32_t *)m_buf = CRP_START_CODE;
     *(uint8_t *)(m_buf+4) = type;
     *(ChirpProc *)(m_buf+6) = proc;
     *(uint32_t *)(m_buf+8) = m_len;
+
+    // intrinsic chirps (init, enumerate) always go out unchecked so any gotoe can understand them
+    m_check = type&CRP_INTRINSIC || m_sharedMem ? CRP_INTEGRITY_NONE : m_integrityMode;
+    if (m_check==CRP_INTEGRITY_CRC)
+    {
+        // crc-32 trailer follows the data, it rides along with the header if there's room
+        crc = calcCrc32(m_buf, m_headerLen+m_len);
+        if (m_len+m_headerLen+4<=CRP_MAX_HEADER_LEN)
+            copyAlign((char *)(m_buf+m_headerLen+m_len), (char *)&crc, 4);
+    }
+
     // send header
     if ((res=m_link->send(m_buf, CRP_MAX_HEADER_LEN, m_sendTimeout))<0)
         return res;
@@ -1079,6 +1447,11 @@ int Chirp::sendFull(uint8_t type, ChirpProc proc)
         if ((res=m_link->send(m_buf+CRP_MAX_HEADER_LEN, m_len-(CRP_MAX_HEADER_LEN-m_headerLen), m_sendTimeout))<0)
             return res;
     }
+    if (m_check==CRP_INTEGRITY_CRC && m_len+m_headerLen+4>CRP_MAX_HEADER_LEN)
+    {
+        if ((res=m_link->send((uint8_t *)&crc, 4, m_sendTimeout))<0)
+            return res;
+    }
     return CRP_RES_OK;
 }
 
@@ -1095,19 +1468,19 @@ int Chirp::sendHeader(uint8_t type, ChirpProc proc)
     *(uint8_t *)m_buf = type;
     *(uint16_t *)(m_buf+2) = proc;
     *(uint32_t *)(m_buf+4) = m_len;
-    if ((res=m_link->send(m_buf, m_headerLen, m_sendTimeout))<0)
-        return res;
-    crc = calcCrc(m_buf, m_headerLen);
+    m_check = type&CRP_INTRINSIC ? CRP_INTEGRITY_NONE : m_integrityMode;
+    crc = checksum(m_buf, m_headerLen, 0);
 
-    if (m_len>=CRP_MAX_HEADER_LEN)
-        chunk = CRP_MAX_HEADER_LEN;
+    // first chunk of data goes out with the header, the rest is sent by sendData()
+    if (m_len>=CRP_MAX_HEADER_LEN-m_headerLen)
+        chunk = CRP_MAX_HEADER_LEN-m_headerLen;
     else
         chunk = m_len;
-    if (m_link->send(m_buf, chunk, m_sendTimeout)<0)
-        return CRP_RES_ERROR_SEND_TIMEOUT;
+    if ((res=m_link->send(m_buf, m_headerLen+chunk, m_sendTimeout))<0)
+        return res;
 
     // send crc
-    crc += calcCrc(m_buf, chunk);
+    crc = checksum(m_buf+m_headerLen, chunk, crc);
     if (m_link->send((uint8_t *)&crc, 2, m_sendTimeout)<0)
         return CRP_RES_ERROR_SEND_TIMEOUT;
 
@@ -1137,13 +1510,13 @@ int Chirp::sendData()
         else
             chunk = m_len-m_offset;
         // send data
-        if (m_link->send(m_buf+m_offset, chunk, m_sendTimeout)<0)
+        if (m_link->send(m_buf+m_headerLen+m_offset, chunk, m_sendTimeout)<0)
             return CRP_RES_ERROR_SEND_TIMEOUT;
         // send sequence
         if (m_link->send((uint8_t *)&sequence, 1, m_sendTimeout)<0)
             return CRP_RES_ERROR_SEND_TIMEOUT;
         // send crc
-        crc = calcCrc(m_buf+m_offset, chunk) + calcCrc((uint8_t *)&sequence, 1);
+        crc = checksum((uint8_t *)&sequence, 1, checksum(m_buf+m_headerLen+m_offset, chunk, 0));
         if (m_link->send((uint8_t *)&crc, 2, m_sendTimeout)<0)
             return CRP_RES_ERROR_SEND_TIMEOUT;
 
@@ -1210,7 +1583,9 @@ int Chirp::recvHeader(uint8_t *type, ChirpProc *proc, bool wait)
         }
     }
     // receive rest of header
-    if (m_link->receive(m_buf, m_headerLen, m_idleTimeout) < 0) {
+    return_value = m_link->receive(m_buf, m_headerLen, m_idleTimeout);
+
+    if (return_value < 0) {
       return_value = CRP_RES_ERROR_RECV_TIMEOUT;
       goto chirp_recvheader__exit;
     }
@@ -1223,14 +1598,15 @@ int Chirp::recvHeader(uint8_t *type, ChirpProc *proc, bool wait)
     *type = *(uint8_t *)m_buf;
     *proc = *(ChirpProc *)(m_buf+2);
     m_len = *(uint32_t *)(m_buf+4);
-    crc = calcCrc(m_buf, m_headerLen);
+    m_check = *type&CRP_INTRINSIC ? CRP_INTEGRITY_NONE : m_integrityMode;
+    crc = checksum(m_buf, m_headerLen, 0);
 
     if (m_len>=CRP_MAX_HEADER_LEN-m_headerLen)
         chunk = CRP_MAX_HEADER_LEN-m_headerLen;
     else
         chunk = m_len;
 
-    return_value = m_link->receive(m_buf, chunk+2, m_idleTimeout);
+    return_value = m_link->receive(m_buf+m_headerLen, chunk+2, m_idleTimeout);
 
     if (return_value < 0) { // +2 for crc
       goto chirp_recvheader__exit;
@@ -1239,8 +1615,8 @@ int Chirp::recvHeader(uint8_t *type, ChirpProc *proc, bool wait)
       return_value = CRP_RES_ERROR;
       goto chirp_recvheader__exit;
     }
-    copyAlign((char *)&rcrc, (char *)(m_buf+chunk), 2);
-    if (rcrc==crc+calcCrc(m_buf, chunk))
+    copyAlign((char *)&rcrc, (char *)(m_buf+m_headerLen+chunk), 2);
+    if (rcrc==checksum(m_buf+m_headerLen, chunk, crc))
     {
         m_offset = chunk;
         sendAck(true);
@@ -1262,8 +1638,8 @@ chirp_recvheader__exit:
 int Chirp::recvFull(uint8_t *type, ChirpProc *proc, bool wait)
 {
     int res;
-    uint32_t startCode;
-    uint32_t len, recvd;
+    uint32_t startCode, crc;
+    uint32_t len, recvd, trailer;
 
     // receive header, with startcode check to make sure we're synced
     while(1)
@@ -1282,12 +1658,21 @@ int Chirp::recvFull(uint8_t *type, ChirpProc *proc, bool wait)
     *proc = *(ChirpProc *)(m_buf+6);
     m_len = *(uint32_t *)(m_buf+8);
 
-    if (m_len+m_headerLen>m_bufSize && (res=realloc(m_len+m_headerLen))<0)
+    m_check = *type&CRP_INTRINSIC || m_sharedMem ? CRP_INTEGRITY_NONE : m_integrityMode;
+    len = m_len+m_headerLen;
+    // The crc-32 trailer follows the data, as sendFull() sends it: in the header packet if
+    // there's room, else after it, the whole packet if the data ends in it.
+    trailer = len;
+    if (trailer<CRP_MAX_HEADER_LEN && trailer+4>CRP_MAX_HEADER_LEN)
+        trailer = CRP_MAX_HEADER_LEN;
+    if (m_check==CRP_INTEGRITY_CRC)
+        len = trailer+4;
+
+    if (len>m_bufSize && (res=realloc(len))<0)
         return res;
 
-    if (m_len+m_headerLen>recvd && !m_sharedMem)
+    if (len>recvd && !m_sharedMem)
     {
-        len = m_len+m_headerLen;
         while(recvd<len)
         {
             if ((res=m_link->receive(m_buf+recvd, len-recvd, m_idleTimeout))<0)
@@ -1296,6 +1681,13 @@ int Chirp::recvFull(uint8_t *type, ChirpProc *proc, bool wait)
         }
     }
 
+    if (m_check==CRP_INTEGRITY_CRC)
+    {
+        copyAlign((char *)&crc, (char *)(m_buf+trailer), 4);
+        if (crc!=calcCrc32(m_buf, m_headerLen+m_len))
+            return CRP_RES_ERROR_CRC;
+    }
+
     return CRP_RES_OK;
 }
 
@@ -1337,13 +1729,13 @@ int Chirp::recvData()
             chunk = m_blkSize;
         else
             chunk = m_len-m_offset;
-        if (m_link->receive(m_buf+m_offset, chunk+3, m_dataTimeout)<0) // +3 to read sequence, crc
+        if ((res=m_link->receive(m_buf+m_headerLen+m_offset, chunk+3, m_dataTimeout))<0) // +3 to read sequence, crc
             return CRP_RES_ERROR_RECV_TIMEOUT;
         if (res<(int)chunk+3)
             return CRP_RES_ERROR;
-        sequence = *(uint8_t *)(m_buf+m_offset+chunk);
-        copyAlign((char *)&crc, (char *)(m_buf+m_offset+chunk+1), 2);
-        if (crc==calcCrc(m_buf+m_offset, chunk+1))
+        sequence = *(uint8_t *)(m_buf+m_headerLen+m_offset+chunk);
+        copyAlign((char *)&crc, (char *)(m_buf+m_headerLen+m_offset+chunk+1), 2);
+        if (crc==checksum(m_buf+m_headerLen+m_offset, chunk+1, 0))
         {
             if (rsequence==sequence)
             {
@@ -1356,10 +1748,7 @@ int Chirp::recvData()
         else
         {
             sendAck(false);
-            naks++;
-            if (naks<m_maxNak)
-                naks++;
-            else
+            if (++naks>=m_maxNak)
                 return CRP_RES_ERROR_MAX_NAK;
         }
     }
@@ -1377,8 +1766,10 @@ int Chirp::recvAck(bool *ack, uint16_t timeout) // false=nack
 
     if (c==CRP_ACK)
         *ack = true;
-    else
+    else if (c==CRP_NACK)
         *ack = false;
+    else // we're out of sync (e.g. both ends sending), treating this as a nack would keep us resending forever
+        return CRP_RES_ERROR;
 
     return CRP_RES_OK;
 }
@@ -0,0 +1,103 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <string.h>
+#include "framebuf.h"
+
+FrameBuf::FrameBuf()
+{
+#ifdef PIXY
+    m_fields = (FrameBufFields *)MEM_FB_LOC;
+    m_mem = (uint8_t *)MEM_FRAMES_LOC;
+#else
+    m_fields = new FrameBufFields;
+    m_mem = new uint8_t[FB_MEM_SIZE];
+#endif
+    memset((void *)m_fields, 0, sizeof(FrameBufFields));
+}
+
+FrameBuf::~FrameBuf()
+{
+#ifdef PIXY
+#else
+    delete m_fields;
+    delete [] m_mem;
+#endif
+}
+
+uint8_t FrameBuf::state(uint8_t slot) const
+{
+    return slot<FB_SLOTS ? m_fields->state[slot] : FB_FREE;
+}
+
+uint8_t *FrameBuf::slot(uint8_t slot) const
+{
+    return slot<FB_SLOTS ? m_mem + slot*FB_SLOT_SIZE : NULL;
+}
+
+uint8_t FrameBuf::arm()
+{
+    uint8_t i, n;
+
+    for (i=0, n=0; i<FB_SLOTS; i++)
+    {
+        if (m_fields->state[i]==FB_FREE || m_fields->state[i]==FB_USB_SENDING)
+            m_fields->state[i] = FB_ARMED;
+        // the M0 may have taken it already
+        if (m_fields->state[i]==FB_ARMED || m_fields->state[i]==FB_FILLING)
+            n++;
+    }
+    return n;
+}
+
+bool FrameBuf::claim(uint8_t slot, uint8_t owner)
+{
+    if (slot>=FB_SLOTS || m_fields->state[slot]!=FB_READY)
+        return false;
+    m_fields->state[slot] = owner;
+    return true;
+}
+
+void FrameBuf::release(uint8_t slot, uint8_t owner)
+{
+    // ARMED and FILLING are the M0's
+    if (slot<FB_SLOTS && owner!=FB_ARMED && owner!=FB_FILLING && m_fields->state[slot]==owner)
+        m_fields->state[slot] = FB_FREE;
+}
+
+void FrameBuf::releaseAll(uint8_t owner)
+{
+    uint8_t i;
+
+    for (i=0; i<FB_SLOTS; i++)
+        release(i, owner);
+}
+
+uint8_t *FrameBuf::acquireAll(uint8_t owner, uint32_t *size)
+{
+    uint8_t i, state;
+
+    for (i=0; i<FB_SLOTS; i++)
+    {
+        state = m_fields->state[i];
+        if (state!=FB_FREE && state!=FB_READY && state!=FB_USB_SENDING)
+            return NULL;
+    }
+    for (i=0; i<FB_SLOTS; i++)
+        m_fields->state[i] = owner;
+    if (size)
+        *size = FB_MEM_SIZE;
+    return m_mem;
+}
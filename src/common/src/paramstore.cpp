@@ -0,0 +1,490 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <string.h>
+#include "paramstore.h"
+
+// Sector header: uint32 magic, uint32 seq (higher is newer), uint32 erases, uint16 0xffff,
+// uint16 CRC of seq through the 0xffff.  A sector is marked free by clearing its magic,
+// which leaves the erase count readable.
+//
+// Record: uint16 key, uint8 len, uint8 batch (0 none), uint16 CRC of the first 4 bytes
+// and the value, the value, 0xff to the next 4 bytes.
+
+static uint16_t crc16(const uint8_t *buf, uint32_t len, uint16_t crc=0)
+{
+    uint8_t bit;
+
+    while (len--)
+    {
+        crc ^= *buf++<<8;
+        for (bit=0; bit<8; bit++)
+            crc = crc&0x8000 ? (crc<<1)^0x1021 : crc<<1;
+    }
+    return crc;
+}
+
+static uint16_t getUint16(const uint8_t *p)
+{
+    return p[0] | (p[1]<<8);
+}
+
+static uint32_t getUint32(const uint8_t *p)
+{
+    return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static void putUint16(uint8_t *p, uint16_t val)
+{
+    p[0] = val;
+    p[1] = val>>8;
+}
+
+static void putUint32(uint8_t *p, uint32_t val)
+{
+    putUint16(p, val);
+    putUint16(p+2, val>>16);
+}
+
+ParamStore::ParamStore()
+{
+    memset(&m_flash, 0, sizeof(m_flash));
+    m_numEntries = 0;
+    memset(m_index, 0, sizeof(m_index));
+    memset(m_seq, 0, sizeof(m_seq));
+    memset(m_erases, 0, sizeof(m_erases));
+    m_head = 0;
+    m_write = 0;
+    m_batch = 1;
+    m_records = 0;
+}
+
+int ParamStore::init(const ParamFlash *flash)
+{
+    if (flash->sectors<2 || flash->sectors>PS_MAX_SECTORS ||
+        flash->sectorSize<PS_SECTOR_HEADER_LEN + 2*PS_RECORD_LEN(PS_MAX_VALUE))
+        return PS_ERROR_FLASH;
+    m_flash = *flash;
+    return load();
+}
+
+int ParamStore::lookup(uint16_t key) const
+{
+    uint16_t i = ((key*40503u)>>8)&(PS_INDEX_SIZE-1);
+
+    for (; m_index[i]; i=(i+1)&(PS_INDEX_SIZE-1))
+    {
+        if (m_entries[m_index[i]-1].key==key)
+            return m_index[i]-1;
+    }
+    return -1;
+}
+
+ParamStore::Entry *ParamStore::insert(uint16_t key)
+{
+    uint16_t i = ((key*40503u)>>8)&(PS_INDEX_SIZE-1);
+    Entry *e;
+
+    if (m_numEntries==PS_MAX_PARAMS)
+        return NULL;
+    while (m_index[i])
+        i = (i+1)&(PS_INDEX_SIZE-1);
+    e = m_entries + m_numEntries++;
+    m_index[i] = m_numEntries;
+    memset(e, 0, sizeof(*e));
+    e->key = key;
+    return e;
+}
+
+const uint8_t *ParamStore::read(uint32_t addr) const
+{
+    return m_flash.mem + (addr - m_flash.addr);
+}
+
+// False if the header is gone.  seq is 0 if the sector is free.
+bool ParamStore::readHeader(uint8_t sector, uint32_t *seq, uint32_t *erases) const
+{
+    const uint8_t *h = read(m_flash.addr + sector*m_flash.sectorSize);
+
+    if (crc16(h+4, 10)!=getUint16(h+14))
+        return false;
+    *erases = getUint32(h+8);
+    *seq = getUint32(h)==PS_SECTOR_MAGIC ? getUint32(h+4) : 0;
+    return true;
+}
+
+// the record at addr is the key's latest value
+void ParamStore::apply(uint16_t key, uint32_t addr)
+{
+    const uint8_t *r = read(addr);
+    int i = lookup(key);
+    Entry *e = i<0 ? insert(key) : m_entries + i;
+
+    if (e==NULL)
+        return; // more keys in flash than we keep, the extras are dropped
+    e->len = r[2];
+    e->addr = addr;
+    memcpy(e->value, r+PS_RECORD_HEADER_LEN, e->len);
+}
+
+void ParamStore::scan(uint8_t sector, bool head)
+{
+    uint32_t base = m_flash.addr + sector*m_flash.sectorSize, off, pending[PS_MAX_BATCH];
+    uint16_t key, pendingKeys[PS_MAX_BATCH];
+    uint8_t len, batch, pendingBatch = 0, numPending = 0, i;
+    const uint8_t *r;
+
+    for (off=PS_SECTOR_HEADER_LEN; off+PS_RECORD_HEADER_LEN<=m_flash.sectorSize; off+=PS_RECORD_LEN(len))
+    {
+        r = read(base+off);
+        key = getUint16(r);
+        len = r[2];
+        batch = r[3];
+        if (key==PS_KEY_ERASED && len==0xff && batch==0xff && getUint16(r+4)==0xffff)
+            break;
+        // cut short or corrupt, nothing after it can be trusted
+        if (len>PS_MAX_VALUE || off+PS_RECORD_LEN(len)>m_flash.sectorSize ||
+            crc16(r+PS_RECORD_HEADER_LEN, len, crc16(r, 4))!=getUint16(r+4))
+        {
+            off = m_flash.sectorSize;
+            break;
+        }
+        if (batch)
+        {
+            m_batch = batch==0xff ? 1 : batch+1;
+            if (batch!=pendingBatch)
+                numPending = 0;
+            pendingBatch = batch;
+        }
+        else
+            pendingBatch = numPending = 0;
+
+        if (key==PS_KEY_COMMIT)
+        {
+            for (i=0; i<numPending; i++)
+                apply(pendingKeys[i], pending[i]);
+            pendingBatch = numPending = 0;
+        }
+        else if (batch && numPending<PS_MAX_BATCH)
+        {
+            pendingKeys[numPending] = key;
+            pending[numPending++] = base+off;
+        }
+        else if (batch==0)
+            apply(key, base+off);
+    }
+    if (head)
+    {
+        // anything but erased flash after the log means a record was cut short
+        for (m_write=off; off<m_flash.sectorSize && *read(base+off)==0xff; off++);
+        if (off<m_flash.sectorSize)
+            m_write = m_flash.sectorSize;
+    }
+}
+
+int ParamStore::load()
+{
+    uint32_t seq, erases, maxErases = 0, last;
+    uint8_t s, next, numValid = 0;
+    bool known[PS_MAX_SECTORS];
+
+    m_numEntries = 0;
+    memset(m_index, 0, sizeof(m_index));
+    for (s=0; s<m_flash.sectors; s++)
+    {
+        seq = erases = 0;
+        known[s] = readHeader(s, &seq, &erases);
+        m_seq[s] = seq;
+        m_erases[s] = erases;
+        if (seq)
+        {
+            if (numValid==0 || seq>m_seq[m_head])
+                m_head = s;
+            numValid++;
+        }
+        if (erases>maxErases)
+            maxErases = erases;
+    }
+    // a sector whose header is gone was erased at least as often as any other, about
+    for (s=0; s<m_flash.sectors; s++)
+    {
+        if (!known[s])
+            m_erases[s] = maxErases;
+    }
+    if (numValid==0)
+        return format();
+
+    // oldest first
+    for (last=0; true; last=m_seq[next])
+    {
+        for (s=0, next=m_flash.sectors; s<m_flash.sectors; s++)
+        {
+            if (m_seq[s]>last && (next==m_flash.sectors || m_seq[s]<m_seq[next]))
+                next = s;
+        }
+        if (next==m_flash.sectors)
+            break;
+        scan(next, next==m_head);
+    }
+
+    // The head was opened but the oldest sector wasn't copied into it yet.  The head holds
+    // only copies then, so drop it, and the next write opens it again.
+    next = (m_head+1)%m_flash.sectors;
+    if (m_seq[next])
+    {
+        if (invalidate(m_head)<0)
+            return PS_ERROR_FLASH;
+        return load();
+    }
+    return PS_OK;
+}
+
+int ParamStore::writeHeader(uint8_t sector, uint32_t seq)
+{
+    uint8_t h[PS_SECTOR_HEADER_LEN];
+
+    putUint32(h, PS_SECTOR_MAGIC);
+    putUint32(h+4, seq);
+    putUint32(h+8, m_erases[sector]);
+    putUint16(h+12, 0xffff);
+    putUint16(h+14, crc16(h+4, 10));
+    if (m_flash.program(m_flash.addr + sector*m_flash.sectorSize, h, sizeof(h))<0)
+        return PS_ERROR_FLASH;
+    m_seq[sector] = seq;
+    return PS_OK;
+}
+
+int ParamStore::invalidate(uint8_t sector)
+{
+    uint8_t zero[4] = {0, 0, 0, 0};
+
+    m_seq[sector] = 0;
+    return m_flash.program(m_flash.addr + sector*m_flash.sectorSize, zero, sizeof(zero))<0 ? PS_ERROR_FLASH : PS_OK;
+}
+
+int ParamStore::append(uint16_t key, uint8_t batch, const void *value, uint8_t len, uint32_t *addr)
+{
+    uint8_t buf[PS_RECORD_LEN(PS_MAX_VALUE)];
+    uint32_t rlen = PS_RECORD_LEN(len);
+    int res;
+
+    if (m_write+rlen>m_flash.sectorSize && (res=open())<0)
+        return res;
+
+    memset(buf, 0xff, rlen);
+    putUint16(buf, key);
+    buf[2] = len;
+    buf[3] = batch;
+    memcpy(buf+PS_RECORD_HEADER_LEN, value, len);
+    putUint16(buf+4, crc16(buf+PS_RECORD_HEADER_LEN, len, crc16(buf, 4)));
+    *addr = m_flash.addr + m_head*m_flash.sectorSize + m_write;
+    m_records++;
+    if (m_flash.program(*addr, buf, rlen)<0)
+    {
+        m_write = m_flash.sectorSize; // don't know what's there now, start over in the next
+        return PS_ERROR_FLASH;
+    }
+    m_write += rlen;
+    return PS_OK;
+}
+
+// Opens the sector after the head and copies the live values of the one after that, the
+// oldest, so it can be marked free.
+int ParamStore::open()
+{
+    uint8_t next = (m_head+1)%m_flash.sectors, victim = (next+1)%m_flash.sectors, i;
+    uint32_t start, end;
+    int res;
+
+    if (m_flash.erase(m_flash.addr + next*m_flash.sectorSize, m_flash.sectorSize)<0)
+        return PS_ERROR_FLASH;
+    m_erases[next]++;
+    if ((res=writeHeader(next, m_seq[m_head]+1))<0)
+        return res;
+    m_head = next;
+    m_write = PS_SECTOR_HEADER_LEN;
+
+    if (m_seq[victim])
+    {
+        start = m_flash.addr + victim*m_flash.sectorSize;
+        end = start + m_flash.sectorSize;
+        for (i=0; i<m_numEntries; i++)
+        {
+            // live() keeps these within half a sector, so this doesn't get here again
+            if (m_entries[i].addr>=start && m_entries[i].addr<end &&
+                (res=append(m_entries[i].key, 0, m_entries[i].value, m_entries[i].len, &m_entries[i].addr))<0)
+                return res;
+        }
+        if ((res=invalidate(victim))<0)
+            return res;
+    }
+    return PS_OK;
+}
+
+uint32_t ParamStore::live() const
+{
+    uint32_t sum = 0;
+    uint8_t i;
+
+    for (i=0; i<m_numEntries; i++)
+        sum += PS_RECORD_LEN(m_entries[i].len);
+    return sum;
+}
+
+int ParamStore::add(uint16_t key, const void *def, uint8_t len)
+{
+    int i = lookup(key);
+    Entry *e;
+
+    if (key>=PS_KEY_COMMIT)
+        return PS_ERROR_KEY;
+    if (len>PS_MAX_VALUE)
+        return PS_ERROR_VALUE;
+    if (i>=0 && m_entries[i].added)
+        return PS_OK;
+    if (i>=0)
+        e = m_entries + i;
+    else if (live() + PS_RECORD_LEN(len)>(m_flash.sectorSize-PS_SECTOR_HEADER_LEN)/2 || (e=insert(key))==NULL)
+        return PS_ERROR_FULL;
+    // a value of another length is of another type, from another firmware
+    if (e->addr==0 || e->len!=len)
+    {
+        e->len = len;
+        e->addr = 0;
+        memcpy(e->value, def, len);
+    }
+    e->added = true;
+    return PS_OK;
+}
+
+const uint8_t *ParamStore::get(uint16_t key, uint8_t *len) const
+{
+    int i = lookup(key);
+
+    if (i<0 || !m_entries[i].added)
+        return NULL;
+    if (len)
+        *len = m_entries[i].len;
+    return (const uint8_t *)m_entries[i].value;
+}
+
+int ParamStore::set(uint16_t key, const void *value, uint8_t len)
+{
+    int i = lookup(key), res;
+    Entry *e;
+    uint32_t addr;
+
+    if (i<0 || !m_entries[i].added)
+        return PS_ERROR_KEY;
+    e = m_entries + i;
+    if (len!=e->len)
+        return PS_ERROR_VALUE;
+    if (memcmp(e->value, value, len)==0)
+        return PS_OK;
+    if ((res=append(key, 0, value, len, &addr))<0)
+        return res;
+    memcpy(e->value, value, len);
+    e->addr = addr;
+    return PS_OK;
+}
+
+int ParamStore::set(const ParamUpdate *updates, uint8_t count)
+{
+    uint32_t total = PS_RECORD_LEN(0), addr[PS_MAX_BATCH], commit;
+    uint8_t i, batch;
+    int j, res;
+
+    if (count>PS_MAX_BATCH)
+        return PS_ERROR_BATCH;
+    for (i=0; i<count; i++)
+    {
+        j = lookup(updates[i].key);
+        if (j<0 || !m_entries[j].added)
+            return PS_ERROR_KEY;
+        if (updates[i].len!=m_entries[j].len)
+            return PS_ERROR_VALUE;
+        total += PS_RECORD_LEN(updates[i].len);
+    }
+    if (total>(m_flash.sectorSize-PS_SECTOR_HEADER_LEN)/2)
+        return PS_ERROR_BATCH;
+    // the whole batch in one sector, scan() only looks for the commit there
+    if (m_write+total>m_flash.sectorSize && (res=open())<0)
+        return res;
+
+    batch = m_batch;
+    m_batch = m_batch==0xff ? 1 : m_batch+1;
+    for (i=0; i<count; i++)
+    {
+        if ((res=append(updates[i].key, batch, updates[i].value, updates[i].len, addr+i))<0)
+            return res;
+    }
+    if ((res=append(PS_KEY_COMMIT, batch, NULL, 0, &commit))<0)
+        return res;
+
+    for (i=0; i<count; i++)
+    {
+        j = lookup(updates[i].key);
+        memcpy(m_entries[j].value, updates[i].value, updates[i].len);
+        m_entries[j].addr = addr[i];
+    }
+    return PS_OK;
+}
+
+int ParamStore::format()
+{
+    uint8_t s, i, n;
+    Entry e;
+
+    for (s=0; s<m_flash.sectors; s++)
+    {
+        m_seq[s] = 0;
+        if (m_flash.erase(m_flash.addr + s*m_flash.sectorSize, m_flash.sectorSize)<0)
+            return PS_ERROR_FLASH;
+        m_erases[s]++;
+    }
+    m_head = 0;
+    m_write = PS_SECTOR_HEADER_LEN;
+    // keep what was added, forget the rest
+    memset(m_index, 0, sizeof(m_index));
+    for (i=0, n=m_numEntries, m_numEntries=0; i<n; i++)
+    {
+        if (m_entries[i].added)
+        {
+            e = m_entries[i];
+            e.addr = 0;
+            *insert(e.key) = e;
+        }
+    }
+    return writeHeader(0, 1);
+}
+
+void ParamStore::eraseCounts(uint32_t *min, uint32_t *max) const
+{
+    uint8_t s;
+
+    *min = *max = m_erases[0];
+    for (s=1; s<m_flash.sectors; s++)
+    {
+        if (m_erases[s]<*min)
+            *min = m_erases[s];
+        if (m_erases[s]>*max)
+            *max = m_erases[s];
+    }
+}
+
+uint32_t ParamStore::records() const
+{
+    return m_records;
+}
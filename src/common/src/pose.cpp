@@ -0,0 +1,762 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <string.h>
+#include <math.h>
+#include "pose.h"
+
+#define PO_COLLINEAR          0.02f // smallest triangle, of the sum of all four
+#define PO_EXHAUSTIVE_POINTS  10    // up to this many blobs every 4 of them get tried, C(10, 4)<=PO_MAX_SAMPLES
+
+// 1.2 m square with one beacon off center, so the pad's yaw is not ambiguous
+static const int16_t g_defaultModel[] =
+{
+    -600, -600,  600, -600,  600, 600,  -600, 600,  0, 300
+};
+
+// twice the signed area of abc
+static inline float area2(const float *a, const float *b, const float *c)
+{
+    return (b[0]-a[0])*(c[1]-a[1]) - (b[1]-a[1])*(c[0]-a[0]);
+}
+
+// Normalized areas of the triangles left when each point is taken out.  An affine map
+// scales all of them by the same factor, so these stay put under weak perspective.
+static void invariants(const float *p[4], float *areas)
+{
+    float sum;
+
+    areas[0] = fabsf(area2(p[1], p[2], p[3]));
+    areas[1] = fabsf(area2(p[0], p[2], p[3]));
+    areas[2] = fabsf(area2(p[0], p[1], p[3]));
+    areas[3] = fabsf(area2(p[0], p[1], p[2]));
+    sum = areas[0] + areas[1] + areas[2] + areas[3];
+    areas[0] /= sum;
+    areas[1] /= sum;
+    areas[2] /= sum;
+    areas[3] /= sum;
+}
+
+static bool similar(const float *a, const float *b)
+{
+    return fabsf(a[0]-b[0])<PO_AFFINE_TOL && fabsf(a[1]-b[1])<PO_AFFINE_TOL &&
+        fabsf(a[2]-b[2])<PO_AFFINE_TOL && fabsf(a[3]-b[3])<PO_AFFINE_TOL;
+}
+
+// Puts 4 points in order of angle about their centroid, or if one is inside the triangle
+// of the others, that one first and the others in order of angle.  False if three of them
+// are (nearly) in a line.
+static bool arrange(const float *p[4], uint8_t *order, bool *inner)
+{
+    float areas[4], angles[4], cx, cy, a;
+    uint8_t i, j, k, o, first;
+
+    invariants(p, areas);
+    for (i=0; i<4; i++)
+    {
+        if (areas[i]<PO_COLLINEAR)
+            return false;
+    }
+
+    // inside the triangle of the others if on the same side of all three edges
+    *inner = false;
+    for (i=0; i<4 && !*inner; i++)
+    {
+        const float *t[3];
+        for (j=0, k=0; j<4; j++)
+        {
+            if (j!=i)
+                t[k++] = p[j];
+        }
+        a = area2(t[0], t[1], p[i]);
+        if ((a>0)==(area2(t[1], t[2], p[i])>0) && (a>0)==(area2(t[2], t[0], p[i])>0))
+        {
+            *inner = true;
+            order[0] = i;
+        }
+    }
+
+    first = *inner ? 1 : 0;
+    for (i=0, k=first; i<4; i++)
+    {
+        if (!*inner || i!=order[0])
+            order[k++] = i;
+    }
+    for (i=first, cx=cy=0; i<4; i++)
+    {
+        cx += p[order[i]][0];
+        cy += p[order[i]][1];
+    }
+    cx /= 4-first;
+    cy /= 4-first;
+    for (i=first; i<4; i++)
+        angles[i] = atan2f(p[order[i]][1]-cy, p[order[i]][0]-cx);
+    for (i=first+1; i<4; i++)
+    {
+        for (j=i; j>first && angles[j-1]>angles[j]; j--)
+        {
+            a = angles[j]; angles[j] = angles[j-1]; angles[j-1] = a;
+            o = order[j]; order[j] = order[j-1]; order[j-1] = o;
+        }
+    }
+    return true;
+}
+
+// Maps the corners of the unit square (0,0), (1,0), (1,1), (0,1) to p[0..3], row major,
+// after Heckbert.  Any 4 points with no three in a line will do, convex or not.
+static void squareToQuad(const float *p[4], float *m)
+{
+    float sx, sy, dx1, dx2, dy1, dy2, den, g, h;
+
+    sx = p[0][0] - p[1][0] + p[2][0] - p[3][0];
+    sy = p[0][1] - p[1][1] + p[2][1] - p[3][1];
+    dx1 = p[1][0] - p[2][0];
+    dx2 = p[3][0] - p[2][0];
+    dy1 = p[1][1] - p[2][1];
+    dy2 = p[3][1] - p[2][1];
+    den = dx1*dy2 - dx2*dy1;
+    g = (sx*dy2 - dx2*sy)/den;
+    h = (dx1*sy - sx*dy1)/den;
+
+    m[0] = p[1][0] - p[0][0] + g*p[1][0];
+    m[1] = p[3][0] - p[0][0] + h*p[3][0];
+    m[2] = p[0][0];
+    m[3] = p[1][1] - p[0][1] + g*p[1][1];
+    m[4] = p[3][1] - p[0][1] + h*p[3][1];
+    m[5] = p[0][1];
+    m[6] = g;
+    m[7] = h;
+    m[8] = 1.0f;
+}
+
+// the inverse up to scale, which is all a homography needs
+static void adjugate(const float *m, float *a)
+{
+    a[0] = m[4]*m[8] - m[5]*m[7];
+    a[1] = m[2]*m[7] - m[1]*m[8];
+    a[2] = m[1]*m[5] - m[2]*m[4];
+    a[3] = m[5]*m[6] - m[3]*m[8];
+    a[4] = m[0]*m[8] - m[2]*m[6];
+    a[5] = m[2]*m[3] - m[0]*m[5];
+    a[6] = m[3]*m[7] - m[4]*m[6];
+    a[7] = m[1]*m[6] - m[0]*m[7];
+    a[8] = m[0]*m[4] - m[1]*m[3];
+}
+
+static void multiply(const float *a, const float *b, float *c)
+{
+    uint8_t i, j;
+
+    for (i=0; i<3; i++)
+    {
+        for (j=0; j<3; j++)
+            c[i*3+j] = a[i*3]*b[j] + a[i*3+1]*b[3+j] + a[i*3+2]*b[6+j];
+    }
+}
+
+// Gaussian elimination with partial pivoting, a is n rows of n+1 (the right hand side last)
+static bool solve(float *a, uint8_t n, float *x)
+{
+    uint8_t i, j, k, pivot, w = n+1;
+    float f, t;
+
+    for (i=0; i<n; i++)
+    {
+        for (pivot=i, j=i+1; j<n; j++)
+        {
+            if (fabsf(a[j*w+i])>fabsf(a[pivot*w+i]))
+                pivot = j;
+        }
+        if (fabsf(a[pivot*w+i])<1e-12f)
+            return false;
+        if (pivot!=i)
+        {
+            for (k=i; k<w; k++)
+            {
+                t = a[i*w+k]; a[i*w+k] = a[pivot*w+k]; a[pivot*w+k] = t;
+            }
+        }
+        for (j=i+1; j<n; j++)
+        {
+            f = a[j*w+i]/a[i*w+i];
+            for (k=i; k<w; k++)
+                a[j*w+k] -= f*a[i*w+k];
+        }
+    }
+    for (i=n; i-->0;)
+    {
+        for (t=a[i*w+n], k=i+1; k<n; k++)
+            t -= a[i*w+k]*x[k];
+        x[i] = t/a[i*w+i];
+    }
+    return true;
+}
+
+// Accumulates the upper triangle of the normal equations of one residual row
+// (n coefficients, then the residual).
+static void accumulate(float *a, uint8_t n, const float *row)
+{
+    uint8_t i, k, w = n+1;
+
+    for (i=0; i<n; i++)
+    {
+        for (k=i; k<w; k++)
+            a[i*w+k] += row[i]*row[k];
+    }
+}
+
+static void symmetrize(float *a, uint8_t n)
+{
+    uint8_t i, k, w = n+1;
+
+    for (i=1; i<n; i++)
+    {
+        for (k=0; k<i; k++)
+            a[i*w+k] = a[k*w+i];
+    }
+}
+
+// Makes the first two columns of the row major rotation r unit length and orthogonal,
+// moving both the same amount, and the third their cross product.  The unit sum and
+// difference of the columns are at right angles, the columns are halfway between them.
+static bool orthonormalize(float *r)
+{
+    float a[3], b[3], na, nb;
+    uint8_t i;
+
+    for (i=0; i<3; i++)
+    {
+        a[i] = r[i*3] + r[i*3+1];
+        b[i] = r[i*3] - r[i*3+1];
+    }
+    na = sqrtf(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+    nb = sqrtf(b[0]*b[0] + b[1]*b[1] + b[2]*b[2]);
+    if (na<1e-9f || nb<1e-9f)
+        return false;
+    for (i=0; i<3; i++)
+    {
+        a[i] /= na;
+        b[i] /= nb;
+    }
+    na = sqrtf(2.0f + 2.0f*(a[0]*b[0] + a[1]*b[1] + a[2]*b[2]));
+    nb = sqrtf(2.0f - 2.0f*(a[0]*b[0] + a[1]*b[1] + a[2]*b[2]));
+    if (na<1e-9f || nb<1e-9f)
+        return false;
+    for (i=0; i<3; i++)
+    {
+        r[i*3] = (a[i] + b[i])/na;
+        r[i*3+1] = (a[i] - b[i])/nb;
+    }
+    r[2] = r[3]*r[7] - r[6]*r[4];
+    r[5] = r[6]*r[1] - r[0]*r[7];
+    r[8] = r[0]*r[4] - r[3]*r[1];
+    return true;
+}
+
+// A homography of the pad has columns of equal length at right angles (see decompose()),
+// one that is far from that can't be a view of it.
+static bool plausible(const float *h)
+{
+    float n1, n2, dot;
+
+    n1 = sqrtf(h[0]*h[0] + h[3]*h[3] + h[6]*h[6]);
+    n2 = sqrtf(h[1]*h[1] + h[4]*h[4] + h[7]*h[7]);
+    dot = h[0]*h[1] + h[3]*h[4] + h[6]*h[7];
+    return fabsf(n1-n2)<PO_MAX_SKEW*(n1+n2) && fabsf(dot)<PO_MAX_SKEW*n1*n2;
+}
+
+// next 4 of n in lexicographic order, false after the last
+static bool nextCombination(uint8_t *s, uint16_t n)
+{
+    int8_t i;
+    uint8_t j;
+
+    for (i=3; i>=0 && s[i]==n-4+i; i--);
+    if (i<0)
+        return false;
+    s[i]++;
+    for (j=i+1; j<4; j++)
+        s[j] = s[j-1] + 1;
+    return true;
+}
+
+Pose::Pose()
+{
+    m_numModel = 0;
+    m_numQuads = 0;
+    m_seed = 1;
+    memset(&m_result, 0, sizeof(m_result));
+    m_undistort = NULL;
+    m_fx = m_fy = UD_DEFAULT_FX;
+    setModel(g_defaultModel, sizeof(g_defaultModel)/sizeof(int16_t)/2, 0);
+}
+
+void Pose::setCamera(const Undistort *undistort)
+{
+    m_undistort = undistort;
+    m_fx = undistort->fx();
+    m_fy = undistort->fy();
+}
+
+const PoseResult *Pose::result()
+{
+    return &m_result;
+}
+
+
+bool Pose::setModel(const int16_t *points, uint8_t count, uint8_t signature)
+{
+    float model[PO_MAX_MODEL][2], scale, a, m[9];
+    const float *p[4];
+    uint8_t i, j, k, r, rotations, s[4], order[4], seq[4];
+    bool inner;
+    Quad *quad;
+
+    if (count<PO_MIN_MODEL || count>PO_MAX_MODEL)
+        return false;
+
+    // work in units of the pad's size, so the least squares fit is well conditioned
+    for (i=0, scale=0; i<count; i++)
+    {
+        model[i][0] = points[i*2];
+        model[i][1] = points[i*2+1];
+        a = fabsf(model[i][0]) + fabsf(model[i][1]);
+        if (a>scale)
+            scale = a;
+    }
+    if (scale==0)
+        return false;
+    for (i=0; i<count; i++)
+    {
+        model[i][0] /= scale;
+        model[i][1] /= scale;
+    }
+    s[0] = 0; s[1] = 1; s[2] = 2; s[3] = 3;
+    do
+    {
+        for (i=0; i<4; i++)
+            p[i] = model[s[i]];
+        if (!arrange(p, order, &inner))
+            return false;
+    }
+    while (nextCombination(s, count));
+
+    memcpy(m_model, model, sizeof(model));
+    m_numModel = count;
+    m_signature = signature;
+    m_scale = scale;
+
+    // every 4 points, in every order a view of the pad can put them in
+    s[0] = 0; s[1] = 1; s[2] = 2; s[3] = 3;
+    m_numQuads = 0;
+    do
+    {
+        for (i=0; i<4; i++)
+            p[i] = m_model[s[i]];
+        arrange(p, order, &inner);
+        // the camera sees the pad from above, mirrored (the pad's z axis points at it),
+        // so the image has the points in reverse order of angle
+        if (inner)
+        {
+            seq[0] = s[order[0]]; seq[1] = s[order[3]]; seq[2] = s[order[2]]; seq[3] = s[order[1]];
+            rotations = 3;
+        }
+        else
+        {
+            seq[0] = s[order[3]]; seq[1] = s[order[2]]; seq[2] = s[order[1]]; seq[3] = s[order[0]];
+            rotations = 4;
+        }
+        for (r=0; r<rotations; r++)
+        {
+            quad = m_quads + m_numQuads++;
+            quad->inner = inner;
+            for (j=0; j<4; j++)
+            {
+                if (inner)
+                    k = j==0 ? seq[0] : seq[1 + (j-1+r)%3];
+                else
+                    k = seq[(j+r)%4];
+                quad->index[j] = k;
+                p[j] = m_model[k];
+            }
+            invariants(p, quad->areas);
+            squareToQuad(p, m);
+            adjugate(m, quad->inverse);
+        }
+    }
+    while (nextCombination(s, count));
+
+    return true;
+}
+
+// Projects the model through h and matches each point to the closest unclaimed blob
+// within PO_INLIER_TOL.  Returns the number of inliers, error is their squared distances.
+uint8_t Pose::score(const float *h, const float (*points)[2], uint16_t numPoints, int8_t *match, float *error)
+{
+    float tol2 = (PO_INLIER_TOL/m_fx)*(PO_INLIER_TOL/m_fx);
+    float u, v, w, dx, dy, d2, best;
+    uint32_t used = 0;
+    uint16_t i;
+    uint8_t j, inliers = 0;
+    int8_t b;
+
+    *error = 0;
+    for (j=0; j<m_numModel; j++)
+    {
+        match[j] = -1;
+        w = h[6]*m_model[j][0] + h[7]*m_model[j][1] + h[8];
+        if (fabsf(w)<1e-9f)
+            continue;
+        u = (h[0]*m_model[j][0] + h[1]*m_model[j][1] + h[2])/w;
+        v = (h[3]*m_model[j][0] + h[4]*m_model[j][1] + h[5])/w;
+        for (i=0, b=-1, best=tol2; i<numPoints; i++)
+        {
+            if (used&(1<<i))
+                continue;
+            dx = points[i][0] - u;
+            dy = points[i][1] - v;
+            d2 = dx*dx + dy*dy;
+            if (d2<best)
+            {
+                best = d2;
+                b = i;
+            }
+        }
+        if (b>=0)
+        {
+            match[j] = b;
+            used |= 1<<b;
+            *error += best;
+            inliers++;
+        }
+    }
+    return inliers;
+}
+
+// Least squares homography (h[8] = 1) through all matched points, from the normal equations.
+bool Pose::refine(const float (*points)[2], const int8_t *match, float *h)
+{
+    float a[8*9], row[9], x, y, u, v;
+    uint8_t j;
+
+    memset(a, 0, sizeof(a));
+    for (j=0; j<m_numModel; j++)
+    {
+        if (match[j]<0)
+            continue;
+        x = m_model[j][0];
+        y = m_model[j][1];
+        u = points[match[j]][0];
+        v = points[match[j]][1];
+        row[0] = x; row[1] = y; row[2] = 1; row[3] = 0; row[4] = 0; row[5] = 0;
+        row[6] = -x*u; row[7] = -y*u; row[8] = u;
+        accumulate(a, 8, row);
+        row[0] = 0; row[1] = 0; row[2] = 0; row[3] = x; row[4] = y; row[5] = 1;
+        row[6] = -x*v; row[7] = -y*v; row[8] = v;
+        accumulate(a, 8, row);
+    }
+    symmetrize(a, 8);
+    if (!solve(a, 8, h))
+        return false;
+    h[8] = 1.0f;
+    return true;
+}
+
+// h maps the model (in units of m_scale) to normalized image coordinates, so it is
+// [r1 r2 t] up to scale, r1 and r2 the pad's x and y axes in the camera frame.
+bool Pose::decompose(const float *h, float *r, float *t)
+{
+    float n1, n2, l;
+    uint8_t i;
+
+    n1 = sqrtf(h[0]*h[0] + h[3]*h[3] + h[6]*h[6]);
+    n2 = sqrtf(h[1]*h[1] + h[4]*h[4] + h[7]*h[7]);
+    l = 2.0f/(n1 + n2);
+    // the pad is in front of the camera
+    if (h[8]<0)
+        l = -l;
+    for (i=0; i<3; i++)
+    {
+        r[i*3] = l*h[i*3];
+        r[i*3+1] = l*h[i*3+1];
+        t[i] = l*h[i*3+2];
+    }
+    return orthonormalize(r);
+}
+
+// Sum of the squared reprojection errors in pixels, and if a isn't NULL, the normal
+// equations for the change in rotation (small angles about the camera's axes) and position
+// that reduces them.
+float Pose::reproject(const float (*points)[2], const int8_t *match, const float *r, const float *t, float *a)
+{
+    float q[3], p[3], row[7], iz, u, v, eu, ev, error = 0;
+    uint8_t j, k;
+
+    for (j=0; j<m_numModel; j++)
+    {
+        if (match[j]<0)
+            continue;
+        for (k=0; k<3; k++)
+        {
+            q[k] = r[k*3]*m_model[j][0] + r[k*3+1]*m_model[j][1];
+            p[k] = q[k] + t[k];
+        }
+        if (p[2]<1e-6f)
+            return 1e9f;
+        iz = 1.0f/p[2];
+        u = p[0]*iz;
+        v = p[1]*iz;
+        eu = (points[match[j]][0] - u)*m_fx;
+        ev = (points[match[j]][1] - v)*m_fy;
+        error += eu*eu + ev*ev;
+        if (a==NULL)
+            continue;
+        // rotating by w moves p by w x q, moving by d moves it by d
+        row[0] = -m_fx*iz*u*q[1];
+        row[1] = m_fx*iz*(q[2] + u*q[0]);
+        row[2] = m_fx*iz*(-q[1]);
+        row[3] = m_fx*iz;
+        row[4] = 0;
+        row[5] = -m_fx*iz*u;
+        row[6] = eu;
+        accumulate(a, 6, row);
+        row[0] = m_fy*iz*(-q[2] - v*q[1]);
+        row[1] = m_fy*iz*v*q[0];
+        row[2] = m_fy*iz*q[0];
+        row[3] = 0;
+        row[4] = m_fy*iz;
+        row[5] = -m_fy*iz*v;
+        row[6] = ev;
+        accumulate(a, 6, row);
+    }
+    return error;
+}
+
+// Gauss-Newton on the reprojection error over the full pose, which a homography's 8
+// degrees of freedom leave too loose.  Returns the sum of the squared errors.
+float Pose::solvePose(const float (*points)[2], const int8_t *match, float *r, float *t)
+{
+    float a[6*7], d[6], rot[9], w[9];
+    uint8_t i, k;
+
+    for (i=0; i<PO_ITERATIONS; i++)
+    {
+        memset(a, 0, sizeof(a));
+        reproject(points, match, r, t, a);
+        symmetrize(a, 6);
+        if (!solve(a, 6, d))
+            break;
+        // R <- (I + [d]x)R, then back to a rotation
+        w[0] = 1;     w[1] = -d[2]; w[2] = d[1];
+        w[3] = d[2];  w[4] = 1;     w[5] = -d[0];
+        w[6] = -d[1]; w[7] = d[0];  w[8] = 1;
+        multiply(w, r, rot);
+        if (!orthonormalize(rot))
+            break;
+        memcpy(r, rot, sizeof(rot));
+        for (k=0; k<3; k++)
+            t[k] += d[3+k];
+    }
+    return reproject(points, match, r, t, NULL);
+}
+
+// Refits the candidate's homography to all of its inliers (twice, in case the first refit
+// picks up more of them), then the pose.  Returns the rms reprojection error in pixels.
+float Pose::fit(const float (*points)[2], uint16_t numPoints, Candidate *candidate)
+{
+    float h[9], error;
+    int8_t match[PO_MAX_MODEL];
+    uint8_t i, inliers;
+
+    for (i=0, candidate->inliers=0; i<m_numModel; i++)
+    {
+        if (candidate->match[i]>=0)
+            candidate->inliers++;
+    }
+    for (i=0; i<2; i++)
+    {
+        memcpy(h, candidate->h, sizeof(h));
+        if (!refine(points, candidate->match, h) || (inliers=score(h, points, numPoints, match, &error))<candidate->inliers)
+            break;
+        memcpy(candidate->h, h, sizeof(h));
+        memcpy(candidate->match, match, sizeof(match));
+        candidate->inliers = inliers;
+    }
+
+    candidate->error = 1e9f;
+    if (!decompose(candidate->h, candidate->r, candidate->t))
+        return candidate->error;
+    error = solvePose(points, candidate->match, candidate->r, candidate->t);
+    candidate->error = sqrtf(error/candidate->inliers);
+    return candidate->error;
+}
+
+// Fits a pose to the match and keeps it as a candidate if a rigid pad, facing the camera,
+// fits it at least as well as the best so far.
+void Pose::consider(const float (*points)[2], uint16_t numPoints, const float *h, const int8_t *match)
+{
+    Candidate trial;
+    uint8_t c;
+
+    // the same match from another sample
+    for (c=0; c<m_numCandidates && memcmp(match, m_candidates[c].match, sizeof(trial.match)); c++);
+    if (c<m_numCandidates || m_result.fits==PO_MAX_FITS)
+        return;
+
+    // only a match a rigid pad fits counts
+    m_result.fits++;
+    memcpy(trial.h, h, sizeof(trial.h));
+    memcpy(trial.match, match, sizeof(trial.match));
+    if (fit(points, numPoints, &trial)>PO_MAX_ERROR || trial.inliers<m_bestInliers || -trial.r[8]<PO_MIN_FACING)
+        return;
+    if (trial.inliers>m_bestInliers)
+    {
+        m_bestInliers = trial.inliers;
+        m_numCandidates = 0;
+        m_overflow = false;
+    }
+    if (m_numCandidates==PO_MAX_CANDIDATES)
+        m_overflow = true;
+    else
+        m_candidates[m_numCandidates++] = trial;
+}
+
+bool Pose::update(const uint16_t *blobs, uint16_t numBlobs)
+{
+    float points[PO_MAX_POINTS][2], areas[4], image[9], h[9], error;
+    const float *sample[4], *ordered[4];
+    uint8_t s[4], order[4], idx[PO_MAX_POINTS], i, j, k, c, inliers, numPending = 0;
+    int8_t match[PO_MAX_MODEL];
+    int16_t x, y;
+    uint16_t n, q;
+    const Quad *quad;
+    const Candidate *candidate;
+    bool inner, exhaustive, full, overflow = false;
+
+    m_result.valid = false;
+    m_result.inliers = 0;
+    m_result.samples = 0;
+    m_result.hypotheses = 0;
+    m_result.fits = 0;
+    m_bestInliers = 0;
+    m_numCandidates = 0;
+    m_overflow = false;
+
+    if (m_undistort==NULL)
+        return false;
+    // blob centers in normalized camera coordinates, without the lens' distortion
+    for (n=0; numBlobs && n<PO_MAX_POINTS; numBlobs--, blobs+=5)
+    {
+        if (m_signature && blobs[0]!=m_signature)
+            continue;
+        m_undistort->normalize(blobs[1] + blobs[2], blobs[3] + blobs[4], &x, &y);
+        points[n][0] = x*(1.0f/(1<<UD_NORM_SHIFT));
+        points[n][1] = y*(1.0f/(1<<UD_NORM_SHIFT));
+        n++;
+    }
+    if (n<PO_MIN_INLIERS)
+        return false;
+
+    exhaustive = n<=PO_EXHAUSTIVE_POINTS;
+    s[0] = 0; s[1] = 1; s[2] = 2; s[3] = 3;
+    // any 4 points match exactly, more than that is only matched by the pad, so that's it
+    full = m_numModel>PO_MIN_INLIERS;
+    while (m_result.samples<PO_MAX_SAMPLES && m_result.hypotheses<PO_MAX_HYPOTHESES && m_result.fits<PO_MAX_FITS &&
+        !(m_bestInliers==m_numModel && full))
+    {
+        if (exhaustive)
+        {
+            if (m_result.samples && !nextCombination(s, n))
+                break;
+        }
+        else
+        {
+            // 4 distinct blobs, the start of a Fisher-Yates shuffle
+            for (i=0; i<n; i++)
+                idx[i] = i;
+            for (i=0; i<4; i++)
+            {
+                m_seed = m_seed*1103515245 + 12345;
+                j = i + (m_seed>>16)%(n-i);
+                k = idx[i]; idx[i] = idx[j]; idx[j] = k;
+                s[i] = idx[i];
+            }
+        }
+        m_result.samples++;
+
+        for (i=0; i<4; i++)
+            sample[i] = points[s[i]];
+        if (!arrange(sample, order, &inner))
+            continue;
+        for (i=0; i<4; i++)
+            ordered[i] = sample[order[i]];
+        invariants(ordered, areas);
+        squareToQuad(ordered, image);
+
+        for (q=0; q<m_numQuads && m_result.hypotheses<PO_MAX_HYPOTHESES; q++)
+        {
+            quad = m_quads + q;
+            if (quad->inner!=inner || !similar(areas, quad->areas))
+                continue;
+            multiply(image, quad->inverse, h);
+            if (!plausible(h))
+                continue;
+            m_result.hypotheses++;
+            inliers = score(h, points, n, match, &error);
+            if (inliers<m_bestInliers || inliers<PO_MIN_INLIERS)
+                continue;
+            // Any 4 blobs match some 4 model points, so with more model points a match of
+            // just 4 waits until no better one turned up.
+            if (inliers==PO_MIN_INLIERS && full)
+            {
+                for (c=0; c<numPending && memcmp(match, m_pending[c].match, sizeof(match)); c++);
+                if (c<numPending)
+                    continue;
+                if (numPending==PO_MAX_PENDING)
+                    overflow = true;
+                else
+                {
+                    memcpy(m_pending[numPending].h, h, sizeof(h));
+                    memcpy(m_pending[numPending++].match, match, sizeof(match));
+                }
+                continue;
+            }
+            consider(points, n, h, match);
+            if (m_bestInliers==m_numModel && full)
+                break;
+        }
+    }
+    if (m_bestInliers<=PO_MIN_INLIERS)
+    {
+        if (overflow)
+            return false;
+        for (c=0; c<numPending; c++)
+            consider(points, n, m_pending[c].h, m_pending[c].match);
+    }
+    // Another match of as many points fits too: a symmetric part of the pad, or blobs that
+    // happen to line up with it.  Nothing tells which is right.
+    if (m_numCandidates!=1 || m_overflow)
+        return false;
+
+    candidate = m_candidates;
+    m_result.valid = true;
+    m_result.inliers = candidate->inliers;
+    m_result.x = candidate->t[0]*m_scale;
+    m_result.y = candidate->t[1]*m_scale;
+    m_result.z = candidate->t[2]*m_scale;
+    m_result.yaw = atan2f(candidate->r[3], candidate->r[0]);
+    m_result.error = candidate->error;
+    return true;
+}
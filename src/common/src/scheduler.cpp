@@ -0,0 +1,167 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <string.h>
+#include "scheduler.h"
+
+Scheduler::Scheduler(SchedTime clock, SchedTime slack)
+{
+    m_clock = clock;
+    m_slack = slack;
+    m_idle = NULL;
+    memset(m_tasks, 0, sizeof(m_tasks));
+    m_numTasks = 1; // 0 is the frame task
+    resetStats();
+}
+
+void Scheduler::setFrameTask(const char *name, SchedFunc run, SchedReady ready)
+{
+    m_tasks[0].run = run;
+    m_tasks[0].ready = ready;
+    m_tasks[0].stats.name = name;
+}
+
+int Scheduler::addTask(const char *name, SchedFunc run, SchedReady ready, uint32_t cost)
+{
+    Task *task;
+
+    if (m_numTasks==SC_MAX_TASKS)
+        return -1;
+    task = m_tasks + m_numTasks++;
+    task->run = run;
+    task->ready = ready;
+    task->stats.name = name;
+    task->stats.cost = cost;
+    return 0;
+}
+
+void Scheduler::setIdle(SchedIdle idle)
+{
+    m_idle = idle;
+}
+
+void Scheduler::run(Task *task, uint32_t budget)
+{
+    uint32_t start = (*m_clock)(), us;
+
+    if ((*task->run)(budget)<0)
+        task->stats.errors++;
+    us = (*m_clock)() - start;
+    task->stats.runs++;
+    task->stats.totalUs += us;
+    if (us>task->stats.maxUs)
+        task->stats.maxUs = us;
+    if (task!=m_tasks && us>budget + SC_MARGIN)
+        task->stats.late++;
+}
+
+bool Scheduler::dispatch()
+{
+    uint32_t slack, budget, start, us;
+    uint8_t i;
+
+    if (m_tasks[0].run && (*m_tasks[0].ready)())
+    {
+        run(m_tasks, 0);
+        return true;
+    }
+
+    slack = (*m_slack)();
+    budget = slack>SC_MARGIN ? slack-SC_MARGIN : 0;
+    for (i=1; i<m_numTasks; i++)
+    {
+        if (!(*m_tasks[i].ready)())
+            continue;
+        if (m_tasks[i].stats.cost>budget)
+        {
+            // a task further down may still fit
+            m_tasks[i].stats.deferred++;
+            continue;
+        }
+        run(m_tasks + i, budget);
+        return true;
+    }
+
+    if (m_idle)
+    {
+        start = (*m_clock)();
+        (*m_idle)();
+        us = (*m_clock)() - start;
+        m_idleStats.sleeps++;
+        m_idleStats.totalUs += us;
+        if (us>m_idleStats.maxUs)
+            m_idleStats.maxUs = us;
+    }
+    return false;
+}
+
+void Scheduler::endFrame()
+{
+    uint32_t now = (*m_clock)(), us, idle;
+
+    if (m_frameStarted)
+    {
+        us = now - m_frameStart;
+        idle = us ? (uint32_t)((uint64_t)(m_idleStats.totalUs - m_frameIdle)*1000/us) : 0;
+        if (idle>1000)
+            idle = 1000;
+        m_idleStats.lastIdle = idle;
+        if (m_idleStats.frames==0 || idle<m_idleStats.minIdle)
+            m_idleStats.minIdle = idle;
+        m_idleStats.sumIdle += idle;
+        m_idleStats.frames++;
+    }
+    m_frameStarted = true;
+    m_frameStart = now;
+    m_frameIdle = m_idleStats.totalUs;
+}
+
+uint8_t Scheduler::tasks() const
+{
+    return m_numTasks;
+}
+
+const SchedStats *Scheduler::stats(uint8_t task) const
+{
+    return task<m_numTasks ? &m_tasks[task].stats : NULL;
+}
+
+const SchedIdleStats *Scheduler::idleStats() const
+{
+    return &m_idleStats;
+}
+
+void Scheduler::resetStats()
+{
+    uint8_t i;
+
+    for (i=0; i<m_numTasks; i++)
+    {
+        m_tasks[i].stats.runs = m_tasks[i].stats.deferred = m_tasks[i].stats.late = 0;
+        m_tasks[i].stats.errors = m_tasks[i].stats.maxUs = m_tasks[i].stats.totalUs = 0;
+    }
+    memset(&m_idleStats, 0, sizeof(m_idleStats));
+    // the frame under way started before, its idle share is unknown
+    m_frameStarted = false;
+    m_frameIdle = 0;
+}
+
+uint32_t Scheduler::queueSlack(uint32_t free, uint32_t perLine, uint32_t maxLine, uint32_t lineUs)
+{
+    if (free<maxLine || perLine==0)
+        return 0;
+    // the M0 checks for maxLine free before each line, the line after the last that fits is lost
+    return (free - maxLine)/perLine*lineUs;
+}
@@ -0,0 +1,213 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <string.h>
+#include "tracker.h"
+
+#define TR_NO_MATCH           0xffffffff
+#define TR_DIST_SHIFT         4     // distances are compared in 1/16 pixels
+#define TR_GATE2              ((uint32_t)(TR_GATE<<TR_DIST_SHIFT)*(TR_GATE<<TR_DIST_SHIFT))
+
+
+Tracker::Tracker()
+{
+    m_nextId = 1;
+    reset();
+}
+
+void Tracker::reset()
+{
+    m_numTracks = 0;
+    m_started = false;
+    m_pairs = 0;
+}
+
+uint16_t Tracker::getTracks(const Track **tracks)
+{
+    *tracks = m_tracks;
+    return m_numTracks;
+}
+
+bool Tracker::confirmed(const Track *track)
+{
+    return track->hits>=TR_CONFIRM_HITS;
+}
+
+uint32_t Tracker::pairs()
+{
+    return m_pairs;
+}
+
+void Tracker::predict(Track *track)
+{
+    track->x += ((int64_t)track->vx*m_dtq)>>16;
+    track->y += ((int64_t)track->vy*m_dtq)>>16;
+}
+
+// blob is the one associated with the already predicted track
+void Tracker::correct(Track *track, const uint16_t *blob)
+{
+    track->seen |= 1;
+    int32_t rx, ry;
+
+    rx = ((blob[1] + blob[2])<<(TR_SHIFT-1)) - track->x;
+    ry = ((blob[3] + blob[4])<<(TR_SHIFT-1)) - track->y;
+
+    if (track->hits==1) // second blob, the first estimate of velocity is the difference
+    {
+        track->x += rx;
+        track->y += ry;
+        track->vx = ((int64_t)rx*m_rateq)>>8;
+        track->vy = ((int64_t)ry*m_rateq)>>8;
+    }
+    else
+    {
+        track->x += (rx*TR_ALPHA)>>8;
+        track->y += (ry*TR_ALPHA)>>8;
+        track->vx += ((int64_t)((rx*TR_BETA)>>8)*m_rateq)>>8;
+        track->vy += ((int64_t)((ry*TR_BETA)>>8)*m_rateq)>>8;
+    }
+    track->width = blob[2] - blob[1];
+    track->height = blob[4] - blob[3];
+    if (track->hits<TR_CONFIRM_HITS)
+        track->hits++;
+    track->misses = 0;
+}
+
+void Tracker::start(const uint16_t *blob)
+{
+    Track *track = m_tracks + m_numTracks++;
+
+    track->id = m_nextId++;
+    if (m_nextId==0)
+        m_nextId = 1;
+    track->signature = blob[0];
+    track->x = (blob[1] + blob[2])<<(TR_SHIFT-1);
+    track->y = (blob[3] + blob[4])<<(TR_SHIFT-1);
+    track->vx = 0;
+    track->vy = 0;
+    track->width = blob[2] - blob[1];
+    track->height = blob[4] - blob[3];
+    track->age = 0;
+    track->hits = 1;
+    track->misses = 0;
+    track->seen = 1;
+    track->valid = 1;
+}
+
+void Tracker::update(const uint16_t *blobs, uint16_t numBlobs, uint32_t timestamp)
+{
+    uint32_t dt, d2, best, frames;
+    int32_t dx, dy;
+    uint16_t i, t, b, bestT, bestB, numTracks;
+    int8_t match[TR_MAX_TRACKS];
+    bool used[TR_MAX_BLOBS];
+    const uint16_t *blob;
+    Track *track;
+
+    if (numBlobs>TR_MAX_BLOBS)
+        numBlobs = TR_MAX_BLOBS;
+
+    dt = timestamp - m_timestamp;
+    if (!m_started || dt==0)
+        dt = TR_FRAME_PERIOD;
+    // frames since the last update, more than one if the camera dropped some
+    frames = (dt + TR_FRAME_PERIOD/2)/TR_FRAME_PERIOD;
+    if (frames==0)
+        frames = 1;
+    else if (frames>31)
+        frames = 31;
+    if (dt>TR_MAX_PERIOD)
+        dt = TR_MAX_PERIOD;
+    m_timestamp = timestamp;
+    m_started = true;
+    m_dtq = ((uint64_t)dt<<16)/1000000;
+    m_rateq = (1000000u<<8)/dt;
+
+    // distance from every prediction to every blob of its signature
+    m_pairs = 0;
+    for (t=0; t<m_numTracks; t++)
+    {
+        track = m_tracks + t;
+        predict(track);
+        track->seen <<= frames;
+        track->valid = (track->valid<<frames) | 1;
+        match[t] = -1;
+        for (b=0, blob=blobs; b<numBlobs; b++, blob+=5)
+        {
+            m_cost[t][b] = TR_NO_MATCH;
+            if (blob[0]!=track->signature)
+                continue;
+            dx = (((blob[1] + blob[2])<<(TR_SHIFT-1)) - track->x)>>(TR_SHIFT-TR_DIST_SHIFT);
+            dy = (((blob[3] + blob[4])<<(TR_SHIFT-1)) - track->y)>>(TR_SHIFT-TR_DIST_SHIFT);
+            if (dx>=-(TR_GATE<<TR_DIST_SHIFT) && dx<=(TR_GATE<<TR_DIST_SHIFT) &&
+                dy>=-(TR_GATE<<TR_DIST_SHIFT) && dy<=(TR_GATE<<TR_DIST_SHIFT))
+            {
+                d2 = dx*dx + dy*dy;
+                if (d2<=TR_GATE2)
+                    m_cost[t][b] = d2;
+            }
+            m_pairs++;
+        }
+    }
+    memset(used, 0, sizeof(used));
+
+    // closest pair first, until no pair is inside the gate
+    while (1)
+    {
+        best = TR_NO_MATCH;
+        bestT = bestB = 0;
+        for (t=0; t<m_numTracks; t++)
+        {
+            if (match[t]>=0)
+                continue;
+            for (b=0; b<numBlobs; b++)
+            {
+                if (!used[b] && m_cost[t][b]<best)
+                {
+                    best = m_cost[t][b];
+                    bestT = t;
+                    bestB = b;
+                }
+            }
+        }
+        if (best==TR_NO_MATCH)
+            break;
+        match[bestT] = bestB;
+        used[bestB] = true;
+    }
+
+    // update, keeping the survivors in order, oldest first
+    for (t=0, numTracks=0; t<m_numTracks; t++)
+    {
+        track = m_tracks + t;
+        if (match[t]>=0)
+            correct(track, blobs + match[t]*5);
+        else if (!confirmed(track) || ++track->misses>TR_MAX_MISSES)
+            continue;
+        if (track->age<0xffff)
+            track->age++;
+        if (numTracks!=t)
+            m_tracks[numTracks] = *track;
+        numTracks++;
+    }
+    m_numTracks = numTracks;
+
+    for (i=0, blob=blobs; i<numBlobs && m_numTracks<TR_MAX_TRACKS; i++, blob+=5)
+    {
+        if (!used[i])
+            start(blob);
+    }
+}
@@ -0,0 +1,160 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <math.h>
+#include "undistort.h"
+
+#define UD_CONVERGED          1e-6f // normalized, how close the inversion has to get
+#define UD_DEGREES            (180.0f/3.14159265f*UD_BEARING_SCALE)
+
+static int16_t toFixed(float v)
+{
+    v = v<0 ? v-0.5f : v+0.5f;
+    return v<-32767.0f ? -32767 : (v>32767.0f ? 32767 : (int16_t)v);
+}
+
+// Newton's method on OpenCV's distortion of normalized x, y.  False if it doesn't get there,
+// or if the distortion turns back on itself (the Jacobian's determinant isn't positive) on
+// the way, past which the image holds nothing sensible.
+static bool invert(const Calibration *cal, float xd, float yd, float *x, float *y)
+{
+    float r2, radial, dr, ex, ey, j00, j01, j10, j11, det;
+    uint8_t i;
+
+    *x = xd;
+    *y = yd;
+    for (i=0; i<UD_ITERATIONS; i++)
+    {
+        r2 = *x**x + *y**y;
+        radial = 1.0f + r2*(cal->k1 + r2*(cal->k2 + r2*cal->k3));
+        dr = 2.0f*(cal->k1 + r2*(2.0f*cal->k2 + 3.0f*r2*cal->k3));
+        ex = *x*radial + 2.0f*cal->p1**x**y + cal->p2*(r2 + 2.0f**x**x) - xd;
+        ey = *y*radial + cal->p1*(r2 + 2.0f**y**y) + 2.0f*cal->p2**x**y - yd;
+        if (fabsf(ex)<UD_CONVERGED && fabsf(ey)<UD_CONVERGED)
+            return true;
+        j00 = radial + *x**x*dr + 2.0f*cal->p1**y + 6.0f*cal->p2**x;
+        j01 = *x**y*dr + 2.0f*cal->p1**x + 2.0f*cal->p2**y;
+        j10 = j01;
+        j11 = radial + *y**y*dr + 6.0f*cal->p1**y + 2.0f*cal->p2**x;
+        det = j00*j11 - j01*j10;
+        if (!(det>0.0f))
+            return false;
+        *x -= (j11*ex - j01*ey)/det;
+        *y -= (j00*ey - j10*ex)/det;
+    }
+    return false;
+}
+
+Undistort::Undistort()
+{
+    build(NULL);
+}
+
+bool Undistort::build(const Calibration *cal)
+{
+    Calibration pinhole;
+    float s, u, v, x, y;
+    uint16_t r, c, i;
+
+    if (cal==NULL)
+    {
+        pinhole.width = UD_WIDTH;
+        pinhole.height = UD_HEIGHT;
+        pinhole.fx = UD_DEFAULT_FX;
+        pinhole.fy = UD_DEFAULT_FY;
+        pinhole.cx = UD_DEFAULT_CX;
+        pinhole.cy = UD_DEFAULT_CY;
+        pinhole.k1 = pinhole.k2 = pinhole.p1 = pinhole.p2 = pinhole.k3 = 0.0f;
+        cal = &pinhole;
+    }
+    else if (cal->magic!=UD_CAL_MAGIC || cal->version!=UD_CAL_VERSION || cal->width<UD_WIDTH ||
+        (uint32_t)cal->width*UD_HEIGHT!=(uint32_t)cal->height*UD_WIDTH || !(cal->fx>0.0f) || !(cal->fy>0.0f))
+        return false;
+
+    // A blob image pixel covers s x s pixels of the calibration's image, its center is
+    // (s-1)/2 past the first of them.
+    s = (float)cal->width/UD_WIDTH;
+    for (r=0, i=0; r<UD_ROWS; r++)
+    {
+        for (c=0; c<UD_COLS; c++, i++)
+        {
+            u = s*(c<<UD_STEP_SHIFT) + 0.5f*(s-1.0f);
+            v = s*(r<<UD_STEP_SHIFT) + 0.5f*(s-1.0f);
+            if (!invert(cal, (u - cal->cx)/cal->fx, (v - cal->cy)/cal->fy, &x, &y))
+            {
+                // rather the default than a grid that's partly wrong
+                if (cal!=&pinhole)
+                    build(NULL);
+                return false;
+            }
+            m_normal[i][0] = toFixed(x*(1<<UD_NORM_SHIFT));
+            m_normal[i][1] = toFixed(y*(1<<UD_NORM_SHIFT));
+        }
+    }
+    m_fx = cal->fx/s;
+    m_fy = cal->fy/s;
+    m_calibrated = cal!=&pinhole;
+    return true;
+}
+
+// Bilinear, the cell's 4 corners weighted by half pixels each way.
+void Undistort::normalize(uint16_t x2, uint16_t y2, int16_t *x, int16_t *y) const
+{
+    uint16_t c = x2>>(UD_STEP_SHIFT+1), r = y2>>(UD_STEP_SHIFT+1);
+    int32_t fx, fy, w00, w01, w10, w11;
+    const int16_t (*g)[2];
+
+    // past the last cell is extrapolated from it
+    if (c>UD_COLS-2)
+        c = UD_COLS-2;
+    if (r>UD_ROWS-2)
+        r = UD_ROWS-2;
+    fx = x2 - (c<<(UD_STEP_SHIFT+1));
+    fy = y2 - (r<<(UD_STEP_SHIFT+1));
+    w11 = fx*fy;
+    w10 = (fx<<(UD_STEP_SHIFT+1)) - w11;
+    w01 = (fy<<(UD_STEP_SHIFT+1)) - w11;
+    w00 = (1<<(2*UD_STEP_SHIFT+2)) - w10 - w01 - w11;
+    g = m_normal + r*UD_COLS + c;
+    *x = (g[0][0]*w00 + g[1][0]*w10 + g[UD_COLS][0]*w01 + g[UD_COLS+1][0]*w11 + (1<<(2*UD_STEP_SHIFT+1)))>>(2*UD_STEP_SHIFT+2);
+    *y = (g[0][1]*w00 + g[1][1]*w10 + g[UD_COLS][1]*w01 + g[UD_COLS+1][1]*w11 + (1<<(2*UD_STEP_SHIFT+1)))>>(2*UD_STEP_SHIFT+2);
+}
+
+void Undistort::bearing(uint16_t x2, uint16_t y2, int16_t *azimuth, int16_t *elevation) const
+{
+    int16_t nx, ny;
+    float x, y;
+
+    normalize(x2, y2, &nx, &ny);
+    x = nx*(1.0f/(1<<UD_NORM_SHIFT));
+    y = ny*(1.0f/(1<<UD_NORM_SHIFT));
+    *azimuth = toFixed(atanf(x)*UD_DEGREES);
+    *elevation = toFixed(atan2f(y, sqrtf(1.0f + x*x))*UD_DEGREES);
+}
+
+float Undistort::fx() const
+{
+    return m_fx;
+}
+
+float Undistort::fy() const
+{
+    return m_fy;
+}
+
+bool Undistort::calibrated() const
+{
+    return m_calibrated;
+}
@@ -0,0 +1,72 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef _M0CMD_H
+#define _M0CMD_H
+
+#include <stdint.h>
+#include "pixyvals.h"
+
+// Command mailbox from the M4 to the M0, in shared memory beside the SMLink buffer.  It
+// takes the place of chirp calls for what the M4 asks of the M0 while programs run, a
+// chirp call over SMLink only being seen when the M0 is between frames.  One command at a
+// time: the M4 writes the args and cmd, then bumps seq and signals the M0 (SEV).  The M0
+// checks for a command each line and while it waits for a frame, so a stop takes effect
+// within a line, sets result, then done to seq, and signals back.  Chirp stays for
+// debugging (cmd-test, PixyMon), the M0 keeps its procs.
+
+#define M0C_RUN          1   // args.run
+#define M0C_STOP         2   // aborts a frame under way (QVAL_FRAME_ERROR), done once stopped
+#define M0C_RLS_PARAMS   3   // args.rls, for the next frame
+#define M0C_GET_FRAME    4   // args.frame, only while stopped, done when grabbed
+
+typedef struct
+{
+    uint32_t seq;            // written by the M4, last
+    uint32_t done;           // written by the M0, seq of the last command finished
+    int32_t result;
+    uint8_t cmd;
+    uint8_t running;         // the M0 is running a program
+    uint8_t reserved[2];
+    union
+    {
+        struct
+        {
+            uint8_t prog;
+        } run;
+        struct
+        {
+            uint8_t threshold;
+            uint8_t logFps;
+            uint8_t lowThreshold;   // hysteresis (rls_m0.c), 0 for none
+            uint8_t intensity;      // queue each run's intensity (QVAL_LAYOUT_INTENSITY)
+        } rls;
+        struct
+        {
+            uint8_t type;
+            uint8_t reserved;
+            uint16_t xOffset;
+            uint16_t yOffset;
+            uint16_t xWidth;
+            uint16_t yWidth;
+            uint32_t memory;
+        } frame;
+    } args;
+}
+M0Cmd;
+
+#define M0C_OBJECT       ((volatile M0Cmd *)MEM_M0C_LOC)
+
+#endif
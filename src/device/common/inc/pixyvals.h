@@ -33,15 +33,23 @@
 #define SRAM4_LOC                0x2000c000   // Shared memory between M0 and M4
 #define SRAM4_SIZE               0x4000
 
-#define MEM_USB_FRAME_LOC        SRAM1_LOC
-#define MEM_USB_FRAME_SIZE       SRAM1_SIZE
-#define MEM_SD_FRAME_LOC         SRAM1_LOC
-#define MEM_SD_FRAME_HDR_SIZE    512
-#define MEM_M0_FRAME_LOC         (MEM_SD_FRAME_LOC + MEM_SD_FRAME_HDR_SIZE) // Leave room in front for USB/SD header
+#define MEM_FRAMES_LOC           SRAM1_LOC  // frame slots for the M0, SD card and USB (framebuf.h)
+#define MEM_FRAMES_SIZE          SRAM1_SIZE
 #define MEM_QQ_LOC               SRAM4_LOC
 #define MEM_QQ_SIZE              (0x3c00)
 #define MEM_SM_LOC               (SRAM4_LOC + MEM_QQ_SIZE)
-#define MEM_SM_SIZE              (SRAM4_SIZE - MEM_QQ_SIZE)
+#define MEM_FB_SIZE              (0x20)     // frame slot states (framebuf.h)
+#define MEM_M0C_SIZE             (0x40)     // M0 command mailbox (m0cmd.h), at the top of SRAM4
+#define MEM_SM_SIZE              (SRAM4_SIZE - MEM_QQ_SIZE - MEM_FB_SIZE - MEM_M0C_SIZE)
 #define MEM_SM_BUFSIZE           (MEM_SM_SIZE - 4)
+#define MEM_FB_LOC               (MEM_SM_LOC + MEM_SM_SIZE)
+#define MEM_M0C_LOC              (MEM_FB_LOC + MEM_FB_SIZE)
+
+// M0 run length defaults, the M4 keeps the values in use as parameters
+#define RLS_CAMERA_FPS           50     // frame rate of the camera
+#define RLS_PIXEL_THRESHOLD      170    // a pixel brighter than this is part of a run
+#define RLS_LOW_THRESHOLD        0      // with hysteresis, a run is the pixels brighter than this around one, 0 none
+#define RLS_RUN_INTENSITY        0      // 1 queues each run's brightest pixel and pixel sum after it
+#define RLS_LOG_FPS              10     // frames written to the SD card per second, at most
 
 #endif
@@ -20,6 +20,7 @@ int exec_init(void);
 uint32_t exec_running(void);
 int32_t exec_stop(void);
 int32_t exec_run(uint8_t *prog);
+int exec_stopRequested(void);
 void exec_loop(void);
 
 #endif
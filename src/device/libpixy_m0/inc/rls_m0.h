@@ -20,5 +20,6 @@
 
 int rls_init(void);
 int32_t getRLSFrame(void);
+int32_t setRLSParams(uint8_t *threshold, uint8_t *lowThreshold, uint8_t *intensity, uint8_t *logFps);
 
 #endif
@@ -0,0 +1,66 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef _RLS_REF_H
+#define _RLS_REF_H
+
+#include <stdint.h>
+#include "cameravals.h"
+#include "qqueue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// processLine() in rls_m0.c takes a line of this many red pixels and queues at most this
+// many runs of it, the rest of the line is dropped
+#define RLS_LINE_WIDTH          CAM_RES2_WIDTH
+#define RLS_MAX_LINE_QVALS      ((CAM_RES2_WIDTH/3)+2)
+#define RLS_INVALID_COL         (CAM_RES2_WIDTH+1)
+// with the run intensity on, each run is followed by its intensity
+#define RLS_MAX_LINE_QVALS_INTENSITY  (2*RLS_MAX_LINE_QVALS)
+
+// What processLine() puts in qMem for a line of red pixels, without the camera and the
+// cycle counting: the runs of pixels brighter than threshold, start and end (not
+// inclusive), at most RLS_MAX_LINE_QVALS of them, a run still going at the end of the
+// line ending there.  Returns the number of Qvals.  Host tools and tests use it in place
+// of the assembly, any change to processLine() is made here too.
+uint32_t processLineRef(const uint8_t *line, uint32_t threshold, Qval *qMem);
+
+// Hysteresis along the line: of the n runs processLine() found in line at the low
+// threshold, keeps those with a pixel brighter than threshold, in order at the front of
+// qMem.  A run so starts over threshold and goes on while its pixels are over the low one,
+// and glow that never gets there is dropped.  Returns the number kept.  The M0 runs this
+// itself between a red line and the next, it only looks at a run's pixels up to its first
+// bright one.
+uint32_t keepBrightRuns(const uint8_t *line, uint32_t threshold, Qval *qMem, uint32_t n);
+
+// The Qval getRLSFrame() queues after a run of line with QVAL_LAYOUT_INTENSITY, its
+// brightest pixel and the sum of its pixels (qqueue.h).  The M0 runs this itself, with
+// hysteresis in place of keepBrightRuns(): the runs it keeps are those whose brightest
+// pixel is over threshold.
+void runIntensity(const uint8_t *line, const Qval *run, Qval *intensity);
+
+// What getRLSFrame() queues for a line after its QVAL_LINE_BEGIN: the runs over threshold,
+// or with lowThreshold between 0 and threshold (not inclusive) the runs over lowThreshold
+// keepBrightRuns() keeps, each followed by its runIntensity() if intensity is set, when
+// qMem must hold RLS_MAX_LINE_QVALS_INTENSITY.
+uint32_t rlsLineRef(const uint8_t *line, uint32_t threshold, uint32_t lowThreshold, uint32_t intensity, Qval *qMem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
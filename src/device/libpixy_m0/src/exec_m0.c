@@ -15,21 +15,38 @@
 
 #include "debug.h"
 #include <pixyvals.h>
+#include <m0cmd.h>
+#include "lpc43xx.h"
+#include "platform_config.h"
 #include "chirp.h"
 #include "exec_m0.h"
+#include "frame_m0.h"
 #include "rls_m0.h"
 #include "qqueue.h"
+#include "framebuf.h"
 
 uint8_t g_running = 0;
 uint8_t g_run = 0;
 int8_t g_program = -1;
 
+static uint32_t g_cmdSeq = 0;       // seq of the last command taken from the M4
+static uint8_t g_stopPending = 0;   // M0C_STOP taken, finished once the frame is aborted
+
 int exec_init(void)
 {
     qq_init();
     chirpSetProc("run", (ProcPtr)exec_run);
     chirpSetProc("stop", (ProcPtr)exec_stop);
     chirpSetProc("running", (ProcPtr)exec_running);
+
+    M0C_OBJECT->done = M0C_OBJECT->seq = 0;
+    M0C_OBJECT->running = 0;
+
+    // The M4's SEV pends its interrupt, which stays disabled (ipc_mbx.c has the handler),
+    // and with SEVONPEND that wakes waitM4()'s WFE.
+    MASTER_TXEV_QUIT();
+    NVIC_ClearPendingIRQ((IRQn_Type)MASTER_IRQn);
+    SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
     return 0;
 }
 
@@ -49,22 +66,137 @@ int32_t exec_run(uint8_t *prog)
     g_program = *prog;
     g_run = 1;
     g_running = 1;
+    M0C_OBJECT->running = 1;
     return 0;
 }
 
+static void finishCmd(int32_t result)
+{
+    M0C_OBJECT->result = result;
+    __DMB();
+    M0C_OBJECT->done = g_cmdSeq;
+    __SEV();
+}
+
+// Takes a new command if there is one, true if there was.
+static int takeCmd(void)
+{
+    uint32_t seq = M0C_OBJECT->seq;
+
+    if (seq==g_cmdSeq)
+        return 0;
+    g_cmdSeq = seq;
+    __DMB();
+    return 1;
+}
+
+static void serviceCmd(void)
+{
+    volatile M0Cmd *cmd = M0C_OBJECT;
+    uint8_t prog, threshold, lowThreshold, intensity, logFps, type;
+    uint32_t memory;
+    uint16_t xOffset, yOffset, xWidth, yWidth;
+
+    if (!takeCmd())
+        return;
+
+    switch (cmd->cmd)
+    {
+    case M0C_RUN:
+        prog = cmd->args.run.prog;
+        finishCmd(exec_run(&prog));
+        break;
+
+    case M0C_STOP:
+        g_run = 0;
+        if (g_running)
+            g_stopPending = 1; // finished when exec_loop() leaves the frame loop
+        else
+            finishCmd(0);
+        break;
+
+    case M0C_RLS_PARAMS:
+        threshold = cmd->args.rls.threshold;
+        lowThreshold = cmd->args.rls.lowThreshold;
+        intensity = cmd->args.rls.intensity;
+        logFps = cmd->args.rls.logFps;
+        finishCmd(setRLSParams(&threshold, &lowThreshold, &intensity, &logFps));
+        break;
+
+    case M0C_GET_FRAME:
+        if (g_running)
+        {
+            finishCmd(-1);
+            break;
+        }
+        type = cmd->args.frame.type;
+        memory = cmd->args.frame.memory;
+        xOffset = cmd->args.frame.xOffset;
+        yOffset = cmd->args.frame.yOffset;
+        xWidth = cmd->args.frame.xWidth;
+        yWidth = cmd->args.frame.yWidth;
+        finishCmd(getFrame(&type, &memory, &xOffset, &yOffset, &xWidth, &yWidth));
+        break;
+
+    default:
+        finishCmd(-1);
+    }
+}
+
+// Between lines of a frame and while waiting for one, a stop and new run length
+// parameters are the only commands taken.  The parameters are for the next frame, but
+// taken at once the M4 doesn't wait out this one for them.
+int exec_stopRequested(void)
+{
+    if (g_run && M0C_OBJECT->seq!=g_cmdSeq)
+    {
+        if (M0C_OBJECT->cmd==M0C_STOP)
+        {
+            takeCmd();
+            g_run = 0;
+            g_stopPending = 1;
+        }
+        else if (M0C_OBJECT->cmd==M0C_RLS_PARAMS)
+            serviceCmd();
+    }
+    return !g_run;
+}
+
+// Sleeps until the M4 signals, a command or a chirp message (SMLink), or an interrupt is
+// taken.  A signal since the last look returns at once, WFE's event register keeps it.
+static void waitM4(void)
+{
+    MASTER_TXEV_QUIT();
+    NVIC_ClearPendingIRQ((IRQn_Type)MASTER_IRQn);
+    __WFE();
+}
+
 void exec_loop(void)
 {
     while(1)
     {
         while(!g_run)
+        {
             chirpService();
+            serviceCmd();
+            if (!g_run)
+                waitM4();
+        }
 
         while(g_run)
         {
             getRLSFrame();
             chirpService();
+            serviceCmd();
         }
-        // set variable to indicate we've stopped
+        // set variable to indicate we've stopped, and give back the frame slots
         g_running = 0;
+        M0C_OBJECT->running = 0;
+        fb_disarm();
+        if (g_stopPending)
+        {
+            g_stopPending = 0;
+            finishCmd(0);
+        }
     }
 }
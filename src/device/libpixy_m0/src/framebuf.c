@@ -0,0 +1,69 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include "pixyvals.h"
+#include "framebuf.h"
+
+#ifdef PIXY
+struct FrameBufFields *g_fb = (struct FrameBufFields *)MEM_FB_LOC;
+uint8_t *g_fbMem = (uint8_t *)MEM_FRAMES_LOC;
+#else
+struct FrameBufFields *g_fb = 0;   // the host model points them at the M4's
+uint8_t *g_fbMem = 0;
+#endif
+
+uint8_t fb_beginFill(void)
+{
+    uint8_t i;
+
+    for (i=0; i<FB_SLOTS; i++)
+    {
+        if (g_fb->state[i]==FB_ARMED)
+        {
+            g_fb->state[i] = FB_FILLING;
+            return i;
+        }
+    }
+    g_fb->missed++;
+    return FB_NO_SLOT;
+}
+
+uint8_t *fb_frame(uint8_t slot)
+{
+    return g_fbMem + slot*FB_SLOT_SIZE + FB_HEADER_SIZE;
+}
+
+void fb_endFill(uint8_t slot)
+{
+    g_fb->filled++;
+    g_fb->state[slot] = FB_READY;
+}
+
+void fb_abortFill(uint8_t slot)
+{
+    g_fb->aborted++;
+    g_fb->state[slot] = FB_ARMED;
+}
+
+void fb_disarm(void)
+{
+    uint8_t i;
+
+    for (i=0; i<FB_SLOTS; i++)
+    {
+        if (g_fb->state[i]==FB_ARMED)
+            g_fb->state[i] = FB_FREE;
+    }
+}
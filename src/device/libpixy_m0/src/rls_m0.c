@@ -14,22 +14,39 @@
 //
 
 #include "rls_m0.h"
+#include "rls_ref.h"
 #include "frame_m0.h"
+#include "exec_m0.h"
 #include "chirp.h"
 #include "qqueue.h"
+#include "framebuf.h"
 #include "pixyvals.h"
 #include "assembly.h"
 
-#define CAMERA_FPS     50    // Frame rate of camera
-#define IMAGE_LOG_FPS  10    // Frame rate of logging images to SD Card
-
-static const uint32_t DIVIDER_FPS = CAMERA_FPS / IMAGE_LOG_FPS;
-static const uint32_t MAX_NEW_QVALS_PER_LINE  = ((CAM_RES2_WIDTH/3)+2);
-static const uint32_t PIXEL_THRESHOLD = 170;
-static const uint32_t WIDTH = CAM_RES2_WIDTH;
-static const uint32_t INVALID_COL = CAM_RES2_WIDTH + 1;
-
-
+static const uint32_t MAX_NEW_QVALS_PER_LINE  = RLS_MAX_LINE_QVALS;
+// lines between SEVs, which wake the M4 if it is waiting for run lengths (exec_waitM0())
+static const uint32_t DOORBELL_LINES = 8;
+// set from the M4's (setRLSParams) as a frame starts, processLine() loads the threshold
+// each line
+static uint32_t s_pixelThreshold = RLS_PIXEL_THRESHOLD;
+// with hysteresis, the pixel threshold a run must get over, 0 without; s_pixelThreshold is
+// then the low one and the line's pixels go to s_line when the frame isn't written
+static uint32_t s_brightThreshold = 0;
+static uint8_t s_line[RLS_LINE_WIDTH];
+// with the run intensity, each run is followed by its brightest pixel and pixel sum
+// (QVAL_LAYOUT_INTENSITY), which also needs the line's pixels
+static uint32_t s_intensity = RLS_RUN_INTENSITY;
+static uint32_t s_logDivider = RLS_CAMERA_FPS / RLS_LOG_FPS;
+// what setRLSParams() was given, which the next frame takes up
+static uint32_t s_newPixelThreshold, s_newBrightThreshold, s_newIntensity, s_newLogDivider;
+static uint8_t s_newParams = 0;
+static const uint32_t WIDTH = RLS_LINE_WIDTH;
+static const uint32_t INVALID_COL = RLS_INVALID_COL;
+
+
+// Every pixel takes the same cycles whichever way it goes, the NOPs at sync_cycles_xx
+// make up the difference; scripts/check_rls_cycles.py counts them.  processLineRef() in
+// rls_ref.c is this in C, change both.
 _ASM_FUNC uint32_t processLine(uint32_t *gpio, uint8_t *framebuf, Qval *qMem, uint32_t writeFrame)
 {
 // r0: gpio register
@@ -78,7 +95,7 @@ _ASM_FUNC uint32_t processLine(uint32_t *gpio, uint8_t *framebuf, Qval *qMem, ui
     _ASM(MOV    r10, r7)
 
     // fetch pixel threshold value
-    _ASM(LDR    r6, =PIXEL_THRESHOLD)
+    _ASM(LDR    r6, =s_pixelThreshold)
     _ASM(LDR    r7, [r6])
     _ASM(MOV    r11, r7)
 
@@ -260,29 +277,58 @@ int32_t getRLSFrame(void)
     // must be deterministic in regards to timing. This means, if the M0 is writing the frame
     // pixels to the shared frame buffer, the M4 core should not access it during this time
     // or else the pixel sync timing will not align and the pixel data is invalid.
+    // A frame is only written into a slot the M4 armed (framebuf.h), which it leaves alone
+    // until the frame is READY, so a write to the SD card can't be overwritten either.
     static uint32_t s_frameCount = 0;
-    uint32_t writeFrame = (s_frameCount++ % DIVIDER_FPS == 0);
+    if (s_newParams)
+    {
+        s_pixelThreshold = s_newPixelThreshold;
+        s_brightThreshold = s_newBrightThreshold;
+        s_intensity = s_newIntensity;
+        s_logDivider = s_newLogDivider;
+        s_newParams = 0;
+    }
+    uint8_t slot = (s_frameCount++ % s_logDivider == 0) ? fb_beginFill() : FB_NO_SLOT;
+    uint32_t writeFrame = slot != FB_NO_SLOT;
 
-    // If writing the pixels to the frame buffer then use the correct shared memory address.
+    // If writing the pixels to the frame buffer then use the slot's frame.
     // Else use a dummy address on the stack. See comments in the processLine function for more details.
+    // With hysteresis or the run intensity the pixels are kept either way, one line at a
+    // time in s_line.
     uint8_t dummyFrameBuf;
-    uint8_t *frameBuf = (writeFrame) ? (uint8_t*)MEM_M0_FRAME_LOC : &dummyFrameBuf;
+    uint32_t keepLine = s_brightThreshold || s_intensity;
+    uint8_t *frameBuf = (writeFrame) ? fb_frame(slot) : (keepLine) ? s_line : &dummyFrameBuf;
+    uint32_t increment = writeFrame || keepLine;
+    uint32_t maxLineQvals = (s_intensity) ? 2*MAX_NEW_QVALS_PER_LINE : MAX_NEW_QVALS_PER_LINE;
 
     uint32_t numQvals;
     Qval qScratch[MAX_NEW_QVALS_PER_LINE];
-    Qval lineBegin = {QVAL_LINE_BEGIN};
+    Qval intensity;
+    Qval lineBegin = {QVAL_LINE_BEGIN, (s_intensity) ? QVAL_LAYOUT_INTENSITY : QVAL_LAYOUT_RUNS};
 
-    // This waits for the current frame to finish to avoid partial frame.
-    skipLines(0);
+    // This waits for the current frame to finish to avoid partial frame, as skipLines(0),
+    // but gives up if the M4 stops us (M0C_STOP) meanwhile.  New parameters are taken
+    // meanwhile too, for the next frame.
+    while(!CAM_VSYNC())
+    {
+        if (exec_stopRequested())
+            goto abort;
+    }
+    while(CAM_VSYNC())
+    {
+        if (exec_stopRequested())
+            goto abort;
+    }
 
     for (uint32_t line = 0; line < CAM_RES2_HEIGHT; line++)
     {
-        // not enough space--- return error
-        if (qq_free() < MAX_NEW_QVALS_PER_LINE)
+        // stopped, or not enough space--- return error, the M4 drops what it has of the frame
+        if (exec_stopRequested() || qq_free() < maxLineQvals)
         {
             Qval frameError = {QVAL_FRAME_ERROR};
             qq_enqueue(&frameError);
-            return -1;
+            __SEV();
+            goto abort;
         }
         qq_enqueue(&lineBegin);
 
@@ -293,25 +339,79 @@ int32_t getRLSFrame(void)
         // for IR application.
         skipLine();
 
-        numQvals = processLine((uint32_t *)&CAM_PORT, frameBuf, qScratch, writeFrame);
+        numQvals = processLine((uint32_t *)&CAM_PORT, frameBuf, qScratch, increment);
 
-        if (writeFrame)
-            frameBuf += CAM_RES2_WIDTH;
+        // Done before the blue and green line is over, which skipLine() waits for: at worst
+        // it looks at each pixel of the line once, about half the 7680 cycles a line takes.
+        // With the run intensity a run's brightest pixel is there anyway and tells if
+        // hysteresis keeps it, so the line isn't looked at twice.
+        if (s_brightThreshold && !s_intensity)
+            numQvals = keepBrightRuns(frameBuf, s_brightThreshold, qScratch, numQvals);
 
         for (uint32_t i = 0; i < numQvals; ++i)
         {
-            qq_enqueue(&qScratch[i]);
+            if (s_intensity)
+            {
+                runIntensity(frameBuf, &qScratch[i], &intensity);
+                if (QVAL_INTENSITY_PEAK(intensity) <= s_brightThreshold)
+                    continue;
+                qq_enqueue(&qScratch[i]);
+                qq_enqueue(&intensity);
+            }
+            else
+                qq_enqueue(&qScratch[i]);
         }
+
+        if (writeFrame)
+            frameBuf += CAM_RES2_WIDTH;
+
+        if (line % DOORBELL_LINES == DOORBELL_LINES - 1)
+            __SEV();
     }
 
-    Qval frameEnd = {QVAL_FRAME_END};
-    if (writeFrame) frameEnd.m_col_start |= QVAL_WRITE_FRAME_BIT;
+    // the slot is handed over before the frame end that names it is queued
+    Qval frameEnd = {QVAL_FRAME_END, FB_NO_SLOT};
+    if (writeFrame)
+    {
+        fb_endFill(slot);
+        frameEnd.m_col_start |= QVAL_WRITE_FRAME_BIT;
+        frameEnd.m_col_end = slot;
+    }
     qq_enqueue(&frameEnd);
+    __SEV();
+    return 0;
+
+abort:
+    if (writeFrame)
+        fb_abortFill(slot);
+    return -1;
+}
+
+// A low threshold of 0, or not under threshold, is no hysteresis.  Taken while a frame is
+// read (exec_stopRequested()), the parameters apply from the next frame.
+int32_t setRLSParams(uint8_t *threshold, uint8_t *lowThreshold, uint8_t *intensity, uint8_t *logFps)
+{
+    if (*logFps==0 || *logFps>RLS_CAMERA_FPS)
+        return -1;
+    if (*lowThreshold && *lowThreshold<*threshold)
+    {
+        s_newPixelThreshold = *lowThreshold;
+        s_newBrightThreshold = *threshold;
+    }
+    else
+    {
+        s_newPixelThreshold = *threshold;
+        s_newBrightThreshold = 0;
+    }
+    s_newIntensity = *intensity!=0;
+    s_newLogDivider = RLS_CAMERA_FPS / *logFps;
+    s_newParams = 1;
     return 0;
 }
 
 int rls_init(void)
 {
     chirpSetProc("getRLSFrame", (ProcPtr)getRLSFrame);
+    chirpSetProc("setRLSParams", (ProcPtr)setRLSParams);
     return 0;
 }
@@ -0,0 +1,103 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include "rls_ref.h"
+
+// Step for step as processLine(), the registers it keeps are named in the comments.
+uint32_t processLineRef(const uint8_t *line, uint32_t threshold, Qval *qMem)
+{
+    uint32_t col;                           // r3, col_current
+    uint32_t colStart = RLS_INVALID_COL;    // r4
+    uint32_t n = 0;                         // r5, Q count
+
+    for (col=0; col<RLS_LINE_WIDTH; col++)
+    {
+        // BGT, the pixel is zero extended so signed is unsigned here
+        if (line[col]>threshold)
+        {
+            if (colStart==RLS_INVALID_COL)
+                colStart = col;
+        }
+        else if (colStart!=RLS_INVALID_COL)
+        {
+            qMem[n].m_col_start = colStart;
+            qMem[n].m_col_end = col;
+            n++;
+            colStart = RLS_INVALID_COL;
+            // q memory full, off to eol, where nothing more is stored
+            if (n==RLS_MAX_LINE_QVALS)
+                return n;
+        }
+    }
+
+    // eol: end any run that was in progress
+    if (colStart!=RLS_INVALID_COL)
+    {
+        qMem[n].m_col_start = colStart;
+        qMem[n].m_col_end = col;
+        n++;
+    }
+    return n;
+}
+
+uint32_t keepBrightRuns(const uint8_t *line, uint32_t threshold, Qval *qMem, uint32_t n)
+{
+    uint32_t i, kept = 0;
+    const uint8_t *p, *end;
+
+    for (i=0; i<n; i++)
+    {
+        end = line + qMem[i].m_col_end;
+        for (p=line+qMem[i].m_col_start; p<end && *p<=threshold; p++);
+        if (p<end)
+            qMem[kept++] = qMem[i];
+    }
+    return kept;
+}
+
+void runIntensity(const uint8_t *line, const Qval *run, Qval *intensity)
+{
+    const uint8_t *p, *end = line + run->m_col_end;
+    uint32_t peak = 0, sum = 0;
+
+    for (p=line+run->m_col_start; p<end; p++)
+    {
+        sum += *p;
+        if (*p>peak)
+            peak = *p;
+    }
+    intensity->m_col_start = QVAL_INTENSITY_START(peak, sum);
+    intensity->m_col_end = QVAL_INTENSITY_END(sum);
+}
+
+uint32_t rlsLineRef(const uint8_t *line, uint32_t threshold, uint32_t lowThreshold, uint32_t intensity, Qval *qMem)
+{
+    uint32_t i, n;
+
+    if (lowThreshold==0 || lowThreshold>=threshold)
+        n = processLineRef(line, threshold, qMem);
+    else
+        n = keepBrightRuns(line, threshold, qMem, processLineRef(line, lowThreshold, qMem));
+    if (!intensity)
+        return n;
+
+    // spread the runs out from the back, each one's old place is free once it's moved
+    for (i=n; i>0; i--)
+    {
+        qMem[2*i-2] = qMem[i-1];
+        runIntensity(line, &qMem[2*i-2], &qMem[2*i-1]);
+    }
+    return 2*n;
+}
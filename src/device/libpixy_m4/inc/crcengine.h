@@ -0,0 +1,38 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef _CRCENGINE_H
+#define _CRCENGINE_H
+#include <inttypes.h>
+
+// CRC engine registers, see the LPC43xx user manual (UM10503), CRC engine chapter
+#define CRC_BASE                  0x40087000
+#define CRC_MODE                  (*(volatile uint32_t *)(CRC_BASE + 0x000))
+#define CRC_SEED                  (*(volatile uint32_t *)(CRC_BASE + 0x004))
+#define CRC_SUM                   (*(volatile uint32_t *)(CRC_BASE + 0x008))   // read
+#define CRC_WR_DATA32             (*(volatile uint32_t *)(CRC_BASE + 0x008))   // write
+#define CRC_WR_DATA8              (*(volatile uint8_t *)(CRC_BASE + 0x008))
+
+#define CRC_MODE_POLY_CRC32       2
+#define CRC_MODE_BIT_RVS_WR       (1<<2)
+#define CRC_MODE_CMPL_WR          (1<<3)
+#define CRC_MODE_BIT_RVS_SUM      (1<<4)
+#define CRC_MODE_CMPL_SUM         (1<<5)
+
+// Sets the engine up for chirp's crc-32 (zlib) and hands it to Chirp if it passes a self
+// test, else chirp keeps its table.  Not reentrant, the engine holds one sum at a time.
+int crc_init();
+
+#endif
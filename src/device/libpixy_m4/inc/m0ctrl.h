@@ -0,0 +1,34 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef _M0CTRL_H
+#define _M0CTRL_H
+
+#include <stdint.h>
+
+// Commands to the M0 through the shared mailbox (m0cmd.h).  Each waits for the M0 to
+// finish and returns its result, or M0_TIMEOUT if it didn't within the command's timeout.
+
+#define M0_TIMEOUT             -100
+#define M0_CMD_TIMEOUT_US      100000
+#define M0_FRAME_TIMEOUT_US    500000    // a grab in mode 0 takes up to 2 frames
+
+int32_t m0_run(uint8_t prog);
+int32_t m0_stop();             // done when the M0 has left the frame under way
+int32_t m0_setRLSParams(uint8_t threshold, uint8_t lowThreshold, uint8_t intensity, uint8_t logFps);
+int32_t m0_getFrame(uint8_t type, uint8_t *memory, uint16_t xOffset, uint16_t yOffset, uint16_t xWidth, uint16_t yWidth);
+bool m0_running();
+
+#endif
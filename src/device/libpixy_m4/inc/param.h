@@ -32,6 +32,8 @@ int32_t prm_get(const char *id, ...);
 int32_t prm_getChirp(const char *id, Chirp *chirp);
 int32_t prm_getInfo(const char *id, Chirp *chirp);
 int32_t prm_getAll(const uint16_t &index, Chirp *chirp);
+int32_t prm_begin();
+int32_t prm_commit();
 
 int prm_setShadowCallback(const char *id, ShadowCallback callback);
 int32_t prm_resetShadows();
@@ -27,6 +27,7 @@
 #include "ipc_mbx.h"
 #include "chirp.hpp"
 #include "pixyvals.h"
+#include "framebuf.h"
 
 #ifdef KEIL
 extern uint8_t *__Vectors;
@@ -49,5 +50,6 @@ void periodic();
 
 extern Chirp *g_chirpUsb;
 extern Chirp *g_chirpM0;
+extern FrameBuf *g_frameBuf;
 
 #endif
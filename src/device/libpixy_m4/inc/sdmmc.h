@@ -47,4 +47,11 @@ bool sdmmc_format();
 bool sdmmc_updateHeader();
 bool sdmmc_writeFrame(void *frame, uint32_t len, const BlobA *blobs, uint16_t blob_cnt);
 
+// The same as sdmmc_writeFrame() a few blocks at a time, so the main loop can do other work
+// in between.  The frame mustn't change until sdmmc_writeSlice() returns 0 (done) or -1
+// (error), or the write is aborted.
+bool sdmmc_beginFrame(void *frame, uint32_t len, const BlobA *blobs, uint16_t blob_cnt);
+int32_t sdmmc_writeSlice(uint32_t max_blocks);  // returns blocks left
+void sdmmc_abortFrame();
+
 #endif
@@ -134,7 +134,10 @@
 #define USB_ADC_SIF2_NUM    2
 #define USB_CDC             0
 
-#define USB_DEV_BUFSIZE     64
+#define USB_DEV_BUFSIZE     64      // bulk max packet size at full speed
+#define USB_HS_BUFSIZE      512     // bulk max packet size at high speed
+#define USB_DTD_LEN         0x4000  // bytes per bulk dTD, a multiple of both packet sizes that always fits in 5 pages
+#define USB_DTD_CHAIN       4       // dTDs queued at once on the bulk endpoints, one interrupt per USB_DTD_CHAIN*USB_DTD_LEN bytes
 #define USB_BULK_IN_EP      0x82
 #define USB_BULK_OUT_EP     0x02
 /*
@@ -27,6 +27,7 @@ public:
     virtual int receive(uint8_t *data, uint32_t len, uint16_t timeoutMs);
     virtual void setTimer();
     virtual uint32_t getTimer();
+    virtual uint32_t blockSize();
 
 private:
     uint32_t m_timer;
@@ -38,7 +38,7 @@
  extern "C" {
 #endif
 
-#define USB_MAX_CHUNK        0x4000
+#define USB_MAX_CHUNK        (USB_DTD_LEN*USB_DTD_CHAIN)
 
 /* USB Device Events Callback Functions */
 extern void USB_Power_Event     (uint32_t power);
@@ -67,6 +67,7 @@ extern void USB_Feature_Event   (void);
 
 extern void USB_UserInit(void);
 extern uint32_t USB_handleState(void);
+extern uint32_t USB_MaxPacketSize(void);
 extern void USB_Recv(uint8_t *data, uint32_t len);
 extern void USB_Send(const uint8_t *data, uint32_t len);
 extern void USB_RecvReset(void);
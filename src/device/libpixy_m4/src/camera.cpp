@@ -17,6 +17,8 @@
 #include <pixy_init.h>
 #include <pixyvals.h>
 #include "camera.h"
+#include "m0ctrl.h"
+#include "sdmmc.h"
 #include "misc.h"
 
 static const ProcModule g_module[] =
@@ -475,7 +477,7 @@ int cam_testPattern(const uint8_t &enable)
 int32_t cam_getFrame(uint8_t *memory, uint32_t memSize, uint8_t type, uint16_t xOffset, uint16_t yOffset, uint16_t xWidth, uint16_t yWidth)
 {
     int32_t res;
-    int32_t responseInt = -1;
+    int32_t responseInt;
 
     if (xWidth*yWidth>memSize)
         return -2;
@@ -504,10 +506,8 @@ int32_t cam_getFrame(uint8_t *memory, uint32_t memSize, uint8_t type, uint16_t x
     if ((res=cam_setMode(type&0x0f))<0)
         return res;
 
-    // forward call to M0, get frame
-    g_chirpM0->callSync(g_getFrameM0,
-        UINT8(type), UINT32((uint32_t)memory), UINT16(xOffset), UINT16(yOffset), UINT16(xWidth), UINT16(yWidth), END_OUT_ARGS,
-        &responseInt, END_IN_ARGS);
+    // have the M0 get the frame (its getFrame chirp proc is kept for debugging)
+    responseInt = m0_getFrame(type, memory, xOffset, yOffset, xWidth, yWidth);
 
     if (responseInt==0)
     {
@@ -527,12 +527,16 @@ int32_t cam_getFrameChirp(const uint8_t &type, const uint16_t &xOffset, const ui
 int32_t cam_getFrameChirpFlags(const uint8_t &type, const uint16_t &xOffset, const uint16_t &yOffset, const uint16_t &xWidth, const uint16_t &yWidth, Chirp *chirp, uint8_t renderFlags)
 {
     int32_t result, len;
-    uint8_t *frame = (uint8_t *)MEM_USB_FRAME_LOC;
+    uint32_t size;
+    uint8_t *frame = cam_frameMemory(&size);
+
+    if (frame==NULL)
+        return -4;
 
     // fill buffer contents manually for return data
-    len = Chirp::serialize(chirp, frame, MEM_USB_FRAME_SIZE, HTYPE(FOURCC('B','A','8','1')), HINT8(renderFlags), UINT16(xWidth), UINT16(yWidth), UINTS8_NO_COPY(xWidth*yWidth), END);
+    len = Chirp::serialize(chirp, frame, size, HTYPE(FOURCC('B','A','8','1')), HINT8(renderFlags), UINT16(xWidth), UINT16(yWidth), UINTS8_NO_COPY(xWidth*yWidth), END);
     // write frame after chirp args
-    result = cam_getFrame(frame+len, MEM_USB_FRAME_SIZE-len, type, xOffset, yOffset, xWidth, yWidth);
+    result = cam_getFrame(frame+len, size-len, type, xOffset, yOffset, xWidth, yWidth);
 
     // tell chirp to use this buffer
     chirp->useBuffer(frame, len+xWidth*yWidth);
@@ -540,6 +544,18 @@ int32_t cam_getFrameChirpFlags(const uint8_t &type, const uint16_t &xOffset, con
     return result;
 }
 
+// All of the frame memory (framebuf.h), for a frame sent over USB; NULL while the M0 runs
+// or a slot is busy.  With the M0 stopped no program is running, and an SD write one left
+// behind when it stopped is dropped.
+uint8_t *cam_frameMemory(uint32_t *size)
+{
+    if (m0_running())
+        return NULL;
+    sdmmc_abortFrame();
+    g_frameBuf->releaseAll(FB_SD_WRITING);
+    return g_frameBuf->acquireAll(FB_USB_SENDING, size);
+}
+
 int32_t cam_setRegister(const uint8_t &reg, const uint8_t &value)
 {
     g_sccb->Write(reg, value);
@@ -0,0 +1,52 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include "chirp.hpp"
+#include "crcengine.h"
+
+// The engine shifts each write in msb first, so the data is bit-reversed going in to get the
+// reflected crc.  Reversing a little-endian word puts bit 0 of its first byte first, so whole
+// words can go in once the buffer is aligned.
+static uint32_t crc_calc32(const uint8_t *buf, uint32_t len)
+{
+    CRC_SEED = 0xffffffff;
+
+    for (; len && ((uint32_t)buf&3); len--)
+        CRC_WR_DATA8 = *buf++;
+    for (; len>=4; buf+=4, len-=4)
+        CRC_WR_DATA32 = *(const uint32_t *)buf;
+    while (len--)
+        CRC_WR_DATA8 = *buf++;
+
+    return CRC_SUM;
+}
+
+int crc_init()
+{
+    uint8_t test[67];
+    uint32_t i;
+
+    CRC_MODE = CRC_MODE_POLY_CRC32 | CRC_MODE_BIT_RVS_WR | CRC_MODE_BIT_RVS_SUM | CRC_MODE_CMPL_SUM;
+
+    // standard check value, and the table's result over an unaligned buffer with a tail
+    for (i=0; i<sizeof(test); i++)
+        test[i] = i*7 + 3;
+    if (crc_calc32((const uint8_t *)"123456789", 9)!=0xcbf43926 ||
+            crc_calc32(test+1, sizeof(test)-1)!=Chirp::calcCrc32(test+1, sizeof(test)-1))
+        return -1;
+
+    Chirp::setCrc32Engine(crc_calc32);
+    return 0;
+}
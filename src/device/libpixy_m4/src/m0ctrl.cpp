@@ -0,0 +1,81 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include "lpc43xx.h"
+#include "misc.h"
+#include "m0cmd.h"
+#include "m0ctrl.h"
+
+// The M0 writes done last, so result is valid once it matches.  Polled rather than slept
+// on, the M0's line doorbells would wake a WFE anyway and the timeout needs the timer.
+static int32_t command(uint8_t cmd, uint32_t timeoutUs)
+{
+    volatile M0Cmd *m0c = M0C_OBJECT;
+    uint32_t timer, seq;
+
+    m0c->cmd = cmd;
+    seq = m0c->seq + 1;
+    __DMB();
+    m0c->seq = seq;
+    __DSB();
+    __SEV();
+
+    setTimer(&timer);
+    while (m0c->done!=seq)
+    {
+        if (getTimer(timer)>timeoutUs)
+            return M0_TIMEOUT;
+    }
+    __DMB();
+    return m0c->result;
+}
+
+int32_t m0_run(uint8_t prog)
+{
+    M0C_OBJECT->args.run.prog = prog;
+    return command(M0C_RUN, M0_CMD_TIMEOUT_US);
+}
+
+int32_t m0_stop()
+{
+    return command(M0C_STOP, M0_CMD_TIMEOUT_US);
+}
+
+int32_t m0_setRLSParams(uint8_t threshold, uint8_t lowThreshold, uint8_t intensity, uint8_t logFps)
+{
+    M0C_OBJECT->args.rls.threshold = threshold;
+    M0C_OBJECT->args.rls.lowThreshold = lowThreshold;
+    M0C_OBJECT->args.rls.intensity = intensity;
+    M0C_OBJECT->args.rls.logFps = logFps;
+    return command(M0C_RLS_PARAMS, M0_CMD_TIMEOUT_US);
+}
+
+int32_t m0_getFrame(uint8_t type, uint8_t *memory, uint16_t xOffset, uint16_t yOffset, uint16_t xWidth, uint16_t yWidth)
+{
+    volatile M0Cmd *m0c = M0C_OBJECT;
+
+    m0c->args.frame.type = type;
+    m0c->args.frame.memory = (uint32_t)(uintptr_t)memory;
+    m0c->args.frame.xOffset = xOffset;
+    m0c->args.frame.yOffset = yOffset;
+    m0c->args.frame.xWidth = xWidth;
+    m0c->args.frame.yWidth = yWidth;
+    return command(M0C_GET_FRAME, M0_FRAME_TIMEOUT_US);
+}
+
+bool m0_running()
+{
+    return M0C_OBJECT->running!=0;
+}
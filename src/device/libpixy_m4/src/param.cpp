@@ -17,21 +17,27 @@
 #include <string.h>
 #include <stdio.h>
 #include "param.h"
+#include "paramstore.h"
 #include "pixytypes.h"
 #include "flash.h"
-#include "debug.h"
 #include "pixy_init.h"
-#include "simplevector.h"
 
-#define PRM_MAX_LEN                 256
-#define PRM_HEADER_LEN              8
-#define PRM_DATA_LEN                (PRM_MAX_LEN-PRM_HEADER_LEN)
 #define PRM_ALLOCATED_LEN           (FLASH_SECTOR_SIZE*8) // 8 sectors
 #define PRM_FLASH_LOC               (FLASH_BEGIN + FLASH_SIZE - PRM_ALLOCATED_LEN)  // last sectors
-#define PRM_ENDREC_OFFSET           ((PRM_ALLOCATED_LEN/PRM_MAX_LEN)*PRM_MAX_LEN)  // last sector
-#define PRM_ENDREC                  (PRM_FLASH_LOC + PRM_ENDREC_OFFSET)  // last sector
+#define PRM_MAX_SERIALIZED          64    // room for vserialize(), which doesn't check scalars
 
-// Matternet: This file is only here as a shell so PixyMon doesn't fail.
+// Values are kept serialized, as chirp sends them, in a ParamStore under the CRC of their
+// id.  prm_get() deserializes from the store's RAM copy, so it doesn't touch flash, but
+// it does look the id up, so don't call it per frame.  Programs copy what they need into
+// their own variables when prm_dirty() says something changed.
+
+struct Param
+{
+    const char *id;
+    const char *desc;
+    uint32_t flags;
+    uint16_t key;
+};
 
 static const ProcModule g_module[] =
 {
@@ -39,7 +45,7 @@ static const ProcModule g_module[] =
     "prm_restore",
     (ProcPtr)prm_format,
     {END},
-    "Erase all parameters and restore to default values"
+    "Erase all parameters, the default values are used from the next program start"
     "@r 0 if success, negative if error"
     },
     {
@@ -98,47 +104,253 @@ static const ProcModule g_module[] =
     "@p index index of parameter"
     "@r 0 if success, negative if error"
     },
+    {
+    "prm_begin",
+    (ProcPtr)prm_begin,
+    {END},
+    "Hold the following prm_set calls until prm_commit, which writes them all or none"
+    "@r 0 if success, negative if error"
+    },
+    {
+    "prm_commit",
+    (ProcPtr)prm_commit,
+    {END},
+    "Write the prm_set calls since prm_begin, all or none of them"
+    "@r 0 if success, negative if error"
+    },
     END
 };
 
+static ParamStore g_store;
+static Param g_params[PS_MAX_PARAMS];
+static uint8_t g_numParams = 0;
+static bool g_dirty = false;
+static bool g_batching = false;
+static ParamUpdate g_batch[PS_MAX_BATCH];
+static uint32_t g_batchValues[PS_MAX_BATCH][(PS_MAX_VALUE+3)/4];
+static uint8_t g_batchLen = 0;
+
+static uint16_t key(const char *id)
+{
+    // PS_KEY_COMMIT and PS_KEY_ERASED are the store's
+    return Chirp::calcCrc16((const uint8_t *)id, strlen(id))&0x7fff;
+}
+
+static Param *lookup(const char *id)
+{
+    uint16_t k = key(id);
+    uint8_t i;
+
+    for (i=0; i<g_numParams; i++)
+    {
+        if (g_params[i].key==k && strcmp(g_params[i].id, id)==0)
+            return g_params + i;
+    }
+    return NULL;
+}
 
 int prm_init(Chirp *chirp)
 {
+    ParamFlash flash = {(const uint8_t *)PRM_FLASH_LOC, PRM_FLASH_LOC, FLASH_SECTOR_SIZE,
+                        PRM_ALLOCATED_LEN/FLASH_SECTOR_SIZE, flash_erase, flash_program};
+    int res;
+
+    if ((res=g_store.init(&flash))<0)
+        cprintf("prm: init failed %d\n", res);
     chirp->registerModule(g_module);
-    return 0;
+    return res;
 }
 
-int32_t prm_resetShadows()
+int prm_add(const char *id, uint32_t flags, const char *desc, ...)
 {
-    return -1;
+    uint32_t buf[PRM_MAX_SERIALIZED/4];
+    va_list args;
+    int len;
+    uint16_t k = key(id);
+    uint8_t i;
+
+    if (lookup(id))
+        return 0; // added already, programs add theirs each time they start
+    for (i=0; i<g_numParams; i++)
+    {
+        if (g_params[i].key==k)
+            return -1; // another id with this CRC, rename one of them
+    }
+    if (g_numParams==PS_MAX_PARAMS)
+        return -2;
+
+    va_start(args, desc);
+    len = Chirp::vserialize(NULL, (uint8_t *)buf, sizeof(buf), &args);
+    va_end(args);
+    if (len<0 || len>PS_MAX_VALUE)
+        return -3;
+    if (g_store.add(k, buf, len)<0)
+        return -2;
+
+    g_params[g_numParams].id = id;
+    g_params[g_numParams].desc = desc;
+    g_params[g_numParams].flags = flags;
+    g_params[g_numParams++].key = k;
+    return 0;
 }
 
-int32_t prm_getInfo(const char *id, Chirp *chirp)
+int32_t prm_get(const char *id, ...)
 {
-    return -1;
+    Param *param = lookup(id);
+    const uint8_t *value;
+    uint8_t len;
+    va_list args;
+    int res;
+
+    if (param==NULL || (value=g_store.get(param->key, &len))==NULL)
+        return -1;
+    va_start(args, id);
+    // strings point into the store's copy, good until the next set
+    res = Chirp::vdeserialize((uint8_t *)value, len, &args);
+    va_end(args);
+    return res;
 }
 
-int32_t  prm_getAll(const uint16_t &index, Chirp *chirp)
+static int32_t setValue(Param *param, const uint8_t *value, uint32_t len)
 {
-    return -1;
+    uint8_t argList[CRP_MAX_ARGS+1], newArgList[CRP_MAX_ARGS+1];
+    const uint8_t *current;
+    uint8_t currentLen;
+    uint32_t *staged;
+
+    if (g_batching && g_batchLen==PS_MAX_BATCH)
+        return -3;
+    current = g_store.get(param->key, &currentLen);
+    if (current==NULL || len!=currentLen)
+        return -2;
+    staged = g_batchValues[g_batchLen];
+    memcpy(staged, value, len); // aligned, as vserialize() laid it out
+    // same types, not just the same length
+    if (Chirp::getArgList((uint8_t *)current, len, argList)<0 ||
+        Chirp::getArgList((uint8_t *)staged, len, newArgList)<0 ||
+        strcmp((char *)argList, (char *)newArgList)!=0)
+        return -2;
+
+    if (g_batching)
+    {
+        g_batch[g_batchLen].key = param->key;
+        g_batch[g_batchLen].value = staged;
+        g_batch[g_batchLen++].len = len;
+        return 0;
+    }
+    return g_store.set(param->key, staged, len)<0 ? -4 : 0;
 }
 
-int prm_format()
+int32_t prm_set(const char *id, ...)
 {
-    return -1;
+    Param *param = lookup(id);
+    uint32_t buf[PRM_MAX_SERIALIZED/4];
+    va_list args;
+    int len;
+
+    if (param==NULL)
+        return -1;
+    va_start(args, id);
+    len = Chirp::vserialize(NULL, (uint8_t *)buf, sizeof(buf), &args);
+    va_end(args);
+    if (len<0)
+        return -2;
+    return setValue(param, (uint8_t *)buf, len);
 }
 
 int32_t prm_setChirp(const char *id, const uint32_t &valLen, const uint8_t *val)
 {
-    return -1;
+    Param *param = lookup(id);
+
+    if (param==NULL)
+        return -1;
+    return setValue(param, val, valLen);
+}
+
+int32_t prm_begin()
+{
+    g_batching = true;
+    g_batchLen = 0;
+    return 0;
+}
+
+int32_t prm_commit()
+{
+    int res;
+
+    if (!g_batching)
+        return -1;
+    g_batching = false;
+    res = g_store.set(g_batch, g_batchLen);
+    g_batchLen = 0;
+    return res<0 ? -4 : 0;
 }
 
 int32_t prm_getChirp(const char *id, Chirp *chirp)
 {
-    return -1;
+    Param *param = lookup(id);
+    const uint8_t *value;
+    uint8_t len;
+
+    if (param==NULL || (value=g_store.get(param->key, &len))==NULL)
+        return -1;
+    if (chirp)
+        CRP_RETURN(chirp, UINTS8(len, value), END);
+    return 0;
+}
+
+int32_t prm_getInfo(const char *id, Chirp *chirp)
+{
+    Param *param = lookup(id);
+
+    if (param==NULL)
+        return -1;
+    if (chirp)
+        CRP_RETURN(chirp, STRING(param->desc), END);
+    return 0;
+}
+
+int32_t prm_getAll(const uint16_t &index, Chirp *chirp)
+{
+    uint8_t argList[CRP_MAX_ARGS+1];
+    const uint8_t *value;
+    uint8_t len;
+
+    if (index>=g_numParams || (value=g_store.get(g_params[index].key, &len))==NULL)
+        return -1;
+    if (Chirp::getArgList((uint8_t *)value, len, argList)<0)
+        return -2;
+    if (chirp)
+        CRP_RETURN(chirp, UINT32(g_params[index].flags), STRING((char *)argList), STRING(g_params[index].id),
+                   STRING(g_params[index].desc), UINTS8(len, value), END);
+    return 0;
+}
+
+bool prm_verifyAll()
+{
+    return true; // the store checks each record's CRC as it loads
+}
+
+int prm_format()
+{
+    return g_store.format()<0 ? -1 : 0;
 }
 
 int32_t prm_setDirty()
+{
+    g_dirty = true;
+    return 0;
+}
+
+bool prm_dirty()
+{
+    bool dirty = g_dirty;
+
+    g_dirty = false;
+    return dirty;
+}
+
+int32_t prm_resetShadows()
 {
     return -1;
 }
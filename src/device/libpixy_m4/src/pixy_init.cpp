@@ -27,9 +27,11 @@
 #include "power.h"
 #include "misc.h"
 #include "sdmmc.h"
+#include "crcengine.h"
 
 Chirp *g_chirpUsb = NULL;
 Chirp *g_chirpM0 = NULL;
+FrameBuf *g_frameBuf = NULL;
 
 void ADCInit()
 {
@@ -170,8 +172,9 @@ void pixyInit(void)
     SCTInit();
     CameraInit();
 
-    // initialize shared memory interface before running M0
+    // initialize shared memory interface and frame slots before running M0
     SMLink *smLink = new SMLink;
+    g_frameBuf = new FrameBuf;
 
     // start slave
 #ifdef KEIL
@@ -191,6 +194,7 @@ void pixyInit(void)
     g_chirpUsb->setRecvTimeout(3000); // set a high timeout because the host can sometimes go AWOL for a second or two....
 
     g_chirpM0 = new Chirp(false, true, smLink);
+    crc_init();
 
     // initialize devices/modules
     led_init();
@@ -208,6 +212,7 @@ void pixySimpleInit(void)
 
     USBLink *usbLink = new USBLink;
     g_chirpUsb = new Chirp(false, false, usbLink);
+    crc_init();
 }
 
 void cprintf(const char *format, ...)
@@ -13,6 +13,7 @@
 // end license header
 //
 
+#include "camera.h"
 #include "cameravals.h"
 #include "chirp.hpp"
 #include "debug.h"
@@ -63,6 +64,12 @@ static uint32_t session_cnt_ = 0;
 static int32_t session_id_ = -1;
 static uint32_t session_block_ = SESSION_BLOCK_START;
 static uint32_t frame_index_ = 0;
+// the frame being written, see sdmmc_beginFrame()
+static uint8_t *write_buf_ = NULL;
+static int write_block_ = 0;
+static int write_left_ = 0;
+static uint32_t write_start_us_ = 0;
+static uint32_t last_write_time_us_ = 0;
 
 
 // Function used by SDMMC stack for delaying time
@@ -87,8 +94,16 @@ static void sdmmc_setup_wakeup(void *bits)
 // Function used by SDMMC stack
 static uint32_t sdmmc_irq_driven_wait(void)
 {
-    // Wait for event
-    while (sdio_wait_exit_ == 0) {}
+    // Sleep until the interrupt, with interrupts masked between the check and the WFI so
+    // one can't come in between and leave us asleep.  WFI still wakes on it.
+    __disable_irq();
+    while (sdio_wait_exit_ == 0)
+    {
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
 
     // Get status and clear interrupts
     uint32_t status = Chip_SDIF_GetIntStatus(LPC_SDMMC);
@@ -108,15 +123,21 @@ extern "C" void SDIO_IRQHandler(void)
 static int read_blocks(const uint32_t &blkStart, const uint32_t &blkCnt, Chirp *chirp)
 {
     const int32_t bytecnt = blkCnt * MMC_SECTOR_SIZE;
-    uint8_t *buffer = (uint8_t*)MEM_USB_FRAME_LOC;
+    uint8_t *buffer;
+    uint32_t size;
     int32_t bytes_read;
     int32_t len;
 
     if (blkCnt == 0 || blkCnt > BLOCKS_PER_FRAME || chirp == NULL)
         return -1;
 
+    // not while a frame is being captured, as for a frame sent over USB
+    buffer = cam_frameMemory(&size);
+    if (buffer == NULL)
+        return -1;
+
     // fill buffer contents manually for return data
-    len = Chirp::serialize(chirp, buffer, MEM_USB_FRAME_SIZE, UINTS8_NO_COPY(bytecnt), END);
+    len = Chirp::serialize(chirp, buffer, size, UINTS8_NO_COPY(bytecnt), END);
     if (len <= 0)
         return -1;
 
@@ -303,10 +324,9 @@ bool sdmmc_format()
 }
 
 // Write a frame to the SD Card
-bool sdmmc_writeFrame(void *frame, uint32_t len, const BlobA *blobs, uint16_t blob_cnt)
+bool sdmmc_beginFrame(void *frame, uint32_t len, const BlobA *blobs, uint16_t blob_cnt)
 {
     static uint32_t s_frame_cnt = 0;
-    static uint32_t s_last_write_time_us = 0;
 
     if (init_success_ == false || frame == NULL || session_id_ < 0)
         return false;
@@ -315,34 +335,60 @@ bool sdmmc_writeFrame(void *frame, uint32_t len, const BlobA *blobs, uint16_t bl
         blob_cnt = MAX_BLOBS;
 
     // Get current monotonic time since bootup (microseconds)
-    uint32_t starttime_us;
-    setTimer(&starttime_us);
+    setTimer(&write_start_us_);
 
     // Caculate block to write to.
-    int block = session_block_ + (frame_index_ * BLOCKS_PER_FRAME);
-    int numblocks = len / MMC_SECTOR_SIZE + FRAME_HEADER_BLOCK_SIZE;
+    write_buf_ = (uint8_t *)frame;
+    write_block_ = session_block_ + (frame_index_ * BLOCKS_PER_FRAME);
+    write_left_ = len / MMC_SECTOR_SIZE + FRAME_HEADER_BLOCK_SIZE;
 
     // Prepare frame header
     SdmmcFrameHeader *header = (SdmmcFrameHeader*)frame;
     header->session_cnt = session_cnt_;
     header->frame_cnt = s_frame_cnt;
-    header->timestamp_us = starttime_us;
-    header->last_write_time_us = s_last_write_time_us;
+    header->timestamp_us = write_start_us_;
+    header->last_write_time_us = last_write_time_us_;
     header->blob_cnt = blob_cnt;
     memcpy(header->blobs, blobs, sizeof(BlobA) * blob_cnt);
     header->crc8 = crc8(header, offsetof(SdmmcFrameHeader, crc8));
 
-    int32_t ret = Chip_SDMMC_WriteBlocks(LPC_SDMMC, frame, block, numblocks);
-
-    // Calculate elapsed time
-    uint32_t endtime_us;
-    setTimer(&endtime_us);
-    s_last_write_time_us = endtime_us - starttime_us;
-
+    // the frame gets its place in the session even if it isn't written completely
     frame_index_++;
     if (frame_index_ >= FRAMES_PER_SESSION)
         frame_index_ = 0;
 
     s_frame_cnt++;
-    return ret == (int32_t)len;
+    return true;
+}
+
+int32_t sdmmc_writeSlice(uint32_t max_blocks)
+{
+    int blocks = write_left_ < (int)max_blocks ? write_left_ : max_blocks;
+
+    if (write_left_ == 0 || blocks == 0)
+        return write_left_;
+
+    if (Chip_SDMMC_WriteBlocks(LPC_SDMMC, write_buf_, write_block_, blocks) != blocks * MMC_SECTOR_SIZE)
+    {
+        write_left_ = 0;
+        return -1;
+    }
+    write_buf_ += blocks * MMC_SECTOR_SIZE;
+    write_block_ += blocks;
+    write_left_ -= blocks;
+
+    // Calculate elapsed time, the next frame's header records it
+    if (write_left_ == 0)
+        last_write_time_us_ = getTimer(write_start_us_);
+    return write_left_;
+}
+
+void sdmmc_abortFrame()
+{
+    write_left_ = 0;
+}
+
+bool sdmmc_writeFrame(void *frame, uint32_t len, const BlobA *blobs, uint16_t blob_cnt)
+{
+    return sdmmc_beginFrame(frame, len, blobs, blob_cnt) && sdmmc_writeSlice(BLOCKS_PER_FRAME) == 0;
 }
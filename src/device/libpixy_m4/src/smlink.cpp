@@ -46,6 +46,9 @@ int SMLink::send(const uint8_t *data, uint32_t len, uint16_t timeoutMs)
     }
     // set status to indicate data is avail
     SM_OBJECT->sendStatus = SM_STATUS_DATA_AVAIL;
+    // wake the M0 if it's waiting between frames (exec_m0.c)
+    __DSB();
+    __SEV();
     return len;
 }
 
@@ -355,15 +355,14 @@ INLINE uint32_t USB_ReqGetDescriptor (void) {
           len = ((USB_STRING_DESCRIPTOR *)pD)->bLength;
           break;
         case USB_DEVICE_QUALIFIER_DESCRIPTOR_TYPE:
-          /* USB Chapter 9. page 9.6.2 */
-          if ( DevStatusFS2HS == FALSE ) {
-              return (FALSE);
-          }
-          else
-          {
-             EP0Data.pData = (uint8_t *)USB_DeviceQualifier;
-               len = USB_DEVICE_QUALI_SIZE;
-          }
+          /* USB Chapter 9. page 9.6.2, a high-speed capable device returns this */
+          /* at either speed so a full-speed host port can tell it's running slow */
+#ifdef USE_USB0
+          EP0Data.pData = (uint8_t *)USB_DeviceQualifier;
+          len = USB_DEVICE_QUALI_SIZE;
+#else
+          return (FALSE);  /* USB1 is forced to full speed */
+#endif
           break;
         case USB_OTHER_SPEED_CONFIG_DESCRIPTOR_TYPE:
               if ( DevStatusFS2HS == TRUE ) {
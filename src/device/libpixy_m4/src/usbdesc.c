@@ -182,14 +182,14 @@ ALIGNED(4) const uint8_t USB_HSConfigDescriptor[] = {
   USB_ENDPOINT_DESCRIPTOR_TYPE,      /* bDescriptorType */
   USB_ENDPOINT_OUT(2),               /* bEndpointAddress */
   USB_ENDPOINT_TYPE_BULK,            /* bmAttributes */
-  WBVAL(512),            /* wMaxPacketSize */
+  WBVAL(USB_HS_BUFSIZE),             /* wMaxPacketSize */
   0x00,                              /* bInterval: ignore for Bulk transfer */
 /* Endpoint, EP2 Bulk In */
   USB_ENDPOINT_DESC_SIZE,            /* bLength */
   USB_ENDPOINT_DESCRIPTOR_TYPE,      /* bDescriptorType */
   USB_ENDPOINT_IN(2),                /* bEndpointAddress */
   USB_ENDPOINT_TYPE_BULK,            /* bmAttributes */
-  WBVAL(512),            /* wMaxPacketSize */
+  WBVAL(USB_HS_BUFSIZE),             /* wMaxPacketSize */
   0x00,                              /* bInterval: ignore for Bulk transfer */
 /* Terminator */
   0                                  /* bLength */
@@ -264,7 +264,7 @@ ALIGNED(4) const uint8_t USB_DeviceQualifier[] = {
 ALIGNED(4) const uint8_t USB_FSOtherSpeedConfiguration[] = {
 /* Configuration 1 */
   USB_CONFIGUARTION_DESC_SIZE,       /* bLength */
-  USB_CONFIGURATION_DESCRIPTOR_TYPE, /* bDescriptorType */
+  USB_OTHER_SPEED_CONFIG_DESCRIPTOR_TYPE, /* bDescriptorType */
   WBVAL(                             /* wTotalLength */
     (1 * USB_CONFIGUARTION_DESC_SIZE) +
     (1 * USB_INTERFACE_DESC_SIZE)     +  /* communication interface */
@@ -328,7 +328,7 @@ ALIGNED(4) const uint8_t USB_FSOtherSpeedConfiguration[] = {
 ALIGNED(4) const uint8_t USB_HSOtherSpeedConfiguration[] = {
 /* Configuration 1 */
   USB_CONFIGUARTION_DESC_SIZE,       /* bLength */
-  USB_CONFIGURATION_DESCRIPTOR_TYPE, /* bDescriptorType */
+  USB_OTHER_SPEED_CONFIG_DESCRIPTOR_TYPE, /* bDescriptorType */
   WBVAL(                             /* wTotalLength */
     (1 * USB_CONFIGUARTION_DESC_SIZE) +
     (1 * USB_INTERFACE_DESC_SIZE)     +  /* communication interface */
@@ -374,14 +374,14 @@ ALIGNED(4) const uint8_t USB_HSOtherSpeedConfiguration[] = {
   USB_ENDPOINT_DESCRIPTOR_TYPE,      /* bDescriptorType */
   USB_ENDPOINT_OUT(2),               /* bEndpointAddress */
   USB_ENDPOINT_TYPE_BULK,            /* bmAttributes */
-  WBVAL(USB_DEV_BUFSIZE),            /* wMaxPacketSize */
+  WBVAL(USB_HS_BUFSIZE),             /* wMaxPacketSize */
   0x00,                              /* bInterval: ignore for Bulk transfer */
 /* Endpoint, EP2 Bulk In */
   USB_ENDPOINT_DESC_SIZE,            /* bLength */
   USB_ENDPOINT_DESCRIPTOR_TYPE,      /* bDescriptorType */
   USB_ENDPOINT_IN(2),                /* bEndpointAddress */
   USB_ENDPOINT_TYPE_BULK,            /* bmAttributes */
-  WBVAL(USB_DEV_BUFSIZE),            /* wMaxPacketSize */
+  WBVAL(USB_HS_BUFSIZE),             /* wMaxPacketSize */
   0x00,                              /* bInterval: ignore for Bulk transfer */
 /* Terminator */
   0                                  /* bLength */
@@ -57,19 +57,24 @@
 #pragma diag_suppress 1441
 #endif
 
+/* the bulk endpoints (out and in) get USB_DTD_CHAIN-1 more dTDs each, chained after ep_TD */
 #ifdef __ICCARM__
 #pragma data_alignment=2048
 DQH_T ep_QH[EP_NUM_MAX];
 #pragma data_alignment=32
 DTD_T ep_TD[EP_NUM_MAX];
+#pragma data_alignment=32
+DTD_T ep_TDChain[2][USB_DTD_CHAIN-1];
 #pragma data_alignment=4
 #elif defined   (  __GNUC__  )
 #define __align(x) __attribute__((aligned(x)))
 DQH_T ep_QH[EP_NUM_MAX] __attribute__((aligned(2048)));
 DTD_T ep_TD[EP_NUM_MAX] __attribute__((aligned(32)));
+DTD_T ep_TDChain[2][USB_DTD_CHAIN-1] __attribute__((aligned(32)));
 #else
 DQH_T __align(2048) ep_QH[EP_NUM_MAX];
 DTD_T __align(32) ep_TD[EP_NUM_MAX];
+DTD_T __align(32) ep_TDChain[2][USB_DTD_CHAIN-1];
 #endif
 
 static uint32_t ep_read_len[4];
@@ -523,32 +528,66 @@ void USB_ClrStallEP (uint32_t EPNum) {
  *                       EPNum.7:    Dir
  *                     Buffer pointer
  *                     Transfer buffer size
- *    Return Value:    None
+ *    Return Value:    Number of bytes queued
+ *
+ *  The bulk endpoints queue up to USB_DTD_CHAIN dTDs of USB_DTD_LEN bytes, so a
+ *  transfer of up to USB_DTD_CHAIN*USB_DTD_LEN bytes goes out as back-to-back
+ *  max size packets with a single interrupt at the end.
  */
-void USB_ProgDTD(uint32_t Edpt, uint32_t ptrBuff, uint32_t TsfSize)
+uint32_t USB_ProgDTD(uint32_t Edpt, uint32_t ptrBuff, uint32_t TsfSize)
 {
   DTD_T*  pDTD;
+  uint32_t i, n, chunk, len = 0;
 
-  pDTD = (DTD_T*)&ep_TD[ Edpt ];
-
-  /* Zero out the device transfer descriptors */
-  memset((void*)pDTD, 0, sizeof(DTD_T));
-  /* The next DTD pointer is INVALID */
-  pDTD->next_dTD = 0x01 ;
-
-  /* Length */
-  pDTD->total_bytes = ((TsfSize & 0x7fff) << 16);
-  pDTD->total_bytes |= TD_IOC ;
-  pDTD->total_bytes |= 0x80 ;
+  if ((Edpt >> 1) == (USB_BULK_OUT_EP & 0x0F))
+  {
+    n = (TsfSize + USB_DTD_LEN - 1) / USB_DTD_LEN;
+    if (n > USB_DTD_CHAIN)
+      n = USB_DTD_CHAIN;
+    else if (n == 0)
+      n = 1;
+  }
+  else
+    n = 1;
 
-  pDTD->buffer0 = ptrBuff;
-  pDTD->buffer1 = (ptrBuff + 0x1000) & 0xfffff000;
-  pDTD->buffer2 = (ptrBuff + 0x2000) & 0xfffff000;
-  pDTD->buffer3 = (ptrBuff + 0x3000) & 0xfffff000;
-  pDTD->buffer4 = (ptrBuff + 0x4000) & 0xfffff000;
+  for (i = 0; i < n; i++)
+  {
+    if (i == 0)
+      pDTD = (DTD_T*)&ep_TD[ Edpt ];
+    else
+      pDTD = (DTD_T*)&ep_TDChain[ Edpt & 1 ][ i - 1 ];
+
+    chunk = TsfSize - len;
+    if (n > 1 && chunk > USB_DTD_LEN)
+      chunk = USB_DTD_LEN;
+
+    /* Zero out the device transfer descriptors */
+    memset((void*)pDTD, 0, sizeof(DTD_T));
+    /* The next DTD pointer is INVALID on the last dTD */
+    if (i + 1 < n)
+      pDTD->next_dTD = (uint32_t)&ep_TDChain[ Edpt & 1 ][ i ];
+    else
+      pDTD->next_dTD = 0x01 ;
+
+    /* Length, only interrupt on the last dTD */
+    pDTD->total_bytes = ((chunk & 0x7fff) << 16);
+    if (i + 1 == n)
+      pDTD->total_bytes |= TD_IOC ;
+    pDTD->total_bytes |= 0x80 ;
+
+    pDTD->buffer0 = ptrBuff + len;
+    pDTD->buffer1 = (ptrBuff + len + 0x1000) & 0xfffff000;
+    pDTD->buffer2 = (ptrBuff + len + 0x2000) & 0xfffff000;
+    pDTD->buffer3 = (ptrBuff + len + 0x3000) & 0xfffff000;
+    pDTD->buffer4 = (ptrBuff + len + 0x4000) & 0xfffff000;
+
+    len += chunk;
+  }
 
   ep_QH[Edpt].next_dTD = (uint32_t)(&ep_TD[ Edpt ]);
   ep_QH[Edpt].total_bytes &= (~0xC0) ;
+
+  return len;
 }
 
 /*
@@ -613,7 +652,7 @@ uint32_t USB_ReadReqEP(uint32_t EPNum, uint8_t *pData, uint32_t len)
   uint32_t num = EPAdr(EPNum);
   uint32_t n = USB_EP_BITPOS(EPNum);
 
-  USB_ProgDTD(num, (uint32_t)pData, len);
+  len = USB_ProgDTD(num, (uint32_t)pData, len);
   ep_read_len[EPNum & 0x0F] = len;
   /* prime the endpoint for read */
   LPC_USB->ENDPTPRIME |= (1<<n);
@@ -655,7 +694,7 @@ uint32_t USB_WriteEP(uint32_t EPNum, uint8_t *pData, uint32_t cnt)
 {
   uint32_t n = USB_EP_BITPOS(EPNum);
 
-  USB_ProgDTD(EPAdr(EPNum), (uint32_t)pData, cnt);
+  cnt = USB_ProgDTD(EPAdr(EPNum), (uint32_t)pData, cnt);
   /* prime the endpoint for transmit */
   LPC_USB->ENDPTPRIME |= (1<<n);
 
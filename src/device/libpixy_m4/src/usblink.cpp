@@ -129,3 +129,9 @@ uint32_t USBLink::getTimer()
 {
     return ::getTimer(m_timer);
 }
+
+// 512 once the host has enumerated us at high speed, 64 otherwise
+uint32_t USBLink::blockSize()
+{
+    return USB_MaxPacketSize();
+}
@@ -43,6 +43,8 @@
 
 #include "debug.h"
 
+extern volatile uint32_t DevStatusFS2HS;
+
 void sendChunk(void);
 void recvChunk(void);
 void bulkOutNak(void);
@@ -312,12 +314,16 @@ uint32_t USB_handleState(void)
     return USB_Configuration;
 }
 
+// bulk max packet size for the speed the host enumerated us at
+uint32_t USB_MaxPacketSize(void)
+{
+    return DevStatusFS2HS ? USB_HS_BUFSIZE : USB_DEV_BUFSIZE;
+}
+
 void bulkOutNak(void){
     //USB_ReadReqEP(USB_BULK_OUT_EP, (uint8_t *)buf, len);
 }
 
-#define MAX_CHUNK            0x4000
-
 const uint8_t *g_recvData = NULL;
 uint32_t g_recvLen = 0;
 uint32_t g_recvOffset = 0;
@@ -0,0 +1,37 @@
+//
+// begin license header
+//
+// This file is part of Pixy CMUcam5 or "Pixy" for short
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef _CALIB_H
+#define _CALIB_H
+
+#include "chirp.hpp"
+#include "flash.h"
+#include "undistort.h"
+
+// The lens calibration (undistort.h) has a flash sector of its own, the one below the
+// parameters' (param.cpp).  It's written over USB by PixyMon or pixy-calib through cal_set,
+// the serial link's commands are too short for it, and is used from the next program start.
+
+#define CAL_FLASH_LOC        (FLASH_BEGIN + FLASH_SIZE - FLASH_SECTOR_SIZE*9)
+
+int calib_init(Chirp *chirp);
+// the calibration in flash, NULL if there is none or it's corrupt
+const Calibration *calib_get();
+
+int32_t calib_set(const uint32_t &len, const uint8_t *data);
+int32_t calib_getChirp(Chirp *chirp);
+int32_t calib_erase();
+
+#endif
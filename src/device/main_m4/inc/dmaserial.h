@@ -0,0 +1,177 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef _DMASERIAL_H
+#define _DMASERIAL_H
+
+#include "iserial.h"
+
+#define DMA_FRAME_BUF_LEN       320   // bytes, holds a whole frame of MAX_BLOBS in either format
+
+// Peripheral side of a DMA serial path: one channel feeding the peripheral's transmit
+// register, one emptying its receive register into a ring.  Gpdma implements this on the
+// device, src/host/serial-sim implements it with a model of the peripheral.
+class DmaPort
+{
+public:
+    // send len elements of buf, one per peripheral request, then call the transmit queue's done()
+    virtual void startTx(const void *buf, uint32_t len) = 0;
+    virtual void stopTx() = 0;
+    // receive into ring forever, wrapping around at len elements, no interrupts
+    virtual void startRx(void *ring, uint32_t len) = 0;
+    virtual void stopRx() = 0;
+    // ring element the receive channel writes next
+    virtual uint32_t rxIndex() = 0;
+    // keep the transmit done interrupt from running while the main loop starts a transfer
+    virtual void lock() = 0;
+    virtual void unlock() = 0;
+};
+
+// Same job as TransmitQ, but a frame at a time: the callback hands out one frame (or what
+// fits in the buffer) per call, which goes out in one DMA transfer with one interrupt at the
+// end, instead of an interrupt every few bytes.  When there's no frame, idleLen zeros are
+// sent if idleLen isn't 0 (SPI, where the master clocks whether we have data or not),
+// otherwise the channel stops until the main loop calls start() again.
+template <class BufType> class DmaTransmitQ
+{
+public:
+    DmaTransmitQ(uint32_t size, SerialCallback callback, DmaPort *port, uint32_t idleLen=0)
+    {
+        m_size = size;
+        m_buf = new BufType[m_size];
+        m_callback = callback;
+        m_port = port;
+        m_idleLen = idleLen<size ? idleLen : size;
+        m_busy = false;
+        m_transfers = 0;
+    }
+
+    ~DmaTransmitQ()
+    {
+        delete [] m_buf;
+    }
+
+    // main loop: start sending if stopped
+    void start()
+    {
+        m_port->lock();
+        if (!m_busy)
+            next();
+        m_port->unlock();
+    }
+
+    void stop()
+    {
+        m_port->lock();
+        m_port->stopTx();
+        m_busy = false;
+        m_port->unlock();
+    }
+
+    // interrupt: the last transfer has finished
+    void done()
+    {
+        next();
+    }
+
+    uint32_t transfers()
+    {
+        return m_transfers;
+    }
+
+private:
+    void next()
+    {
+        uint32_t i, len;
+
+        len = (*m_callback)((uint8_t *)m_buf, m_size*sizeof(BufType))/sizeof(BufType);
+        if (len==0 && m_idleLen)
+        {
+            for (i=0; i<m_idleLen; i++)
+                m_buf[i] = 0;
+            len = m_idleLen;
+        }
+        m_busy = len>0;
+        if (m_busy)
+        {
+            m_port->startTx(m_buf, len);
+            m_transfers++;
+        }
+    }
+
+    uint32_t m_size;
+    BufType *m_buf;
+    SerialCallback m_callback;
+    DmaPort *m_port;
+    uint32_t m_idleLen;
+    volatile bool m_busy;
+    uint32_t m_transfers;
+};
+
+// Same job as ReceiveQ, filled by a DMA channel that wraps around the ring by itself, so
+// receiving costs no interrupts at all.  If the main loop falls more than size elements
+// behind, the oldest are overwritten.
+template <class BufType> class DmaReceiveQ
+{
+public:
+    DmaReceiveQ(uint32_t size, DmaPort *port)
+    {
+        m_size = size;
+        m_buf = new BufType[m_size];
+        m_port = port;
+        m_read = 0;
+    }
+
+    ~DmaReceiveQ()
+    {
+        delete [] m_buf;
+    }
+
+    void start()
+    {
+        m_read = 0;
+        m_port->startRx(m_buf, m_size);
+    }
+
+    void stop()
+    {
+        m_port->stopRx();
+    }
+
+    inline int32_t receiveLen()
+    {
+        return (m_port->rxIndex() + m_size - m_read)%m_size;
+    }
+
+    inline int read(BufType *data)
+    {
+        if (m_read==m_port->rxIndex())
+            return 0;
+        *data = m_buf[m_read++];
+
+        if (m_read==m_size)
+            m_read = 0;
+
+        return 1;
+    }
+
+private:
+    uint32_t m_size;
+    BufType *m_buf;
+    DmaPort *m_port;
+    uint32_t m_read;
+};
+
+#endif
@@ -56,6 +56,8 @@ int exec_addProg(Program *prog, bool video=false);
 
 int exec_runM0(uint8_t prog);
 int exec_stopM0();
+int exec_setRLSParamsM0(uint8_t threshold, uint8_t lowThreshold, uint8_t intensity, uint8_t logFps);
+void exec_waitM0();
 void exec_periodic();
 
 uint32_t exec_running();
@@ -69,6 +71,7 @@ int32_t exec_versionType(Chirp *chirp=NULL);
 
 int32_t exec_getAction(const uint16_t &index, Chirp *chirp=NULL);
 uint32_t exec_getUID();
+int32_t exec_benchM0(const uint16_t &cycles, Chirp *chirp=NULL);
 
 extern int32_t g_execArg;
 
@@ -0,0 +1,117 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#ifndef _GPDMA_H
+#define _GPDMA_H
+#include "dmaserial.h"
+
+// GPDMA registers, see the LPC43xx user manual (UM10503), GPDMA chapter
+#define GPDMA_BASE                0x40002000
+#define GPDMA_INTTCSTAT           (*(volatile uint32_t *)(GPDMA_BASE + 0x004))
+#define GPDMA_INTTCCLEAR          (*(volatile uint32_t *)(GPDMA_BASE + 0x008))
+#define GPDMA_INTERRSTAT          (*(volatile uint32_t *)(GPDMA_BASE + 0x00c))
+#define GPDMA_INTERRCLR           (*(volatile uint32_t *)(GPDMA_BASE + 0x010))
+#define GPDMA_CONFIG              (*(volatile uint32_t *)(GPDMA_BASE + 0x030))
+#define GPDMA_CH(n)               ((GpdmaChannel *)(GPDMA_BASE + 0x100 + (n)*0x20))
+#define GPDMA_CHANNELS            8
+
+#define GPDMA_CONFIG_E            (1<<0)
+
+// channel control register
+#define GPDMA_CTRL_SIZE(n)        ((n)&0xfff)
+#define GPDMA_CTRL_SWIDTH(w)      ((w)<<18)
+#define GPDMA_CTRL_DWIDTH(w)      ((w)<<21)
+#define GPDMA_CTRL_S              (1<<24)   // source on AHB master 1, used for peripherals
+#define GPDMA_CTRL_D              (1<<25)   // destination on AHB master 1
+#define GPDMA_CTRL_SI             (1<<26)   // source increment
+#define GPDMA_CTRL_DI             (1<<27)   // destination increment
+#define GPDMA_CTRL_I              (1u<<31)   // terminal count interrupt
+#define GPDMA_WIDTH_8             0
+#define GPDMA_WIDTH_16            1
+#define GPDMA_MAX_TRANSFER        0xfff
+
+// channel config register
+#define GPDMA_CCFG_E              (1<<0)
+#define GPDMA_CCFG_SRCPERIPH(p)   ((p)<<1)
+#define GPDMA_CCFG_DESTPERIPH(p)  ((p)<<6)
+#define GPDMA_CCFG_M2P            (1<<11)
+#define GPDMA_CCFG_P2M            (2<<11)
+#define GPDMA_CCFG_IE             (1<<14)
+#define GPDMA_CCFG_ITC            (1<<15)
+
+// peripheral request lines and their DMAMUX selection in CREG
+#define GPDMA_DMAMUX              (*(volatile uint32_t *)0x4004311c)
+#define GPDMA_PERIPH_USART0_TX    1   // DMAMUX 1
+#define GPDMA_PERIPH_USART0_RX    2   // DMAMUX 1
+#define GPDMA_PERIPH_SSP1_RX      11  // DMAMUX 0
+#define GPDMA_PERIPH_SSP1_TX      12  // DMAMUX 0
+
+// channels, lower numbers have priority
+#define GPDMA_SSP1_TX_CHANNEL     0
+#define GPDMA_SSP1_RX_CHANNEL     1
+#define GPDMA_USART0_TX_CHANNEL   2
+#define GPDMA_USART0_RX_CHANNEL   3
+
+typedef struct
+{
+    volatile uint32_t SRCADDR;
+    volatile uint32_t DESTADDR;
+    volatile uint32_t LLI;
+    volatile uint32_t CONTROL;
+    volatile uint32_t CONFIG;
+    uint32_t RESERVED[3];
+} GpdmaChannel;
+
+// linked list item, the receive channel links to itself to go around its ring
+typedef struct
+{
+    uint32_t src;
+    uint32_t dest;
+    uint32_t next;
+    uint32_t control;
+} GpdmaLli;
+
+// A transmit and a receive channel between memory and one peripheral.
+class Gpdma : public DmaPort
+{
+public:
+    Gpdma(uint8_t txChannel, uint8_t txPeriph, volatile void *txReg, uint8_t rxChannel, uint8_t rxPeriph, const volatile void *rxReg, uint8_t width);
+
+    // DmaPort methods
+    virtual void startTx(const void *buf, uint32_t len);
+    virtual void stopTx();
+    virtual void startRx(void *ring, uint32_t len);
+    virtual void stopRx();
+    virtual uint32_t rxIndex();
+    virtual void lock();
+    virtual void unlock();
+
+private:
+    uint8_t m_txChannel;
+    GpdmaChannel *m_tx;
+    GpdmaChannel *m_rx;
+    uint8_t m_txPeriph;
+    uint8_t m_rxPeriph;
+    uint32_t m_txReg;
+    uint32_t m_rxReg;
+    uint8_t m_width;
+    uint32_t m_ring;
+    uint32_t m_ringLen;
+    GpdmaLli m_rxLli;
+};
+
+void gpdma_init();
+
+#endif
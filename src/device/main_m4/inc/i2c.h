@@ -16,11 +16,13 @@
 #ifndef _I2C_H
 #define _I2C_H
 #include "iserial.h"
+#include "i2cregs.h"
 #include "lpc43xx_i2c.h"
 
 #define I2C_DEFAULT_SLAVE_ADDR    0x54
 #define I2C_TRANSMIT_BUF_SIZE     32
 #define I2C_RECEIVE_BUF_SIZE      32
+#define I2C_DEFAULT_CLOCK         100000
 
 class I2c : public Iserial
 {
@@ -36,6 +38,9 @@ public:
 
     int setSlaveAddr(uint8_t addr);
     void setFlags(bool clearOnEnd, bool sixteenBit);
+    void setRegisterMode(bool regs);
+    int setClock(uint32_t clock);
+    I2cRegs *regs();
     void slaveHandler();
 
 private:
@@ -43,7 +48,10 @@ private:
     bool m_pad0;
     bool m_16bit;
     bool m_clearOnEnd;
+    bool m_regMode;
+    uint32_t m_clock;
     LPC_I2Cn_Type *m_i2c;
+    I2cRegs m_regs;
     ReceiveQ<uint8_t> m_rq;
     TransmitQ<uint8_t> m_tq;
 };
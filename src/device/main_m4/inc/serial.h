@@ -16,6 +16,8 @@
 #ifndef _SERIAL_H
 #define _SERIAL_H
 #include "iserial.h"
+#include "blockframe.h"
+struct CmdProc;  // cmdframe.h
 
 // different interfaces
 #define SER_INTERFACE_ARDUINO_SPI     0   // arduino ICMP SPI (auto slave select)
@@ -25,16 +27,33 @@
 #define SER_INTERFACE_ADX             4
 #define SER_INTERFACE_ADY             5
 #define SER_INTERFACE_LEGO            6
+#define SER_INTERFACE_I2C_REGS        7   // i2c with a register map, see i2cregs.h
 
 #define SER_INTERFACE_SER_BAUD        19200
+#define SER_BAUDRATES                 {19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000, 2000000, 3000000, 4000000, 6000000}
+#define SER_NUM_BAUDRATES             12
 
 #define SER_SYNC_BYTE                 0xA5
 #define SER_CMD_START_IMAGE_LOGGING   0xBE
 #define SER_CMD_STOP_IMAGE_LOGGING    0xEF
+#define SER_CMD_LEGACY_FRAMES         BF_CMD_LEGACY_FRAMES
+#define SER_CMD_COMPACT_FRAMES        BF_CMD_COMPACT_FRAMES
+#define SER_CMD_TRACK_FRAMES          BF_CMD_TRACK_FRAMES
+#define SER_CMD_BEACON_FRAMES         BF_CMD_BEACON_FRAMES
+#define SER_CMD_POSE_FRAMES           BF_CMD_POSE_FRAMES
+#define SER_CMD_INTENSITY_FRAMES      BF_CMD_INTENSITY_FRAMES
+#define SER_CMD_FRAME_DEPTH_BASE      BF_CMD_FRAME_DEPTH_BASE  // + 1..BF_MAX_QUEUED_FRAMES
+#define SER_CMD_BAUD_BASE             0xB0  // + index into SER_BAUDRATES, the uart switches right after this command
+#define SER_CMD_I2C_REGISTERS         0xC4  // switch from the i2c byte stream to the register map
+#define SER_CMD_WRITE_REGS            0xC5  // not sent by the master-- the config registers changed, data is I2CR_CONFIG_FIRST..I2CR_CONFIG_LAST
 
-typedef bool (*SerialCmdCallback)(uint8_t cmd, const uint8_t *data, uint32_t dlen);
+#define SER_FRAME_TIMEOUT             100000  // us, a command frame that stops this long is given up
 
-int ser_init(SerialCallback callback, SerialCmdCallback cmdCallback);
+// queues a response frame for the master, returns false if there's no room
+typedef bool (*SerialResponseCallback)(const uint8_t *buf, uint32_t len);
+
+// commands that aren't the serial layer's own go to cmds, responses to respond
+int ser_init(SerialCallback callback, const CmdProc *cmds, SerialResponseCallback respond);
 void ser_flush();
 int ser_setInterface(uint8_t interface);
 uint8_t ser_getInterface();
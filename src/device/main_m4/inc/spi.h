@@ -17,9 +17,13 @@
 #define _SPI_H
 #include "lpc43xx_ssp.h"
 #include "iserial.h"
+#include "gpdma.h"
 
 #define SPI_RECEIVEBUF_SIZE     16
 #define SPI_TRANSMITBUF_SIZE    16
+#define SPI_DMA_RECEIVEBUF_SIZE GPDMA_MAX_TRANSFER  // words, 16ms of main loop away from ser_processInput() at 4 MHz
+#define SPI_DMA_TRANSMITBUF_SIZE (DMA_FRAME_BUF_LEN/2)
+#define SPI_DMA_IDLE_LEN        32    // words of zeros per transfer when there's no frame
 
 #define SS_ASSERT()             LPC_SGPIO->GPIO_OUTREG = 0;
 #define SS_NEGATE()             LPC_SGPIO->GPIO_OUTREG = 1<<14;
@@ -42,6 +46,7 @@ public:
     virtual int update();
 
     void slaveHandler();
+    void dmaHandler();
     void setAutoSlaveSelect(bool ass);
 
 private:
@@ -50,6 +55,11 @@ private:
     ReceiveQ<uint16_t> m_rq;
     TransmitQ<uint16_t> m_tq;
 
+    // without auto slave select, GPDMA moves the data and interrupts once per frame
+    Gpdma m_dma;
+    DmaReceiveQ<uint16_t> m_drq;
+    DmaTransmitQ<uint16_t> m_dtq;
+
     bool m_sync;
     uint32_t m_recvCounter;
     uint32_t m_lastRecvCounter;
@@ -16,11 +16,13 @@
 #ifndef _UART_H
 #define _UART_H
 #include "iserial.h"
+#include "gpdma.h"
 #include "lpc43xx_uart.h"
 
-#define UART_TRANSMIT_BUF_SIZE     32
-#define UART_RECEIVE_BUF_SIZE      32
+#define UART_TRANSMIT_BUF_SIZE     DMA_FRAME_BUF_LEN
+#define UART_RECEIVE_BUF_SIZE      256
 #define UART_DEFAULT_BAUDRATE      19200
+#define UART_MAX_BAUDRATE          12750000  // CLKFREQ/16
 
 class Uart : public Iserial
 {
@@ -35,14 +37,16 @@ public:
     virtual int update();
 
     int setBaudrate(uint32_t baudrate);
-    void irqHandler();
+    void dmaHandler();
 
 private:
 
     LPC_USARTn_Type *m_uart;
-    ReceiveQ<uint8_t> m_rq;
-    TransmitQ<uint8_t> m_tq;
-    bool m_flag;
+    // GPDMA moves the data, with an interrupt once per frame
+    Gpdma m_dma;
+    DmaReceiveQ<uint8_t> m_rq;
+    DmaTransmitQ<uint8_t> m_tq;
+    bool m_open;
 };
 
 void uart_init(SerialCallback callback);
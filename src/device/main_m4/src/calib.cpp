@@ -0,0 +1,96 @@
+//
+// begin license header
+//
+// This file is part of Pixy CMUcam5 or "Pixy" for short
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <string.h>
+#include "calib.h"
+
+static const ProcModule g_module[] =
+{
+    {
+    "cal_set",
+    (ProcPtr)calib_set,
+    {CRP_INTS8, END},
+    "Write the lens calibration to flash, used from the next program start"
+    "@p calibration Calibration struct as made by pixy-calib, with its CRC"
+    "@r 0 if success, negative if error"
+    },
+    {
+    "cal_get",
+    (ProcPtr)calib_getChirp,
+    {END},
+    "Get the lens calibration in flash"
+    "@r 0 and the Calibration struct if success, negative if there is none"
+    },
+    {
+    "cal_erase",
+    (ProcPtr)calib_erase,
+    {END},
+    "Erase the lens calibration, the default lens is used from the next program start"
+    "@r 0 if success, negative if error"
+    },
+    END
+};
+
+static bool valid(const Calibration *cal)
+{
+    return cal->magic==UD_CAL_MAGIC && cal->version==UD_CAL_VERSION &&
+        Chirp::calcCrc16((const uint8_t *)cal, sizeof(Calibration)-sizeof(uint16_t))==cal->crc;
+}
+
+int calib_init(Chirp *chirp)
+{
+    chirp->registerModule(g_module);
+    return 0;
+}
+
+const Calibration *calib_get()
+{
+    const Calibration *cal = (const Calibration *)CAL_FLASH_LOC;
+
+    return valid(cal) ? cal : NULL;
+}
+
+int32_t calib_set(const uint32_t &len, const uint8_t *data)
+{
+    Calibration cal;
+
+    if (len!=sizeof(Calibration))
+        return -1;
+    // copy, data needn't be aligned
+    memcpy(&cal, data, sizeof(Calibration));
+    if (!valid(&cal))
+        return -2;
+    if (flash_erase(CAL_FLASH_LOC, FLASH_SECTOR_SIZE)<0)
+        return -3;
+    if (flash_program(CAL_FLASH_LOC, (const uint8_t *)&cal, sizeof(Calibration))<0)
+        return -3;
+    return 0;
+}
+
+int32_t calib_getChirp(Chirp *chirp)
+{
+    const Calibration *cal = calib_get();
+
+    if (cal==NULL)
+        return -1;
+    if (chirp)
+        CRP_RETURN(chirp, UINTS8(sizeof(Calibration), cal), END);
+    return 0;
+}
+
+int32_t calib_erase()
+{
+    return flash_erase(CAL_FLASH_LOC, FLASH_SECTOR_SIZE)<0 ? -1 : 0;
+}
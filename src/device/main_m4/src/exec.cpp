@@ -14,14 +14,18 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "pixy_init.h"
 #include "misc.h"
+#include "m0ctrl.h"
+#include "qqueue.h"
 #include "exec.h"
 #include "led.h"
 #include "camera.h"
 #include "serial.h"
 #include "progblobs.h"
+#include "platform_config.h"
 
 static const ProcModule g_module[] =
 {
@@ -99,6 +103,14 @@ static const ProcModule g_module[] =
     "Get the unique ID of this Pixy"
     "@r returns 32-bit unique ID"
     },
+    {
+    "exec_benchM0",
+    (ProcPtr)exec_benchM0,
+    {CRP_UINT16, END},
+    "Time running and stopping the M0 through the mailbox and through chirp, with the program stopped"
+    "@p number of run/stop cycles of each"
+    "@r 0 if successful, -1 if a program is running, -2 if the M0 didn't answer, and mean and max us of mailbox run, mailbox stop, chirp run, chirp stop"
+    },
     END
 };
 
@@ -132,6 +144,12 @@ int exec_init(Chirp *chirp)
     g_runningM0 = g_chirpM0->getProc("running", NULL);
     g_stopM0 = g_chirpM0->getProc("stop", NULL);
 
+    // The M0's SEV pends its interrupt, which stays disabled (ipc_mbx.c has the handler),
+    // and with SEVONPEND that wakes exec_waitM0()'s WFE.
+    SLAVE_TXEV_QUIT();
+    NVIC_ClearPendingIRQ((IRQn_Type)SLAVE_IRQn);
+    SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+
     return 0;
 }
 
@@ -266,36 +284,127 @@ uint32_t exec_getUID()
     return val;
 }
 
+// The M0 is run and stopped through the mailbox (m0ctrl.h), which it looks at every line,
+// its chirp procs are only seen between frames and are kept for debugging and the bench.
 int exec_runM0(uint8_t prog)
 {
     int responseInt;
 
-    g_chirpM0->callSync(g_runM0, UINT8(prog), END_OUT_ARGS,
-        &responseInt, END_IN_ARGS);
+    responseInt = m0_run(prog);
 
     g_progM0 = prog;
 
     return responseInt;
 }
 
+// returns once the M0 has stopped, within a line of a frame under way
 int exec_stopM0()
 {
-    int responseInt;
+    return m0_stop();
+}
 
-    g_chirpM0->callSync(g_stopM0, END_OUT_ARGS,
-        &responseInt, END_IN_ARGS);
+// takes effect at the M0's next frame
+int exec_setRLSParamsM0(uint8_t threshold, uint8_t lowThreshold, uint8_t intensity, uint8_t logFps)
+{
+    return m0_setRLSParams(threshold, lowThreshold, intensity, logFps);
+}
 
-    return responseInt;
+// Sleeps until the M0 rings, which it does every few lines and at the end of a frame (see
+// rls_m0.c), or an interrupt is taken.  An event since the caller last looked returns at
+// once, WFE's event register keeps it.
+void exec_waitM0()
+{
+    SLAVE_TXEV_QUIT();
+    NVIC_ClearPendingIRQ((IRQn_Type)SLAVE_IRQn);
+    __WFE();
 }
 
 uint8_t exec_runningM0()
 {
-    uint32_t responseInt;
+    return m0_running();
+}
 
-    g_chirpM0->callSync(g_runningM0, END_OUT_ARGS,
-        &responseInt, END_IN_ARGS);
+// stats is the total and max, the total made the mean at the end
+static void benchDone(uint32_t timer, uint32_t *stats)
+{
+    uint32_t us = getTimer(timer);
 
-    return responseInt;
+    stats[0] += us;
+    if (us>stats[1])
+        stats[1] = us;
+}
+
+// Lets the M0 run 0 to 20ms, so a stop lands anywhere in a frame or between frames, with
+// its run lengths thrown away as they come.
+static void benchRun(Qqueue *qq)
+{
+    uint32_t timer, delay = rand()%20000;
+    Qval val;
+
+    setTimer(&timer);
+    while (getTimer(timer)<delay)
+    {
+        while (qq->dequeue(&val));
+    }
+}
+
+// The latency of switching the M0's mode, through the mailbox and as it was through chirp,
+// where a stop is only seen between frames and isn't done until running says so.
+int32_t exec_benchM0(const uint16_t &cycles, Chirp *chirp)
+{
+    uint32_t stats[8], timer;
+    int32_t responseInt;
+    uint32_t running;
+    uint16_t i;
+    Qqueue qq;
+
+    if (g_running || cycles==0)
+        return -1;
+
+    memset(stats, 0, sizeof(stats));
+    for (i=0; i<cycles; i++)
+    {
+        setTimer(&timer);
+        if (m0_run(0)<0)
+            break;
+        benchDone(timer, stats+0);
+        benchRun(&qq);
+        setTimer(&timer);
+        if (m0_stop()<0)
+            break;
+        benchDone(timer, stats+2);
+
+        setTimer(&timer);
+        if (g_chirpM0->callSync(g_runM0, UINT8(0), END_OUT_ARGS, &responseInt, END_IN_ARGS)<0)
+            break;
+        benchDone(timer, stats+4);
+        benchRun(&qq);
+        setTimer(&timer);
+        if (g_chirpM0->callSync(g_stopM0, END_OUT_ARGS, &responseInt, END_IN_ARGS)<0)
+            break;
+        running = 1;
+        do
+        {
+            if (g_chirpM0->callSync(g_runningM0, END_OUT_ARGS, &running, END_IN_ARGS)<0)
+                break;
+        } while (running);
+        if (running)
+            break;
+        benchDone(timer, stats+6);
+    }
+    qq.flush();
+    if (i<cycles)
+    {
+        m0_stop();
+        return -2;
+    }
+    for (i=0; i<sizeof(stats)/sizeof(uint32_t); i+=2)
+        stats[i] /= cycles;
+
+    if (chirp)
+        CRP_RETURN(chirp, UINTS32(sizeof(stats)/sizeof(uint32_t), stats), END);
+
+    return 0;
 }
 
 void exec_periodic()
@@ -0,0 +1,134 @@
+//
+// begin license header
+//
+// Copyright 2021 Matternet
+//
+// All Pixy source code is provided under the terms of the
+// GNU General Public License v2 (http://www.gnu.org/licenses/gpl-2.0.html).
+// Those wishing to use Pixy source code, software and/or
+// technologies under different licensing terms should contact us at
+// cmucam@cs.cmu.edu. Such licensing terms are available for
+// all portions of the Pixy codebase presented here.
+//
+// end license header
+//
+
+#include <inttypes.h>
+#include "gpdma.h"
+#include "spi.h"
+#include "uart.h"
+
+extern "C" void DMA_IRQHandler(void);
+
+// Only the transmit channels interrupt, once per frame.
+void DMA_IRQHandler(void)
+{
+    uint32_t status;
+
+    status = GPDMA_INTTCSTAT;
+    GPDMA_INTTCCLEAR = status;
+
+    if (status&(1<<GPDMA_SSP1_TX_CHANNEL))
+        g_spi->dmaHandler();
+    if (status&(1<<GPDMA_USART0_TX_CHANNEL))
+        g_uart0->dmaHandler();
+}
+
+Gpdma::Gpdma(uint8_t txChannel, uint8_t txPeriph, volatile void *txReg, uint8_t rxChannel, uint8_t rxPeriph, const volatile void *rxReg, uint8_t width)
+{
+    m_txChannel = txChannel;
+    m_tx = GPDMA_CH(txChannel);
+    m_rx = GPDMA_CH(rxChannel);
+    m_txPeriph = txPeriph;
+    m_rxPeriph = rxPeriph;
+    m_txReg = (uint32_t)txReg;
+    m_rxReg = (uint32_t)rxReg;
+    m_width = width;
+    m_ring = 0;
+    m_ringLen = 0;
+
+    m_tx->CONFIG = 0;
+    m_rx->CONFIG = 0;
+}
+
+void Gpdma::startTx(const void *buf, uint32_t len)
+{
+    if (len>GPDMA_MAX_TRANSFER) // transmit buffers are much smaller than this
+        len = GPDMA_MAX_TRANSFER;
+
+    m_tx->CONFIG = 0;
+    GPDMA_INTTCCLEAR = 1<<m_txChannel;
+    m_tx->SRCADDR = (uint32_t)buf;
+    m_tx->DESTADDR = m_txReg;
+    m_tx->LLI = 0;
+    m_tx->CONTROL = GPDMA_CTRL_SIZE(len) | GPDMA_CTRL_SWIDTH(m_width) | GPDMA_CTRL_DWIDTH(m_width) |
+            GPDMA_CTRL_D | GPDMA_CTRL_SI | GPDMA_CTRL_I;
+    m_tx->CONFIG = GPDMA_CCFG_E | GPDMA_CCFG_DESTPERIPH(m_txPeriph) | GPDMA_CCFG_M2P | GPDMA_CCFG_ITC;
+}
+
+void Gpdma::stopTx()
+{
+    m_tx->CONFIG = 0;
+    GPDMA_INTTCCLEAR = 1<<m_txChannel;
+}
+
+void Gpdma::startRx(void *ring, uint32_t len)
+{
+    if (len>GPDMA_MAX_TRANSFER)
+        len = GPDMA_MAX_TRANSFER;
+
+    m_ring = (uint32_t)ring;
+    m_ringLen = len;
+
+    // the linked list item points back to itself, so the channel never stops
+    m_rxLli.src = m_rxReg;
+    m_rxLli.dest = m_ring;
+    m_rxLli.next = (uint32_t)&m_rxLli;
+    m_rxLli.control = GPDMA_CTRL_SIZE(len) | GPDMA_CTRL_SWIDTH(m_width) | GPDMA_CTRL_DWIDTH(m_width) |
+            GPDMA_CTRL_S | GPDMA_CTRL_DI;
+
+    m_rx->CONFIG = 0;
+    m_rx->SRCADDR = m_rxLli.src;
+    m_rx->DESTADDR = m_rxLli.dest;
+    m_rx->LLI = m_rxLli.next;
+    m_rx->CONTROL = m_rxLli.control;
+    m_rx->CONFIG = GPDMA_CCFG_E | GPDMA_CCFG_SRCPERIPH(m_rxPeriph) | GPDMA_CCFG_P2M;
+}
+
+void Gpdma::stopRx()
+{
+    m_rx->CONFIG = 0;
+}
+
+uint32_t Gpdma::rxIndex()
+{
+    uint32_t index;
+
+    index = (m_rx->DESTADDR - m_ring)>>m_width;
+    if (index>=m_ringLen) // end of the ring, about to be reloaded
+        index = 0;
+    return index;
+}
+
+void Gpdma::lock()
+{
+    NVIC_DisableIRQ(DMA_IRQn);
+}
+
+void Gpdma::unlock()
+{
+    NVIC_EnableIRQ(DMA_IRQn);
+}
+
+void gpdma_init()
+{
+    GPDMA_CONFIG = GPDMA_CONFIG_E;
+
+    // USART0 requests are on DMAMUX setting 1 of their lines, SSP1 on setting 0
+    GPDMA_DMAMUX = (GPDMA_DMAMUX & ~((3<<(GPDMA_PERIPH_USART0_TX*2)) | (3<<(GPDMA_PERIPH_USART0_RX*2)) |
+            (3<<(GPDMA_PERIPH_SSP1_RX*2)) | (3<<(GPDMA_PERIPH_SSP1_TX*2)))) |
+            (1<<(GPDMA_PERIPH_USART0_TX*2)) | (1<<(GPDMA_PERIPH_USART0_RX*2));
+
+    NVIC_SetPriority(DMA_IRQn, 0); // high priority interrupt
+    NVIC_EnableIRQ(DMA_IRQn);
+}
@@ -47,6 +47,8 @@ void I2c::slaveHandler()
     case I2C_I2STAT_S_RX_SLAW_ACK:
     // General call address has been received, ACK has been returned
     case I2C_I2STAT_S_RX_GENCALL_ACK:
+        if (m_regMode)
+            m_regs.startWrite();
         m_i2c->CONSET = I2C_I2CONSET_AA;
         m_i2c->CONCLR = I2C_I2CONCLR_SIC;
         break;
@@ -59,7 +61,10 @@ void I2c::slaveHandler()
     case I2C_I2STAT_S_RX_PRE_GENCALL_DAT_ACK:
          // All data bytes that over-flow the specified receive
          // data length, just ignore them.
-        m_rq.write((uint8_t)m_i2c->DAT);
+        if (m_regMode)
+            m_regs.write((uint8_t)m_i2c->DAT);
+        else
+            m_rq.write((uint8_t)m_i2c->DAT);
         m_i2c->CONSET = I2C_I2CONSET_AA;
         m_i2c->CONCLR = I2C_I2CONCLR_SIC;
         break;
@@ -71,6 +76,8 @@ void I2c::slaveHandler()
     // DATA has been received, NOT ACK has been returned
     case I2C_I2STAT_S_RX_PRE_GENCALL_DAT_NACK:
     case I2C_I2STAT_S_RX_STA_STO_SLVREC_SLVTRX:
+        if (m_regMode)
+            m_regs.stop();
         m_i2c->CONSET = I2C_I2CONSET_AA;
         m_i2c->CONCLR = I2C_I2CONCLR_SIC;
         break;
@@ -78,9 +85,13 @@ void I2c::slaveHandler()
     // Writing phase
     // Own SLA+R has been received, ACK has been returned
     case I2C_I2STAT_S_TX_SLAR_ACK:
+        if (m_regMode)
+            m_regs.startRead();
     // Data has been transmitted, ACK has been received
     case I2C_I2STAT_S_TX_DAT_ACK:
-        if (m_pad0 && m_16bit) // m_pad0 is there so we make sure to send 0's in pairs so we don't get out of byte-sync
+        if (m_regMode) // registers are straight out of memory, so this is quick enough for 1 MHz
+            m_i2c->DAT = m_regs.read();
+        else if (m_pad0 && m_16bit) // m_pad0 is there so we make sure to send 0's in pairs so we don't get out of byte-sync
         {
             m_i2c->DAT = 0;
             m_pad0 = false;
@@ -193,11 +204,13 @@ I2c::I2c(LPC_I2Cn_Type *i2c, uint8_t addr, SerialCallback callback) : m_rq(I2C_R
 
     m_16bit = true;
     m_clearOnEnd = false;
+    m_regMode = false;
+    m_clock = I2C_DEFAULT_CLOCK;
 
-    I2C_Init(m_i2c, 100000);
+    I2C_Init(m_i2c, m_clock);
     setSlaveAddr(addr);
 
-    NVIC_SetPriority(SSP1_IRQn, 0); // high priority interrupt
+    NVIC_SetPriority(I2C0_IRQn, 0); // high priority interrupt
 }
 
 int I2c::setSlaveAddr(uint8_t addr)
@@ -217,6 +230,32 @@ void I2c::setFlags(bool clearOnEnd, bool sixteenBit)
     m_16bit = sixteenBit;
 }
 
+void I2c::setRegisterMode(bool regs)
+{
+    m_regMode = regs;
+}
+
+I2cRegs *I2c::regs()
+{
+    return &m_regs;
+}
+
+// The master drives the clock, but the pads need setting up for fast mode plus (1 MHz):
+// I2C_Init() selects 20 mA drive and the shorter glitch filter from 1 MHz up.
+int I2c::setClock(uint32_t clock)
+{
+    if (clock==m_clock)
+        return 0;
+    if (clock>1000000)
+        return -1;
+
+    m_clock = clock;
+    I2C_Init(m_i2c, m_clock); // this disables the interface
+    startSlave();
+
+    return 0;
+}
+
 void i2c_init(SerialCallback callback)
 {
     g_i2c0 = new I2c(LPC_I2C0, I2C_DEFAULT_SLAVE_ADDR, callback);
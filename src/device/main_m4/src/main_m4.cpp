@@ -27,6 +27,7 @@
 #include "progvideo.h"
 #include "progblobs.h"
 #include "serial.h"
+#include "calib.h"
 
 #include <new>
 
@@ -76,6 +77,7 @@ int main(void)
     // main init of hardware plus a version-dependent number for the parameters that will
     // force a format of parameter between version numbers.
     exec_init(g_chirpUsb);
+    calib_init(g_chirpUsb);
 
     // load programs
     exec_addProg(&g_progBlobs);
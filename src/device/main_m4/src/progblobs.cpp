@@ -19,13 +19,30 @@
 #include "camera.h"
 #include "led.h"
 #include "serial.h"
+#include "cmdframe.h"
+#include "i2c.h"
 #include "exec.h"
 #include "sdmmc.h"
+#include "calib.h"
+#include "param.h"
+#include "misc.h"
+#include "scheduler.h"
 
 
 static int blobsSetup();
 static int blobsLoop();
 
+// copied from the parameters when they change, so the loop needn't look them up
+struct BlobParams
+{
+    uint32_t minArea;
+    uint8_t mergeDist;
+    uint8_t pixelThreshold;
+    uint8_t lowThreshold;
+    uint8_t runIntensity;
+    uint8_t logFps;
+};
+
 Program g_progBlobs =
 {
     "Color_connected_components",
@@ -36,14 +53,22 @@ Program g_progBlobs =
 
 static bool initialized_ = false;
 static bool enable_image_logging_ = false;
+static uint8_t log_interval_ = 1;   // save every nth frame
+static uint8_t log_count_ = 0;
 static Qqueue qqueue_;
 static Blobs blobs_;
+static BlobParams params_;
 
 static uint32_t getTxData(uint8_t *data, uint32_t len)
 {
     return blobs_.getBlock(data, len);
 }
 
+static bool queueResponse(const uint8_t *buf, uint32_t len)
+{
+    return blobs_.queueMessage(buf, len);
+}
+
 static void enable_logging(bool enable)
 {
     static bool sd_card_header_intialized = false;
@@ -57,23 +82,137 @@ static void enable_logging(bool enable)
     enable_image_logging_ = enable;
 }
 
-static bool handleRxData(uint8_t cmd, const uint8_t *data, uint32_t dlen)
+static uint16_t getUint16(const uint8_t *data)
 {
-    switch (cmd)
-    {
-    case SER_CMD_START_IMAGE_LOGGING:
-        enable_logging(true);
-        return true;
+    return data[0] | (data[1]<<8);
+}
+
+static uint8_t startLogging(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    log_interval_ = 1;
+    enable_logging(true);
+    return BF_RESULT_OK;
+}
 
-    case SER_CMD_STOP_IMAGE_LOGGING:
-        enable_logging(false);
-        return true;
+static uint8_t stopLogging(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    enable_logging(false);
+    return BF_RESULT_OK;
+}
 
-    default:
-        break;
-    }
+static uint8_t setLogging(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    if (data[0])
+        log_interval_ = data[0];
+    enable_logging(data[0]!=0);
+    return BF_RESULT_OK;
+}
+
+static uint8_t setFormat(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    if (cmd>=SER_CMD_LEGACY_FRAMES && cmd<=SER_CMD_BEACON_FRAMES)
+        blobs_.setBlockFormat(BF_FORMAT_LEGACY + cmd-SER_CMD_LEGACY_FRAMES);
+    else if (cmd==SER_CMD_POSE_FRAMES)
+        blobs_.setBlockFormat(BF_FORMAT_POSE);
+    else if (cmd==SER_CMD_INTENSITY_FRAMES)
+        blobs_.setBlockFormat(BF_FORMAT_INTENSITY);
+    else if (data[0]<=BF_FORMAT_INTENSITY)
+        blobs_.setBlockFormat(data[0]);
+    else
+        return BF_RESULT_VALUE;
+    return BF_RESULT_OK;
+}
+
+static uint8_t setFrameDepth(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    uint8_t depth = len ? data[0] : cmd-SER_CMD_FRAME_DEPTH_BASE;
 
-    return false;
+    if (depth<1 || depth>BF_MAX_QUEUED_FRAMES)
+        return BF_RESULT_VALUE;
+    blobs_.setFrameDepth(depth);
+    return BF_RESULT_OK;
+}
+
+static uint8_t setMinArea(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    blobs_.setMinArea(getUint16(data));
+    return BF_RESULT_OK;
+}
+
+static uint8_t setRoi(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    uint16_t left = getUint16(data), top = getUint16(data+2), right = getUint16(data+4), bottom = getUint16(data+6);
+
+    if (right && (left>right || top>bottom))
+        return BF_RESULT_VALUE;
+    blobs_.setRoi(left, top, right, bottom);
+    return BF_RESULT_OK;
+}
+
+// data is the blob signature, then x, y pairs of the pad's points in mm
+static uint8_t setPad(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    int16_t points[PO_MAX_MODEL*2];
+    uint8_t i, count = (len-1)/4;
+
+    if ((len-1)%4)
+        return BF_RESULT_LENGTH;
+    for (i=0; i<count*2; i++)
+        points[i] = (int16_t)getUint16(data+1+i*2);
+    return blobs_.setPad(points, count, data[0]) ? BF_RESULT_OK : BF_RESULT_VALUE;
+}
+
+static uint8_t setCoords(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    return blobs_.setCoords(data[0]) ? BF_RESULT_OK : BF_RESULT_VALUE;
+}
+
+static uint8_t getStatus(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    blobs_.encodeStatus(resp);
+    resp[BF_STATUS_LOGGING] = enable_image_logging_ ? log_interval_ : 0;
+    *rlen = BF_STATUS_LEN;
+    return BF_RESULT_OK;
+}
+
+// data is I2CR_CONFIG_FIRST..I2CR_CONFIG_LAST
+static uint8_t writeRegisters(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    enable_logging(data[I2CR_CONFIG-I2CR_CONFIG_FIRST]&I2CR_CONFIG_LOGGING);
+    blobs_.setMinArea(getUint16(data+I2CR_MIN_AREA-I2CR_CONFIG_FIRST));
+    return BF_RESULT_OK;
+}
+
+// commands the master can send, either as two byte commands or as command frames
+static const CmdProc cmds_[] =
+{
+    {BF_CMD_GET_STATUS, BF_CMD_GET_STATUS, 0, 0, getStatus},
+    {BF_CMD_SET_MIN_AREA, BF_CMD_SET_MIN_AREA, 2, 2, setMinArea},
+    {BF_CMD_SET_ROI, BF_CMD_SET_ROI, 8, 8, setRoi},
+    {BF_CMD_SET_FORMAT, BF_CMD_SET_FORMAT, 1, 1, setFormat},
+    {BF_CMD_SET_FRAME_DEPTH, BF_CMD_SET_FRAME_DEPTH, 1, 1, setFrameDepth},
+    {BF_CMD_SET_LOGGING, BF_CMD_SET_LOGGING, 1, 1, setLogging},
+    {BF_CMD_SET_PAD, BF_CMD_SET_PAD, 1+PO_MIN_MODEL*4, 1+PO_MAX_MODEL*4, setPad},
+    {BF_CMD_SET_COORDS, BF_CMD_SET_COORDS, 1, 1, setCoords},
+    {SER_CMD_START_IMAGE_LOGGING, SER_CMD_START_IMAGE_LOGGING, 0, 0, startLogging},
+    {SER_CMD_STOP_IMAGE_LOGGING, SER_CMD_STOP_IMAGE_LOGGING, 0, 0, stopLogging},
+    {SER_CMD_LEGACY_FRAMES, SER_CMD_BEACON_FRAMES, 0, 0, setFormat},
+    {SER_CMD_POSE_FRAMES, SER_CMD_POSE_FRAMES, 0, 0, setFormat},
+    {SER_CMD_INTENSITY_FRAMES, SER_CMD_INTENSITY_FRAMES, 0, 0, setFormat},
+    {SER_CMD_FRAME_DEPTH_BASE+1, SER_CMD_FRAME_DEPTH_BASE+BF_MAX_QUEUED_FRAMES, 0, 0, setFrameDepth},
+    {SER_CMD_WRITE_REGS, SER_CMD_WRITE_REGS, I2CR_CONFIG_LAST-I2CR_CONFIG_FIRST+1, I2CR_CONFIG_LAST-I2CR_CONFIG_FIRST+1, writeRegisters},
+    {0, 0, 0, 0, NULL}
+};
+
+// register-mapped i2c: publish this frame and the settings it was made with
+static void updateRegisters()
+{
+    I2cRegs *regs = g_i2c0->regs();
+
+    blobs_.encodeRegisters(regs->frameBuf());
+    regs->setConfig8(I2CR_CONFIG, enable_image_logging_ ? I2CR_CONFIG_LOGGING : 0);
+    regs->setConfig16(I2CR_MIN_AREA, blobs_.getMinArea());
+    regs->publish();
 }
 
 static int sendBlobs(Chirp *chirp, const BlobA *blobs, uint32_t len, uint8_t renderFlags=RENDER_FLAG_FLUSH)
@@ -85,6 +224,274 @@ static int sendBlobs(Chirp *chirp, const BlobA *blobs, uint32_t len, uint8_t ren
     return 0;
 }
 
+// M0 run lengths go into a queue of QQ_MEM_SIZE; the scheduler keeps background work short
+// enough that the worst case the M0 can queue in the meantime still fits
+#define BLOBS_LINE_US         35    // per line at CAM_MODE1
+#define BLOBS_MAX_LINE_QVALS  (CAM_RES2_WIDTH/3 + 2)  // the M0 skips a line with fewer free
+
+// us, measured, see sched_stats
+#define BLOBS_SEND_US         300   // CCB1 to PixyMon
+#define BLOBS_SD_SLICE_US     400   // per SD write, on top of the blocks
+#define BLOBS_SD_BLOCK_US     170
+#define BLOBS_SD_MAX_BLOCKS   16
+#define BLOBS_PARAMS_US       150
+#define BLOBS_USB_US          200
+#define BLOBS_SERIAL_US       200
+
+static int32_t getSchedStats(const uint8_t &reset, Chirp *chirp);
+
+static const ProcModule module_[] =
+{
+    {
+    "sched_stats",
+    (ProcPtr)getSchedStats,
+    {CRP_UINT8, END},
+    "Get how the blob program's tasks ran, in the order frame, send, log, params, usb, serial, "
+    "and how long it slept waiting for the M0"
+    "@p reset if nonzero the counts start over after this call"
+    "@r 0 and runs, deferred, late, errors, max us and mean us for each task, then sleeps, "
+    "frames, the last frame's permille asleep, the least, the longest sleep in us and the mean permille"
+    },
+    END
+};
+
+static bool frameDone_ = false;     // blobsLoop returns once a frame is done
+static bool sendPending_ = false;
+static bool logging_ = false;       // an SD write is under way
+static uint8_t logSlot_ = FB_NO_SLOT;
+static bool paramsDirty_ = false;
+static bool paramsM0Pending_ = false;
+static bool usbDue_ = false;
+static bool serialDue_ = false;
+
+static uint32_t now()
+{
+    uint32_t timer;
+
+    setTimer(&timer);
+    return timer;
+}
+
+static uint32_t slack()
+{
+    return Scheduler::queueSlack(QQ_MEM_SIZE - qqueue_.queued(), BLOBS_MAX_LINE_QVALS+1, BLOBS_MAX_LINE_QVALS, BLOBS_LINE_US);
+}
+
+static Scheduler sched_(now, slack);
+
+static void loadParams()
+{
+    prm_get("Min blob area", &params_.minArea, END);
+    prm_get("Max merge distance", &params_.mergeDist, END);
+    prm_get("Pixel threshold", &params_.pixelThreshold, END);
+    prm_get("Low pixel threshold", &params_.lowThreshold, END);
+    prm_get("Run intensity", &params_.runIntensity, END);
+    prm_get("Log frame rate", &params_.logFps, END);
+
+    blobs_.setMinArea(params_.minArea);
+    blobs_.setMergeDist(params_.mergeDist);
+}
+
+static void stopLog()
+{
+    logging_ = false;
+    g_frameBuf->release(logSlot_, FB_SD_WRITING);
+    logSlot_ = FB_NO_SLOT;
+    g_frameBuf->arm();
+    led_setRGB(0, 0, 0);
+}
+
+// The frame's slot is ours till the write is done, the M0 fills another or misses the frame.
+static void startLog(uint8_t slot, const BlobA *blobs, uint32_t numBlobs)
+{
+    if (logging_ || !g_frameBuf->claim(slot, FB_SD_WRITING))
+        return;
+    logSlot_ = slot;
+    logging_ = sdmmc_beginFrame(g_frameBuf->slot(slot), FB_FRAME_SIZE, blobs, numBlobs);
+    if (!logging_)
+    {
+        stopLog();
+        return;
+    }
+    led_setRGB(0, 50, 0);
+}
+
+// Frames the M0 filled that aren't logged go back to it, with any whose frame end was
+// flushed, or that is a frame ahead of us.
+static void recycleSlots()
+{
+    g_frameBuf->releaseAll(FB_READY);
+    g_frameBuf->arm();
+}
+
+static bool frameReady()
+{
+    return qqueue_.queued()>0;
+}
+
+// takes what the M0 queued, and at the end of a frame hands it to the other tasks
+static int32_t consumeFrame(uint32_t budget)
+{
+    BlobA *blobs;
+    uint32_t numBlobs;
+    int res;
+
+    if ((res=blobs_.blobify(&qqueue_))==BL_FRAME_PENDING)
+        return 0;
+    frameDone_ = true;
+    serialDue_ = true;
+    sched_.endFrame();
+
+    // the M0 takes them within a line, whatever it is doing, and uses them from the frame
+    // after the one it is waiting for or reading
+    if (paramsM0Pending_)
+    {
+        exec_setRLSParamsM0(params_.pixelThreshold, params_.lowThreshold, params_.runIntensity, params_.logFps);
+        paramsM0Pending_ = false;
+    }
+    if (res<0)
+    {
+        recycleSlots();
+        return -1;
+    }
+
+    if (ser_getInterface()==SER_INTERFACE_I2C_REGS)
+        updateRegisters();
+    sendPending_ = true;
+
+    if (enable_image_logging_ && blobs_.frameBufValid() && ++log_count_>=log_interval_)
+    {
+        log_count_ = 0;
+        blobs_.getBlobs(&blobs, &numBlobs);
+        startLog(blobs_.frameSlot(), blobs, numBlobs);
+    }
+    recycleSlots();
+    return 0;
+}
+
+static bool sendReady()
+{
+    return sendPending_;
+}
+
+// send blobs over USB if available
+static int32_t send(uint32_t budget)
+{
+    BlobA *blobs;
+    uint32_t numBlobs;
+
+    sendPending_ = false;
+    blobs_.getBlobs(&blobs, &numBlobs);
+    sendBlobs(g_chirpUsb, blobs, numBlobs);
+    return 0;
+}
+
+static bool logReady()
+{
+    return logging_;
+}
+
+// writes as many blocks of the frame buffer to the SD card as the budget allows
+static int32_t writeLog(uint32_t budget)
+{
+    uint32_t blocks = budget>BLOBS_SD_SLICE_US ? (budget-BLOBS_SD_SLICE_US)/BLOBS_SD_BLOCK_US : 0;
+    int32_t res;
+
+    if (blocks<1)
+        blocks = 1;
+    else if (blocks>BLOBS_SD_MAX_BLOCKS)
+        blocks = BLOBS_SD_MAX_BLOCKS;
+    if ((res=sdmmc_writeSlice(blocks))<=0)
+        stopLog();
+    return res<0 ? -1 : 0;
+}
+
+// prm_dirty() only says so once, and the task may have to wait
+static bool paramsReady()
+{
+    if (prm_dirty())
+        paramsDirty_ = true;
+    return paramsDirty_;
+}
+
+// PixyMon changed a parameter
+static int32_t updateParams(uint32_t budget)
+{
+    uint8_t pixelThreshold = params_.pixelThreshold, lowThreshold = params_.lowThreshold, runIntensity = params_.runIntensity;
+    uint8_t logFps = params_.logFps;
+
+    paramsDirty_ = false;
+    loadParams();
+    if (params_.pixelThreshold!=pixelThreshold || params_.lowThreshold!=lowThreshold ||
+        params_.runIntensity!=runIntensity || params_.logFps!=logFps)
+        paramsM0Pending_ = true;
+    return 0;
+}
+
+static bool usbReady()
+{
+    return usbDue_ && g_chirpUsb->connected();
+}
+
+// one chirp message at a time, serial takes turns with it
+static int32_t serviceUsb(uint32_t budget)
+{
+    usbDue_ = false;
+    g_chirpUsb->service(false);
+    return 0;
+}
+
+// after every frame and every wake up, an interrupt may have brought input
+static bool serialReady()
+{
+    return serialDue_;
+}
+
+static int32_t serviceSerial(uint32_t budget)
+{
+    serialDue_ = false;
+    usbDue_ = true;
+    ser_update();
+    ser_processInput();
+    return 0;
+}
+
+static void idle()
+{
+    exec_waitM0();
+    serialDue_ = true;
+}
+
+static int32_t getSchedStats(const uint8_t &reset, Chirp *chirp)
+{
+    uint32_t values[(SC_MAX_TASKS+1)*6], *value = values;
+    const SchedStats *stats;
+    const SchedIdleStats *idle = sched_.idleStats();
+    uint8_t i;
+
+    for (i=0; i<sched_.tasks(); i++)
+    {
+        stats = sched_.stats(i);
+        *value++ = stats->runs;
+        *value++ = stats->deferred;
+        *value++ = stats->late;
+        *value++ = stats->errors;
+        *value++ = stats->maxUs;
+        *value++ = stats->runs ? stats->totalUs/stats->runs : 0;
+    }
+    *value++ = idle->sleeps;
+    *value++ = idle->frames;
+    *value++ = idle->lastIdle;
+    *value++ = idle->minIdle;
+    *value++ = idle->maxUs;
+    *value++ = idle->frames ? idle->sumIdle/idle->frames : 0;
+    if (reset)
+        sched_.resetStats();
+    if (chirp)
+        CRP_RETURN(chirp, UINTS32(value-values, values), END);
+    return 0;
+}
+
 static int blobsSetup()
 {
     if (initialized_ == false)
@@ -93,7 +500,32 @@ static int blobsSetup()
         enable_logging(true);
 #endif
 
-        ser_init(getTxData, handleRxData);
+        ser_init(getTxData, cmds_, queueResponse);
+        // the default lens if there's no calibration or it doesn't fit
+        blobs_.setCalibration(calib_get());
+
+        prm_add("Min blob area", 0,
+            "@c Blob_Detection @m 1 @M 10000 Blobs with fewer pixels are dropped (default " STRINGIFY(MIN_AREA) ")", UINT32(MIN_AREA), END);
+        prm_add("Max merge distance", PRM_FLAG_ADVANCED,
+            "@c Blob_Detection @m 0 @M 50 Blobs this many pixels apart or closer are merged (default " STRINGIFY(MAX_MERGE_DIST) ")", UINT8(MAX_MERGE_DIST), END);
+        prm_add("Pixel threshold", 0,
+            "@c Blob_Detection @m 1 @M 254 Pixels brighter than this are part of a blob (default " STRINGIFY(RLS_PIXEL_THRESHOLD) ")", UINT8(RLS_PIXEL_THRESHOLD), END);
+        prm_add("Low pixel threshold", PRM_FLAG_ADVANCED,
+            "@c Blob_Detection @m 0 @M 254 Runs of pixels brighter than this are part of a blob if they have a pixel over the pixel threshold, 0 or at least the pixel threshold for none (default " STRINGIFY(RLS_LOW_THRESHOLD) ")", UINT8(RLS_LOW_THRESHOLD), END);
+        prm_add("Run intensity", PRM_FLAG_ADVANCED | PRM_FLAG_CHECKBOX,
+            "@c Blob_Detection Measures the brightest pixel and the mean of each blob, which the intensity block format sends (default " STRINGIFY(RLS_RUN_INTENSITY) ")", UINT8(RLS_RUN_INTENSITY), END);
+        prm_add("Log frame rate", PRM_FLAG_ADVANCED,
+            "@c Logging @m 1 @M " STRINGIFY(RLS_CAMERA_FPS) " Frames written to the SD card per second, at most (default " STRINGIFY(RLS_LOG_FPS) ")", UINT8(RLS_LOG_FPS), END);
+
+        // background tasks in priority order, they run while the M0 reads out a frame
+        sched_.setFrameTask("frame", consumeFrame, frameReady);
+        sched_.addTask("send", send, sendReady, BLOBS_SEND_US);
+        sched_.addTask("log", writeLog, logReady, BLOBS_SD_SLICE_US+BLOBS_SD_BLOCK_US);
+        sched_.addTask("params", updateParams, paramsReady, BLOBS_PARAMS_US);
+        sched_.addTask("usb", serviceUsb, usbReady, BLOBS_USB_US);
+        sched_.addTask("serial", serviceSerial, serialReady, BLOBS_SERIAL_US);
+        sched_.setIdle(idle);
+        g_chirpUsb->registerModule(module_);
         initialized_ = true;
     }
 
@@ -102,6 +534,16 @@ static int blobsSetup()
 
     // setup qqueue and M0
     qqueue_.flush();
+    loadParams();
+    exec_setRLSParamsM0(params_.pixelThreshold, params_.lowThreshold, params_.runIntensity, params_.logFps);
+    paramsM0Pending_ = false;
+    if (logging_)
+    {
+        sdmmc_abortFrame();
+        stopLog();
+    }
+    recycleSlots();
+    sendPending_ = false;
     exec_runM0(0);
 
     // flush serial receive queue
@@ -109,35 +551,12 @@ static int blobsSetup()
     return 0;
 }
 
+// Runs the tasks until a frame is done, so exec's loop still gets its turn once a frame.
 static int blobsLoop()
 {
-    BlobA *blobs;
-    uint32_t numBlobs;
-
-    // create blobs
-    if (blobs_.blobify(&qqueue_) < 0)
-    {
-        return 0;
-    }
-
-    // send blobs over USB if available
-    blobs_.getBlobs(&blobs, &numBlobs);
-    sendBlobs(g_chirpUsb, blobs, numBlobs);
-
-    // Write frame buffer to SD Card if available
-    if (enable_image_logging_ && blobs_.frameBufValid())
-    {
-        led_setRGB(0, 50, 0);
-        sdmmc_writeFrame((void*)MEM_SD_FRAME_LOC, CAM_RES2_WIDTH * CAM_RES2_HEIGHT, blobs, numBlobs);
-        led_setRGB(0, 0, 0);
-    }
-
-    // can do work here while waiting for more data in queue
-    ser_update();
-    while(!qqueue_.queued())
-    {
-        ser_processInput();
-    }
+    frameDone_ = false;
+    while (!frameDone_)
+        sched_.dispatch();
 
     return 0;
 }
@@ -41,25 +41,29 @@ static int videoSetup()
 static void sendCustom(uint8_t renderFlags=RENDER_FLAG_FLUSH)
 {
     int32_t len;
-    uint8_t *frame = (uint8_t *)MEM_USB_FRAME_LOC;
-    uint32_t fcc;
+    uint32_t size, fcc;
+    uint8_t *frame;
 
     if (g_execArg==1)
     {
+        if ((frame=cam_frameMemory(&size))==NULL)
+            return;
         // fill buffer contents manually for return data
-        len = Chirp::serialize(g_chirpUsb, frame, MEM_USB_FRAME_SIZE, HTYPE(FOURCC('C','M','V','2')), HINT8(renderFlags), UINT16(CAM_RES2_WIDTH), UINT16(CAM_RES2_HEIGHT), UINTS8_NO_COPY(CAM_RES2_WIDTH*CAM_RES2_HEIGHT), END);
+        len = Chirp::serialize(g_chirpUsb, frame, size, HTYPE(FOURCC('C','M','V','2')), HINT8(renderFlags), UINT16(CAM_RES2_WIDTH), UINT16(CAM_RES2_HEIGHT), UINTS8_NO_COPY(CAM_RES2_WIDTH*CAM_RES2_HEIGHT), END);
         // write frame after chirp args
-        cam_getFrame(frame+len, MEM_USB_FRAME_SIZE-len, CAM_GRAB_M1R2, 0, 0, CAM_RES2_WIDTH, CAM_RES2_HEIGHT);
+        cam_getFrame(frame+len, size-len, CAM_GRAB_M1R2, 0, 0, CAM_RES2_WIDTH, CAM_RES2_HEIGHT);
 
         // tell chirp to use this buffer
         g_chirpUsb->useBuffer(frame, len+CAM_RES2_WIDTH*CAM_RES2_HEIGHT);
     }
     else if (100<=g_execArg && g_execArg<200)
     {
+        if ((frame=cam_frameMemory(&size))==NULL)
+            return;
         fcc =  FOURCC('E','X',(g_execArg%100)/10 + '0', (g_execArg%10) + '0');
-        len = Chirp::serialize(g_chirpUsb, frame, MEM_USB_FRAME_SIZE, HTYPE(fcc), HINT8(renderFlags), UINT16(CAM_RES2_WIDTH), UINT16(CAM_RES2_HEIGHT), UINTS8_NO_COPY(CAM_RES2_WIDTH*CAM_RES2_HEIGHT), END);
+        len = Chirp::serialize(g_chirpUsb, frame, size, HTYPE(fcc), HINT8(renderFlags), UINT16(CAM_RES2_WIDTH), UINT16(CAM_RES2_HEIGHT), UINTS8_NO_COPY(CAM_RES2_WIDTH*CAM_RES2_HEIGHT), END);
         // write frame after chirp args
-        cam_getFrame(frame+len, MEM_USB_FRAME_SIZE-len, CAM_GRAB_M1R2, 0, 0, CAM_RES2_WIDTH, CAM_RES2_HEIGHT);
+        cam_getFrame(frame+len, size-len, CAM_GRAB_M1R2, 0, 0, CAM_RES2_WIDTH, CAM_RES2_HEIGHT);
 
         // tell chirp to use this buffer
         g_chirpUsb->useBuffer(frame, len+CAM_RES2_WIDTH*CAM_RES2_HEIGHT);
@@ -15,28 +15,37 @@
 
 #include <string.h>
 #include "serial.h"
+#include "cmdframe.h"
 #include "spi.h"
 #include "i2c.h"
 #include "uart.h"
 #include "pixy_init.h"
 #include "exec.h"
+#include "misc.h"
 
 
-enum SerialRecvState
-{
-    RECV_STATE_INIT,
-    RECV_STATE_SYNC,
-    RECV_STATE_CMD,
-};
-
 static uint8_t g_interface = 0;
 static Iserial *g_serial = 0;
-static SerialCmdCallback g_cmdCallback = NULL;
-static SerialRecvState g_state = RECV_STATE_INIT;
+static const CmdProc *g_cmds = NULL;
+static SerialResponseCallback g_respond = NULL;
+static CmdParser g_parser;
+static uint32_t g_lastInput;
+
+static uint8_t setBaudrate(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen);
+static uint8_t setRegisterMode(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen);
+
+// the serial layer's own commands, tried before the program's
+static const CmdProc g_serCmds[] =
+{
+    {SER_CMD_BAUD_BASE, SER_CMD_BAUD_BASE+SER_NUM_BAUDRATES-1, 0, 0, setBaudrate},
+    {SER_CMD_I2C_REGISTERS, SER_CMD_I2C_REGISTERS, 0, 0, setRegisterMode},
+    {0, 0, 0, 0, NULL}
+};
 
 
-int ser_init(SerialCallback callback, SerialCmdCallback cmdCallback)
+int ser_init(SerialCallback callback, const CmdProc *cmds, SerialResponseCallback respond)
 {
+    gpdma_init();
     i2c_init(callback);
     spi_init(callback);
     uart_init(callback);
@@ -45,7 +54,8 @@ int ser_init(SerialCallback callback, SerialCmdCallback cmdCallback)
     g_uart0->setBaudrate(SER_INTERFACE_SER_BAUD);
     ser_setInterface(SER_INTERFACE_I2C);
 
-    g_cmdCallback = cmdCallback;
+    g_cmds = cmds;
+    g_respond = respond;
     return 0;
 }
 
@@ -53,17 +63,19 @@ void ser_flush()
 {
     uint8_t c;
     while(g_serial->receive(&c, 1));
+    g_parser.reset();
 }
 
 int ser_setInterface(uint8_t interface)
 {
-    if (interface>SER_INTERFACE_LEGO)
+    if (interface>SER_INTERFACE_I2C_REGS)
         return -1;
 
     if (g_serial!=NULL)
         g_serial->close();
 
     g_interface = interface;
+    g_i2c0->setRegisterMode(interface==SER_INTERFACE_I2C_REGS);
 
     switch (interface)
     {
@@ -87,6 +99,12 @@ int ser_setInterface(uint8_t interface)
         g_i2c0->setFlags(true, false);
         break;
 
+    case SER_INTERFACE_I2C_REGS:
+        g_serial = g_i2c0;
+        g_i2c0->setFlags(false, false);
+        g_i2c0->regs()->setConfig8(I2CR_MODE, I2CR_MODE_REGISTERS);
+        break;
+
     default:
     case SER_INTERFACE_ARDUINO_SPI:
         g_serial = g_spi;
@@ -114,33 +132,92 @@ void ser_update()
     g_serial->update();
 }
 
-void ser_processInput()
+// the uart switches right away, a response goes out at the new rate
+static uint8_t setBaudrate(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
 {
-    uint8_t byte;
+    static const uint32_t baudrates[SER_NUM_BAUDRATES] = SER_BAUDRATES;
 
-    switch (g_state)
-    {
-    case RECV_STATE_INIT:
-        g_state = RECV_STATE_SYNC;
-        break;
+    if (g_uart0->setBaudrate(baudrates[cmd-SER_CMD_BAUD_BASE])<0)
+        return BF_RESULT_VALUE;
+    return BF_RESULT_OK;
+}
+
+// register mode has no byte stream, so there's no response
+static uint8_t setRegisterMode(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    if (g_interface!=SER_INTERFACE_I2C)
+        return BF_RESULT_VALUE;
+    ser_setInterface(SER_INTERFACE_I2C_REGS);
+    return BF_RESULT_OK;
+}
 
-    case RECV_STATE_SYNC:
-        if (g_serial->receive(&byte, 1) && byte == SER_SYNC_BYTE)
+// Register mode: the master writes config registers instead of sending commands.
+static void processRegWrites()
+{
+    static const uint32_t clocks[] = {100000, 400000, 1000000};
+    I2cRegs *regs = g_i2c0->regs();
+    uint8_t first, last, speed, rlen, resp[BF_MAX_CMD_PAYLOAD];
+    CmdFrame frame;
+    int i;
+
+    while (regs->getWrite(&first, &last))
+    {
+        if (first<=I2CR_MODE && last>=I2CR_MODE && regs->config8(I2CR_MODE)==I2CR_MODE_STREAM)
         {
-            g_state = RECV_STATE_CMD;
+            ser_setInterface(SER_INTERFACE_I2C);
+            return;
         }
-        break;
-
-    case RECV_STATE_CMD:
-        if (g_serial->receive(&byte, 1) && g_cmdCallback)
+        if (first<=I2CR_SPEED && last>=I2CR_SPEED)
         {
-            g_cmdCallback(byte, NULL, 0);
+            speed = regs->config8(I2CR_SPEED);
+            if (speed>I2CR_SPEED_1M)
+                regs->setConfig8(I2CR_SPEED, speed=I2CR_SPEED_1M);
+            g_i2c0->setClock(clocks[speed]);
         }
-        g_state = RECV_STATE_INIT;
-        break;
 
-    default:
-        g_state = RECV_STATE_INIT;
-        break;
+        // the rest is up to the program
+        frame.seq = 0;
+        frame.cmd = SER_CMD_WRITE_REGS;
+        frame.len = I2CR_CONFIG_LAST-I2CR_CONFIG_FIRST+1;
+        for (i=0; i<frame.len; i++)
+            frame.data[i] = regs->config8(I2CR_CONFIG_FIRST+i);
+        if (g_cmds)
+            cmd_dispatch(g_cmds, &frame, resp, &rlen);
+    }
+}
+
+// Called between frames, as often as the main loop can.  Takes what has arrived (at most a
+// parser buffer full) and handles at most one command, so one call never takes long.
+void ser_processInput()
+{
+    uint8_t c, result, rlen, resp[BF_MAX_CMD_PAYLOAD], buf[BF_RESPONSE_FRAME_LEN(BF_MAX_CMD_PAYLOAD)];
+    CmdFrame frame;
+    int type;
+
+    if (g_interface==SER_INTERFACE_I2C_REGS)
+    {
+        processRegWrites();
+        return;
+    }
+
+    while (g_parser.space() && g_serial->receive(&c, 1))
+    {
+        g_parser.put(c);
+        setTimer(&g_lastInput);
     }
+
+    type = g_parser.next(&frame);
+    if (type==CF_NONE)
+    {
+        if (g_parser.partial() && getTimer(g_lastInput)>SER_FRAME_TIMEOUT)
+            g_parser.expire();
+        return;
+    }
+
+    result = cmd_dispatch(g_serCmds, &frame, resp, &rlen);
+    if (result==BF_RESULT_UNKNOWN && g_cmds)
+        result = cmd_dispatch(g_cmds, &frame, resp, &rlen);
+
+    if (type==CF_FRAME && g_respond)
+        g_respond(buf, cmd_encodeResponse(buf, &frame, result, resp, rlen));
 }
@@ -136,11 +136,27 @@ void Spi::slaveHandler()
     }
 }
 
+void Spi::dmaHandler()
+{
+    m_dtq.done();
+}
+
 int Spi::receive(uint8_t *buf, uint32_t len)
 {
     uint32_t i;
     uint16_t buf16;
 
+    if (!m_autoSlaveSelect)
+    {
+        // the ring has everything the master clocked in, only keep data words
+        for (i=0; i<len && m_drq.read(&buf16); )
+        {
+            if ((buf16&SPI_SYNC_MASK)==SPI_SYNC_WORD_DATA)
+                buf[i++] = buf16&0xff;
+        }
+        return i;
+    }
+
     for (i=0; i<len; i++)
     {
         if (m_rq.read(&buf16)==0)
@@ -153,6 +169,8 @@ int Spi::receive(uint8_t *buf, uint32_t len)
 
 int Spi::receiveLen()
 {
+    if (!m_autoSlaveSelect)
+        return m_drq.receiveLen(); // not all of these are data words
     return m_rq.receiveLen();
 }
 
@@ -164,6 +182,14 @@ int Spi::open()
     scu_pinmux(0x1, 4, (MD_PLN | MD_EZI | MD_ZI | MD_EHS), FUNC5); // SSP1_MOSI
     scu_pinmux(0x1, 19, (MD_PLN | MD_EZI | MD_ZI | MD_EHS), FUNC1); // SSP1_SCK
 
+    if (!m_autoSlaveSelect)
+    {
+        LPC_SSP1->DMACR = SSP_DMA_RXDMA_EN | SSP_DMA_TXDMA_EN;
+        m_drq.start();
+        m_dtq.start();
+        return 0;
+    }
+
     // enable interrupt
     NVIC_EnableIRQ(SSP1_IRQn);
 
@@ -180,12 +206,18 @@ int Spi::close()
 
     // disable interrupt
     NVIC_DisableIRQ(SSP1_IRQn);
+
+    m_dtq.stop();
+    m_drq.stop();
+    LPC_SSP1->DMACR = 0;
     return 0;
 }
 
 int Spi::update()
 {
-    if (m_autoSlaveSelect)
+    if (!m_autoSlaveSelect)
+        m_dtq.start(); // sends zeros when idle, so this only matters if it was stopped
+    else
     {
         // check to see if we've received new data (m_rq.m_produced would have increased)
         if (m_recvCounter-m_lastRecvCounter>0)
@@ -227,7 +259,9 @@ void Spi::setAutoSlaveSelect(bool ass)
 }
 
 
-Spi::Spi(SerialCallback callback) : m_rq(SPI_RECEIVEBUF_SIZE), m_tq(SPI_TRANSMITBUF_SIZE, callback)
+Spi::Spi(SerialCallback callback) : m_rq(SPI_RECEIVEBUF_SIZE), m_tq(SPI_TRANSMITBUF_SIZE, callback),
+    m_dma(GPDMA_SSP1_TX_CHANNEL, GPDMA_PERIPH_SSP1_TX, &LPC_SSP1->DR, GPDMA_SSP1_RX_CHANNEL, GPDMA_PERIPH_SSP1_RX, &LPC_SSP1->DR, GPDMA_WIDTH_16),
+    m_drq(SPI_DMA_RECEIVEBUF_SIZE, &m_dma), m_dtq(SPI_DMA_TRANSMITBUF_SIZE, callback, &m_dma, SPI_DMA_IDLE_LEN)
 {
     uint32_t i;
     volatile uint32_t d;
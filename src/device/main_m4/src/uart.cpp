@@ -20,39 +20,9 @@
 
 Uart *g_uart0;
 
-extern "C" void UART0_IRQHandler(void);
-
-void UART0_IRQHandler(void)
-{
-    g_uart0->irqHandler();
-}
-
-void Uart::irqHandler()
+void Uart::dmaHandler()
 {
-    uint32_t status;
-    uint8_t i, c;
-    volatile uint32_t v;
-
-    m_flag = false;
-
-    /* Determine the interrupt source */
-    status = m_uart->IIR & UART_IIR_INTID_MASK;
-
-    if (status==UART_IIR_INTID_RDA) // Receive Data Available
-        m_rq.write(m_uart->RBR&UART_RBR_MASKBIT);
-    else if (status==UART_IIR_INTID_CTI)
-        v = m_uart->RBR; // toss...
-    else if (status==UART_IIR_INTID_THRE) // Transmit Holding Empty
-    {
-        for (i=0; i<UART_TX_FIFO_SIZE; i++) // fill transmit FIFO
-        {
-            if (m_tq.read(&c))
-            {
-                m_flag = true;
-                m_uart->THR = c;
-            }
-        }
-    }
+    m_tq.done();
 }
 
 int Uart::open()
@@ -62,16 +32,21 @@ int Uart::open()
     scu_pinmux(0x1, 3, (MD_PLN | MD_EZI | MD_ZI | MD_EHS), FUNC0);           // turn SSP1_MISO into GPIO0[10]
     scu_pinmux(0x1, 4, (MD_PLN | MD_EZI | MD_ZI | MD_EHS), FUNC0);           // turn SSP1_MOSI into GPIO0[11]
 
-    NVIC_EnableIRQ(USART0_IRQn);
+    m_rq.start();
+    m_tq.start();
+    m_open = true;
     return 0;
 }
 
 int Uart::close()
 {
+    m_open = false;
+    m_tq.stop();
+    m_rq.stop();
+
     scu_pinmux(0x2, 0, (MD_PLN | MD_EZI | MD_ZI | MD_EHS), FUNC4);           // U0_TXD
     scu_pinmux(0x2, 1, (MD_PLN | MD_EZI | MD_ZI | MD_EHS), FUNC4);           // U0_RXD
 
-    NVIC_DisableIRQ(USART0_IRQn);
     return 0;
 }
 
@@ -95,22 +70,20 @@ int Uart::receiveLen()
 
 int Uart::update()
 {
-    if (m_flag==false)
-    {
-        m_uart->THR = 0; // send a 0 to get the transmit interrupt going again, send 16 bits
-        m_uart->THR = 0;
-    }
+    m_tq.start(); // the transmit channel stops when there's no frame, start it on the next one
     return 0;
 }
 
 
-Uart::Uart(LPC_USARTn_Type *uart,  SerialCallback callback) : m_rq(UART_RECEIVE_BUF_SIZE), m_tq(UART_TRANSMIT_BUF_SIZE, callback)
+Uart::Uart(LPC_USARTn_Type *uart,  SerialCallback callback) :
+    m_dma(GPDMA_USART0_TX_CHANNEL, GPDMA_PERIPH_USART0_TX, &uart->THR, GPDMA_USART0_RX_CHANNEL, GPDMA_PERIPH_USART0_RX, &uart->RBR, GPDMA_WIDTH_8),
+    m_rq(UART_RECEIVE_BUF_SIZE, &m_dma), m_tq(UART_TRANSMIT_BUF_SIZE, callback, &m_dma)
 {
     UART_FIFO_CFG_Type ufifo;
     UART_CFG_Type ucfg;
 
     m_uart = uart;
-    m_flag = false;
+    m_open = false;
 
     // regular config
     ucfg.Baud_rate = UART_DEFAULT_BAUDRATE;
@@ -122,25 +95,40 @@ Uart::Uart(LPC_USARTn_Type *uart,  SerialCallback callback) : m_rq(UART_RECEIVE_
     UART_Init(m_uart, &ucfg);
 
     // config FIFOs
-    ufifo.FIFO_DMAMode = DISABLE;
+    ufifo.FIFO_DMAMode = ENABLE;
     ufifo.FIFO_Level = UART_FIFO_TRGLEV0;
     ufifo.FIFO_ResetRxBuf = ENABLE;
     ufifo.FIFO_ResetTxBuf = ENABLE;
 
     UART_FIFOConfig(m_uart, &ufifo);
     UART_TxCmd(m_uart, ENABLE);
-
-    // enable interrupts
-    UART_IntConfig(m_uart, UART_INTCFG_RBR, ENABLE);
-    UART_IntConfig(m_uart, UART_INTCFG_THRE, ENABLE);
-
-    NVIC_SetPriority(USART0_IRQn, 0);
 }
 
 int Uart::setBaudrate(uint32_t baudrate)
 {
-    UART_setBaudRate(m_uart, baudrate, CLKFREQ);
-    return 0;
+    Status res;
+
+    if (baudrate==0 || baudrate>UART_MAX_BAUDRATE)
+        return -1;
+
+    // The divisor registers share their address with THR and RBR, so DMA has to stay away
+    // while they're written.  Whatever is in the transmit FIFO goes out at the old rate.
+    if (m_open)
+    {
+        m_tq.stop();
+        m_rq.stop();
+        while((m_uart->LSR&UART_LSR_TEMT)==0);
+    }
+
+    res = UART_setBaudRate(m_uart, baudrate, CLKFREQ);
+
+    if (m_open)
+    {
+        m_rq.start();
+        m_tq.start();
+    }
+
+    return res==SUCCESS ? 0 : -1;
 }
 
 void uart_init(SerialCallback callback)
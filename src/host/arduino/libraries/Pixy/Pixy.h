@@ -93,6 +93,12 @@ class LinkSPI
       #endif
     }
     
+    // reads never wait, Pixy sends zeros when it has nothing
+    uint16_t available()
+    {
+      return 0xffff;
+    }
+
 	uint16_t getWord()
     {
       // ordering is different (big endian) because Pixy is sending 16 bits through SPI 
@@ -44,6 +44,11 @@ public:
 	else
 	  addr = arg;
   }
+  // reads never wait, Pixy sends zeros when it has nothing
+  uint16_t available()
+  {
+    return 0xffff;
+  }
   uint16_t getWord()
   {
     uint16_t w;
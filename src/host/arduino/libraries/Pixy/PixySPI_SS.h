@@ -53,6 +53,12 @@ class LinkSPI_SS
       #endif
     }
     
+    // reads never wait, Pixy sends zeros when it has nothing
+    uint16_t available()
+    {
+      return 0xffff;
+    }
+
     uint16_t getWord()
     {
       // ordering is different because Pixy is sending 16 bits through SPI 
@@ -31,6 +31,11 @@ public:
   void setArg(uint16_t arg)
   {
   }
+  // bytes that can be read without waiting
+  uint16_t available()
+  {
+    return Serial1.available();
+  }
   uint16_t getWord()
   {
     int16_t u, v;
@@ -23,13 +23,23 @@
 #include "Arduino.h"
 
 // Communication/misc parameters
-#define PIXY_INITIAL_ARRAYSIZE      30
-#define PIXY_MAXIMUM_ARRAYSIZE      130
+#ifndef PIXY_ARRAYSIZE
+#define PIXY_ARRAYSIZE              30    // blocks kept per frame, define before including to change
+#endif
+#ifndef PIXY_POLL_WORDS
+#define PIXY_POLL_WORDS             16    // most words one call to poll() reads
+#endif
 #define PIXY_START_WORD             0xaa55
 #define PIXY_START_WORD_CC          0xaa56
 #define PIXY_START_WORDX            0x55aa
+#define PIXY_START_WORD_COMPACT     0xaa57
 #define PIXY_MAX_SIGNATURE          7
 #define PIXY_DEFAULT_ARGVAL         0xffff
+#define PIXY_SER_SYNC_BYTE          0xa5
+#define PIXY_CMD_LEGACY_FRAMES      0xc0
+#define PIXY_CMD_COMPACT_FRAMES     0xc1
+#define PIXY_CMD_FRAME_DEPTH        0xd0  // + number of unread frames Pixy keeps
+#define PIXY_MAX_FRAME_DEPTH        3
 
 // Pixy x-y position values
 #define PIXY_MIN_X                  0L
@@ -46,7 +56,20 @@
 enum BlockType
 {
 	NORMAL_BLOCK,
-	CC_BLOCK
+	CC_BLOCK,
+	COMPACT_BLOCK
+};
+
+// where poll() is in the stream
+enum PixyState
+{
+  PIXY_STATE_SYNC,              // looking for the start of a frame
+  PIXY_STATE_CHECKSUM,          // legacy: checksum of the next block, or the end of the frame
+  PIXY_STATE_BLOCK,             // legacy: the rest of the block
+  PIXY_STATE_MARKER,            // legacy: marker of the next block, or the end of the frame
+  PIXY_STATE_COMPACT_HEADER,
+  PIXY_STATE_COMPACT_RECORDS,
+  PIXY_STATE_COMPACT_CRC
 };
 
 struct Block 
@@ -92,31 +115,71 @@ public:
   ~TPixy();
 	
   uint16_t getBlocks(uint16_t maxBlocks=1000);
+  boolean poll(uint16_t maxBlocks=1000);
   int8_t setServos(uint16_t s0, uint16_t s1);
   int8_t setBrightness(uint8_t brightness);
   int8_t setLED(uint8_t r, uint8_t g, uint8_t b);
+  int8_t setCompactFrames(boolean enable);
+  int8_t setFrameDepth(uint8_t depth);
   void init();
   
-  Block *blocks;
+  Block blocks[PIXY_ARRAYSIZE];
+  // blocks in blocks[], the whole frame once frameComplete is set.  Both are only valid
+  // until the next call to poll() or getBlocks().
+  uint16_t numBlocks;
+  boolean frameComplete;
+  // compact frames only: sequence number of the last frame (a jump of more than 1 means
+  // frames were dropped) and its capture time in microseconds
+  uint16_t frame;
+  uint32_t timestamp;
+  // blocks and compact frames that failed their checksum or CRC
+  uint16_t errors;
 	
 private:
-  boolean getStart();
-  void resize();
+  int8_t parseWord(uint16_t w);
+  int8_t parseCompactByte(uint8_t c);
+  void startFrame(BlockType type);
+  int8_t endFrame(BlockType next);
+  Block *nextBlock();
 
   LinkType link;
-  boolean  skipStart;
+  uint8_t  state;
   BlockType blockType;
-  uint16_t blockCount;
-  uint16_t blockArraySize;
+  BlockType pendingType;
+  boolean  startPending;
+  boolean  resync;
+  uint16_t blockLimit;
+  uint16_t lastWord;
+  // legacy block being read
+  Block    spare;           // blocks beyond blockLimit are read into this and dropped
+  Block   *block;
+  uint8_t  index;
+  uint16_t checksum;
+  uint16_t sum;
+  // compact frame being read
+  uint8_t  count;
+  uint8_t  record;
+  uint8_t  shift;
+  uint32_t value;
+  uint16_t fields[5];
+  uint16_t crc;
+  uint16_t received;
+  uint16_t frameSeq;
+  uint32_t frameTime;
 };
 
 
 template <class LinkType> TPixy<LinkType>::TPixy(uint16_t arg)
 {
-  skipStart = false;
-  blockCount = 0;
-  blockArraySize = PIXY_INITIAL_ARRAYSIZE;
-  blocks = (Block *)malloc(sizeof(Block)*blockArraySize);
+  state = PIXY_STATE_SYNC;
+  startPending = false;
+  resync = false;
+  lastWord = 0xffff;
+  numBlocks = 0;
+  frameComplete = false;
+  frame = 0;
+  timestamp = 0;
+  errors = 0;
   link.setArg(arg);
 }
 
@@ -127,113 +190,272 @@ template <class LinkType> void TPixy<LinkType>::init()
 
 template <class LinkType> TPixy<LinkType>::~TPixy()
 {
-  free(blocks);
 }
 
-template <class LinkType> boolean TPixy<LinkType>::getStart()
+// Reads what the link has (at most PIXY_POLL_WORDS words) and returns true if that
+// completed a frame, then blocks[0..numBlocks-1] is the frame.  Never waits: a silent
+// link or a partial frame just returns false, and the next call carries on where this one
+// stopped.  Call it often enough to keep up with Pixy, once per loop() is typical.
+template <class LinkType> boolean TPixy<LinkType>::poll(uint16_t maxBlocks)
 {
-  uint16_t w, lastw;
- 
-  lastw = 0xffff;
-  
-  while(true)
+  uint16_t n, avail;
+  int8_t res;
+
+  if (startPending)
   {
-    w = link.getWord();
-    if (w==0 && lastw==0)
-	{
-      delayMicroseconds(10);
-	  return false;
-	}		
-    else if (w==PIXY_START_WORD && lastw==PIXY_START_WORD)
-	{
-      blockType = NORMAL_BLOCK;
-      return true;
-	}
-    else if (w==PIXY_START_WORD_CC && lastw==PIXY_START_WORD)
-	{
-      blockType = CC_BLOCK;
+    startPending = false;
+    startFrame(pendingType);
+  }
+  blockLimit = maxBlocks<PIXY_ARRAYSIZE ? maxBlocks : PIXY_ARRAYSIZE;
+
+  avail = link.available();
+  if (resync)
+  {
+    if (avail==0)
+      return false;
+    link.getByte(); // the next frame will be word aligned
+    avail--;
+    resync = false;
+  }
+
+  for (n=0; n<PIXY_POLL_WORDS && avail>=2; n++, avail-=2)
+  {
+    res = parseWord(link.getWord());
+    if (res>0)
       return true;
-	}
-	else if (w==PIXY_START_WORDX)
-	{
-	  Serial.println("reorder");
-	  link.getByte(); // resync
-	}
-	lastw = w; 
+    if (res<0) // nothing to read
+      break;
   }
+  return false;
 }
 
-template <class LinkType> void TPixy<LinkType>::resize()
-{
-  blockArraySize += PIXY_INITIAL_ARRAYSIZE;
-  blocks = (Block *)realloc(blocks, sizeof(Block)*blockArraySize);
-}  
-		
+// Kept for older sketches, the same as poll() but returns the number of blocks of a
+// frame that just completed and 0 otherwise.
 template <class LinkType> uint16_t TPixy<LinkType>::getBlocks(uint16_t maxBlocks)
 {
-  uint8_t i;
-  uint16_t w, checksum, sum;
-  Block *block;
-  
-  if (!skipStart)
+  if (poll(maxBlocks))
+    return numBlocks;
+  return 0;
+}
+
+template <class LinkType> void TPixy<LinkType>::startFrame(BlockType type)
+{
+  numBlocks = 0;
+  frameComplete = false;
+  blockType = type;
+  if (type==COMPACT_BLOCK)
   {
-    if (getStart()==false)
-      return 0;
+    state = PIXY_STATE_COMPACT_HEADER;
+    index = 0;
+    crc = 0;
+    fields[0] = fields[1] = fields[2] = 0;
   }
   else
-	skipStart = false;
-	
-  for(blockCount=0; blockCount<maxBlocks && blockCount<PIXY_MAXIMUM_ARRAYSIZE;)
+    state = PIXY_STATE_CHECKSUM;
+}
+
+// The current legacy frame is complete.  next is the type of the frame that has already
+// started (NORMAL_BLOCK or CC_BLOCK for its first block) or COMPACT_BLOCK for a compact
+// frame, it starts at the next poll() so blocks[] holds this one until then.
+template <class LinkType> int8_t TPixy<LinkType>::endFrame(BlockType next)
+{
+  frameComplete = true;
+  pendingType = next;
+  startPending = true;
+  state = PIXY_STATE_SYNC;
+  return 1;
+}
+
+template <class LinkType> Block *TPixy<LinkType>::nextBlock()
+{
+  if (numBlocks<blockLimit)
+    return blocks + numBlocks;
+  return &spare;
+}
+
+// Returns 1 if w completed a frame, -1 if Pixy has nothing to send, 0 otherwise.
+template <class LinkType> int8_t TPixy<LinkType>::parseWord(uint16_t w)
+{
+  int8_t res;
+
+  switch (state)
   {
-    checksum = link.getWord();
-    if (checksum==PIXY_START_WORD) // we've reached the beginning of the next frame
+  case PIXY_STATE_SYNC:
+    res = 0;
+    if (w==0 && lastWord==0)
+      res = -1;
+    else if (w==PIXY_START_WORD && lastWord==PIXY_START_WORD)
+      startFrame(NORMAL_BLOCK);
+    else if (w==PIXY_START_WORD_CC && lastWord==PIXY_START_WORD)
+      startFrame(CC_BLOCK);
+    else if (w==PIXY_START_WORD_COMPACT)
+      startFrame(COMPACT_BLOCK);
+    else if (w==PIXY_START_WORDX || ((lastWord>>8)==(PIXY_START_WORD_COMPACT&0xff) && (w&0xff)==(PIXY_START_WORD_COMPACT>>8)))
     {
-      skipStart = true;
-	  blockType = NORMAL_BLOCK;
-	  //Serial.println("skip");
-      return blockCount;
+      resync = true; // off by a byte
+      res = -1;
     }
-	else if (checksum==PIXY_START_WORD_CC)
-	{
-	  skipStart = true;
-	  blockType = CC_BLOCK;
-	  return blockCount;
-	}
-    else if (checksum==0)
-      return blockCount;
-    
-	if (blockCount>blockArraySize)
-		resize();
-	
-	block = blocks + blockCount;
-	
-    for (i=0, sum=0; i<sizeof(Block)/sizeof(uint16_t); i++)
+    lastWord = state==PIXY_STATE_SYNC ? w : 0xffff;
+    return res;
+
+  case PIXY_STATE_CHECKSUM:
+    if (w==PIXY_START_WORD) // the last marker was the beginning of the next frame
+      return endFrame(NORMAL_BLOCK);
+    if (w==PIXY_START_WORD_CC)
+      return endFrame(CC_BLOCK);
+    if (w==PIXY_START_WORD_COMPACT) // Pixy switched to compact frames
+      return endFrame(COMPACT_BLOCK);
+    if (w==0)
     {
-	  if (blockType==NORMAL_BLOCK && i>=5) // skip 
-	  {
-		block->angle = 0;
-		break;
-	  }
-      w = link.getWord();
-      sum += w;
-      *((uint16_t *)block + i) = w;
+      frameComplete = true;
+      state = PIXY_STATE_SYNC;
+      lastWord = w;
+      return 1;
     }
+    checksum = w;
+    sum = 0;
+    index = 0;
+    block = nextBlock();
+    state = PIXY_STATE_BLOCK;
+    return 0;
 
-    if (checksum==sum)
-      blockCount++;
+  case PIXY_STATE_BLOCK:
+    sum += w;
+    *((uint16_t *)block + index++) = w;
+    if (blockType==NORMAL_BLOCK && index==5)
+      block->angle = 0;
+    else if (index<sizeof(Block)/sizeof(uint16_t))
+      return 0;
+    if (checksum!=sum)
+      errors++;
+    else if (block!=&spare)
+      numBlocks++;
+    state = PIXY_STATE_MARKER;
+    return 0;
+
+  case PIXY_STATE_MARKER:
+    state = PIXY_STATE_CHECKSUM;
+    if (w==PIXY_START_WORD)
+      blockType = NORMAL_BLOCK;
+    else if (w==PIXY_START_WORD_CC)
+      blockType = CC_BLOCK;
+    else if (w==PIXY_START_WORD_COMPACT)
+      return endFrame(COMPACT_BLOCK);
     else
-      Serial.println("cs error");
-	
-	w = link.getWord();
-	if (w==PIXY_START_WORD)
-	  blockType = NORMAL_BLOCK;
-	else if (w==PIXY_START_WORD_CC)
-	  blockType = CC_BLOCK;
-	else
-      return blockCount;
+    {
+      frameComplete = true;
+      state = PIXY_STATE_SYNC;
+      lastWord = w;
+      return 1;
+    }
+    return 0;
+
+  default: // compact frames are a byte stream, low byte first
+    res = parseCompactByte(w&0xff);
+    if (res==0) // otherwise the high byte is the pad after the CRC
+      res = parseCompactByte(w>>8);
+    if (res)
+      lastWord = 0xffff;
+    return res>0 ? 1 : 0;
   }
 }
 
+// Compact frames, see blockframe.h in the Pixy firmware.  Returns 1 at the end of a good
+// frame, -1 at the end of a bad one, 0 otherwise.
+template <class LinkType> int8_t TPixy<LinkType>::parseCompactByte(uint8_t c)
+{
+  uint8_t i;
+  Block *b;
+
+  if (state!=PIXY_STATE_COMPACT_CRC) // CRC-16/XMODEM
+  {
+    crc ^= (uint16_t)c<<8;
+    for (i=0; i<8; i++)
+      crc = (crc&0x8000) ? (crc<<1)^0x1021 : crc<<1;
+  }
+
+  switch (state)
+  {
+  case PIXY_STATE_COMPACT_HEADER:
+    // seq, timestamp and count
+    if (index<2)
+      frameSeq = index ? frameSeq | (uint16_t)c<<8 : c;
+    else if (index<6)
+      frameTime = index>2 ? frameTime | (uint32_t)c<<(8*(index-2)) : c;
+    else
+    {
+      count = c;
+      record = 0;
+      index = 0;
+      shift = 0;
+      value = 0;
+      state = count ? PIXY_STATE_COMPACT_RECORDS : PIXY_STATE_COMPACT_CRC;
+      return 0;
+    }
+    index++;
+    return 0;
+
+  case PIXY_STATE_COMPACT_RECORDS:
+    // five varints: signature, x and y as zigzag deltas from the previous record, then width and height
+    value |= (uint32_t)(c&0x7f)<<shift;
+    if (c&0x80)
+    {
+      shift += 7;
+      if (shift>14)
+      {
+        errors++;
+        state = PIXY_STATE_SYNC;
+        return -1;
+      }
+      return 0;
+    }
+    if (index<3)
+      value = fields[index] + ((value>>1) ^ -(int32_t)(value&1));
+    fields[index++] = value;
+    shift = 0;
+    value = 0;
+    if (index<5)
+      return 0;
+
+    if (numBlocks<blockLimit)
+    {
+      b = blocks + numBlocks++;
+      b->signature = fields[0];
+      b->x = fields[1];
+      b->y = fields[2];
+      b->width = fields[3];
+      b->height = fields[4];
+      b->angle = 0;
+    }
+    index = 0;
+    if (++record==count)
+      state = PIXY_STATE_COMPACT_CRC;
+    return 0;
+
+  case PIXY_STATE_COMPACT_CRC:
+    // little endian
+    if (index==0)
+    {
+      received = c;
+      index++;
+      return 0;
+    }
+    received |= (uint16_t)c<<8;
+    state = PIXY_STATE_SYNC;
+    if (crc!=received)
+    {
+      errors++;
+      numBlocks = 0;
+      return -1;
+    }
+    frame = frameSeq;
+    timestamp = frameTime;
+    frameComplete = true;
+    return 1;
+  }
+  return -1;
+}
+
 template <class LinkType> int8_t TPixy<LinkType>::setServos(uint16_t s0, uint16_t s1)
 {
   uint8_t outBuf[6];
@@ -270,4 +492,31 @@ template <class LinkType> int8_t TPixy<LinkType>::setLED(uint8_t r, uint8_t g, u
   return link.send(outBuf, 5);
 }
 
+// Ask Pixy for compact frames (one header and CRC per frame, about half the bytes of the
+// default format), or go back to the default.  Pixy switches at its next frame.
+template <class LinkType> int8_t TPixy<LinkType>::setCompactFrames(boolean enable)
+{
+  uint8_t outBuf[2];
+
+  outBuf[0] = PIXY_SER_SYNC_BYTE;
+  outBuf[1] = enable ? PIXY_CMD_COMPACT_FRAMES : PIXY_CMD_LEGACY_FRAMES;
+
+  return link.send(outBuf, 2);
+}
+
+// Pixy sends whole frames and drops the oldest unread ones beyond depth.  The default
+// of 1 always gets the latest frame, a larger depth (up to PIXY_MAX_FRAME_DEPTH) lets a
+// slow reader catch up on every frame as long as it's only briefly behind.
+template <class LinkType> int8_t TPixy<LinkType>::setFrameDepth(uint8_t depth)
+{
+  uint8_t outBuf[2];
+
+  if (depth<1 || depth>PIXY_MAX_FRAME_DEPTH)
+    return -1;
+  outBuf[0] = PIXY_SER_SYNC_BYTE;
+  outBuf[1] = PIXY_CMD_FRAME_DEPTH + depth;
+
+  return link.send(outBuf, 2);
+}
+
 #endif
@@ -0,0 +1,405 @@
+/**
+ * @file main.cpp
+ * @brief Turns a camera calibration from OpenCV (calibrateCamera() written with FileStorage)
+ *        or ROS (camera_calibration's ost.yaml) into the Calibration blob the camera keeps in
+ *        flash (common/inc/undistort.h), and checks the grid the camera builds from it: every
+ *        half pixel of the blob image is looked up the way the camera does it and compared
+ *        with the exact inversion of the distortion, in pixels and in degrees.  Without a
+ *        file, checks a set of built-in lenses.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "undistort.h"
+#include "pixyblocks.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PIXEL_ERROR     0.25    // pixels of the blob image, grid against exact; centers come in half pixels
+#define MAX_BEARING_ERROR   0.1     // degrees
+#define TIMING_ROUNDS       20      // over all half pixels
+
+static_assert(sizeof(Calibration) == 48, "Calibration must match the camera's layout");
+
+typedef struct
+{
+    const char *name;
+    uint16_t width, height;
+    float fx, fy, cx, cy, k1, k2, p1, p2, k3;
+} Lens;
+
+// Pixy's stock lens is close to the first, the others are wide angle lenses as they might
+// be fitted for landing, at the sizes a calibration is usually made at.
+static const Lens lenses_[] =
+{
+    { "pinhole 320x200", 320, 200, 208.0f, 208.0f, 159.5f, 99.5f, 0, 0, 0, 0, 0 },
+    { "mild barrel 640x400", 640, 400, 420.0f, 418.0f, 322.0f, 197.5f, -0.12f, 0.05f, 0, 0, 0 },
+    { "wide 1280x800", 1280, 800, 800.0f, 801.0f, 637.0f, 405.0f, -0.28f, 0.09f, 0.001f, -0.0015f, -0.012f },
+    { "very wide 320x200", 320, 200, 180.0f, 180.0f, 161.0f, 98.0f, -0.3f, 0.1f, 0.0005f, 0.0005f, -0.01f },
+};
+
+typedef struct
+{
+    double maxPixels, rmsPixels;    // normalized error times the focal length
+    double maxDegrees, rmsDegrees;
+    double normalizeNs;             // per call
+    double bearingNs;
+} Accuracy;
+
+static bool verbose_ = false;
+
+static double now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void make_calibration(const Lens *lens, Calibration *cal)
+{
+    memset(cal, 0, sizeof(*cal));
+    cal->magic = UD_CAL_MAGIC;
+    cal->version = UD_CAL_VERSION;
+    cal->width = lens->width;
+    cal->height = lens->height;
+    cal->fx = lens->fx;
+    cal->fy = lens->fy;
+    cal->cx = lens->cx;
+    cal->cy = lens->cy;
+    cal->k1 = lens->k1;
+    cal->k2 = lens->k2;
+    cal->p1 = lens->p1;
+    cal->p2 = lens->p2;
+    cal->k3 = lens->k3;
+    cal->crc = pixy_blocks_crc16((const uint8_t *)cal, sizeof(*cal) - sizeof(cal->crc));
+}
+
+// Newton's method in double, as far as it goes, for the reference.  False if it doesn't
+// converge.
+static bool exact_undistort(const Calibration *cal, double xd, double yd, double *x, double *y)
+{
+    double r2, radial, dr, ex, ey, j[4], det;
+    int i;
+
+    *x = xd;
+    *y = yd;
+    for (i = 0; i < 50; i++)
+    {
+        r2 = *x * *x + *y * *y;
+        radial = 1.0 + r2 * (cal->k1 + r2 * (cal->k2 + r2 * cal->k3));
+        dr = 2.0 * (cal->k1 + r2 * (2.0 * cal->k2 + 3.0 * r2 * cal->k3)); // d radial / d r2, times 2
+        ex = *x * radial + 2.0 * cal->p1 * *x * *y + cal->p2 * (r2 + 2.0 * *x * *x) - xd;
+        ey = *y * radial + cal->p1 * (r2 + 2.0 * *y * *y) + 2.0 * cal->p2 * *x * *y - yd;
+        j[0] = radial + *x * *x * dr + 2.0 * cal->p1 * *y + 6.0 * cal->p2 * *x;
+        j[1] = *x * *y * dr + 2.0 * cal->p1 * *x + 2.0 * cal->p2 * *y;
+        j[2] = *x * *y * dr + 2.0 * cal->p1 * *x + 2.0 * cal->p2 * *y;
+        j[3] = radial + *y * *y * dr + 6.0 * cal->p1 * *y + 2.0 * cal->p2 * *x;
+        det = j[0] * j[3] - j[1] * j[2];
+        if (fabs(det) < 1e-9)
+            return false;
+        *x -= (j[3] * ex - j[1] * ey) / det;
+        *y -= (j[0] * ey - j[2] * ex) / det;
+        if (fabs(ex) < 1e-12 && fabs(ey) < 1e-12)
+            return true;
+    }
+    return false;
+}
+
+// Every half pixel of the blob image, as Blobs hands centers to the grid.  Returns false
+// if the exact inversion fails anywhere.
+static bool check(const Calibration *cal, const Undistort *undistort, Accuracy *acc)
+{
+    double s = (double)cal->width / UD_WIDTH, u, v, x, y, az, el, dx, dy, e, sumPixels = 0, sumDegrees = 0, t;
+    int16_t nx, ny, baz, bel;
+    volatile int16_t sink;
+    uint32_t n = 0, r;
+    uint16_t x2, y2;
+
+    memset(acc, 0, sizeof(*acc));
+    for (y2 = 0; y2 <= 2 * (UD_HEIGHT - 1); y2++)
+    {
+        for (x2 = 0; x2 <= 2 * (UD_WIDTH - 1); x2++)
+        {
+            u = s * x2 / 2.0 + (s - 1.0) / 2.0;
+            v = s * y2 / 2.0 + (s - 1.0) / 2.0;
+            if (!exact_undistort(cal, (u - cal->cx) / cal->fx, (v - cal->cy) / cal->fy, &x, &y))
+            {
+                printf("  exact inversion fails at %.1f, %.1f\n", x2 / 2.0, y2 / 2.0);
+                return false;
+            }
+            undistort->normalize(x2, y2, &nx, &ny);
+            dx = (nx / (double)(1 << UD_NORM_SHIFT) - x) * undistort->fx();
+            dy = (ny / (double)(1 << UD_NORM_SHIFT) - y) * undistort->fy();
+            e = dx * dx + dy * dy;
+            sumPixels += e;
+            if (sqrt(e) > acc->maxPixels)
+            {
+                acc->maxPixels = sqrt(e);
+                if (verbose_)
+                    printf("    %.1f, %.1f: %.3f px\n", x2 / 2.0, y2 / 2.0, acc->maxPixels);
+            }
+
+            undistort->bearing(x2, y2, &baz, &bel);
+            az = atan(x) * 180.0 / M_PI;
+            el = atan2(y, sqrt(1.0 + x * x)) * 180.0 / M_PI;
+            dx = baz / (double)UD_BEARING_SCALE - az;
+            dy = bel / (double)UD_BEARING_SCALE - el;
+            e = dx * dx + dy * dy;
+            sumDegrees += e;
+            if (sqrt(e) > acc->maxDegrees)
+                acc->maxDegrees = sqrt(e);
+            n++;
+        }
+    }
+    acc->rmsPixels = sqrt(sumPixels / n);
+    acc->rmsDegrees = sqrt(sumDegrees / n);
+
+    t = now_ns();
+    for (r = 0; r < TIMING_ROUNDS; r++)
+    {
+        for (y2 = 0; y2 <= 2 * (UD_HEIGHT - 1); y2++)
+        {
+            for (x2 = 0; x2 <= 2 * (UD_WIDTH - 1); x2++)
+            {
+                undistort->normalize(x2, y2, &nx, &ny);
+                sink = nx + ny;
+            }
+        }
+    }
+    acc->normalizeNs = (now_ns() - t) / (n * TIMING_ROUNDS);
+    t = now_ns();
+    for (r = 0; r < TIMING_ROUNDS; r++)
+    {
+        for (y2 = 0; y2 <= 2 * (UD_HEIGHT - 1); y2++)
+        {
+            for (x2 = 0; x2 <= 2 * (UD_WIDTH - 1); x2++)
+            {
+                undistort->bearing(x2, y2, &baz, &bel);
+                sink = baz + bel;
+            }
+        }
+    }
+    acc->bearingNs = (now_ns() - t) / (n * TIMING_ROUNDS);
+    (void)sink;
+    return true;
+}
+
+static void print_accuracy(const char *name, const Accuracy *acc, bool failed)
+{
+    printf("  %-22s %8.3f %8.3f %8.4f %8.4f %8.1f %8.1f%s\n", name, acc->maxPixels, acc->rmsPixels,
+           acc->maxDegrees, acc->rmsDegrees, acc->normalizeNs, acc->bearingNs, failed ? "  FAILED" : "");
+}
+
+static void print_header()
+{
+    printf("grid of %dx%d points every %d pixels, %u bytes\n", UD_COLS, UD_ROWS, UD_STEP,
+           (unsigned)sizeof(int16_t[UD_ROWS * UD_COLS][2]));
+    printf("  %-22s %8s %8s %8s %8s %8s %8s\n", "lens", "max px", "rms px", "max deg", "rms deg", "norm ns",
+           "bear ns");
+}
+
+static int test_lenses()
+{
+    Calibration cal;
+    Undistort undistort;
+    Accuracy acc;
+    uint32_t failed = 0;
+    bool bad;
+    size_t i;
+
+    print_header();
+    for (i = 0; i < sizeof(lenses_) / sizeof(lenses_[0]); i++)
+    {
+        make_calibration(lenses_ + i, &cal);
+        memset(&acc, 0, sizeof(acc));
+        bad = !undistort.build(&cal) || !undistort.calibrated() || !check(&cal, &undistort, &acc) ||
+              acc.maxPixels > MAX_PIXEL_ERROR || acc.maxDegrees > MAX_BEARING_ERROR;
+        print_accuracy(lenses_[i].name, &acc, bad);
+        failed += bad;
+    }
+
+    // what the camera must turn down, and keep its grid through
+    make_calibration(lenses_ + 1, &cal);
+    cal.height = 480;
+    bad = undistort.build(&cal);
+    make_calibration(lenses_ + 1, &cal);
+    cal.version++;
+    bad |= undistort.build(&cal);
+    make_calibration(lenses_ + 1, &cal);
+    cal.k1 = 2.0f;  // folds back inside the image
+    cal.k2 = -3.0f;
+    bad |= undistort.build(&cal) || undistort.calibrated();
+    printf("  %-22s %s\n", "rejects bad input", bad ? "FAILED" : "ok");
+    failed += bad;
+
+    return failed ? 1 : 0;
+}
+
+// The numbers in "data: [ ... ]" after key, which OpenCV may spread over several lines.
+static int parse_data(const char *text, const char *key, double *values, int max)
+{
+    const char *p = strstr(text, key), *end;
+    char *next;
+    int n = 0;
+
+    if (p == NULL || (p = strstr(p, "data:")) == NULL || (p = strchr(p, '[')) == NULL ||
+        (end = strchr(p, ']')) == NULL)
+        return -1;
+    for (p++; p < end && n < max; p = next)
+    {
+        while (p < end && (*p == ',' || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+        if (p == end)
+            break;
+        values[n] = strtod(p, &next);
+        if (next == p)
+            return -1;
+        n++;
+    }
+    return n;
+}
+
+static bool parse_int(const char *text, const char *key, long *value)
+{
+    const char *p = strstr(text, key);
+
+    if (p == NULL)
+        return false;
+    *value = strtol(p + strlen(key), NULL, 10);
+    return true;
+}
+
+static bool read_calibration(const char *filename, Calibration *cal)
+{
+    FILE *file = fopen(filename, "rb");
+    char text[16384];
+    double k[9], d[14];
+    long width, height;
+    size_t len;
+    int nk, nd, i;
+
+    if (file == NULL)
+    {
+        perror(filename);
+        return false;
+    }
+    len = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[len] = '\0';
+
+    nk = parse_data(text, "camera_matrix:", k, 9);
+    nd = parse_data(text, "distortion_coefficients:", d, 14);
+    if (nk != 9 || nd < 4)
+    {
+        printf("%s: no camera_matrix or distortion_coefficients\n", filename);
+        return false;
+    }
+    if (!parse_int(text, "image_width:", &width) || !parse_int(text, "image_height:", &height) || width <= 0 ||
+        height <= 0 || width > 65535 || height > 65535)
+    {
+        printf("%s: no image_width or image_height\n", filename);
+        return false;
+    }
+    for (i = 5; i < nd; i++)
+    {
+        if (d[i] != 0.0)
+        {
+            printf("%s: only k1, k2, p1, p2, k3 are supported, not the rational or thin prism model\n", filename);
+            return false;
+        }
+    }
+
+    Lens lens = { filename, (uint16_t)width, (uint16_t)height, (float)k[0], (float)k[4], (float)k[2], (float)k[5],
+                  (float)d[0], (float)d[1], (float)d[2], (float)d[3], nd > 4 ? (float)d[4] : 0.0f };
+    make_calibration(&lens, cal);
+    return true;
+}
+
+static int convert(const char *filename, const char *outname)
+{
+    Calibration cal;
+    Undistort undistort;
+    Accuracy acc;
+    FILE *file;
+    bool bad;
+
+    if (!read_calibration(filename, &cal))
+        return 1;
+    printf("%ux%u, fx %.2f fy %.2f cx %.2f cy %.2f, k1 %.5f k2 %.5f p1 %.5f p2 %.5f k3 %.5f\n", cal.width,
+           cal.height, cal.fx, cal.fy, cal.cx, cal.cy, cal.k1, cal.k2, cal.p1, cal.p2, cal.k3);
+    if (!undistort.build(&cal))
+    {
+        printf("the camera won't take this, it must be at least %dx%d with the same aspect, and the distortion "
+               "must invert over the whole image\n", UD_WIDTH, UD_HEIGHT);
+        return 1;
+    }
+    print_header();
+    bad = !check(&cal, &undistort, &acc) || acc.maxPixels > MAX_PIXEL_ERROR || acc.maxDegrees > MAX_BEARING_ERROR;
+    print_accuracy(filename, &acc, bad);
+    if (bad)
+        printf("the grid is too coarse for this lens, a smaller UD_STEP_SHIFT would do\n");
+
+    if (outname)
+    {
+        file = fopen(outname, "wb");
+        if (file == NULL || fwrite(&cal, sizeof(cal), 1, file) != 1)
+        {
+            perror(outname);
+            if (file)
+                fclose(file);
+            return 1;
+        }
+        fclose(file);
+        printf("wrote %u bytes to %s, send them with cal_set\n", (unsigned)sizeof(cal), outname);
+    }
+    return bad ? 1 : 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-v] [-o calibration.bin] [calibration.yaml]\n", progname);
+    printf("  -v  Print where the error grows, for the built-in lenses\n");
+    printf("  -o  Write the blob for the camera's flash\n");
+    printf("  Without a file, checks the built-in lenses.\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outname = NULL;
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "vo:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = true;
+                break;
+
+            case 'o':
+                outname = optarg;
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    if (optind < argc)
+        return convert(argv[optind], outname);
+    if (outname)
+        help(argv[0]);
+
+    failures += test_lenses();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
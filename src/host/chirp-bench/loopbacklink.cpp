@@ -0,0 +1,146 @@
+/**
+ * @file loopbacklink.cpp
+ * @brief In-memory Link for running two Chirp endpoints on the host
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "loopbacklink.h"
+
+#include <algorithm>
+#include <string.h>
+
+using std::chrono::steady_clock;
+
+LoopbackLink::LoopbackLink(const LoopbackConfig &config)
+    : config_(config)
+    , rx_(new LoopbackChannel)
+    , tx_(NULL)
+    , random_(config.seed)
+    , timer_(steady_clock::now())
+{
+    memset(&stats_, 0, sizeof(stats_));
+    if (config_.block_size == 0)
+        config_.block_size = 64;
+    m_blockSize = config_.block_size;
+    m_flags = config_.error_corrected ? LINK_FLAG_ERROR_CORRECTED : 0;
+}
+
+LoopbackLink::~LoopbackLink()
+{
+    delete rx_;
+}
+
+void LoopbackLink::connect(LoopbackLink *a, LoopbackLink *b)
+{
+    a->tx_ = b->rx_;
+    b->tx_ = a->rx_;
+}
+
+void LoopbackLink::impair(std::vector<uint8_t> &block)
+{
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    if (config_.corruption > 0.0 && chance(random_) < config_.corruption)
+    {
+        std::uniform_int_distribution<uint32_t> bit(0, block.size() * 8 - 1);
+        uint32_t b = bit(random_);
+        block[b / 8] ^= 1 << (b % 8);
+        stats_.blocks_corrupted++;
+    }
+}
+
+int LoopbackLink::send(const uint8_t *data, uint32_t len, uint16_t timeoutMs)
+{
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    steady_clock::time_point deliver = steady_clock::now() + std::chrono::microseconds(config_.latency_us);
+
+    if (tx_ == NULL)
+        return LINK_RESULT_ERROR;
+
+    std::unique_lock<std::mutex> lock(tx_->mutex);
+    for (uint32_t offset = 0; offset < len; offset += config_.block_size)
+    {
+        uint32_t n = std::min(len - offset, config_.block_size);
+
+        // blocks go out back to back, each one holds the wire for block_us
+        if (config_.block_us > 0.0)
+        {
+            tx_->wire = std::max(tx_->wire, steady_clock::now()) +
+                std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double, std::micro>(config_.block_us));
+            deliver = std::max(deliver, tx_->wire);
+        }
+
+        stats_.bytes_sent += n;
+        stats_.blocks_sent++;
+        if (config_.loss > 0.0 && chance(random_) < config_.loss)
+        {
+            stats_.blocks_lost++;
+            continue;
+        }
+
+        LoopbackChannel::Block block;
+        block.deliver = deliver;
+        block.data.assign(data + offset, data + offset + n);
+        impair(block.data);
+        tx_->blocks.push_back(block);
+    }
+    lock.unlock();
+    tx_->cond.notify_all();
+
+    return len;
+}
+
+int LoopbackLink::receive(uint8_t *data, uint32_t len, uint16_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(rx_->mutex);
+    steady_clock::time_point idle = steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    uint32_t recvd = 0;
+
+    while (recvd < len)
+    {
+        steady_clock::time_point now = steady_clock::now();
+
+        // wait for the next block to arrive, give up once the channel has been idle too long
+        if (rx_->blocks.empty() || rx_->blocks.front().deliver > now)
+        {
+            steady_clock::time_point wake = idle;
+            if (!rx_->blocks.empty())
+                wake = std::min(wake, rx_->blocks.front().deliver);
+            if (timeoutMs == 0 || now >= idle)
+                break;
+            rx_->cond.wait_until(lock, wake);
+            continue;
+        }
+
+        LoopbackChannel::Block &block = rx_->blocks.front();
+        uint32_t n = std::min(len - recvd, (uint32_t)block.data.size() - rx_->offset);
+        memcpy(data + recvd, &block.data[rx_->offset], n);
+        recvd += n;
+        rx_->offset += n;
+        idle = now + std::chrono::milliseconds(timeoutMs);
+
+        if (rx_->offset == block.data.size())
+        {
+            bool short_block = block.data.size() < config_.block_size;
+            rx_->blocks.pop_front();
+            rx_->offset = 0;
+            // a short packet ends a bulk transfer
+            if (config_.error_corrected && short_block)
+                break;
+        }
+    }
+
+    if (recvd == 0)
+        return LINK_RESULT_ERROR_RECV_TIMEOUT;
+    return recvd;
+}
+
+void LoopbackLink::setTimer()
+{
+    timer_ = steady_clock::now();
+}
+
+uint32_t LoopbackLink::getTimer()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - timer_).count();
+}
@@ -0,0 +1,118 @@
+/**
+ * @file loopbacklink.h
+ * @brief In-memory Link for running two Chirp endpoints on the host
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#ifndef __LOOPBACKLINK_H__
+#define __LOOPBACKLINK_H__
+
+#include "link.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Impairments applied to each block as it is sent.  A block is at most blockSize bytes;
+ * a send() of len bytes is split into len/blockSize full blocks and one short block,
+ * the same way a USB bulk transfer is split into packets.
+ */
+struct LoopbackConfig
+{
+    uint32_t block_size;    // bytes per block (USB full-speed bulk is 64)
+    uint32_t latency_us;    // delay from send() until a block can be received
+    double block_us;        // time each block occupies the wire, models bus bandwidth (0 = unlimited)
+    double loss;            // probability that a block is dropped
+    double corruption;      // probability that one bit of a block is flipped
+    bool error_corrected;   // set LINK_FLAG_ERROR_CORRECTED (USB/SMLink) or not (UART-style)
+    uint32_t seed;          // random seed for loss and corruption
+
+    LoopbackConfig()
+        : block_size(64)
+        , latency_us(0)
+        , block_us(0.0)
+        , loss(0.0)
+        , corruption(0.0)
+        , error_corrected(true)
+        , seed(1)
+    {
+    }
+};
+
+/*
+ * One direction of a loopback connection.  Blocks are queued by the sender and
+ * released to the receiver once their latency has elapsed.
+ */
+class LoopbackChannel
+{
+public:
+    struct Block
+    {
+        std::chrono::steady_clock::time_point deliver;
+        std::vector<uint8_t> data;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Block> blocks;
+    uint32_t offset;        // bytes already consumed from the front block
+    std::chrono::steady_clock::time_point wire; // when the wire is free for the next block
+
+    LoopbackChannel()
+        : offset(0)
+        , wire(std::chrono::steady_clock::now())
+    {
+    }
+};
+
+struct LoopbackStats
+{
+    uint64_t bytes_sent;
+    uint64_t blocks_sent;
+    uint64_t blocks_lost;
+    uint64_t blocks_corrupted;
+};
+
+/*
+ * One end of a loopback connection.  Create the pair with connect().
+ *
+ * If the link is error corrected, receive() behaves like a USB bulk read: it returns
+ * once len bytes have arrived or a short block ends the transfer.  Otherwise the link
+ * is a byte stream like a UART and receive() waits for len bytes until the channel has
+ * been idle for timeoutMs.  A timeout of 0 polls.
+ */
+class LoopbackLink : public Link
+{
+public:
+    LoopbackLink(const LoopbackConfig &config = LoopbackConfig());
+    ~LoopbackLink();
+
+    static void connect(LoopbackLink *a, LoopbackLink *b);
+
+    virtual int send(const uint8_t *data, uint32_t len, uint16_t timeoutMs);
+    virtual int receive(uint8_t *data, uint32_t len, uint16_t timeoutMs);
+    virtual void setTimer();
+    virtual uint32_t getTimer();
+
+    const LoopbackStats &stats() const
+    {
+        return stats_;
+    }
+
+private:
+    void impair(std::vector<uint8_t> &block);
+
+    LoopbackConfig config_;
+    LoopbackChannel *rx_;
+    LoopbackChannel *tx_;
+    LoopbackStats stats_;
+    std::mt19937 random_;
+    std::chrono::steady_clock::time_point timer_;
+};
+
+#endif // __LOOPBACKLINK_H__
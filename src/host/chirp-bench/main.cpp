@@ -0,0 +1,928 @@
+/**
+ * @file main.cpp
+ * @brief Chirp protocol benchmarks and deserialize fuzzing over an in-memory LoopbackLink
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "chirp.hpp"
+#include "chirpbinding.hpp"
+#include "loopbacklink.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <inttypes.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define FRAME_WIDTH         320
+#define FRAME_HEIGHT        200
+#define FRAME_BUF_SIZE      0x12000     // same as MEM_USB_FRAME_SIZE on the device
+#define SECTOR_SIZE         512
+#define BLOCKS_PER_FRAME    (FRAME_WIDTH * FRAME_HEIGHT / SECTOR_SIZE + 1)
+#define CCB1_BLOBS          20          // typical number of blobs per frame
+#define BLOB_WORDS          5           // BlobA is model, left, right, top, bottom
+
+typedef std::chrono::steady_clock Clock;
+
+static uint8_t frame_buf_[FRAME_BUF_SIZE];
+
+static uint8_t pattern(uint32_t seq, uint32_t i)
+{
+    return (uint8_t)(seq * 31 + i * 7 + (i >> 8));
+}
+
+static uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Server-side procedures, written the same way as their device counterparts
+ */
+static int32_t bench_ping(Chirp *chirp)
+{
+    return 0;
+}
+
+// same layout as cam_getFrameChirpFlags()
+static int32_t bench_getFrame(const uint16_t &xWidth, const uint16_t &yWidth, Chirp *chirp)
+{
+    uint32_t len = xWidth * yWidth;
+    int32_t hlen;
+
+    hlen = Chirp::serialize(chirp, frame_buf_, FRAME_BUF_SIZE, HTYPE(FOURCC('B','A','8','1')), HINT8(0), UINT16(xWidth), UINT16(yWidth), UINTS8_NO_COPY(len), END);
+    if (hlen < 0 || hlen + len > FRAME_BUF_SIZE)
+        return -1;
+    for (uint32_t i = 0; i < len; i++)
+        frame_buf_[hlen + i] = pattern(len, i);
+
+    chirp->useBuffer(frame_buf_, hlen + len);
+    return 0;
+}
+
+// same layout as read_blocks() in sdmmc.cpp
+static int32_t bench_readBlocks(const uint32_t &blkStart, const uint32_t &blkCnt, Chirp *chirp)
+{
+    uint32_t bytecnt = blkCnt * SECTOR_SIZE;
+    int32_t len;
+
+    if (blkCnt == 0 || blkCnt > BLOCKS_PER_FRAME)
+        return -1;
+
+    len = Chirp::serialize(chirp, frame_buf_, FRAME_BUF_SIZE, UINTS8_NO_COPY(bytecnt), END);
+    if (len <= 0)
+        return -1;
+    for (uint32_t i = 0; i < bytecnt; i++)
+        frame_buf_[len + i] = pattern(blkStart, i);
+
+    chirp->useBuffer(frame_buf_, len + bytecnt);
+    return bytecnt;
+}
+
+// returns the bytes it's given, so both directions see the same message lengths
+static int32_t bench_echo(const uint32_t &len, const uint8_t *data, Chirp *chirp)
+{
+    int32_t hlen;
+
+    hlen = Chirp::serialize(chirp, frame_buf_, FRAME_BUF_SIZE, UINTS8_NO_COPY(len), END);
+    if (hlen <= 0 || hlen + len > FRAME_BUF_SIZE)
+        return -1;
+    memcpy(frame_buf_ + hlen, data, len);
+
+    chirp->useBuffer(frame_buf_, hlen + len);
+    return len;
+}
+
+static const ProcModule g_module[] =
+{
+    {
+    "bench_ping",
+    (ProcPtr)bench_ping,
+    {END},
+    "Return immediately"
+    "@r always returns 0"
+    },
+    {
+    "bench_getFrame",
+    (ProcPtr)bench_getFrame,
+    {CRP_UINT16, CRP_UINT16, END},
+    "Return a BA81 frame filled with a test pattern"
+    "@p width"
+    "@p height"
+    "@r 0 if success, negative if error"
+    },
+    {
+    "read_blocks",
+    (ProcPtr)bench_readBlocks,
+    {CRP_UINT32, CRP_UINT32, END},
+    "Return SD card blocks filled with a test pattern"
+    "@p block_start"
+    "@p block_count"
+    "@r number of bytes if success, negative if error"
+    },
+    {
+    "bench_echo",
+    (ProcPtr)bench_echo,
+    {CRP_UINTS8, END},
+    "Return the given bytes"
+    "@p data"
+    "@r number of bytes if success, negative if error"
+    },
+    END
+};
+
+/*
+ * Client endpoint; counts CCB1 messages streamed by the server
+ */
+class BenchChirp : public Chirp
+{
+public:
+    BenchChirp()
+        : Chirp(true, true)
+        , received(0)
+        , corrupt(0)
+        , sent_us(0)
+    {
+    }
+
+    std::atomic<uint32_t> received;
+    std::atomic<uint32_t> corrupt;
+    std::atomic<uint64_t> sent_us;
+    std::vector<double> latency_us;
+
+protected:
+    virtual void handleXdata(const void *data[])
+    {
+        if (data[0] == NULL || getType(data[0]) != CRP_TYPE_HINT ||
+            *(const uint32_t *)data[0] != FOURCC('C','C','B','1'))
+            return;
+
+        uint32_t n = *(const uint32_t *)data[4];
+        const uint16_t *blobs = (const uint16_t *)data[5];
+        bool ok = n == CCB1_BLOBS * BLOB_WORDS;
+        for (uint32_t i = 0; ok && i < n; i++)
+            ok = blobs[i] == (uint16_t)(received * 131 + i);
+
+        latency_us.push_back(now_us() - sent_us);
+        if (!ok)
+            corrupt++;
+        received++;
+    }
+};
+
+/*
+ * Server thread; services calls and streams CCB1 messages on request
+ */
+class BenchServer
+{
+public:
+    BenchServer(Link *link, BenchChirp *client)
+        : chirp_(false, false)
+        , client_(client)
+        , running_(true)
+        , ccb1_requested_(0)
+        , ccb1_sent_(0)
+    {
+        chirp_.registerModule(g_module);
+        chirp_.setLink(link);
+        thread_ = std::thread(&BenchServer::run, this);
+    }
+
+    ~BenchServer()
+    {
+        running_ = false;
+        thread_.join();
+    }
+
+    void requestCcb1(uint32_t count)
+    {
+        ccb1_sent_ = 0;
+        ccb1_requested_ = count;
+    }
+
+private:
+    void run()
+    {
+        uint16_t blobs[CCB1_BLOBS * BLOB_WORDS];
+
+        while (running_)
+        {
+            // send the next message once the client has the previous one, so we can measure latency
+            if (ccb1_sent_ < ccb1_requested_ && client_->received == ccb1_sent_)
+            {
+                for (uint32_t i = 0; i < CCB1_BLOBS * BLOB_WORDS; i++)
+                    blobs[i] = ccb1_sent_ * 131 + i;
+                client_->sent_us = now_us();
+                CRP_RETURN((&chirp_), HTYPE(FOURCC('C','C','B','1')), HINT8(1), HINT16(FRAME_WIDTH), HINT16(FRAME_HEIGHT),
+                           UINTS16(CCB1_BLOBS * BLOB_WORDS, blobs), END);
+                ccb1_sent_++;
+            }
+            if (chirp_.service() == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    Chirp chirp_;
+    BenchChirp *client_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<uint32_t> ccb1_requested_;
+    std::atomic<uint32_t> ccb1_sent_;
+};
+
+struct Result
+{
+    const char *name;
+    uint32_t calls;
+    uint32_t failures;
+    uint32_t bad_payloads;
+    uint64_t bytes;
+    double seconds;
+    std::vector<double> latency_us;
+};
+
+static void print_header()
+{
+    printf("%-12s %7s %6s %6s %10s %9s %9s %9s %9s %9s\n",
+           "benchmark", "calls", "fail", "bad", "calls/s", "MB/s", "avg us", "p50 us", "p99 us", "max us");
+}
+
+static void print_result(Result &r)
+{
+    std::vector<double> &l = r.latency_us;
+    double avg = 0;
+
+    std::sort(l.begin(), l.end());
+    for (size_t i = 0; i < l.size(); i++)
+        avg += l[i];
+    if (l.size())
+        avg /= l.size();
+
+    printf("%-12s %7u %6u %6u %10.0f %9.2f %9.1f %9.1f %9.1f %9.1f\n",
+           r.name, r.calls, r.failures, r.bad_payloads,
+           r.seconds > 0 ? r.calls / r.seconds : 0.0, r.seconds > 0 ? r.bytes / r.seconds / 1e6 : 0.0, avg,
+           l.size() ? l[l.size() / 2] : 0.0,
+           l.size() ? l[l.size() * 99 / 100] : 0.0,
+           l.size() ? l.back() : 0.0);
+}
+
+static void bench_calls(Result &r, BenchChirp &client, uint32_t iterations)
+{
+    ChirpProc ping = client.getProc("bench_ping");
+    Clock::time_point start = Clock::now();
+    int32_t response;
+
+    r.name = "ping";
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t t = now_us();
+        if (client.callSync(ping, END_OUT_ARGS, &response, END_IN_ARGS) < 0 || response != 0)
+        {
+            r.failures++;
+            continue;
+        }
+        r.latency_us.push_back(now_us() - t);
+        r.calls++;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// look the procedure up by name before every call, the way pixy_command() does
+static void bench_named_calls(Result &r, BenchChirp &client, uint32_t iterations)
+{
+    Clock::time_point start = Clock::now();
+    int32_t response;
+
+    r.name = "named ping";
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t t = now_us();
+        ChirpProc ping = client.getProc("bench_ping");
+        if (ping < 0 || client.callSync(ping, END_OUT_ARGS, &response, END_IN_ARGS) < 0 || response != 0)
+        {
+            r.failures++;
+            continue;
+        }
+        r.latency_us.push_back(now_us() - t);
+        r.calls++;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void bench_frames(Result &r, BenchChirp &client, uint32_t iterations)
+{
+    ChirpProc getFrame = client.getProc("bench_getFrame");
+    Clock::time_point start = Clock::now();
+    void *args[CRP_MAX_ARGS + 1];
+    uint32_t len = FRAME_WIDTH * FRAME_HEIGHT;
+
+    r.name = "frame 64KB";
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t t = now_us();
+        // response, fourcc, renderFlags, width, height, len, pixels
+        if (client.callSyncArray(getFrame, UINT16(FRAME_WIDTH), UINT16(FRAME_HEIGHT), END_OUT_ARGS, args, END_IN_ARGS) < 0 ||
+            *(int32_t *)args[0] != 0)
+        {
+            r.failures++;
+            continue;
+        }
+        r.latency_us.push_back(now_us() - t);
+        r.calls++;
+
+        const uint8_t *pixels = (const uint8_t *)args[6];
+        bool ok = *(uint32_t *)args[5] == len;
+        for (uint32_t j = 0; ok && j < len; j++)
+            ok = pixels[j] == pattern(len, j);
+        if (ok)
+            r.bytes += len;
+        else
+            r.bad_payloads++;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void bench_read_blocks(Result &r, BenchChirp &client, uint32_t iterations)
+{
+    ChirpProc readBlocks = client.getProc("read_blocks");
+    Clock::time_point start = Clock::now();
+    uint32_t bytecnt = BLOCKS_PER_FRAME * SECTOR_SIZE;
+
+    r.name = "read_blocks";
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        int32_t response;
+        uint32_t len;
+        uint8_t *data;
+        uint64_t t = now_us();
+
+        if (client.callSync(readBlocks, UINT32(i), UINT32(BLOCKS_PER_FRAME), END_OUT_ARGS,
+                            &response, &len, &data, END_IN_ARGS) < 0 || response != (int32_t)bytecnt)
+        {
+            r.failures++;
+            continue;
+        }
+        r.latency_us.push_back(now_us() - t);
+        r.calls++;
+
+        bool ok = len == bytecnt;
+        for (uint32_t j = 0; ok && j < len; j++)
+            ok = data[j] == pattern(i, j);
+        if (ok)
+            r.bytes += len;
+        else
+            r.bad_payloads++;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*
+ * The same calls through typed bindings instead of va_list marshalling
+ */
+static void bench_typed_calls(Result &r, BenchChirp &client, uint32_t iterations)
+{
+    ChirpBinding<ChirpIn<>, ChirpOut<int32_t> > ping("bench_ping");
+    Clock::time_point start = Clock::now();
+    int32_t response;
+
+    r.name = "typed ping";
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t t = now_us();
+        if (ping.call(&client, response) < 0 || response != 0)
+        {
+            r.failures++;
+            continue;
+        }
+        r.latency_us.push_back(now_us() - t);
+        r.calls++;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void bench_typed_frames(Result &r, BenchChirp &client, uint32_t iterations)
+{
+    ChirpBinding<ChirpIn<uint16_t, uint16_t>,
+                 ChirpOut<int32_t, ChirpFourcc, ChirpHint<uint8_t>, uint16_t, uint16_t, ChirpArray<uint8_t> > > getFrame("bench_getFrame");
+    Clock::time_point start = Clock::now();
+    uint32_t len = FRAME_WIDTH * FRAME_HEIGHT;
+
+    r.name = "typed frame";
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        int32_t response;
+        ChirpFourcc fourcc;
+        ChirpHint<uint8_t> flags;
+        uint16_t width, height;
+        ChirpArray<uint8_t> pixels;
+        uint64_t t = now_us();
+
+        if (getFrame.call(&client, FRAME_WIDTH, FRAME_HEIGHT, response, fourcc, flags, width, height, pixels) < 0 || response != 0)
+        {
+            r.failures++;
+            continue;
+        }
+        r.latency_us.push_back(now_us() - t);
+        r.calls++;
+
+        bool ok = fourcc.valid && fourcc.value == FOURCC('B','A','8','1') && flags.valid &&
+                  width == FRAME_WIDTH && height == FRAME_HEIGHT && pixels.len == len;
+        for (uint32_t j = 0; ok && j < len; j++)
+            ok = pixels.data[j] == pattern(len, j);
+        if (ok)
+            r.bytes += len;
+        else
+            r.bad_payloads++;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Message lengths swept across the header packet, where the crc-32 trailer moves out of it
+static void bench_echo_sweep(Result &r, BenchChirp &client, uint32_t iterations)
+{
+    ChirpProc echo = client.getProc("bench_echo");
+    Clock::time_point start = Clock::now();
+    uint8_t sent[CRP_MAX_HEADER_LEN * 2];
+
+    r.name = "echo sweep";
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        uint32_t n = i % sizeof(sent);
+        int32_t response;
+        uint32_t len;
+        uint8_t *data;
+        uint64_t t = now_us();
+
+        for (uint32_t j = 0; j < n; j++)
+            sent[j] = pattern(i, j);
+        if (client.callSync(echo, UINTS8(n, sent), END_OUT_ARGS, &response, &len, &data, END_IN_ARGS) < 0 ||
+            response != (int32_t)n)
+        {
+            r.failures++;
+            continue;
+        }
+        r.latency_us.push_back(now_us() - t);
+        r.calls++;
+
+        if (len == n && memcmp(data, sent, n) == 0)
+            r.bytes += 2 * n;
+        else
+            r.bad_payloads++;
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void bench_ccb1(Result &r, BenchChirp &client, BenchServer &server, uint32_t iterations)
+{
+    Clock::time_point start = Clock::now();
+    Clock::time_point last = start;
+    uint32_t received = 0;
+
+    r.name = "CCB1 xdata";
+    client.received = 0;
+    client.corrupt = 0;
+    client.latency_us.clear();
+    server.requestCcb1(iterations);
+
+    // give up if nothing arrives for a second (lost messages are never resent)
+    while (client.received < iterations && Clock::now() - last < std::chrono::seconds(1))
+    {
+        if (client.service() == 0)
+            std::this_thread::yield();
+        if (client.received != received)
+        {
+            received = client.received;
+            last = Clock::now();
+        }
+    }
+    server.requestCcb1(0);
+
+    r.calls = client.received;
+    r.failures = iterations - client.received;
+    r.bad_payloads = client.corrupt;
+    r.bytes = (uint64_t)(client.received - client.corrupt) * CCB1_BLOBS * BLOB_WORDS * sizeof(uint16_t);
+    r.latency_us = client.latency_us;
+    r.seconds = std::chrono::duration<double>(last - start).count();
+}
+
+/*
+ * Checksum throughput over frame-sized buffers: the old byte sum against the CRCs
+ */
+static void bench_checksums(uint32_t iterations)
+{
+    std::vector<uint8_t> frame(FRAME_WIDTH * FRAME_HEIGHT);
+    volatile uint32_t sink = 0;
+
+    for (uint32_t i = 0; i < frame.size(); i++)
+        frame[i] = pattern(0, i);
+
+    printf("%-12s %9s  %s\n", "checksum", "MB/s", "check");
+    for (int c = 0; c < 3; c++)
+    {
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            if (c == 0)
+                sink += Chirp::calcCrc(&frame[0], frame.size());
+            else if (c == 1)
+                sink += Chirp::calcCrc16(&frame[0], frame.size());
+            else
+                sink += Chirp::calcCrc32(&frame[0], frame.size());
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        // standard check values for "123456789"
+        const char *check = "-";
+        if (c == 1)
+            check = Chirp::calcCrc16((const uint8_t *)"123456789", 9) == 0x31c3 ? "ok" : "FAILED";
+        else if (c == 2)
+            check = Chirp::calcCrc32((const uint8_t *)"123456789", 9) == 0xcbf43926 ? "ok" : "FAILED";
+
+        printf("%-12s %9.1f  %s\n", c == 0 ? "byte sum" : c == 1 ? "crc-16" : "crc-32",
+               (double)frame.size() * iterations / seconds / 1e6, check);
+    }
+}
+
+/*
+ * Marshalling cost without the link: Chirp::serialize()/deserialize() walking a va_list
+ * against the typed bindings, for a few argument lists the firmware actually uses.
+ * Both must produce the same bytes.
+ */
+struct MarshalResult
+{
+    const char *name;
+    double va_ns;
+    double typed_ns;
+    bool same;
+};
+
+static void print_marshal(const MarshalResult &m)
+{
+    printf("%-22s %9.1f %9.1f %8.2fx  %s\n", m.name, m.va_ns, m.typed_ns,
+           m.typed_ns > 0 ? m.va_ns / m.typed_ns : 0.0, m.same ? "same" : "DIFFERENT");
+}
+
+static void bench_marshalling(uint32_t iterations)
+{
+    uint8_t va_buf[0x400], typed_buf[0x400];
+    uint16_t blobs[CCB1_BLOBS * BLOB_WORDS];
+    float floats[4] = {1.0f, -2.5f, 3.25f, 0.0f};
+    volatile uint32_t sink = 0;
+    int va_len = 0, typed_len = 0;
+    Clock::time_point start;
+    MarshalResult m;
+
+    for (uint32_t i = 0; i < CCB1_BLOBS * BLOB_WORDS; i++)
+        blobs[i] = i * 131;
+
+    // iterations are per argument list, each one is short so run a lot of them
+    iterations *= 1000;
+    printf("%-22s %9s %9s %9s  %s\n", "marshalling", "va ns", "typed ns", "speedup", "wire");
+
+    // cam_getFrame call
+    typedef ChirpBinding<ChirpIn<uint8_t, uint16_t, uint16_t, uint16_t, uint16_t>, ChirpOut<> > GetFrame;
+    memset(va_buf, 0, sizeof(va_buf));
+    memset(typed_buf, 0, sizeof(typed_buf));
+    m.name = "cam_getFrame call";
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += va_len = Chirp::serialize(NULL, va_buf, sizeof(va_buf), UINT8(i), UINT16(i), UINT16(i+1), UINT16(FRAME_WIDTH), UINT16(FRAME_HEIGHT), END);
+    m.va_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += typed_len = GetFrame::serialize(typed_buf, sizeof(typed_buf), i, i, i+1, FRAME_WIDTH, FRAME_HEIGHT);
+    m.typed_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    m.same = va_len > 0 && va_len == typed_len && memcmp(va_buf, typed_buf, va_len) == 0;
+    print_marshal(m);
+
+    // CCB1 xdata
+    typedef ChirpBinding<ChirpIn<ChirpFourcc, ChirpHint<uint8_t>, ChirpHint<uint16_t>, ChirpHint<uint16_t>, ChirpArray<uint16_t> >,
+                         ChirpOut<ChirpFourcc, ChirpHint<uint8_t>, ChirpHint<uint16_t>, ChirpHint<uint16_t>, ChirpArray<uint16_t> > > Ccb1;
+    memset(va_buf, 0, sizeof(va_buf));
+    memset(typed_buf, 0, sizeof(typed_buf));
+    m.name = "CCB1 xdata";
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += va_len = Chirp::serialize(NULL, va_buf, sizeof(va_buf), HTYPE(FOURCC('C','C','B','1')), HINT8(1),
+                                          HINT16(FRAME_WIDTH), HINT16(FRAME_HEIGHT), UINTS16(CCB1_BLOBS * BLOB_WORDS, blobs), END);
+    m.va_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += typed_len = Ccb1::serialize(typed_buf, sizeof(typed_buf), FOURCC('C','C','B','1'), 1, FRAME_WIDTH, FRAME_HEIGHT,
+                                            ChirpArray<uint16_t>(CCB1_BLOBS * BLOB_WORDS, blobs));
+    m.typed_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    m.same = va_len > 0 && va_len == typed_len && memcmp(va_buf, typed_buf, va_len) == 0;
+    print_marshal(m);
+
+    // CCB1 decode, deserialize() loads the args with loadArgs()
+    {
+        void *args[CRP_MAX_ARGS + 1];
+        uint32_t fourcc, n = 0;
+        uint8_t flags;
+        uint16_t width, height, *data = NULL;
+        ChirpFourcc t_fourcc;
+        ChirpHint<uint8_t> t_flags;
+        ChirpHint<uint16_t> t_width, t_height;
+        ChirpArray<uint16_t> t_blobs;
+        int va_res = 0, typed_res = 0;
+
+        m.name = "CCB1 decode";
+        start = Clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            va_res |= Chirp::deserialize(va_buf, va_len, &fourcc, &flags, &width, &height, &n, &data, END);
+            sink += n;
+        }
+        m.va_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+        start = Clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            typed_res |= Chirp::deserializeParse(typed_buf, typed_len, args);
+            typed_res |= Ccb1::read(args, t_fourcc, t_flags, t_width, t_height, t_blobs);
+            sink += t_blobs.len;
+        }
+        m.typed_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+        m.same = va_res == CRP_RES_OK && typed_res == CRP_RES_OK && t_fourcc.value == fourcc && t_flags.value == flags &&
+                 t_width.value == width && t_height.value == height && t_blobs.len == n &&
+                 memcmp(t_blobs.data, data, n * sizeof(uint16_t)) == 0;
+        print_marshal(m);
+    }
+
+    // mixed scalars, string and float array
+    typedef ChirpBinding<ChirpIn<uint32_t, const char *, ChirpArray<float> >, ChirpOut<> > Mixed;
+    memset(va_buf, 0, sizeof(va_buf));
+    memset(typed_buf, 0, sizeof(typed_buf));
+    m.name = "string and floats";
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += va_len = Chirp::serialize(NULL, va_buf, sizeof(va_buf), UINT32(i), STRING("cam_getFrame"), FLTS32(4, floats), END);
+    m.va_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += typed_len = Mixed::serialize(typed_buf, sizeof(typed_buf), i, "cam_getFrame", ChirpArray<float>(4, floats));
+    m.typed_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    m.same = va_len > 0 && va_len == typed_len && memcmp(va_buf, typed_buf, va_len) == 0;
+    print_marshal(m);
+}
+
+/*
+ * Deserialize fuzzing.  Every buffer must either be rejected or parse into arguments
+ * that lie entirely within the buffer.
+ */
+static bool check_args(const uint8_t *buf, uint32_t len, void *args[])
+{
+    const uint8_t *end = buf + len;
+
+    for (int a = 0; args[a]; a++)
+    {
+        const uint8_t *p = (const uint8_t *)args[a];
+        if (p <= buf || p > end)
+            return false;
+
+        uint8_t type = Chirp::getType(p);
+        uint8_t size = type & 0x0f;
+        if (type == CRP_STRING || type == CRP_HSTRING)
+        {
+            if (memchr(p, '\0', end - p) == NULL)
+                return false;
+        }
+        else if (type & CRP_ARRAY)
+        {
+            const uint8_t *q = (const uint8_t *)args[++a];
+            uint32_t n;
+            if (q == NULL || p + 4 > end || q < p + 4 || q > end)
+                return false;
+            memcpy(&n, p, 4);
+            if ((uint64_t)n * size > (uint64_t)(end - q))
+                return false;
+        }
+        else if (p + size > end)
+            return false;
+    }
+    return true;
+}
+
+static int fuzz(uint32_t iterations, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    uint8_t seedbuf[0x400];
+    uint16_t blobs[CCB1_BLOBS * BLOB_WORDS];
+    float floats[4] = {1.0f, -2.5f, 3.25f, 0.0f};
+    void *args[CRP_MAX_ARGS + 1];
+    uint8_t argList[CRP_MAX_ARGS + 1];
+    uint32_t accepted = 0, rejected = 0, violations = 0;
+
+    for (uint32_t i = 0; i < CCB1_BLOBS * BLOB_WORDS; i++)
+        blobs[i] = random();
+
+    for (uint32_t it = 0; it < iterations; it++)
+    {
+        int len;
+
+        // start from a well-formed buffer or from noise, then mutate
+        switch (it % 4)
+        {
+        case 0:
+            len = Chirp::serialize(NULL, seedbuf, sizeof(seedbuf), HTYPE(FOURCC('C','C','B','1')), HINT8(1),
+                                   HINT16(FRAME_WIDTH), HINT16(FRAME_HEIGHT), UINTS16(random() % (CCB1_BLOBS * BLOB_WORDS), blobs), END);
+            break;
+        case 1:
+            len = Chirp::serialize(NULL, seedbuf, sizeof(seedbuf), UINT8(random()), UINT16(random()), UINT32(random()),
+                                   STRING("cam_getFrame"), FLTS32(4, floats), END);
+            break;
+        case 2:
+            len = Chirp::serialize(NULL, seedbuf, sizeof(seedbuf), UINT32(random()), UINTS8(random() % 64, (uint8_t *)blobs), END);
+            break;
+        default:
+            len = random() % 128;
+            for (int i = 0; i < len; i++)
+                seedbuf[i] = random();
+            break;
+        }
+        if (len < 0)
+            len = 0;
+
+        uint32_t mutations = random() % 4;
+        for (uint32_t m = 0; m < mutations && len > 0; m++)
+        {
+            uint32_t pos = random() % len;
+            switch (random() % 3)
+            {
+            case 0:
+                seedbuf[pos] ^= 1 << (random() % 8);
+                break;
+            case 1:
+                seedbuf[pos] = random();
+                break;
+            default:
+                len = pos;  // truncate
+                break;
+            }
+        }
+
+        // exact-size heap copy so out-of-bounds reads show up under a sanitizer
+        std::vector<uint8_t> data(seedbuf, seedbuf + len);
+        uint8_t *buf = data.empty() ? NULL : &data[0];
+
+        if (Chirp::deserializeParse(buf, len, args) == CRP_RES_OK)
+        {
+            accepted++;
+            if (!check_args(buf, len, args))
+            {
+                violations++;
+                printf("violation in iteration %u, len %d\n", it, len);
+            }
+        }
+        else
+            rejected++;
+        Chirp::getArgList(buf, len, argList);
+    }
+
+    printf("fuzz: %u iterations, %u accepted, %u rejected, %u violations\n", iterations, accepted, rejected, violations);
+    return violations ? -1 : 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-b size] [-l us] [-t us] [-p loss] [-c corruption] [-u] [-i mode] [-n iterations] [-s seed] [-f iterations]\n", progname);
+    printf("  -b  Link block size in bytes (default: 64)\n");
+    printf("  -l  Link latency per block in microseconds (default: 0)\n");
+    printf("  -t  Wire time per block in microseconds, e.g. 53 for 64 byte full-speed USB packets,\n");
+    printf("      9.6 for 512 byte high-speed packets (default: 0, unlimited bandwidth)\n");
+    printf("  -p  Probability that a block is lost (default: 0)\n");
+    printf("  -c  Probability that a block is corrupted (default: 0)\n");
+    printf("  -u  Use a link that is not error corrected (ACK/NACK, crc)\n");
+    printf("  -i  Integrity mode the client asks for, 0=none 1=crc (default: 1)\n");
+    printf("  -n  Number of iterations per benchmark (default: 200)\n");
+    printf("  -s  Random seed (default: 1)\n");
+    printf("  -f  Fuzz Chirp::deserialize for the given number of iterations and exit\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    LoopbackConfig config;
+    uint32_t iterations = 200;
+    uint32_t fuzz_iterations = 0;
+    uint8_t integrity = CRP_INTEGRITY_CRC;
+
+    // Parse command line arguments
+    int arg;
+    while ((arg = getopt(argc, argv, "b:l:t:p:c:ui:n:s:f:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'b':
+                config.block_size = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'l':
+                config.latency_us = strtoul(optarg, NULL, 0);
+                break;
+
+            case 't':
+                config.block_us = strtod(optarg, NULL);
+                break;
+
+            case 'p':
+                config.loss = strtod(optarg, NULL);
+                break;
+
+            case 'c':
+                config.corruption = strtod(optarg, NULL);
+                break;
+
+            case 'u':
+                config.error_corrected = false;
+                break;
+
+            case 'i':
+                integrity = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'n':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+
+            case 's':
+                config.seed = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'f':
+                fuzz_iterations = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    if (fuzz_iterations)
+        return fuzz(fuzz_iterations, config.seed);
+
+    LoopbackLink server_link(config);
+    LoopbackConfig client_config = config;
+    client_config.seed = config.seed + 1;
+    LoopbackLink client_link(client_config);
+    LoopbackLink::connect(&server_link, &client_link);
+
+    BenchChirp *client = new BenchChirp;
+    BenchServer *server = new BenchServer(&server_link, client);
+    client->setIntegrity(integrity);
+    if (client->setLink(&client_link) < 0 || !client->connected())
+    {
+        printf("Failed to connect chirp endpoints\n");
+        return -1;
+    }
+
+    printf("block size %u, latency %u us, wire %g us/block, loss %g, corruption %g, %s, integrity %s\n",
+           config.block_size, config.latency_us, config.block_us, config.loss, config.corruption,
+           config.error_corrected ? "error corrected" : "not error corrected",
+           client->integrity() == CRP_INTEGRITY_CRC ? "crc" : "none");
+    print_header();
+
+    Result results[8] = {};
+    bench_calls(results[0], *client, iterations * 10);
+    bench_typed_calls(results[1], *client, iterations * 10);
+    bench_named_calls(results[2], *client, iterations * 10);
+    bench_ccb1(results[3], *client, *server, iterations * 10);
+    bench_frames(results[4], *client, iterations);
+    bench_typed_frames(results[5], *client, iterations);
+    bench_read_blocks(results[6], *client, iterations);
+    bench_echo_sweep(results[7], *client, iterations * 2);
+    for (int i = 0; i < 8; i++)
+        print_result(results[i]);
+
+    // chirp drops the connection once a send fails after retries, every call after that fails
+    if (!client->connected())
+        printf("client disconnected\n");
+    bench_checksums(iterations);
+    bench_marshalling(iterations);
+
+    const LoopbackStats &s = client_link.stats();
+    const LoopbackStats &t = server_link.stats();
+    printf("link: %" PRIu64 " blocks sent, %" PRIu64 " lost, %" PRIu64 " corrupted\n",
+           s.blocks_sent + t.blocks_sent, s.blocks_lost + t.blocks_lost, s.blocks_corrupted + t.blocks_corrupted);
+
+    // on a clean link every message has to get through intact, whatever its length
+    int res = 0;
+    if (config.loss == 0 && config.corruption == 0 && (results[7].failures || results[7].bad_payloads))
+    {
+        printf("echo sweep failed on a clean link\n");
+        res = -1;
+    }
+
+    // the client disconnects from the server when it's destroyed, so it has to go first
+    delete client;
+    delete server;
+
+    return res;
+}
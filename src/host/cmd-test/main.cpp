@@ -0,0 +1,531 @@
+/**
+ * @file main.cpp
+ * @brief Feeds the firmware's command parser and dispatcher (cmdframe.h) byte streams with
+ *        garbage, cut off and corrupted command frames, the way ser_processInput() drives
+ *        them, and checks every good command comes out once, in order, and nothing else
+ *        does.  Then sends responses through the firmware's FrameQ between block frames and
+ *        checks libpixyblocks gets the frames and the responses apart, and the blocks (and
+ *        their intensities) as they were sent.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "cmdframe.h"
+#include "frameq.h"
+#include "pixyblocks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#define COMMANDS            2000
+#define MAX_ARRIVAL         24      // bytes arriving between two calls to ser_processInput()
+#define QUIET_CALLS         50      // calls without input before a partial frame is given up (SER_FRAME_TIMEOUT)
+#define SLOT_LEN            (BF_COMPACT_FRAME_LEN(PB_MAX_BLOCKS) + BF_LEGACY_FRAME_LEN(PB_MAX_BLOCKS))
+#define FRAMES              500
+
+#define NOISE_GARBAGE       0x01    // random bytes between commands, heavy on sync values
+#define NOISE_PARTIAL       0x02    // the start of a command frame that never finishes
+#define NOISE_CORRUPT       0x04    // command frames with one byte changed
+#define NOISE_LEGACY        0x08    // two byte commands mixed in
+
+typedef struct
+{
+    const char *name;
+    uint8_t noise;
+} Case;
+
+static const Case cases_[] =
+{
+    { "clean", 0 },
+    { "two byte commands", NOISE_LEGACY },
+    { "garbage", NOISE_GARBAGE },
+    { "partial frames", NOISE_PARTIAL },
+    { "corrupt frames", NOISE_CORRUPT },
+    { "everything", NOISE_GARBAGE | NOISE_PARTIAL | NOISE_CORRUPT | NOISE_LEGACY },
+};
+
+typedef struct
+{
+    int type;               // CF_COMMAND or CF_FRAME
+    CmdFrame frame;
+} Command;
+
+static uint32_t seed_ = 1;
+static int verbose_ = 0;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+static uint8_t echo(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    for (uint8_t i = 0; i < len; i++)
+        resp[i] = data[len - 1 - i];
+    *rlen = len;
+    return BF_RESULT_OK;
+}
+
+static uint8_t status(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    for (uint8_t i = 0; i < BF_STATUS_LEN; i++)
+        resp[i] = i;
+    *rlen = BF_STATUS_LEN;
+    return BF_RESULT_OK;
+}
+
+static uint8_t depth(uint8_t cmd, const uint8_t *data, uint8_t len, uint8_t *resp, uint8_t *rlen)
+{
+    uint8_t k = len ? data[0] : cmd - BF_CMD_FRAME_DEPTH_BASE;
+
+    return k >= 1 && k <= BF_MAX_QUEUED_FRAMES ? BF_RESULT_OK : BF_RESULT_VALUE;
+}
+
+// shaped like the program's table in progblobs.cpp
+static const CmdProc cmds_[] =
+{
+    { BF_CMD_GET_STATUS, BF_CMD_GET_STATUS, 0, 0, status },
+    { BF_CMD_SET_MIN_AREA, BF_CMD_SET_MIN_AREA, 2, 2, echo },
+    { BF_CMD_SET_ROI, BF_CMD_SET_ROI, 8, 8, echo },
+    { BF_CMD_SET_FRAME_DEPTH, BF_CMD_SET_FRAME_DEPTH, 1, 1, depth },
+    { 0x40, 0x4f, 0, BF_MAX_CMD_PAYLOAD, echo },
+    { BF_CMD_LEGACY_FRAMES, BF_CMD_COMPACT_FRAMES, 0, 0, echo },
+    { BF_CMD_FRAME_DEPTH(1), BF_CMD_FRAME_DEPTH(BF_MAX_QUEUED_FRAMES), 0, 0, depth },
+    { 0, 0, 0, 0, NULL }
+};
+
+static void random_frame(uint8_t seq, CmdFrame *frame)
+{
+    frame->seq = seq;
+    frame->cmd = 0x40 + rnd(16);
+    frame->len = rnd(BF_MAX_CMD_PAYLOAD + 1);
+    for (uint8_t i = 0; i < frame->len; i++)
+        frame->data[i] = rnd(256);
+}
+
+static void put_frame(std::vector<uint8_t> *stream, const CmdFrame *frame)
+{
+    uint8_t buf[BF_CMD_FRAME_LEN(BF_MAX_CMD_PAYLOAD)];
+    uint32_t len = pixy_blocks_command(frame->seq, frame->cmd, frame->data, frame->len, buf);
+
+    stream->insert(stream->end(), buf, buf + len);
+}
+
+static bool same(const Command *a, int type, const CmdFrame *b)
+{
+    return a->type == type && a->frame.seq == b->seq && a->frame.cmd == b->cmd && a->frame.len == b->len &&
+           memcmp(a->frame.data, b->data, b->len) == 0;
+}
+
+// Builds a stream of COMMANDS good commands with the case's noise in between.
+static void make_stream(uint8_t noise, std::vector<uint8_t> *stream, std::vector<Command> *expected)
+{
+    uint8_t buf[BF_CMD_FRAME_LEN(BF_MAX_CMD_PAYLOAD)];
+    Command command;
+    CmdFrame bad;
+    uint32_t i, n, len;
+
+    for (i = 0; i < COMMANDS; i++)
+    {
+        if ((noise & NOISE_GARBAGE) && rnd(2))
+        {
+            for (n = rnd(20); n; n--)
+            {
+                switch (rnd(8))
+                {
+                case 0:
+                    stream->push_back(CF_SYNC_BYTE);
+                    break;
+                case 1:
+                    stream->push_back(BF_CMD_FRAME_SYNC);
+                    break;
+                default:
+                    stream->push_back(rnd(256));
+                    break;
+                }
+            }
+        }
+        if ((noise & NOISE_PARTIAL) && rnd(3) == 0)
+        {
+            random_frame(rnd(256), &bad);
+            len = pixy_blocks_command(bad.seq, bad.cmd, bad.data, bad.len, buf);
+            stream->insert(stream->end(), buf, buf + 1 + rnd(len - 2));  // at least the CRC missing
+        }
+        if ((noise & NOISE_CORRUPT) && rnd(4) == 0)
+        {
+            random_frame(rnd(256), &bad);
+            len = pixy_blocks_command(bad.seq, bad.cmd, bad.data, bad.len, buf);
+            n = 1 + rnd(len - 1);  // anything but the sync
+            buf[n] ^= 1 + rnd(255);
+            stream->insert(stream->end(), buf, buf + len);
+        }
+        if ((noise & NOISE_LEGACY) && rnd(2))
+        {
+            command.type = CF_COMMAND;
+            command.frame.seq = 0;
+            command.frame.cmd = rnd(2) ? BF_CMD_COMPACT_FRAMES : BF_CMD_FRAME_DEPTH(1 + rnd(BF_MAX_QUEUED_FRAMES));
+            command.frame.len = 0;
+            stream->push_back(CF_SYNC_BYTE);
+            stream->push_back(command.frame.cmd);
+            expected->push_back(command);
+        }
+        command.type = CF_FRAME;
+        random_frame(i, &command.frame);
+        put_frame(stream, &command.frame);
+        expected->push_back(command);
+    }
+    // and one that never finishes
+    if (noise & NOISE_PARTIAL)
+        stream->insert(stream->end(), { BF_CMD_FRAME_SYNC, 0x12, 0x40, 0x10, 0x01 });
+}
+
+typedef struct
+{
+    uint32_t calls;
+    uint32_t received;
+    uint32_t missed;        // good commands that never came out
+    uint32_t spurious;      // commands made up from noise
+    uint32_t spuriousFrames; // of those, command frames
+    uint32_t max_skipped;   // most bytes one call threw away
+    uint32_t errors;
+    uint32_t garbage;
+    bool drained;
+} Result;
+
+// Runs the stream through a CmdParser the way ser_processInput() does: take what has
+// arrived while there's room, take out at most one command, give up a partial frame after
+// QUIET_CALLS calls without input.
+static void run(const std::vector<uint8_t> &stream, const std::vector<Command> &expected, Result *res)
+{
+    CmdParser parser;
+    CmdFrame frame;
+    uint8_t result, rlen, resp[BF_MAX_CMD_PAYLOAD], buf[BF_RESPONSE_FRAME_LEN(BF_MAX_CMD_PAYLOAD)];
+    uint32_t pos = 0, arrived = 0, quiet = 0, next = 0, skipped, k;
+    int type;
+
+    memset(res, 0, sizeof(*res));
+    while (pos < stream.size() || parser.partial())
+    {
+        if (++res->calls > 100 * stream.size())
+            break;
+        arrived += rnd(MAX_ARRIVAL + 1);
+        if (arrived > stream.size())
+            arrived = stream.size();
+        if (pos < arrived && parser.space())
+            quiet = 0;
+        else
+            quiet++;
+        while (pos < arrived && parser.space())
+            parser.put(stream[pos++]);
+
+        skipped = parser.garbage() + parser.errors();
+        type = parser.next(&frame);
+        skipped = parser.garbage() + parser.errors() - skipped;
+        if (skipped > res->max_skipped)
+            res->max_skipped = skipped;
+
+        if (type == CF_NONE)
+        {
+            if (parser.partial() && quiet > QUIET_CALLS)
+                parser.expire();
+            continue;
+        }
+
+        res->received++;
+        if (type == CF_FRAME)
+        {
+            result = cmd_dispatch(cmds_, &frame, resp, &rlen);
+            cmd_encodeResponse(buf, &frame, result, resp, rlen);
+        }
+        for (k = next; k < expected.size() && !same(&expected[k], type, &frame); k++);
+        if (k < expected.size() && (type == CF_FRAME || k == next))
+        {
+            res->missed += k - next;
+            next = k + 1;
+        }
+        else
+        {
+            res->spurious++;
+            if (type == CF_FRAME)
+                res->spuriousFrames++;
+            if (verbose_)
+                printf("    spurious %s seq %u cmd 0x%02x len %u\n", type == CF_FRAME ? "frame" : "command", frame.seq, frame.cmd, frame.len);
+        }
+    }
+    res->missed += expected.size() - next;
+    res->errors = parser.errors();
+    res->garbage = parser.garbage();
+    res->drained = !parser.partial();
+}
+
+static int test_dispatch()
+{
+    static const struct
+    {
+        uint8_t cmd;
+        uint8_t len;
+        uint8_t data;
+        uint8_t result;
+        uint8_t rlen;
+    } checks[] =
+    {
+        { BF_CMD_GET_STATUS, 0, 0, BF_RESULT_OK, BF_STATUS_LEN },
+        { BF_CMD_GET_STATUS, 1, 0, BF_RESULT_LENGTH, 0 },
+        { BF_CMD_SET_MIN_AREA, 2, 7, BF_RESULT_OK, 2 },
+        { BF_CMD_SET_MIN_AREA, 3, 7, BF_RESULT_LENGTH, 0 },
+        { BF_CMD_SET_ROI, 7, 0, BF_RESULT_LENGTH, 0 },
+        { BF_CMD_SET_FRAME_DEPTH, 1, 2, BF_RESULT_OK, 0 },
+        { BF_CMD_SET_FRAME_DEPTH, 1, BF_MAX_QUEUED_FRAMES + 1, BF_RESULT_VALUE, 0 },
+        { BF_CMD_FRAME_DEPTH(BF_MAX_QUEUED_FRAMES), 0, 0, BF_RESULT_OK, 0 },
+        { BF_CMD_FRAME_DEPTH(BF_MAX_QUEUED_FRAMES + 1), 0, 0, BF_RESULT_UNKNOWN, 0 },
+        { 0x4f, BF_MAX_CMD_PAYLOAD, 1, BF_RESULT_OK, BF_MAX_CMD_PAYLOAD },
+        { 0x50, 0, 0, BF_RESULT_UNKNOWN, 0 },
+    };
+    CmdFrame frame;
+    uint8_t result, rlen, resp[BF_MAX_CMD_PAYLOAD];
+    int failures = 0;
+
+    printf("dispatch\n");
+    for (uint32_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        frame.seq = i;
+        frame.cmd = checks[i].cmd;
+        frame.len = checks[i].len;
+        memset(frame.data, checks[i].data, sizeof(frame.data));
+        result = cmd_dispatch(cmds_, &frame, resp, &rlen);
+        if (result != checks[i].result || rlen != checks[i].rlen)
+        {
+            printf("  cmd 0x%02x len %u: result %u rlen %u, expected %u %u  FAILED\n", frame.cmd, frame.len, result, rlen,
+                   checks[i].result, checks[i].rlen);
+            failures++;
+        }
+    }
+    printf("  %u checks, %s\n", (unsigned)(sizeof(checks) / sizeof(checks[0])), failures ? "FAILED" : "ok");
+    return failures;
+}
+
+static int test_streams()
+{
+    std::vector<uint8_t> stream;
+    std::vector<Command> expected;
+    Result res;
+    int failures = 0;
+    bool failed;
+
+    printf("\nparser, %d good commands per stream, up to %d bytes per call\n", COMMANDS, MAX_ARRIVAL);
+    printf("  %-18s %7s %7s %8s %7s %8s %7s %7s %8s\n", "stream", "bytes", "calls", "received", "missed", "spurious",
+           "errors", "garbage", "max skip");
+    for (uint32_t c = 0; c < sizeof(cases_) / sizeof(cases_[0]); c++)
+    {
+        stream.clear();
+        expected.clear();
+        make_stream(cases_[c].noise, &stream, &expected);
+        run(stream, expected, &res);
+
+        // Random bytes can make up a two byte command (the sync and any byte).  A made up
+        // command frame needs its CRC to match by chance, about once in 65536 rejected frames,
+        // and it can swallow the good frame behind it.  Nothing may take more than the parser
+        // holds at once.
+        failed = res.missed > res.spuriousFrames || !res.drained || res.max_skipped > CF_BUF_LEN ||
+                 res.spuriousFrames > 1 + res.errors / 4096 ||
+                 (!(cases_[c].noise & (NOISE_GARBAGE | NOISE_PARTIAL | NOISE_CORRUPT)) && res.spurious);
+        printf("  %-18s %7u %7u %8u %7u %8u %7u %7u %8u%s\n", cases_[c].name, (unsigned)stream.size(), res.calls,
+               res.received, res.missed, res.spurious, res.errors, res.garbage, res.max_skipped,
+               failed ? "  FAILED" : "");
+        if (failed)
+            failures++;
+    }
+    return failures;
+}
+
+static void read_out(FrameQ *frameq, PixyBlockDecoder *dec, uint32_t max, uint32_t *frames, std::vector<PixyResponse> *responses)
+{
+    uint8_t buf[64];
+    PixyResponse resp;
+    uint32_t n, len, i;
+
+    for (n = 0; n < max; n += len)
+    {
+        len = frameq->read(buf, 2 + 2 * rnd(sizeof(buf) / 2));
+        if (len == 0)
+            break;
+        for (i = 0; i < len; i++)
+        {
+            *frames += pixy_blocks_push(dec, buf[i]);
+            if (pixy_blocks_response(dec, &resp))
+                responses->push_back(resp);
+        }
+    }
+}
+
+static bool same_blocks(const PixyBlockDecoder *dec, uint8_t format, const PixyBlock *blocks,
+    const PixyIntensity *intensities, uint32_t count)
+{
+    uint32_t i;
+
+    if (dec->format != format || dec->count != count)
+        return false;
+    for (i = 0; i < count; i++)
+    {
+        if (memcmp(&dec->blocks[i], &blocks[i], sizeof(PixyBlock)) != 0)
+            return false;
+        if (format == BF_FORMAT_INTENSITY && (dec->intensities[i].peak != intensities[i].peak ||
+            dec->intensities[i].mean != intensities[i].mean || dec->intensities[i].flags != intensities[i].flags))
+            return false;
+    }
+    return true;
+}
+
+// Commands go in through the parser, their responses out through the FrameQ between block
+// frames, with reads of random sizes, some starting before the response is queued.
+static int test_responses()
+{
+    static const uint8_t formats[] = {BF_FORMAT_LEGACY, BF_FORMAT_COMPACT, BF_FORMAT_INTENSITY};
+    static const char *names[] = {"legacy", "compact", "", "", "", "intensity"};
+    FrameQ frameq(SLOT_LEN);
+    PixyBlockDecoder dec;
+    PixyBlock blocks[8];
+    PixyIntensity intensities[8];
+    CmdParser parser;
+    CmdFrame frame, sent[2];
+    std::vector<CmdFrame> commands;
+    std::vector<PixyResponse> responses;
+    uint8_t cmdbuf[BF_CMD_FRAME_LEN(BF_MAX_CMD_PAYLOAD)], resp[BF_MAX_CMD_PAYLOAD], rlen, result;
+    uint8_t buf[BF_RESPONSE_FRAME_LEN(BF_MAX_CMD_PAYLOAD)], *slot;
+    uint32_t frames, len, i, n, k, count, bad, wrong;
+    int failures = 0;
+    uint8_t seq = 0, format, f;
+
+    printf("\nresponses between block frames, %d frames\n", FRAMES);
+    for (f = 0; f < sizeof(formats); f++)
+    {
+        format = formats[f];
+        pixy_blocks_init(&dec);
+        commands.clear();
+        responses.clear();
+        frames = wrong = 0;
+        for (i = 0; i < FRAMES; i++)
+        {
+            count = 1 + rnd(8);
+            for (k = 0; k < count; k++)
+            {
+                blocks[k].signature = 1 + rnd(7);
+                blocks[k].x = rnd(320);
+                blocks[k].y = rnd(200);
+                blocks[k].width = 1 + rnd(100);
+                blocks[k].height = 1 + rnd(100);
+                // not measured, or a mean under the peak, saturated at full scale
+                intensities[k].peak = rnd(4) ? 1 + rnd(BF_SATURATED_LEVEL) : 0;
+                intensities[k].mean = intensities[k].peak ? 1 + rnd(intensities[k].peak) : 0;
+                intensities[k].flags = intensities[k].peak == BF_SATURATED_LEVEL ? BF_INTENSITY_SATURATED : 0;
+            }
+            slot = frameq.writeBuf();
+            if (format == BF_FORMAT_INTENSITY)
+                len = pixy_blocks_encode_intensity(i, i * 20000, blocks, intensities, count, slot);
+            else if (format == BF_FORMAT_COMPACT)
+                len = pixy_blocks_encode_compact(i, i * 20000, blocks, count, slot);
+            else
+                len = pixy_blocks_encode_legacy(blocks, count, slot);
+            frameq.publish(len);
+
+            // the master may be partway through the frame when the commands are handled
+            read_out(&frameq, &dec, rnd(3) * 16, &frames, &responses);
+
+            for (k = rnd(3); k; k--)
+            {
+                if (rnd(3) == 0)
+                {
+                    sent[0].cmd = BF_CMD_GET_STATUS;
+                    sent[0].len = 0;
+                }
+                else
+                    random_frame(0, &sent[0]);
+                sent[0].seq = seq++;
+                len = pixy_blocks_command(sent[0].seq, sent[0].cmd, sent[0].data, sent[0].len, cmdbuf);
+                for (n = 0; n < len; n++)
+                    parser.put(cmdbuf[n]);
+                if (parser.next(&frame) != CF_FRAME)
+                {
+                    failures++;
+                    continue;
+                }
+                result = cmd_dispatch(cmds_, &frame, resp, &rlen);
+                if (!frameq.publishMessage(buf, cmd_encodeResponse(buf, &frame, result, resp, rlen)))
+                    failures++;
+                commands.push_back(frame);
+            }
+            read_out(&frameq, &dec, 0xffffffff, &frames, &responses);
+            frames += pixy_blocks_idle(&dec);
+            if (!same_blocks(&dec, format, blocks, intensities, count))
+                wrong++;
+        }
+
+        for (i = 0, bad = 0; i < commands.size() && i < responses.size(); i++)
+        {
+            if (responses[i].seq != commands[i].seq || responses[i].cmd != commands[i].cmd ||
+                responses[i].result != BF_RESULT_OK)
+                bad++;
+            else if (commands[i].cmd != BF_CMD_GET_STATUS &&
+                     (responses[i].len != commands[i].len ||
+                      (commands[i].len && responses[i].data[0] != commands[i].data[commands[i].len - 1])))
+                bad++;
+        }
+        bad += commands.size() > responses.size() ? commands.size() - responses.size() : responses.size() - commands.size();
+        printf("  %-9s frames %u/%u  wrong %u  responses %u/%u  crc errors %u  sync errors %u%s\n",
+               names[format], frames, FRAMES, wrong, (unsigned)responses.size(), (unsigned)commands.size(),
+               dec.stats.crc_errors, dec.stats.sync_errors, bad || wrong || frames != FRAMES || dec.stats.crc_errors ? "  FAILED" : "");
+        if (bad || wrong || frames != FRAMES || dec.stats.crc_errors)
+            failures++;
+    }
+
+    // a master that doesn't read doesn't make the camera block, responses beyond the slots are dropped
+    for (i = 0; i < FQ_MSG_SLOTS; i++)
+        frameq.publishMessage(buf, 8);
+    printf("  message slots full: %u dropped%s\n", frameq.messagesDropped(), frameq.messagesDropped() == 1 ? "" : "  FAILED");
+    if (frameq.messagesDropped() != 1)
+        failures++;
+
+    return failures;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-s seed] [-v]\n", progname);
+    printf("  -s  Seed for the generated streams (default: 1)\n");
+    printf("  -v  Print the commands noise made up\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "s:vh")) != EOF)
+    {
+        switch (arg)
+        {
+            case 's':
+                seed_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'v':
+                verbose_ = 1;
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    failures += test_dispatch();
+    failures += test_streams();
+    failures += test_responses();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
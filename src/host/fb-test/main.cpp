@@ -0,0 +1,426 @@
+/**
+ * @file main.cpp
+ * @brief Tests the frame buffer manager (common/inc/framebuf.h): every slot state
+ *        transition and the owner checks, then the M0 filling slots, the M4 writing them
+ *        to the SD card and USB taking all of the frame memory, interleaved at random one
+ *        store at a time, checking that no one writes a slot it doesn't own, no logged
+ *        frame is overwritten while it's written and no slot is lost.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "framebuf.h"
+
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// the M0's side, device/libpixy_m0/src/framebuf.c
+extern "C"
+{
+uint8_t fb_beginFill(void);
+uint8_t *fb_frame(uint8_t slot);
+void fb_endFill(uint8_t slot);
+void fb_abortFill(uint8_t slot);
+void fb_disarm(void);
+extern struct FrameBufFields *g_fb;
+extern uint8_t *g_fbMem;
+}
+
+#define STEPS           2000000
+#define LINES           20          // stores per frame, each a chunk of the frame
+#define LINE_SIZE       (FB_FRAME_SIZE / LINES)
+#define LOG_DIVIDER     3           // every third frame logged
+#define ABORT_ODDS      400         // one line in, the M0 aborts the frame
+#define STOP_ODDS       20000       // one step in, the program stops for a USB frame
+#define USB_BYTE        0xee
+
+static uint32_t random_ = 1;
+static bool verbose_ = false;
+
+static uint32_t rnd()
+{
+    random_ = random_ * 1103515245 + 12345;
+    return random_ >> 8;
+}
+
+static int check(bool ok, const char *what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+static void connect(FrameBuf *fb)
+{
+    // the M0's pointers at the M4's memory, as MEM_FB_LOC and MEM_FRAMES_LOC on the device
+    g_fb = (struct FrameBufFields *)fb->fields();
+    g_fbMem = fb->slot(0);
+}
+
+static bool all_in(FrameBuf *fb, uint8_t state)
+{
+    uint8_t i;
+
+    for (i = 0; i < FB_SLOTS; i++)
+    {
+        if (fb->state(i) != state)
+            return false;
+    }
+    return true;
+}
+
+static int test_transitions()
+{
+    FrameBuf fb;
+    uint8_t slot, i;
+    uint8_t *mem;
+    uint32_t size = 0;
+    int failures = 0;
+
+    printf("transitions, %u slots:\n", FB_SLOTS);
+    connect(&fb);
+
+    failures += check(all_in(&fb, FB_FREE), "all free at start");
+    failures += check(fb_beginFill() == FB_NO_SLOT && fb.fields()->missed == 1,
+                      "nothing armed, the frame is missed");
+    failures += check(fb.arm() == FB_SLOTS && all_in(&fb, FB_ARMED), "arm lends all free slots");
+
+    slot = fb_beginFill();
+    failures += check(slot == 0 && fb.state(0) == FB_FILLING, "ARMED -> FILLING");
+    failures += check(fb_frame(slot) == fb.slot(slot) + FB_HEADER_SIZE,
+                      "the M0 fills behind the header");
+    failures += check(!fb.claim(0, FB_SD_WRITING), "a filling slot can't be claimed");
+    fb.release(0, FB_FILLING);
+    fb.releaseAll(FB_ARMED);
+    failures += check(fb.state(0) == FB_FILLING && fb.state(1) == FB_ARMED,
+                      "the M4 can't release the M0's slots");
+    failures += check(fb.acquireAll(FB_USB_SENDING, &size) == NULL, "no USB while the M0 has slots");
+
+    fb_endFill(slot);
+    failures += check(fb.state(0) == FB_READY && fb.fields()->filled == 1, "FILLING -> READY");
+    failures += check(fb.claim(0, FB_SD_WRITING) && fb.state(0) == FB_SD_WRITING,
+                      "READY -> SD_WRITING");
+    failures += check(!fb.claim(0, FB_SD_WRITING), "claimed once");
+    failures += check(fb.arm() == FB_SLOTS - 1 && fb.state(0) == FB_SD_WRITING,
+                      "arm leaves the slot being written");
+
+    slot = fb_beginFill();
+    failures += check(slot == 1, "the M0 fills another while the M4 writes");
+    fb_abortFill(slot);
+    failures += check(fb.state(1) == FB_ARMED && fb.fields()->aborted == 1, "FILLING -> ARMED, aborted");
+
+    fb.release(0, FB_USB_SENDING);
+    failures += check(fb.state(0) == FB_SD_WRITING, "release by another owner does nothing");
+    fb.release(0, FB_SD_WRITING);
+    failures += check(fb.state(0) == FB_FREE, "SD_WRITING -> FREE");
+    failures += check(fb.acquireAll(FB_USB_SENDING, &size) == NULL, "no USB while slots are armed");
+
+    slot = fb_beginFill();
+    fb_disarm();
+    failures += check(fb.state(slot) == FB_FILLING, "disarm leaves the frame under way");
+    for (i = 0; i < FB_SLOTS; i++)
+    {
+        if (i != slot && fb.state(i) != FB_FREE)
+            break;
+    }
+    failures += check(i == FB_SLOTS, "ARMED -> FREE when stopped");
+    fb_endFill(slot);
+
+    mem = fb.acquireAll(FB_USB_SENDING, &size);
+    failures += check(mem == fb.slot(0) && size == FB_MEM_SIZE && all_in(&fb, FB_USB_SENDING),
+                      "FREE/READY -> USB_SENDING, all of the memory");
+    failures += check(fb.acquireAll(FB_USB_SENDING, &size) == mem, "USB again, the last reply is out");
+    failures += check(fb.arm() == FB_SLOTS && all_in(&fb, FB_ARMED), "USB_SENDING -> ARMED");
+
+    slot = fb_beginFill();
+    fb_endFill(slot);
+    fb.releaseAll(FB_READY);
+    failures += check(fb.state(slot) == FB_FREE && fb.state(slot + 1) == FB_ARMED,
+                      "READY -> FREE, dropped unwritten");
+
+    failures += check(!fb.claim(FB_SLOTS, FB_SD_WRITING) && fb.slot(FB_SLOTS) == NULL &&
+                      fb.state(FB_NO_SLOT) == FB_FREE, "out of range slots refused");
+    return failures;
+}
+
+// The blob program's use of the slots, as in progblobs.cpp, and the M0's, as in
+// rls_m0.c, each step being one store the core makes, interleaved at random.
+struct FrameEnd
+{
+    uint8_t slot;
+    uint8_t frame;
+};
+
+struct Model
+{
+    FrameBuf *fb;
+    std::deque<FrameEnd> queue;     // frame ends the M0 queued
+
+    // M0
+    bool running;
+    bool inFrame;
+    uint32_t frames;
+    uint8_t frame;
+    uint8_t fillSlot;
+    uint32_t line;
+
+    // M4
+    uint8_t logSlot;
+    uint8_t logFrame;
+    uint32_t logChunk;
+    uint32_t logChunks;
+
+    uint32_t queued, logged, usb, stops, fillsWhileLogging;
+    uint32_t bad;
+};
+
+static void fail(Model *m, const char *what, uint8_t slot)
+{
+    if (verbose_ && m->bad < 10)
+        printf("  slot %u (%u): %s\n", slot, slot < FB_SLOTS ? m->fb->state(slot) : 0, what);
+    m->bad++;
+}
+
+static bool intact(const uint8_t *data, uint32_t len, uint8_t value)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (data[i] != value)
+            return false;
+    }
+    return true;
+}
+
+static void m0_step(Model *m)
+{
+    uint8_t *dst;
+
+    if (!m->running)
+        return;
+    if (!m->inFrame)
+    {
+        m->inFrame = true;
+        m->frame = m->frames++;
+        m->line = 0;
+        m->fillSlot = m->frames % LOG_DIVIDER == 0 ? fb_beginFill() : FB_NO_SLOT;
+        if (m->fillSlot != FB_NO_SLOT && m->logSlot != FB_NO_SLOT)
+            m->fillsWhileLogging++;
+        return;
+    }
+    if (m->fillSlot != FB_NO_SLOT)
+    {
+        if (m->fb->state(m->fillSlot) != FB_FILLING)
+            fail(m, "the M0 writes a slot it doesn't have", m->fillSlot);
+        if (rnd() % ABORT_ODDS == 0)
+        {
+            fb_abortFill(m->fillSlot);
+            m->inFrame = false;
+            return;
+        }
+        dst = fb_frame(m->fillSlot) + m->line * LINE_SIZE;
+        memset(dst, m->frame, LINE_SIZE);
+    }
+    if (++m->line < LINES)
+        return;
+    if (m->fillSlot != FB_NO_SLOT)
+    {
+        fb_endFill(m->fillSlot);
+        m->queue.push_back({ m->fillSlot, m->frame });
+        m->queued++;
+    }
+    m->inFrame = false;
+}
+
+static void recycle(Model *m)
+{
+    m->fb->releaseAll(FB_READY);
+    m->fb->arm();
+}
+
+static void m4_step(Model *m)
+{
+    FrameEnd end;
+    uint8_t *frame;
+    uint32_t line;
+
+    if (m->logSlot != FB_NO_SLOT && (m->queue.empty() || rnd() % 2))
+    {
+        // the SD card task, a chunk at a time
+        frame = m->fb->slot(m->logSlot) + FB_HEADER_SIZE;
+        line = m->logChunk * LINES / m->logChunks;
+        if (m->fb->state(m->logSlot) != FB_SD_WRITING ||
+            !intact(frame + line * LINE_SIZE, LINE_SIZE, m->logFrame))
+            fail(m, "the frame changed while it was written", m->logSlot);
+        if (++m->logChunk < m->logChunks)
+            return;
+        if (!intact(frame, FB_FRAME_SIZE, m->logFrame))
+            fail(m, "the frame changed while it was written", m->logSlot);
+        m->fb->release(m->logSlot, FB_SD_WRITING);
+        m->fb->arm();
+        m->logSlot = FB_NO_SLOT;
+        m->logged++;
+        return;
+    }
+    if (m->queue.empty())
+        return;
+
+    // the frame task
+    end = m->queue.front();
+    m->queue.pop_front();
+    if (m->fb->state(end.slot) != FB_READY)
+        fail(m, "a queued frame's slot isn't ready", end.slot);
+    if (m->logSlot == FB_NO_SLOT && m->fb->claim(end.slot, FB_SD_WRITING))
+    {
+        m->logSlot = end.slot;
+        m->logFrame = end.frame;
+        m->logChunk = 0;
+        // sometimes longer than the M0 takes for a logged frame
+        m->logChunks = 1 + rnd() % (3 * LINES * LOG_DIVIDER);
+    }
+    recycle(m);
+}
+
+static void stop_and_send(Model *m)
+{
+    uint8_t *mem;
+    uint32_t size = 0;
+
+    // exec_stopM0(): the M0 aborts the frame under way and gives back what's armed
+    if (m->inFrame && m->fillSlot != FB_NO_SLOT)
+        fb_abortFill(m->fillSlot);
+    fb_disarm();
+    m->inFrame = false;
+    m->running = false;
+    m->queue.clear();
+    m->stops++;
+
+    // cam_frameMemory(): the SD write is abandoned, then USB has it all
+    m->fb->releaseAll(FB_SD_WRITING);
+    m->logSlot = FB_NO_SLOT;
+    mem = m->fb->acquireAll(FB_USB_SENDING, &size);
+    if (mem == NULL || size != FB_MEM_SIZE)
+    {
+        fail(m, "USB can't have the memory once stopped", FB_NO_SLOT);
+        m->fb->releaseAll(FB_READY);    // carry on regardless
+    }
+    else
+    {
+        memset(mem, USB_BYTE, size);
+        m->usb++;
+    }
+
+    // the program runs again, blobsSetup()
+    recycle(m);
+    m->running = true;
+}
+
+static int check_states(Model *m)
+{
+    uint8_t i, state, filling = 0, writing = 0;
+    int bad = 0;
+
+    for (i = 0; i < FB_SLOTS; i++)
+    {
+        state = m->fb->state(i);
+        if (state == FB_FILLING)
+        {
+            filling++;
+            if (!m->inFrame || m->fillSlot != i)
+                bad++;
+        }
+        else if (state == FB_SD_WRITING)
+        {
+            writing++;
+            if (m->logSlot != i)
+                bad++;
+        }
+        else if (state == FB_USB_SENDING || state > FB_USB_SENDING)
+            bad++;
+    }
+    return bad + (filling > 1) + (writing > 1);
+}
+
+static int test_owners()
+{
+    FrameBuf fb;
+    Model m;
+    uint32_t i, r, badStates = 0;
+    int failures = 0;
+
+    printf("M0, M4 and USB interleaved, %u steps:\n", STEPS);
+    connect(&fb);
+    m.fb = &fb;
+    m.running = true;
+    m.inFrame = false;
+    m.frames = m.line = 0;
+    m.frame = 0;
+    m.fillSlot = m.logSlot = FB_NO_SLOT;
+    m.logFrame = 0;
+    m.logChunk = m.logChunks = 0;
+    m.queued = m.logged = m.usb = m.stops = m.fillsWhileLogging = m.bad = 0;
+    recycle(&m);
+
+    for (i = 0; i < STEPS; i++)
+    {
+        r = rnd();
+        if (r % STOP_ODDS == 0)
+            stop_and_send(&m);
+        else if (r % 3)
+            m0_step(&m);
+        else
+            m4_step(&m);
+        if (check_states(&m))
+        {
+            fail(&m, "a slot is held by someone who doesn't know it", FB_NO_SLOT);
+            badStates++;
+        }
+    }
+    stop_and_send(&m);
+
+    printf("  %u frames, %u filled, %u logged, %u missed, %u aborted, %u USB frames\n",
+           m.frames, fb.fields()->filled, m.logged, fb.fields()->missed, fb.fields()->aborted, m.usb);
+    printf("  %u fills while a log was written\n", m.fillsWhileLogging);
+    failures += check(m.bad == 0 && badStates == 0, "every store by the slot's owner");
+    failures += check(fb.fields()->filled == m.queued, "every filled slot queued");
+    failures += check(m.logged > 0 && m.usb == m.stops && m.stops > 1, "logs written, USB served");
+    failures += check(fb.fields()->aborted > 0, "aborts exercised");
+    failures += check(FB_SLOTS < 2 || m.fillsWhileLogging > 0, "the M0 fills while the M4 writes");
+    failures += check(all_in(&fb, FB_ARMED), "no slot lost");
+    return failures;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-v]\n", progname);
+    printf("  -v  Print the first bad stores\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "vh")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = true;
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    failures += test_transitions();
+    failures += test_owners();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
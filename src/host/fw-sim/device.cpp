@@ -0,0 +1,368 @@
+/**
+ * @file device.cpp
+ * @brief What the blob program calls on the camera that isn't built here: the clock,
+ *        parameters, LED and camera, the serial interfaces but I2C, the M0's controls and
+ *        the chip library under the SD card driver.  Time goes to the simulation
+ *        (sim.cpp), the SD card is a file.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "sim.h"
+#include "pixy_init.h"
+#include "misc.h"
+#include "exec.h"
+#include "m0ctrl.h"
+#include "param.h"
+#include "led.h"
+#include "camera.h"
+#include "sdmmc.h"
+#include "framebuf.h"
+#include "calib.h"
+#include "uart.h"
+#include "spi.h"
+#include "lpc43xx_sdmmc.h"
+#include "lpc43xx_scu.h"
+#include "lpc43xx_cgu.h"
+#include "lpc43xx_i2c.h"
+
+#include <map>
+#include <stdarg.h>
+#include <string>
+#include <string.h>
+
+#define SD_BLOCK_SIZE       512
+#define SD_BLOCKS           (64ull*1024*1024*1024/SD_BLOCK_SIZE)  // a 64 GB card
+#define SD_COMMAND_US       300     // per write command, programming included
+#define SD_BLOCK_US         160     // per block at 25 MHz, 4 bits
+
+uint8_t g_debug = 0;
+Chirp *g_chirpUsb;
+FrameBuf *g_frameBuf;
+Uart *g_uart0;
+Spi *g_spi;
+
+LPC_I2Cn_Type g_simI2c0;
+LPC_SDMMC_Type g_simSdmmc;
+LPC_SGPIO_Type g_simSgpio;
+LPC_GPIO_PORT_Type g_simGpioPort;
+
+struct Param
+{
+    uint8_t type;
+    uint32_t value;
+};
+
+static std::map<std::string, Param> params_;
+static std::map<std::string, uint32_t> settings_;
+
+void cprintf(const char *format, ...)
+{
+    va_list args;
+
+    if (!sim_verbose())
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void lpc_printf(const char *format, ...)
+{
+    va_list args;
+
+    if (!sim_verbose())
+        return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void setTimer(uint32_t *timer)
+{
+    sim_sync();
+    *timer = (uint32_t)sim_now();
+}
+
+uint32_t getTimer(uint32_t timer)
+{
+    sim_sync();
+    return (uint32_t)sim_now() - timer;
+}
+
+void delayms(uint32_t ms)
+{
+    sim_charge(ms*1000.0);
+}
+
+// as device/libpixy_m4/src/misc.cpp (poly 0x07, init 0)
+uint8_t crc8(const void* const data, uint8_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t crc = 0;
+    int bit;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+// Parameters are kept as their type and value, the flash store's serialization is
+// param-test's business.
+int prm_add(const char *id, uint32_t flags, const char *desc, ...)
+{
+    va_list args;
+    Param param;
+
+    va_start(args, desc);
+    param.type = va_arg(args, int);
+    param.value = va_arg(args, uint32_t);
+    va_end(args);
+    if (settings_.count(id))
+        param.value = settings_[id];
+    params_[id] = param;
+    return 0;
+}
+
+void sim_setParam(const char *id, uint32_t value)
+{
+    settings_[id] = value;
+    if (params_.count(id))
+        params_[id].value = value;
+}
+
+int32_t prm_get(const char *id, ...)
+{
+    std::map<std::string, Param>::const_iterator i = params_.find(id);
+    va_list args;
+    void *value;
+
+    if (i == params_.end())
+        return -1;
+    va_start(args, id);
+    value = va_arg(args, void *);
+    va_end(args);
+    switch (i->second.type & 0x0f)
+    {
+        case 1:
+            *(uint8_t *)value = i->second.value;
+            break;
+
+        case 2:
+            *(uint16_t *)value = i->second.value;
+            break;
+
+        default:
+            *(uint32_t *)value = i->second.value;
+            break;
+    }
+    return 0;
+}
+
+bool prm_dirty()
+{
+    return sim_paramsDirty();
+}
+
+int32_t led_setRGB(const uint8_t &r, const uint8_t &g, const uint8_t &b)
+{
+    return 0;
+}
+
+int32_t cam_setMode(const uint8_t &mode)
+{
+    return 0;
+}
+
+// as device/libpixy_m4/src/camera.cpp, which sdmmc.cpp's read_blocks() takes the frame
+// memory from
+uint8_t *cam_frameMemory(uint32_t *size)
+{
+    if (m0_running())
+        return NULL;
+    sdmmc_abortFrame();
+    g_frameBuf->releaseAll(FB_SD_WRITING);
+    return g_frameBuf->acquireAll(FB_USB_SENDING, size);
+}
+
+// the default lens
+const Calibration *calib_get()
+{
+    return NULL;
+}
+
+int exec_runM0(uint8_t prog)
+{
+    return m0_run(prog);
+}
+
+int exec_setRLSParamsM0(uint8_t threshold, uint8_t lowThreshold, uint8_t intensity, uint8_t logFps)
+{
+    double start;
+    int res;
+
+    sim_sync();
+    start = sim_now();
+    res = m0_setRLSParams(threshold, lowThreshold, intensity, logFps);
+    sim_sync();
+    sim_paramsTaken(sim_now() - start);
+    return res;
+}
+
+void exec_waitM0()
+{
+    sim_sleep();
+}
+
+void gpdma_init()
+{
+}
+
+void spi_init(SerialCallback callback)
+{
+    g_spi = new Spi;
+}
+
+Uart::Uart(SerialCallback callback) : m_rq(UART_RECEIVE_BUF_SIZE), m_tq(UART_TRANSMIT_BUF_SIZE, callback)
+{
+    m_baudrate = UART_DEFAULT_BAUDRATE;
+    m_open = false;
+}
+
+int Uart::open()
+{
+    m_open = true;
+    return 0;
+}
+
+int Uart::close()
+{
+    m_open = false;
+    return 0;
+}
+
+int Uart::receive(uint8_t *buf, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < len && m_rq.read(buf + i); i++);
+    return i;
+}
+
+int Uart::receiveLen()
+{
+    return m_rq.receiveLen();
+}
+
+int Uart::update()
+{
+    return 0;
+}
+
+int Uart::setBaudrate(uint32_t baudrate)
+{
+    if (baudrate == 0 || baudrate > UART_MAX_BAUDRATE)
+        return -1;
+    m_baudrate = baudrate;
+    return 0;
+}
+
+uint32_t Uart::baudrate()
+{
+    return m_baudrate;
+}
+
+// what the DMA would have put in the receive ring, dropped past its end as on the camera
+int Uart::masterWrite(const uint8_t *buf, uint32_t len)
+{
+    uint32_t i;
+
+    if (!m_open)
+        return 0;
+    for (i = 0; i < len && m_rq.write(buf[i]); i++);
+    return i;
+}
+
+uint32_t Uart::masterRead(uint8_t *buf, uint32_t len)
+{
+    uint32_t i;
+
+    if (!m_open)
+        return 0;
+    for (i = 0; i < len && m_tq.read(buf + i); i++);
+    return i;
+}
+
+void uart_init(SerialCallback callback)
+{
+    g_uart0 = new Uart(callback);
+}
+
+extern "C"
+{
+
+void scu_pinmux(uint8_t port, uint8_t pin, uint8_t mode, uint8_t func)
+{
+}
+
+uint32_t CGU_EntityConnect(CGU_ENTITY_T ClockSource, CGU_ENTITY_T ClockEntity)
+{
+    return 0;
+}
+
+void I2C_Init(LPC_I2Cn_Type *I2Cx, uint32_t clockrate)
+{
+}
+
+void I2C_SetOwnSlaveAddr(LPC_I2Cn_Type *I2Cx, I2C_OWNSLAVEADDR_CFG_Type *OwnSlaveAddrConfigStruct)
+{
+    sim_i2cSlaveAddr(OwnSlaveAddrConfigStruct->SlaveAddr_7bit);
+}
+
+void Chip_SDIF_Init(LPC_SDMMC_Type *pSDMMC)
+{
+}
+
+uint32_t Chip_SDMMC_Acquire(LPC_SDMMC_Type *pSDMMC, mci_card_struct *pcardinfo)
+{
+    return sim_card() != NULL;
+}
+
+uint64_t Chip_SDMMC_GetDeviceSize(LPC_SDMMC_Type *pSDMMC)
+{
+    return SD_BLOCKS*SD_BLOCK_SIZE;
+}
+
+int32_t Chip_SDMMC_GetDeviceBlocks(LPC_SDMMC_Type *pSDMMC)
+{
+    return SD_BLOCKS;
+}
+
+// blocks never written read as erased, zeros
+int32_t Chip_SDMMC_ReadBlocks(LPC_SDMMC_Type *pSDMMC, void *buffer, int32_t start_block, int32_t num_blocks)
+{
+    size_t len = (size_t)num_blocks*SD_BLOCK_SIZE, got;
+
+    sim_charge(SD_COMMAND_US + num_blocks*SD_BLOCK_US);
+    if (fseeko(sim_card(), (off_t)start_block*SD_BLOCK_SIZE, SEEK_SET) != 0)
+        return 0;
+    got = fread(buffer, 1, len, sim_card());
+    memset((uint8_t *)buffer + got, 0, len - got);
+    return len;
+}
+
+int32_t Chip_SDMMC_WriteBlocks(LPC_SDMMC_Type *pSDMMC, void *buffer, int32_t start_block, int32_t num_blocks)
+{
+    size_t len = (size_t)num_blocks*SD_BLOCK_SIZE;
+
+    sim_charge(SD_COMMAND_US + num_blocks*SD_BLOCK_US);
+    if (fseeko(sim_card(), (off_t)start_block*SD_BLOCK_SIZE, SEEK_SET) != 0 || fwrite(buffer, 1, len, sim_card()) != len)
+        return 0;
+    sim_sdWritten(start_block, num_blocks);
+    return len;
+}
+
+}
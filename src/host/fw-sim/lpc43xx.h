@@ -0,0 +1,111 @@
+/**
+ * @file lpc43xx.h
+ * @brief The LPC43xx device header as far as the firmware fw-sim builds reaches it.  The
+ *        I2C and SD/MMC register blocks are memory the simulation drives (sim.cpp), the
+ *        rest is there for the drivers' headers to compile, and interrupts and events are
+ *        the simulation's.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#ifndef __LPC43XX_H__
+#define __LPC43XX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __I     volatile          // read only to the firmware, the simulation sets them
+#define __O     volatile
+#define __IO    volatile
+
+typedef enum
+{
+    M0CORE_IRQn = 1,
+    SDIO_IRQn = 6,
+    I2C0_IRQn = 18,
+    SSP1_IRQn = 23,
+    USART0_IRQn = 24
+} IRQn_Type;
+
+typedef struct
+{
+    __IO uint32_t CONSET;
+    __I  uint32_t STAT;
+    __IO uint32_t DAT;
+    __IO uint32_t ADR0;
+    __IO uint32_t SCLH;
+    __IO uint32_t SCLL;
+    __O  uint32_t CONCLR;
+} LPC_I2Cn_Type;
+
+typedef struct
+{
+    __IO uint32_t CTYPE;
+    __IO uint32_t BLKSIZ;
+    __IO uint32_t BYTCNT;
+    __IO uint32_t INTMASK;
+    __IO uint32_t RINTSTS;
+    __I  uint32_t CDETECT;
+    __I  uint32_t WRTPRT;
+    __IO uint32_t PWREN;
+    __IO uint32_t RST_N;
+} LPC_SDMMC_Type;
+
+typedef struct
+{
+    __IO uint32_t RBR;
+} LPC_USARTn_Type;
+
+typedef struct
+{
+    __IO uint32_t RBR;
+} LPC_UART1_Type;
+
+typedef struct
+{
+    __IO uint32_t IR;
+} LPC_TIMERn_Type;
+
+typedef struct
+{
+    __IO uint32_t GPIO_OUTREG;
+    __IO uint32_t GPIO_OENREG;
+} LPC_SGPIO_Type;
+
+typedef struct
+{
+    __IO uint32_t DIR[8];
+    __IO uint32_t PIN[8];
+} LPC_GPIO_PORT_Type;
+
+extern LPC_I2Cn_Type g_simI2c0;
+extern LPC_SDMMC_Type g_simSdmmc;
+extern LPC_SGPIO_Type g_simSgpio;
+extern LPC_GPIO_PORT_Type g_simGpioPort;
+
+#define LPC_I2C0        (&g_simI2c0)
+#define LPC_SDMMC       (&g_simSdmmc)
+#define LPC_SGPIO       (&g_simSgpio)
+#define LPC_GPIO_PORT   (&g_simGpioPort)
+
+// the M4's interrupts are taken by the simulation, between the firmware's reads of the clock
+static inline void NVIC_EnableIRQ(IRQn_Type irq) {}
+static inline void NVIC_DisableIRQ(IRQn_Type irq) {}
+static inline void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) {}
+static inline void NVIC_ClearPendingIRQ(IRQn_Type irq) {}
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+static inline void __WFI(void) {}
+static inline void __DMB(void) {}
+static inline void __DSB(void) {}
+// the M0 looks at its mailbox at each step anyway
+static inline void __SEV(void) {}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
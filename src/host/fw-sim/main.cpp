@@ -0,0 +1,770 @@
+/**
+ * @file main.cpp
+ * @brief Runs the blob program's firmware (device/main_m4/src/progblobs.cpp and what it
+ *        calls) on the host against a simulated camera, M0, serial master and SD card, in
+ *        virtual time (sim.h).  Frames come from built-in scenes of bright discs with known
+ *        centers, or from a recorded SD card session or PGM images (-f).  Reports what
+ *        became of every frame, how long a frame took from the M0's frame end to the M4
+ *        and to the master, SD card logs and how much the M4 slept, and checks the master
+ *        got every frame with the discs where they are (and as bright as they are) and the
+ *        SD card has the frames the M0 logged, byte for byte.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "sim.h"
+#include "exec.h"
+#include "progblobs.h"
+#include "serial.h"
+#include "framebuf.h"
+#include "pixyvals.h"
+#include "param.h"
+#include "m0ctrl.h"
+#include "blobs.h"
+#include "rls_ref.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define FRAMES              300
+#define POLL_US             5000    // the master reads this often
+#define I2C_CLOCK           400000
+#define BAUD_INDEX          6       // 921600 in SER_BAUDRATES
+#define MAX_DISCS           20      // MAX_BLOBS
+#define BACKGROUND          30
+#define DISC                240
+#define SATURATED_DISC      255     // every other disc of the intensity scene
+#define MAX_ERROR           1.5     // pixels, a block this close to a disc's center found it
+#define RECOVER_FRAMES      50      // after glare, these frames are clean again
+#define MAX_PARAMS_MS       1.0     // the M4 waits a few lines at most for the M0 to take parameters
+#define PI                  3.14159265358979
+
+// Recorded sessions are the SD card blocks device/libpixy_m4/src/sdmmc.cpp writes, one
+// frame after the other: the header below in the first sector, then the image.
+#define SD_SECTOR_SIZE      512
+#define SD_SESSION_BLOCK    2       // SESSION_BLOCK_START, session 0 on a new card
+#define SD_FRAME_BLOCKS     (SIM_WIDTH*SIM_HEIGHT/SD_SECTOR_SIZE + 1)
+#define SD_FRAME_LEN        (SD_FRAME_BLOCKS*SD_SECTOR_SIZE)
+#define SD_MAX_BLOBS        20      // MAX_BLOBS
+
+// the M0's side of the queue
+extern "C"
+{
+void qq_init();
+uint32_t qq_enqueue(const Qval *val);
+}
+
+typedef struct __attribute__((packed))
+{
+    uint32_t session_cnt;
+    uint32_t frame_cnt;
+    uint32_t timestamp_us;
+    uint32_t last_write_time_us;
+    uint16_t blob_cnt;
+    uint16_t blobs[SD_MAX_BLOBS*5];
+    uint8_t crc8;
+} SdFrameHeader;            // SdmmcFrameHeader in device/libpixy_m4/inc/sdmmc.h
+
+// Discs on a grid, each moving about its cell so they never merge, over a noisy
+// background.  Glare covers the frames in between with thin bright stripes, close to the
+// most runs a line can have.  In the intensity format every other disc is at full scale.
+// PixyMon may change the pixel threshold every so many frames.
+typedef struct
+{
+    const char *name;
+    uint8_t discs;
+    double radius;
+    double amplitude;       // pixels, how far a disc goes from its cell's center
+    double period;          // s, to go round once
+    uint8_t noise;          // +- this on every pixel
+    uint32_t glareFrom;
+    uint32_t glareTo;
+    uint8_t interface;
+    uint8_t logInterval;
+    uint8_t format;         // BF_FORMAT_xxx the master asks for
+    uint32_t paramsInterval;
+} Scene;
+
+static const Scene scenes_[] =
+{
+    {"sparse", 4, 5, 20, 2, 6, 0, 0, SER_INTERFACE_I2C, 1, BF_FORMAT_COMPACT, 0},
+    {"busy", 16, 4, 10, 1, 10, 0, 0, SER_INTERFACE_I2C, 1, BF_FORMAT_COMPACT, 0},
+    {"uart", 4, 5, 20, 2, 6, 0, 0, SER_INTERFACE_UART, 1, BF_FORMAT_COMPACT, 0},
+    {"no logging", 9, 4, 12, 1.5, 6, 0, 0, SER_INTERFACE_I2C, 0, BF_FORMAT_COMPACT, 0},
+    {"glare", 4, 5, 20, 2, 6, 100, 140, SER_INTERFACE_I2C, 1, BF_FORMAT_COMPACT, 0},
+    {"intensity", 4, 5, 20, 2, 6, 0, 0, SER_INTERFACE_I2C, 1, BF_FORMAT_INTENSITY, 0},
+    {"parameters", 4, 5, 20, 2, 6, 0, 0, SER_INTERFACE_I2C, 1, BF_FORMAT_COMPACT, 10},
+};
+
+typedef struct
+{
+    uint32_t frames;        // camera frames
+    uint32_t processed;     // done without an error
+    uint32_t errors;        // the M0 dropped them, queue full
+    uint32_t flushed;
+    uint32_t received;
+    uint32_t wrong;         // received with a disc missing or a block where there's none
+    uint32_t dropped;       // the master saw a gap in the sequence
+    uint32_t crcErrors;
+    double meanLatency;     // ms, frame end to done
+    double p99Latency;
+    double maxLatency;
+    double meanDelivery;    // ms, frame end to received
+    double maxDelivery;
+    uint32_t fills;
+    uint32_t logs;          // complete on the card
+    uint32_t logsBad;       // not what the M0 filled
+    uint32_t logsAborted;
+    uint32_t lastError;     // frame, +1, 0 if none
+    double runs;            // queued a frame, of the frames done
+    double m4Ms;            // the M4 ran a frame, blobify() the most of it
+    double idle;            // percent of the run asleep
+    double hostFps;
+    uint32_t paramChanges;  // the M4 gave the M0 new parameters
+    double maxParamsMs;     // the longest it waited for the M0 to take them
+} Result;
+
+static const Scene *scene_;
+static std::vector<std::vector<uint8_t> > files_;
+static uint32_t random_;
+static uint32_t wrong_, wrongAfter_;
+static uint32_t glareTo_;
+static bool verbose_ = false;
+
+static uint32_t rnd()
+{
+    random_ = random_ * 1103515245 + 12345;
+    return random_ >> 8;
+}
+
+static int check(bool ok, const char *what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+// where disc i is in frame n
+static void disc(const Scene *scene, uint8_t i, uint32_t n, double *x, double *y)
+{
+    uint8_t cols = (uint8_t)ceil(sqrt((double)scene->discs)), rows = (scene->discs + cols - 1) / cols;
+    double cellWidth = (double)SIM_WIDTH / cols, cellHeight = (double)SIM_HEIGHT / rows;
+    double a = 2 * PI * (n * SIM_FRAME_US / 1e6 / scene->period + (double)i / scene->discs);
+
+    *x = (i % cols + 0.5) * cellWidth + scene->amplitude * cos(a);
+    *y = (i / cols + 0.5) * cellHeight + scene->amplitude * sin(a) * cellHeight / cellWidth;
+}
+
+static uint8_t discLevel(const Scene *scene, uint8_t i)
+{
+    return scene->format == BF_FORMAT_INTENSITY && i % 2 ? SATURATED_DISC : DISC;
+}
+
+static bool sceneFrame(uint32_t n, uint8_t *pixels)
+{
+    const Scene *scene = scene_;
+    double x[MAX_DISCS], y[MAX_DISCS], dx, dy;
+    uint32_t row, col;
+    uint8_t i;
+    int v;
+
+    for (i = 0; i < scene->discs; i++)
+        disc(scene, i, n, x + i, y + i);
+    random_ = n + 1;
+    for (row = 0; row < SIM_HEIGHT; row++)
+    {
+        for (col = 0; col < SIM_WIDTH; col++)
+        {
+            v = BACKGROUND;
+            for (i = 0; i < scene->discs; i++)
+            {
+                dx = col - x[i];
+                dy = row - y[i];
+                if (dx * dx + dy * dy <= scene->radius * scene->radius)
+                    v = discLevel(scene, i);
+            }
+            if (n >= scene->glareFrom && n < scene->glareTo && col % 3 == 0)
+                v = DISC;
+            v += rnd() % (2 * scene->noise + 1) - scene->noise;
+            *pixels++ = v > 255 ? 255 : v;
+        }
+    }
+    return true;
+}
+
+static bool fileFrame(uint32_t n, uint8_t *pixels)
+{
+    if (n >= files_.size())
+        return false;
+    memcpy(pixels, &files_[n][0], SIM_WIDTH * SIM_HEIGHT);
+    return true;
+}
+
+// A disc's block is as bright as the disc, give or take the noise, and saturated if the
+// disc is at full scale.
+static bool sameIntensity(const Scene *scene, uint8_t i, const PixyIntensity *intensity)
+{
+    uint8_t level = discLevel(scene, i);
+
+    if (abs(intensity->mean - level) > scene->noise || intensity->peak < intensity->mean ||
+        intensity->peak > level + scene->noise)
+        return false;
+    return level == SATURATED_DISC ? intensity->flags == BF_INTENSITY_SATURATED : intensity->flags == 0;
+}
+
+// every disc has a block at its center and there's no other, in frames without glare
+static void received(int32_t frame, const PixyBlockDecoder *dec)
+{
+    const Scene *scene = scene_;
+    double x, y, dx, dy;
+    uint8_t i, j, found;
+
+    if (frame < 0 || scene == NULL || ((uint32_t)frame >= scene->glareFrom && (uint32_t)frame < scene->glareTo))
+        return;
+    for (i = 0, found = 0; i < scene->discs; i++)
+    {
+        disc(scene, i, frame, &x, &y);
+        for (j = 0; j < dec->count; j++)
+        {
+            dx = dec->blocks[j].x - x;
+            dy = dec->blocks[j].y - y;
+            if (sqrt(dx * dx + dy * dy) <= MAX_ERROR)
+            {
+                if (dec->format == scene->format &&
+                    (scene->format != BF_FORMAT_INTENSITY || sameIntensity(scene, i, dec->intensities + j)))
+                    found++;
+                break;
+            }
+        }
+    }
+    if (found != scene->discs || dec->count != scene->discs)
+    {
+        wrong_++;
+        if ((uint32_t)frame >= glareTo_)
+            wrongAfter_++;
+        if (verbose_)
+            printf("frame %d: %u blocks, %u of %u discs found\n", frame, dec->count, found, scene->discs);
+    }
+}
+
+// A 320x200 image is the red pixels, a 640x400 one the raw Bayer image the M0 samples the
+// red of, (2x+1, 2y+1).  Any number of them, one after the other.
+static int loadPgm(FILE *file, const char *filename)
+{
+    std::vector<uint8_t> image, frame(SIM_WIDTH * SIM_HEIGHT);
+    unsigned width, height, maxval, x, y;
+    char magic[3];
+
+    while (fscanf(file, "%2s", magic) == 1)
+    {
+        if (strcmp(magic, "P5") != 0 || fscanf(file, " %u %u %u", &width, &height, &maxval) != 3 || maxval > 255 ||
+            fgetc(file) == EOF)
+        {
+            printf("%s: not a binary PGM\n", filename);
+            return -1;
+        }
+        if (!((width == SIM_WIDTH && height == SIM_HEIGHT) || (width == SIM_WIDTH * 2 && height == SIM_HEIGHT * 2)))
+        {
+            printf("%s: %ux%u, the camera's are %ux%u or %ux%u\n", filename, width, height, SIM_WIDTH, SIM_HEIGHT,
+                   SIM_WIDTH * 2, SIM_HEIGHT * 2);
+            return -1;
+        }
+        image.resize(width * height);
+        if (fread(&image[0], 1, image.size(), file) != image.size())
+        {
+            printf("%s: short image\n", filename);
+            return -1;
+        }
+        for (y = 0; y < SIM_HEIGHT; y++)
+        {
+            for (x = 0; x < SIM_WIDTH; x++)
+                frame[y * SIM_WIDTH + x] = width == SIM_WIDTH ? image[y * width + x] : image[(2 * y + 1) * width + 2 * x + 1];
+        }
+        files_.push_back(frame);
+    }
+    return 0;
+}
+
+// Same as the camera's CRC8 in device/libpixy_m4/src/misc.cpp (poly 0x07, init 0).
+static uint8_t crc8(const uint8_t *data, uint32_t len)
+{
+    uint8_t crc = 0;
+    int bit;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static int loadSession(FILE *file, const char *filename)
+{
+    static uint8_t buf[SD_FRAME_LEN];
+    const SdFrameHeader *header = (const SdFrameHeader *)buf;
+    uint32_t bad = 0;
+
+    while (fread(buf, 1, SD_FRAME_LEN, file) == SD_FRAME_LEN)
+    {
+        // blank sectors pass the CRC too
+        if (crc8(buf, offsetof(SdFrameHeader, crc8)) != header->crc8 || header->blob_cnt > SD_MAX_BLOBS ||
+            (header->session_cnt == 0 && header->timestamp_us == 0))
+        {
+            bad++;
+            continue;
+        }
+        files_.push_back(std::vector<uint8_t>(buf + SD_SECTOR_SIZE, buf + SD_FRAME_LEN));
+    }
+    if (bad)
+        printf("%s: %u bad frames skipped\n", filename, bad);
+    return 0;
+}
+
+static int load(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    int c, res;
+
+    if (file == NULL)
+    {
+        printf("can't open %s\n", filename);
+        return -1;
+    }
+    c = fgetc(file);
+    ungetc(c, file);
+    res = c == 'P' ? loadPgm(file, filename) : loadSession(file, filename);
+    fclose(file);
+    if (res == 0 && files_.empty())
+    {
+        printf("%s: no frames\n", filename);
+        return -1;
+    }
+    return res;
+}
+
+// The session's frames as the M4 logged them, each one the M0 filled, in order, though
+// not every one filled is logged.
+static void verifyCard(FILE *card, SimSource source, uint32_t frames, Result *result)
+{
+    static uint8_t buf[SD_FRAME_LEN], pixels[SIM_WIDTH * SIM_HEIGHT];
+    const SdFrameHeader *header = (const SdFrameHeader *)buf;
+    const uint32_t *fills;
+    uint32_t count, fill = 0, i;
+    int32_t block;
+    bool found;
+
+    fills = sim_fills(&count);
+    for (i = 0, block = SD_SESSION_BLOCK; i < count; i++, block += SD_FRAME_BLOCKS)
+    {
+        if (!sim_sdComplete(block, SD_FRAME_BLOCKS))
+        {
+            if (sim_sdComplete(block, 1))
+                result->logsAborted++;
+            continue;
+        }
+        if (fseeko(card, (off_t)block * SD_SECTOR_SIZE, SEEK_SET) != 0 || fread(buf, 1, SD_FRAME_LEN, card) != SD_FRAME_LEN ||
+            crc8(buf, offsetof(SdFrameHeader, crc8)) != header->crc8)
+        {
+            if (verbose_)
+                printf("log %u: bad header\n", i);
+            result->logsBad++;
+            continue;
+        }
+        for (found = false; fill < count && !found; fill++)
+        {
+            // as the M0 had it, blank in the tail
+            if (fills[fill] >= frames || !source(fills[fill], pixels))
+                memset(pixels, 0, sizeof(pixels));
+            found = memcmp(pixels, buf + SD_SECTOR_SIZE, sizeof(pixels)) == 0;
+        }
+        if (found)
+            result->logs++;
+        else
+        {
+            if (verbose_)
+                printf("log %u: not a frame the M0 filled\n", i);
+            result->logsBad++;
+        }
+    }
+}
+
+static double cpuUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Times blobify() alone on each of the frames, queued as the M0 does at the thresholds
+// the firmware was given, after the simulation so nothing else runs in between.  M4 us a
+// frame, the host's scaled, and the blocks it found a frame.
+static double timeBlobify(uint32_t frames, double scale, double *blocks)
+{
+    static uint8_t pixels[SIM_WIDTH * SIM_HEIGHT];
+    Qval qvals[RLS_MAX_LINE_QVALS_INTENSITY], lineBegin(QVAL_LINE_BEGIN, QVAL_LAYOUT_RUNS), frameEnd(QVAL_FRAME_END, FB_NO_SLOT);
+    uint8_t threshold = RLS_PIXEL_THRESHOLD, lowThreshold = RLS_LOW_THRESHOLD, intensity = RLS_RUN_INTENSITY;
+    uint32_t minArea = MIN_AREA, frame, row, i, n, len;
+    uint8_t mergeDist = MAX_MERGE_DIST;
+    double us = 0, start;
+    BlobA *found;
+    Blobs blobs;
+    Qqueue qq;
+
+    prm_get("Pixel threshold", &threshold, END);
+    prm_get("Low pixel threshold", &lowThreshold, END);
+    prm_get("Run intensity", &intensity, END);
+    prm_get("Min blob area", &minArea, END);
+    prm_get("Max merge distance", &mergeDist, END);
+    blobs.setMinArea(minArea);
+    blobs.setMergeDist(mergeDist);
+    // the simulated M0 would go on queueing the camera's frames whenever blobify() reads
+    // the clock
+    m0_stop();
+    qq_init();
+    if (intensity)
+        lineBegin.m_col_end = QVAL_LAYOUT_INTENSITY;
+    *blocks = 0;
+    for (frame = 0; frame < frames && fileFrame(frame, pixels); frame++)
+    {
+        for (row = 0; row < SIM_HEIGHT; row++)
+        {
+            qq_enqueue(&lineBegin);
+            n = rlsLineRef(pixels + row * SIM_WIDTH, threshold, lowThreshold, intensity, qvals);
+            for (i = 0; i < n; i++)
+                qq_enqueue(qvals + i);
+        }
+        qq_enqueue(&frameEnd);
+        start = cpuUs();
+        blobs.blobify(&qq);
+        us += cpuUs() - start;
+        blobs.getBlobs(&found, &len);
+        *blocks += len;
+    }
+    if (frame)
+        *blocks /= frame;
+    return frame ? us * scale / frame : 0;
+}
+
+static double percentile(std::vector<double> &v, double p)
+{
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+static void summarize(const SimFrame *frames, uint32_t count, Result *result)
+{
+    std::vector<double> latency;
+    double delivery = 0, us;
+    uint32_t i;
+    const SimStats *stats = sim_stats();
+
+    for (i = 0; i < count; i++)
+    {
+        const SimFrame *frame = frames + i;
+
+        if (frame->error)
+        {
+            result->errors++;
+            result->lastError = i + 1;
+        }
+        else if (frame->flushed)
+            result->flushed++;
+        else if (frame->done >= 0)
+        {
+            result->processed++;
+            result->runs += frame->qvals - SIM_HEIGHT - 1;
+            latency.push_back(frame->done - frame->end);
+        }
+        if (frame->received >= 0)
+        {
+            result->received++;
+            us = frame->received - frame->end;
+            delivery += us;
+            if (us > result->maxDelivery)
+                result->maxDelivery = us;
+        }
+    }
+    for (i = 0; i < latency.size(); i++)
+        result->meanLatency += latency[i] / latency.size();
+    result->p99Latency = percentile(latency, 0.99) / 1000;
+    result->maxLatency = latency.size() ? latency.back() / 1000 : 0;
+    result->meanLatency /= 1000;
+    result->meanDelivery = result->received ? delivery / result->received / 1000 : 0;
+    result->maxDelivery /= 1000;
+    result->runs = result->processed ? result->runs / result->processed : 0;
+    result->m4Ms = count ? stats->m4Us / count / 1000 : 0;
+    result->frames = count;
+    result->fills = stats->fills;
+    result->idle = sim_now() > 0 ? stats->idleUs * 100 / sim_now() : 0;
+    result->hostFps = stats->hostUs > 0 ? count * 1e6 / stats->hostUs : 0;
+    result->paramChanges = stats->paramChanges;
+    result->maxParamsMs = stats->maxParamsUs / 1000;
+}
+
+static void writeCsv(const char *filename, const SimFrame *frames, uint32_t count)
+{
+    FILE *file = fopen(filename, "w");
+    uint32_t i;
+
+    if (file == NULL)
+    {
+        printf("can't open %s\n", filename);
+        return;
+    }
+    fprintf(file, "frame,start_us,end_us,done_us,received_us,qvals,slot,status\n");
+    for (i = 0; i < count; i++)
+    {
+        fprintf(file, "%u,%.1f,%.1f,%.1f,%.1f,%u,%d,%s\n", i, frames[i].start, frames[i].end, frames[i].done,
+                frames[i].received, frames[i].qvals, frames[i].slot == FB_NO_SLOT ? -1 : frames[i].slot,
+                frames[i].error ? "error" : frames[i].flushed ? "flushed" : frames[i].done >= 0 ? "done" : "pending");
+    }
+    fclose(file);
+}
+
+// the firmware from power up to the last frame, so only once per process
+static void simulate(SimConfig *config, const char *csv, Result *result)
+{
+    const SimFrame *frames;
+    uint32_t count;
+
+    memset(result, 0, sizeof(*result));
+    wrong_ = wrongAfter_ = 0;
+    sim_init(config);
+    g_progBlobs.setup();
+    if (config->interface == SER_INTERFACE_UART)
+        ser_setInterface(SER_INTERFACE_UART);
+    while (!sim_ended())
+    {
+        g_progBlobs.loop();
+        sim_frameDone();
+    }
+
+    frames = sim_frames(&count);
+    summarize(frames, count, result);
+    if (config->card)
+        verifyCard(config->card, config->source, config->frames, result);
+    result->wrong = wrong_;
+    if (csv)
+        writeCsv(csv, frames, count);
+}
+
+static void printHeader()
+{
+    printf("%-11s %6s %5s %4s %5s %5s %5s %6s %6s %6s %7s %6s %5s %5s %5s %5s %8s\n", "scene", "frames", "done", "err",
+           "flush", "recvd", "wrong", "lat ms", "p99", "max", "deliver", "max", "fills", "logs", "bad", "idle%", "host fps");
+}
+
+static void print(const char *name, const Result *result, bool bad)
+{
+    printf("%-11s %6u %5u %4u %5u %5u %5u %6.2f %6.2f %6.2f %7.2f %6.2f %5u %5u %5u %5.1f %8.0f%s\n", name,
+           result->frames, result->processed, result->errors, result->flushed, result->received, result->wrong,
+           result->meanLatency, result->p99Latency, result->maxLatency, result->meanDelivery, result->maxDelivery,
+           result->fills, result->logs, result->logsBad + result->logsAborted, result->idle, result->hostFps,
+           bad ? "  FAILED" : "");
+}
+
+static void configure(SimConfig *config, double scale)
+{
+    memset(config, 0, sizeof(*config));
+    config->frames = FRAMES;
+    config->scale = scale;
+    config->interface = SER_INTERFACE_I2C;
+    config->format = BF_FORMAT_COMPACT;
+    config->baudIndex = BAUD_INDEX;
+    config->pollUs = POLL_US;
+    config->i2cClock = I2C_CLOCK;
+    config->verbose = verbose_;
+    config->received = received;
+}
+
+// Each scene in a process of its own, the firmware's statics start over.  Nominal scenes
+// lose no frame, the master gets them all with every disc, and the card has what the M0
+// logged; glare may cost frames, but after it all is as before.  New parameters don't hold
+// up the M4 for a frame.
+static int runScene(const Scene *scene, double scale)
+{
+    SimConfig config;
+    Result result;
+    bool bad;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    if ((pid = fork()) != 0)
+    {
+        if (pid < 0 || waitpid(pid, &status, 0) != pid)
+            return 1;
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+
+    scene_ = scene;
+    glareTo_ = scene->glareTo;
+    configure(&config, scale);
+    config.source = sceneFrame;
+    config.interface = scene->interface;
+    config.logInterval = scene->logInterval;
+    config.format = scene->format;
+    config.paramsInterval = scene->paramsInterval;
+    if (scene->format == BF_FORMAT_INTENSITY)
+        sim_setParam("Run intensity", 1);
+    config.card = tmpfile();
+    simulate(&config, NULL, &result);
+    if (scene->glareTo)
+        bad = result.lastError > scene->glareTo || wrongAfter_ || result.processed + result.errors +
+            result.flushed < result.frames - 1 || result.frames - result.received > scene->glareTo - scene->glareFrom +
+            RECOVER_FRAMES || result.logsBad;
+    else
+        bad = result.errors || result.flushed || result.processed < result.frames - 1 ||
+            result.received < result.frames - 2 || result.wrong || result.logsBad ||
+            (scene->logInterval && result.logs == 0);
+    if (scene->paramsInterval)
+        bad = bad || result.paramChanges < FRAMES / scene->paramsInterval || result.maxParamsMs > MAX_PARAMS_MS;
+    print(scene->name, &result, bad);
+    if (scene->paramsInterval)
+        printf("%-11s the M4 gave the M0 new parameters %u times and waited at most %.2f ms\n", "", result.paramChanges,
+               result.maxParamsMs);
+    fflush(stdout);
+    _exit(bad ? 1 : 0);
+}
+
+static int runFile(SimConfig *config, const char *csv, const char *card)
+{
+    Result result;
+    double us, blocks;
+
+    config->source = fileFrame;
+    if (config->frames > files_.size())
+        config->frames = files_.size();
+    config->card = card ? fopen(card, "w+b") : tmpfile();
+    if (config->card == NULL)
+    {
+        printf("can't open %s\n", card);
+        return 1;
+    }
+    simulate(config, csv, &result);
+    printHeader();
+    print("file", &result, false);
+    us = timeBlobify(config->frames, config->scale, &blocks);
+    printf("%.1f runs a frame, blobify() %.0f us a frame, %.1f blocks a frame, the M4 ran %.2f ms a frame\n",
+           result.runs, us, blocks, result.m4Ms);
+    fclose(config->card);
+    return check(result.logsBad == 0, "the SD card has the frames the M0 logged");
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-v] [-x scale] [-f frames [-n count] [-u] [-p us] [-l interval] [-t threshold] [-L low] [-s card]\n", progname);
+    printf("       [-o csv]]\n");
+    printf("  -v  Print the firmware's output, and the frames the master got wrong\n");
+    printf("  -x  How much slower the M4 is than this computer (default %.0f)\n", SIM_SCALE);
+    printf("  -f  Frames from a recorded SD card session or binary PGM images, 320x200 red\n");
+    printf("      or 640x400 raw, instead of the built-in scenes\n");
+    printf("  -n  At most this many of them\n");
+    printf("  -u  The master is on the UART, at 921600 baud, not I2C\n");
+    printf("  -p  The master reads this often, in us (default %d)\n", POLL_US);
+    printf("  -l  Log every nth frame to the SD card, 0 not at all (default 1)\n");
+    printf("  -t  Pixel threshold (default %d)\n", RLS_PIXEL_THRESHOLD);
+    printf("  -L  Low pixel threshold, runs over it with a pixel over -t are kept (default %d, none)\n", RLS_LOW_THRESHOLD);
+    printf("  -s  Keep the SD card's blocks in this file\n");
+    printf("  -o  What became of each frame, as CSV\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    SimConfig config;
+    const char *filename = NULL, *csv = NULL, *card = NULL;
+    double scale = SIM_SCALE;
+    uint32_t frames = 0, pollUs = POLL_US;
+    uint8_t interface = SER_INTERFACE_I2C, logInterval = 1, i;
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "vx:f:n:up:l:t:L:s:o:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = true;
+                break;
+
+            case 'x':
+                scale = atof(optarg);
+                break;
+
+            case 'f':
+                filename = optarg;
+                break;
+
+            case 'n':
+                frames = atoi(optarg);
+                break;
+
+            case 'u':
+                interface = SER_INTERFACE_UART;
+                break;
+
+            case 'p':
+                pollUs = atoi(optarg);
+                break;
+
+            case 'l':
+                logInterval = atoi(optarg);
+                break;
+
+            case 't':
+                sim_setParam("Pixel threshold", atoi(optarg));
+                break;
+
+            case 'L':
+                sim_setParam("Low pixel threshold", atoi(optarg));
+                break;
+
+            case 's':
+                card = optarg;
+                break;
+
+            case 'o':
+                csv = optarg;
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+    if (scale <= 0 || pollUs == 0)
+        help(argv[0]);
+
+    if (filename)
+    {
+        if (load(filename) < 0)
+            return 1;
+        configure(&config, scale);
+        config.frames = frames ? frames : files_.size();
+        config.interface = interface;
+        config.pollUs = pollUs;
+        config.logInterval = logInterval;
+        failures = runFile(&config, csv, card);
+    }
+    else
+    {
+        printHeader();
+        for (i = 0; i < sizeof(scenes_) / sizeof(scenes_[0]); i++)
+            failures += runScene(scenes_ + i, scale);
+    }
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+/**
+ * @file pixy_init.h
+ * @brief Stands in for device/libpixy_m4/inc/pixy_init.h, without the USB stack and the
+ *        M0's image: the globals the firmware shares, set up by sim_init().
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#ifndef PIXY_INIT_H
+#define PIXY_INIT_H
+
+#include "debug.h"
+#include "chirp.hpp"
+#include "pixyvals.h"
+#include "framebuf.h"
+
+void cprintf(const char *format, ...);
+void periodic();
+
+extern Chirp *g_chirpUsb;
+extern FrameBuf *g_frameBuf;
+
+#endif
@@ -0,0 +1,761 @@
+/**
+ * @file sim.cpp
+ * @brief The virtual clock and what it runs besides the M4: the M0 reading out the camera
+ *        into the shared queue and frame slots as rls_m0.c and exec_m0.c do, the serial
+ *        master polling the camera for frames and the SD card's bookkeeping.  The camera's
+ *        shared memory is mapped where it is on the camera, so the M4's code and the M0's
+ *        C files (qqueue.c, framebuf.c) find it at the addresses in pixyvals.h.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "sim.h"
+#include "pixy_init.h"
+#include "lpc43xx.h"
+#include "lpc43xx_i2c.h"
+#include "i2c.h"
+#include "m0cmd.h"
+#include "qqueue.h"
+#include "rls_ref.h"
+#include "serial.h"
+#include "uart.h"
+#include "sdmmc.h"
+#include "blockframe.h"
+
+#include <deque>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <vector>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0   // a hint then, checked below
+#endif
+
+#define NEVER               1e300
+#define MIN_STEP_US         0.1     // a read of the clock takes at least this, so it moves
+#define MASTER_CHUNK        16      // bytes the master reads at a time
+#define MASTER_MAX_CHUNKS   64      // per poll, it stops at a chunk of zeros before
+#define STALL_US            2000000 // the firmware took no frame for this long, give up
+#define CHANGED_THRESHOLD   150     // what PixyMon changes the pixel threshold to and from
+
+// the M0's side of the shared memory, rls_m0.c's and exec_m0.c's part is below
+extern "C"
+{
+void qq_init();
+uint32_t qq_enqueue(const Qval *val);
+uint16_t qq_free(void);
+uint8_t fb_beginFill(void);
+uint8_t *fb_frame(uint8_t slot);
+void fb_endFill(uint8_t slot);
+void fb_abortFill(uint8_t slot);
+void fb_disarm(void);
+}
+
+extern "C" void I2C0_IRQHandler(void);
+
+enum M0State
+{
+    M0_IDLE,        // waits for a command
+    M0_WAIT,        // in getRLSFrame(), for the frame to start
+    M0_LINES        // reading out the frame, a line per event
+};
+
+// setRLSParams()'s, the next frame takes them up
+struct RlsParams
+{
+    uint32_t threshold;
+    uint32_t lowThreshold;
+    uint32_t intensity;
+    uint32_t logDivider;
+};
+
+struct M0
+{
+    M0State state;
+    uint32_t cmdSeq;
+    RlsParams rls;
+    RlsParams newRls;
+    bool newParams;
+    uint32_t frameCount;    // s_frameCount
+    uint32_t camFrame;      // the camera's, from the start of the simulation
+    uint32_t firstFrame;    // camFrame of source frame 0
+    uint32_t frame;         // source frame being read
+    uint16_t line;
+    uint8_t slot;
+    double start;
+    uint8_t pixels[SIM_WIDTH*SIM_HEIGHT];
+};
+
+// a frame end or error the M0 queued, which the M4 hasn't taken yet
+struct Marker
+{
+    uint32_t frame;
+    uint64_t index;         // qvals queued up to and with it
+};
+
+struct Master
+{
+    double next;
+    uint8_t addr;
+    std::vector<uint8_t> out;   // commands not sent yet
+    PixyBlockDecoder dec;
+    uint32_t matched;           // frames_ before this were received or can't be any more
+};
+
+static SimConfig config_;
+static SimStats stats_;
+static double now_;
+static double mark_;            // host CPU us the M4's time was last counted up to
+static double hostStart_;
+static bool event_;             // the M4's event register, set by the M0's SEV and interrupts
+static M0 m0_;
+static Master master_;
+static uint64_t queued_;        // qvals the M0 queued since the start
+static std::deque<Marker> markers_;
+static std::vector<SimFrame> frames_;
+static std::vector<uint32_t> fills_;
+static std::vector<uint8_t> sdWritten_;
+static uint8_t slaveAddr_;
+static bool paramsDirty_;
+
+// The shared memory where it is on the camera, before the firmware's static objects (the
+// blob program's Qqueue) get to it.
+static void mapAt(uintptr_t loc, size_t size)
+{
+    void *mem = mmap((void *)loc, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (mem != (void *)loc)
+    {
+        fprintf(stderr, "can't map the camera's memory at 0x%lx\n", (unsigned long)loc);
+        exit(1);
+    }
+}
+
+__attribute__((constructor(101))) static void mapShared()
+{
+    mapAt(SRAM1_LOC, SRAM1_SIZE);
+    mapAt(SRAM4_LOC, SRAM4_SIZE);
+}
+
+static double hostUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// the M4's time is what the host spent running it, not the time it was preempted
+static double cpuUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// the M0's doorbell
+static void sev()
+{
+    event_ = true;
+    stats_.doorbells++;
+}
+
+static bool cmdPending()
+{
+    return M0C_OBJECT->seq != m0_.cmdSeq;
+}
+
+static bool stopRequested()
+{
+    return m0_.state != M0_IDLE && cmdPending() && M0C_OBJECT->cmd == M0C_STOP;
+}
+
+// exec_stopRequested() takes these too, while a frame is read or waited for
+static bool paramsRequested()
+{
+    return m0_.state != M0_IDLE && cmdPending() && M0C_OBJECT->cmd == M0C_RLS_PARAMS;
+}
+
+static void finishCmd(int32_t result)
+{
+    M0C_OBJECT->result = result;
+    M0C_OBJECT->done = m0_.cmdSeq;
+    event_ = true;
+}
+
+static void enqueue(uint16_t start, uint16_t end)
+{
+    Qval qval(start, end);
+
+    if (qq_enqueue(&qval))
+    {
+        queued_++;
+        if (m0_.frame < frames_.size())
+            frames_[m0_.frame].qvals++;
+    }
+}
+
+// as getRLSFrame() starts: picks the slot, then waits for the next frame
+static void beginWait()
+{
+    if (m0_.newParams)
+    {
+        m0_.rls = m0_.newRls;
+        m0_.newParams = false;
+    }
+    m0_.slot = (m0_.frameCount++ % m0_.rls.logDivider == 0) ? fb_beginFill() : FB_NO_SLOT;
+    m0_.camFrame = (uint32_t)floor(now_ / SIM_FRAME_US) + 1;
+    m0_.start = (double)m0_.camFrame * SIM_FRAME_US;
+    m0_.state = M0_WAIT;
+}
+
+static void stopped()
+{
+    m0_.state = M0_IDLE;
+    M0C_OBJECT->running = 0;
+    fb_disarm();
+    finishCmd(0);
+}
+
+// exec_loop()'s serviceCmd(), between frames and while stopped, and for new parameters
+// while a frame is read
+static void serviceCmd()
+{
+    volatile M0Cmd *cmd = M0C_OBJECT;
+    uint8_t logFps;
+
+    if (!cmdPending())
+        return;
+    m0_.cmdSeq = cmd->seq;
+    switch (cmd->cmd)
+    {
+        case M0C_RUN:
+            M0C_OBJECT->running = 1;
+            finishCmd(0);
+            if (m0_.state == M0_IDLE)
+            {
+                m0_.firstFrame = (uint32_t)floor(now_ / SIM_FRAME_US) + 1;
+                beginWait();
+            }
+            break;
+
+        case M0C_STOP:
+            if (m0_.state == M0_IDLE)
+                finishCmd(0);
+            else
+                stopped();
+            break;
+
+        case M0C_RLS_PARAMS:
+            logFps = cmd->args.rls.logFps;
+            if (logFps == 0 || logFps > RLS_CAMERA_FPS)
+            {
+                finishCmd(-1);
+                break;
+            }
+            m0_.newRls.threshold = cmd->args.rls.threshold;
+            m0_.newRls.lowThreshold = cmd->args.rls.lowThreshold;
+            m0_.newRls.intensity = cmd->args.rls.intensity != 0;
+            m0_.newRls.logDivider = RLS_CAMERA_FPS / logFps;
+            m0_.newParams = true;
+            finishCmd(0);
+            break;
+
+        // the simulated camera has no frame to grab
+        default:
+            finishCmd(-1);
+            break;
+    }
+}
+
+static void endFrame(bool error)
+{
+    Marker marker;
+
+    if (m0_.frame < frames_.size())
+    {
+        frames_[m0_.frame].end = now_;
+        frames_[m0_.frame].error = error;
+    }
+    marker.frame = m0_.frame;
+    marker.index = queued_;
+    markers_.push_back(marker);
+}
+
+// the frame's first line: the source gives its pixels, blank once it has no more.  Every
+// paramsInterval frames PixyMon changes the pixel threshold, back and forth.
+static void beginFrame()
+{
+    SimFrame frame;
+
+    m0_.frame = m0_.camFrame - m0_.firstFrame;
+    if (m0_.frame >= config_.frames || !config_.source(m0_.frame, m0_.pixels))
+        memset(m0_.pixels, 0, sizeof(m0_.pixels));
+    if (m0_.frame >= frames_.size())
+    {
+        frame.start = now_;
+        frame.end = frame.done = frame.received = -1;
+        frame.qvals = 0;
+        frame.slot = m0_.slot;
+        frame.error = frame.flushed = false;
+        frames_.resize(m0_.frame + 1, frame);
+        frames_[m0_.frame] = frame;
+    }
+    m0_.line = 0;
+    m0_.state = M0_LINES;
+    if (config_.paramsInterval && m0_.frame && m0_.frame % config_.paramsInterval == 0)
+    {
+        sim_setParam("Pixel threshold", m0_.frame / config_.paramsInterval % 2 ? CHANGED_THRESHOLD : RLS_PIXEL_THRESHOLD);
+        paramsDirty_ = true;
+    }
+}
+
+// a line of getRLSFrame(), at its end
+static void readLine()
+{
+    Qval qvals[RLS_MAX_LINE_QVALS_INTENSITY];
+    uint32_t i, n;
+
+    if (paramsRequested())
+        serviceCmd();
+    if (stopRequested() || qq_free() < (m0_.rls.intensity ? RLS_MAX_LINE_QVALS_INTENSITY : RLS_MAX_LINE_QVALS))
+    {
+        enqueue(QVAL_FRAME_ERROR, 0);
+        sev();
+        endFrame(true);
+        if (m0_.slot != FB_NO_SLOT)
+            fb_abortFill(m0_.slot);
+        if (stopRequested())
+        {
+            m0_.cmdSeq = M0C_OBJECT->seq;
+            stopped();
+            return;
+        }
+        serviceCmd();
+        if (m0_.state != M0_IDLE)
+            beginWait();
+        return;
+    }
+    enqueue(QVAL_LINE_BEGIN, m0_.rls.intensity ? QVAL_LAYOUT_INTENSITY : QVAL_LAYOUT_RUNS);
+    n = rlsLineRef(m0_.pixels + m0_.line * SIM_WIDTH, m0_.rls.threshold, m0_.rls.lowThreshold, m0_.rls.intensity, qvals);
+    if (m0_.slot != FB_NO_SLOT)
+        memcpy(fb_frame(m0_.slot) + m0_.line * SIM_WIDTH, m0_.pixels + m0_.line * SIM_WIDTH, SIM_WIDTH);
+    for (i = 0; i < n; i++)
+        enqueue(qvals[i].m_col_start, qvals[i].m_col_end);
+    if (m0_.line % SIM_DOORBELL_LINES == SIM_DOORBELL_LINES - 1)
+        sev();
+    if (++m0_.line < SIM_HEIGHT)
+        return;
+
+    // the slot is handed over before the frame end that names it is queued
+    if (m0_.slot != FB_NO_SLOT)
+    {
+        fb_endFill(m0_.slot);
+        fills_.push_back(m0_.frame);
+        stats_.fills++;
+        enqueue(QVAL_FRAME_END | QVAL_WRITE_FRAME_BIT, m0_.slot);
+    }
+    else
+        enqueue(QVAL_FRAME_END, FB_NO_SLOT);
+    sev();
+    endFrame(false);
+    serviceCmd();
+    if (m0_.state != M0_IDLE)
+        beginWait();
+}
+
+static double m0Next()
+{
+    switch (m0_.state)
+    {
+        case M0_IDLE:
+            return cmdPending() ? now_ : NEVER;
+
+        case M0_WAIT:
+            return stopRequested() || paramsRequested() ? now_ : m0_.start + SIM_LINE_US;
+
+        default:
+            return m0_.start + (m0_.line + 1) * SIM_LINE_US;
+    }
+}
+
+static void m0Step()
+{
+    switch (m0_.state)
+    {
+        case M0_IDLE:
+            serviceCmd();
+            break;
+
+        case M0_WAIT:
+            if (paramsRequested())
+            {
+                serviceCmd();
+                break;
+            }
+            // stopped before the frame started, no error to queue
+            if (stopRequested())
+            {
+                m0_.cmdSeq = M0C_OBJECT->seq;
+                if (m0_.slot != FB_NO_SLOT)
+                    fb_abortFill(m0_.slot);
+                stopped();
+                break;
+            }
+            beginFrame();
+            readLine();
+            break;
+
+        default:
+            readLine();
+            break;
+    }
+}
+
+// A slave interrupt for each state the bus gets to, the master's time on the bus is its
+// own but the handler's is the M4's.
+static void i2cIrq(uint8_t stat)
+{
+    double host = cpuUs(), us;
+
+    g_simI2c0.STAT = stat;
+    I2C0_IRQHandler();
+    g_simI2c0.STAT = I2C_I2STAT_NO_INF;
+    us = (cpuUs() - host) * config_.scale;
+    now_ += us;
+    stats_.irqUs += us;
+    event_ = true;
+}
+
+// The first frame the M4 finished after its capture time is the one, frames the master
+// never got are left behind.
+static int32_t matchFrame(uint32_t timestamp)
+{
+    uint32_t i;
+
+    for (i = master_.matched; i < frames_.size(); i++)
+    {
+        if (frames_[i].error || frames_[i].flushed)
+            continue;
+        if (frames_[i].done < 0)
+            break;
+        if (frames_[i].done < timestamp)
+            continue;
+        master_.matched = i + 1;
+        return i;
+    }
+    return -1;
+}
+
+static void masterByte(uint8_t byte, double t)
+{
+    int32_t frame;
+
+    stats_.bytes++;
+    if (pixy_blocks_push(&master_.dec, byte) != 1)
+        return;
+    frame = matchFrame(master_.dec.timestamp);
+    if (frame >= 0 && frames_[frame].received < 0)
+        frames_[frame].received = t;
+    if (config_.received)
+        config_.received(frame < (int32_t)config_.frames ? frame : -1, &master_.dec);
+}
+
+static void pollI2c()
+{
+    double t = now_, byteUs = 9e6 / config_.i2cClock;
+    uint8_t byte, chunk;
+    uint32_t i;
+    bool data;
+
+    if (master_.addr != slaveAddr_)
+        return;
+    if (master_.out.size())
+    {
+        i2cIrq(I2C_I2STAT_S_RX_SLAW_ACK);
+        for (i = 0; i < master_.out.size(); i++)
+        {
+            g_simI2c0.DAT = master_.out[i];
+            i2cIrq(I2C_I2STAT_S_RX_PRE_SLA_DAT_ACK);
+        }
+        i2cIrq(I2C_I2STAT_S_RX_STA_STO_SLVREC_SLVTRX);
+        t += (master_.out.size() + 2) * byteUs;
+        master_.out.clear();
+    }
+    for (chunk = 0, data = true; chunk < MASTER_MAX_CHUNKS && data; chunk++)
+    {
+        t += byteUs;    // SLA+R
+        for (i = 0, data = false; i < MASTER_CHUNK; i++)
+        {
+            i2cIrq(i == 0 ? I2C_I2STAT_S_TX_SLAR_ACK : I2C_I2STAT_S_TX_DAT_ACK);
+            byte = g_simI2c0.DAT;
+            t += byteUs;
+            data |= byte != 0;
+            masterByte(byte, t);
+        }
+        i2cIrq(I2C_I2STAT_S_TX_DAT_NACK);
+    }
+}
+
+// bytes come in as fast as the rate goes, the master takes what came since the last poll
+static void pollUart()
+{
+    uint8_t buf[MASTER_CHUNK];
+    uint32_t budget = (uint64_t)g_uart0->baudrate() * config_.pollUs / 10000000, len, i;
+    double host = cpuUs(), us;
+
+    if (master_.out.size())
+    {
+        g_uart0->masterWrite(&master_.out[0], master_.out.size());
+        master_.out.clear();
+    }
+    while (budget)
+    {
+        if ((len = g_uart0->masterRead(buf, budget < sizeof(buf) ? budget : sizeof(buf))) == 0)
+            break;
+        for (i = 0; i < len; i++)
+            masterByte(buf[i], now_);
+        budget -= len;
+    }
+    // the DMA's interrupts
+    us = (cpuUs() - host) * config_.scale;
+    now_ += us;
+    stats_.irqUs += us;
+}
+
+static void masterStep()
+{
+    stats_.polls++;
+    if (config_.interface == SER_INTERFACE_UART)
+        pollUart();
+    else
+        pollI2c();
+    master_.next += config_.pollUs;
+}
+
+// everything due by now, the M0 first as it's the one in a hurry
+static void run()
+{
+    while (true)
+    {
+        if (m0Next() <= now_)
+            m0Step();
+        else if (master_.next <= now_)
+            masterStep();
+        else
+            break;
+    }
+}
+
+void sim_init(const SimConfig *config)
+{
+    uint8_t cmd[BF_CMD_FRAME_LEN(1)];
+    uint32_t len;
+
+    config_ = *config;
+    memset(&stats_, 0, sizeof(stats_));
+    now_ = 0;
+    event_ = false;
+    frames_.clear();
+    fills_.clear();
+    markers_.clear();
+    queued_ = 0;
+    paramsDirty_ = false;
+
+    // exec_init() and rls_m0.c on the M0
+    qq_init();
+    memset((void *)M0C_OBJECT, 0, sizeof(M0Cmd));
+    memset(&m0_, 0, sizeof(m0_));
+    m0_.state = M0_IDLE;
+    m0_.rls.threshold = RLS_PIXEL_THRESHOLD;
+    m0_.rls.lowThreshold = RLS_LOW_THRESHOLD;
+    m0_.rls.intensity = RLS_RUN_INTENSITY;
+    m0_.rls.logDivider = RLS_CAMERA_FPS / RLS_LOG_FPS;
+    m0_.newParams = false;
+
+    // pixy_init()
+    g_chirpUsb = new Chirp;
+    g_frameBuf = new FrameBuf;
+    g_simI2c0.STAT = I2C_I2STAT_NO_INF;
+    if (config_.card)
+        sdmmc_init();
+
+    // the master's commands go out at its first poll
+    master_ = Master();
+    master_.addr = I2C_DEFAULT_SLAVE_ADDR;
+    master_.next = config_.interface == SIM_NO_MASTER ? NEVER : config_.pollUs;
+    pixy_blocks_init(&master_.dec);
+    if (config_.interface == SER_INTERFACE_UART && config_.baudIndex != 0xff)
+    {
+        master_.out.push_back(SER_SYNC_BYTE);
+        master_.out.push_back(SER_CMD_BAUD_BASE + config_.baudIndex);
+    }
+    pixy_blocks_format_cmd(config_.format, cmd);
+    master_.out.insert(master_.out.end(), cmd, cmd + 2);
+    if (config_.logInterval)
+    {
+        len = pixy_blocks_command(1, BF_CMD_SET_LOGGING, &config_.logInterval, 1, cmd);
+        master_.out.insert(master_.out.end(), cmd, cmd + len);
+    }
+
+    hostStart_ = hostUs();
+    mark_ = cpuUs();
+}
+
+bool sim_ended()
+{
+    return frames_.size() > config_.frames + SIM_TAIL_FRAMES;
+}
+
+double sim_now()
+{
+    return now_;
+}
+
+bool sim_verbose()
+{
+    return config_.verbose;
+}
+
+FILE *sim_card()
+{
+    return config_.card;
+}
+
+void sim_sync()
+{
+    double us = (cpuUs() - mark_) * config_.scale;
+
+    if (us < MIN_STEP_US)
+        us = MIN_STEP_US;
+    now_ += us;
+    stats_.m4Us += us;
+    run();
+    mark_ = cpuUs();
+}
+
+void sim_charge(double us)
+{
+    sim_sync();
+    now_ += us;
+    stats_.waitUs += us;
+    run();
+    mark_ = cpuUs();
+}
+
+// WFE: back at once if there was an event since the last sleep, else at the next event, the
+// doorbell, an interrupt or the tick
+void sim_sleep()
+{
+    double until, t;
+
+    sim_sync();
+    stats_.sleeps++;
+    until = (floor(now_ / SIM_TICK_US) + 1) * SIM_TICK_US;
+    while (!event_ && now_ < until)
+    {
+        t = m0Next() < master_.next ? m0Next() : master_.next;
+        if (t > until)
+            t = until;
+        if (t > now_)
+        {
+            stats_.idleUs += t - now_;
+            now_ = t;
+        }
+        run();
+    }
+    event_ = false;
+    now_ += SIM_WAKE_US;
+    if (frames_.size() && now_ > frames_.back().start + STALL_US)
+    {
+        fprintf(stderr, "the firmware took no frame for %.1f s\n", STALL_US / 1e6);
+        exit(2);
+    }
+    mark_ = cpuUs();
+}
+
+// The M4 took a frame end or error off the queue, the first it hadn't.  Any others it
+// took with it were flushed after an error.
+void sim_frameDone()
+{
+    const QqueueFields *fields = (const QqueueFields *)MEM_QQ_LOC;
+    uint64_t consumed = queued_ - (uint16_t)(fields->produced - fields->consumed);
+    bool first = true;
+
+    while (markers_.size() && markers_.front().index <= consumed)
+    {
+        if (markers_.front().frame < frames_.size())
+        {
+            if (first)
+                frames_[markers_.front().frame].done = now_;
+            else
+                frames_[markers_.front().frame].flushed = true;
+        }
+        first = false;
+        markers_.pop_front();
+    }
+}
+
+void sim_i2cSlaveAddr(uint8_t addr)
+{
+    slaveAddr_ = addr;
+}
+
+void sim_sdWritten(int32_t block, int32_t blocks)
+{
+    stats_.sdWrites++;
+    stats_.sdBlocks += blocks;
+    if (sdWritten_.size() < (size_t)(block + blocks))
+        sdWritten_.resize(block + blocks, 0);
+    memset(&sdWritten_[block], 1, blocks);
+}
+
+bool sim_paramsDirty()
+{
+    bool dirty = paramsDirty_;
+
+    paramsDirty_ = false;
+    return dirty;
+}
+
+void sim_paramsTaken(double us)
+{
+    stats_.paramChanges++;
+    if (us > stats_.maxParamsUs)
+        stats_.maxParamsUs = us;
+}
+
+bool sim_sdComplete(int32_t block, int32_t blocks)
+{
+    int32_t i;
+
+    if (sdWritten_.size() < (size_t)(block + blocks))
+        return false;
+    for (i = 0; i < blocks; i++)
+    {
+        if (!sdWritten_[block + i])
+            return false;
+    }
+    return true;
+}
+
+const SimFrame *sim_frames(uint32_t *count)
+{
+    *count = frames_.size() < config_.frames ? frames_.size() : config_.frames;
+    return frames_.size() ? &frames_[0] : NULL;
+}
+
+const SimStats *sim_stats()
+{
+    stats_.hostUs = hostUs() - hostStart_;
+    return &stats_;
+}
+
+const uint32_t *sim_fills(uint32_t *count)
+{
+    *count = fills_.size();
+    return fills_.size() ? &fills_[0] : NULL;
+}
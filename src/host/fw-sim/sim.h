@@ -0,0 +1,108 @@
+/**
+ * @file sim.h
+ * @brief The simulation the firmware runs in: a virtual clock, the M0 reading out the
+ *        camera into the shared queue and frame slots, the serial master and the SD card.
+ *        One thread: the M4's code runs for real and its time is host time scaled
+ *        (SimConfig::scale), the rest are events the clock runs whenever the firmware
+ *        reads it, sleeps or waits on a peripheral.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "pixyblocks.h"
+
+#define SIM_WIDTH           320     // CAM_RES2_WIDTH, the red pixels the M0 samples
+#define SIM_HEIGHT          200
+#define SIM_FRAME_US        20000   // RLS_CAMERA_FPS
+#define SIM_LINE_US         35      // BLOBS_LINE_US, the first line starts at the frame's start
+#define SIM_DOORBELL_LINES  8       // DOORBELL_LINES in rls_m0.c
+#define SIM_TICK_US         1000    // other interrupts wake the M4 at least this often, USB SOF
+#define SIM_WAKE_US         2       // from WFE to running
+#define SIM_SCALE           20.0    // M4 us per host us, see SimConfig::scale
+#define SIM_TAIL_FRAMES     3       // frames the camera runs on, blank, so the last ones get out
+#define SIM_NO_MASTER       0xff
+
+// the camera's red pixels of frame n, false if there are no more
+typedef bool (*SimSource)(uint32_t frame, uint8_t *pixels);
+
+// a complete frame the master decoded, frame is the camera's, -1 if it couldn't be told
+typedef void (*SimReceived)(int32_t frame, const PixyBlockDecoder *dec);
+
+struct SimConfig
+{
+    SimSource source;
+    SimReceived received;
+    uint32_t frames;        // camera frames, at most
+    double scale;           // the M4 is this much slower than the host, measure with sched_stats
+    uint8_t interface;      // SER_INTERFACE_I2C, SER_INTERFACE_UART or SIM_NO_MASTER
+    uint8_t format;         // BF_FORMAT_xxx the master asks for
+    uint8_t logInterval;    // BF_CMD_SET_LOGGING, 0 doesn't log
+    uint8_t baudIndex;      // SER_CMD_BAUD_BASE + this before anything else, 0xff leaves the rate
+    uint32_t pollUs;        // the master reads this often
+    uint32_t i2cClock;      // Hz
+    FILE *card;             // the SD card's blocks, NULL if there's no card
+    uint32_t paramsInterval;// frames between changes of the pixel threshold, as from PixyMon, 0 none
+    bool verbose;           // the firmware's printf()s
+};
+
+// what became of a camera frame, times in virtual us, -1 if it didn't happen
+struct SimFrame
+{
+    double start;           // the first line
+    double end;             // the M0 queued its frame end or error
+    double done;            // blobsLoop() returned with it
+    double received;        // the master had it
+    uint32_t qvals;
+    uint8_t slot;           // the frame slot the M0 filled, FB_NO_SLOT
+    bool error;             // the M0 aborted it, queue full or stopped
+    bool flushed;           // the M4 threw its frame end away with an earlier frame's error
+};
+
+struct SimStats
+{
+    double m4Us;            // the M4 ran
+    double idleUs;          // asleep in exec_waitM0()
+    double waitUs;          // waiting on the SD card
+    double irqUs;           // in the serial master's interrupts
+    double hostUs;          // the whole run took
+    uint32_t sleeps;
+    uint32_t doorbells;
+    uint32_t polls;         // the master's reads
+    uint32_t bytes;         // the master read
+    uint32_t sdWrites;
+    uint32_t sdBlocks;
+    uint32_t fills;         // frames the M0 wrote into a slot
+    uint32_t paramChanges;  // the M4 gave the M0 new parameters
+    double maxParamsUs;     // the longest the M4 waited for the M0 to take them
+};
+
+void sim_init(const SimConfig *config);
+bool sim_ended();           // every frame went through, and the tail after them
+double sim_now();           // virtual us, without running the M4's time so far
+
+// a parameter's value in place of the one prm_add() gives it, before the firmware starts,
+// or after, where prm_get() gives it from then on
+void sim_setParam(const char *id, uint32_t value);
+
+// for the stand-ins, device.cpp
+bool sim_verbose();
+FILE *sim_card();
+void sim_sync();            // the M4 ran since the last call, the clock catches up
+void sim_charge(double us); // the M4 waits this long, on the SD card
+void sim_sleep();           // exec_waitM0()
+void sim_frameDone();       // blobsLoop() returned
+void sim_i2cSlaveAddr(uint8_t addr);
+void sim_sdWritten(int32_t block, int32_t blocks);
+bool sim_paramsDirty();     // prm_dirty(), once for each change
+void sim_paramsTaken(double us);
+
+const SimFrame *sim_frames(uint32_t *count);
+const SimStats *sim_stats();
+const uint32_t *sim_fills(uint32_t *count);   // the frames the M0 wrote into a slot, in order
+bool sim_sdComplete(int32_t block, int32_t blocks);
+
+#endif
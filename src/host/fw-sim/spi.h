@@ -0,0 +1,24 @@
+/**
+ * @file spi.h
+ * @brief Stands in for device/main_m4/inc/spi.h: an SPI slave no master talks to.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#ifndef _SPI_H
+#define _SPI_H
+#include "iserial.h"
+#include "gpdma.h"
+
+class Spi : public Iserial
+{
+public:
+    void setAutoSlaveSelect(bool ass)
+    {
+    }
+};
+
+void spi_init(SerialCallback callback);
+
+extern Spi *g_spi;
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * @file uart.h
+ * @brief Stands in for device/main_m4/inc/uart.h: the UART without its DMA, the bytes
+ *        the firmware sends and receives are the virtual master's (sim.cpp).
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#ifndef _UART_H
+#define _UART_H
+#include "iserial.h"
+#include "gpdma.h"
+
+#define UART_TRANSMIT_BUF_SIZE     64
+#define UART_RECEIVE_BUF_SIZE      256
+#define UART_DEFAULT_BAUDRATE      19200
+#define UART_MAX_BAUDRATE          12750000  // CLKFREQ/16
+
+class Uart : public Iserial
+{
+public:
+    Uart(SerialCallback callback);
+
+    // Iserial methods
+    virtual int open();
+    virtual int close();
+    virtual int receive(uint8_t *buf, uint32_t len);
+    virtual int receiveLen();
+    virtual int update();
+
+    int setBaudrate(uint32_t baudrate);
+    uint32_t baudrate();
+
+    // the master's end
+    int masterWrite(const uint8_t *buf, uint32_t len);
+    uint32_t masterRead(uint8_t *buf, uint32_t len);
+
+private:
+    ReceiveQ<uint8_t> m_rq;
+    TransmitQ<uint8_t> m_tq;
+    uint32_t m_baudrate;
+    bool m_open;
+};
+
+void uart_init(SerialCallback callback);
+
+extern Uart *g_uart0;
+#endif
@@ -0,0 +1,439 @@
+/**
+ * @file main.cpp
+ * @brief I2C master simulator: how long after a frame a master has its blobs, reading the
+ *        byte stream (legacy or compact frames) or the register map in i2cregs.h, at 100 kHz,
+ *        400 kHz and 1 MHz.  The camera side is the firmware's own FrameQ and I2cRegs, driven
+ *        the way the I2C interrupt drives them, and every read is checked against the scene.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "frameq.h"
+#include "i2cregs.h"
+#include "pixyblocks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAME_WIDTH         320
+#define FRAME_HEIGHT        200
+#define SLOT_LEN            (BF_COMPACT_FRAME_LEN(PB_MAX_BLOCKS) + BF_LEGACY_FRAME_LEN(PB_MAX_BLOCKS))
+#define STREAM_CHUNK        16      // bytes per read transaction in stream mode, like i2c-test
+#define ISR_US              0.6     // slave interrupt entry to DAT loaded, LPC4330 at 204 MHz
+
+typedef struct
+{
+    const char *name;
+    double hz;
+    double bus_free_us;     // tBUF between stop and the next start
+} Speed;
+
+static const Speed speeds_[] =
+{
+    { "100kHz", 100000.0, 4.7 },
+    { "400kHz", 400000.0, 1.3 },
+    { "1MHz", 1000000.0, 0.5 },
+};
+
+static const uint8_t scene_blobs_[] = { 1, 4, 10, 20 };
+
+static uint32_t seed_ = 1;
+static double isr_us_ = ISR_US;
+static double transaction_us_ = 0.0;
+static uint32_t chunk_ = STREAM_CHUNK;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+static void make_scene(uint8_t count, PixyBlock *blocks)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        blocks[i].signature = 1 + rnd(3);
+        blocks[i].width = 2 + rnd(60);
+        blocks[i].height = 2 + rnd(40);
+        blocks[i].x = blocks[i].width / 2 + rnd(FRAME_WIDTH - blocks[i].width);
+        blocks[i].y = blocks[i].height / 2 + rnd(FRAME_HEIGHT - blocks[i].height);
+    }
+}
+
+/*
+ * Bus timing.  Every byte is 8 bits plus ack.  The slave holds SCL low after the ack until
+ * its interrupt has loaded the next byte, which costs time once that takes longer than
+ * half a bit.
+ */
+class Bus
+{
+public:
+    Bus(const Speed *speed) : m_speed(speed), m_us(0.0)
+    {
+    }
+
+    void start()
+    {
+        m_us += transaction_us_ + bit();
+    }
+
+    void restart()
+    {
+        m_us += bit();
+    }
+
+    void byte()
+    {
+        double stretch = isr_us_ - bit() / 2;
+
+        m_us += 9 * bit() + (stretch > 0 ? stretch : 0);
+    }
+
+    void stop()
+    {
+        m_us += bit() + m_speed->bus_free_us;
+    }
+
+    double us()
+    {
+        return m_us;
+    }
+
+private:
+    double bit()
+    {
+        return 1000000.0 / m_speed->hz;
+    }
+
+    const Speed *m_speed;
+    double m_us;
+};
+
+/*
+ * Camera side
+ */
+static void put16(uint8_t *regs, uint8_t addr, uint16_t val)
+{
+    regs[addr] = val & 0xff;
+    regs[addr + 1] = val >> 8;
+}
+
+static uint16_t get16(const uint8_t *regs, uint8_t addr)
+{
+    return regs[addr] | (regs[addr + 1] << 8);
+}
+
+// same as Blobs::encodeRegisters()
+static void publish_registers(I2cRegs *regs, uint16_t seq, uint32_t timestamp, const PixyBlock *blocks, uint8_t count)
+{
+    uint8_t *frame = regs->frameBuf();
+
+    put16(frame, I2CR_FRAME_SEQ, seq);
+    put16(frame, I2CR_TIMESTAMP, timestamp & 0xffff);
+    put16(frame, I2CR_TIMESTAMP + 2, timestamp >> 16);
+    frame[I2CR_BLOB_COUNT] = count;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t *blob = frame + I2CR_BLOB(i);
+        put16(blob, I2CR_BLOB_SIGNATURE, blocks[i].signature);
+        put16(blob, I2CR_BLOB_X, blocks[i].x);
+        put16(blob, I2CR_BLOB_Y, blocks[i].y);
+        put16(blob, I2CR_BLOB_WIDTH, blocks[i].width);
+        put16(blob, I2CR_BLOB_HEIGHT, blocks[i].height);
+    }
+    regs->publish();
+}
+
+static void publish_stream(FrameQ *q, uint8_t format, uint16_t seq, const PixyBlock *blocks, uint8_t count)
+{
+    uint8_t *buf = q->writeBuf();
+
+    if (format == BF_FORMAT_COMPACT)
+        q->publish(pixy_blocks_encode_compact(seq, 0, blocks, count, buf));
+    else
+        q->publish(pixy_blocks_encode_legacy(blocks, count, buf));
+}
+
+/*
+ * Master side, register mode: S addr+W reg Sr addr+R data... P
+ */
+static void reg_read(Bus *bus, I2cRegs *regs, uint8_t addr, uint8_t *buf, uint32_t len)
+{
+    bus->start();
+    bus->byte();
+    regs->startWrite();
+    bus->byte();
+    regs->write(addr);
+    bus->restart();
+    regs->stop();
+    bus->byte();
+    regs->startRead();
+    for (uint32_t i = 0; i < len; i++)
+    {
+        buf[i] = regs->read();
+        bus->byte();
+    }
+    bus->stop();
+}
+
+static void reg_write(Bus *bus, I2cRegs *regs, uint8_t addr, const uint8_t *buf, uint32_t len)
+{
+    bus->start();
+    bus->byte();
+    regs->startWrite();
+    bus->byte();
+    regs->write(addr);
+    for (uint32_t i = 0; i < len; i++)
+    {
+        bus->byte();
+        regs->write(buf[i]);
+    }
+    bus->stop();
+    regs->stop();
+}
+
+static bool same_blob(const uint8_t *blob, const PixyBlock *block)
+{
+    return get16(blob, I2CR_BLOB_SIGNATURE) == block->signature && get16(blob, I2CR_BLOB_X) == block->x &&
+           get16(blob, I2CR_BLOB_Y) == block->y && get16(blob, I2CR_BLOB_WIDTH) == block->width &&
+           get16(blob, I2CR_BLOB_HEIGHT) == block->height;
+}
+
+/*
+ * Master side, stream mode: read chunk_ bytes per transaction until the decoder has the
+ * frame.  Returns how long that took, last_blob_us is when the last blob's bytes were in
+ * (the compact format can't use a blob before the CRC at the end).
+ */
+static int stream_read(Bus *bus, FrameQ *q, uint8_t format, const PixyBlock *blocks, uint8_t count, double *last_blob_us)
+{
+    static PixyBlockDecoder dec;
+    uint8_t buf[STREAM_CHUNK * 4];
+    uint32_t len = 0, index = 0, frame_bytes = 0;
+    uint32_t last_blob_end = BF_LEGACY_FRAME_LEN(count);
+
+    pixy_blocks_init(&dec);
+    while (bus->us() < 1000000.0)
+    {
+        bus->start();
+        bus->byte();
+        for (uint32_t i = 0; i < chunk_; i++)
+        {
+            // the interrupt refills its transmit queue from the frame queue, zeros when idle
+            if (index == len)
+            {
+                index = 0;
+                len = q->read(buf, 2);
+                if (len == 0)
+                {
+                    buf[0] = buf[1] = 0;
+                    len = 2;
+                }
+            }
+            bus->byte();
+            frame_bytes++;
+            if (format == BF_FORMAT_LEGACY && frame_bytes == last_blob_end)
+                *last_blob_us = bus->us();
+            if (pixy_blocks_push(&dec, buf[index++]))
+            {
+                bus->stop();
+                if (dec.count != count || memcmp(dec.blocks, blocks, count * sizeof(PixyBlock)) != 0)
+                    return -1;
+                if (format == BF_FORMAT_COMPACT)
+                    *last_blob_us = bus->us();
+                return 0;
+            }
+        }
+        bus->stop();
+    }
+    return -1;
+}
+
+/*
+ * Checks of the register map itself
+ */
+
+// A frame published while the master is reading must not show up in that read.
+static int check_coherent(const PixyBlock *blocks, uint8_t count)
+{
+    static I2cRegs regs;
+    uint8_t frame[I2CR_SIZE];
+    PixyBlock other[PB_MAX_BLOCKS];
+    Bus bus(&speeds_[0]);
+    uint32_t i;
+
+    make_scene(count, other);
+    publish_registers(&regs, 1, 100, blocks, count);
+
+    bus.start();
+    bus.byte();
+    regs.startWrite();
+    bus.byte();
+    regs.write(0);
+    bus.restart();
+    regs.stop();
+    bus.byte();
+    regs.startRead();
+    for (i = 0; i < I2CR_SIZE; i++)
+    {
+        if (i == I2CR_BLOB(0) + 3u || i == I2CR_BLOB(count / 2) + 1u)
+            publish_registers(&regs, i, 200, other, count);
+        frame[i] = regs.read();
+    }
+    bus.stop();
+
+    if (frame[I2CR_ID] != I2CR_ID_VALUE || frame[I2CR_VERSION] != I2CR_VERSION_VALUE ||
+        get16(frame, I2CR_FRAME_SEQ) != 1 || frame[I2CR_BLOB_COUNT] != count)
+        return -1;
+    for (i = 0; i < count; i++)
+    {
+        if (!same_blob(frame + I2CR_BLOB(i), &blocks[i]))
+            return -1;
+    }
+
+    // the next read gets the latest frame
+    reg_read(&bus, &regs, I2CR_FRAME_SEQ, frame, 2);
+    if (get16(frame, 0) == 1)
+        return -1;
+    return 0;
+}
+
+// Config writes reach the main loop whole, read-only registers and address-only writes don't queue anything.
+static int check_writes()
+{
+    static I2cRegs regs;
+    uint8_t first, last, buf[4];
+    Bus bus(&speeds_[0]);
+
+    buf[0] = 0x34;
+    buf[1] = 0x12;
+    buf[2] = I2CR_SPEED_1M;
+    reg_write(&bus, &regs, I2CR_MIN_AREA, buf, 3);
+    reg_read(&bus, &regs, I2CR_ID, buf, 1);
+    buf[0] = 7;
+    reg_write(&bus, &regs, I2CR_BLOBS, buf, 1);
+    buf[0] = 0xff;
+    buf[1] = I2CR_CONFIG_LOGGING;
+    reg_write(&bus, &regs, I2CR_BLOB_COUNT, buf, 2);
+
+    if (!regs.getWrite(&first, &last) || first != I2CR_MIN_AREA || last != I2CR_SPEED ||
+        regs.config16(I2CR_MIN_AREA) != 0x1234 || regs.config8(I2CR_SPEED) != I2CR_SPEED_1M)
+        return -1;
+    // the write to the blob count started in the read-only part, only its config bytes count
+    if (!regs.getWrite(&first, &last) || first != I2CR_CONFIG || last != I2CR_CONFIG || regs.config8(I2CR_CONFIG) != I2CR_CONFIG_LOGGING)
+        return -1;
+    if (regs.getWrite(&first, &last))
+        return -1;
+    return 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-s seed] [-i us] [-t us] [-c bytes]\n", progname);
+    printf("  -s  Seed for the generated scenes (default: 1)\n");
+    printf("  -i  Slave interrupt time per byte, stretches the clock when longer than half a bit (default: %.1f)\n", ISR_US);
+    printf("  -t  Master overhead per transaction, e.g. a Linux i2c-dev ioctl (default: 0)\n");
+    printf("  -c  Bytes per read transaction in stream mode (default: %d)\n", STREAM_CHUNK);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    PixyBlock blocks[PB_MAX_BLOCKS];
+    uint8_t buf[I2CR_SIZE];
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "s:i:t:c:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 's':
+                seed_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'i':
+                isr_us_ = atof(optarg);
+                break;
+
+            case 't':
+                transaction_us_ = atof(optarg);
+                break;
+
+            case 'c':
+                chunk_ = strtoul(optarg, NULL, 0);
+                if (chunk_ < 2 || chunk_ > STREAM_CHUNK * 4)
+                    help(argv[0]);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    if (check_writes() < 0)
+    {
+        printf("register write check FAILED\n");
+        failures++;
+    }
+
+    printf("Microseconds from a new frame until the master has it, slave interrupt %.1f us, %.1f us per transaction\n",
+           isr_us_, transaction_us_);
+    printf("  stream: %u bytes per read, reading from the start of the frame\n", chunk_);
+    printf("  registers: one read from I2CR_BLOB(i) (one blob) or from I2CR_FRAME_SEQ through the last blob (whole frame)\n");
+
+    for (uint32_t n = 0; n < sizeof(scene_blobs_); n++)
+    {
+        uint8_t count = scene_blobs_[n];
+
+        make_scene(count, blocks);
+        if (check_coherent(blocks, count) < 0)
+        {
+            printf("register coherency check FAILED\n");
+            failures++;
+        }
+
+        printf("\n%d blobs\n", count);
+        printf("  %-7s %13s %13s %14s %13s %13s\n", "speed", "legacy last", "legacy done", "compact done", "reg blob[i]", "reg frame");
+        for (uint32_t s = 0; s < sizeof(speeds_) / sizeof(speeds_[0]); s++)
+        {
+            const Speed *speed = &speeds_[s];
+            FrameQ legacyq(SLOT_LEN), compactq(SLOT_LEN);
+            I2cRegs regs;
+            Bus legacy(speed), compact(speed), one(speed), whole(speed);
+            double legacy_last = 0, compact_last = 0;
+            uint8_t i = rnd(count);
+
+            publish_stream(&legacyq, BF_FORMAT_LEGACY, 1, blocks, count);
+            publish_stream(&compactq, BF_FORMAT_COMPACT, 1, blocks, count);
+            publish_registers(&regs, 1, 0, blocks, count);
+
+            if (stream_read(&legacy, &legacyq, BF_FORMAT_LEGACY, blocks, count, &legacy_last) < 0 ||
+                stream_read(&compact, &compactq, BF_FORMAT_COMPACT, blocks, count, &compact_last) < 0)
+            {
+                printf("  stream decode check FAILED\n");
+                failures++;
+            }
+
+            reg_read(&one, &regs, I2CR_BLOB(i), buf, I2CR_BLOB_LEN);
+            if (!same_blob(buf, &blocks[i]))
+            {
+                printf("  register read check FAILED\n");
+                failures++;
+            }
+            reg_read(&whole, &regs, I2CR_FRAME_SEQ, buf, I2CR_BLOB(count) - I2CR_FRAME_SEQ);
+            if (get16(buf, 0) != 1 || buf[I2CR_BLOB_COUNT - I2CR_FRAME_SEQ] != count ||
+                !same_blob(buf + I2CR_BLOB(count - 1) - I2CR_FRAME_SEQ, &blocks[count - 1]))
+            {
+                printf("  register read check FAILED\n");
+                failures++;
+            }
+
+            printf("  %-7s %13.0f %13.0f %14.0f %13.0f %13.0f\n", speed->name,
+                   legacy_last, legacy.us(), compact.us(), one.us(), whole.us());
+        }
+    }
+
+    return failures ? 1 : 0;
+}
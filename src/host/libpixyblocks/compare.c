@@ -0,0 +1,232 @@
+/**
+ * @file compare.c
+ * @brief Compares legacy and compact block frames for typical scenes: bytes per frame, time
+ *        on the wire and how soon the receiver has the whole frame.  Every frame is also
+ *        decoded again to check the encoders and decoder agree.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "pixyblocks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAME_PERIOD_MS   20.0  // Pixy runs blob detection at 50 frames/s
+#define FRAME_WIDTH       320
+#define FRAME_HEIGHT      200
+
+typedef struct
+{
+    const char *name;
+    uint8_t blobs;
+    uint8_t signatures;
+} Scene;
+
+typedef struct
+{
+    const char *name;
+    double bits_per_second;
+    double bits_per_byte;   // start/stop bits, I2C ack
+    int idle_reads_zero;    // I2C and SPI read zeros when the camera has nothing to send
+} LinkModel;
+
+static const Scene scenes_[] =
+{
+    { "single beacon", 1, 1 },
+    { "few targets", 4, 1 },
+    { "cluttered", 10, 2 },
+    { "full (MAX_BLOBS)", 20, 3 },
+};
+
+static const LinkModel links_[] =
+{
+    { "I2C 100kHz", 100000.0, 9.0, 1 },
+    { "I2C 400kHz", 400000.0, 9.0, 1 },
+    { "UART 19200", 19200.0, 10.0, 0 },
+    { "SPI 1MHz", 1000000.0, 8.0, 1 },
+};
+
+static uint32_t seed_ = 1;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+// blobs come out of the camera grouped by signature
+static void make_scene(const Scene *scene, PixyBlock *blocks)
+{
+    uint8_t i;
+
+    for (i = 0; i < scene->blobs; i++)
+    {
+        blocks[i].signature = 1 + i * scene->signatures / scene->blobs;
+        blocks[i].width = 2 + rnd(60);
+        blocks[i].height = 2 + rnd(40);
+        blocks[i].x = blocks[i].width / 2 + rnd(FRAME_WIDTH - blocks[i].width);
+        blocks[i].y = blocks[i].height / 2 + rnd(FRAME_HEIGHT - blocks[i].height);
+    }
+}
+
+static double wire_ms(const LinkModel *link, uint32_t bytes)
+{
+    return bytes * link->bits_per_byte * 1000.0 / link->bits_per_second;
+}
+
+// How long after the first byte the receiver knows it has the whole frame.  A compact
+// frame carries its length.  A legacy frame ends when the next read returns zeros, or on
+// UART, when both markers of the next frame have arrived.
+static double complete_ms(const LinkModel *link, uint8_t format, uint32_t bytes)
+{
+    double ms = wire_ms(link, bytes);
+
+    if (format == BF_FORMAT_COMPACT)
+        return ms;
+    if (link->idle_reads_zero)
+        return wire_ms(link, bytes + 2);
+    if (ms < FRAME_PERIOD_MS)
+        ms = FRAME_PERIOD_MS;
+    return ms + wire_ms(link, 4);
+}
+
+static int same_blocks(const PixyBlockDecoder *dec, const PixyBlock *blocks, uint8_t count)
+{
+    return dec->count == count && memcmp(dec->blocks, blocks, count * sizeof(PixyBlock)) == 0;
+}
+
+// Decode three frames of the scene back to back, with or without idle zeros between them.
+static int round_trip(const PixyBlock *blocks, uint8_t count, uint8_t format, int idle_zeros)
+{
+    static uint8_t buf[BF_COMPACT_FRAME_LEN(PB_MAX_BLOCKS) + (PB_MAX_BLOCKS + 1) * BF_LEGACY_BLOCK_LEN];
+    static PixyBlockDecoder dec;
+    uint32_t len, i;
+    int frame, frames = 0;
+
+    pixy_blocks_init(&dec);
+    for (frame = 0; frame < 3; frame++)
+    {
+        if (format == BF_FORMAT_COMPACT)
+            len = pixy_blocks_encode_compact(frame, 1000 + frame * 20000, blocks, count, buf);
+        else
+            len = pixy_blocks_encode_legacy(blocks, count, buf);
+        if (idle_zeros)
+        {
+            memset(buf + len, 0, 4);
+            len += 4;
+        }
+        for (i = 0; i < len; i++)
+        {
+            if (pixy_blocks_push(&dec, buf[i]))
+            {
+                if (!same_blocks(&dec, blocks, count) || dec.format != format)
+                    return -1;
+                if (format == BF_FORMAT_COMPACT && (dec.seq != frame || dec.timestamp != 1000 + frame * 20000))
+                    return -1;
+                frames++;
+            }
+        }
+    }
+    if (pixy_blocks_idle(&dec))
+    {
+        if (!same_blocks(&dec, blocks, count))
+            return -1;
+        frames++;
+    }
+    if (frames != 3 || dec.stats.crc_errors || dec.stats.dropped_frames)
+        return -1;
+    return 0;
+}
+
+// A corrupted compact frame must be rejected, and the frame after it counted as a drop.
+static int check_crc(const PixyBlock *blocks, uint8_t count)
+{
+    static uint8_t buf[3 * BF_COMPACT_FRAME_LEN(PB_MAX_BLOCKS)];
+    static PixyBlockDecoder dec;
+    uint32_t len = 0, i;
+    int frames = 0;
+
+    len += pixy_blocks_encode_compact(0xfffe, 0, blocks, count, buf + len);
+    i = len;
+    len += pixy_blocks_encode_compact(0xffff, 0, blocks, count, buf + len);
+    buf[i + BF_COMPACT_HEADER_LEN] ^= 0x04;
+    len += pixy_blocks_encode_compact(0, 0, blocks, count, buf + len);
+
+    pixy_blocks_init(&dec);
+    for (i = 0; i < len; i++)
+        frames += pixy_blocks_push(&dec, buf[i]);
+
+    if (frames != 2 || dec.seq != 0 || dec.stats.crc_errors != 1 || dec.stats.dropped_frames != 1)
+        return -1;
+    return 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-s seed]\n", progname);
+    printf("  -s  Seed for the generated scenes (default: 1)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t legacy[(PB_MAX_BLOCKS + 1) * BF_LEGACY_BLOCK_LEN];
+    static uint8_t compact[BF_COMPACT_FRAME_LEN(PB_MAX_BLOCKS)];
+    PixyBlock blocks[PB_MAX_BLOCKS];
+    uint32_t legacy_len, compact_len;
+    unsigned int s, l;
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "hs:")) != EOF)
+    {
+        switch (arg)
+        {
+            case 's':
+                seed_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    for (s = 0; s < sizeof(scenes_) / sizeof(scenes_[0]); s++)
+    {
+        const Scene *scene = &scenes_[s];
+
+        make_scene(scene, blocks);
+        legacy_len = pixy_blocks_encode_legacy(blocks, scene->blobs, legacy);
+        compact_len = pixy_blocks_encode_compact(0, 0, blocks, scene->blobs, compact);
+
+        printf("%s, %d blobs: legacy %u bytes, compact %u bytes (%+.0f%%)\n", scene->name, scene->blobs,
+               legacy_len, compact_len, 100.0 * ((double)compact_len / legacy_len - 1.0));
+        printf("  %-12s %10s %10s %14s %14s\n", "link", "legacy ms", "compact ms", "legacy done ms", "compact done ms");
+        for (l = 0; l < sizeof(links_) / sizeof(links_[0]); l++)
+        {
+            const LinkModel *link = &links_[l];
+            printf("  %-12s %10.2f %10.2f %14.2f %14.2f%s\n", link->name,
+                   wire_ms(link, legacy_len), wire_ms(link, compact_len),
+                   complete_ms(link, BF_FORMAT_LEGACY, legacy_len), complete_ms(link, BF_FORMAT_COMPACT, compact_len),
+                   wire_ms(link, legacy_len) > FRAME_PERIOD_MS ? "  (legacy can't keep up with 50 fps)" : "");
+        }
+
+        if (round_trip(blocks, scene->blobs, BF_FORMAT_LEGACY, 1) < 0 ||
+            round_trip(blocks, scene->blobs, BF_FORMAT_LEGACY, 0) < 0 ||
+            round_trip(blocks, scene->blobs, BF_FORMAT_COMPACT, 1) < 0 ||
+            round_trip(blocks, scene->blobs, BF_FORMAT_COMPACT, 0) < 0 ||
+            check_crc(blocks, scene->blobs) < 0)
+        {
+            printf("  decode check FAILED\n");
+            failures++;
+        }
+    }
+
+    // an empty compact frame still has its header and CRC, the legacy format sends nothing at all
+    printf("empty frame: legacy 0 bytes, compact %u bytes\n", pixy_blocks_encode_compact(0, 0, blocks, 0, compact));
+
+    return failures ? 1 : 0;
+}
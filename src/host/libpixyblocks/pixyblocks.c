@@ -0,0 +1,731 @@
+/**
+ * @file pixyblocks.c
+ * @brief Decoder and encoder for the block frames Pixy sends over I2C, SPI and UART
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "pixyblocks.h"
+
+#include <string.h>
+
+enum
+{
+    PB_STATE_SYNC,            // looking for a marker
+    PB_STATE_LEGACY_BODY,     // checksum and five fields of a legacy block
+    PB_STATE_LEGACY_NEXT,     // marker of the next legacy block, or idle
+    PB_STATE_COMPACT_HEADER,  // seq, timestamp and count
+    PB_STATE_COMPACT_RECORDS,
+    PB_STATE_COMPACT_CRC,
+    PB_STATE_COMPACT_PAD,     // also after responses
+    PB_STATE_RESPONSE         // seq, cmd, result, len, payload and crc
+};
+
+#define PB_LEGACY_BODY_LEN    (BF_LEGACY_BLOCK_LEN - 2)
+#define PB_RESPONSE_HEADER    (BF_RESPONSE_HEADER_LEN - 2)
+
+static uint16_t get_word(const uint8_t *buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+static uint8_t *put_word(uint8_t *p, uint16_t w)
+{
+    *p++ = w & 0xff;
+    *p++ = w >> 8;
+    return p;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t val)
+{
+    while (val >= 0x80)
+    {
+        *p++ = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+    return p;
+}
+
+uint16_t pixy_blocks_crc16(const uint8_t *buf, uint32_t len)
+{
+    uint16_t crc = 0;
+    uint32_t i;
+    int bit;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= buf[i] << 8;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+void pixy_blocks_init(PixyBlockDecoder *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->state = PB_STATE_SYNC;
+}
+
+static void resync(PixyBlockDecoder *dec)
+{
+    dec->stats.sync_errors++;
+    dec->state = PB_STATE_SYNC;
+    dec->have_prev = 0;
+    dec->framed = 0;
+    dec->pending = 0;
+}
+
+static int publish(PixyBlockDecoder *dec, uint8_t format, uint16_t seq, uint32_t timestamp)
+{
+    if (format == BF_FORMAT_TRACKS)
+        memcpy(dec->tracks, dec->work_tracks, dec->pending * sizeof(PixyTrack));
+    else if (format == BF_FORMAT_BEACONS)
+        memcpy(dec->beacons, dec->work_beacons, dec->pending * sizeof(PixyBeacon));
+    else if (format == BF_FORMAT_POSE)
+        dec->pose = dec->work_pose;
+    else
+    {
+        memcpy(dec->blocks, dec->work, dec->pending * sizeof(PixyBlock));
+        if (format == BF_FORMAT_INTENSITY)
+            memcpy(dec->intensities, dec->work_intensities, dec->pending * sizeof(PixyIntensity));
+    }
+    dec->count = dec->pending;
+    dec->format = format;
+    dec->seq = seq;
+    dec->timestamp = timestamp;
+    dec->pending = 0;
+    dec->stats.frames++;
+    return 1;
+}
+
+// A legacy frame ends when something other than a block follows.  Blocks seen before
+// the first frame marker belong to a frame we only got part of, so they are dropped.
+static int finish_legacy(PixyBlockDecoder *dec)
+{
+    int result = 0;
+
+    if (dec->framed && dec->pending > 0)
+        result = publish(dec, BF_FORMAT_LEGACY, dec->seq + 1, 0);
+    dec->framed = 0;
+    dec->pending = 0;
+    return result;
+}
+
+// the compact, tracks, beacons, pose and intensity formats share the header, CRC and pad
+static int compact_marker(uint16_t word)
+{
+    return word == BF_COMPACT_MARKER || word == BF_TRACKS_MARKER || word == BF_BEACONS_MARKER || word == BF_POSE_MARKER ||
+        word == BF_INTENSITY_MARKER;
+}
+
+static void start_compact(PixyBlockDecoder *dec, uint16_t marker)
+{
+    dec->state = PB_STATE_COMPACT_HEADER;
+    if (marker == BF_TRACKS_MARKER)
+        dec->record_format = BF_FORMAT_TRACKS;
+    else if (marker == BF_BEACONS_MARKER)
+        dec->record_format = BF_FORMAT_BEACONS;
+    else if (marker == BF_POSE_MARKER)
+        dec->record_format = BF_FORMAT_POSE;
+    else if (marker == BF_INTENSITY_MARKER)
+        dec->record_format = BF_FORMAT_INTENSITY;
+    else
+        dec->record_format = BF_FORMAT_COMPACT;
+    dec->len = 0;
+    dec->pending = 0;
+}
+
+static void start_response(PixyBlockDecoder *dec)
+{
+    dec->state = PB_STATE_RESPONSE;
+    dec->len = 0;
+}
+
+static int response_byte(PixyBlockDecoder *dec, uint8_t byte)
+{
+    uint16_t len;
+
+    dec->buf[dec->len++] = byte;
+    if (dec->len == PB_RESPONSE_HEADER && dec->buf[3] > BF_MAX_CMD_PAYLOAD)
+    {
+        resync(dec);
+        return 0;
+    }
+    if (dec->len < PB_RESPONSE_HEADER)
+        return 0;
+    len = PB_RESPONSE_HEADER + dec->buf[3] + 2;
+    if (dec->len < len)
+        return 0;
+
+    dec->have_prev = 0;
+    if (pixy_blocks_crc16(dec->buf, len - 2) != get_word(dec->buf + len - 2))
+    {
+        dec->stats.crc_errors++;
+        dec->state = PB_STATE_SYNC;
+        return 0;
+    }
+    dec->response.seq = dec->buf[0];
+    dec->response.cmd = dec->buf[1];
+    dec->response.result = dec->buf[2];
+    dec->response.len = dec->buf[3];
+    memcpy(dec->response.data, dec->buf + PB_RESPONSE_HEADER, dec->response.len);
+    dec->response_ready = 1;
+    dec->stats.responses++;
+    dec->state = (len & 1) ? PB_STATE_COMPACT_PAD : PB_STATE_SYNC;
+    return 0;
+}
+
+static void legacy_block(PixyBlockDecoder *dec)
+{
+    const uint8_t *b = dec->buf;
+    uint16_t checksum = get_word(b);
+    PixyBlock block;
+
+    block.signature = get_word(b + 2);
+    block.x = get_word(b + 4);
+    block.y = get_word(b + 6);
+    block.width = get_word(b + 8);
+    block.height = get_word(b + 10);
+
+    if ((uint16_t)(block.signature + block.x + block.y + block.width + block.height) != checksum)
+        dec->stats.crc_errors++;
+    else if (dec->pending < PB_MAX_BLOCKS)
+        dec->work[dec->pending++] = block;
+}
+
+// intensity records are compact ones with three plain fields after them
+static int compact_field(PixyBlockDecoder *dec, uint32_t val)
+{
+    const PixyBlock *prev = dec->pending ? &dec->work[dec->pending - 1] : NULL;
+    uint8_t intensity = dec->record_format == BF_FORMAT_INTENSITY;
+    PixyIntensity *in;
+    PixyBlock *block;
+
+    // signature, x and y are deltas from the previous record
+    switch (dec->field)
+    {
+    case 0:
+        val = (prev ? prev->signature : 0) + BF_UNZIGZAG(val);
+        break;
+    case 1:
+        val = (prev ? prev->x : 0) + BF_UNZIGZAG(val);
+        break;
+    case 2:
+        val = (prev ? prev->y : 0) + BF_UNZIGZAG(val);
+        break;
+    }
+    dec->fields[dec->field++] = val;
+    if (dec->field < (intensity ? 8 : 5))
+        return 0;
+
+    if (intensity)
+    {
+        in = &dec->work_intensities[dec->pending];
+        in->peak = dec->fields[5];
+        in->mean = dec->fields[6];
+        in->flags = dec->fields[7];
+    }
+    block = &dec->work[dec->pending++];
+    block->signature = dec->fields[0];
+    block->x = dec->fields[1];
+    block->y = dec->fields[2];
+    block->width = dec->fields[3];
+    block->height = dec->fields[4];
+    dec->field = 0;
+    return dec->pending == dec->records;
+}
+
+// tracks records are nine fields, only the id is a delta
+static int track_field(PixyBlockDecoder *dec, uint32_t val)
+{
+    const PixyTrack *prev = dec->pending ? &dec->work_tracks[dec->pending - 1] : NULL;
+    PixyTrack *track;
+
+    if (dec->field == 0)
+        val = (prev ? prev->id : 0) + BF_UNZIGZAG(val);
+    else if (dec->field == 4 || dec->field == 5)
+        val = BF_UNZIGZAG(val);
+    dec->fields[dec->field++] = val;
+    if (dec->field < 9)
+        return 0;
+
+    track = &dec->work_tracks[dec->pending++];
+    track->id = dec->fields[0];
+    track->signature = dec->fields[1];
+    track->x = dec->fields[2];
+    track->y = dec->fields[3];
+    track->vx = (int16_t)dec->fields[4];
+    track->vy = (int16_t)dec->fields[5];
+    track->width = dec->fields[6];
+    track->height = dec->fields[7];
+    track->age = dec->fields[8];
+    dec->field = 0;
+    return dec->pending == dec->records;
+}
+
+// beacons records are seven plain fields
+static int beacon_field(PixyBlockDecoder *dec, uint32_t val)
+{
+    PixyBeacon *beacon;
+
+    dec->fields[dec->field++] = val;
+    if (dec->field < 7)
+        return 0;
+
+    beacon = &dec->work_beacons[dec->pending++];
+    beacon->beacon = dec->fields[0];
+    beacon->track = dec->fields[1];
+    beacon->signature = dec->fields[2];
+    beacon->x = dec->fields[3];
+    beacon->y = dec->fields[4];
+    beacon->width = dec->fields[5];
+    beacon->height = dec->fields[6];
+    dec->field = 0;
+    return dec->pending == dec->records;
+}
+
+// the pose record is six fields, x and y zigzag
+static int pose_field(PixyBlockDecoder *dec, uint32_t val)
+{
+    PixyPose *pose = &dec->work_pose;
+
+    if (dec->field == 1 || dec->field == 2)
+        val = BF_UNZIGZAG(val);
+    dec->fields[dec->field++] = val;
+    if (dec->field < 6)
+        return 0;
+
+    pose->inliers = dec->fields[0];
+    pose->x = (int16_t)dec->fields[1];
+    pose->y = (int16_t)dec->fields[2];
+    pose->z = dec->fields[3];
+    pose->yaw = dec->fields[4];
+    pose->error = dec->fields[5];
+    dec->pending++;
+    dec->field = 0;
+    return dec->pending == dec->records;
+}
+
+static int record_field(PixyBlockDecoder *dec, uint32_t val)
+{
+    if (dec->record_format == BF_FORMAT_POSE)
+        return pose_field(dec, val);
+    if (dec->record_format == BF_FORMAT_TRACKS)
+        return track_field(dec, val);
+    if (dec->record_format == BF_FORMAT_BEACONS)
+        return beacon_field(dec, val);
+    return compact_field(dec, val);
+}
+
+static int compact_crc(PixyBlockDecoder *dec)
+{
+    uint16_t crc = get_word(dec->buf + dec->len - 2);
+    uint16_t seq = get_word(dec->buf);
+    uint32_t timestamp = get_word(dec->buf + 2) | ((uint32_t)get_word(dec->buf + 4) << 16);
+    int result;
+
+    if (pixy_blocks_crc16(dec->buf, dec->len - 2) != crc)
+    {
+        dec->stats.crc_errors++;
+        dec->state = PB_STATE_SYNC;
+        dec->have_prev = 0;
+        dec->pending = 0;
+        return 0;
+    }
+
+    if (dec->have_last_seq)
+        dec->stats.dropped_frames += (uint16_t)(seq - dec->last_seq - 1);
+    dec->last_seq = seq;
+    dec->have_last_seq = 1;
+    result = publish(dec, dec->record_format, seq, timestamp);
+
+    // marker + data is odd, so the camera added a pad byte
+    dec->state = (dec->len & 1) ? PB_STATE_COMPACT_PAD : PB_STATE_SYNC;
+    dec->have_prev = 0;
+    return result;
+}
+
+int pixy_blocks_push(PixyBlockDecoder *dec, uint8_t byte)
+{
+    uint16_t word;
+    int result;
+
+    switch (dec->state)
+    {
+    case PB_STATE_SYNC:
+        if (dec->have_prev)
+        {
+            word = dec->prev | (byte << 8);
+            if (word == BF_LEGACY_MARKER)
+            {
+                dec->state = PB_STATE_LEGACY_BODY;
+                dec->len = 0;
+                dec->have_prev = 0;
+                return 0;
+            }
+            if (compact_marker(word))
+            {
+                start_compact(dec, word);
+                dec->have_prev = 0;
+                return 0;
+            }
+            if (word == BF_RESPONSE_MARKER)
+            {
+                start_response(dec);
+                dec->have_prev = 0;
+                return 0;
+            }
+            if (dec->prev)  // zeros are what I2C and SPI read when there's nothing to send
+                dec->stats.sync_errors++;
+        }
+        dec->prev = byte;
+        dec->have_prev = 1;
+        return 0;
+
+    case PB_STATE_LEGACY_BODY:
+        dec->buf[dec->len++] = byte;
+        if (dec->len == 2)
+        {
+            word = get_word(dec->buf);
+            // two markers in a row start a frame
+            if (word == BF_LEGACY_MARKER)
+            {
+                result = finish_legacy(dec);
+                dec->framed = 1;
+                dec->len = 0;
+                return result;
+            }
+            if (compact_marker(word))
+            {
+                result = finish_legacy(dec);
+                start_compact(dec, word);
+                return result;
+            }
+            if (word == BF_RESPONSE_MARKER)
+            {
+                result = finish_legacy(dec);
+                start_response(dec);
+                return result;
+            }
+        }
+        if (dec->len == PB_LEGACY_BODY_LEN)
+        {
+            legacy_block(dec);
+            dec->state = PB_STATE_LEGACY_NEXT;
+            dec->len = 0;
+        }
+        return 0;
+
+    case PB_STATE_LEGACY_NEXT:
+        dec->buf[dec->len++] = byte;
+        if (dec->len < 2)
+            return 0;
+        word = get_word(dec->buf);
+        dec->len = 0;
+        if (word == BF_LEGACY_MARKER)
+        {
+            dec->state = PB_STATE_LEGACY_BODY;
+            return 0;
+        }
+        if (compact_marker(word))
+        {
+            result = finish_legacy(dec);
+            start_compact(dec, word);
+            return result;
+        }
+        if (word == BF_RESPONSE_MARKER)
+        {
+            result = finish_legacy(dec);
+            start_response(dec);
+            return result;
+        }
+        if (word == 0)
+        {
+            result = finish_legacy(dec);
+            dec->state = PB_STATE_SYNC;
+            dec->have_prev = 0;
+            return result;
+        }
+        resync(dec);
+        dec->prev = byte;
+        dec->have_prev = 1;
+        return 0;
+
+    case PB_STATE_COMPACT_HEADER:
+        dec->buf[dec->len++] = byte;
+        if (dec->len < BF_COMPACT_HEADER_LEN - 2)
+            return 0;
+        dec->records = dec->buf[dec->len - 1];
+        if ((dec->record_format != BF_FORMAT_COMPACT && dec->record_format != BF_FORMAT_INTENSITY &&
+             dec->records > PB_MAX_TRACKS) ||
+            (dec->record_format == BF_FORMAT_POSE && dec->records > 1))
+        {
+            resync(dec);
+            return 0;
+        }
+        dec->field = 0;
+        dec->varint = 0;
+        dec->varint_len = 0;
+        dec->state = dec->records ? PB_STATE_COMPACT_RECORDS : PB_STATE_COMPACT_CRC;
+        return 0;
+
+    case PB_STATE_COMPACT_RECORDS:
+        dec->buf[dec->len++] = byte;
+        dec->varint |= (uint32_t)(byte & 0x7f) << (7 * dec->varint_len++);
+        if (byte & 0x80)
+        {
+            if (dec->varint_len >= BF_MAX_VARINT_LEN)
+                resync(dec);
+            return 0;
+        }
+        if (record_field(dec, dec->varint))
+            dec->state = PB_STATE_COMPACT_CRC;
+        dec->varint = 0;
+        dec->varint_len = 0;
+        return 0;
+
+    case PB_STATE_COMPACT_CRC:
+        dec->buf[dec->len++] = byte;
+        if (++dec->field < BF_COMPACT_CRC_LEN)
+            return 0;
+        return compact_crc(dec);
+
+    case PB_STATE_COMPACT_PAD:
+        dec->state = PB_STATE_SYNC;
+        return 0;
+
+    case PB_STATE_RESPONSE:
+        return response_byte(dec, byte);
+    }
+
+    return 0;
+}
+
+int pixy_blocks_idle(PixyBlockDecoder *dec)
+{
+    if (dec->state != PB_STATE_LEGACY_NEXT || dec->len != 0)
+        return 0;
+    dec->state = PB_STATE_SYNC;
+    dec->have_prev = 0;
+    return finish_legacy(dec);
+}
+
+uint32_t pixy_blocks_encode_compact(uint16_t seq, uint32_t timestamp, const PixyBlock *blocks, uint8_t count, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint16_t prev_signature = 0, prev_x = 0, prev_y = 0, crc;
+    uint8_t i;
+
+    p = put_word(p, BF_COMPACT_MARKER);
+    p = put_word(p, seq);
+    p = put_word(p, timestamp & 0xffff);
+    p = put_word(p, timestamp >> 16);
+    *p++ = count;
+    for (i = 0; i < count; i++)
+    {
+        p = put_varint(p, BF_ZIGZAG((int32_t)blocks[i].signature - prev_signature));
+        p = put_varint(p, BF_ZIGZAG((int32_t)blocks[i].x - prev_x));
+        p = put_varint(p, BF_ZIGZAG((int32_t)blocks[i].y - prev_y));
+        p = put_varint(p, blocks[i].width);
+        p = put_varint(p, blocks[i].height);
+        prev_signature = blocks[i].signature;
+        prev_x = blocks[i].x;
+        prev_y = blocks[i].y;
+    }
+    crc = pixy_blocks_crc16(buf + 2, p - buf - 2);
+    p = put_word(p, crc);
+    if ((p - buf) & 1)
+        *p++ = 0;
+
+    return p - buf;
+}
+
+uint32_t pixy_blocks_encode_intensity(uint16_t seq, uint32_t timestamp, const PixyBlock *blocks, const PixyIntensity *intensities, uint8_t count, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint16_t prev_signature = 0, prev_x = 0, prev_y = 0, crc;
+    uint8_t i;
+
+    p = put_word(p, BF_INTENSITY_MARKER);
+    p = put_word(p, seq);
+    p = put_word(p, timestamp & 0xffff);
+    p = put_word(p, timestamp >> 16);
+    *p++ = count;
+    for (i = 0; i < count; i++)
+    {
+        p = put_varint(p, BF_ZIGZAG((int32_t)blocks[i].signature - prev_signature));
+        p = put_varint(p, BF_ZIGZAG((int32_t)blocks[i].x - prev_x));
+        p = put_varint(p, BF_ZIGZAG((int32_t)blocks[i].y - prev_y));
+        p = put_varint(p, blocks[i].width);
+        p = put_varint(p, blocks[i].height);
+        p = put_varint(p, intensities[i].peak);
+        p = put_varint(p, intensities[i].mean);
+        p = put_varint(p, intensities[i].flags);
+        prev_signature = blocks[i].signature;
+        prev_x = blocks[i].x;
+        prev_y = blocks[i].y;
+    }
+    crc = pixy_blocks_crc16(buf + 2, p - buf - 2);
+    p = put_word(p, crc);
+    if ((p - buf) & 1)
+        *p++ = 0;
+
+    return p - buf;
+}
+
+uint32_t pixy_blocks_encode_tracks(uint16_t seq, uint32_t timestamp, const PixyTrack *tracks, uint8_t count, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint16_t prev_id = 0, crc;
+    uint8_t i;
+
+    p = put_word(p, BF_TRACKS_MARKER);
+    p = put_word(p, seq);
+    p = put_word(p, timestamp & 0xffff);
+    p = put_word(p, timestamp >> 16);
+    *p++ = count;
+    for (i = 0; i < count; i++)
+    {
+        p = put_varint(p, BF_ZIGZAG((int32_t)tracks[i].id - prev_id));
+        p = put_varint(p, tracks[i].signature);
+        p = put_varint(p, tracks[i].x);
+        p = put_varint(p, tracks[i].y);
+        p = put_varint(p, BF_ZIGZAG(tracks[i].vx));
+        p = put_varint(p, BF_ZIGZAG(tracks[i].vy));
+        p = put_varint(p, tracks[i].width);
+        p = put_varint(p, tracks[i].height);
+        p = put_varint(p, tracks[i].age);
+        prev_id = tracks[i].id;
+    }
+    crc = pixy_blocks_crc16(buf + 2, p - buf - 2);
+    p = put_word(p, crc);
+    if ((p - buf) & 1)
+        *p++ = 0;
+
+    return p - buf;
+}
+
+uint32_t pixy_blocks_encode_beacons(uint16_t seq, uint32_t timestamp, const PixyBeacon *beacons, uint8_t count, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint16_t crc;
+    uint8_t i;
+
+    p = put_word(p, BF_BEACONS_MARKER);
+    p = put_word(p, seq);
+    p = put_word(p, timestamp & 0xffff);
+    p = put_word(p, timestamp >> 16);
+    *p++ = count;
+    for (i = 0; i < count; i++)
+    {
+        p = put_varint(p, beacons[i].beacon);
+        p = put_varint(p, beacons[i].track);
+        p = put_varint(p, beacons[i].signature);
+        p = put_varint(p, beacons[i].x);
+        p = put_varint(p, beacons[i].y);
+        p = put_varint(p, beacons[i].width);
+        p = put_varint(p, beacons[i].height);
+    }
+    crc = pixy_blocks_crc16(buf + 2, p - buf - 2);
+    p = put_word(p, crc);
+    if ((p - buf) & 1)
+        *p++ = 0;
+
+    return p - buf;
+}
+
+uint32_t pixy_blocks_encode_pose(uint16_t seq, uint32_t timestamp, const PixyPose *pose, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint16_t crc;
+
+    p = put_word(p, BF_POSE_MARKER);
+    p = put_word(p, seq);
+    p = put_word(p, timestamp & 0xffff);
+    p = put_word(p, timestamp >> 16);
+    *p++ = pose ? 1 : 0;
+    if (pose)
+    {
+        p = put_varint(p, pose->inliers);
+        p = put_varint(p, BF_ZIGZAG(pose->x));
+        p = put_varint(p, BF_ZIGZAG(pose->y));
+        p = put_varint(p, pose->z);
+        p = put_varint(p, pose->yaw);
+        p = put_varint(p, pose->error);
+    }
+    crc = pixy_blocks_crc16(buf + 2, p - buf - 2);
+    p = put_word(p, crc);
+    if ((p - buf) & 1)
+        *p++ = 0;
+
+    return p - buf;
+}
+
+uint32_t pixy_blocks_encode_legacy(const PixyBlock *blocks, uint16_t count, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint16_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (i == 0)
+            p = put_word(p, BF_LEGACY_MARKER);
+        p = put_word(p, BF_LEGACY_MARKER);
+        p = put_word(p, blocks[i].signature + blocks[i].x + blocks[i].y + blocks[i].width + blocks[i].height);
+        p = put_word(p, blocks[i].signature);
+        p = put_word(p, blocks[i].x);
+        p = put_word(p, blocks[i].y);
+        p = put_word(p, blocks[i].width);
+        p = put_word(p, blocks[i].height);
+    }
+
+    return p - buf;
+}
+
+void pixy_blocks_format_cmd(uint8_t format, uint8_t cmd[2])
+{
+    cmd[0] = 0xa5;  // SER_SYNC_BYTE
+    if (format == BF_FORMAT_POSE)
+        cmd[1] = BF_CMD_POSE_FRAMES;
+    else if (format == BF_FORMAT_INTENSITY)
+        cmd[1] = BF_CMD_INTENSITY_FRAMES;
+    else
+        cmd[1] = format <= BF_FORMAT_BEACONS ? BF_CMD_LEGACY_FRAMES + format : BF_CMD_LEGACY_FRAMES;
+}
+
+void pixy_blocks_depth_cmd(uint8_t depth, uint8_t cmd[2])
+{
+    if (depth < 1)
+        depth = 1;
+    else if (depth > BF_MAX_QUEUED_FRAMES)
+        depth = BF_MAX_QUEUED_FRAMES;
+    cmd[0] = 0xa5;  // SER_SYNC_BYTE
+    cmd[1] = BF_CMD_FRAME_DEPTH(depth);
+}
+
+int pixy_blocks_response(PixyBlockDecoder *dec, PixyResponse *resp)
+{
+    if (!dec->response_ready)
+        return 0;
+    *resp = dec->response;
+    dec->response_ready = 0;
+    return 1;
+}
+
+uint32_t pixy_blocks_command(uint8_t seq, uint8_t cmd, const uint8_t *payload, uint8_t len, uint8_t *buf)
+{
+    uint8_t *p = buf;
+
+    if (len > BF_MAX_CMD_PAYLOAD)
+        return 0;
+    *p++ = BF_CMD_FRAME_SYNC;
+    *p++ = seq;
+    *p++ = cmd;
+    *p++ = len;
+    memcpy(p, payload, len);
+    p += len;
+    p = put_word(p, pixy_blocks_crc16(buf + 1, p - buf - 1));
+
+    return p - buf;
+}
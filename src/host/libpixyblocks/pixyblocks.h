@@ -0,0 +1,227 @@
+/**
+ * @file pixyblocks.h
+ * @brief Decoder and encoder for the block frames Pixy sends over I2C, SPI and UART
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ *
+ * Both the legacy format (14 bytes per block) and the compact format (one header and
+ * one CRC per frame, varint/delta packed records) are described in blockframe.h, as are
+ * the tracks and beacons formats, which carry the camera's tracker output instead of
+ * blocks, the pose format, which carries where the camera found the landing pad, and the
+ * intensity format, the compact format's blocks with how bright each one is.  The
+ * decoder takes one byte at a time so it works with any link, and it follows the
+ * camera when the format is switched.  It also picks out the responses to command frames,
+ * which the camera sends between block frames.
+ */
+
+#ifndef __PIXYBLOCKS_H__
+#define __PIXYBLOCKS_H__
+
+#include <stdint.h>
+#include "blockframe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PB_MAX_BLOCKS         BF_MAX_RECORDS
+#define PB_MAX_TRACKS         BF_MAX_TRACKS
+#define PB_MAX_COMPACT_DATA   (BF_COMPACT_HEADER_LEN - 2 + PB_MAX_BLOCKS*BF_MAX_RECORD_LEN + BF_COMPACT_CRC_LEN)  // all but the marker
+#define PB_MAX_TRACKS_DATA    (BF_COMPACT_HEADER_LEN - 2 + PB_MAX_TRACKS*BF_MAX_TRACK_RECORD_LEN + BF_COMPACT_CRC_LEN)
+#define PB_MAX_INTENSITY_DATA (BF_COMPACT_HEADER_LEN - 2 + PB_MAX_BLOCKS*BF_MAX_INTENSITY_RECORD_LEN + BF_COMPACT_CRC_LEN)
+#define PB_MAX_DATA           PB_MAX_INTENSITY_DATA  // the most of any format
+
+typedef struct
+{
+    uint16_t signature;
+    uint16_t x;               // center in pixels, or int16 if BF_CMD_SET_COORDS says otherwise
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} PixyBlock;
+
+typedef struct
+{
+    uint8_t peak;             // brightest pixel, 0 if the camera doesn't measure intensity
+    uint8_t mean;             // of the block's pixels
+    uint8_t flags;            // BF_INTENSITY_xxx
+} PixyIntensity;
+
+typedef struct
+{
+    uint16_t id;              // stays with the target while the camera tracks it
+    uint16_t signature;
+    uint16_t x;               // filtered center in 1/BF_TRACK_POS_SCALE pixels
+    uint16_t y;
+    int16_t vx;               // pixels per second
+    int16_t vy;
+    uint16_t width;
+    uint16_t height;
+    uint16_t age;             // frames since the track started
+} PixyTrack;
+
+typedef struct
+{
+    uint8_t beacon;           // 1..BC_NUM_CODES, which code it blinks
+    uint16_t track;           // id of the track it's on
+    uint16_t signature;
+    uint16_t x;               // center in 1/BF_TRACK_POS_SCALE pixels
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} PixyBeacon;
+
+typedef struct
+{
+    uint8_t inliers;          // pad points matched to blobs
+    int16_t x;                // pad origin in the camera frame, mm
+    int16_t y;
+    uint16_t z;
+    uint16_t yaw;             // 1/100 degrees, 0..35999
+    uint16_t error;           // rms reprojection error in 1/BF_POSE_ERROR_SCALE pixels
+} PixyPose;
+
+typedef struct
+{
+    uint32_t frames;          // complete frames returned by pixy_blocks_push()
+    uint32_t crc_errors;      // compact frames or legacy blocks that failed their check
+    uint32_t dropped_frames;  // gaps in the compact sequence number
+    uint32_t sync_errors;     // bytes thrown away while looking for a marker
+    uint32_t responses;       // responses to command frames
+} PixyBlockStats;
+
+typedef struct
+{
+    uint8_t seq;              // as sent in the command frame
+    uint8_t cmd;
+    uint8_t result;           // BF_RESULT_xxx
+    uint8_t len;
+    uint8_t data[BF_MAX_CMD_PAYLOAD];
+} PixyResponse;
+
+typedef struct
+{
+    // the last complete frame, valid after pixy_blocks_push() returns 1
+    uint8_t format;           // BF_FORMAT_xxx
+    uint16_t seq;             // camera's sequence number (compact, tracks), local count (legacy)
+    uint32_t timestamp;       // capture time in microseconds (compact, tracks), 0 (legacy)
+    uint16_t count;           // blocks, tracks, beacons or poses (0 or 1), depending on format
+    PixyBlock blocks[PB_MAX_BLOCKS];
+    PixyIntensity intensities[PB_MAX_BLOCKS];  // of the blocks, intensity format only
+    PixyTrack tracks[PB_MAX_TRACKS];
+    PixyBeacon beacons[PB_MAX_TRACKS];
+    PixyPose pose;
+
+    PixyBlockStats stats;
+
+    // the last response, see pixy_blocks_response()
+    PixyResponse response;
+    uint8_t response_ready;
+
+    // parser state, private
+    int state;
+    uint8_t prev;
+    uint8_t have_prev;
+    uint8_t framed;
+    uint16_t last_seq;
+    uint8_t have_last_seq;
+    uint16_t pending;
+    uint8_t record_format;
+    PixyBlock work[PB_MAX_BLOCKS];
+    PixyIntensity work_intensities[PB_MAX_BLOCKS];
+    PixyTrack work_tracks[PB_MAX_TRACKS];
+    PixyBeacon work_beacons[PB_MAX_TRACKS];
+    PixyPose work_pose;
+    uint8_t buf[PB_MAX_DATA];
+    uint16_t len;
+    uint16_t records;
+    uint8_t field;
+    uint8_t varint_len;
+    uint32_t varint;
+    uint16_t fields[9];
+} PixyBlockDecoder;
+
+void pixy_blocks_init(PixyBlockDecoder *dec);
+
+/**
+ * Feed one received byte to the decoder.
+ * @return 1 when a frame is complete (dec->format, dec->blocks (and intensities), tracks, beacons or pose, dec->count,
+ *         dec->seq and dec->timestamp are valid until the next call), 0 otherwise
+ */
+int pixy_blocks_push(PixyBlockDecoder *dec, uint8_t byte);
+
+/**
+ * Tell the decoder the link is idle (nothing more to read for now).  Legacy frames have
+ * no length, so a pending legacy frame is returned here instead of when the next frame
+ * starts.  I2C and SPI read zeros when idle, which the decoder also takes as end of frame.
+ * @return 1 when this completed a frame, 0 otherwise
+ */
+int pixy_blocks_idle(PixyBlockDecoder *dec);
+
+/**
+ * Check for a response to a command frame after pixy_blocks_push() or pixy_blocks_idle().
+ * Responses are kept until the next one arrives, so check after every call.
+ * @return 1 and fills in resp if a response arrived since the last check, 0 otherwise
+ */
+int pixy_blocks_response(PixyBlockDecoder *dec, PixyResponse *resp);
+
+/** CRC-16/XMODEM, the same CRC the camera uses. */
+uint16_t pixy_blocks_crc16(const uint8_t *buf, uint32_t len);
+
+/**
+ * Encode a frame the way the camera sends it.  buf must hold BF_COMPACT_FRAME_LEN(count)
+ * bytes for the compact format, or (count + 1)*BF_LEGACY_BLOCK_LEN for the legacy format.
+ * @return number of bytes written
+ */
+uint32_t pixy_blocks_encode_compact(uint16_t seq, uint32_t timestamp, const PixyBlock *blocks, uint8_t count, uint8_t *buf);
+uint32_t pixy_blocks_encode_legacy(const PixyBlock *blocks, uint16_t count, uint8_t *buf);
+
+/**
+ * Encode a tracks frame.  buf must hold BF_TRACKS_FRAME_LEN(count) bytes.
+ * @return number of bytes written
+ */
+uint32_t pixy_blocks_encode_tracks(uint16_t seq, uint32_t timestamp, const PixyTrack *tracks, uint8_t count, uint8_t *buf);
+
+/**
+ * Encode a beacons frame.  buf must hold BF_BEACONS_FRAME_LEN(count) bytes.
+ * @return number of bytes written
+ */
+uint32_t pixy_blocks_encode_beacons(uint16_t seq, uint32_t timestamp, const PixyBeacon *beacons, uint8_t count, uint8_t *buf);
+
+/**
+ * Encode an intensity frame, the blocks and their intensities.  buf must hold
+ * BF_INTENSITY_FRAME_LEN(count) bytes.
+ * @return number of bytes written
+ */
+uint32_t pixy_blocks_encode_intensity(uint16_t seq, uint32_t timestamp, const PixyBlock *blocks, const PixyIntensity *intensities, uint8_t count, uint8_t *buf);
+
+/**
+ * Encode a pose frame, with the pose if it isn't NULL.  buf must hold BF_POSE_FRAME_LEN bytes.
+ * @return number of bytes written
+ */
+uint32_t pixy_blocks_encode_pose(uint16_t seq, uint32_t timestamp, const PixyPose *pose, uint8_t *buf);
+
+/**
+ * The two bytes to send to the camera to select a format, BF_FORMAT_LEGACY,
+ * BF_FORMAT_COMPACT, BF_FORMAT_TRACKS, BF_FORMAT_BEACONS, BF_FORMAT_POSE or
+ * BF_FORMAT_INTENSITY.  The camera switches at its next frame.
+ */
+void pixy_blocks_format_cmd(uint8_t format, uint8_t cmd[2]);
+
+/**
+ * The two bytes to send to the camera to set how many unread frames it keeps, 1 (the
+ * default, always the latest frame) to BF_MAX_QUEUED_FRAMES.
+ */
+void pixy_blocks_depth_cmd(uint8_t depth, uint8_t cmd[2]);
+
+/**
+ * Encode a command frame (see blockframe.h).  buf must hold BF_CMD_FRAME_LEN(len) bytes.
+ * seq comes back in the response, so the host can match responses to commands.
+ * @return number of bytes written, 0 if len is more than BF_MAX_CMD_PAYLOAD
+ */
+uint32_t pixy_blocks_command(uint8_t seq, uint8_t cmd, const uint8_t *payload, uint8_t len, uint8_t *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PIXYBLOCKS_H__
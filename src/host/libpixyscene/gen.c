@@ -0,0 +1,497 @@
+/**
+ * @file gen.c
+ * @brief Writes synthetic IR scenes (pixyscene.h) for benchmarks and regression tests: the
+ *        frames as binary PGM images, the Qvals the M0 would queue for them and where the
+ *        beacons and glints are.  Without -o it checks the scenes are what they should be
+ *        and measures how fast they're made.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "pixyscene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define THRESHOLD         170     // RLS_PIXEL_THRESHOLD
+#define FRAMES            1000
+#define CHECK_FRAMES      200
+#define BENCH_FRAMES      3000
+#define MIN_FPS           1000    // red pixels and Qvals
+#define MIN_RAW_FPS       250
+#define MAX_CENTROID_ERROR 0.35   // pixels, the runs' centroid from the rendered one
+#define MAX_CENTER_ERROR  0.05    // pixels, the rendered centroid from the center, unclipped
+#define MAX_AREA_ERROR    0.05    // of pi r^2
+#define MAX_SPEED_ERROR   0.1     // of the speed, bounces make steps shorter
+
+static PixyScene scene_, other_;
+static uint8_t red_[PS_WIDTH * PS_HEIGHT], red2_[PS_WIDTH * PS_HEIGHT], raw_[PS_RAW_WIDTH * PS_RAW_HEIGHT];
+static Qval qvals_[PS_MAX_FRAME_QVALS];
+static PixySceneTruth truth_[PS_MAX_TRUTH], truth2_[PS_MAX_TRUTH];
+static int verbose_ = 0;
+
+static int check(int ok, const char *what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// everything there is, so every path is checked
+static void busy_config(PixySceneConfig *config)
+{
+    pixy_scene_default(config);
+    config->glare = 180;
+    config->speculars = 6;
+}
+
+static int test_repeatable(void)
+{
+    PixySceneConfig config;
+    int failures = 0, same = 1, differs;
+    uint32_t n, m;
+
+    printf("repeatable\n");
+    busy_config(&config);
+    pixy_scene_init(&scene_, &config);
+    n = pixy_scene_render(&scene_, 57, red_, truth_);
+    pixy_scene_render(&scene_, 3, red2_, NULL);
+    pixy_scene_init(&other_, &config);
+    m = pixy_scene_render(&other_, 57, red2_, truth2_);
+    same = n == m && memcmp(red_, red2_, sizeof(red_)) == 0 && memcmp(truth_, truth2_, n * sizeof(PixySceneTruth)) == 0;
+    failures += check(same, "a frame is the same whatever was rendered before");
+
+    config.seed++;
+    pixy_scene_init(&other_, &config);
+    pixy_scene_render(&other_, 57, red2_, NULL);
+    differs = memcmp(red_, red2_, sizeof(red_)) != 0;
+    failures += check(differs, "another seed, another scene");
+    return failures;
+}
+
+static int test_raw(void)
+{
+    PixySceneConfig config;
+    uint32_t frame, row, col, n, m, bad = 0;
+    uint64_t red = 0, others = 0;
+    int failures = 0;
+
+    printf("Bayer image\n");
+    busy_config(&config);
+    pixy_scene_init(&scene_, &config);
+    for (frame = 0; frame < CHECK_FRAMES / 10; frame++)
+    {
+        n = pixy_scene_render(&scene_, frame, red_, truth_);
+        m = pixy_scene_render_raw(&scene_, frame, raw_, truth2_);
+        if (n != m || memcmp(truth_, truth2_, n * sizeof(PixySceneTruth)) != 0)
+            bad++;
+        for (row = 0; row < PS_HEIGHT; row++)
+        {
+            for (col = 0; col < PS_WIDTH; col++)
+            {
+                if (raw_[(2 * row + 1) * PS_RAW_WIDTH + 2 * col + 1] != red_[row * PS_WIDTH + col])
+                    bad++;
+                red += red_[row * PS_WIDTH + col];
+                others += raw_[2 * row * PS_RAW_WIDTH + 2 * col] + raw_[2 * row * PS_RAW_WIDTH + 2 * col + 1] +
+                    raw_[(2 * row + 1) * PS_RAW_WIDTH + 2 * col];
+            }
+        }
+    }
+    if (verbose_)
+        printf("    red mean %.1f, the other sites %.1f\n", (double)red / (frame * PS_WIDTH * PS_HEIGHT),
+            (double)others / (3.0 * frame * PS_WIDTH * PS_HEIGHT));
+    failures += check(bad == 0, "its red pixels, (2x + 1, 2y + 1), are the 320x200 frame's");
+    failures += check(others < 3 * red, "the other sites see less of the IR");
+    return failures;
+}
+
+// The Qvals say which pixels are brighter than the threshold, in lines that have room for
+// their runs, and no more than processLine() would queue in those that don't.
+static int test_qvals(void)
+{
+    PixySceneConfig config;
+    uint8_t mask[PS_WIDTH];
+    uint32_t frame, i, n, row, col, lines, runs, bad = 0, capped = 0, longest = 0;
+    int failures = 0;
+
+    printf("Qvals\n");
+    busy_config(&config);
+    pixy_scene_init(&scene_, &config);
+    for (frame = 0; frame < CHECK_FRAMES / 10; frame++)
+    {
+        pixy_scene_render(&scene_, frame, red_, NULL);
+        n = pixy_scene_qvals(red_, THRESHOLD, 0, qvals_);
+        if (qvals_[n - 1].m_col_start != QVAL_FRAME_END || qvals_[n - 1].m_col_end != PS_NO_SLOT)
+            bad++;
+        for (i = 0, lines = 0; i < n - 1; lines++)
+        {
+            if (qvals_[i++].m_col_start != QVAL_LINE_BEGIN)
+            {
+                bad++;
+                break;
+            }
+            memset(mask, 0, sizeof(mask));
+            for (runs = 0; i < n - 1 && qvals_[i].m_col_start != QVAL_LINE_BEGIN; i++, runs++)
+            {
+                if (qvals_[i].m_col_start >= qvals_[i].m_col_end || qvals_[i].m_col_end > PS_WIDTH)
+                    bad++;
+                else
+                    memset(mask + qvals_[i].m_col_start, 1, qvals_[i].m_col_end - qvals_[i].m_col_start);
+            }
+            for (col = 0; col < PS_WIDTH && lines < PS_HEIGHT; col++)
+            {
+                if (mask[col] != (red_[lines * PS_WIDTH + col] > THRESHOLD))
+                    bad++;
+            }
+        }
+        if (lines != PS_HEIGHT)
+            bad++;
+    }
+    failures += check(bad == 0, "every line begins, runs are the bright pixels, the frame ends");
+
+    // stripes, every other column, more runs than a line has room for
+    for (row = 0; row < PS_HEIGHT; row++)
+    {
+        for (col = 0; col < PS_WIDTH; col++)
+            red_[row * PS_WIDTH + col] = col % 2 ? 0 : 255;
+    }
+    n = pixy_scene_qvals(red_, THRESHOLD, 0, qvals_);
+    for (i = 0, runs = 0; i < n; i++)
+    {
+        if (qvals_[i].m_col_start == QVAL_LINE_BEGIN || qvals_[i].m_col_start == QVAL_FRAME_END)
+        {
+            if (runs == PS_MAX_LINE_QVALS)
+                capped++;
+            if (runs > longest)
+                longest = runs;
+            runs = 0;
+        }
+        else
+            runs++;
+    }
+    failures += check(capped == PS_HEIGHT && longest == PS_MAX_LINE_QVALS, "a line has at most MAX_NEW_QVALS_PER_LINE runs");
+    failures += check(n == PS_MAX_FRAME_QVALS, "a frame at most PS_MAX_FRAME_QVALS");
+    return failures;
+}
+
+// A beacon's runs have their centroid where its rendered one is, and that is its center
+// and its area a disc's, if none of it is outside the frame.
+static int test_truth(void)
+{
+    PixySceneConfig config;
+    uint32_t frame, i, j, n, count, checked = 0, bad_runs = 0, bad_center = 0, bad_area = 0;
+    int32_t line;
+    float box, dx, dy, worst = 0, e;
+    double sum, sumx, sumy, len;
+    int failures = 0, isolated;
+
+    printf("ground truth\n");
+    pixy_scene_default(&config);
+    config.noise = 0;
+    pixy_scene_init(&scene_, &config);
+    box = config.radius + config.blur;
+    for (frame = 0; frame < CHECK_FRAMES; frame++)
+    {
+        count = pixy_scene_render(&scene_, frame, red_, truth_);
+        n = pixy_scene_qvals(red_, THRESHOLD, 0, qvals_);
+        for (i = 0; i < count; i++)
+        {
+            for (j = 0, isolated = 1; j < count; j++)
+            {
+                dx = truth_[i].x - truth_[j].x;
+                dy = truth_[i].y - truth_[j].y;
+                if (j != i && sqrtf(dx * dx + dy * dy) < 2 * box + 2)
+                    isolated = 0;
+            }
+            if (!isolated || truth_[i].clipped)
+                continue;
+            checked++;
+
+            // the runs in the beacon's box
+            for (j = 0, line = -1, sum = sumx = sumy = 0; j < n; j++)
+            {
+                if (qvals_[j].m_col_start == QVAL_LINE_BEGIN)
+                {
+                    line++;
+                    continue;
+                }
+                if (qvals_[j].m_col_start == QVAL_FRAME_END || fabsf(line - truth_[i].y) > box ||
+                    qvals_[j].m_col_end < truth_[i].x - box || qvals_[j].m_col_start > truth_[i].x + box)
+                    continue;
+                len = qvals_[j].m_col_end - qvals_[j].m_col_start;
+                sum += len;
+                sumx += len * (qvals_[j].m_col_start + qvals_[j].m_col_end - 1) / 2.0;
+                sumy += len * line;
+            }
+            dx = sum ? sumx / sum - truth_[i].cx : box;
+            dy = sum ? sumy / sum - truth_[i].cy : box;
+            e = sqrtf(dx * dx + dy * dy);
+            if (e > worst)
+                worst = e;
+            if (e > MAX_CENTROID_ERROR)
+                bad_runs++;
+            if (fabsf(truth_[i].cx - truth_[i].x) > MAX_CENTER_ERROR || fabsf(truth_[i].cy - truth_[i].y) > MAX_CENTER_ERROR)
+                bad_center++;
+            if (fabsf(truth_[i].area / (3.14159265f * config.radius * config.radius) - 1) > MAX_AREA_ERROR)
+                bad_area++;
+        }
+    }
+    if (verbose_)
+        printf("    %u beacons checked, runs' centroids at most %.3f pixels off\n", checked, worst);
+    failures += check(checked > CHECK_FRAMES, "beacons to check");
+    failures += check(bad_runs == 0, "the runs' centroid is the rendered one");
+    failures += check(bad_center == 0, "the rendered centroid is the center");
+    failures += check(bad_area == 0, "the area is the disc's");
+    return failures;
+}
+
+static int test_motion(void)
+{
+    PixySceneConfig config;
+    PixySceneTruth prev[PS_MAX_TRUTH];
+    uint32_t frame, i, n, steps = 0;
+    double dist = 0, dx, dy;
+    int failures = 0;
+
+    printf("motion\n");
+    pixy_scene_default(&config);
+    pixy_scene_init(&scene_, &config);
+    for (frame = 0; frame < CHECK_FRAMES; frame++)
+    {
+        n = pixy_scene_render(&scene_, frame, red_, truth_);
+        for (i = 0; frame > 0 && i < n; i++, steps++)
+        {
+            dx = truth_[i].x - prev[i].x;
+            dy = truth_[i].y - prev[i].y;
+            dist += sqrt(dx * dx + dy * dy);
+        }
+        memcpy(prev, truth_, sizeof(prev));
+    }
+    if (verbose_)
+        printf("    %.3f pixels a frame\n", dist / steps);
+    failures += check(fabs(dist / steps - config.speed) < MAX_SPEED_ERROR * config.speed, "beacons move at their speed");
+    return failures;
+}
+
+static int test_speed(void)
+{
+    PixySceneConfig config;
+    uint32_t frame, qvals = 0;
+    double start, fps, raw_fps;
+    int failures = 0;
+    char what[80];
+
+    printf("speed\n");
+    busy_config(&config);
+    pixy_scene_init(&scene_, &config);
+    start = now_s();
+    for (frame = 0; frame < BENCH_FRAMES; frame++)
+    {
+        pixy_scene_render(&scene_, frame, red_, truth_);
+        qvals += pixy_scene_qvals(red_, THRESHOLD, 0, qvals_);
+    }
+    fps = BENCH_FRAMES / (now_s() - start);
+    start = now_s();
+    for (frame = 0; frame < BENCH_FRAMES / 4; frame++)
+        pixy_scene_render_raw(&scene_, frame, raw_, truth_);
+    raw_fps = BENCH_FRAMES / 4 / (now_s() - start);
+    printf("    %.0f frames/s with Qvals (%u a frame), %.0f frames/s 640x400\n", fps, qvals / BENCH_FRAMES, raw_fps);
+    snprintf(what, sizeof(what), "at least %u frames/s", MIN_FPS);
+    failures += check(fps >= MIN_FPS, what);
+    snprintf(what, sizeof(what), "at least %u frames/s 640x400", MIN_RAW_FPS);
+    failures += check(raw_fps >= MIN_RAW_FPS, what);
+    return failures;
+}
+
+static FILE *create(const char *prefix, const char *ext)
+{
+    char filename[256];
+    FILE *file;
+
+    snprintf(filename, sizeof(filename), "%s%s", prefix, ext);
+    file = fopen(filename, "wb");
+    if (file == NULL)
+        printf("can't create %s\n", filename);
+    return file;
+}
+
+// frames.pgm, frames.qv (Qvals, little endian, as in the shared queue) and frames.csv
+static int generate(const PixySceneConfig *config, uint32_t frames, int raw, uint8_t threshold, uint8_t low_threshold,
+    const char *prefix)
+{
+    FILE *pgm = create(prefix, ".pgm"), *qv = create(prefix, ".qv"), *csv = create(prefix, ".csv");
+    uint32_t frame, i, n, count;
+    uint8_t word[4];
+    double start = now_s();
+    int res = 0;
+
+    if (pgm == NULL || qv == NULL || csv == NULL)
+        res = -1;
+    pixy_scene_init(&scene_, config);
+    if (csv)
+        fprintf(csv, "frame,kind,id,x,y,cx,cy,radius,area,clipped\n");
+    for (frame = 0; frame < frames && res == 0; frame++)
+    {
+        if (raw)
+        {
+            count = pixy_scene_render_raw(&scene_, frame, raw_, truth_);
+            fprintf(pgm, "P5\n%u %u\n255\n", PS_RAW_WIDTH, PS_RAW_HEIGHT);
+            fwrite(raw_, 1, sizeof(raw_), pgm);
+            memcpy(red_, scene_.red, sizeof(red_));
+        }
+        else
+        {
+            count = pixy_scene_render(&scene_, frame, red_, truth_);
+            fprintf(pgm, "P5\n%u %u\n255\n", PS_WIDTH, PS_HEIGHT);
+            fwrite(red_, 1, sizeof(red_), pgm);
+        }
+        n = pixy_scene_qvals(red_, threshold, low_threshold, qvals_);
+        for (i = 0; i < n; i++)
+        {
+            word[0] = qvals_[i].m_col_start & 0xff;
+            word[1] = qvals_[i].m_col_start >> 8;
+            word[2] = qvals_[i].m_col_end & 0xff;
+            word[3] = qvals_[i].m_col_end >> 8;
+            fwrite(word, 1, sizeof(word), qv);
+        }
+        for (i = 0; i < count; i++)
+            fprintf(csv, "%u,%s,%u,%.3f,%.3f,%.3f,%.3f,%.2f,%.2f,%u\n", frame, truth_[i].kind == PS_BEACON ? "beacon" : "specular",
+                truth_[i].id, truth_[i].x, truth_[i].y, truth_[i].cx, truth_[i].cy, truth_[i].radius, truth_[i].area,
+                truth_[i].clipped);
+        if (ferror(pgm) || ferror(qv) || ferror(csv))
+        {
+            printf("%s: can't write\n", prefix);
+            res = -1;
+        }
+    }
+    if (res == 0)
+        printf("%u frames in %.2f s\n", frames, now_s() - start);
+    if (pgm)
+        fclose(pgm);
+    if (qv)
+        fclose(qv);
+    if (csv)
+        fclose(csv);
+    return res;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-v] [-o prefix [-n frames] [-R] [-t threshold] [-T low] [scene options]]\n", progname);
+    printf("  -v  Print what the checks measured\n");
+    printf("  -o  Write prefix.pgm (the frames), prefix.qv (their Qvals) and prefix.csv\n");
+    printf("      (where the beacons and glints are) instead of checking\n");
+    printf("  -n  This many frames (default %u)\n", FRAMES);
+    printf("  -R  640x400 Bayer images, not the 320x200 red pixels\n");
+    printf("  -t  Pixels brighter than this are runs (default %u)\n", THRESHOLD);
+    printf("  -T  Or with hysteresis, runs of pixels brighter than this with one over -t\n");
+    printf("  -b  Beacons (default 8, at most %u)\n", PS_MAX_BEACONS);
+    printf("  -r  Their radius, pixels (default 4)\n");
+    printf("  -B  How wide their edge is, pixels (default 1)\n");
+    printf("  -m  How far they move a frame, pixels (default 2)\n");
+    printf("  -N  Noise, standard deviation (default 3)\n");
+    printf("  -g  Sun glare, its brightness over the background (default 0, none)\n");
+    printf("  -s  At most this many specular glints a frame (default 0)\n");
+    printf("  -S  Seed (default 1)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    PixySceneConfig config;
+    const char *prefix = NULL;
+    uint32_t frames = FRAMES;
+    uint8_t threshold = THRESHOLD, low_threshold = 0;
+    int arg, raw = 0, failures = 0;
+
+    pixy_scene_default(&config);
+    while ((arg = getopt(argc, argv, "vo:n:Rt:T:b:r:B:m:N:g:s:S:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = 1;
+                break;
+
+            case 'o':
+                prefix = optarg;
+                break;
+
+            case 'n':
+                frames = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'R':
+                raw = 1;
+                break;
+
+            case 't':
+                threshold = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'T':
+                low_threshold = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'b':
+                config.beacons = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'r':
+                config.radius = strtof(optarg, NULL);
+                break;
+
+            case 'B':
+                config.blur = strtof(optarg, NULL);
+                break;
+
+            case 'm':
+                config.speed = strtof(optarg, NULL);
+                break;
+
+            case 'N':
+                config.noise = strtof(optarg, NULL);
+                break;
+
+            case 'g':
+                config.glare = strtoul(optarg, NULL, 0);
+                break;
+
+            case 's':
+                config.speculars = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'S':
+                config.seed = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    if (prefix)
+        return generate(&config, frames, raw, threshold, low_threshold, prefix) == 0 ? 0 : 1;
+
+    failures += test_repeatable();
+    failures += test_raw();
+    failures += test_qvals();
+    failures += test_truth();
+    failures += test_motion();
+    failures += test_speed();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,314 @@
+/**
+ * @file pixyscene.c
+ * @brief Synthetic IR scenes for benchmarks and regression tests, rendered the way the
+ *        camera sees them
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "pixyscene.h"
+
+#include <math.h>
+#include <string.h>
+
+#define PS_PI                 3.14159265358979f
+#define PS_GREEN_GAIN         218   // 1/256, what the green sites see of the IR next to red
+#define PS_BLUE_GAIN          230
+#define PS_SPECULAR_RADIUS    0.5f  // glints are this big and up to a pixel more
+#define PS_SPECULAR_BLUR      0.5f
+
+// what a frame's random numbers are for, so they don't depend on each other
+enum
+{
+    PS_STREAM_SCENE,
+    PS_STREAM_SPECULARS,
+    PS_STREAM_NOISE         // + the Bayer site, 0 red
+};
+
+static uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// a well mixed, never zero start for one of a frame's streams
+static uint32_t stream(uint32_t seed, uint32_t frame, uint32_t which)
+{
+    uint32_t h = seed ^ (frame * 0x9e3779b1) ^ (which * 0x85ebca77);
+
+    h ^= h >> 16;
+    h *= 0x7feb352d;
+    h ^= h >> 15;
+    h *= 0x846ca68b;
+    h ^= h >> 16;
+    return h ? h : 1;
+}
+
+// 0..1
+static float uniform(uint32_t *state)
+{
+    return (xorshift(state) >> 8) / 16777216.0f;
+}
+
+// p folded back into lo..hi, as if it bounced off the ends
+static float bounce(float p, float lo, float hi)
+{
+    float span = hi - lo, t;
+
+    if (span <= 0)
+        return (lo + hi) / 2;
+    t = fmodf(p - lo, 2 * span);
+    if (t < 0)
+        t += 2 * span;
+    return lo + (t < span ? t : 2 * span - t);
+}
+
+void pixy_scene_default(PixySceneConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->beacons = 8;
+    config->radius = 4;
+    config->blur = 1;
+    config->level = 200;
+    config->background = 30;
+    config->noise = 3;
+    config->speed = 2;
+    config->glare_x = PS_WIDTH / 2;
+    config->glare_y = PS_HEIGHT / 2;
+    config->glare_radius = 60;
+    config->specular_level = 220;
+    config->seed = 1;
+}
+
+void pixy_scene_init(PixyScene *scene, const PixySceneConfig *config)
+{
+    uint32_t state = stream(config->seed, 0, PS_STREAM_SCENE), i;
+    float margin, a, u, v;
+
+    scene->config = *config;
+    if (scene->config.beacons > PS_MAX_BEACONS)
+        scene->config.beacons = PS_MAX_BEACONS;
+    if (scene->config.speculars > PS_MAX_SPECULARS)
+        scene->config.speculars = PS_MAX_SPECULARS;
+
+    margin = config->radius;
+    for (i = 0; i < scene->config.beacons; i++)
+    {
+        scene->x0[i] = margin + uniform(&state) * (PS_WIDTH - 2 * margin);
+        scene->y0[i] = margin + uniform(&state) * (PS_HEIGHT - 2 * margin);
+        a = 2 * PS_PI * uniform(&state);
+        scene->vx[i] = config->speed * cosf(a);
+        scene->vy[i] = config->speed * sinf(a);
+    }
+
+    // Box-Muller, in pairs; a pixel picks one at random, so the table's order doesn't matter
+    for (i = 0; i < PS_NOISE_SAMPLES; i += 2)
+    {
+        u = uniform(&state) + 1.0f / 16777216;
+        v = uniform(&state);
+        a = config->noise * sqrtf(-2 * logf(u));
+        scene->noise[i] = (int16_t)lrintf(a * cosf(2 * PS_PI * v));
+        scene->noise[i + 1] = (int16_t)lrintf(a * sinf(2 * PS_PI * v));
+    }
+}
+
+// Adds a disc of level at (x, y) to the grid of points (col + ox, row + oy), its edge a
+// ramp blur wide, and what it left in the frame to truth if it isn't NULL.
+static void add_disc(PixyScene *scene, float x, float y, float radius, float blur, int32_t level, float ox, float oy,
+    PixySceneTruth *truth)
+{
+    float outer = radius + (blur > 0 ? blur / 2 : 0), dx, dy, d, f;
+    int32_t col0 = (int32_t)floorf(x - ox - outer), col1 = (int32_t)ceilf(x - ox + outer);
+    int32_t row0 = (int32_t)floorf(y - oy - outer), row1 = (int32_t)ceilf(y - oy + outer);
+    int32_t row, col;
+    double sum = 0, sumx = 0, sumy = 0;
+    int32_t *acc;
+
+    if (truth)
+    {
+        truth->x = x;
+        truth->y = y;
+        truth->radius = radius;
+        truth->clipped = x - outer < -0.5f || x + outer > PS_WIDTH - 0.5f || y - outer < -0.5f || y + outer > PS_HEIGHT - 0.5f;
+    }
+    if (col0 < 0)
+        col0 = 0;
+    if (col1 > PS_WIDTH - 1)
+        col1 = PS_WIDTH - 1;
+    if (row0 < 0)
+        row0 = 0;
+    if (row1 > PS_HEIGHT - 1)
+        row1 = PS_HEIGHT - 1;
+    for (row = row0; row <= row1; row++)
+    {
+        acc = scene->acc + row * PS_WIDTH;
+        dy = row + oy - y;
+        for (col = col0; col <= col1; col++)
+        {
+            dx = col + ox - x;
+            d = sqrtf(dx * dx + dy * dy);
+            if (blur > 0)
+            {
+                f = (outer - d) / blur;
+                if (f <= 0)
+                    continue;
+                if (f > 1)
+                    f = 1;
+            }
+            else if (d > radius)
+                continue;
+            else
+                f = 1;
+            acc[col] += (int32_t)(level * f + 0.5f);
+            sum += f;
+            sumx += f * (col + ox);
+            sumy += f * (row + oy);
+        }
+    }
+    if (truth)
+    {
+        truth->area = (float)sum;
+        truth->cx = sum > 0 ? (float)(sumx / sum) : x;
+        truth->cy = sum > 0 ? (float)(sumy / sum) : y;
+    }
+}
+
+// the sun, brightest in the middle and falling off smoothly to nothing at glare_radius
+static void add_glare(PixyScene *scene, float ox, float oy)
+{
+    const PixySceneConfig *config = &scene->config;
+    float r2 = config->glare_radius * config->glare_radius, dx, dy, f;
+    int32_t col0 = (int32_t)floorf(config->glare_x - ox - config->glare_radius);
+    int32_t col1 = (int32_t)ceilf(config->glare_x - ox + config->glare_radius);
+    int32_t row0 = (int32_t)floorf(config->glare_y - oy - config->glare_radius);
+    int32_t row1 = (int32_t)ceilf(config->glare_y - oy + config->glare_radius);
+    int32_t row, col;
+
+    if (col0 < 0)
+        col0 = 0;
+    if (col1 > PS_WIDTH - 1)
+        col1 = PS_WIDTH - 1;
+    if (row0 < 0)
+        row0 = 0;
+    if (row1 > PS_HEIGHT - 1)
+        row1 = PS_HEIGHT - 1;
+    for (row = row0; row <= row1; row++)
+    {
+        dy = row + oy - config->glare_y;
+        for (col = col0; col <= col1; col++)
+        {
+            dx = col + ox - config->glare_x;
+            f = 1 - (dx * dx + dy * dy) / r2;
+            if (f > 0)
+                scene->acc[row * PS_WIDTH + col] += (int32_t)(config->glare * f * f + 0.5f);
+        }
+    }
+}
+
+// The scene of a frame at the grid of points (col + ox, row + oy), without noise, into
+// scene->acc.
+static uint32_t compose(PixyScene *scene, uint32_t frame, float ox, float oy, PixySceneTruth *truth)
+{
+    const PixySceneConfig *config = &scene->config;
+    uint32_t state = stream(config->seed, frame, PS_STREAM_SPECULARS), i, n = 0, glints;
+    float x, y;
+
+    for (i = 0; i < PS_WIDTH * PS_HEIGHT; i++)
+        scene->acc[i] = config->background;
+    if (config->glare && config->glare_radius > 0)
+        add_glare(scene, ox, oy);
+
+    for (i = 0; i < config->beacons; i++, n++)
+    {
+        x = bounce(scene->x0[i] + scene->vx[i] * frame, config->radius, PS_WIDTH - 1 - config->radius);
+        y = bounce(scene->y0[i] + scene->vy[i] * frame, config->radius, PS_HEIGHT - 1 - config->radius);
+        if (truth)
+        {
+            truth[n].kind = PS_BEACON;
+            truth[n].id = i;
+        }
+        add_disc(scene, x, y, config->radius, config->blur, config->level, ox, oy, truth ? truth + n : NULL);
+    }
+
+    glints = config->speculars ? xorshift(&state) % (config->speculars + 1) : 0;
+    for (i = 0; i < glints; i++, n++)
+    {
+        x = uniform(&state) * (PS_WIDTH - 1);
+        y = uniform(&state) * (PS_HEIGHT - 1);
+        if (truth)
+        {
+            truth[n].kind = PS_SPECULAR;
+            truth[n].id = i;
+        }
+        add_disc(scene, x, y, PS_SPECULAR_RADIUS + uniform(&state), PS_SPECULAR_BLUR, config->specular_level, ox, oy,
+            truth ? truth + n : NULL);
+    }
+    return n;
+}
+
+// scene->acc through the sensor, gain in 1/256, noise from the frame and site's own stream
+static void expose(PixyScene *scene, uint32_t frame, uint32_t site, int32_t gain, uint8_t *out, uint32_t pixel_stride,
+    uint32_t row_stride)
+{
+    uint32_t state = stream(scene->config.seed, frame, PS_STREAM_NOISE + site), row, col;
+    const int32_t *acc = scene->acc;
+    uint8_t *p;
+    int32_t v;
+
+    for (row = 0; row < PS_HEIGHT; row++)
+    {
+        p = out + row * row_stride;
+        for (col = 0; col < PS_WIDTH; col++, p += pixel_stride)
+        {
+            v = ((*acc++ * gain) >> 8) + scene->noise[xorshift(&state) >> 20];
+            *p = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+    }
+}
+
+uint32_t pixy_scene_render(PixyScene *scene, uint32_t frame, uint8_t *red, PixySceneTruth *truth)
+{
+    uint32_t n = compose(scene, frame, 0, 0, truth);
+
+    expose(scene, frame, 0, 256, red, 1, PS_WIDTH);
+    return n;
+}
+
+// Row 2y is blue, green, blue..., row 2y + 1 green, red, green..., so red pixel (x, y) is
+// (2x + 1, 2y + 1) and the sites around it are half a red pixel up and to the left.
+uint32_t pixy_scene_render_raw(PixyScene *scene, uint32_t frame, uint8_t *raw, PixySceneTruth *truth)
+{
+    uint32_t n = pixy_scene_render(scene, frame, scene->red, truth), row, col;
+
+    for (row = 0; row < PS_HEIGHT; row++)
+    {
+        for (col = 0; col < PS_WIDTH; col++)
+            raw[(2 * row + 1) * PS_RAW_WIDTH + 2 * col + 1] = scene->red[row * PS_WIDTH + col];
+    }
+    compose(scene, frame, -0.5f, -0.5f, NULL);
+    expose(scene, frame, 1, PS_BLUE_GAIN, raw, 2, 2 * PS_RAW_WIDTH);
+    compose(scene, frame, 0, -0.5f, NULL);
+    expose(scene, frame, 2, PS_GREEN_GAIN, raw + 1, 2, 2 * PS_RAW_WIDTH);
+    compose(scene, frame, -0.5f, 0, NULL);
+    expose(scene, frame, 3, PS_GREEN_GAIN, raw + PS_RAW_WIDTH, 2, 2 * PS_RAW_WIDTH);
+    return n;
+}
+
+uint32_t pixy_scene_qvals(const uint8_t *red, uint8_t threshold, uint8_t low_threshold, Qval *qvals)
+{
+    uint32_t row, n = 0;
+
+    for (row = 0; row < PS_HEIGHT; row++)
+    {
+        qvals[n].m_col_start = QVAL_LINE_BEGIN;
+        qvals[n++].m_col_end = QVAL_LAYOUT_RUNS;
+        n += rlsLineRef(red + row * PS_WIDTH, threshold, low_threshold, 0, qvals + n);
+    }
+    qvals[n].m_col_start = QVAL_FRAME_END;
+    qvals[n++].m_col_end = PS_NO_SLOT;
+    return n;
+}
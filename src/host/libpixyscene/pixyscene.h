@@ -0,0 +1,119 @@
+/**
+ * @file pixyscene.h
+ * @brief Synthetic IR scenes for benchmarks and regression tests, rendered the way the
+ *        camera sees them
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ *
+ * A scene is beacons (soft edged discs) moving about over a noisy background, with sun
+ * glare and specular glints if asked for.  Frames are the red pixels processLine() in
+ * rls_m0.c samples, 320x200, or the whole 640x400 Bayer image they come from, red at
+ * (2x + 1, 2y + 1), which the other sites see less of.  Frame n is the same however many
+ * frames were rendered before it, in whichever order.  Each frame comes with where the
+ * beacons and glints are, the centroid of what was rendered of each, and
+ * pixy_scene_qvals() turns its red pixels into the Qvals the M0 would queue.
+ */
+
+#ifndef __PIXYSCENE_H__
+#define __PIXYSCENE_H__
+
+#include <stdint.h>
+#include "rls_ref.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PS_WIDTH              CAM_RES2_WIDTH
+#define PS_HEIGHT             CAM_RES2_HEIGHT
+#define PS_RAW_WIDTH          (PS_WIDTH*2)
+#define PS_RAW_HEIGHT         (PS_HEIGHT*2)
+#define PS_MAX_BEACONS        32
+#define PS_MAX_SPECULARS      32
+#define PS_MAX_TRUTH          (PS_MAX_BEACONS + PS_MAX_SPECULARS)
+#define PS_MAX_LINE_QVALS     RLS_MAX_LINE_QVALS
+#define PS_MAX_FRAME_QVALS    (PS_HEIGHT*(PS_MAX_LINE_QVALS + 1) + 1)
+#define PS_NO_SLOT            0xff  // FB_NO_SLOT, the frame end of a frame not logged
+#define PS_NOISE_SAMPLES      4096
+
+#define PS_BEACON             0
+#define PS_SPECULAR           1
+
+typedef struct
+{
+    uint8_t beacons;          // 0..PS_MAX_BEACONS
+    float radius;             // red pixels, to the middle of the edge
+    float blur;               // red pixels, how wide the edge goes from level to background
+    uint8_t level;            // a beacon's brightness over the background
+    uint8_t background;
+    float noise;              // standard deviation, every pixel
+    float speed;              // red pixels per frame, each beacon its own way, off the edges
+    uint8_t glare;            // the sun's brightness over the background in the middle, 0 none
+    float glare_x;            // where it is, red pixels
+    float glare_y;
+    float glare_radius;
+    uint8_t speculars;        // at most this many glints a frame, somewhere else each frame
+    uint8_t specular_level;
+    uint32_t seed;
+} PixySceneConfig;
+
+typedef struct
+{
+    uint8_t kind;             // PS_BEACON or PS_SPECULAR
+    uint8_t id;               // beacon, or glint of the frame
+    float x;                  // where it is, red pixels
+    float y;
+    float cx;                 // centroid of what's in the frame of it, weighted by brightness
+    float cy;
+    float radius;
+    float area;               // pixels of it in the frame, edges counting for what they show
+    uint8_t clipped;          // part of it is outside the frame
+} PixySceneTruth;
+
+typedef struct
+{
+    PixySceneConfig config;
+
+    // private
+    float x0[PS_MAX_BEACONS]; // where the beacons are in frame 0
+    float y0[PS_MAX_BEACONS];
+    float vx[PS_MAX_BEACONS];
+    float vy[PS_MAX_BEACONS];
+    int16_t noise[PS_NOISE_SAMPLES];
+    int32_t acc[PS_WIDTH*PS_HEIGHT];
+    uint8_t red[PS_WIDTH*PS_HEIGHT];
+} PixyScene;
+
+/** A scene of 8 beacons of radius 4, slightly blurred and moving, over light noise. */
+void pixy_scene_default(PixySceneConfig *config);
+
+/** Set up a scene, where its beacons start and go come from config->seed. */
+void pixy_scene_init(PixyScene *scene, const PixySceneConfig *config);
+
+/**
+ * Render frame n's red pixels, PS_WIDTH*PS_HEIGHT bytes, and where the beacons and glints
+ * are in it, if truth isn't NULL (PS_MAX_TRUTH records, beacons first).
+ * @return number of truth records
+ */
+uint32_t pixy_scene_render(PixyScene *scene, uint32_t frame, uint8_t *red, PixySceneTruth *truth);
+
+/**
+ * Render frame n's Bayer image, PS_RAW_WIDTH*PS_RAW_HEIGHT bytes, its red pixels the ones
+ * pixy_scene_render() gives for the frame.
+ * @return number of truth records
+ */
+uint32_t pixy_scene_render_raw(PixyScene *scene, uint32_t frame, uint8_t *raw, PixySceneTruth *truth);
+
+/**
+ * The Qvals the M0 queues for a frame's red pixels: for each line QVAL_LINE_BEGIN, then
+ * the line's runs as rlsLineRef() finds them, with hysteresis if low_threshold is between
+ * 0 and threshold, and QVAL_FRAME_END for the frame with no slot.  qvals must hold
+ * PS_MAX_FRAME_QVALS.
+ * @return number of Qvals
+ */
+uint32_t pixy_scene_qvals(const uint8_t *red, uint8_t threshold, uint8_t low_threshold, Qval *qvals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PIXYSCENE_H__
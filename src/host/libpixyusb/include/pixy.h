@@ -122,6 +122,30 @@ extern "C"
   */
   int pixy_command(const char *name, ...);
 
+  /**
+    @brief      Look up a command once, so it can be sent with pixy_command_exec()
+                without resolving its name every time (e.g. LED or servo updates
+                in a loop).  Handles stay valid across pixy_close()/pixy_init(),
+                the command is looked up again after Pixy reconnects.
+    @param[in]  name  Chirp remote procedure call identifier string.
+    @return     Non-negative                Success: Command handle
+    @return     PIXY_ERROR_USB_NOT_FOUND    Not connected to Pixy
+    @return     PIXY_ERROR_INVALID_COMMAND  Pixy doesn't have the command
+  */
+  int pixy_command_prepare(const char *name);
+
+  /**
+    @brief      Send a command prepared with pixy_command_prepare().  Arguments
+                are the same as pixy_command()'s after the name.
+    @param[in]  handle  Command handle from pixy_command_prepare().
+    @return     0                             Success
+    @return     PIXY_ERROR_USB_NOT_FOUND      Not connected to Pixy
+    @return     PIXY_ERROR_INVALID_PARAMETER  Handle wasn't given by pixy_command_prepare()
+    @return     PIXY_ERROR_INVALID_COMMAND    Pixy doesn't have the command
+    @return     Negative                      Chirp error
+  */
+  int pixy_command_exec(int handle, ...);
+
   /**
     @brief Terminates connection with Pixy.
   */
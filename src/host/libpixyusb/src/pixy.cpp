@@ -4,6 +4,26 @@
 
 PixyInterpreter interpreter;
 
+// Typed bindings for the Pixy procedures used by the C API //
+
+static ChirpBinding<ChirpIn<uint32_t>, ChirpOut<int32_t> > ledSet("led_set");
+static ChirpBinding<ChirpIn<uint32_t>, ChirpOut<int32_t> > ledSetMaxCurrent("led_setMaxCurrent");
+static ChirpBinding<ChirpIn<>, ChirpOut<int32_t> > ledGetMaxCurrent("led_getMaxCurrent");
+static ChirpBinding<ChirpIn<uint8_t>, ChirpOut<int32_t> > camSetAWB("cam_setAWB");
+static ChirpBinding<ChirpIn<>, ChirpOut<int32_t> > camGetAWB("cam_getAWB");
+static ChirpBinding<ChirpIn<>, ChirpOut<int32_t> > camGetWBV("cam_getWBV");
+static ChirpBinding<ChirpIn<uint32_t>, ChirpOut<int32_t> > camSetWBV("cam_setWBV");
+static ChirpBinding<ChirpIn<uint8_t>, ChirpOut<int32_t> > camSetAEC("cam_setAEC");
+static ChirpBinding<ChirpIn<>, ChirpOut<int32_t> > camGetAEC("cam_getAEC");
+static ChirpBinding<ChirpIn<uint32_t>, ChirpOut<int32_t> > camSetECV("cam_setECV");
+static ChirpBinding<ChirpIn<>, ChirpOut<int32_t> > camGetECV("cam_getECV");
+static ChirpBinding<ChirpIn<uint8_t>, ChirpOut<int32_t> > camSetBrightness("cam_setBrightness");
+static ChirpBinding<ChirpIn<>, ChirpOut<int32_t> > camGetBrightness("cam_getBrightness");
+static ChirpBinding<ChirpIn<uint8_t>, ChirpOut<int32_t> > rcsGetPos("rcs_getPos");
+static ChirpBinding<ChirpIn<uint8_t, uint16_t>, ChirpOut<int32_t> > rcsSetPos("rcs_setPos");
+static ChirpBinding<ChirpIn<uint16_t>, ChirpOut<int32_t> > rcsSetFreq("rcs_setFreq");
+static ChirpBinding<ChirpIn<>, ChirpOut<int32_t, ChirpArray<uint16_t> > > getVersion("version");
+
 /** 
 
   \mainpage libpixyusb-0.4 API Reference
@@ -122,6 +142,27 @@ extern "C"
     return return_value;
   }
 
+  int pixy_command_prepare(const char *name)
+  {
+    if(!pixy_initialized) return PIXY_ERROR_USB_NOT_FOUND;
+
+    return interpreter.prepare_command(name);
+  }
+
+  int pixy_command_exec(int handle, ...)
+  {
+    va_list arguments;
+    int     return_value;
+
+    if(!pixy_initialized) return PIXY_ERROR_USB_NOT_FOUND;
+
+    va_start(arguments, handle);
+    return_value = interpreter.exec_command(handle, arguments);
+    va_end(arguments);
+
+    return return_value;
+  }
+
   void pixy_close()
   {
     if(!pixy_initialized) return;
@@ -152,14 +193,14 @@ extern "C"
 
   int pixy_led_set_RGB(uint8_t red, uint8_t green, uint8_t blue)
   {
-    int      chirp_response;
+    int32_t  chirp_response;
     int      return_value;
     uint32_t RGB;
 
     // Pack the RGB value //
     RGB = blue + (green << 8) + (red << 16);
 
-    return_value = pixy_command("led_set", INT32(RGB), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(ledSet, RGB, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -172,10 +213,10 @@ extern "C"
 
   int pixy_led_set_max_current(uint32_t current)
   {
-    int chirp_response;
+    int32_t chirp_response;
     int return_value;
 
-    return_value = pixy_command("led_setMaxCurrent", INT32(current), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(ledSetMaxCurrent, current, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -189,9 +230,9 @@ extern "C"
   int pixy_led_get_max_current()
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
 
-    return_value = pixy_command("led_getMaxCurrent", END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(ledGetMaxCurrent, chirp_response);
 
     if (return_value < 0) {
       // Error //
@@ -205,9 +246,9 @@ extern "C"
   int pixy_cam_set_auto_white_balance(uint8_t enable)
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
 
-    return_value = pixy_command("cam_setAWB", UINT8(enable), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camSetAWB, enable, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -221,9 +262,9 @@ extern "C"
   int pixy_cam_get_auto_white_balance()
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
 
-    return_value = pixy_command("cam_getAWB", END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camGetAWB, chirp_response);
 
     if (return_value < 0) {
       // Error //
@@ -237,9 +278,9 @@ extern "C"
   uint32_t pixy_cam_get_white_balance_value()
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
 
-    return_value = pixy_command("cam_getWBV", END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camGetWBV, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -253,12 +294,12 @@ extern "C"
   int pixy_cam_set_white_balance_value(uint8_t red, uint8_t green, uint8_t blue)
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
     uint32_t white_balance;
 
     white_balance = green + (red << 8) + (blue << 16);
 
-    return_value = pixy_command("cam_setAWB", UINT32(white_balance), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camSetWBV, white_balance, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -272,9 +313,9 @@ extern "C"
   int pixy_cam_set_auto_exposure_compensation(uint8_t enable)
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
 
-    return_value = pixy_command("cam_setAEC", UINT8(enable), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camSetAEC, enable, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -288,9 +329,9 @@ extern "C"
   int pixy_cam_get_auto_exposure_compensation()
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
 
-    return_value = pixy_command("cam_getAEC", END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camGetAEC, chirp_response);
 
     if (return_value < 0) {
       // Error //
@@ -304,12 +345,12 @@ extern "C"
   int pixy_cam_set_exposure_compensation(uint8_t gain, uint16_t compensation)
   {
     int      return_value;
-    uint32_t chirp_response;
+    int32_t  chirp_response;
     uint32_t exposure;
 
     exposure = gain + (compensation << 8);
 
-    return_value = pixy_command("cam_setECV", UINT32(exposure), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camSetECV, exposure, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -322,10 +363,10 @@ extern "C"
 
   int pixy_cam_get_exposure_compensation(uint8_t * gain, uint16_t * compensation)
   {
-    uint32_t exposure;
+    int32_t  exposure;
     int      return_value;
 
-    return_value = pixy_command("cam_getECV", END_OUT_ARGS, &exposure, END_IN_ARGS);
+    return_value = interpreter.call_command(camGetECV, exposure);
 
     if (return_value < 0) {
       // Chirp error //
@@ -347,10 +388,10 @@ extern "C"
 
   int pixy_cam_set_brightness(uint8_t brightness)
   {
-    int chirp_response;
+    int32_t chirp_response;
     int return_value;
 
-    return_value = pixy_command("cam_setBrightness", UINT8(brightness), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camSetBrightness, brightness, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -363,10 +404,10 @@ extern "C"
 
   int pixy_cam_get_brightness()
   {
-    int chirp_response;
+    int32_t chirp_response;
     int return_value;
 
-    return_value = pixy_command("cam_getBrightness", END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(camGetBrightness, chirp_response);
 
     if (return_value < 0) {
       // Error //
@@ -379,10 +420,10 @@ extern "C"
 
   int pixy_rcs_get_position(uint8_t channel)
   {
-    int chirp_response;
+    int32_t chirp_response;
     int return_value;
 
-    return_value = pixy_command("rcs_getPos", UINT8(channel), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(rcsGetPos, channel, chirp_response);
 
     if (return_value < 0) {
       // Error //
@@ -395,10 +436,10 @@ extern "C"
 
   int pixy_rcs_set_position(uint8_t channel, uint16_t position)
   {
-    int chirp_response;
+    int32_t chirp_response;
     int return_value;
 
-    return_value = pixy_command("rcs_setPos", UINT8(channel), INT16(position), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(rcsSetPos, channel, position, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -411,10 +452,10 @@ extern "C"
 
   int pixy_rcs_set_frequency(uint16_t frequency)
   {
-    int chirp_response;
+    int32_t chirp_response;
     int return_value;
 
-    return_value = pixy_command("rcs_setFreq", UINT16(frequency), END_OUT_ARGS, &chirp_response, END_IN_ARGS);
+    return_value = interpreter.call_command(rcsSetFreq, frequency, chirp_response);
 
    if (return_value < 0) {
       // Error //
@@ -427,26 +468,29 @@ extern "C"
 
   int pixy_get_firmware_version(uint16_t * major, uint16_t * minor, uint16_t * build)
   {
-    uint16_t * pixy_version;
-    uint32_t   version_length;
-    uint32_t   response;
+    ChirpArray<uint16_t> pixy_version;
+    int32_t    response;
     uint16_t   version[3];
     int        return_value;
-    int        chirp_response;
 
     if(major == 0 || minor == 0 || build == 0) {
       // Error: Null pointer //
       return PIXY_ERROR_INVALID_PARAMETER;
     }
 
-    return_value = pixy_command("version",  END_OUT_ARGS, &response, &version_length, &pixy_version, END_IN_ARGS);
+    return_value = interpreter.call_command(getVersion, response, pixy_version);
 
     if (return_value < 0) {
       // Error //
       return return_value;
     }
 
-    memcpy((void *) version, pixy_version, 3 * sizeof(uint16_t));
+    if (pixy_version.len < 3) {
+      // Error: Short version array //
+      return PIXY_ERROR_CHIRP;
+    }
+
+    memcpy((void *) version, pixy_version.data, 3 * sizeof(uint16_t));
 
     *major = version[0];
     *minor = version[1];
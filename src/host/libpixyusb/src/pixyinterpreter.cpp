@@ -148,6 +148,77 @@ int PixyInterpreter::send_command(const char * name, va_list args)
   return return_value;
 }
 
+int PixyInterpreter::prepare_command(const char * name)
+{
+  // Mutual exclusion for receiver_ object //
+  boost::mutex::scoped_lock lock(chirp_access_mutex_);
+  unsigned int handle;
+
+  if (receiver_ == NULL) {
+    return PIXY_ERROR_USB_NOT_FOUND;
+  }
+
+  // Reuse the handle if the command has already been prepared //
+  for (handle = 0; handle < commands_.size(); handle++) {
+    if (commands_[handle].name == name) {
+      break;
+    }
+  }
+
+  if (handle == commands_.size()) {
+    Command command;
+    command.name         = name;
+    command.procedure_id = -1;
+    command.connection   = 0;
+    commands_.push_back(command);
+  }
+
+  if (resolve_command(commands_[handle]) < 0) {
+    return PIXY_ERROR_INVALID_COMMAND;
+  }
+
+  return handle;
+}
+
+int PixyInterpreter::exec_command(int handle, va_list args)
+{
+  int     return_value;
+  va_list arguments;
+
+  // Mutual exclusion for receiver_ object //
+  boost::mutex::scoped_lock lock(chirp_access_mutex_);
+
+  if (handle < 0 || handle >= (int) commands_.size()) {
+    return PIXY_ERROR_INVALID_PARAMETER;
+  }
+
+  if (receiver_ == NULL) {
+    return PIXY_ERROR_USB_NOT_FOUND;
+  }
+
+  if (resolve_command(commands_[handle]) < 0) {
+    return PIXY_ERROR_INVALID_COMMAND;
+  }
+
+  // Execute chirp synchronous remote procedure call //
+  va_copy(arguments, args);
+  return_value = receiver_->call(SYNC, commands_[handle].procedure_id, arguments);
+  va_end(arguments);
+
+  return return_value;
+}
+
+ChirpProc PixyInterpreter::resolve_command(Command & command)
+{
+  // Procedure ids can change when Pixy reconnects (e.g. new firmware) //
+  if (command.procedure_id < 0 || command.connection != receiver_->connection()) {
+    command.procedure_id = receiver_->getProc(command.name.c_str());
+    command.connection   = receiver_->connection();
+  }
+
+  return command.procedure_id;
+}
+
 void PixyInterpreter::interpreter_thread()
 {
   thread_dead_ = false;
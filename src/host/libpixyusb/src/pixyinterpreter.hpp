@@ -17,6 +17,7 @@
 #define __PIXYINTERPRETER_HPP__
 
 #include <vector>
+#include <string>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include "pixytypes.h"
@@ -24,6 +25,7 @@
 #include "usblink.h"
 #include "interpreter.hpp"
 #include "chirpreceiver.hpp"
+#include "chirpbinding.hpp"
 
 #define PIXY_BLOCK_CAPACITY         250
 
@@ -94,8 +96,64 @@ class PixyInterpreter : public Interpreter
     */
     int send_command(const char * name, ...);
 
+    /**
+      @brief         Looks up a command so it can be sent with exec_command()
+                     without resolving its name each time.
+      @param[in]     name       Remote procedure call identifier string.
+      @return        Non-negative                Command handle
+      @return        PIXY_ERROR_USB_NOT_FOUND    Not connected to Pixy
+      @return        PIXY_ERROR_INVALID_COMMAND  Pixy doesn't have the procedure
+    */
+    int prepare_command(const char * name);
+
+    /**
+      @brief         Sends a command prepared with prepare_command().
+      @param[in]     handle     Command handle.
+      @param[in,out] arguments  Argument list to function call.
+      @return        -1         Error
+    */
+    int exec_command(int handle, va_list arguments);
+
+    /**
+      @brief         Sends a command to Pixy through a typed binding
+                     (see chirpbinding.hpp).  Argument types are checked
+                     at compile time instead of being described with
+                     CRP_ tags, and the response is checked against the
+                     binding's out types.
+      @param[in]     binding    Procedure and argument types.
+      @param[in,out] arguments  In arguments followed by out arguments,
+                                the first out argument is the response.
+      @return        0          Success
+      @return        PIXY_ERROR_USB_NOT_FOUND    Not connected to Pixy
+      @return        PIXY_ERROR_INVALID_COMMAND  Pixy doesn't have the procedure
+      @return        Negative   Chirp error
+    */
+    template <typename Binding, typename... Arguments>
+    int call_command(Binding & binding, Arguments &&... arguments)
+    {
+      // Mutual exclusion for receiver_ object //
+      boost::mutex::scoped_lock lock(chirp_access_mutex_);
+
+      if (receiver_ == NULL) {
+        return PIXY_ERROR_USB_NOT_FOUND;
+      }
+
+      if (binding.proc(receiver_) < 0) {
+        return PIXY_ERROR_INVALID_COMMAND;
+      }
+
+      return binding.call(receiver_, arguments...);
+    }
+
   private:
-    
+
+    struct Command
+    {
+      std::string name;
+      ChirpProc   procedure_id;
+      uint32_t    connection;   // receiver_->connection() when procedure_id was looked up
+    };
+
     ChirpReceiver *    receiver_;
     USBLink            link_;
     boost::thread      thread_;
@@ -105,6 +163,15 @@ class PixyInterpreter : public Interpreter
     boost::mutex       blocks_access_mutex_;
     boost::mutex       chirp_access_mutex_;
     bool               blocks_are_new_;
+    std::vector<Command> commands_;
+
+    /**
+      @brief  Looks up the procedure id for a prepared command again if Pixy
+              has reconnected since it was last looked up.
+
+      @return  The procedure id, negative if Pixy doesn't have the procedure.
+    */
+    ChirpProc resolve_command(Command & command);
 
     /**
       @brief  Interpreter thread entry point.
@@ -86,6 +86,12 @@ int USBLink::open()
   log("pixydebug:  libusb_reset_device() = %d\n", return_value);
 #endif
 
+  /* Chirp blocks match the bulk packet size: 512 at high speed, 64 at full speed */
+  return_value = libusb_get_max_packet_size(libusb_get_device(m_handle), 0x82);
+  log("pixydebug:  libusb_get_max_packet_size() = %d\n", return_value);
+  if (return_value > 0)
+    m_blockSize = return_value;
+
   /* Success */
   return_value = 0;
   goto usblink_open__exit;
@@ -139,6 +145,9 @@ int USBLink::receive(uint8_t *data, uint32_t len, uint16_t timeoutMs)
     if ((res=libusb_bulk_transfer(m_handle, 0x82, (unsigned char *)data, len, &transferred, timeoutMs))<0)
     {
         log("pixydebug:  libusb_bulk_transfer() = %d\n", res);
+        // a large transfer can time out part way through, return what arrived so the caller can keep reading
+        if (res==LIBUSB_ERROR_TIMEOUT && transferred>0)
+            return transferred;
 #ifdef __MACOS__
         libusb_clear_halt(m_handle, 0x82);
 #endif
@@ -0,0 +1,62 @@
+#!/usr/bin/python
+
+##
+# @file frame_rate.py
+# @brief This script measures how many raw 320x200 frames/sec Pixy can deliver over USB.
+#        At full speed (64 byte bulk packets) a frame takes about 55ms, at high speed (512 byte
+#        bulk packets) the transfer itself takes a few ms and the camera becomes the limit.
+#
+# @copyright Copyright 2021 Matternet. All rights reserved.
+#
+
+import argparse
+import pixy
+import sys
+import time
+
+
+FRAME_WIDTH = 320
+FRAME_HEIGHT = 200
+
+
+def main(count, mode):
+    # Initialize Pixy interface
+    if pixy.pixy_init() < 0:
+        print("Failed to initialize USB interface")
+        sys.exit(-1)
+
+    # Stop default program
+    pixy.pixy_command("stop")
+
+    data = pixy.byteArray(FRAME_WIDTH * FRAME_HEIGHT)
+
+    failures = 0
+    max = 0
+    start = time.time()
+    for i in range(count):
+        t = time.time()
+        if pixy.pixy_cam_get_frame(mode, 0, 0, FRAME_WIDTH, FRAME_HEIGHT, data) < 0:
+            failures = failures + 1
+            continue
+        t = time.time() - t
+        if t > max:
+            max = t
+    elapsed = time.time() - start
+
+    frames = count - failures
+    print("frames: {}, failures: {}".format(frames, failures))
+    print("frames/sec: {:.1f}".format(frames / elapsed))
+    print("MB/sec: {:.2f}".format(frames * FRAME_WIDTH * FRAME_HEIGHT / elapsed / 1e6))
+    print("max: {:.1f} ms".format(max * 1000.0))
+
+    # Close connection to Pixy
+    pixy.pixy_close()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-n', '--count', type=int, default=100)
+    # 0x21 is CAM_GRAB_M1R2, a 320x200 frame binned from the full sensor
+    parser.add_argument('-m', '--mode', type=lambda x: int(x, 0), default=0x21)
+    args = parser.parse_args()
+    main(args.count, args.mode)
@@ -4,6 +4,15 @@
 #include <signal.h>
 #include <string.h>
 #include "pixy.h"
+#include "pixyinterpreter.hpp"
+
+
+// interpreter is defined by libpixyusb (pixy.cpp)
+extern PixyInterpreter interpreter;
+
+static ChirpBinding<ChirpIn<uint8_t, uint16_t, uint16_t, uint16_t, uint16_t>,
+                    ChirpOut<int32_t, ChirpFourcc, ChirpHint<uint8_t>, uint16_t, uint16_t, ChirpArray<uint8_t> > > camGetFrame("cam_getFrame");
+static ChirpBinding<ChirpIn<uint32_t, uint32_t>, ChirpOut<int32_t, ChirpArray<uint8_t> > > readBlocks("read_blocks");
 
 
 // frame should be at least 64000 bytes
@@ -14,34 +23,26 @@ int pixy_cam_get_frame(uint8_t mode, uint16_t xoffset, uint16_t yoffset, uint16_
         return -1;
     }
 
-    uint8_t *out_pixels;
-    int32_t out_fourcc;
-    int8_t out_flags;
+    ChirpFourcc out_fourcc;
+    ChirpHint<uint8_t> out_flags;
     uint16_t out_width;
     uint16_t out_height;
-    uint32_t out_pixel_cnt;
+    ChirpArray<uint8_t> out_pixels;
     int32_t out_response = 0;
     int ret;
 
-    ret = pixy_command("cam_getFrame",
-                        CRP_UINT8,  mode,
-                        CRP_UINT16, xoffset,
-                        CRP_UINT16, yoffset,
-                        CRP_UINT16, width,
-                        CRP_UINT16, height,
-                        END_OUT_ARGS,        // separator
-                        &out_response,       // pointer to mem address for return value
-                        &out_fourcc,         // contrary to docs, the next 5 args are needed
-                        &out_flags,
-                        &out_width,
-                        &out_height,
-                        &out_pixel_cnt,
-                        &out_pixels,         // pointer to mem address for returned frame
-                        END_IN_ARGS);
+    ret = interpreter.call_command(camGetFrame,
+                                   mode, xoffset, yoffset, width, height,
+                                   out_response,        // return value
+                                   out_fourcc,          // BA81, hint
+                                   out_flags,           // render flags, hint
+                                   out_width,
+                                   out_height,
+                                   out_pixels);         // returned frame
 
     if (ret == 0)
     {
-        memcpy(frame, out_pixels, out_pixel_cnt);
+        memcpy(frame, out_pixels.data, out_pixels.len);
     }
 
     return ret;
@@ -55,23 +56,15 @@ int pixy_read_blocks(uint32_t block_start, uint32_t block_count, uint8_t *buffer
         return -1;
     }
 
-    uint8_t *out_data;
-    uint32_t out_len = 0;
+    ChirpArray<uint8_t> out_data;
     int32_t out_response = -1;
     int ret;
 
-    ret = pixy_command("read_blocks",
-                        CRP_UINT32, block_start,
-                        CRP_UINT32, block_count,
-                        END_OUT_ARGS,
-                        &out_response,
-                        &out_len,
-                        &out_data,
-                        END_IN_ARGS);
+    ret = interpreter.call_command(readBlocks, block_start, block_count, out_response, out_data);
 
     if (ret == 0)
     {
-        memcpy(buffer, out_data, out_len);
+        memcpy(buffer, out_data.data, out_data.len);
     }
 
     return ret;
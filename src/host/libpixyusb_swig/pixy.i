@@ -24,6 +24,8 @@ int pixy_get_firmware_version(uint16_t *OUTPUT, uint16_t *OUTPUT, uint16_t *OUTP
 
 int pixy_init();
 int pixy_command(const char *name, ...);
+int pixy_command_prepare(const char *name);
+int pixy_command_exec(int handle, ...);
 int pixy_get_blocks(uint16_t max_blocks, BlockArray *blocks);
 int pixy_led_set_RGB(uint8_t red, uint8_t green, uint8_t blue);
 int pixy_led_set_max_current(uint32_t current);
@@ -8,6 +8,7 @@ pixy_module = Extension('_pixy',
 	include_dirs = ['/usr/include/libusb-1.0',
 	'/usr/local/include/libusb-1.0',
 	'../../src/common/inc',
+	'../../src/host/libpixyusb/src',
 	'../../src/host/libpixyusb/src/utils',
 	'../../src/host/libpixyusb/include',
 	'../../src/host/libpixyusb_swig'],
@@ -16,6 +17,7 @@ pixy_module = Extension('_pixy',
 	'boost_chrono',
 	'pthread',
 	'usb-1.0'],
+	extra_compile_args = ['-std=c++11'],
 	sources=['pixy_wrap.cxx',
 	'../../src/common/src/chirp.cpp',
 	'../../src/host/libpixyusb/src/pixy.cpp',
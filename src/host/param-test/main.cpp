@@ -0,0 +1,501 @@
+/**
+ * @file main.cpp
+ * @brief Tests the camera's parameter store (common/inc/paramstore.h) on a simulated NOR
+ *        flash: values and batches persist, unchanged values aren't written, sectors wear
+ *        evenly, and power lost at any erase or program leaves each value old or new and
+ *        each batch all old or all new, with the store usable after the restart.  Times
+ *        get() and init().
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "paramstore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FLASH_BASE          0x14000000
+#define FLASH_MAX           (16 * 4096)
+#define DEVICE_SECTOR_SIZE  4096    // FLASH_SECTOR_SIZE
+#define DEVICE_SECTORS      8       // PRM_ALLOCATED_LEN / FLASH_SECTOR_SIZE
+#define WEAR_SETS           200000
+#define SWEEP_SECTOR_SIZE   256     // small, so the sweep crosses many sectors
+#define SWEEP_SECTORS       4
+#define SWEEP_STEPS         120
+#define SWEEP_KEYS          4       // the last only set once, so it has to survive being copied
+#define GET_LOOPS           10000000
+
+// A NOR flash: erase sets a sector to 0xff, program can only clear bits.  Each erased sector
+// and each program call is an operation; when power_ counts down to 0 the operation is cut
+// short, an erase leaving the sector's bits anything between old and erased and a program
+// leaving a prefix written and the next byte partly, and every operation after it fails
+// until restart().
+static uint8_t flash_[FLASH_MAX];
+static uint32_t sectorSize_;
+static int32_t power_ = -1;     // operations until the power is lost, -1 never
+static bool dead_ = false;
+static uint32_t ops_;
+static uint32_t overwrites_;    // programs of a 1 over a 0, the store's bug
+static uint32_t random_ = 1;
+static bool verbose_ = false;
+
+static uint32_t rnd()
+{
+    random_ = random_ * 1103515245 + 12345;
+    return random_ >> 8;
+}
+
+static bool lose_power()
+{
+    ops_++;
+    if (power_ > 0 && --power_ == 0)
+    {
+        dead_ = true;
+        return true;
+    }
+    return false;
+}
+
+static int32_t sim_erase(uint32_t addr, uint32_t len)
+{
+    uint32_t i, j;
+
+    addr -= FLASH_BASE;
+    if (dead_ || addr % sectorSize_ || len % sectorSize_ || addr + len > FLASH_MAX)
+        return -1;
+    for (i = 0; i < len; i += sectorSize_)
+    {
+        if (lose_power())
+        {
+            for (j = 0; j < sectorSize_; j++)
+                flash_[addr + i + j] |= rnd();
+            return -1;
+        }
+        memset(flash_ + addr + i, 0xff, sectorSize_);
+    }
+    return 0;
+}
+
+static int32_t sim_program(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    uint32_t i, n = len;
+
+    addr -= FLASH_BASE;
+    if (dead_ || addr + len > FLASH_MAX)
+        return -1;
+    if (lose_power())
+        n = rnd() % len;
+    for (i = 0; i < n; i++)
+    {
+        if ((flash_[addr + i] & data[i]) != data[i])
+            overwrites_++;
+        flash_[addr + i] &= data[i];
+    }
+    if (n < len)
+    {
+        flash_[addr + n] &= data[n] | rnd();
+        return -1;
+    }
+    return 0;
+}
+
+static void make_flash(ParamFlash *flash, uint32_t sectorSize, uint8_t sectors)
+{
+    sectorSize_ = sectorSize;
+    flash->mem = flash_;
+    flash->addr = FLASH_BASE;
+    flash->sectorSize = sectorSize;
+    flash->sectors = sectors;
+    flash->erase = sim_erase;
+    flash->program = sim_program;
+}
+
+static void restart()
+{
+    dead_ = false;
+}
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int check(bool ok, const char *what)
+{
+    if (!ok)
+        printf("  %s  FAILED\n", what);
+    return ok ? 0 : 1;
+}
+
+static int test_basic()
+{
+    ParamFlash flash;
+    ParamStore *store;
+    uint32_t area = 20, threshold = 170, u32, records;
+    uint8_t dist = 7, u8, len, pad[6] = { 1, 2, 3, 4, 5, 6 }, pad2[6] = { 6, 5, 4, 3, 2, 1 };
+    const uint8_t *value;
+    ParamUpdate batch[2];
+    int failed = 0;
+
+    printf("basic, %u sectors of %u bytes\n", DEVICE_SECTORS, DEVICE_SECTOR_SIZE);
+    memset(flash_, 0, sizeof(flash_)); // not erased, init() formats
+    make_flash(&flash, DEVICE_SECTOR_SIZE, DEVICE_SECTORS);
+
+    store = new ParamStore;
+    failed += check(store->init(&flash) == PS_OK, "init formats");
+    failed += check(store->add(1, &area, 4) == PS_OK && store->add(2, &dist, 1) == PS_OK &&
+                    store->add(3, pad, 6) == PS_OK, "add");
+    value = store->get(1, &len);
+    failed += check(value && len == 4 && memcmp(value, &area, 4) == 0, "default");
+    failed += check(store->get(4) == NULL, "get of a key not added");
+    u32 = 35;
+    failed += check(store->set(1, &u32, 4) == PS_OK && memcmp(store->get(1), &u32, 4) == 0, "set");
+    records = store->records();
+    failed += check(store->set(1, &u32, 4) == PS_OK && store->records() == records, "unchanged set writes nothing");
+    failed += check(store->set(1, &u8, 1) == PS_ERROR_VALUE, "set of another length");
+    failed += check(store->set(4, &u32, 4) == PS_ERROR_KEY, "set of a key not added");
+    failed += check(store->add(PS_KEY_COMMIT, &u32, 4) == PS_ERROR_KEY, "add of a reserved key");
+    u8 = 12;
+    batch[0].key = 2;
+    batch[0].value = &u8;
+    batch[0].len = 1;
+    batch[1].key = 3;
+    batch[1].value = pad2;
+    batch[1].len = 6;
+    failed += check(store->set(batch, 2) == PS_OK, "batch");
+    delete store;
+
+    // the new firmware changed key 3 to 4 bytes and added key 5
+    store = new ParamStore;
+    failed += check(store->init(&flash) == PS_OK, "init");
+    store->add(1, &area, 4);
+    store->add(2, &dist, 1);
+    store->add(3, &threshold, 4);
+    store->add(5, &threshold, 4);
+    failed += check(memcmp(store->get(1), &u32, 4) == 0 && *store->get(2) == 12, "values persist");
+    failed += check(memcmp(store->get(3), &threshold, 4) == 0, "a value of another length gives the default");
+    failed += check(memcmp(store->get(5), &threshold, 4) == 0, "a new key gives the default");
+    failed += check(store->format() == PS_OK, "format");
+    delete store;
+
+    store = new ParamStore;
+    failed += check(store->init(&flash) == PS_OK, "init");
+    store->add(1, &area, 4);
+    failed += check(memcmp(store->get(1), &area, 4) == 0, "defaults after format");
+    delete store;
+    failed += check(overwrites_ == 0, "no program of a 1 over a 0");
+    return failed;
+}
+
+static int test_wear()
+{
+    ParamFlash flash;
+    ParamStore *store;
+    static const uint8_t lens[] = { 4, 1, 2, 8, 24, 4, 12 };
+    uint8_t value[sizeof(lens)][PS_MAX_VALUE], def[PS_MAX_VALUE];
+    uint32_t i, k, j, min, max;
+    double start, us;
+    int failed = 0;
+
+    printf("wear, %u random sets of %u values\n", WEAR_SETS, (unsigned)sizeof(lens));
+    memset(flash_, 0xff, sizeof(flash_));
+    make_flash(&flash, DEVICE_SECTOR_SIZE, DEVICE_SECTORS);
+    memset(def, 0, sizeof(def));
+    store = new ParamStore;
+    store->init(&flash);
+    for (k = 0; k < sizeof(lens); k++)
+    {
+        store->add(k + 1, def, lens[k]);
+        memset(value[k], 0, lens[k]);
+    }
+    for (i = 0; i < WEAR_SETS; i++)
+    {
+        k = rnd() % sizeof(lens);
+        for (j = 0; j < lens[k]; j++)
+            value[k][j] = rnd();
+        if (store->set(k + 1, value[k], lens[k]) != PS_OK)
+        {
+            failed += check(false, "set");
+            break;
+        }
+    }
+    store->eraseCounts(&min, &max);
+    printf("  %u records (copies included), sector erases %u..%u\n", store->records(), min, max);
+    failed += check(max - min <= 1, "erases within 1 of each other");
+    failed += check(store->records() < WEAR_SETS * 5 / 4, "copies under a quarter of the writes");
+    delete store;
+
+    store = new ParamStore;
+    start = now_us();
+    store->init(&flash);
+    us = now_us() - start;
+    for (k = 0; k < sizeof(lens); k++)
+    {
+        store->add(k + 1, def, lens[k]);
+        if (memcmp(store->get(k + 1), value[k], lens[k]))
+            break;
+    }
+    failed += check(k == sizeof(lens), "values persist");
+    printf("  init %.1f us for %u sectors\n", us, DEVICE_SECTORS);
+    delete store;
+    failed += check(overwrites_ == 0, "no program of a 1 over a 0");
+    return failed;
+}
+
+// step 0 sets the last key, the others one of the rest, or every third step a batch of 2 or 3
+static uint8_t step_keys(uint32_t s, uint16_t *keys)
+{
+    uint8_t n = s % 3 == 2 ? 2 + s / 3 % 2 : 1, i;
+
+    if (s == 0)
+    {
+        keys[0] = SWEEP_KEYS;
+        return 1;
+    }
+    for (i = 0; i < n; i++)
+        keys[i] = 1 + (s + i) % (SWEEP_KEYS - 1);
+    return n;
+}
+
+static const uint8_t sweepLens_[SWEEP_KEYS] = { 4, 8, 12, 4 };
+
+static void step_value(uint32_t s, uint16_t key, uint8_t *value)
+{
+    uint8_t i;
+
+    for (i = 0; i < sweepLens_[key - 1]; i++)
+        value[i] = s * 31 + key * 7 + i * 13 + (i == 1 ? s >> 8 : 0);
+}
+
+static void add_sweep(ParamStore *store)
+{
+    uint8_t def[PS_MAX_VALUE];
+    uint16_t k;
+
+    memset(def, 0, sizeof(def));
+    for (k = 1; k <= SWEEP_KEYS; k++)
+        store->add(k, def, sweepLens_[k - 1]);
+}
+
+static void apply_step(uint8_t model[][PS_MAX_VALUE], uint32_t s)
+{
+    uint16_t keys[PS_MAX_BATCH];
+    uint8_t n = step_keys(s, keys), i;
+
+    for (i = 0; i < n; i++)
+        step_value(s, keys[i], model[keys[i] - 1]);
+}
+
+static int run_step(ParamStore *store, uint32_t s)
+{
+    uint8_t values[PS_MAX_BATCH][PS_MAX_VALUE], n, i;
+    uint16_t keys[PS_MAX_BATCH];
+    ParamUpdate updates[PS_MAX_BATCH];
+
+    n = step_keys(s, keys);
+    for (i = 0; i < n; i++)
+    {
+        step_value(s, keys[i], values[i]);
+        updates[i].key = keys[i];
+        updates[i].value = values[i];
+        updates[i].len = sweepLens_[keys[i] - 1];
+    }
+    return n == 1 ? store->set(keys[0], values[0], updates[0].len) : store->set(updates, n);
+}
+
+// After power was lost in step s (s==-1 none), each value must be as in model, or as s
+// left it, all of s's or none.  model then holds what's there.
+static bool verify(ParamStore *store, uint8_t model[][PS_MAX_VALUE], int32_t s, uint32_t cut)
+{
+    uint8_t value[PS_MAX_VALUE], n = 0, i, taken = 0;
+    uint16_t keys[PS_MAX_BATCH], k;
+    const uint8_t *v;
+    bool in;
+
+    if (s >= 0)
+        n = step_keys(s, keys);
+    for (k = 1; k <= SWEEP_KEYS; k++)
+    {
+        v = store->get(k);
+        for (i = 0, in = false; i < n; i++)
+            in |= keys[i] == k;
+        if (memcmp(v, model[k - 1], sweepLens_[k - 1]) == 0)
+            continue;
+        if (in)
+        {
+            step_value(s, k, value);
+            if (memcmp(v, value, sweepLens_[k - 1]) == 0)
+            {
+                taken++;
+                continue;
+            }
+        }
+        if (verbose_)
+            printf("  cut at op %u, step %d: key %u is neither old nor new\n", cut, s, k);
+        return false;
+    }
+    // all or none; a new value equal to the old one can't tell, step_value() avoids that
+    if (taken && taken != n)
+    {
+        if (verbose_)
+            printf("  cut at op %u, step %d: %u of a batch of %u taken\n", cut, s, taken, n);
+        return false;
+    }
+    for (k = 1; k <= SWEEP_KEYS; k++)
+        memcpy(model[k - 1], store->get(k), sweepLens_[k - 1]);
+    return true;
+}
+
+// Runs the steps, losing power at cut operations in and at cut2 more after the first
+// restart.  False if a value went wrong or the store stopped working.
+static bool sweep_run(ParamFlash *flash, uint32_t cut, uint32_t cut2, uint32_t *restarts)
+{
+    uint8_t model[SWEEP_KEYS][PS_MAX_VALUE];
+    ParamStore *store = new ParamStore;
+    int32_t pending = -1;
+    uint32_t s = 0, k, cuts = 0;
+    bool ok = true;
+
+    memset(flash_, 0xff, sizeof(flash_));
+    memset(model, 0, sizeof(model));
+    restart();
+    random_ = cut * 2654435761u + cut2;
+    power_ = cut;
+    if (store->init(flash) == PS_OK)
+        add_sweep(store);
+
+    while (ok && s <= SWEEP_STEPS)
+    {
+        if (!dead_)
+        {
+            if (s == SWEEP_STEPS)
+                break;
+            // only power loss makes a step fail
+            if (run_step(store, s) == PS_OK)
+                apply_step(model, s);
+            else if (dead_)
+                pending = s;
+            else
+                ok = false;
+            s++;
+            continue;
+        }
+        // restart, the power may go again while it starts up
+        delete store;
+        restart();
+        (*restarts)++;
+        if (++cuts == 1)
+            power_ = cut2;
+        store = new ParamStore;
+        if (store->init(flash) != PS_OK || dead_)
+        {
+            ok = dead_;
+            continue;
+        }
+        add_sweep(store);
+        ok = verify(store, model, pending, cut);
+        pending = -1;
+    }
+
+    // a last restart with the power on finds everything as the model has it
+    delete store;
+    restart();
+    power_ = -1;
+    store = new ParamStore;
+    ok = ok && store->init(flash) == PS_OK;
+    add_sweep(store);
+    for (k = 1; ok && k <= SWEEP_KEYS; k++)
+        ok = memcmp(store->get(k), model[k - 1], sweepLens_[k - 1]) == 0;
+    // and takes another write
+    ok = ok && run_step(store, SWEEP_STEPS) == PS_OK;
+    delete store;
+    return ok;
+}
+
+static int test_power_loss()
+{
+    ParamFlash flash;
+    uint32_t total, cut, bad = 0, restarts = 0;
+
+    make_flash(&flash, SWEEP_SECTOR_SIZE, SWEEP_SECTORS);
+    // how many operations the steps take with the power on
+    ops_ = 0;
+    sweep_run(&flash, 0, 0, &restarts);
+    total = ops_;
+    printf("power loss, %u steps on %u sectors of %u bytes, %u operations, cut at each\n", SWEEP_STEPS,
+           SWEEP_SECTORS, SWEEP_SECTOR_SIZE, total);
+
+    for (cut = 1; cut <= total; cut++)
+    {
+        // the second cut hits the restart's repair for some, a later step for most
+        if (!sweep_run(&flash, cut, 0, &restarts) || !sweep_run(&flash, cut, 1 + cut % 17, &restarts))
+        {
+            if (bad++ == 0 || verbose_)
+                printf("  cut at op %u went wrong\n", cut);
+        }
+    }
+    printf("  %u restarts, %u bad\n", restarts, bad);
+    return check(bad == 0 && overwrites_ == 0, "every value old or new, every batch all or none");
+}
+
+static int test_get()
+{
+    ParamFlash flash;
+    ParamStore store;
+    uint32_t i, def = 0;
+    volatile uint8_t sink;
+    double start, ns;
+
+    memset(flash_, 0xff, sizeof(flash_));
+    make_flash(&flash, DEVICE_SECTOR_SIZE, DEVICE_SECTORS);
+    store.init(&flash);
+    for (i = 0; i < PS_MAX_PARAMS; i++)
+        store.add(i * 977 + 1, &def, 4);
+    start = now_us();
+    for (i = 0; i < GET_LOOPS; i++)
+        sink = *store.get((i % PS_MAX_PARAMS) * 977 + 1);
+    ns = (now_us() - start) * 1e3 / GET_LOOPS;
+    (void)sink;
+    printf("get, %u keys: %.1f ns\n", PS_MAX_PARAMS, ns);
+    return 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-v]\n", progname);
+    printf("  -v  Print every power loss that went wrong\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "vh")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = true;
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    failures += test_basic();
+    failures += test_wear();
+    failures += test_power_loss();
+    failures += test_get();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
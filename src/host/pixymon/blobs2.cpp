@@ -944,6 +944,8 @@ void Blobs2::addSegment(uint8_t sig, uint16_t row, uint16_t startCol, uint16_t e
     s.row = row;
     s.startCol = startCol;
     s.endCol = endCol;
+    s.peak = 0;
+    s.sum = 0;
 
     m_assembler[s.model-1].Add(s);
 }
@@ -26,6 +26,10 @@ SOURCES += main.cpp\
     ../../common/src/colorlut.cpp \
     ../../common/src/blob.cpp \
     ../../common/src/blobs.cpp \
+    ../../common/src/tracker.cpp \
+    ../../common/src/beacons.cpp \
+    ../../common/src/pose.cpp \
+    ../../common/src/undistort.cpp \
     ../../common/src/qqueue.cpp \
     ../../common/src/calc.cpp \
     configdialog.cpp \
@@ -60,6 +64,10 @@ HEADERS  += mainwindow.h \
     ../../common/inc/colorlut.h \
     ../../common/inc/blobs.h \
     ../../common/inc/blob.h \
+    ../../common/inc/tracker.h \
+    ../../common/inc/beacons.h \
+    ../../common/inc/pose.h \
+    ../../common/inc/undistort.h \
     ../../common/inc/blobs.h \
     ../../common/inc/qqueue.h \
     ../../common/inc/link.h \
@@ -57,7 +57,7 @@ void USBLink::close()
 int USBLink::openDevice()
 {
     libusb_device **list = NULL;
-    int i, count = 0;
+    int i, res, count = 0;
     libusb_device *device;
     libusb_device_descriptor desc;
 
@@ -91,6 +91,9 @@ int USBLink::openDevice()
 #ifdef __LINUX__
                 libusb_reset_device(m_handle);
 #endif
+                // chirp blocks match the bulk packet size: 512 at high speed, 64 at full speed
+                if ((res=libusb_get_max_packet_size(device, 0x82))>0)
+                    m_blockSize = res;
                 break;
             }
         }
@@ -132,6 +135,9 @@ int USBLink::receive(uint8_t *data, uint32_t len, uint16_t timeoutMs)
     // cause us to revert to a 1.0 connection.
     if ((res=libusb_bulk_transfer(m_handle, 0x82, (unsigned char *)data, len, &transferred, timeoutMs))<0)
     {
+        // a large transfer can time out part way through, return what arrived so the caller can keep reading
+        if (res==LIBUSB_ERROR_TIMEOUT && transferred>0)
+            return transferred;
 #ifdef __MACOS__
         libusb_clear_halt(m_handle, 0x82);
 #endif
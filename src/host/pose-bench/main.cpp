@@ -0,0 +1,359 @@
+/**
+ * @file main.cpp
+ * @brief Runs the camera's landing pad matcher and pose estimator (common/inc/pose.h) on
+ *        synthetic views of the pad, projected through a pinhole camera from known poses,
+ *        with noise, missed beacons and clutter, and reports how often the pad is found,
+ *        position and yaw error, the samples and hypotheses tried and the time per frame.
+ *        Checks the pose survives its block format.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "pose.h"
+#include "pixyblocks.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAMES              2000
+#define WIDTH               320
+#define HEIGHT              200
+#define MARGIN              4       // pixels, beacons this close to the edge are not seen
+#define BEACON_SIZE         80.0    // mm, diameter of a beacon's glow
+#define MAX_BLOBS           20      // MAX_BLOBS in blobs.h
+#define GOOD_POSITION       0.20    // of the distance, more position error than this is a wrong match
+#define GOOD_YAW            15.0    // degrees
+
+typedef struct
+{
+    const char *name;
+    const int16_t *pad;
+    uint8_t padPoints;
+    double minZ, maxZ;      // mm, distance range
+    double tilt;            // degrees, most the camera is off looking straight down
+    double noise;           // pixels, standard deviation of the blob centers
+    uint8_t missed;         // beacons per frame that give no blob
+    uint8_t clutter;        // blobs per frame that belong to no beacon
+    double minGood;         // fraction of frames that must give a good pose
+} Scene;
+
+// the default pad in pose.cpp, and a 4 point one, neither looks the same turned
+static const int16_t pad_[] = { -600, -600, 600, -600, 600, 600, -600, 600, 0, 300 };
+static const int16_t kite_[] = { -600, -600, 600, -600, 600, 600, -300, 400 };
+
+// A missed inner beacon leaves the square of the corners, which looks the same turned, so
+// about a fifth of those frames can't give a pose.  With clutter, 4 blobs fit a rigid pad
+// too easily to be told apart.  Past a few clutter blobs the sample budget runs out first.
+static const Scene scenes_[] =
+{
+    { "overhead 3-10 m", pad_, 5, 3000, 10000, 5, 0.3, 0, 0, 0.99 },
+    { "tilted 30 deg", pad_, 5, 3000, 10000, 30, 0.3, 0, 0, 0.99 },
+    { "close 1.5-3 m", pad_, 5, 1500, 3000, 30, 0.3, 0, 0, 0.99 },
+    { "far 10-20 m", pad_, 5, 10000, 20000, 10, 0.3, 0, 0, 0.90 },
+    { "noise 1 px", pad_, 5, 3000, 10000, 10, 1.0, 0, 0, 0.85 },
+    { "+3 clutter", pad_, 5, 3000, 10000, 10, 0.3, 0, 3, 0.98 },
+    { "+10 clutter", pad_, 5, 3000, 10000, 10, 0.3, 0, 10, 0.30 },
+    { "1 missed", pad_, 5, 3000, 10000, 10, 0.3, 1, 0, 0.65 },
+    { "1 missed +2 clutter", pad_, 5, 3000, 10000, 10, 0.3, 1, 2, 0.40 },
+    { "4 point pad", kite_, 4, 3000, 10000, 10, 0.3, 0, 0, 0.98 },
+};
+
+typedef struct
+{
+    uint32_t good;          // pose within GOOD_POSITION and GOOD_YAW
+    uint32_t bad;           // pose reported but not good
+    uint32_t missed;        // no pose
+    double posError;        // of good poses, relative to distance
+    double yawError;        // of good poses, degrees
+    uint32_t samples;
+    uint32_t hypotheses;
+    uint32_t maxHypotheses;
+    double totalUs;
+    double maxUs;
+    uint32_t roundTripErrors;
+} Result;
+
+static uint32_t seed_ = 1;
+static bool verbose_ = false;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+static double uniform()
+{
+    return (rnd(0x8000) + 0.5) / 0x8000;
+}
+
+static double gauss()
+{
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void rotate_x(double a, double r[9])
+{
+    double c = cos(a), s = sin(a), t[9];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        t[i] = r[i];
+        t[3 + i] = c * r[3 + i] - s * r[6 + i];
+        t[6 + i] = s * r[3 + i] + c * r[6 + i];
+    }
+    memcpy(r, t, sizeof(t));
+}
+
+static void rotate_y(double a, double r[9])
+{
+    double c = cos(a), s = sin(a), t[9];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        t[i] = c * r[i] + s * r[6 + i];
+        t[3 + i] = r[3 + i];
+        t[6 + i] = -s * r[i] + c * r[6 + i];
+    }
+    memcpy(r, t, sizeof(t));
+}
+
+static void put_blob(uint16_t *blob, double x, double y, double size)
+{
+    uint16_t w = size < 1 ? 1 : (uint16_t)(size + 0.5);
+
+    blob[0] = 1;
+    blob[1] = (uint16_t)(x - w / 2.0 + 0.5);
+    blob[2] = blob[1] + w;
+    blob[3] = (uint16_t)(y - w / 2.0 + 0.5);
+    blob[4] = blob[3] + w;
+}
+
+// A random pose of the pad with all of it in view, and the blobs the camera would see.
+// r and t take pad points (mm) to the camera frame.  Returns the number of blobs.
+static uint16_t make_view(const Scene *scene, double r[9], double t[3], uint16_t *blobs)
+{
+    double u[PO_MAX_MODEL], v[PO_MAX_MODEL], z, yaw, tilt, dir, x, y, c[3];
+    uint16_t n, i, j, tmp[5];
+    bool inView;
+
+    do
+    {
+        // pad z toward the camera, then yaw about it and the camera tilted off vertical
+        yaw = 2.0 * M_PI * uniform();
+        memset(r, 0, 9 * sizeof(double));
+        r[0] = cos(yaw);
+        r[1] = -sin(yaw);
+        r[3] = -sin(yaw);
+        r[4] = -cos(yaw);
+        r[8] = -1.0;
+        tilt = scene->tilt * M_PI / 180.0 * uniform();
+        dir = 2.0 * M_PI * uniform();
+        rotate_x(tilt * cos(dir), r);
+        rotate_y(tilt * sin(dir), r);
+
+        z = scene->minZ + (scene->maxZ - scene->minZ) * uniform();
+        t[2] = z;
+        t[0] = (uniform() - 0.5) * 0.6 * WIDTH * z / UD_DEFAULT_FX;
+        t[1] = (uniform() - 0.5) * 0.6 * HEIGHT * z / UD_DEFAULT_FY;
+
+        inView = true;
+        for (i = 0; i < scene->padPoints && inView; i++)
+        {
+            for (j = 0; j < 3; j++)
+                c[j] = r[j * 3] * scene->pad[i * 2] + r[j * 3 + 1] * scene->pad[i * 2 + 1] + t[j];
+            u[i] = UD_DEFAULT_FX * c[0] / c[2] + UD_DEFAULT_CX + scene->noise * gauss();
+            v[i] = UD_DEFAULT_FY * c[1] / c[2] + UD_DEFAULT_CY + scene->noise * gauss();
+            inView = c[2] > 0 && u[i] >= MARGIN && u[i] < WIDTH - MARGIN && v[i] >= MARGIN && v[i] < HEIGHT - MARGIN;
+        }
+    }
+    while (!inView);
+
+    for (i = 0, n = 0; i < scene->padPoints; i++)
+        put_blob(blobs + 5 * n++, u[i], v[i], BEACON_SIZE * UD_DEFAULT_FX / t[2]);
+    // missed beacons: drop random ones
+    for (i = 0; i < scene->missed && n > 0; i++)
+    {
+        j = rnd(n);
+        memmove(blobs + 5 * j, blobs + 5 * (j + 1), 5 * (n - j - 1) * sizeof(uint16_t));
+        n--;
+    }
+    for (i = 0; i < scene->clutter && n < MAX_BLOBS; i++)
+    {
+        x = MARGIN + (WIDTH - 2 * MARGIN) * uniform();
+        y = MARGIN + (HEIGHT - 2 * MARGIN) * uniform();
+        put_blob(blobs + 5 * n++, x, y, 1 + 4 * uniform());
+    }
+    // the camera sorts blobs by size, which says nothing about which is which
+    for (i = n; i > 1; i--)
+    {
+        j = rnd(i);
+        memcpy(tmp, blobs + 5 * (i - 1), sizeof(tmp));
+        memcpy(blobs + 5 * (i - 1), blobs + 5 * j, sizeof(tmp));
+        memcpy(blobs + 5 * j, tmp, sizeof(tmp));
+    }
+    return n;
+}
+
+// Sends the pose the way Blobs::encodePoseFrame() does and checks the decoder gets it back.
+static bool round_trip(const PoseResult *pose, uint16_t seq, uint32_t timestamp)
+{
+    static PixyBlockDecoder dec;
+    PixyPose sent;
+    uint8_t buf[BF_POSE_FRAME_LEN];
+    double error = pose->error * BF_POSE_ERROR_SCALE;
+    uint32_t len, i;
+    bool done = false;
+
+    sent.inliers = pose->inliers;
+    sent.x = pose->x < -32767 ? -32767 : (pose->x > 32767 ? 32767 : (int32_t)pose->x);
+    sent.y = pose->y < -32767 ? -32767 : (pose->y > 32767 ? 32767 : (int32_t)pose->y);
+    sent.z = pose->z > 65535 ? 65535 : (uint32_t)pose->z;
+    sent.yaw = (int32_t)(pose->yaw * (18000.0f / 3.14159265f) + 36000.5f) % 36000;
+    sent.error = error > 65535 ? 65535 : (uint16_t)(error + 0.5);
+
+    len = pixy_blocks_encode_pose(seq, timestamp, pose->valid ? &sent : NULL, buf);
+    if (seq == 0)
+        pixy_blocks_init(&dec);
+    for (i = 0; i < len; i++)
+        done |= pixy_blocks_push(&dec, buf[i]) == 1;
+    if (!done || dec.format != BF_FORMAT_POSE || dec.count != (pose->valid ? 1 : 0) || dec.seq != seq ||
+        dec.timestamp != timestamp)
+        return false;
+    return !pose->valid || (dec.pose.inliers == sent.inliers && dec.pose.x == sent.x && dec.pose.y == sent.y &&
+                            dec.pose.z == sent.z && dec.pose.yaw == sent.yaw && dec.pose.error == sent.error);
+}
+
+static void run_scene(const Scene *scene, Result *res)
+{
+    Pose pose;
+    Undistort undistort;
+    const PoseResult *result;
+    uint16_t blobs[MAX_BLOBS * 5], numBlobs;
+    double r[9], t[3], us, dist, posError, yaw, yawError;
+    uint32_t frame;
+
+    memset(res, 0, sizeof(*res));
+    pose.setModel(scene->pad, scene->padPoints, 0);
+    pose.setCamera(&undistort);
+    for (frame = 0; frame < FRAMES; frame++)
+    {
+        numBlobs = make_view(scene, r, t, blobs);
+
+        us = now_us();
+        pose.update(blobs, numBlobs);
+        us = now_us() - us;
+        result = pose.result();
+
+        res->totalUs += us;
+        if (us > res->maxUs)
+            res->maxUs = us;
+        res->samples += result->samples;
+        res->hypotheses += result->hypotheses;
+        if (result->hypotheses > res->maxHypotheses)
+            res->maxHypotheses = result->hypotheses;
+        if (!round_trip(result, frame, frame * 20000))
+            res->roundTripErrors++;
+
+        if (!result->valid)
+        {
+            res->missed++;
+            continue;
+        }
+        dist = sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+        posError = sqrt((result->x - t[0]) * (result->x - t[0]) + (result->y - t[1]) * (result->y - t[1]) +
+                        (result->z - t[2]) * (result->z - t[2])) / dist;
+        yaw = atan2(r[3], r[0]);
+        yawError = fabs(remainder(result->yaw - yaw, 2.0 * M_PI)) * 180.0 / M_PI;
+        if (posError <= GOOD_POSITION && yawError <= GOOD_YAW)
+        {
+            res->good++;
+            res->posError += posError;
+            res->yawError += yawError;
+        }
+        else
+        {
+            res->bad++;
+            if (verbose_)
+                printf("  %s frame %u: %u inliers, position off %.1f%%, yaw off %.1f deg, z %.0f for %.0f mm, error %.2f px\n",
+                       scene->name, frame, result->inliers, 100.0 * posError, yawError, result->z, t[2], result->error);
+        }
+    }
+}
+
+static int test_scenes()
+{
+    Result res;
+    uint32_t failed = 0, bad;
+    size_t s;
+
+    printf("%d frames per scene, %d samples and %d hypotheses at most, inliers within %.1f px\n", FRAMES,
+           PO_MAX_SAMPLES, PO_MAX_HYPOTHESES, PO_INLIER_TOL);
+    printf("  %-20s %7s %6s %6s %7s %7s %8s %8s %8s %8s %8s\n", "scene", "good", "bad", "none", "pos err", "yaw err",
+           "samples", "hyps", "max hyps", "mean us", "max us");
+    for (s = 0; s < sizeof(scenes_) / sizeof(scenes_[0]); s++)
+    {
+        run_scene(scenes_ + s, &res);
+        bad = res.good < scenes_[s].minGood * FRAMES || res.bad > FRAMES / 100 || res.roundTripErrors;
+        printf("  %-20s %6.1f%% %6u %6u %6.2f%% %7.2f %8.1f %8.1f %8u %8.2f %8.2f%s\n", scenes_[s].name,
+               100.0 * res.good / FRAMES, res.bad, res.missed, res.good ? 100.0 * res.posError / res.good : 0.0,
+               res.good ? res.yawError / res.good : 0.0, (double)res.samples / FRAMES,
+               (double)res.hypotheses / FRAMES, res.maxHypotheses, res.totalUs / FRAMES, res.maxUs,
+               bad ? "  FAILED" : "");
+        failed += bad;
+    }
+    printf("  good: pose within %.0f%% of the distance and %.0f deg of yaw, bad: pose reported but not good,\n"
+           "  none: no pose, pos err and yaw err: mean of the good poses, hyps: homographies scored per frame\n",
+           100.0 * GOOD_POSITION, GOOD_YAW);
+    return failed ? 1 : 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-v] [-s seed]\n", progname);
+    printf("  -v  Print every frame with a bad pose\n");
+    printf("  -s  Seed for the synthetic views (default: 1)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "vs:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = true;
+                break;
+
+            case 's':
+                seed_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    failures += test_scenes();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,526 @@
+/**
+ * @file main.cpp
+ * @brief Tests processLineRef() (device/libpixy_m0/inc/rls_ref.h), the C model of the M0's
+ *        processLine(), against the Qvals the assembly queues for lines made to hit its
+ *        corners: the threshold, runs at both ends of the line, a run still going at the
+ *        end and lines with more runs than MAX_NEW_QVALS_PER_LINE.  Then random lines
+ *        against runs found another way, and the same for hysteresis, the runs over a low
+ *        threshold keepBrightRuns() keeps, and the runs' intensities, the brightest pixel
+ *        and pixel sum runIntensity() queues after each.  scripts/check_rls_cycles.py
+ *        checks the assembly's timing.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "rls_ref.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#define THRESHOLD       170     // RLS_PIXEL_THRESHOLD
+#define LOW             120
+#define DARK            30
+#define GLOW            150     // over LOW, not over THRESHOLD
+#define BRIGHT          240
+#define RANDOM_LINES    200000
+
+typedef std::vector<Qval> Qvals;
+
+struct Case
+{
+    const char *name;
+    uint8_t line[RLS_LINE_WIDTH];
+    uint32_t threshold;
+    uint32_t low;
+    Qvals expected;
+};
+
+static uint32_t random_ = 1;
+static bool verbose_ = false;
+
+static uint32_t rnd(uint32_t range)
+{
+    random_ = random_ * 1103515245 + 12345;
+    return (random_ >> 8) % range;
+}
+
+static int check(bool ok, const char *what)
+{
+    printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+static void print(const char *what, const Qval *qvals, uint32_t n)
+{
+    uint32_t i;
+
+    printf("    %s:", what);
+    for (i = 0; i < n; i++)
+        printf(" %u-%u", qvals[i].m_col_start, qvals[i].m_col_end);
+    printf("\n");
+}
+
+static bool same(const Qval *qvals, uint32_t n, const Qvals &expected)
+{
+    uint32_t i;
+
+    if (n != expected.size())
+        return false;
+    for (i = 0; i < n; i++)
+    {
+        if (qvals[i].m_col_start != expected[i].m_col_start || qvals[i].m_col_end != expected[i].m_col_end)
+            return false;
+    }
+    return true;
+}
+
+// a dark line, bright from start to end (not inclusive)
+static void dark(Case *c, const char *name)
+{
+    c->name = name;
+    memset(c->line, DARK, sizeof(c->line));
+    c->threshold = THRESHOLD;
+    c->low = 0;
+    c->expected.clear();
+}
+
+// with hysteresis, glow from start to end that isn't a run
+static void glow(Case *c, uint32_t start, uint32_t end)
+{
+    memset(c->line + start, GLOW, end - start);
+    c->low = LOW;
+}
+
+static void bright(Case *c, uint32_t start, uint32_t end)
+{
+    memset(c->line + start, BRIGHT, end - start);
+    c->expected.push_back(Qval(start, end));
+}
+
+// single pixel runs every step columns from 0, as many as fit before limit
+static void dots(Case *c, uint32_t step, uint32_t limit)
+{
+    uint32_t col;
+
+    for (col = 0; col < limit; col += step)
+        bright(c, col, col + 1);
+}
+
+// What processLine() queues, worked out from the assembly by hand.
+static std::vector<Case> cases()
+{
+    std::vector<Case> cases;
+    Case c;
+
+    dark(&c, "a dark line has no runs");
+    cases.push_back(c);
+
+    dark(&c, "a bright line is one run, ended at the end of the line");
+    bright(&c, 0, RLS_LINE_WIDTH);
+    cases.push_back(c);
+
+    dark(&c, "a run at the first pixel");
+    bright(&c, 0, 1);
+    cases.push_back(c);
+
+    dark(&c, "a run at the last pixel");
+    bright(&c, RLS_LINE_WIDTH - 1, RLS_LINE_WIDTH);
+    cases.push_back(c);
+
+    dark(&c, "runs one dark pixel apart are two");
+    bright(&c, 10, 20);
+    bright(&c, 21, 30);
+    cases.push_back(c);
+
+    dark(&c, "a pixel at the threshold is dark, one over it bright (BGT)");
+    memset(c.line + 40, THRESHOLD, 10);
+    bright(&c, 50, 60);
+    memset(c.line + 50, THRESHOLD + 1, 10);
+    cases.push_back(c);
+
+    dark(&c, "with the threshold at 255 nothing is bright");
+    memset(c.line, 255, sizeof(c.line));
+    c.threshold = 255;
+    cases.push_back(c);
+
+    dark(&c, "with the threshold at 0 anything but 0 is bright");
+    memset(c.line, 0, sizeof(c.line));
+    c.threshold = 0;
+    bright(&c, 100, 101);
+    c.line[100] = 1;
+    cases.push_back(c);
+
+    dark(&c, "every third pixel, the most runs a line has room for");
+    dots(&c, 3, RLS_LINE_WIDTH);
+    cases.push_back(c);
+
+    // 108 stored, the q memory is full at the 108th's end and the line ends there
+    dark(&c, "every other pixel, the first MAX_NEW_QVALS_PER_LINE runs");
+    dots(&c, 2, RLS_LINE_WIDTH);
+    c.expected.resize(RLS_MAX_LINE_QVALS);
+    cases.push_back(c);
+
+    dark(&c, "the last run fits if it is ended at the end of the line");
+    dots(&c, 2, 2 * (RLS_MAX_LINE_QVALS - 1));
+    bright(&c, 300, RLS_LINE_WIDTH);
+    cases.push_back(c);
+
+    dark(&c, "a run going at the end of a full line is dropped");
+    dots(&c, 2, 2 * RLS_MAX_LINE_QVALS);
+    memset(c.line + 300, BRIGHT, RLS_LINE_WIDTH - 300);
+    cases.push_back(c);
+
+    dark(&c, "a run ended by the last pixel fills the line");
+    dots(&c, 2, 2 * (RLS_MAX_LINE_QVALS - 1));
+    bright(&c, 300, RLS_LINE_WIDTH - 1);
+    cases.push_back(c);
+
+    return cases;
+}
+
+// What rlsLineRef() gives with hysteresis, runs over LOW with a pixel over THRESHOLD.
+static std::vector<Case> hysteresisCases()
+{
+    std::vector<Case> cases;
+    Case c;
+
+    dark(&c, "glow without a bright pixel is dropped");
+    glow(&c, 10, 50);
+    cases.push_back(c);
+
+    dark(&c, "a bright pixel keeps the glow around it");
+    glow(&c, 10, 50);
+    bright(&c, 30, 31);
+    c.expected[0] = Qval(10, 50);
+    cases.push_back(c);
+
+    dark(&c, "bright cores joined by glow are one run");
+    glow(&c, 100, 140);
+    bright(&c, 100, 105);
+    bright(&c, 130, 135);
+    c.expected.clear();
+    c.expected.push_back(Qval(100, 140));
+    cases.push_back(c);
+
+    dark(&c, "glow between runs and at the ends of the line is dropped");
+    glow(&c, 0, 20);
+    glow(&c, 300, RLS_LINE_WIDTH);
+    bright(&c, 150, 160);
+    glow(&c, 200, 210);
+    cases.push_back(c);
+
+    dark(&c, "a pixel at the low threshold ends the run");
+    glow(&c, 60, 80);
+    c.line[70] = LOW;
+    bright(&c, 75, 76);
+    c.expected[0] = Qval(71, 80);
+    cases.push_back(c);
+
+    dark(&c, "a low threshold of 0 is none, glow is dark");
+    glow(&c, 10, 50);
+    bright(&c, 30, 31);
+    c.low = 0;
+    cases.push_back(c);
+
+    dark(&c, "a low threshold at the threshold is none");
+    glow(&c, 10, 50);
+    bright(&c, 30, 31);
+    c.low = THRESHOLD;
+    cases.push_back(c);
+
+    // the runs kept are of the first MAX_NEW_QVALS_PER_LINE at the low threshold
+    dark(&c, "a line full of glow keeps the bright runs among the first");
+    for (uint32_t col = 0; col < RLS_LINE_WIDTH; col += 2)
+        glow(&c, col, col + 1);
+    bright(&c, 100, 101);
+    bright(&c, 250, 251);
+    c.expected.pop_back();
+    cases.push_back(c);
+
+    return cases;
+}
+
+static int test_cases(const char *what, const std::vector<Case> &all)
+{
+    Qval qvals[RLS_MAX_LINE_QVALS];
+    uint32_t i, n;
+    int failures = 0;
+
+    printf("%s\n", what);
+    for (i = 0; i < all.size(); i++)
+    {
+        n = rlsLineRef(all[i].line, all[i].threshold, all[i].low, 0, qvals);
+        if (!same(qvals, n, all[i].expected) && verbose_)
+        {
+            print("got", qvals, n);
+            print("expected", all[i].expected.data(), all[i].expected.size());
+        }
+        failures += check(same(qvals, n, all[i].expected), all[i].name);
+    }
+    return failures;
+}
+
+// all the runs of the line, then as many as the assembly has room for
+static uint32_t runs(const uint8_t *line, uint32_t threshold, Qval *qvals)
+{
+    uint32_t start, end, n = 0;
+
+    for (start = 0; start < RLS_LINE_WIDTH; start = end)
+    {
+        if (line[start] <= threshold)
+        {
+            end = start + 1;
+            continue;
+        }
+        for (end = start; end < RLS_LINE_WIDTH && line[end] > threshold; end++);
+        if (n < RLS_MAX_LINE_QVALS)
+            qvals[n++] = Qval(start, end);
+    }
+    return n;
+}
+
+// Random lines of stretches of random length, bright or dark at random, or every other
+// one bright so there are lines with more runs than room.  The model must not write past
+// the room for a line's runs.
+static int test_random()
+{
+    uint8_t line[RLS_LINE_WIDTH];
+    Qval qvals[RLS_MAX_LINE_QVALS + 1], expected[RLS_MAX_LINE_QVALS];
+    uint32_t i, col, len, maxLen, threshold, n, m, bad = 0, full = 0;
+    bool alternate, lit = false;
+
+    printf("random lines\n");
+    for (i = 0; i < RANDOM_LINES; i++)
+    {
+        threshold = rnd(256);
+        alternate = i % 4 == 0;
+        maxLen = 1 + rnd(alternate ? 3 : 40);
+        for (col = 0; col < RLS_LINE_WIDTH; col += len)
+        {
+            len = 1 + rnd(maxLen);
+            if (col + len > RLS_LINE_WIDTH)
+                len = RLS_LINE_WIDTH - col;
+            lit = alternate ? !lit : rnd(2);
+            memset(line + col, lit && threshold < 255 ? threshold + 1 + rnd(255 - threshold) : rnd(threshold + 1), len);
+        }
+        qvals[RLS_MAX_LINE_QVALS].m_col_start = qvals[RLS_MAX_LINE_QVALS].m_col_end = 0xeeee;
+        n = processLineRef(line, threshold, qvals);
+        m = runs(line, threshold, expected);
+        if (n != m || memcmp(qvals, expected, n * sizeof(Qval)) != 0 || qvals[RLS_MAX_LINE_QVALS].m_col_start != 0xeeee)
+        {
+            if (verbose_ && bad < 3)
+            {
+                print("got", qvals, n);
+                print("expected", expected, m);
+            }
+            bad++;
+        }
+        if (n == RLS_MAX_LINE_QVALS)
+            full++;
+    }
+    if (verbose_)
+        printf("    %u lines, %u of them full\n", RANDOM_LINES, full);
+    return check(bad == 0, "the runs, the first MAX_NEW_QVALS_PER_LINE of them") + check(full > 0, "full lines among them");
+}
+
+// Random lines of dark, glow and bright stretches, the runs over the low threshold with a
+// pixel over the threshold.
+static int test_random_hysteresis()
+{
+    uint8_t line[RLS_LINE_WIDTH];
+    Qval qvals[RLS_MAX_LINE_QVALS + 1], expected[RLS_MAX_LINE_QVALS];
+    uint32_t i, col, len, maxLen, threshold, low, n, m, j, k, bad = 0, dropped = 0;
+    uint8_t peak;
+
+    printf("random lines, hysteresis\n");
+    for (i = 0; i < RANDOM_LINES; i++)
+    {
+        threshold = 2 + rnd(253);
+        low = 1 + rnd(threshold - 1);
+        maxLen = 1 + rnd(i % 4 == 0 ? 3 : 40);
+        for (col = 0; col < RLS_LINE_WIDTH; col += len)
+        {
+            len = 1 + rnd(maxLen);
+            if (col + len > RLS_LINE_WIDTH)
+                len = RLS_LINE_WIDTH - col;
+            switch (rnd(3))
+            {
+                case 0:
+                    memset(line + col, rnd(low + 1), len);
+                    break;
+
+                case 1:
+                    memset(line + col, low + 1 + rnd(threshold - low), len);
+                    break;
+
+                default:
+                    for (j = 0; j < len; j++)
+                        line[col + j] = low + 1 + rnd(255 - low);
+                    break;
+            }
+        }
+        qvals[RLS_MAX_LINE_QVALS].m_col_start = qvals[RLS_MAX_LINE_QVALS].m_col_end = 0xeeee;
+        n = rlsLineRef(line, threshold, low, 0, qvals);
+        m = runs(line, low, expected);
+        for (j = k = 0; j < m; j++)
+        {
+            for (col = expected[j].m_col_start, peak = 0; col < expected[j].m_col_end; col++)
+                peak = std::max(peak, line[col]);
+            if (peak > threshold)
+                expected[k++] = expected[j];
+        }
+        dropped += m - k;
+        if (n != k || memcmp(qvals, expected, n * sizeof(Qval)) != 0 || qvals[RLS_MAX_LINE_QVALS].m_col_start != 0xeeee)
+        {
+            if (verbose_ && bad < 3)
+            {
+                print("got", qvals, n);
+                print("expected", expected, k);
+            }
+            bad++;
+        }
+    }
+    if (verbose_)
+        printf("    %u lines, %u runs dropped\n", RANDOM_LINES, dropped);
+    return check(bad == 0, "the runs over the low threshold with a bright pixel") + check(dropped > 0, "runs dropped among them");
+}
+
+// The intensity Qval holds any peak and the sum of a whole line at full scale, below the
+// markers.
+static int test_intensity_qval()
+{
+    static const uint32_t sums[] = {0, 1, 0xffff, 0x10000, 0x1abcd, RLS_LINE_WIDTH * 255};
+    uint32_t peak, i, bad = 0, marker = 0;
+    Qval q;
+
+    printf("intensity Qvals\n");
+    for (peak = 0; peak < 256; peak++)
+    {
+        for (i = 0; i < sizeof(sums) / sizeof(sums[0]); i++)
+        {
+            q.m_col_start = QVAL_INTENSITY_START(peak, sums[i]);
+            q.m_col_end = QVAL_INTENSITY_END(sums[i]);
+            if (QVAL_INTENSITY_PEAK(q) != peak || QVAL_INTENSITY_SUM(q) != sums[i])
+                bad++;
+            if ((q.m_col_start & QVAL_VAL_MASK) >= QVAL_LINE_BEGIN || (q.m_col_start & QVAL_WRITE_FRAME_BIT))
+                marker++;
+        }
+    }
+    return check(bad == 0, "peak and sum come back, up to a line at 255") + check(marker == 0, "never a marker");
+}
+
+// Random lines as for hysteresis, with and without a low threshold, the runs each followed
+// by its intensity.  The runs are those without intensity, the intensities the brightest
+// pixel and sum of each, and the M0's way, hysteresis by the brightest pixel of the runs
+// at the low threshold, gives the same.
+static int test_random_intensity()
+{
+    uint8_t line[RLS_LINE_WIDTH];
+    Qval qvals[RLS_MAX_LINE_QVALS_INTENSITY + 1], runs[RLS_MAX_LINE_QVALS], m0[RLS_MAX_LINE_QVALS_INTENSITY];
+    uint32_t i, col, len, maxLen, threshold, low, n, m, j, k, sum, badRuns = 0, badIntensity = 0, badM0 = 0, saturated = 0;
+    uint8_t peak;
+    Qval intensity;
+
+    printf("random lines, intensity\n");
+    for (i = 0; i < RANDOM_LINES; i++)
+    {
+        threshold = 2 + rnd(253);
+        low = i % 2 ? 1 + rnd(threshold - 1) : 0;
+        maxLen = 1 + rnd(i % 4 == 0 ? 3 : 40);
+        for (col = 0; col < RLS_LINE_WIDTH; col += len)
+        {
+            len = 1 + rnd(maxLen);
+            if (col + len > RLS_LINE_WIDTH)
+                len = RLS_LINE_WIDTH - col;
+            for (j = 0; j < len; j++)
+                line[col + j] = rnd(3) ? rnd(256) : 255;
+        }
+        qvals[RLS_MAX_LINE_QVALS_INTENSITY].m_col_start = qvals[RLS_MAX_LINE_QVALS_INTENSITY].m_col_end = 0xeeee;
+        n = rlsLineRef(line, threshold, low, 1, qvals);
+        m = rlsLineRef(line, threshold, low, 0, runs);
+        if (n != 2 * m || qvals[RLS_MAX_LINE_QVALS_INTENSITY].m_col_start != 0xeeee)
+        {
+            badRuns++;
+            continue;
+        }
+        for (j = 0; j < m; j++)
+        {
+            if (memcmp(qvals + 2 * j, runs + j, sizeof(Qval)) != 0)
+                badRuns++;
+            for (col = runs[j].m_col_start, peak = 0, sum = 0; col < runs[j].m_col_end; col++)
+            {
+                peak = std::max(peak, line[col]);
+                sum += line[col];
+            }
+            if (QVAL_INTENSITY_PEAK(qvals[2 * j + 1]) != peak || QVAL_INTENSITY_SUM(qvals[2 * j + 1]) != sum)
+                badIntensity++;
+            if (peak == 255)
+                saturated++;
+        }
+
+        // getRLSFrame() with the run intensity on
+        m = low ? processLineRef(line, low, runs) : processLineRef(line, threshold, runs);
+        for (j = k = 0; j < m; j++)
+        {
+            runIntensity(line, runs + j, &intensity);
+            if (low && QVAL_INTENSITY_PEAK(intensity) <= threshold)
+                continue;
+            m0[k++] = runs[j];
+            m0[k++] = intensity;
+        }
+        if (n != k || memcmp(qvals, m0, n * sizeof(Qval)) != 0)
+        {
+            if (verbose_ && badM0 < 3)
+            {
+                print("got", qvals, n);
+                print("M0", m0, k);
+            }
+            badM0++;
+        }
+    }
+    if (verbose_)
+        printf("    %u lines, %u saturated runs\n", RANDOM_LINES, saturated);
+    return check(badRuns == 0, "the runs are those without intensity") +
+        check(badIntensity == 0, "each followed by its brightest pixel and sum") +
+        check(badM0 == 0, "the same as the M0, hysteresis by the brightest pixel") + check(saturated > 0, "saturated runs among them");
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-v]\n", progname);
+    printf("  -v  Print the Qvals of lines that came out wrong\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "vh")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = true;
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    failures += test_cases("lines", cases());
+    failures += test_random();
+    failures += test_cases("hysteresis", hysteresisCases());
+    failures += test_random_hysteresis();
+    failures += test_intensity_qval();
+    failures += test_random_intensity();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
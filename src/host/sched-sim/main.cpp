@@ -0,0 +1,665 @@
+/**
+ * @file main.cpp
+ * @brief Simulates the blob program's main loop on the camera, the M0 queueing run lengths
+ *        as it reads out each line and the M4 taking them off, in virtual time: with the
+ *        scheduler (common/inc/scheduler.h) and its tasks as in progblobs.cpp, sleeping until
+ *        the M0's doorbell when idle, the same spinning instead, and the loop the scheduler
+ *        replaced.  Task durations are built-in estimates or recorded ones (-f).  Reports
+ *        frames the M0 dropped because the queue was full, SD card logs written and
+ *        missed, how long a finished frame waited, tasks that ran late and the share of
+ *        each frame asleep.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "scheduler.h"
+
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAMES              500
+#define FRAME_US            20000   // RLS_CAMERA_FPS
+#define LINES               200     // CAM_RES2_HEIGHT
+#define LINE_US             35      // BLOBS_LINE_US
+#define QUEUE_SIZE          3838    // QQ_MEM_SIZE
+#define MAX_LINE_QVALS      108     // MAX_NEW_QVALS_PER_LINE in rls_m0.c
+#define LOG_DIVIDER         5       // RLS_CAMERA_FPS / RLS_LOG_FPS
+#define SD_FRAME_BLOCKS     126     // BLOCKS_PER_FRAME in sdmmc.cpp
+#define PARAMS_EVERY        50      // frames between parameter changes from PixyMon
+#define IDLE_US             2       // one dispatch that found nothing to run
+#define DOORBELL_LINES      8       // DOORBELL_LINES in rls_m0.c
+#define TICK_US             1000    // other interrupts wake the M4 at least this often, USB SOF
+#define WAKE_US             2       // from WFE to running
+#define WAKE_LATENCY        20      // us, sleeping may add this to a frame's mean wait
+#define MAX_WAKE_LATENCY    (DOORBELL_LINES * LINE_US)  // and this to the longest, one doorbell
+#define MAX_SAMPLES         64
+
+// costs as in progblobs.cpp
+#define SEND_COST           300
+#define SD_SLICE_US         400
+#define SD_BLOCK_US         170
+#define SD_MAX_BLOCKS       16
+#define PARAMS_COST         150
+#define USB_COST            200
+#define SERIAL_COST         200
+
+// Durations in us, a task's run takes the next one in turn.  The defaults are estimates,
+// replace them with sched_stats from the camera (-f).
+typedef struct
+{
+    const char *name;
+    double us[MAX_SAMPLES];
+    uint8_t count;
+    uint8_t next;
+} Durations;
+
+enum
+{
+    D_QVAL,             // blobify() per run length
+    D_FRAME_END,        // blobify() at the end of a frame: blobs, tracks and pose
+    D_M0_PARAMS,        // exec_setRLSParamsM0()
+    D_SEND,
+    D_SD_SLICE,         // per SD write, on top of the blocks
+    D_SD_BLOCK,
+    D_PARAMS,
+    D_USB,
+    D_SERIAL,
+    D_PERIODIC,         // periodic() in exec's loop, between frames
+    D_COUNT
+};
+
+static Durations durations_[D_COUNT] =
+{
+    { "qval", { 0.25 }, 1, 0 },
+    { "frame_end", { 900, 1500, 1200 }, 3, 0 },
+    { "m0_params", { 80 }, 1, 0 },
+    { "send", { 150, 280, 300, 220 }, 4, 0 },
+    { "sd_slice", { 250, 400, 320 }, 3, 0 },
+    { "sd_block", { 150, 170, 180, 170 }, 4, 0 },
+    { "params", { 60, 150 }, 2, 0 },
+    { "usb", { 10, 10, 40, 200 }, 4, 0 },
+    { "serial", { 15, 30, 15, 200 }, 4, 0 },
+    { "periodic", { 50, 400, 50, 50 }, 4, 0 },
+};
+
+typedef struct
+{
+    const char *name;
+    bool logging;
+    uint32_t (*runs)(uint32_t frame, uint32_t line);    // run lengths the M0 finds in a line
+} Scene;
+
+typedef struct
+{
+    uint32_t frames;        // the M0 started
+    uint32_t lost;          // the M0 dropped, the queue was full
+    uint32_t logs;          // started
+    uint32_t written;
+    uint32_t missed;        // frames to log the M0 had no slot for, the last log still had it
+    double maxLatency;      // us from the M0 ending a frame to blobify() being done with it
+    double meanLatency;
+    uint32_t late;
+    uint32_t deferred;
+    double idle;            // mean of the frames' shares asleep
+    double minIdle;
+} Result;
+
+enum
+{
+    Q_RUN,
+    Q_END,
+    Q_END_WRITE,
+    Q_ERROR
+};
+
+static bool verbose_ = false;
+static uint32_t seed_ = 1;
+
+static double time_;                // us
+static std::deque<uint8_t> queue_;
+static std::deque<double> ends_;    // when the M0 queued each frame end still in the queue
+static uint32_t m0Frame_, m0Line_;
+static bool m0Write_;
+static bool bell_;                  // the M0 rang since the M4 went to sleep
+static Result result_;
+static const Scene *scene_;
+static double latencySum_;
+static uint32_t latencies_;
+
+// the blob program's state
+static bool frameDone_, sendPending_, logging_, paramsDirty_, paramsM0Pending_, usbDue_, serialDue_;
+static Scheduler *sched_;
+static uint32_t logLeft_;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+static double duration(uint8_t d)
+{
+    Durations *dur = durations_ + d;
+    double us = dur->us[dur->next++];
+
+    if (dur->next >= dur->count)
+        dur->next = 0;
+    return us;
+}
+
+// a few beacons
+static uint32_t sparse(uint32_t frame, uint32_t line)
+{
+    return (line % 40) < 6 ? 1 + (line % 3 == 0) : 0;
+}
+
+// sunlit ground, up to 40 runs on every line, more in a frame than the queue holds
+static uint32_t busy(uint32_t frame, uint32_t line)
+{
+    return rnd(41);
+}
+
+// glare across a band of lines now and then, as many runs as the M0 can queue
+static uint32_t burst(uint32_t frame, uint32_t line)
+{
+    if (frame % 3 == 1 && line >= 60 && line < 140)
+        return MAX_LINE_QVALS - 1;
+    return rnd(4);
+}
+
+static const Scene scenes_[] =
+{
+    { "sparse", false, sparse },
+    { "sparse, logging", true, sparse },
+    { "busy", false, busy },
+    { "busy, logging", true, busy },
+    { "burst", false, burst },
+    { "burst, logging", true, burst },
+};
+
+// The M0 catches up with time_: each line queues a line marker and its runs if at least
+// MAX_LINE_QVALS are free, otherwise an error and it waits for the next frame.
+static void advance()
+{
+    uint32_t i, runs;
+    double lineTime;
+
+    while (true)
+    {
+        lineTime = (double)m0Frame_ * FRAME_US + m0Line_ * LINE_US;
+        if (lineTime > time_ || m0Frame_ >= FRAMES)
+            return;
+        if (m0Line_ == 0)
+        {
+            result_.frames++;
+            // the frame buffer has one slot (framebuf.h), which a log being written keeps
+            m0Write_ = m0Frame_ % LOG_DIVIDER == 0;
+            if (m0Write_ && logging_)
+            {
+                m0Write_ = false;
+                result_.missed++;
+            }
+        }
+        if (m0Line_ == LINES)
+        {
+            queue_.push_back(m0Write_ ? Q_END_WRITE : Q_END);
+            ends_.push_back(lineTime);
+            bell_ = true;
+            m0Frame_++;
+            m0Line_ = 0;
+            continue;
+        }
+        if (QUEUE_SIZE - queue_.size() < MAX_LINE_QVALS)
+        {
+            queue_.push_back(Q_ERROR);
+            ends_.push_back(lineTime);
+            bell_ = true;
+            result_.lost++;
+            m0Frame_++;
+            m0Line_ = 0;
+            continue;
+        }
+        runs = (*scene_->runs)(m0Frame_, m0Line_);
+        if (runs > MAX_LINE_QVALS - 1)
+            runs = MAX_LINE_QVALS - 1;
+        for (i = 0; i < runs + 1; i++)
+            queue_.push_back(Q_RUN);
+        if (m0Line_ % DOORBELL_LINES == DOORBELL_LINES - 1)
+            bell_ = true;
+        m0Line_++;
+    }
+}
+
+static void spend(double us)
+{
+    time_ += us;
+    advance();
+}
+
+static uint32_t now()
+{
+    return (uint32_t)time_;
+}
+
+static uint32_t slack()
+{
+    advance();
+    return Scheduler::queueSlack(QUEUE_SIZE - queue_.size(), MAX_LINE_QVALS + 1, MAX_LINE_QVALS, LINE_US);
+}
+
+static void startLog()
+{
+    logging_ = true;
+    logLeft_ = SD_FRAME_BLOCKS;
+    result_.logs++;
+}
+
+static void endLog()
+{
+    logging_ = false;
+    result_.written++;
+}
+
+// blobify(): takes what is queued, returns 1 until the end of a frame, then 0 or -1
+static int blobify()
+{
+    uint8_t q;
+    double latency;
+
+    while (true)
+    {
+        advance();
+        if (queue_.empty())
+            return 1;
+        q = queue_.front();
+        queue_.pop_front();
+        spend(duration(D_QVAL));
+        if (q == Q_RUN)
+            continue;
+        if (q != Q_ERROR)
+            spend(duration(D_FRAME_END));
+        latency = time_ - ends_.front();
+        ends_.pop_front();
+        latencySum_ += latency;
+        latencies_++;
+        if (latency > result_.maxLatency)
+            result_.maxLatency = latency;
+        if (q == Q_ERROR)
+            return -1;
+        if (q == Q_END_WRITE && scene_->logging)
+            startLog();
+        return 0;
+    }
+}
+
+// the tasks in progblobs.cpp
+
+static bool frameReady()
+{
+    advance();
+    return !queue_.empty();
+}
+
+static int32_t consumeFrame(uint32_t budget)
+{
+    int res;
+
+    if ((res = blobify()) == 1)
+        return 0;
+    frameDone_ = true;
+    serialDue_ = true;
+    sched_->endFrame();
+    if (paramsM0Pending_)
+    {
+        spend(duration(D_M0_PARAMS));
+        paramsM0Pending_ = false;
+    }
+    if (res < 0)
+        return -1;
+    sendPending_ = true;
+    if (m0Frame_ % PARAMS_EVERY == 0)
+        paramsDirty_ = true;
+    return 0;
+}
+
+static bool sendReady()
+{
+    return sendPending_;
+}
+
+static int32_t send(uint32_t budget)
+{
+    sendPending_ = false;
+    spend(duration(D_SEND));
+    return 0;
+}
+
+static bool logReady()
+{
+    return logging_;
+}
+
+static int32_t writeLog(uint32_t budget)
+{
+    uint32_t blocks = budget > SD_SLICE_US ? (budget - SD_SLICE_US) / SD_BLOCK_US : 0, i;
+
+    if (blocks < 1)
+        blocks = 1;
+    else if (blocks > SD_MAX_BLOCKS)
+        blocks = SD_MAX_BLOCKS;
+    if (blocks > logLeft_)
+        blocks = logLeft_;
+    spend(duration(D_SD_SLICE));
+    for (i = 0; i < blocks; i++)
+        spend(duration(D_SD_BLOCK));
+    logLeft_ -= blocks;
+    if (logLeft_ == 0)
+        endLog();
+    return 0;
+}
+
+static bool paramsReady()
+{
+    return paramsDirty_;
+}
+
+static int32_t updateParams(uint32_t budget)
+{
+    paramsDirty_ = false;
+    spend(duration(D_PARAMS));
+    paramsM0Pending_ = true;
+    return 0;
+}
+
+static bool usbReady()
+{
+    return usbDue_;
+}
+
+static int32_t serviceUsb(uint32_t budget)
+{
+    usbDue_ = false;
+    spend(duration(D_USB));
+    return 0;
+}
+
+static bool serialReady()
+{
+    return serialDue_;
+}
+
+static int32_t serviceSerial(uint32_t budget)
+{
+    serialDue_ = false;
+    usbDue_ = true;
+    spend(duration(D_SERIAL));
+    return 0;
+}
+
+static void reset(const Scene *scene)
+{
+    uint8_t i;
+
+    scene_ = scene;
+    time_ = 0;
+    queue_.clear();
+    ends_.clear();
+    m0Frame_ = m0Line_ = 0;
+    memset(&result_, 0, sizeof(result_));
+    latencySum_ = 0;
+    latencies_ = 0;
+    frameDone_ = sendPending_ = logging_ = paramsDirty_ = paramsM0Pending_ = usbDue_ = serialDue_ = false;
+    bell_ = false;
+    seed_ = 1;
+    for (i = 0; i < D_COUNT; i++)
+        durations_[i].next = 0;
+}
+
+static void finish()
+{
+    // a log still being written when the M0 stopped isn't counted either way
+    if (logging_)
+        result_.logs--;
+    result_.meanLatency = latencies_ ? latencySum_ / latencies_ : 0;
+}
+
+static void spin()
+{
+    spend(IDLE_US);
+    serialDue_ = true;
+}
+
+// exec_waitM0(): until the M0 rings or another interrupt comes in
+static void waitM0()
+{
+    double tick = ((uint32_t)(time_ / TICK_US) + 1) * TICK_US, line;
+
+    bell_ = false;
+    while (!bell_ && time_ < tick)
+    {
+        line = (double)m0Frame_ * FRAME_US + m0Line_ * LINE_US;
+        time_ = m0Frame_ < FRAMES && line < tick ? line : tick;
+        advance();
+    }
+    spend(WAKE_US);
+    serialDue_ = true;
+}
+
+static void runScheduler(const Scene *scene, bool sleeping)
+{
+    Scheduler sched(now, slack);
+    const SchedStats *stats;
+    const SchedIdleStats *idle = sched.idleStats();
+    uint8_t i;
+
+    reset(scene);
+    sched_ = &sched;
+    sched.setIdle(sleeping ? waitM0 : spin);
+    sched.setFrameTask("frame", consumeFrame, frameReady);
+    sched.addTask("send", send, sendReady, SEND_COST);
+    sched.addTask("log", writeLog, logReady, SD_SLICE_US + SD_BLOCK_US);
+    sched.addTask("params", updateParams, paramsReady, PARAMS_COST);
+    sched.addTask("usb", serviceUsb, usbReady, USB_COST);
+    sched.addTask("serial", serviceSerial, serialReady, SERIAL_COST);
+
+    while (m0Frame_ < FRAMES || !queue_.empty())
+    {
+        // blobsLoop()
+        frameDone_ = false;
+        while (!frameDone_ && (m0Frame_ < FRAMES || !queue_.empty()))
+        {
+            if (!sched.dispatch())
+                spend(IDLE_US);
+        }
+        spend(duration(D_PERIODIC));
+    }
+    finish();
+
+    for (i = 1; i < sched.tasks(); i++)
+    {
+        stats = sched.stats(i);
+        result_.late += stats->late;
+        result_.deferred += stats->deferred;
+    }
+    result_.idle = idle->frames ? idle->sumIdle / 10.0 / idle->frames : 0;
+    result_.minIdle = idle->minIdle / 10.0;
+    if (verbose_)
+    {
+        for (i = 0; i < sched.tasks(); i++)
+        {
+            stats = sched.stats(i);
+            printf("    %-8s runs %7u deferred %7u late %3u errors %3u max %6u us mean %6.1f us\n",
+                   stats->name, stats->runs, stats->deferred, stats->late, stats->errors, stats->maxUs,
+                   stats->runs ? (double)stats->totalUs / stats->runs : 0.0);
+        }
+        printf("    idle     sleeps %5u max %6u us, of each frame %.1f%% least %.1f%% last %.1f%%\n", idle->sleeps,
+               idle->maxUs, result_.idle, result_.minIdle, idle->lastIdle / 10.0);
+    }
+}
+
+// The loop before the scheduler: blobify() waits for the whole frame, servicing USB when
+// the queue is empty, then the blobs go out, the frame is written to the SD card in one
+// go, and serial input is serviced until the M0 queues the next run length.
+static void runInline(const Scene *scene)
+{
+    int res;
+    uint32_t i;
+
+    reset(scene);
+    while (m0Frame_ < FRAMES || !queue_.empty())
+    {
+        while ((res = blobify()) == 1 && (m0Frame_ < FRAMES || !queue_.empty()))
+            spend(duration(D_USB));
+        if (res == 0)
+        {
+            spend(duration(D_SEND));
+            if (logging_)
+            {
+                spend(duration(D_SD_SLICE));
+                for (i = 0; i < SD_FRAME_BLOCKS; i++)
+                    spend(duration(D_SD_BLOCK));
+                endLog();
+            }
+            spend(duration(D_SERIAL));
+            while (!frameReady() && m0Frame_ < FRAMES)
+                spend(duration(D_SERIAL));
+        }
+        spend(duration(D_PERIODIC));
+    }
+    finish();
+}
+
+static void print(const char *scene, const char *loop, const Result *result, bool bad)
+{
+    printf("%-16s %-9s %4u %5u %5u %6u %7u %9.0f %8.0f %4u %8u %5.1f %5.1f%s\n", scene, loop, result->frames,
+           result->lost, result->logs, result->written, result->missed, result->maxLatency, result->meanLatency,
+           result->late, result->deferred, result->idle, result->minIdle, bad ? "  FAILED" : "");
+}
+
+static int simulate()
+{
+    uint8_t i;
+    int failed = 0;
+    double spinWait, spinMax;
+    bool bad;
+
+    printf("%-16s %-9s %4s %5s %5s %6s %7s %9s %8s %4s %8s %5s %5s\n", "scene", "loop", "frames", "lost", "logs",
+           "written", "missed", "max wait", "mean", "late", "deferred", "idle%", "least");
+    for (i = 0; i < sizeof(scenes_) / sizeof(scenes_[0]); i++)
+    {
+        runInline(scenes_ + i);
+        print(scenes_[i].name, "inline", &result_, false);
+
+        runScheduler(scenes_ + i, false);
+        // the scheduler never lets background work cost a frame or a log
+        bad = result_.lost || result_.missed || result_.written != result_.logs || result_.late;
+        print(scenes_[i].name, "spinning", &result_, bad);
+        failed += bad;
+        spinWait = result_.meanLatency;
+        spinMax = result_.maxLatency;
+
+        // and sleeping doesn't make a frame wait longer
+        runScheduler(scenes_ + i, true);
+        bad = result_.lost || result_.missed || result_.written != result_.logs || result_.late ||
+            result_.meanLatency > spinWait + WAKE_LATENCY || result_.maxLatency > spinMax + MAX_WAKE_LATENCY;
+        print(scenes_[i].name, "sleeping", &result_, bad);
+        failed += bad;
+    }
+    return failed;
+}
+
+// one task's recorded durations per line: its name, then us
+static int load(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    char line[1024], *tok, *end;
+    Durations *dur;
+    uint8_t i;
+
+    if (file == NULL)
+    {
+        printf("can't open %s\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file))
+    {
+        if ((tok = strtok(line, " \t\r\n")) == NULL || tok[0] == '#')
+            continue;
+        for (i = 0, dur = NULL; i < D_COUNT; i++)
+        {
+            if (strcmp(tok, durations_[i].name) == 0)
+                dur = durations_ + i;
+        }
+        if (dur == NULL)
+        {
+            printf("%s: no task %s\n", filename, tok);
+            fclose(file);
+            return -1;
+        }
+        for (dur->count = 0; (tok = strtok(NULL, " \t\r\n")) && dur->count < MAX_SAMPLES; )
+        {
+            dur->us[dur->count] = strtod(tok, &end);
+            if (*end || dur->us[dur->count] < 0)
+            {
+                printf("%s: bad duration %s\n", filename, tok);
+                fclose(file);
+                return -1;
+            }
+            dur->count++;
+        }
+        if (dur->count == 0)
+        {
+            printf("%s: no durations for %s\n", filename, dur->name);
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static void help(const char *progname)
+{
+    uint8_t i;
+
+    printf("Usage: %s [-v] [-f durations]\n", progname);
+    printf("  -v  Print how each of the scheduler's tasks ran\n");
+    printf("  -f  Task durations in us, a line per task of its name and one or more durations,\n");
+    printf("      taken in turn:");
+    for (i = 0; i < D_COUNT; i++)
+        printf(" %s", durations_[i].name);
+    printf("\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg, failures;
+
+    while ((arg = getopt(argc, argv, "vf:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'v':
+                verbose_ = true;
+                break;
+
+            case 'f':
+                if (load(optarg) < 0)
+                    return 1;
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    failures = simulate();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
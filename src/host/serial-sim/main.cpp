@@ -0,0 +1,464 @@
+/**
+ * @file main.cpp
+ * @brief Runs the firmware's DMA serial paths (DmaTransmitQ and DmaReceiveQ from dmaserial.h)
+ *        against a model of an SPI or UART peripheral and its DMA channels, with frames from
+ *        the firmware's FrameQ.  Checks every frame reaches the master intact and commands
+ *        reach the camera, and counts interrupts against the byte-at-a-time paths.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "dmaserial.h"
+#include "frameq.h"
+#include "pixyblocks.h"
+#include "serial.h"
+
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAME_PERIOD_US     20000.0 // Pixy runs blob detection at 50 frames/s
+#define FRAME_WIDTH         320
+#define FRAME_HEIGHT        200
+#define SLOT_LEN            (BF_COMPACT_FRAME_LEN(PB_MAX_BLOCKS) + BF_LEGACY_FRAME_LEN(PB_MAX_BLOCKS))
+#define SIM_SECONDS         2.0
+#define ISR_CYCLES          100     // interrupt entry, handler and exit on the M4
+#define CPU_HZ              204000000.0
+#define BUSY_US             5000.0  // main loop time per frame not spent in ser_processInput()
+#define SPI_DMA_RX_WORDS    4095    // same as SPI_DMA_RECEIVEBUF_SIZE
+#define SPI_DMA_TX_WORDS    (DMA_FRAME_BUF_LEN / 2)
+#define SPI_DMA_IDLE        32      // same as SPI_DMA_IDLE_LEN
+#define UART_DMA_RX_BYTES   256     // same as UART_RECEIVE_BUF_SIZE
+#define UART_TX_FIFO        16
+#define SPI_SYNC_WORD       0x5a00
+#define SPI_SYNC_WORD_DATA  0x5b00
+#define SPI_SYNC_MASK       0xff00
+
+typedef struct
+{
+    const char *name;
+    int spi;                // 16 bit words clocked by the master, otherwise UART bytes
+    double bits_per_second;
+} Link;
+
+static const Link links_[] =
+{
+    { "SPI 2MHz", 1, 2000000.0 },
+    { "SPI 4MHz", 1, 4000000.0 },
+    { "UART 115200", 0, 115200.0 },
+    { "UART 921600", 0, 921600.0 },
+    { "UART 3M", 0, 3000000.0 },
+    { "UART 6M", 0, 6000000.0 },
+};
+
+static const uint8_t scene_blobs_[] = { 4, 20 };
+
+static uint32_t seed_ = 1;
+static uint32_t isr_cycles_ = ISR_CYCLES;
+static double busy_us_ = BUSY_US;
+static FrameQ *frameq_;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+static void make_scene(uint8_t count, PixyBlock *blocks)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        blocks[i].signature = 1 + rnd(3);
+        blocks[i].width = 2 + rnd(60);
+        blocks[i].height = 2 + rnd(40);
+        blocks[i].x = blocks[i].width / 2 + rnd(FRAME_WIDTH - blocks[i].width);
+        blocks[i].y = blocks[i].height / 2 + rnd(FRAME_HEIGHT - blocks[i].height);
+    }
+}
+
+// Blobs::getBlock()
+static uint32_t get_tx_data(uint8_t *data, uint32_t len)
+{
+    return frameq_->read(data, len);
+}
+
+/*
+ * Peripheral model: the peripheral asks for one element per slot on the wire and hands
+ * over one received element.  The transmit channel raises its interrupt when its transfer
+ * is done, held off while the main loop has it locked.
+ */
+class ModelPort : public DmaPort
+{
+public:
+    ModelPort(uint8_t elem_size) : m_elemSize(elem_size), m_tx(NULL), m_txLen(0), m_txPos(0),
+        m_ring(NULL), m_ringLen(0), m_rxPos(0), m_locked(false), m_pending(false), m_interrupts(0)
+    {
+    }
+
+    void setHandler(std::function<void ()> handler)
+    {
+        m_handler = handler;
+    }
+
+    virtual void startTx(const void *buf, uint32_t len)
+    {
+        m_tx = (const uint8_t *)buf;
+        m_txLen = len;
+        m_txPos = 0;
+    }
+
+    virtual void stopTx()
+    {
+        m_tx = NULL;
+        m_pending = false;
+    }
+
+    virtual void startRx(void *ring, uint32_t len)
+    {
+        m_ring = (uint8_t *)ring;
+        m_ringLen = len;
+        m_rxPos = 0;
+    }
+
+    virtual void stopRx()
+    {
+        m_ring = NULL;
+    }
+
+    virtual uint32_t rxIndex()
+    {
+        return m_rxPos;
+    }
+
+    virtual void lock()
+    {
+        m_locked = true;
+    }
+
+    virtual void unlock()
+    {
+        m_locked = false;
+        if (m_pending)
+        {
+            m_pending = false;
+            m_handler();
+        }
+    }
+
+    // peripheral wants the next element to send, false if the channel isn't running
+    bool txRequest(uint16_t *elem)
+    {
+        if (m_tx == NULL)
+            return false;
+        if (m_elemSize == 2)
+            *elem = m_tx[m_txPos * 2] | (m_tx[m_txPos * 2 + 1] << 8);
+        else
+            *elem = m_tx[m_txPos];
+        if (++m_txPos == m_txLen)
+        {
+            m_tx = NULL;
+            m_interrupts++;
+            if (m_locked)
+                m_pending = true;
+            else
+                m_handler();
+        }
+        return true;
+    }
+
+    void rxRequest(uint16_t elem)
+    {
+        if (m_ring == NULL)
+            return;
+        if (m_elemSize == 2)
+            ((uint16_t *)m_ring)[m_rxPos] = elem;
+        else
+            m_ring[m_rxPos] = elem;
+        m_rxPos = (m_rxPos + 1) % m_ringLen;
+    }
+
+    uint32_t interrupts()
+    {
+        return m_interrupts;
+    }
+
+private:
+    uint8_t m_elemSize;
+    const uint8_t *m_tx;
+    uint32_t m_txLen;
+    uint32_t m_txPos;
+    uint8_t *m_ring;
+    uint32_t m_ringLen;
+    uint32_t m_rxPos;
+    bool m_locked;
+    bool m_pending;
+    uint32_t m_interrupts;
+    std::function<void ()> m_handler;
+};
+
+typedef struct
+{
+    uint32_t published;
+    uint32_t received;
+    uint32_t errors;
+    uint32_t commands_sent;
+    uint32_t commands_received;
+    uint32_t interrupts;
+    uint32_t old_interrupts;    // what the interrupt-per-element paths would have taken
+    double latency_us;          // publish to decoded, average, compact frames only (legacy has no seq)
+} Result;
+
+static void publish(FrameQ *q, uint8_t format, uint16_t seq, const PixyBlock *blocks, uint8_t count)
+{
+    uint8_t *buf = q->writeBuf();
+
+    if (format == BF_FORMAT_COMPACT)
+        q->publish(pixy_blocks_encode_compact(seq, seq, blocks, count, buf));
+    else
+        q->publish(pixy_blocks_encode_legacy(blocks, count, buf));
+}
+
+static int check_frame(const PixyBlockDecoder *dec, const PixyBlock *blocks, uint8_t count)
+{
+    return dec->count == count && memcmp(dec->blocks, blocks, count * sizeof(PixyBlock)) == 0 ? 0 : -1;
+}
+
+// Every 100 ms the master sends SER_SYNC_BYTE and a command, which the camera's main loop has
+// to read out of the receive ring before the DMA channel goes around and overwrites it.
+static void simulate(const Link *link, uint8_t format, const PixyBlock *blocks, uint8_t count, Result *res)
+{
+    static PixyBlockDecoder dec;
+    FrameQ q(SLOT_LEN);
+    ModelPort port(link->spi ? 2 : 1);
+    DmaTransmitQ<uint16_t> spi_tq(SPI_DMA_TX_WORDS, get_tx_data, &port, SPI_DMA_IDLE);
+    DmaReceiveQ<uint16_t> spi_rq(SPI_DMA_RX_WORDS, &port);
+    DmaTransmitQ<uint8_t> uart_tq(DMA_FRAME_BUF_LEN, get_tx_data, &port);
+    DmaReceiveQ<uint8_t> uart_rq(UART_DMA_RX_BYTES, &port);
+    double slot_us = (link->spi ? 16.0 : 10.0) * 1000000.0 / link->bits_per_second;
+    double t, next_frame = 0, next_command = 0, busy_until = 0, published_at[BF_MAX_QUEUED_FRAMES + 2];
+    uint8_t command[2] = { 0, 0 }, command_pos = 2, rx_state = 0;
+    uint32_t tx_elems = 0, rx_elems = 0;
+    uint16_t seq = 0, elem;
+
+    memset(res, 0, sizeof(*res));
+    frameq_ = &q;
+    pixy_blocks_init(&dec);
+    if (link->spi)
+    {
+        port.setHandler([&spi_tq]() { spi_tq.done(); });
+        spi_rq.start();
+        spi_tq.start();
+    }
+    else
+    {
+        port.setHandler([&uart_tq]() { uart_tq.done(); });
+        uart_rq.start();
+        uart_tq.start();
+    }
+
+    for (t = 0; t < SIM_SECONDS * 1000000.0; t += slot_us)
+    {
+        // camera main loop: blobify() and ser_update() once per frame, then busy for a while
+        // (USB, SD card), then ser_processInput() until the next frame
+        if (t >= next_frame)
+        {
+            published_at[seq % (BF_MAX_QUEUED_FRAMES + 2)] = t;
+            publish(&q, format, seq++, blocks, count);
+            res->published++;
+            next_frame += FRAME_PERIOD_US;
+            busy_until = t + busy_us_;
+
+            if (link->spi)
+                spi_tq.start();
+            else
+                uart_tq.start();
+        }
+        if (t >= busy_until)
+        {
+            while (link->spi ? spi_rq.read(&elem) : uart_rq.read((uint8_t *)&elem))
+            {
+                uint8_t c;
+
+                if (link->spi) // Spi::receive() keeps data words only
+                {
+                    if ((elem & SPI_SYNC_MASK) != SPI_SYNC_WORD_DATA)
+                        continue;
+                    c = elem & 0xff;
+                }
+                else
+                    c = elem & 0xff;
+                // ser_processInput()
+                if (rx_state == 0 && c == SER_SYNC_BYTE)
+                    rx_state = 1;
+                else if (rx_state == 1)
+                {
+                    if (c == SER_CMD_COMPACT_FRAMES)
+                        res->commands_received++;
+                    rx_state = 0;
+                }
+            }
+        }
+
+        // master side of the slot
+        if (t >= next_command && command_pos == 2)
+        {
+            command[0] = SER_SYNC_BYTE;
+            command[1] = SER_CMD_COMPACT_FRAMES;
+            command_pos = 0;
+            res->commands_sent++;
+            next_command += 100000.0;
+        }
+        if (link->spi)
+        {
+            // the master clocks a word every slot, SPI_SYNC_WORD unless it has a command byte
+            port.rxRequest(command_pos < 2 ? SPI_SYNC_WORD_DATA | command[command_pos++] : SPI_SYNC_WORD);
+            rx_elems++;
+        }
+        else if (command_pos < 2)
+        {
+            port.rxRequest(command[command_pos++]);
+            rx_elems++;
+        }
+
+        if (port.txRequest(&elem))
+        {
+            tx_elems++;
+            // the master puts each word back in memory order
+            uint8_t bytes[2] = { (uint8_t)(elem & 0xff), (uint8_t)(elem >> 8) };
+            for (int i = 0; i < (link->spi ? 2 : 1); i++)
+            {
+                if (pixy_blocks_push(&dec, bytes[i]))
+                {
+                    res->received++;
+                    res->latency_us += t + slot_us - published_at[dec.seq % (BF_MAX_QUEUED_FRAMES + 2)];
+                    if (check_frame(&dec, blocks, count) < 0)
+                        res->errors++;
+                }
+            }
+        }
+        else if (link->spi)
+            res->errors++; // transmit underrun, the master would read garbage
+        else if (pixy_blocks_idle(&dec))
+        {
+            res->received++;
+            if (check_frame(&dec, blocks, count) < 0)
+                res->errors++;
+        }
+    }
+
+    res->interrupts = port.interrupts();
+    // SSP1: one interrupt per word.  USART0: one per received byte, one per transmit FIFO refill.
+    res->old_interrupts = link->spi ? tx_elems : rx_elems + (tx_elems + UART_TX_FIFO - 1) / UART_TX_FIFO;
+    if (res->received && format == BF_FORMAT_COMPACT)
+        res->latency_us /= res->received;
+    else
+        res->latency_us = -1;
+    res->errors += dec.stats.crc_errors;
+}
+
+// Same search as UART_setBaudRate(): divisor and fractional divider closest to the rate.
+static double uart_baudrate(uint32_t clock, uint32_t baudrate)
+{
+    double best = 0, err, best_err = 1e30;
+
+    for (uint32_t m = 1; m <= 15; m++)
+    {
+        for (uint32_t d = 0; d < m; d++)
+        {
+            double div = (double)clock * m / (16.0 * baudrate * (m + d));
+            uint32_t dl = (uint32_t)(div + 0.5);
+            if (dl < 1 || dl > 65535)
+                continue;
+            double rate = (double)clock * m / (16.0 * dl * (m + d));
+            err = rate > baudrate ? rate - baudrate : baudrate - rate;
+            if (err < best_err)
+            {
+                best_err = err;
+                best = rate;
+            }
+        }
+    }
+    return best;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-s seed] [-c cycles] [-b us]\n", progname);
+    printf("  -s  Seed for the generated scenes (default: 1)\n");
+    printf("  -c  CPU cycles per interrupt, for the load estimate (default: %d)\n", ISR_CYCLES);
+    printf("  -b  Main loop time per frame away from ser_processInput() (default: %.0f)\n", BUSY_US);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint32_t baudrates[SER_NUM_BAUDRATES] = SER_BAUDRATES;
+    PixyBlock blocks[PB_MAX_BLOCKS];
+    Result res;
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "s:c:b:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 's':
+                seed_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'c':
+                isr_cycles_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'b':
+                busy_us_ = atof(optarg);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    printf("UART baudrates (SER_CMD_BAUD_BASE + index) from a %.0f MHz clock:\n", CPU_HZ / 1000000.0);
+    for (uint32_t i = 0; i < SER_NUM_BAUDRATES; i++)
+    {
+        double rate = uart_baudrate((uint32_t)CPU_HZ, baudrates[i]);
+        double err = 100.0 * (rate - baudrates[i]) / baudrates[i];
+        printf("  0x%02x %8u  %+.2f%%%s\n", SER_CMD_BAUD_BASE + i, baudrates[i], err, err > 1.5 || err < -1.5 ? "  FAILED" : "");
+        if (err > 1.5 || err < -1.5)
+            failures++;
+    }
+
+    for (uint32_t n = 0; n < sizeof(scene_blobs_); n++)
+    {
+        uint8_t count = scene_blobs_[n];
+
+        make_scene(count, blocks);
+        for (uint8_t format = BF_FORMAT_LEGACY; format <= BF_FORMAT_COMPACT; format++)
+        {
+            printf("\n%d blobs, %s frames, %.0f s\n", count, format == BF_FORMAT_COMPACT ? "compact" : "legacy", SIM_SECONDS);
+            printf("  %-12s %7s %7s %6s %10s %9s %9s %8s %8s\n", "link", "frames", "decoded", "errors", "latency us",
+                   "irq/s", "old irq/s", "cpu %", "old cpu %");
+            for (uint32_t l = 0; l < sizeof(links_) / sizeof(links_[0]); l++)
+            {
+                const Link *link = &links_[l];
+
+                simulate(link, format, blocks, count, &res);
+                char latency[16] = "-";
+                if (res.latency_us >= 0)
+                    snprintf(latency, sizeof(latency), "%.0f", res.latency_us);
+                printf("  %-12s %7u %7u %6u %10s %9.0f %9.0f %8.2f %8.2f%s\n", link->name, res.published, res.received,
+                       res.errors, latency, res.interrupts / SIM_SECONDS, res.old_interrupts / SIM_SECONDS,
+                       100.0 * res.interrupts * isr_cycles_ / SIM_SECONDS / CPU_HZ,
+                       100.0 * res.old_interrupts * isr_cycles_ / SIM_SECONDS / CPU_HZ,
+                       res.commands_received != res.commands_sent ? "  (commands lost)" : "");
+                if (res.errors || res.commands_received != res.commands_sent)
+                    failures++;
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file Arduino.h
+ * @brief Just enough of the Arduino core to compile TPixy.h on the host
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+
+struct HostSerial
+{
+    void print(const char *s)
+    {
+        fputs(s, stdout);
+    }
+    void println(const char *s)
+    {
+        puts(s);
+    }
+};
+
+extern HostSerial Serial;
+
+inline void delayMicroseconds(unsigned int us)
+{
+}
+
+#endif // ARDUINO_H
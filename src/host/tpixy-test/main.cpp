@@ -0,0 +1,435 @@
+/**
+ * @file main.cpp
+ * @brief Runs the Arduino library's parser (TPixy::poll) on the host over a fake link that
+ *        replays byte streams, either generated with libpixyblocks or captured from a Pixy,
+ *        and checks every frame comes out whole while no call reads more than
+ *        PIXY_POLL_WORDS words.  Prints the time per call.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "TPixy.h"
+#include "pixyblocks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define FRAMES              1000
+#define MAX_BLOCKS          12
+#define MAX_ARRIVAL         40      // uart: bytes arriving between two calls to poll()
+#define CALLS_PER_FRAME     8       // i2c: calls to poll() between two frames
+#define SILENT_CALLS        10000
+
+#define LINK_I2C            0       // reads never wait, zeros when Pixy has nothing (also SPI)
+#define LINK_UART           1       // bytes arrive over time, only those can be read
+
+#define NOISE_SWITCH        0x01    // each frame in either format
+#define NOISE_GARBAGE       0x02    // random bytes between frames, no markers in them
+#define NOISE_ODD           0x04    // one byte between frames, so the next is off by a byte
+#define NOISE_OVERSIZE      0x08    // more blocks than PIXY_ARRAYSIZE
+
+HostSerial Serial;
+
+// The stream the fake link replays.  arrived is how much of it Pixy has sent so far.
+struct Replay
+{
+    std::vector<uint8_t> bytes;
+    uint32_t pos;
+    uint32_t arrived;
+    uint32_t reads;         // words and bytes read, the link's time
+    int type;
+};
+
+static Replay replay_;
+
+class LinkReplay
+{
+public:
+    void init()
+    {
+    }
+    void setArg(uint16_t arg)
+    {
+    }
+    uint16_t available()
+    {
+        if (replay_.type == LINK_I2C)
+            return 0xffff;
+        return replay_.arrived - replay_.pos > 0xffff ? 0xffff : replay_.arrived - replay_.pos;
+    }
+    uint16_t getWord()
+    {
+        uint16_t w = getByte();
+
+        return w | getByte() << 8;
+    }
+    uint8_t getByte()
+    {
+        replay_.reads++;
+        if (replay_.pos < replay_.arrived)
+            return replay_.bytes[replay_.pos++];
+        if (replay_.type == LINK_UART)
+        {
+            printf("  read past the bytes that arrived  FAILED\n");
+            exit(1);
+        }
+        return 0;
+    }
+    int8_t send(uint8_t *data, uint8_t len)
+    {
+        return len;
+    }
+};
+
+typedef TPixy<LinkReplay> PixyReplay;
+
+typedef struct
+{
+    bool compact;
+    uint16_t seq;
+    uint32_t timestamp;
+    std::vector<PixyBlock> blocks;
+    uint32_t end;           // offset in the stream just after the frame
+} Frame;
+
+typedef struct
+{
+    const char *name;
+    int type;
+    uint8_t format;
+    uint8_t noise;
+} Case;
+
+static const Case cases_[] =
+{
+    { "legacy i2c", LINK_I2C, BF_FORMAT_LEGACY, 0 },
+    { "compact i2c", LINK_I2C, BF_FORMAT_COMPACT, 0 },
+    { "legacy uart", LINK_UART, BF_FORMAT_LEGACY, 0 },
+    { "compact uart", LINK_UART, BF_FORMAT_COMPACT, 0 },
+    { "switching uart", LINK_UART, BF_FORMAT_LEGACY, NOISE_SWITCH },
+    { "garbage uart", LINK_UART, BF_FORMAT_LEGACY, NOISE_SWITCH | NOISE_GARBAGE },
+    { "odd bytes i2c", LINK_I2C, BF_FORMAT_LEGACY, NOISE_SWITCH | NOISE_ODD },
+    { "odd bytes uart", LINK_UART, BF_FORMAT_LEGACY, NOISE_SWITCH | NOISE_ODD },
+    { "oversize i2c", LINK_I2C, BF_FORMAT_LEGACY, NOISE_SWITCH | NOISE_OVERSIZE },
+};
+
+typedef struct
+{
+    uint32_t calls;
+    uint32_t frames;
+    uint32_t missed;
+    uint32_t wrong;
+    uint32_t errors;
+    uint32_t maxReads;      // most bytes one call read
+    double maxUs;
+    double totalUs;
+} Result;
+
+static uint32_t seed_ = 1;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Builds FRAMES frames with the case's noise between them.  Returns how many noise
+// insertions could cost the frame after them.
+static uint32_t make_stream(const Case *c, std::vector<Frame> *frames)
+{
+    static uint8_t buf[BF_LEGACY_FRAME_LEN(PB_MAX_BLOCKS)];
+    Frame frame;
+    PixyBlock block;
+    uint32_t i, k, n, len, risky = 0;
+
+    replay_.bytes.clear();
+    for (i = 0; i < FRAMES; i++)
+    {
+        frame.compact = c->noise & NOISE_SWITCH ? rnd(2) : c->format == BF_FORMAT_COMPACT;
+        frame.seq = i;
+        frame.timestamp = i * 20000 + rnd(1000);
+        frame.blocks.clear();
+        n = c->noise & NOISE_OVERSIZE ? PIXY_ARRAYSIZE + rnd(2 * PIXY_ARRAYSIZE) : rnd(MAX_BLOCKS + 1);
+        if (!frame.compact && n == 0) // legacy frames without blocks aren't sent
+            n = 1;
+        for (k = 0; k < n; k++)
+        {
+            block.signature = 1 + rnd(7);
+            block.x = rnd(320);
+            block.y = rnd(200);
+            block.width = 1 + rnd(320);
+            block.height = 1 + rnd(200);
+            frame.blocks.push_back(block);
+        }
+        len = frame.compact ? pixy_blocks_encode_compact(frame.seq, frame.timestamp, frame.blocks.data(), n, buf) :
+              pixy_blocks_encode_legacy(frame.blocks.data(), n, buf);
+        replay_.bytes.insert(replay_.bytes.end(), buf, buf + len);
+        frame.end = replay_.bytes.size();
+        frames->push_back(frame);
+
+        if ((c->noise & NOISE_GARBAGE) && rnd(4) == 0)
+        {
+            for (k = 2 * (1 + rnd(8)); k; k--)
+            {
+                do
+                    n = rnd(256);
+                while (n == 0xaa || n == 0x55 || n == 0x57);
+                replay_.bytes.push_back(n);
+            }
+            risky++;
+        }
+        if ((c->noise & NOISE_ODD) && rnd(8) == 0)
+        {
+            replay_.bytes.push_back(1 + rnd(0xa0));
+            risky++;
+        }
+    }
+    // a legacy frame only ends when something else follows, Pixy's idle zeros do on i2c
+    replay_.bytes.insert(replay_.bytes.end(), 4, 0);
+
+    return risky;
+}
+
+static bool same(const Frame *frame, const PixyReplay *pixy)
+{
+    uint16_t n = frame->blocks.size() < PIXY_ARRAYSIZE ? frame->blocks.size() : PIXY_ARRAYSIZE;
+
+    if (pixy->numBlocks != n || (frame->compact && (pixy->frame != frame->seq || pixy->timestamp != frame->timestamp)))
+        return false;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        const PixyBlock *a = &frame->blocks[i];
+        const Block *b = &pixy->blocks[i];
+
+        if (a->signature != b->signature || a->x != b->x || a->y != b->y || a->width != b->width ||
+            a->height != b->height || b->angle != 0)
+            return false;
+    }
+    return true;
+}
+
+static void timed_poll(PixyReplay *pixy, Result *res, bool *complete)
+{
+    uint32_t reads = replay_.reads;
+    double t = now_us(), us;
+
+    *complete = pixy->poll();
+    us = now_us() - t;
+    res->calls++;
+    res->totalUs += us;
+    if (us > res->maxUs)
+        res->maxUs = us;
+    if (replay_.reads - reads > res->maxReads)
+        res->maxReads = replay_.reads - reads;
+}
+
+static void run(int type, const std::vector<Frame> &frames, Result *res)
+{
+    static PixyReplay pixy;
+    uint32_t next = 0, k, f = 0, idle = 0;
+    bool complete;
+
+    pixy = PixyReplay();
+    memset(res, 0, sizeof(*res));
+    replay_.pos = 0;
+    replay_.arrived = 0;
+    replay_.reads = 0;
+    replay_.type = type;
+
+    while (next < frames.size() && idle < 100)
+    {
+        // i2c: Pixy queues whole frames, uart: bytes trickle in
+        if (type == LINK_I2C)
+        {
+            if (res->calls % CALLS_PER_FRAME == 0)
+                replay_.arrived = f < frames.size() ? frames[f++].end : replay_.bytes.size();
+        }
+        else
+        {
+            replay_.arrived += rnd(MAX_ARRIVAL + 1);
+            if (replay_.arrived > replay_.bytes.size())
+                replay_.arrived = replay_.bytes.size();
+        }
+
+        timed_poll(&pixy, res, &complete);
+        if (!complete)
+        {
+            if (replay_.pos == replay_.bytes.size())
+                idle++;
+            continue;
+        }
+
+        res->frames++;
+        for (k = next; k < frames.size() && !same(&frames[k], &pixy); k++);
+        if (k < frames.size())
+        {
+            res->missed += k - next;
+            next = k + 1;
+        }
+        else
+            res->wrong++;
+    }
+    res->missed += frames.size() - next;
+    res->errors = pixy.errors;
+}
+
+static int test_streams()
+{
+    std::vector<Frame> frames;
+    Result res;
+    uint32_t risky;
+    int failures = 0;
+    bool failed;
+
+    printf("poll(), %d frames per stream, PIXY_ARRAYSIZE %d, PIXY_POLL_WORDS %d\n", FRAMES, PIXY_ARRAYSIZE, PIXY_POLL_WORDS);
+    printf("  %-16s %7s %7s %7s %7s %7s %7s %10s %8s %8s\n", "stream", "bytes", "calls", "frames", "missed", "wrong",
+           "errors", "max bytes", "mean us", "max us");
+    for (uint32_t c = 0; c < sizeof(cases_) / sizeof(cases_[0]); c++)
+    {
+        frames.clear();
+        risky = make_stream(&cases_[c], &frames);
+        run(cases_[c].type, frames, &res);
+
+        // noise may cost the frame after it but never makes one up, and no call reads more
+        // than PIXY_POLL_WORDS words, plus a byte to realign
+        failed = res.wrong || res.missed > risky || res.maxReads > 2 * PIXY_POLL_WORDS + 1;
+        printf("  %-16s %7u %7u %7u %7u %7u %7u %10u %8.2f %8.2f%s\n", cases_[c].name,
+               (unsigned)replay_.bytes.size(), res.calls, res.frames, res.missed, res.wrong, res.errors, res.maxReads,
+               res.totalUs / res.calls, res.maxUs, failed ? "  FAILED" : "");
+        if (failed)
+            failures++;
+    }
+    return failures;
+}
+
+// Pixy is silent: the old getBlocks() waited here forever on uart
+static int test_silent()
+{
+    static PixyReplay pixy;
+    Result res;
+    bool complete, failed = false;
+
+    printf("\nsilent link, %d calls\n", SILENT_CALLS);
+    for (int type = LINK_I2C; type <= LINK_UART; type++)
+    {
+        pixy = PixyReplay();
+        memset(&res, 0, sizeof(res));
+        replay_.bytes.clear();
+        replay_.pos = replay_.arrived = replay_.reads = 0;
+        replay_.type = type;
+        for (int i = 0; i < SILENT_CALLS; i++)
+        {
+            timed_poll(&pixy, &res, &complete);
+            if (complete)
+                failed = true;
+        }
+        printf("  %-6s max bytes %u  mean us %.3f  max us %.3f%s\n", type == LINK_I2C ? "i2c" : "uart", res.maxReads,
+               res.totalUs / res.calls, res.maxUs, failed ? "  FAILED" : "");
+    }
+    return failed ? 1 : 0;
+}
+
+// Replays a captured stream (the raw bytes Pixy sent) and prints the frames.
+static int replay_file(const char *filename, int type)
+{
+    static PixyReplay pixy;
+    FILE *file = fopen(filename, "rb");
+    Result res;
+    uint8_t buf[4096];
+    size_t len;
+    bool complete;
+
+    if (file == NULL)
+    {
+        printf("Can't open %s\n", filename);
+        return 1;
+    }
+    replay_.bytes.clear();
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+        replay_.bytes.insert(replay_.bytes.end(), buf, buf + len);
+    fclose(file);
+
+    memset(&res, 0, sizeof(res));
+    replay_.pos = 0;
+    replay_.arrived = 0;
+    replay_.reads = 0;
+    replay_.type = type;
+    while (replay_.pos < replay_.bytes.size())
+    {
+        replay_.arrived += type == LINK_UART ? rnd(MAX_ARRIVAL + 1) : replay_.bytes.size();
+        if (replay_.arrived > replay_.bytes.size())
+            replay_.arrived = replay_.bytes.size();
+        timed_poll(&pixy, &res, &complete);
+        if (!complete)
+            continue;
+        res.frames++;
+        printf("frame %u: %u blocks, seq %u, timestamp %u\n", res.frames, pixy.numBlocks, pixy.frame, pixy.timestamp);
+        for (uint16_t i = 0; i < pixy.numBlocks; i++)
+        {
+            printf("  ");
+            pixy.blocks[i].print();
+        }
+    }
+    printf("%u bytes, %u frames, %u errors, %u calls, max bytes %u, mean us %.3f, max us %.3f\n",
+           (unsigned)replay_.bytes.size(), res.frames, pixy.errors, res.calls, res.maxReads, res.totalUs / res.calls,
+           res.maxUs);
+    return 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-f file] [-u] [-s seed]\n", progname);
+    printf("  -f  Replay a captured byte stream instead of the generated ones\n");
+    printf("  -u  The capture is from uart, feed it a few bytes per call (default: i2c or spi)\n");
+    printf("  -s  Seed for the generated streams (default: 1)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = NULL;
+    int arg, type = LINK_I2C, failures = 0;
+
+    while ((arg = getopt(argc, argv, "f:us:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'f':
+                filename = optarg;
+                break;
+
+            case 'u':
+                type = LINK_UART;
+                break;
+
+            case 's':
+                seed_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    if (filename)
+        return replay_file(filename, type);
+
+    failures += test_streams();
+    failures += test_silent();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
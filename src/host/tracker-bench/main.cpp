@@ -0,0 +1,750 @@
+/**
+ * @file main.cpp
+ * @brief Runs the camera's blob tracker (common/inc/tracker.h) on synthetic sessions with
+ *        known targets, or on a session recorded to the SD card, and reports how stable the
+ *        track IDs are, how well the tracks follow the targets, and the time and blob/track
+ *        pairs compared per frame.  Also runs the beacon decoder (common/inc/beacons.h) on
+ *        synthetic blinking beacons among glints and flicker, with missed blobs and dropped
+ *        frames.  Checks tracks and beacons survive their block formats.
+ * @copyright Copyright © 2021 Matternet. All rights reserved.
+ */
+
+#include "tracker.h"
+#include "beacons.h"
+#include "pixyblocks.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+
+#define FRAMES              3000
+#define WIDTH               320
+#define HEIGHT              200
+#define PERIOD_US           20000
+#define ACCEL               200     // pixels/s^2, how hard targets turn
+#define SETTLE_FRAMES       10      // track age before velocity error counts
+
+// Recorded sessions are the SD card blocks device/libpixy_m4/src/sdmmc.cpp writes, one
+// frame after the other: the header below in the first sector, then the image.
+#define SD_SECTOR_SIZE      512
+#define SD_FRAME_LEN        ((WIDTH*HEIGHT/SD_SECTOR_SIZE + 1)*SD_SECTOR_SIZE)
+#define SD_MAX_BLOBS        20      // MAX_BLOBS
+
+typedef struct __attribute__((packed))
+{
+    uint32_t session_cnt;
+    uint32_t frame_cnt;
+    uint32_t timestamp_us;
+    uint32_t last_write_time_us;
+    uint16_t blob_cnt;
+    uint16_t blobs[SD_MAX_BLOBS*5];
+    uint8_t crc8;
+} SdFrameHeader;            // SdmmcFrameHeader in device/libpixy_m4/inc/sdmmc.h
+
+typedef struct
+{
+    const char *name;
+    uint8_t targets;
+    uint8_t signatures;
+    double noise;           // pixels, standard deviation of the blob centers
+    uint8_t dropout;        // percent of frames a target has no blob
+    uint8_t clutter;        // blobs per frame that belong to no target
+    double speed;           // pixels/s, most a target moves
+    uint32_t jitter;        // us, frame period varies by up to this much
+} Scene;
+
+static const Scene scenes_[] =
+{
+    { "1 target", 1, 1, 0.5, 0, 0, 100, 0 },
+    { "4 targets", 4, 2, 0.5, 0, 0, 100, 0 },
+    { "4 noisy", 4, 2, 1.5, 0, 0, 100, 0 },
+    { "4 dropouts 10%", 4, 2, 0.5, 10, 0, 100, 0 },
+    { "4 + 3 clutter", 4, 2, 0.5, 0, 3, 100, 0 },
+    { "4 jittered period", 4, 2, 0.5, 0, 0, 100, 8000 },
+    { "4 fast", 4, 2, 0.5, 0, 0, 500, 0 },
+    { "8 one signature", 8, 1, 0.5, 0, 0, 150, 0 },
+    { "16 + 4 clutter", 16, 4, 1.0, 5, 4, 100, 0 },
+};
+
+typedef struct
+{
+    double x, y;
+    double vx, vy;
+    uint16_t signature;
+    uint16_t width, height;
+    uint16_t track;         // id of the track following it, 0 if none yet
+} Target;
+
+typedef struct
+{
+    uint32_t targetFrames;
+    uint32_t covered;       // target frames with a confirmed track on the target
+    uint32_t switches;      // times a target changed track id
+    uint32_t falseTracks;   // confirmed tracks on no target, summed over frames
+    uint32_t velFrames;
+    double velError2;
+    uint32_t pairs;
+    uint32_t maxPairs;
+    double totalUs;
+    double maxUs;
+    uint32_t roundTripErrors;
+} Result;
+
+static uint32_t seed_ = 1;
+
+static uint32_t rnd(uint32_t range)
+{
+    seed_ = seed_ * 1103515245 + 12345;
+    return (seed_ >> 16) % range;
+}
+
+static double uniform()
+{
+    return (rnd(0x8000) + 0.5) / 0x8000;
+}
+
+static double gauss()
+{
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint16_t clamp(double v, uint16_t max)
+{
+    return v < 0 ? 0 : (v > max ? max : (uint16_t)(v + 0.5));
+}
+
+// Same as the camera's CRC8 in device/libpixy_m4/src/misc.cpp (poly 0x07, init 0).
+static uint8_t crc8(const uint8_t *data, uint32_t len)
+{
+    uint8_t crc = 0;
+    int bit;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static void timed_update(Tracker *tracker, const uint16_t *blobs, uint16_t numBlobs, uint32_t timestamp, Result *res)
+{
+    double t = now_us();
+
+    tracker->update(blobs, numBlobs, timestamp);
+    t = now_us() - t;
+    res->totalUs += t;
+    if (t > res->maxUs)
+        res->maxUs = t;
+    res->pairs += tracker->pairs();
+    if (tracker->pairs() > res->maxPairs)
+        res->maxPairs = tracker->pairs();
+}
+
+// Sends the confirmed tracks the way Blobs::encodeTracksFrame() does and checks the decoder
+// gets them back.
+static bool round_trip(Tracker *tracker, uint16_t seq, uint32_t timestamp)
+{
+    static PixyBlockDecoder dec;
+    PixyTrack sent[BF_MAX_TRACKS];
+    uint8_t buf[BF_TRACKS_FRAME_LEN(BF_MAX_TRACKS)];
+    const Track *tracks;
+    uint32_t len, i;
+    uint16_t n, count = 0;
+    int32_t vx, vy;
+    bool done = false;
+
+    n = tracker->getTracks(&tracks);
+    for (i = 0; i < n; i++)
+    {
+        if (!tracker->confirmed(tracks + i))
+            continue;
+        vx = tracks[i].vx >> TR_SHIFT;
+        vy = tracks[i].vy >> TR_SHIFT;
+        sent[count].id = tracks[i].id;
+        sent[count].signature = tracks[i].signature;
+        sent[count].x = tracks[i].x < 0 ? 0 : tracks[i].x >> (TR_SHIFT - 2);
+        sent[count].y = tracks[i].y < 0 ? 0 : tracks[i].y >> (TR_SHIFT - 2);
+        sent[count].vx = vx < -32768 ? -32768 : (vx > 32767 ? 32767 : vx);
+        sent[count].vy = vy < -32768 ? -32768 : (vy > 32767 ? 32767 : vy);
+        sent[count].width = tracks[i].width;
+        sent[count].height = tracks[i].height;
+        sent[count].age = tracks[i].age;
+        count++;
+    }
+
+    len = pixy_blocks_encode_tracks(seq, timestamp, sent, count, buf);
+    if (seq == 0)
+        pixy_blocks_init(&dec);
+    for (i = 0; i < len; i++)
+        done |= pixy_blocks_push(&dec, buf[i]) == 1;
+    if (!done || dec.format != BF_FORMAT_TRACKS || dec.count != count || dec.seq != seq || dec.timestamp != timestamp)
+        return false;
+    return memcmp(dec.tracks, sent, count * sizeof(PixyTrack)) == 0;
+}
+
+static void move(Target *target, double dt, double speed)
+{
+    double v;
+
+    target->vx += gauss() * ACCEL * dt;
+    target->vy += gauss() * ACCEL * dt;
+    v = sqrt(target->vx * target->vx + target->vy * target->vy);
+    if (v > speed)
+    {
+        target->vx *= speed / v;
+        target->vy *= speed / v;
+    }
+    target->x += target->vx * dt;
+    target->y += target->vy * dt;
+    if (target->x < target->width / 2 || target->x > WIDTH - target->width / 2)
+    {
+        target->vx = -target->vx;
+        target->x += 2 * target->vx * dt;
+    }
+    if (target->y < target->height / 2 || target->y > HEIGHT - target->height / 2)
+    {
+        target->vy = -target->vy;
+        target->y += 2 * target->vy * dt;
+    }
+}
+
+static void put_blob(uint16_t *blob, uint16_t signature, double x, double y, uint16_t width, uint16_t height)
+{
+    blob[0] = signature;
+    blob[1] = clamp(x - width / 2.0, WIDTH - 1);
+    blob[2] = clamp(x + width / 2.0, WIDTH - 1);
+    blob[3] = clamp(y - height / 2.0, HEIGHT - 1);
+    blob[4] = clamp(y + height / 2.0, HEIGHT - 1);
+}
+
+// blobify() sorts by size, not by target
+static void shuffle(uint16_t *blobs, uint16_t numBlobs)
+{
+    uint16_t i, j, tmp[5];
+
+    for (i = numBlobs; i > 1; i--)
+    {
+        j = rnd(i);
+        memcpy(tmp, blobs + j * 5, sizeof(tmp));
+        memcpy(blobs + j * 5, blobs + (i - 1) * 5, sizeof(tmp));
+        memcpy(blobs + (i - 1) * 5, tmp, sizeof(tmp));
+    }
+}
+
+// Each target takes the closest confirmed track of its signature inside the gate.
+static void score(Tracker *tracker, Target *targets, uint8_t numTargets, Result *res)
+{
+    bool used[TR_MAX_TRACKS] = { false };
+    const Track *tracks;
+    uint16_t i, j, n, best;
+    double dx, dy, d2, bestD2;
+
+    n = tracker->getTracks(&tracks);
+    for (i = 0; i < numTargets; i++)
+    {
+        res->targetFrames++;
+        best = n;
+        bestD2 = TR_GATE * TR_GATE;
+        for (j = 0; j < n; j++)
+        {
+            if (used[j] || !tracker->confirmed(tracks + j) || tracks[j].signature != targets[i].signature)
+                continue;
+            dx = tracks[j].x / 256.0 - targets[i].x;
+            dy = tracks[j].y / 256.0 - targets[i].y;
+            d2 = dx * dx + dy * dy;
+            if (d2 < bestD2)
+            {
+                bestD2 = d2;
+                best = j;
+            }
+        }
+        if (best == n)
+            continue;
+        used[best] = true;
+        res->covered++;
+        if (targets[i].track && targets[i].track != tracks[best].id)
+            res->switches++;
+        targets[i].track = tracks[best].id;
+        if (tracks[best].age >= SETTLE_FRAMES)
+        {
+            dx = tracks[best].vx / 256.0 - targets[i].vx;
+            dy = tracks[best].vy / 256.0 - targets[i].vy;
+            res->velError2 += dx * dx + dy * dy;
+            res->velFrames++;
+        }
+    }
+    for (j = 0; j < n; j++)
+    {
+        if (!used[j] && tracker->confirmed(tracks + j))
+            res->falseTracks++;
+    }
+}
+
+static void run_scene(const Scene *scene, Result *res)
+{
+    static Tracker tracker;
+    Target targets[TR_MAX_TRACKS];
+    uint16_t blobs[TR_MAX_BLOBS * 5];
+    uint16_t numBlobs, i;
+    uint32_t frame, timestamp = 0, period;
+    double dt;
+
+    memset(res, 0, sizeof(*res));
+    tracker.reset();
+    for (i = 0; i < scene->targets; i++)
+    {
+        targets[i].width = 6 + rnd(15);
+        targets[i].height = 6 + rnd(15);
+        targets[i].x = targets[i].width + rnd(WIDTH - 2 * targets[i].width);
+        targets[i].y = targets[i].height + rnd(HEIGHT - 2 * targets[i].height);
+        targets[i].vx = (uniform() * 2 - 1) * scene->speed / 2;
+        targets[i].vy = (uniform() * 2 - 1) * scene->speed / 2;
+        targets[i].signature = 1 + i % scene->signatures;
+        targets[i].track = 0;
+    }
+
+    for (frame = 0; frame < FRAMES; frame++)
+    {
+        period = PERIOD_US + (scene->jitter ? rnd(2 * scene->jitter + 1) - scene->jitter : 0);
+        dt = period / 1e6;
+        timestamp += period;
+
+        numBlobs = 0;
+        for (i = 0; i < scene->targets; i++)
+        {
+            move(targets + i, dt, scene->speed);
+            if (rnd(100) < scene->dropout || numBlobs == TR_MAX_BLOBS)
+                continue;
+            put_blob(blobs + numBlobs++ * 5, targets[i].signature, targets[i].x + gauss() * scene->noise,
+                     targets[i].y + gauss() * scene->noise, targets[i].width, targets[i].height);
+        }
+        for (i = 0; i < scene->clutter && numBlobs < TR_MAX_BLOBS; i++)
+            put_blob(blobs + numBlobs++ * 5, 1 + rnd(scene->signatures), rnd(WIDTH), rnd(HEIGHT), 3 + rnd(6), 3 + rnd(6));
+        shuffle(blobs, numBlobs);
+
+        timed_update(&tracker, blobs, numBlobs, timestamp, res);
+        score(&tracker, targets, scene->targets, res);
+        if (!round_trip(&tracker, frame, timestamp))
+            res->roundTripErrors++;
+    }
+}
+
+static int test_scenes()
+{
+    Result res;
+    uint32_t failed = 0;
+    size_t s;
+
+    printf("%d frames per scene, gate %d px, confirm %d, coast %d, alpha %d/256, beta %d/256\n", FRAMES, TR_GATE,
+           TR_CONFIRM_HITS, TR_MAX_MISSES, TR_ALPHA, TR_BETA);
+    printf("  %-18s %8s %8s %8s %9s %9s %9s %8s %8s\n", "scene", "switches", "covered", "false", "vel rms", "pairs",
+           "max pairs", "mean us", "max us");
+    for (s = 0; s < sizeof(scenes_) / sizeof(scenes_[0]); s++)
+    {
+        run_scene(scenes_ + s, &res);
+        printf("  %-18s %8u %7.1f%% %8.2f %9.1f %9.1f %9u %8.2f %8.2f%s\n", scenes_[s].name, res.switches,
+               100.0 * res.covered / res.targetFrames, (double)res.falseTracks / FRAMES,
+               res.velFrames ? sqrt(res.velError2 / res.velFrames) : 0.0, (double)res.pairs / FRAMES, res.maxPairs,
+               res.totalUs / FRAMES, res.maxUs, res.roundTripErrors ? "  FAILED" : "");
+        failed += res.roundTripErrors;
+    }
+    printf("  switches: times a target changed track id, covered: target frames with its track,\n"
+           "  false: confirmed tracks on no target per frame, vel rms: px/s once a track is %d frames old\n",
+           SETTLE_FRAMES);
+    return failed ? 1 : 0;
+}
+
+typedef struct
+{
+    const char *name;
+    uint8_t beacons;        // blinking codes 1..beacons
+    uint8_t glints;         // steady blobs
+    uint8_t flickers;       // blobs on or off at random
+    uint8_t missed;         // percent of frames a lit LED gives no blob
+    uint8_t dropped;        // percent of frames the camera drops
+    double speed;           // pixels/s, the camera moving over the pad
+} BeaconScene;
+
+static const BeaconScene beaconScenes_[] =
+{
+    { "4 beacons", 4, 0, 0, 0, 0, 20 },
+    { "4 + 2 glints", 4, 2, 0, 0, 0, 20 },
+    { "4 + 2 flickering", 4, 0, 2, 0, 0, 20 },
+    { "4 missed 3%", 4, 0, 0, 3, 0, 20 },
+    { "4 dropped 5%", 4, 0, 0, 0, 5, 20 },
+    { "4 moving", 4, 0, 0, 0, 0, 100 },
+    { "8 + clutter, noise", 8, 2, 2, 2, 2, 40 },
+};
+
+typedef struct
+{
+    uint32_t beaconFrames;  // frames after BEACON_WARMUP, summed over beacons
+    uint32_t identified;    // of those, with the beacon's id on its track
+    uint32_t wrong;         // with another id
+    uint32_t falseBeacons;  // ids reported on tracks of no beacon, summed over frames
+    uint32_t firstId;       // frames until each beacon was first identified, summed
+    uint32_t neverIds;      // beacons never identified
+    double totalUs;
+    double maxUs;
+    uint32_t roundTripErrors;
+} BeaconResult;
+
+#define BEACON_WARMUP       64  // frames, 32 of history and BC_CONFIRM, with some to spare
+#define SWAY                20  // pixels, how far the pad moves in the image
+
+static bool beacon_round_trip(Tracker *tracker, Beacons *beacons, uint16_t seq, uint32_t timestamp)
+{
+    static PixyBlockDecoder dec;
+    PixyBeacon sent[BF_MAX_TRACKS];
+    uint8_t buf[BF_BEACONS_FRAME_LEN(BF_MAX_TRACKS)];
+    const Track *tracks;
+    uint32_t len, i;
+    uint16_t n, count = 0;
+    bool done = false;
+
+    n = tracker->getTracks(&tracks);
+    for (i = 0; i < n; i++)
+    {
+        if (!tracker->confirmed(tracks + i) || beacons->id(tracks + i) == 0)
+            continue;
+        sent[count].beacon = beacons->id(tracks + i);
+        sent[count].track = tracks[i].id;
+        sent[count].signature = tracks[i].signature;
+        sent[count].x = tracks[i].x < 0 ? 0 : tracks[i].x >> (TR_SHIFT - 2);
+        sent[count].y = tracks[i].y < 0 ? 0 : tracks[i].y >> (TR_SHIFT - 2);
+        sent[count].width = tracks[i].width;
+        sent[count].height = tracks[i].height;
+        count++;
+    }
+
+    len = pixy_blocks_encode_beacons(seq, timestamp, sent, count, buf);
+    if (seq == 0)
+        pixy_blocks_init(&dec);
+    for (i = 0; i < len; i++)
+        done |= pixy_blocks_push(&dec, buf[i]) == 1;
+    if (!done || dec.format != BF_FORMAT_BEACONS || dec.count != count || dec.seq != seq)
+        return false;
+    for (i = 0; i < count; i++)
+    {
+        if (dec.beacons[i].beacon != sent[i].beacon || dec.beacons[i].track != sent[i].track ||
+            dec.beacons[i].x != sent[i].x || dec.beacons[i].y != sent[i].y ||
+            dec.beacons[i].width != sent[i].width || dec.beacons[i].height != sent[i].height)
+            return false;
+    }
+    return true;
+}
+
+static void run_beacon_scene(const BeaconScene *scene, BeaconResult *res)
+{
+    static Tracker tracker;
+    static Beacons beacons;
+    Target targets[TR_MAX_TRACKS];
+    double x0[TR_MAX_TRACKS], y0[TR_MAX_TRACKS];
+    uint8_t phase[TR_MAX_TRACKS];
+    int32_t first[TR_MAX_TRACKS];
+    bool reported[TR_MAX_TRACKS];
+    uint16_t blobs[TR_MAX_BLOBS * 5];
+    uint16_t numBlobs, i, j, n, best, code, numTargets;
+    uint32_t frame, timestamp = 0;
+    const Track *tracks;
+    double dx, dy, d2, bestD2, t, w;
+
+    memset(res, 0, sizeof(*res));
+    tracker.reset();
+    beacons.reset();
+    // beacons first, then glints, then flickers, spread over the image and moving together
+    numTargets = scene->beacons + scene->glints + scene->flickers;
+    w = scene->speed / SWAY;
+    for (i = 0; i < numTargets; i++)
+    {
+        targets[i].width = 4 + rnd(6);
+        targets[i].height = 4 + rnd(6);
+        x0[i] = 30 + (i % 4) * 80 + rnd(10);
+        y0[i] = 40 + (i / 4) * 50 + rnd(10);
+        targets[i].signature = 1;
+        phase[i] = rnd(BC_CODE_BITS);
+        first[i] = -1;
+    }
+
+    for (frame = 0; frame < FRAMES; frame++)
+    {
+        timestamp += PERIOD_US;
+        numBlobs = 0;
+        for (i = 0; i < numTargets; i++)
+        {
+            targets[i].x = x0[i] + SWAY * sin(w * timestamp / 1e6);
+            targets[i].y = y0[i] + SWAY * sin(0.7 * w * timestamp / 1e6);
+            if (i < scene->beacons)
+            {
+                code = g_beaconCodes[i];
+                if (!((code >> (BC_CODE_BITS - 1 - (frame + phase[i]) % BC_CODE_BITS)) & 1) || rnd(100) < scene->missed)
+                    continue;
+            }
+            else if (i >= scene->beacons + scene->glints && rnd(2))
+                continue;
+            if (numBlobs < TR_MAX_BLOBS)
+                put_blob(blobs + numBlobs++ * 5, targets[i].signature, targets[i].x + gauss() * 0.5,
+                         targets[i].y + gauss() * 0.5, targets[i].width, targets[i].height);
+        }
+        if (rnd(100) < scene->dropped)
+            continue;
+        shuffle(blobs, numBlobs);
+
+        tracker.update(blobs, numBlobs, timestamp);
+        t = now_us();
+        beacons.update(&tracker);
+        t = now_us() - t;
+        res->totalUs += t;
+        if (t > res->maxUs)
+            res->maxUs = t;
+        if (!beacon_round_trip(&tracker, &beacons, frame, timestamp))
+            res->roundTripErrors++;
+
+        // each target takes the closest confirmed track
+        n = tracker.getTracks(&tracks);
+        memset(reported, 0, sizeof(reported));
+        for (i = 0; i < numTargets; i++)
+        {
+            best = n;
+            bestD2 = TR_GATE * TR_GATE;
+            for (j = 0; j < n; j++)
+            {
+                dx = tracks[j].x / 256.0 - targets[i].x;
+                dy = tracks[j].y / 256.0 - targets[i].y;
+                d2 = dx * dx + dy * dy;
+                if (!reported[j] && tracker.confirmed(tracks + j) && d2 < bestD2)
+                {
+                    bestD2 = d2;
+                    best = j;
+                }
+            }
+            if (best == n)
+                continue;
+            reported[best] = true;
+            code = beacons.id(tracks + best);
+            if (i >= scene->beacons)
+            {
+                res->falseBeacons += code != 0;
+                continue;
+            }
+            if (code == i + 1 && first[i] < 0)
+                first[i] = frame;
+            if (frame < BEACON_WARMUP)
+                continue;
+            res->identified += code == i + 1;
+            res->wrong += code != 0 && code != i + 1;
+        }
+        for (j = 0; j < n; j++)
+            res->falseBeacons += !reported[j] && beacons.id(tracks + j) != 0;
+        if (frame >= BEACON_WARMUP)
+            res->beaconFrames += scene->beacons;
+    }
+    for (i = 0; i < scene->beacons; i++)
+    {
+        if (first[i] < 0)
+            res->neverIds++;
+        else
+            res->firstId += first[i];
+    }
+}
+
+static int test_beacons()
+{
+    BeaconResult res;
+    uint32_t failed = 0, found;
+    size_t s;
+
+    printf("\nbeacons, %d frames per scene, %d codes of %d bits, up to %d errors in 32 frames, confirm %d\n", FRAMES,
+           BC_NUM_CODES, BC_CODE_BITS, BC_MAX_ERRORS, BC_CONFIRM);
+    printf("  %-20s %10s %8s %8s %9s %8s %8s\n", "scene", "identified", "wrong", "false", "first id", "mean us",
+           "max us");
+    for (s = 0; s < sizeof(beaconScenes_) / sizeof(beaconScenes_[0]); s++)
+    {
+        run_beacon_scene(beaconScenes_ + s, &res);
+        found = beaconScenes_[s].beacons - res.neverIds;
+        printf("  %-20s %9.1f%% %8u %8u %9.1f %8.2f %8.2f%s\n", beaconScenes_[s].name,
+               100.0 * res.identified / res.beaconFrames, res.wrong, res.falseBeacons,
+               found ? (double)res.firstId / found : 0.0, res.totalUs / FRAMES, res.maxUs,
+               res.roundTripErrors || res.wrong || res.falseBeacons ? "  FAILED" : "");
+        failed += res.roundTripErrors + res.wrong + res.falseBeacons;
+    }
+    printf("  identified: beacon frames after %d with the right id, wrong: with another id,\n"
+           "  false: ids on glints, flicker or no beacon, first id: frames until a beacon is identified\n",
+           BEACON_WARMUP);
+    return failed ? 1 : 0;
+}
+
+typedef struct
+{
+    uint32_t ended;
+    uint32_t lifetime;
+    uint32_t shortLived;
+} Lifetimes;
+
+// Counts the tracks in prev that are not in live (id -> age) as ended.
+static void end_tracks(const std::map<uint16_t, uint16_t> &prev, const std::map<uint16_t, uint16_t> &live, Lifetimes *lt)
+{
+    std::map<uint16_t, uint16_t>::const_iterator it;
+
+    for (it = prev.begin(); it != prev.end(); it++)
+    {
+        if (live.find(it->first) != live.end())
+            continue;
+        lt->ended++;
+        lt->lifetime += it->second + 1;
+        if (it->second + 1 < SETTLE_FRAMES * 5)
+            lt->shortLived++;
+    }
+}
+
+// Runs the tracker on the blobs of a recorded session.  Without ground truth, how long
+// confirmed tracks live and how many there are tells how stable the IDs are.
+static int replay_file(const char *filename, bool verbose)
+{
+    static Tracker tracker;
+    static uint8_t buf[SD_FRAME_LEN];
+    const SdFrameHeader *header = (const SdFrameHeader *)buf;
+    std::map<uint16_t, uint16_t> live, prev;
+    Lifetimes lt;
+    const Track *tracks;
+    FILE *file = fopen(filename, "rb");
+    Result res;
+    uint16_t frameBlobs[SD_MAX_BLOBS*5];
+    uint32_t frames = 0, bad = 0, blobs = 0, started = 0, confirmed = 0;
+    uint32_t session = 0;
+    uint16_t i, n;
+
+    if (file == NULL)
+    {
+        printf("Can't open %s\n", filename);
+        return 1;
+    }
+    memset(&res, 0, sizeof(res));
+    memset(&lt, 0, sizeof(lt));
+    while (fread(buf, 1, SD_FRAME_LEN, file) == SD_FRAME_LEN)
+    {
+        // blank sectors pass the CRC too
+        if (crc8(buf, offsetof(SdFrameHeader, crc8)) != header->crc8 || header->blob_cnt > SD_MAX_BLOBS ||
+            (header->session_cnt == 0 && header->timestamp_us == 0))
+        {
+            bad++;
+            continue;
+        }
+        if (frames == 0 || header->session_cnt != session)
+        {
+            tracker.reset();
+            end_tracks(prev, std::map<uint16_t, uint16_t>(), &lt);
+            prev.clear();
+            session = header->session_cnt;
+        }
+        frames++;
+        blobs += header->blob_cnt;
+        memcpy(frameBlobs, buf + offsetof(SdFrameHeader, blobs), sizeof(frameBlobs));  // packed, maybe unaligned
+        timed_update(&tracker, frameBlobs, header->blob_cnt, header->timestamp_us, &res);
+
+        live.clear();
+        n = tracker.getTracks(&tracks);
+        for (i = 0; i < n; i++)
+        {
+            if (tracks[i].age == 0)
+                started++;
+            if (!tracker.confirmed(tracks + i))
+                continue;
+            if (prev.find(tracks[i].id) == prev.end())
+                confirmed++;
+            live[tracks[i].id] = tracks[i].age;
+        }
+        end_tracks(prev, live, &lt);
+        prev = live;
+
+        if (verbose)
+        {
+            printf("session %u frame %u: %u blobs, %u confirmed tracks\n", header->session_cnt, header->frame_cnt,
+                   header->blob_cnt, (unsigned)live.size());
+            for (i = 0; i < n; i++)
+            {
+                if (tracker.confirmed(tracks + i))
+                    printf("  id %u sig %u x %.1f y %.1f vx %d vy %d age %u%s\n", tracks[i].id, tracks[i].signature,
+                           tracks[i].x / 256.0, tracks[i].y / 256.0, tracks[i].vx >> TR_SHIFT, tracks[i].vy >> TR_SHIFT,
+                           tracks[i].age, tracks[i].misses ? " coasting" : "");
+            }
+        }
+    }
+    fclose(file);
+    end_tracks(prev, std::map<uint16_t, uint16_t>(), &lt);
+
+    if (frames == 0)
+    {
+        printf("No frames in %s (%u bad)\n", filename, bad);
+        return 1;
+    }
+    printf("%u frames (%u bad), %.2f blobs/frame, %u tracks started, %u confirmed\n", frames, bad,
+           (double)blobs / frames, started, confirmed);
+    printf("mean confirmed lifetime %.1f frames, %u lived under %d frames\n",
+           lt.ended ? (double)lt.lifetime / lt.ended : 0.0, lt.shortLived, SETTLE_FRAMES * 5);
+    printf("pairs %.1f/frame (max %u), mean us %.2f, max us %.2f\n", (double)res.pairs / frames, res.maxPairs,
+           res.totalUs / frames, res.maxUs);
+    return 0;
+}
+
+static void help(const char *progname)
+{
+    printf("Usage: %s [-f file] [-v] [-s seed]\n", progname);
+    printf("  -f  Replay a session recorded to the SD card instead of the synthetic scenes\n");
+    printf("  -v  Print the confirmed tracks of every replayed frame\n");
+    printf("  -s  Seed for the synthetic scenes (default: 1)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = NULL;
+    bool verbose = false;
+    int arg, failures = 0;
+
+    while ((arg = getopt(argc, argv, "f:vs:h")) != EOF)
+    {
+        switch (arg)
+        {
+            case 'f':
+                filename = optarg;
+                break;
+
+            case 'v':
+                verbose = true;
+                break;
+
+            case 's':
+                seed_ = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'h':
+            default:
+                help(argv[0]);
+                break;
+        }
+    }
+
+    if (filename)
+        return replay_file(filename, verbose);
+    failures += test_scenes();
+    failures += test_beacons();
+
+    printf("\n%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}